@@ -14,7 +14,7 @@
 
 #include <fstream>
 
-#include "client/kvs_client.hpp"
+#include "client/async_client.hpp"
 #include "yaml-cpp/yaml.h"
 
 #include <assert.h>
@@ -33,7 +33,63 @@ void print_set(set<string> set) {
   std::cout << "}" << std::endl;
 }
 
-void handle_request(KvsClientInterface *client, string input) {
+// runs one GET or PUT to completion and returns the answer for its key
+KeyTuple get(AsyncKvsClient *client, const Key &key) {
+  KeyTuple result;
+  client->get(key, [&result](const KeyTuple &tuple) { result = tuple; });
+  client->wait();
+  return result;
+}
+
+KeyTuple put(AsyncKvsClient *client, const Key &key, const string &payload,
+             LatticeType lattice_type) {
+  KeyTuple result;
+  client->put(key, payload, lattice_type,
+              [&result](const KeyTuple &tuple) { result = tuple; });
+  client->wait();
+  return result;
+}
+
+// lists every key that starts with prefix, a page at a time
+void scan(AsyncKvsClient *client, const string &prefix) {
+  Key start;
+  bool more = true;
+  AnnaError error = AnnaError::NO_ERROR;
+
+  while (more && error == AnnaError::NO_ERROR) {
+    vector<Key> keys;
+    client->scan(prefix, start, "", 0,
+                 [&](const vector<Key> &page, bool page_more,
+                     AnnaError page_error) {
+                   keys = page;
+                   more = page_more;
+                   error = page_error;
+                 });
+    client->wait();
+
+    for (const Key &key : keys) {
+      std::cout << key << std::endl;
+    }
+
+    if (!keys.empty()) {
+      start = keys.back();
+    }
+  }
+
+  if (error != AnnaError::NO_ERROR) {
+    std::cout << "Error: " << AnnaError_Name(error) << std::endl;
+  }
+}
+
+void print_put_result(const KeyTuple &tuple) {
+  if (tuple.error() == AnnaError::NO_ERROR) {
+    std::cout << "Success!" << std::endl;
+  } else {
+    std::cout << "Failure!" << std::endl;
+  }
+}
+
+void handle_request(AsyncKvsClient *client, string input) {
   vector<string> v;
   split(input, ' ', v);
 
@@ -42,40 +98,29 @@ void handle_request(KvsClientInterface *client, string input) {
   }
 
   if (v[0] == "GET") {
-    client->get_async(v[1]);
-
-    vector<KeyResponse> responses = client->receive_async();
-    while (responses.size() == 0) {
-      responses = client->receive_async();
-    }
-
-    if (responses.size() > 1) {
-      std::cout << "Error: received more than one response" << std::endl;
+    KeyTuple tuple = get(client, v[1]);
+    if (tuple.error() != AnnaError::NO_ERROR) {
+      std::cout << "Error: " << AnnaError_Name(tuple.error()) << std::endl;
+      return;
     }
 
-    assert(responses[0].tuples(0).lattice_type() == LatticeType::LWW);
+    assert(tuple.lattice_type() == LatticeType::LWW);
 
-    LWWPairLattice<string> lww_lattice =
-        deserialize_lww(responses[0].tuples(0).payload());
+    LWWPairLattice<string> lww_lattice = deserialize_lww(tuple.payload());
     std::cout << lww_lattice.reveal().value << std::endl;
   } else if (v[0] == "GET_CAUSAL") {
     // currently this mode is only for testing purpose
-    client->get_async(v[1]);
-
-    vector<KeyResponse> responses = client->receive_async();
-    while (responses.size() == 0) {
-      responses = client->receive_async();
-    }
-
-    if (responses.size() > 1) {
-      std::cout << "Error: received more than one response" << std::endl;
+    KeyTuple tuple = get(client, v[1]);
+    if (tuple.error() != AnnaError::NO_ERROR) {
+      std::cout << "Error: " << AnnaError_Name(tuple.error()) << std::endl;
+      return;
     }
 
-    assert(responses[0].tuples(0).lattice_type() == LatticeType::MULTI_CAUSAL);
+    assert(tuple.lattice_type() == LatticeType::MULTI_CAUSAL);
 
     MultiKeyCausalLattice<SetLattice<string>> mkcl =
         MultiKeyCausalLattice<SetLattice<string>>(to_multi_key_causal_payload(
-            deserialize_multi_key_causal(responses[0].tuples(0).payload())));
+            deserialize_multi_key_causal(tuple.payload())));
 
     for (const auto &pair : mkcl.reveal().vector_clock.reveal()) {
       std::cout << "{" << pair.first << " : "
@@ -97,23 +142,7 @@ void handle_request(KvsClientInterface *client, string input) {
     LWWPairLattice<string> val(
         TimestampValuePair<string>(generate_timestamp(0), v[2]));
 
-    string rid = client->put_async(key, serialize(val), LatticeType::LWW);
-    vector<KeyResponse> responses = client->receive_async();
-    while (responses.size() == 0) {
-      responses = client->receive_async();
-    }
-
-    KeyResponse response = responses[0];
-
-    if (response.response_id() != rid) {
-      std::cout << "Invalid response: ID did not match request ID!"
-                << std::endl;
-    }
-    if (response.error() == AnnaError::NO_ERROR) {
-      std::cout << "Success!" << std::endl;
-    } else {
-      std::cout << "Failure!" << std::endl;
-    }
+    print_put_result(put(client, key, serialize(val), LatticeType::LWW));
   } else if (v[0] == "PUT_CAUSAL") {
     // currently this mode is only for testing purpose
     Key key = v[1];
@@ -131,70 +160,36 @@ void handle_request(KvsClientInterface *client, string input) {
 
     MultiKeyCausalLattice<SetLattice<string>> mkcl(mkcp);
 
-    string rid =
-        client->put_async(key, serialize(mkcl), LatticeType::MULTI_CAUSAL);
-
-    vector<KeyResponse> responses = client->receive_async();
-    while (responses.size() == 0) {
-      responses = client->receive_async();
-    }
-
-    KeyResponse response = responses[0];
-
-    if (response.response_id() != rid) {
-      std::cout << "Invalid response: ID did not match request ID!"
-                << std::endl;
-    }
-    if (response.error() == AnnaError::NO_ERROR) {
-      std::cout << "Success!" << std::endl;
-    } else {
-      std::cout << "Failure!" << std::endl;
-    }
+    print_put_result(
+        put(client, key, serialize(mkcl), LatticeType::MULTI_CAUSAL));
   } else if (v[0] == "PUT_SET") {
     set<string> set;
     for (int i = 2; i < v.size(); i++) {
       set.insert(v[i]);
     }
 
-    string rid = client->put_async(v[1], serialize(SetLattice<string>(set)),
-                                   LatticeType::SET);
-
-    vector<KeyResponse> responses = client->receive_async();
-    while (responses.size() == 0) {
-      responses = client->receive_async();
-    }
-
-    KeyResponse response = responses[0];
-
-    if (response.response_id() != rid) {
-      std::cout << "Invalid response: ID did not match request ID!"
-                << std::endl;
-    }
-    if (response.error() == AnnaError::NO_ERROR) {
-      std::cout << "Success!" << std::endl;
-    } else {
-      std::cout << "Failure!" << std::endl;
-    }
+    print_put_result(put(client, v[1], serialize(SetLattice<string>(set)),
+                         LatticeType::SET));
   } else if (v[0] == "GET_SET") {
-    client->get_async(v[1]);
-    string serialized;
-
-    vector<KeyResponse> responses = client->receive_async();
-    while (responses.size() == 0) {
-      responses = client->receive_async();
+    KeyTuple tuple = get(client, v[1]);
+    if (tuple.error() != AnnaError::NO_ERROR) {
+      std::cout << "Error: " << AnnaError_Name(tuple.error()) << std::endl;
+      return;
     }
 
-    SetLattice<string> latt = deserialize_set(responses[0].tuples(0).payload());
+    SetLattice<string> latt = deserialize_set(tuple.payload());
     print_set(latt.reveal());
+  } else if (v[0] == "SCAN") {
+    scan(client, v.size() > 1 ? v[1] : "");
   } else {
     std::cout << "Unrecognized command " << v[0]
               << ". Valid commands are GET, GET_SET, PUT, PUT_SET, PUT_CAUSAL, "
-              << "and GET_CAUSAL." << std::endl;
+              << "GET_CAUSAL, and SCAN." << std::endl;
     ;
   }
 }
 
-void run(KvsClientInterface *client) {
+void run(AsyncKvsClient *client) {
   string input;
   while (true) {
     std::cout << "kvs> ";
@@ -204,7 +199,7 @@ void run(KvsClientInterface *client) {
   }
 }
 
-void run(KvsClientInterface *client, string filename) {
+void run(AsyncKvsClient *client, string filename) {
   string input;
   std::ifstream infile(filename);
 
@@ -246,7 +241,7 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  KvsClient client(threads, ip, 0, 10000);
+  AsyncKvsClient client(threads, ip, 0, 10000);
 
   if (argc == 2) {
     run(&client);
@@ -233,8 +233,7 @@ class BaseAnnaClient():
 
         return (req, tuples)
 
-    # Returns and increments a request ID. Loops back after 10,000 requests.
+    # Returns the next request ID. IDs never repeat, so the response to an
+    # old request is never taken for that of a newer one still in flight.
     def _get_request_id(self):
-        response = self.ut.get_ip() + ':' + str(self.rid)
-        self.rid = (self.rid + 1) % 10000
-        return response
+        return self.ut.get_ip() + ':' + str(next(self.rid))
@@ -12,8 +12,11 @@
 #  See the License for the specific language governing permissions and
 #  limitations under the License.
 
+import heapq
+import itertools
 import random
 import socket
+import time
 
 import zmq
 
@@ -22,19 +25,65 @@ from anna.anna_pb2 import (
     NO_ERROR,  # Anna's error modes
     KeyAddressRequest,
     KeyAddressResponse,
+    KeyRequest,
     KeyResponse
 )
 from anna.base_client import BaseAnnaClient
 from anna.common import UserThread
+from anna.futures import AnnaFuture
+from anna.lattices import LWWPairLattice
+from anna.metadata_pb2 import CachedKeys, RingSnapshot
+from anna.replica_selector import ReplicaSelector
+from anna.ring import (
+    METADATA_PREFIX,
+    RING_SNAPSHOT_BASE_PORT,
+    RING_UPDATE_BASE_PORT,
+    RingView
+)
+from anna.tracing import Tracer
+from anna.value_cache import ValueCache
 from anna.zmq_util import (
+    recv_keyed_responses,
     recv_response,
     send_request,
     SocketCache
 )
 
 
+# How long to wait for a routing thread to answer a ring snapshot request (in
+# milliseconds) before falling back to per-key routing queries, and how long
+# to keep using those before asking again (in seconds).
+RING_SNAPSHOT_TIMEOUT = 1000
+RING_SNAPSHOT_RETRY = 10
+
+# How often a client with a value cache tells the KVS which keys it holds, so
+# that servers push updates to those keys (in seconds).
+CACHE_REGISTRATION_INTERVAL = 1
+
+# The entry in a cache's registered keys that asks servers for invalidations
+# instead of new values; kCacheInvalidationsOnly in the KVS.
+CACHE_INVALIDATIONS_ONLY = 'ANNA_CACHE_INVALIDATIONS_ONLY'
+
+# The most changes to its cached keys a client registers before it registers
+# them in full again, along with the fraction of its keys they may add up to.
+MAX_CACHE_DELTAS = 16
+MAX_CACHE_DELTA_FRACTION = 0.5
+
+# The most keys that get_async and put_async buffer in one request before
+# sending it.
+MAX_REQUEST_TUPLES = 1000
+
+# The percentile of recent request latencies after which a client that hedges
+# its gets sends an unanswered GET to another replica as well.
+HEDGE_PERCENTILE = 0.95
+
+
 class AnnaTcpClient(BaseAnnaClient):
-    def __init__(self, elb_addr, ip, local=False, offset=0):
+    def __init__(self, elb_addr, ip, local=False, offset=0,
+                 ring_snapshot=False, value_cache_size=0,
+                 value_cache_staleness=1.0, cache_update_port=None,
+                 trace_fraction=0, hedge_gets=False,
+                 cache_invalidations_only=False):
         '''
         The AnnaTcpClientTcpAnnaClient allows you to interact with a local
         copy of Anna or with a remote cluster running on AWS.
@@ -48,6 +97,30 @@ class AnnaTcpClient(BaseAnnaClient):
         running in local mode, otherwise do not change
         offset: A port numbering offset, which is only needed if multiple
         clients are running on the same machine
+        ring_snapshot: If True, the client keeps a copy of the hash rings,
+        which one routing thread pushes to it, and computes key addresses on
+        its own instead of querying the routing tier on every cache miss
+        value_cache_size: If positive, the client caches up to this many
+        values it has read or written, and answers gets from the cache
+        value_cache_staleness: How long a cached value may be served after it
+        was last refreshed from the KVS (in seconds); None means until it is
+        evicted, which is only safe with cache_update_port set
+        cache_update_port: If set, the client registers its cached keys with
+        the KVS, as cache nodes do, and merges the updates that servers push
+        to this port into the cache; servers only push to clients that the
+        management node lists, so this has no effect in local mode
+        cache_invalidations_only: If True, servers push only invalidations
+        for the registered keys, which drop them from the value cache, rather
+        than their new values
+        trace_fraction: The fraction of requests to trace; the routing tier
+        and the KVS write their spans of traced requests to their span logs
+        if tracing is enabled in their conf, and the client keeps its own
+        spans in self.tracer.spans
+        hedge_gets: If True, the keys of a GET that has gone unanswered for
+        longer than HEDGE_PERCENTILE of recent requests took are sent to
+        another of their replicas as well; the first answer for a key is its
+        result, and a later one that arrives before the result is read is
+        merged into it. Only keys with more than one replica are hedged.
         '''
 
         self.elb_addr = elb_addr
@@ -74,52 +147,118 @@ class AnnaTcpClient(BaseAnnaClient):
         self.key_address_puller = self.context.socket(zmq.PULL)
         self.key_address_puller.bind(self.ut.get_key_address_bind_addr())
 
-        self.rid = 0
+        self.tracer = Tracer(trace_fraction, self.ut.get_ip())
+
+        self.rid = itertools.count()
+
+        # (worker address, request type) -> the request being buffered for
+        # it, and request ID -> [the number of its tuples not yet answered,
+        # the futures waiting on them, its Span if it is traced, the worker
+        # address it was sent to]
+        self._outbox = {}
+        self._inflight = {}
+        self._selector = ReplicaSelector()
+
+        # request ID -> (the GET, the worker address it was sent to) for the
+        # requests that may be hedged, and a heap of (the time to hedge it,
+        # request ID); IDs that have left the map are skipped
+        self.hedge_gets = hedge_gets
+        self._hedges = {}
+        self._hedge_times = []
+
+        # the keys that have been hedged
+        self.hedged_keys = 0
+
+        self.ring = None
+        self.ring_stale = False
+        self.ring_retry = 0
+        self.ring_subscriber = None
+        if ring_snapshot:
+            # the snapshot and its updates must come from the same routing
+            # thread, since versions are only ordered within one thread
+            ring_tid = random.choice(self.elb_ports) - self.elb_ports[0]
+            routing_base = 'tcp://' + self.elb_addr + ':'
+
+            self.ring_snapshot_addr = routing_base + str(
+                ring_tid + RING_SNAPSHOT_BASE_PORT)
+
+            # subscribe before asking for the snapshot, so no update falls in
+            # between
+            self.ring_subscriber = self.context.socket(zmq.SUB)
+            self.ring_subscriber.setsockopt(zmq.SUBSCRIBE, b'')
+            self.ring_subscriber.connect(routing_base + str(
+                ring_tid + RING_UPDATE_BASE_PORT))
+
+            self._refresh_ring()
+
+        self.value_cache = None
+        self.cache_update_puller = None
+        if value_cache_size > 0:
+            self.value_cache = ValueCache(value_cache_size,
+                                          value_cache_staleness)
+
+            if cache_update_port is not None:
+                self.cache_update_puller = self.context.socket(zmq.PULL)
+                self.cache_update_puller.bind('tcp://*:' +
+                                              str(cache_update_port))
+                self.registered_keys = set()
+
+                # the version of the registered keys, and the registration
+                # itself: the keys as of one version and the changes since,
+                # so that servers only apply what they have not seen
+                self.cache_version = 0
+                self.cache_registration = CachedKeys()
+                self.registration_sent = True
+                self.cache_invalidations_only = cache_invalidations_only
+                self.registration_time = 0
 
     def get(self, keys):
+        return self.get_async(keys).result()
+
+    def get_async(self, keys, flush=True):
+        '''
+        Starts reading keys and returns an AnnaFuture for their values,
+        without waiting for the KVS. Keys bound for the same worker share
+        one request; unless flush is True, the requests stay buffered until
+        flush() is called, a request grows to MAX_REQUEST_TUPLES keys, or
+        a result is asked for.
+        '''
         if type(keys) != list:
             keys = [keys]
 
-        worker_addresses = {}
-        for key in keys:
-            worker_addresses[key] = (self._get_worker_address(key))
-
-        # Initialize all KV pairs to 0. Only change a value if we get a valid
-        # response from the server.
-        kv_pairs = {}
-        for key in keys:
-            kv_pairs[key] = None
-
-        request_ids = []
-        for key in worker_addresses:
-            if worker_addresses[key]:
-                send_sock = self.pusher_cache.get(worker_addresses[key])
+        future = AnnaFuture(self, GET, keys)
 
-                req, _ = self._prepare_data_request([key])
-                req.type = GET
+        if self.value_cache is not None:
+            self._apply_cache_updates()
 
-                send_request(req, send_sock)
-                request_ids.append(req.request_id)
+            missing = []
+            for key in keys:
+                value = self.value_cache.get(key)
+                if value is None:
+                    missing.append(key)
+                else:
+                    future._resolve(key, value)
 
-        # Wait for all responses to return.
-        responses = recv_response(request_ids, self.response_puller,
-                                  KeyResponse)
+            keys = missing
 
-        for response in responses:
-            for tup in response.tuples:
-                if tup.invalidate:
-                    self._invalidate_cache(tup.key)
+        worker_addresses = self._get_worker_addresses(keys)
+        for key in keys:
+            if worker_addresses[key]:
+                self._enqueue(worker_addresses[key], GET, key, future)
 
-                if tup.error == NO_ERROR:
-                    kv_pairs[tup.key] = self._deserialize(tup)
+        if flush:
+            self.flush()
 
-        return kv_pairs
+        return future
 
     def get_all(self, keys):
         if type(keys) != list:
             keys = [keys]
             raise ValueError('`get_all` currently only supports single key'
                              + ' GETs.')
+
+        self._drain()
+
         worker_addresses = {}
         for key in keys:
             worker_addresses[key] = self._get_worker_address(key, False)
@@ -162,49 +301,50 @@ class AnnaTcpClient(BaseAnnaClient):
         return kv_pairs
 
     def put(self, keys, values):
-        request_ids = []
-
         if type(keys) != list:
             keys = [keys]
-        if type(values) != list:
-            values = [values]
 
-        for key, value in zip(keys, values):
-            worker_address = self._get_worker_address(key)
+        worker_addresses = self._get_worker_addresses(keys)
 
-            if not worker_address:
+        for key in keys:
+            if not worker_addresses[key]:
                 return False
 
-            send_sock = self.pusher_cache.get(worker_address)
-
-            # We pass in a list because the data request preparation can prepare
-            # multiple tuples
-            req, tup = self._prepare_data_request([key])
-            req.type = PUT
-            request_ids.append(req.request_id)
+        return self.put_async(keys, values).result()
 
-            # PUT only supports one key operations, we only ever have to look at
-            # the first KeyTuple returned.
-            tup = tup[0]
-            tup.payload, tup.lattice_type = self._serialize(value)
+    def put_async(self, keys, values, flush=True):
+        '''
+        Starts writing values to keys and returns an AnnaFuture for whether
+        each key was written; requests are batched as in get_async. Keys
+        whose workers cannot be found are reported as not written.
+        '''
+        if type(keys) != list:
+            keys = [keys]
+        if type(values) != list:
+            values = [values]
 
-            send_request(req, send_sock)
+        future = AnnaFuture(self, PUT, keys, values)
 
-        responses = recv_response(request_ids, self.response_puller,
-                                 KeyResponse)
+        worker_addresses = self._get_worker_addresses(keys)
+        for key, value in zip(keys, values):
+            if worker_addresses[key]:
+                self._enqueue(worker_addresses[key], PUT, key, future, value)
 
-        results = {}
-        for response in responses:
-            tup = response.tuples[0]
+        if flush:
+            self.flush()
 
-            if tup.invalidate:
-                self._invalidate_cache(tup.key)
+        return future
 
-            results[tup.key] = (tup.error == NO_ERROR)
+    # Sends every request that get_async and put_async have buffered.
+    def flush(self):
+        for (address, _), req in self._outbox.items():
+            self._send_data_request(req, address)
 
-        return results
+        self._outbox = {}
 
     def put_all(self, key, value):
+        self._drain()
+
         worker_addresses = self._get_worker_address(key, False)
 
         if not worker_addresses:
@@ -238,55 +378,423 @@ class AnnaTcpClient(BaseAnnaClient):
 
         return True
 
+    # Adds key to the buffered request of type req_type for address, which
+    # is created if there is none, and makes future wait for its answer; a
+    # request that reaches MAX_REQUEST_TUPLES keys is sent right away.
+    def _enqueue(self, address, req_type, key, future, value=None):
+        slot = (address, req_type)
+
+        if slot not in self._outbox:
+            req = KeyRequest()
+            req.request_id = self._get_request_id()
+            req.response_address = self.response_address
+            req.type = req_type
+
+            self._outbox[slot] = req
+            self._inflight[req.request_id] = [
+                0, [], self.tracer.sample('client.request'), address]
+
+        req = self._outbox[slot]
+
+        tup = req.tuples.add()
+        tup.key = key
+        if key in self.address_cache:
+            tup.address_cache_size = len(self.address_cache[key])
+
+        if value is not None:
+            tup.payload, tup.lattice_type = self._serialize(value)
+
+        inflight = self._inflight[req.request_id]
+        inflight[0] += 1
+        if future not in inflight[1]:
+            inflight[1].append(future)
+        future._expect(key)
+
+        if len(req.tuples) >= MAX_REQUEST_TUPLES:
+            self._send_data_request(req, address)
+            del self._outbox[slot]
+
+    # Sends a request buffered by _enqueue, with its trace context in front if
+    # it is traced, and schedules a hedge for it if it is a GET that may be
+    # hedged.
+    def _send_data_request(self, req, address, hedge=True):
+        span = self._inflight[req.request_id][2]
+        trace = None
+
+        if span is not None:
+            span.tags['request.type'] = 'GET' if req.type == GET else 'PUT'
+            span.tags['request.tuples'] = str(len(req.tuples))
+            trace = span.context()
+
+        self._selector.sent(address, req.request_id)
+        send_request(req, self.pusher_cache.get(address), trace)
+
+        if hedge and self.hedge_gets and req.type == GET:
+            delay = self._selector.percentile(HEDGE_PERCENTILE)
+            if delay is not None:
+                self._hedges[req.request_id] = (req, address)
+                heapq.heappush(self._hedge_times,
+                               (time.time() + delay, req.request_id))
+
+    # Waits up to timeout seconds (forever if None) for responses, and hands
+    # every response tuple that has arrived to the first future waiting on
+    # its key in that request. Responses to unknown requests are dropped.
+    def _pump(self, timeout=None):
+        while len(self._hedge_times) > 0 and \
+                self._hedge_times[0][1] not in self._hedges:
+            heapq.heappop(self._hedge_times)
+
+        if len(self._hedge_times) > 0:
+            wait = max(self._hedge_times[0][0] - time.time(), 0)
+            if timeout is None or wait < timeout:
+                timeout = wait
+
+        if timeout is not None:
+            timeout = int(timeout * 1000)
+
+        if self.response_puller.poll(timeout) == 0:
+            self._send_hedges()
+            return
+
+        while True:
+            try:
+                message = self.response_puller.recv(zmq.NOBLOCK)
+            except zmq.ZMQError:
+                break
+
+            response = KeyResponse()
+            response.ParseFromString(message)
+            self._selector.answered(response.response_id)
+
+            inflight = self._inflight.get(response.response_id)
+            if inflight is None:
+                continue
+
+            for tup in response.tuples:
+                for future in inflight[1]:
+                    if future._accept(tup, inflight[3]):
+                        inflight[0] -= 1
+                        break
+
+            if inflight[0] <= 0:
+                if inflight[2] is not None:
+                    self.tracer.finish(inflight[2])
+
+                del self._inflight[response.response_id]
+                self._hedges.pop(response.response_id, None)
+
+        self._send_hedges()
+
+    # Sends the keys of every GET whose hedge is due, and that is still
+    # waiting on them, to another of their replicas; the keys hedged to the
+    # same replica share a request, which is not hedged again.
+    def _send_hedges(self):
+        now = time.time()
+        targets = {}
+
+        while len(self._hedge_times) > 0 and self._hedge_times[0][0] <= now:
+            _, request_id = heapq.heappop(self._hedge_times)
+            hedge = self._hedges.pop(request_id, None)
+            inflight = self._inflight.get(request_id)
+            if hedge is None or inflight is None:
+                continue
+
+            req, address = hedge
+            for tup in req.tuples:
+                others = [other for other in
+                          self.address_cache.get(tup.key, [])
+                          if other != address]
+                if len(others) == 0:
+                    continue
+
+                for future in inflight[1]:
+                    if future._hedge(tup.key):
+                        target = self._selector.choose(others)
+                        targets.setdefault(target, []).append(
+                            (tup.key, future))
+                        break
+
+        for address, keys in targets.items():
+            req = KeyRequest()
+            req.request_id = self._get_request_id()
+            req.response_address = self.response_address
+            req.type = GET
+
+            futures = []
+            for key, future in keys:
+                req.tuples.add().key = key
+                if future not in futures:
+                    futures.append(future)
+
+            self._inflight[req.request_id] = [len(keys), futures, None,
+                                              address]
+            self._send_data_request(req, address, False)
+            self.hedged_keys += len(keys)
+
+    # Sends key for future again after the thread at address answered that it
+    # was overloaded, to another of the key's replicas if there is one;
+    # returns False if the key has no known replica.
+    def _retry(self, future, key, address):
+        addresses = self.address_cache.get(key, [])
+        others = [other for other in addresses if other != address]
+        if len(others) > 0:
+            addresses = others
+
+        if len(addresses) == 0:
+            return False
+
+        self._enqueue(self._selector.choose(addresses), future.req_type, key,
+                      future, future._values.get(key))
+        self.flush()
+        return True
+
+    # Waits for every in-flight future, so that the blocking calls that read
+    # the response socket directly do not drop their responses.
+    def _drain(self):
+        self.flush()
+
+        while len(self._inflight) > 0:
+            self._pump()
+
     # Returns the worker address for a particular key. If worker addresses for
     # that key are not cached locally, a query is synchronously issued to the
     # routing tier, and the address cache is updated.
     def _get_worker_address(self, key, pick=True):
-        if key not in self.address_cache or len(self.address_cache[key]) == 0:
+        return self._get_worker_addresses([key], pick)[key]
+
+    # Returns a map from each key to its worker address (or to all of its
+    # addresses if pick is False). The keys that are not cached locally are
+    # looked up in a single query to the routing tier.
+    def _get_worker_addresses(self, keys, pick=True):
+        missing = [key for key in keys if key not in self.address_cache or
+                   len(self.address_cache[key]) == 0]
+
+        if len(missing) > 0 and self.ring_subscriber is not None:
+            self._apply_ring_updates()
+
+            if self.ring is not None:
+                unresolved = []
+                for key in missing:
+                    addresses = self.ring.addresses(key)
+                    if addresses:
+                        self.address_cache[key] = addresses
+                    else:
+                        unresolved.append(key)
+
+                missing = unresolved
+
+        if len(missing) > 0:
             port = random.choice(self.elb_ports)
-            addresses = self._query_routing(key, port)
-            self.address_cache[key] = addresses
+            self.address_cache.update(self._query_routing(missing, port))
 
-        if len(self.address_cache[key]) == 0:
-            return None
+        result = {}
+        for key in keys:
+            addresses = self.address_cache.get(key, [])
 
-        if pick:
-            return random.choice(self.address_cache[key])
-        else:
-            return self.address_cache[key]
+            if len(addresses) == 0:
+                result[key] = None
+            elif pick:
+                result[key] = self._selector.choose(addresses)
+            else:
+                result[key] = addresses
+
+        return result
+
+    # Merges the updates that servers have pushed since the last call into the
+    # value cache, and re-registers the cached keys if they have changed.
+    def _apply_cache_updates(self):
+        if self.cache_update_puller is None:
+            return
+
+        while True:
+            try:
+                message = self.cache_update_puller.recv(zmq.NOBLOCK)
+            except zmq.ZMQError:
+                break
+
+            update = KeyRequest()
+            update.ParseFromString(message)
+
+            for tup in update.tuples:
+                if tup.invalidate:
+                    self.value_cache.invalidate(tup.key)
+
+                # keys that have been evicted since are not brought back
+                elif tup.key in self.value_cache:
+                    self.value_cache.refresh(tup.key, self._deserialize(tup))
+
+        cached = set(self.value_cache.keys())
+        if (cached != self.registered_keys or
+                not self.registration_sent) and \
+                time.time() - self.registration_time >= \
+                CACHE_REGISTRATION_INTERVAL:
+            self._register_cached_keys(cached)
+
+    # Stores the set of cached keys under this client's cache IP metadata key,
+    # which is where servers look up the keys a cache holds, as the changes
+    # since the last full list. The response is not waited for; a lost
+    # registration is repeated at the next interval, and servers that missed
+    # one catch up from the changes the next one still carries.
+    def _register_cached_keys(self, keys):
+        if keys != self.registered_keys:
+            self._add_cache_delta(keys)
+
+        self.registration_time = time.time()
+        self.registration_sent = False
+
+        # the metadata key that get_user_metadata_key builds for cache_ip
+        metadata_key = METADATA_PREFIX + self.ut.get_ip() + '|cache_ip'
+        address = self._get_worker_address(metadata_key)
+        if not address:
+            return
+
+        timestamp = int(time.time() * 1000000)
+        value = LWWPairLattice(timestamp,
+                               self.cache_registration.SerializeToString())
+
+        req, tuples = self._prepare_data_request([metadata_key])
+        req.type = PUT
+        tuples[0].payload, tuples[0].lattice_type = self._serialize(value)
+        send_request(req, self.pusher_cache.get(address))
+
+        self.registration_sent = True
+
+    # Adds the change from the registered keys to keys to the registration,
+    # which goes back to a full list once the changes add up to enough.
+    def _add_cache_delta(self, keys):
+        listed = set(keys)
+        if self.cache_invalidations_only:
+            listed.add(CACHE_INVALIDATIONS_ONLY)
+
+        registered = set(self.registered_keys)
+        if self.cache_invalidations_only and self.cache_version > 0:
+            registered.add(CACHE_INVALIDATIONS_ONLY)
+
+        self.cache_version += 1
+        registration = self.cache_registration
+
+        delta = registration.deltas.add()
+        delta.version = self.cache_version
+        delta.added.extend(sorted(listed - registered))
+        delta.removed.extend(sorted(registered - listed))
+
+        changed = sum(len(d.added) + len(d.removed)
+                      for d in registration.deltas)
+        if len(registration.deltas) > MAX_CACHE_DELTAS or \
+                changed > MAX_CACHE_DELTA_FRACTION * len(listed):
+            registration.Clear()
+            registration.keys.extend(sorted(listed))
+            registration.snapshot_version = self.cache_version
+
+        self.registered_keys = keys
 
     # Invalidates the address cache for a particular key when the server tells
     # the client that its cache is out of date.
     def _invalidate_cache(self, key):
-        del self.address_cache[key]
+        if key in self.address_cache:
+            del self.address_cache[key]
+
+        # the server disagrees with our view, so it may have missed an update
+        self.ring_stale = True
+
+    # Applies the ring updates published since the last call, and fetches a
+    # new snapshot if one was missed or a server reported a stale address.
+    def _apply_ring_updates(self):
+        while True:
+            try:
+                message = self.ring_subscriber.recv(zmq.NOBLOCK)
+            except zmq.ZMQError:
+                break
+
+            update = RingSnapshot()
+            update.ParseFromString(message)
+
+            if self.ring is None:
+                if not update.delta:
+                    self.ring = RingView(update)
+                    self.address_cache = {}
+                continue
+
+            changed = self.ring.apply(update)
+            if changed is False:
+                self.ring_stale = True
+            elif changed is None:
+                self.address_cache = {}
+            else:
+                for key in changed:
+                    self.address_cache.pop(key, None)
+
+        if ((self.ring is None or self.ring_stale) and
+                time.time() >= self.ring_retry):
+            self._refresh_ring()
+
+    # Asks the routing thread for a full snapshot unless ours is current; on
+    # a timeout, the client keeps routing through the routing tier.
+    def _refresh_ring(self):
+        sock = self.context.socket(zmq.REQ)
+        sock.setsockopt(zmq.LINGER, 0)
+        sock.connect(self.ring_snapshot_addr)
+
+        version = ''
+        if self.ring is not None and not self.ring_stale:
+            version = str(self.ring.version)
+
+        sock.send_string(version)
+
+        if sock.poll(RING_SNAPSHOT_TIMEOUT) & zmq.POLLIN:
+            snapshot = RingSnapshot()
+            snapshot.ParseFromString(sock.recv())
+
+            if not snapshot.delta:
+                self.ring = RingView(snapshot)
+                self.address_cache = {}
+
+            self.ring_stale = False
+        else:
+            self.ring_retry = time.time() + RING_SNAPSHOT_RETRY
 
-    # Issues a synchronous query to the routing tier. Takes in a key and a
-    # (randomly chosen) routing port to issue the request to. Returns a list of
-    # addresses that the routing tier returned that correspond to the input
-    # key.
-    def _query_routing(self, key, port):
+        sock.close()
+
+    # Issues a synchronous query to the routing tier. Takes in a list of keys
+    # and a (randomly chosen) routing port to issue the request to. Returns a
+    # map from each key to the list of addresses that the routing tier
+    # returned for it.
+    def _query_routing(self, keys, port):
         key_request = KeyAddressRequest()
 
         key_request.response_address = self.ut.get_key_address_connect_addr()
-        key_request.keys.append(key)
+        key_request.keys.extend(keys)
         key_request.request_id = self._get_request_id()
 
         dst_addr = 'tcp://' + self.elb_addr + ':' + str(port)
         send_sock = self.pusher_cache.get(dst_addr)
 
-        send_request(key_request, send_sock)
-        response = recv_response([key_request.request_id],
-                                 self.key_address_puller,
-                                 KeyAddressResponse)[0]
+        span = self.tracer.sample('client.route')
+        trace = None
+        if span is not None:
+            span.tags['request.keys'] = str(len(keys))
+            trace = span.context()
+
+        send_request(key_request, send_sock, trace)
+        responses = recv_keyed_responses([key_request.request_id], keys,
+                                         self.key_address_puller,
+                                         KeyAddressResponse,
+                                         lambda resp: resp.addresses)
+
+        if span is not None:
+            self.tracer.finish(span)
 
-        if response.error != 0:
-            return []
+        result = {}
+        for key in keys:
+            result[key] = []
+
+        for response in responses:
+            if response.error != 0:
+                continue
 
-        result = []
-        for t in response.addresses:
-            if t.key == key:
-                for a in t.ips:
-                    result.append(a)
+            for t in response.addresses:
+                if t.key in result:
+                    result[t.key].extend(t.ips)
 
         return result
 
@@ -0,0 +1,167 @@
+#  Copyright 2019 U.C. Berkeley RISE Lab
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+import time
+
+from anna.anna_pb2 import (
+    GET,  # Anna's request types
+    NO_ERROR,  # Anna's error modes
+    TIMEOUT
+)
+
+# The error an overloaded server thread answers with, and how many times a
+# key is sent to another replica after one does before it is given up on.
+OVERLOADED = TIMEOUT
+MAX_OVERLOAD_RETRIES = 2
+
+
+class AnnaFuture():
+    '''
+    The eventual result of a get_async or put_async call: a map from each key
+    to its value (for GETs, None if the key could not be read) or to whether
+    it was written (for PUTs). The client hands every response tuple to the
+    futures waiting on its request, so any number of futures can be in flight
+    at once, and their keys can share requests.
+    '''
+
+    def __init__(self, client, req_type, keys, values=None):
+        self._client = client
+        self.req_type = req_type
+
+        self._results = {}
+        for key in keys:
+            self._results[key] = None if req_type == GET else False
+
+        # the values being written, so that they can go into the value cache
+        # once the KVS has acknowledged them
+        self._values = {}
+        if values is not None:
+            self._values = dict(zip(keys, values))
+
+        # key -> the number of tuples for it that have not been answered
+        self._pending = {}
+
+        # key -> the times it has been sent again after an overloaded thread
+        # turned it away
+        self._retries = {}
+
+        # key -> the hedged tuples for it that are still out beyond the ones
+        # in _pending; whichever tuple for a key comes first answers it
+        self._hedged = {}
+
+    def done(self):
+        return len(self._pending) == 0
+
+    # Blocks until every key has been answered, or raises TimeoutError after
+    # timeout seconds. Requests that are still buffered in the client are
+    # sent first.
+    def result(self, timeout=None):
+        if timeout is not None:
+            deadline = time.time() + timeout
+
+        if not self.done():
+            self._client.flush()
+
+        while not self.done():
+            remaining = None
+            if timeout is not None:
+                remaining = deadline - time.time()
+                if remaining <= 0:
+                    raise TimeoutError('Timed out waiting for a response.')
+
+            self._client._pump(remaining)
+
+        return self._results
+
+    def _expect(self, key):
+        self._pending[key] = self._pending.get(key, 0) + 1
+
+    def _resolve(self, key, value):
+        self._results[key] = value
+
+    # Records that key is being sent to another replica as well, and returns
+    # False if it has been answered or hedged already.
+    def _hedge(self, key):
+        if key not in self._pending or key in self._hedged:
+            return False
+
+        self._hedged[key] = 1
+        return True
+
+    # Merges the value in tup, a hedged tuple for a key that has been answered
+    # already, into the key's result if the result has not been read yet (and
+    # into the value cache either way).
+    def _accept_late(self, tup):
+        if self._hedged[tup.key] == 1:
+            del self._hedged[tup.key]
+        else:
+            self._hedged[tup.key] -= 1
+
+        if tup.error != NO_ERROR:
+            return
+
+        client = self._client
+        value = client._deserialize(tup)
+
+        if client.value_cache is not None:
+            client.value_cache.refresh(tup.key, value)
+
+        if not self.done():
+            current = self._results[tup.key]
+            if type(current) == type(value):
+                value = current.merge(value)
+
+            self._results[tup.key] = value
+
+    # Records the answer in response tuple tup, which the thread at address
+    # sent, and returns False if this future is not waiting on tup's key. A
+    # key that an overloaded thread turned away is sent to another replica.
+    def _accept(self, tup, address=None):
+        count = self._pending.get(tup.key, 0)
+        if count == 0:
+            if tup.key not in self._hedged:
+                return False
+
+            self._accept_late(tup)
+            return True
+
+        if count == 1:
+            del self._pending[tup.key]
+        else:
+            self._pending[tup.key] = count - 1
+
+        client = self._client
+        if tup.invalidate:
+            client._invalidate_cache(tup.key)
+
+        retries = self._retries.get(tup.key, 0)
+        if tup.error == OVERLOADED and retries < MAX_OVERLOAD_RETRIES:
+            self._retries[tup.key] = retries + 1
+            if client._retry(self, tup.key, address):
+                return True
+
+        if self.req_type == GET:
+            if tup.error == NO_ERROR:
+                value = client._deserialize(tup)
+                self._results[tup.key] = value
+
+                if client.value_cache is not None:
+                    client.value_cache.refresh(tup.key, value)
+        else:
+            self._results[tup.key] = (tup.error == NO_ERROR)
+
+            if self._results[tup.key] and client.value_cache is not None:
+                client.value_cache.write(tup.key, self._values[tup.key])
+
+        return True
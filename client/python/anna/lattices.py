@@ -125,10 +125,10 @@ class SetLattice(Lattice):
         new_set = set()
 
         for v in other.val:
-            new_set.insert(v)
+            new_set.add(v)
 
         for v in self.val:
-            new_set.insert(v)
+            new_set.add(v)
 
         return SetLattice(new_set)
 
@@ -0,0 +1,156 @@
+#  Copyright 2019 U.C. Berkeley RISE Lab
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+from collections import deque
+import random
+import time
+
+# The weight of a new sample in a replica's average latency.
+LATENCY_WEIGHT = 0.2
+
+# How long a request may go unanswered (in seconds) before it no longer counts
+# as outstanding; it then counts as a sample of this latency instead.
+REQUEST_TIMEOUT = 10
+
+# How many of the latest round trips the latency percentiles are taken over,
+# how many there must be before there are any, and how many new ones it takes
+# before they are sorted again.
+LATENCY_WINDOW = 1000
+MIN_LATENCY_SAMPLES = 20
+LATENCY_RESORT = 50
+
+
+class ReplicaSelector():
+    '''
+    Picks which of a key's replicas a request goes to, by the power of two
+    choices: of two replicas drawn at random, the one with the lower expected
+    wait, its average latency times one more than its outstanding requests.
+    Latencies are exponentially weighted averages of the round trips of the
+    requests that were answered, and a replica with no samples yet is taken
+    to have the average latency of all of them. This is the client's side of
+    the servers' ReplicaSelector.
+    '''
+
+    def __init__(self):
+        # address -> [average latency or None, outstanding requests]
+        self._replicas = {}
+
+        # the average latency over every replica, until the first sample
+        self._prior = None
+
+        # request ID -> (address, time sent), and the IDs oldest first
+        self._requests = {}
+        self._order = deque()
+
+        # the latest round trips of answered requests, to any replica
+        self._window = deque(maxlen=LATENCY_WINDOW)
+
+        # the window as of its last sort, and the samples taken since
+        self._sorted = []
+        self._unsorted = 0
+
+    def score(self, address):
+        prior = 1 if self._prior is None else self._prior
+        replica = self._replicas.get(address)
+        if replica is None:
+            return prior
+
+        latency = prior if replica[0] is None else replica[0]
+        return latency * (replica[1] + 1)
+
+    def choose(self, addresses):
+        '''
+        Returns the chosen one of addresses, which must not be empty.
+        '''
+        if len(addresses) == 1:
+            return addresses[0]
+
+        first, second = random.sample(addresses, 2)
+        return second if self.score(second) < self.score(first) else first
+
+    def sent(self, address, request_id):
+        '''
+        Records that the request with ID request_id went to address.
+        '''
+        now = time.time()
+        self._expire(now)
+
+        if request_id in self._requests:
+            return
+
+        self._requests[request_id] = (address, now)
+        self._order.append((now, request_id))
+        self._replicas.setdefault(address, [None, 0])[1] += 1
+
+    def answered(self, request_id):
+        '''
+        Records the response to the request with ID request_id, if it was sent.
+        '''
+        self._finish(request_id, time.time(), True)
+
+    def outstanding(self, address):
+        return self._replicas.get(address, [None, 0])[1]
+
+    def latency(self, address):
+        '''
+        Returns the average latency of address in seconds, or None if it has no
+        samples.
+        '''
+        return self._replicas.get(address, [None, 0])[0]
+
+    def percentile(self, fraction):
+        '''
+        Returns the latency (in seconds) that fraction of the latest answered
+        requests took at most, or None if there are too few of them.
+        '''
+        if len(self._window) < MIN_LATENCY_SAMPLES:
+            return None
+
+        if len(self._sorted) < MIN_LATENCY_SAMPLES or \
+                self._unsorted >= LATENCY_RESORT:
+            self._sorted = sorted(self._window)
+            self._unsorted = 0
+
+        latencies = self._sorted
+        index = min(int(fraction * len(latencies)), len(latencies) - 1)
+        return latencies[index]
+
+    def _average(self, current, latency):
+        if current is None:
+            return latency
+
+        return (1 - LATENCY_WEIGHT) * current + LATENCY_WEIGHT * latency
+
+    def _finish(self, request_id, now, answered=False):
+        request = self._requests.pop(request_id, None)
+        if request is None:
+            return
+
+        address, sent = request
+        replica = self._replicas[address]
+        replica[1] -= 1
+
+        latency = max(now - sent, 1e-6)
+        replica[0] = self._average(replica[0], latency)
+        self._prior = self._average(self._prior, latency)
+
+        if answered:
+            self._window.append(latency)
+            self._unsorted += 1
+
+    def _expire(self, now):
+        while len(self._order) > 0 and \
+                now - self._order[0][0] >= REQUEST_TIMEOUT:
+            sent, request_id = self._order.popleft()
+            self._finish(request_id, sent + REQUEST_TIMEOUT)
@@ -0,0 +1,369 @@
+#  Copyright 2019 U.C. Berkeley RISE Lab
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+import bisect
+
+from anna.metadata_pb2 import (
+    MEMORY, DISK,  # Anna's storage tiers
+    RingSnapshot
+)
+
+# The port on which routing threads answer ring snapshot requests and the one
+# on which they publish snapshot updates; both are offset by the thread ID.
+RING_SNAPSHOT_BASE_PORT = 6950
+RING_UPDATE_BASE_PORT = 6980
+
+# The port on which KVS worker threads listen for requests, offset by the
+# thread ID.
+KEY_REQUEST_BASE_PORT = 6200
+
+# Metadata keys start with kMetadataIdentifier and a delimiter; they are placed
+# differently from data keys, so only the routing tier resolves them.
+METADATA_PREFIX = 'ANNA_METADATA|'
+
+# The tiers in the order in which the routing tier tries them.
+ALL_TIERS = [MEMORY, DISK]
+
+# Local ring positions are drawn with a different seed than global ones; this
+# must match kLocalHashSalt in hashers.hpp.
+LOCAL_HASH_SALT = 0x9E3779B97F4A7C15
+
+# These must match kOwnershipTableDepth and kLoadArcShift in hash_ring.hpp.
+OWNERSHIP_TABLE_DEPTH = 4
+LOAD_ARC_SHIFT = 16
+
+_MASK = 0xFFFFFFFFFFFFFFFF
+_PRIME1 = 11400714785074694791
+_PRIME2 = 14029467366897019727
+_PRIME3 = 1609587929392839161
+_PRIME4 = 9650029242287828579
+_PRIME5 = 2870177450012600261
+
+
+def _rotl(x, r):
+    return ((x << r) | (x >> (64 - r))) & _MASK
+
+
+def _mix_round(acc, value):
+    acc = (acc + value * _PRIME2) & _MASK
+    return (_rotl(acc, 31) * _PRIME1) & _MASK
+
+
+def _merge_round(acc, value):
+    acc ^= _mix_round(0, value)
+    return (acc * _PRIME1 + _PRIME4) & _MASK
+
+
+def hash64(data, seed):
+    '''
+    XXH64 of the bytes in data, the same as hash64 in hashers.hpp.
+    '''
+    length = len(data)
+    p = 0
+
+    if length >= 32:
+        v1 = (seed + _PRIME1 + _PRIME2) & _MASK
+        v2 = (seed + _PRIME2) & _MASK
+        v3 = seed
+        v4 = (seed - _PRIME1) & _MASK
+
+        while p + 32 <= length:
+            v1 = _mix_round(v1, int.from_bytes(data[p:p + 8], 'little'))
+            v2 = _mix_round(v2, int.from_bytes(data[p + 8:p + 16], 'little'))
+            v3 = _mix_round(v3, int.from_bytes(data[p + 16:p + 24], 'little'))
+            v4 = _mix_round(v4, int.from_bytes(data[p + 24:p + 32], 'little'))
+            p += 32
+
+        h = (_rotl(v1, 1) + _rotl(v2, 7) + _rotl(v3, 12) +
+             _rotl(v4, 18)) & _MASK
+        h = _merge_round(h, v1)
+        h = _merge_round(h, v2)
+        h = _merge_round(h, v3)
+        h = _merge_round(h, v4)
+    else:
+        h = (seed + _PRIME5) & _MASK
+
+    h = (h + length) & _MASK
+
+    while p + 8 <= length:
+        h ^= _mix_round(0, int.from_bytes(data[p:p + 8], 'little'))
+        h = (_rotl(h, 27) * _PRIME1 + _PRIME4) & _MASK
+        p += 8
+
+    if p + 4 <= length:
+        h ^= (int.from_bytes(data[p:p + 4], 'little') * _PRIME1) & _MASK
+        h = (_rotl(h, 23) * _PRIME2 + _PRIME3) & _MASK
+        p += 4
+
+    while p < length:
+        h ^= (data[p] * _PRIME5) & _MASK
+        h = (_rotl(h, 11) * _PRIME1) & _MASK
+        p += 1
+
+    h ^= h >> 33
+    h = (h * _PRIME2) & _MASK
+    h ^= h >> 29
+    h = (h * _PRIME3) & _MASK
+    h ^= h >> 32
+    return h
+
+
+class HashRing():
+    '''
+    A sorted list of virtual node positions, each mapped to one of members;
+    responsible walks it clockwise exactly like HashRing::responsible. With a
+    load bound, the first owners of each position come from a table built
+    like the C++ ring's bounded ownership table.
+    '''
+
+    def __init__(self, members, positions, seed, load_bound=0):
+        self.members = members
+        self.seed = seed
+
+        ring = sorted(positions, key=lambda position: position[0])
+        self._hashes = []
+        self._owners = []
+
+        for position, member in ring:
+            # as in the C++ ring, a taken position is not inserted again
+            if self._hashes and self._hashes[-1] == position:
+                continue
+
+            self._hashes.append(position)
+            self._owners.append(member)
+
+        self._table = None
+        if load_bound > 0 and len(self._hashes) > 0:
+            self._table = self._bounded_table(load_bound)
+
+    def _bounded_table(self, load_bound):
+        '''
+        The same table as HashRing::rebuild_bounded_owners: a row of distinct
+        owners per position, each rank filled in ring order with the first
+        member clockwise that is not yet in the row and whose share of the
+        rank is under the cap.
+        '''
+        n = len(self._hashes)
+        server_count = len(set(self._owners))
+        depth = min(OWNERSHIP_TABLE_DEPTH, server_count)
+
+        arcs = [((self._hashes[i] - self._hashes[i - 1]) & _MASK) >>
+                LOAD_ARC_SHIFT for i in range(n)]
+        positions = {}
+        for i, member in enumerate(self._owners):
+            positions.setdefault(member, []).append(i)
+
+        cap = int((1.0 + load_bound) * float(sum(arcs)) / server_count)
+        table = [[] for _ in range(n)]
+
+        for _ in range(depth):
+            load = {}
+            following = list(range(n + 1))
+
+            def find_open(p):
+                # the first position from p on (or n) whose member has room
+                while following[p] != p:
+                    following[p] = following[following[p]]
+                    p = following[p]
+                return p
+
+            for i in range(n):
+                row = table[i]
+                chosen = None
+                wrapped = False
+                p = find_open(i)
+
+                while True:
+                    if p == n:
+                        if wrapped:
+                            break
+                        wrapped = True
+                        p = find_open(0)
+                        if p == n:
+                            break
+
+                    if wrapped and p >= i:
+                        break
+
+                    if self._owners[p] not in row:
+                        chosen = self._owners[p]
+                        break
+
+                    p = find_open(p + 1)
+
+                j = i
+                while chosen is None:
+                    if self._owners[j] not in row:
+                        chosen = self._owners[j]
+                    j = (j + 1) % n
+
+                row.append(chosen)
+                had_room = load.get(chosen, 0) < cap
+                load[chosen] = load.get(chosen, 0) + arcs[i]
+
+                if had_room and load[chosen] >= cap:
+                    for position in positions[chosen]:
+                        following[position] = position + 1
+
+        return table
+
+    def responsible(self, key, count):
+        if len(self._hashes) == 0:
+            return []
+
+        index = bisect.bisect_left(self._hashes, hash64(key, self.seed))
+        count = min(count, len(self.members))
+        index %= len(self._hashes)
+        result = []
+
+        if self._table is not None:
+            result = self._table[index][:count]
+
+        while len(result) < count:
+            member = self._owners[index]
+
+            if member not in result:
+                result.append(member)
+
+            index = (index + 1) % len(self._hashes)
+
+        return [self.members[member] for member in result]
+
+
+def _global_ring(servers, virtual_nodes, seed, load_bound):
+    positions = []
+    for member, server in enumerate(servers):
+        for virtual_num in range(virtual_nodes):
+            # the virtual ID of thread 0 of the server
+            virtual_id = '%s:0_%d' % (server.private_ip, virtual_num)
+            positions.append((hash64(virtual_id.encode(), seed), member))
+
+    return HashRing([server.public_ip for server in servers], positions, seed,
+                    load_bound)
+
+
+def _local_ring(thread_count, virtual_nodes, seed, load_bound):
+    positions = []
+    for tid in range(thread_count):
+        for virtual_num in range(virtual_nodes):
+            packed = (tid << 32) | virtual_num
+            positions.append((hash64(packed.to_bytes(8, 'little'), seed),
+                              tid))
+
+    return HashRing(list(range(thread_count)), positions, seed, load_bound)
+
+
+class RingView():
+    '''
+    A client's copy of the hash rings and replication factors of the cluster,
+    built from a RingSnapshot published by a routing thread. It computes the
+    same KVS worker addresses for a key as the routing tier would.
+    '''
+
+    def __init__(self, snapshot):
+        self._load(snapshot)
+
+    def _load(self, snapshot):
+        self.version = snapshot.version
+        self.seeded = snapshot.seeded_hashing
+
+        self._global = {}
+        self._local = {}
+        self._defaults = {}
+        self._replication = {}
+
+        if not self.seeded:
+            return
+
+        global_seed = snapshot.hash_seed
+        local_seed = snapshot.hash_seed ^ LOCAL_HASH_SALT
+
+        for ring in snapshot.tiers:
+            virtual_nodes = ring.virtual_nodes or snapshot.virtual_nodes
+            self._global[ring.tier] = _global_ring(ring.servers,
+                                                   virtual_nodes, global_seed,
+                                                   ring.load_bound)
+            self._local[ring.tier] = _local_ring(ring.thread_count,
+                                                 virtual_nodes, local_seed,
+                                                 ring.load_bound)
+            self._defaults[ring.tier] = (ring.global_replication,
+                                         ring.local_replication)
+
+        self._update_replication(snapshot.replication)
+
+    def _update_replication(self, factors):
+        for factor in factors:
+            replication = {}
+
+            # global is a Python keyword, so the field cannot be read directly
+            for value in getattr(factor, 'global'):
+                replication.setdefault(value.tier, [None, None])[0] = \
+                    value.value
+            for value in factor.local:
+                replication.setdefault(value.tier, [None, None])[1] = \
+                    value.value
+
+            self._replication[factor.key] = replication
+
+    def apply(self, update):
+        '''
+        Applies a snapshot or delta published by the routing thread. Returns
+        the keys whose addresses may have changed (None for all keys), or
+        False if the update does not follow this view's version and a new
+        snapshot is needed.
+        '''
+        if not update.delta:
+            self._load(update)
+            return None
+
+        if update.base_version != self.version:
+            return False
+
+        self._update_replication(update.replication)
+        self.version = update.version
+        return [factor.key for factor in update.replication]
+
+    def addresses(self, key):
+        '''
+        Returns the key request addresses of key, or None if this view cannot
+        compute them.
+        '''
+        if not self.seeded or key.startswith(METADATA_PREFIX):
+            return None
+
+        data = key.encode()
+        for tier in ALL_TIERS:
+            if tier not in self._global:
+                continue
+
+            global_rep, local_rep = self._defaults[tier]
+            overrides = self._replication.get(key, {}).get(tier)
+            if overrides:
+                # a global factor of 0 keeps the key out of the tier
+                if overrides[0] is not None:
+                    global_rep = overrides[0]
+                if overrides[1] is not None:
+                    local_rep = overrides[1]
+
+            addresses = []
+            tids = sorted(self._local[tier].responsible(data, local_rep))
+            for public_ip in self._global[tier].responsible(data, global_rep):
+                for tid in tids:
+                    addresses.append('tcp://%s:%d' % (
+                        public_ip, tid + KEY_REQUEST_BASE_PORT))
+
+            if len(addresses) > 0:
+                return addresses
+
+        return None
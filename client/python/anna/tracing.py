@@ -0,0 +1,98 @@
+#  Copyright 2019 U.C. Berkeley RISE Lab
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+import random
+import time
+
+from anna.metadata_pb2 import TracedMessage
+
+
+def trace_time():
+    '''
+    Microseconds since the Unix epoch, which is the time the routing tier and
+    the KVS stamp their spans with.
+    '''
+    return int(time.time() * 1000000)
+
+
+def new_span_id():
+    return random.getrandbits(64) or 1
+
+
+class Span():
+    '''
+    The client's side of one sampled request: from when it was first sent to
+    when its last response arrived.
+    '''
+
+    def __init__(self, name, trace_id):
+        self.name = name
+        self.trace_id = trace_id
+        self.span_id = new_span_id()
+        self.start = None
+        self.tags = {}
+
+    def context(self):
+        '''
+        Returns the serialized trace context to send in front of the request;
+        the first call marks the start of the span.
+        '''
+        now = trace_time()
+        if self.start is None:
+            self.start = now
+
+        traced = TracedMessage()
+        traced.trace.trace_id = self.trace_id
+        traced.trace.parent_span_id = self.span_id
+        traced.trace.sent = now
+        return traced.SerializeToString()
+
+
+class Tracer():
+    '''
+    Starts a trace for a fraction of this client's requests. Servers that
+    trace record their spans of those requests as children of the client's
+    span, and every finished client span is kept in spans, as a Zipkin v2
+    span, for the caller to export.
+    '''
+
+    def __init__(self, fraction, ip, service='anna-client'):
+        self.fraction = fraction
+        self.ip = ip
+        self.service = service
+        self.spans = []
+
+    def sample(self, name):
+        '''
+        Returns a Span for a new request if it is sampled, and None otherwise.
+        '''
+        if self.fraction <= 0 or random.random() >= self.fraction:
+            return None
+
+        return Span(name, new_span_id())
+
+    def finish(self, span):
+        end = trace_time()
+        start = span.start if span.start is not None else end
+
+        self.spans.append({
+            'traceId': '%016x' % span.trace_id,
+            'id': '%016x' % span.span_id,
+            'name': span.name,
+            'kind': 'CLIENT',
+            'timestamp': start,
+            'duration': end - start,
+            'localEndpoint': {'serviceName': self.service, 'ipv4': self.ip},
+            'tags': dict(span.tags)
+        })
@@ -0,0 +1,94 @@
+#  Copyright 2019 U.C. Berkeley RISE Lab
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+from collections import OrderedDict
+import time
+
+
+class ValueCache():
+    '''
+    A bounded map from keys to the lattices this client last read or wrote,
+    evicting the least recently used key first. A cached value is served for
+    at most staleness seconds after it was last refreshed from the KVS (None
+    means forever, which is only safe if the KVS pushes updates to this
+    client). Local writes are merged into the cached value, so reads always
+    reflect this client's own writes.
+    '''
+
+    def __init__(self, capacity, staleness):
+        self.capacity = capacity
+        self.staleness = staleness
+
+        # key -> (lattice, time of the last refresh from the KVS)
+        self._entries = OrderedDict()
+
+    def __len__(self):
+        return len(self._entries)
+
+    def __contains__(self, key):
+        return key in self._entries
+
+    def keys(self):
+        return list(self._entries.keys())
+
+    def get(self, key):
+        '''
+        Returns the cached lattice for key, or None if there is none or it has
+        gone stale.
+        '''
+        if key not in self._entries:
+            return None
+
+        value, refreshed = self._entries[key]
+        if self.staleness is not None and \
+                time.time() - refreshed > self.staleness:
+            del self._entries[key]
+            return None
+
+        self._entries.move_to_end(key)
+        return value
+
+    def refresh(self, key, value):
+        '''
+        Merges a value read from (or pushed by) the KVS into the cache; the
+        entry counts as fresh from now on.
+        '''
+        self._store(key, value, time.time())
+
+    def write(self, key, value):
+        '''
+        Merges a value this client wrote into the cache. A write does not make
+        the rest of the cached value any fresher, so an existing entry keeps
+        its refresh time.
+        '''
+        refreshed = time.time()
+        if key in self._entries:
+            refreshed = self._entries[key][1]
+
+        self._store(key, value, refreshed)
+
+    def invalidate(self, key):
+        self._entries.pop(key, None)
+
+    def _store(self, key, value, refreshed):
+        if key in self._entries:
+            cached = self._entries[key][0]
+            if type(cached) == type(value):
+                value = cached.merge(value)
+
+        self._entries[key] = (value, refreshed)
+        self._entries.move_to_end(key)
+
+        while len(self._entries) > self.capacity:
+            self._entries.popitem(last=False)
@@ -13,8 +13,12 @@
 #  limitations under the License.
 
 
-def send_request(req_obj, send_sock):
+# Sends req_obj on send_sock, after trace (a serialized TracedMessage) if the
+# request is traced.
+def send_request(req_obj, send_sock, trace=None):
     req_string = req_obj.SerializeToString()
+    if trace is not None:
+        req_string = trace + req_string
 
     send_sock.send(req_string)
 
@@ -36,6 +40,29 @@ def recv_response(req_ids, rcv_sock, resp_class):
     return responses
 
 
+# Receives responses to req_ids until every key in keys has been answered. A
+# request with many keys can be answered in several parts, e.g., when some of
+# its keys wait on a replication factor lookup, so responses are counted by
+# key rather than by request. entries returns the per-key entries of a
+# response.
+def recv_keyed_responses(req_ids, keys, rcv_sock, resp_class, entries):
+    responses = []
+    remaining = set(keys)
+
+    while len(remaining) > 0:
+        resp_obj = resp_class()
+        resp_obj.ParseFromString(rcv_sock.recv())
+
+        if resp_obj.response_id not in req_ids:
+            continue
+
+        responses.append(resp_obj)
+        for entry in entries(resp_obj):
+            remaining.discard(entry.key)
+
+    return responses
+
+
 class SocketCache():
     def __init__(self, context, zmq_type):
         self.context = context
@@ -16,6 +16,7 @@
 
 cd anna
 protoc -I=../../../common/proto/ --python_out=. anna.proto shared.proto causal.proto cloudburst.proto
+protoc -I=../../../include/proto/ --python_out=. metadata.proto
 
 if [[ "$OSTYPE" = "darwin"* ]]; then
   sed -i "" "s/import shared_pb2/from . import shared_pb2/g" anna_pb2.py
@@ -35,6 +35,7 @@ class InstallWrapper(install):
     def cleanup(self):
         os.system('rm anna/anna_pb2.py')
         os.system('rm anna/shared_pb2.py')
+        os.system('rm anna/metadata_pb2.py')
         os.system('rm -rf build')
         os.system('rm -rf Anna.egg-info')
 
@@ -0,0 +1,146 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_BENCHMARK_REPLAY_HPP_
+#define KVS_INCLUDE_BENCHMARK_REPLAY_HPP_
+
+#include <cstdio>
+#include <memory>
+
+#include "workload_capture.hpp"
+
+// The syntax of the REPLAY benchmark command. files are captures written by
+// the KVS's workload capture, which are merged by time; speed scales the
+// capture's request rate (2 replays it twice as fast), outstanding caps the
+// requests a thread has in flight, and period is the report period.
+const string kReplayUsage =
+    "REPLAY:files=FILE[,FILE...][:speed=S][:outstanding=N][:period=SECONDS]";
+
+struct Replay {
+  vector<string> files;
+  double speed = 1;
+  unsigned outstanding = 1000;
+  unsigned report_period = 5;
+};
+
+inline bool parse_replay(const vector<string> &fields, Replay &replay,
+                         string &error) {
+  for (unsigned i = 1; i < fields.size(); i++) {
+    std::size_t equals = fields[i].find('=');
+    if (equals == string::npos) {
+      error = "expected name=value instead of " + fields[i];
+      return false;
+    }
+
+    string name = fields[i].substr(0, equals);
+    string value = fields[i].substr(equals + 1);
+    char *end = nullptr;
+
+    if (name == "files") {
+      split(value, ',', replay.files);
+    } else if (name == "speed") {
+      replay.speed = strtod(value.c_str(), &end);
+      if (*end != '\0' || !(replay.speed > 0)) {
+        error = "speed must be positive";
+        return false;
+      }
+    } else if (name == "outstanding" || name == "period") {
+      long number = strtol(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0' || number <= 0) {
+        error = name + " must be a positive integer";
+        return false;
+      }
+
+      if (name == "outstanding") {
+        replay.outstanding = number;
+      } else {
+        replay.report_period = number;
+      }
+    } else {
+      error = "unknown option " + name;
+      return false;
+    }
+  }
+
+  if (replay.files.empty()) {
+    error = "no capture files given";
+    return false;
+  }
+
+  return true;
+}
+
+// the key that stands in for the captured key with key_hash; a replay does
+// not know the original keys, but the same one always maps to the same key
+inline Key replay_key(uint64_t key_hash) {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key_hash);
+  return "replay_" + string(hex);
+}
+
+// Reads several captures as one, in the order of the wall clock times of
+// their requests.
+class CaptureMerger {
+  struct Source {
+    std::unique_ptr<WorkloadReader> reader;
+    CapturedRequest next;
+    bool has_next;
+  };
+
+  vector<Source> sources_;
+
+public:
+  // adds the capture at path; returns false if it is not a capture
+  bool add(const string &path) {
+    Source source;
+    source.reader.reset(new WorkloadReader(path));
+    if (!source.reader->valid()) {
+      return false;
+    }
+
+    source.has_next = source.reader->next(source.next);
+    sources_.push_back(std::move(source));
+    return true;
+  }
+
+  // reads the earliest request left in any capture, and the wall clock time
+  // it arrived at, in microseconds; returns false once none is left
+  bool next(CapturedRequest &request, uint64_t &time) {
+    Source *earliest = nullptr;
+    uint64_t earliest_time = 0;
+
+    for (Source &source : sources_) {
+      if (!source.has_next) {
+        continue;
+      }
+
+      uint64_t at = source.reader->start() + source.next.time;
+      if (earliest == nullptr || at < earliest_time) {
+        earliest = &source;
+        earliest_time = at;
+      }
+    }
+
+    if (earliest == nullptr) {
+      return false;
+    }
+
+    request = earliest->next;
+    time = earliest_time;
+    earliest->has_next = earliest->reader->next(earliest->next);
+    return true;
+  }
+};
+
+#endif // KVS_INCLUDE_BENCHMARK_REPLAY_HPP_
@@ -0,0 +1,372 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_BENCHMARK_WORKLOAD_HPP_
+#define KVS_INCLUDE_BENCHMARK_WORKLOAD_HPP_
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "zipf_sampler.hpp"
+
+// The syntax of the WORKLOAD benchmark command, which anna-bench-trigger
+// prints on request. Every option is a name=value field; a preset sets the
+// mix and key distribution of a YCSB core workload, and the other options
+// override the preset.
+const std::string kWorkloadUsage =
+    "WORKLOAD[:preset=A|B|C|D|F][:read=R][:update=U][:rmw=M][:insert=I]"
+    "[:keys=N][:dist=uniform|zipf,S|hotspot,HOT_KEYS,HOT_OPS|latest,S]"
+    "[:value=fixed,LEN|uniform,MIN,MAX|pareto,MIN,SHAPE,MAX]"
+    "[:lattice=lww|set|causal][:period=SECONDS][:time=SECONDS]";
+
+enum class Operation { READ, UPDATE, RMW, INSERT };
+
+enum class KeyDistribution { UNIFORM, ZIPFIAN, HOTSPOT, LATEST };
+
+enum class ValueDistribution { FIXED, UNIFORM, PARETO };
+
+enum class WorkloadLattice { LWW, SET, CAUSAL };
+
+inline std::string operation_name(Operation op) {
+  switch (op) {
+  case Operation::READ:
+    return "READ";
+  case Operation::UPDATE:
+    return "UPDATE";
+  case Operation::RMW:
+    return "RMW";
+  default:
+    return "INSERT";
+  }
+}
+
+// A benchmark workload: the mix of operations, how keys and value sizes are
+// drawn, and the lattice that values are written as. Keys 1 to keys exist
+// before the run; inserts add keys after them.
+struct Workload {
+  // the fraction of each operation; they add up to 1
+  double read = 1;
+  double update = 0;
+  double rmw = 0;
+  double insert = 0;
+
+  unsigned long long keys = 100000;
+
+  KeyDistribution key_distribution = KeyDistribution::UNIFORM;
+  double zipf = 0.99;
+  // the fraction of keys in the hot set, and of operations on it
+  double hot_keys = 0.2;
+  double hot_ops = 0.8;
+
+  ValueDistribution value_distribution = ValueDistribution::FIXED;
+  unsigned value_min = 1024;
+  unsigned value_max = 1024;
+  double pareto_shape = 1.5;
+
+  WorkloadLattice lattice = WorkloadLattice::LWW;
+
+  // in seconds
+  unsigned report_period = 5;
+  unsigned time = 60;
+
+  Operation next_operation(unsigned &seed) const {
+    double r = rand_r(&seed) / (RAND_MAX + 1.0);
+
+    if (r < read) {
+      return Operation::READ;
+    } else if (r < read + update) {
+      return Operation::UPDATE;
+    } else if (r < read + update + rmw) {
+      return Operation::RMW;
+    }
+
+    return Operation::INSERT;
+  }
+
+  unsigned value_size(unsigned &seed) const {
+    if (value_distribution == ValueDistribution::UNIFORM) {
+      return value_min + rand_r(&seed) % (value_max - value_min + 1);
+    } else if (value_distribution == ValueDistribution::PARETO) {
+      // inverse transform; 1 - u is in (0, 1]
+      double u = 1 - rand_r(&seed) / (RAND_MAX + 1.0);
+      double size = value_min / std::pow(u, 1 / pareto_shape);
+      return size > value_max ? value_max : size;
+    }
+
+    return value_min;
+  }
+};
+
+// Draws the keys of a workload. Keys are numbered from 1; inserted is the
+// number of keys that have been inserted so far, so keys up to keys +
+// inserted exist. Zipfian ranks only span the initial keys, with key 1 the
+// hottest; the latest distribution uses the same ranks counted back from the
+// newest key.
+class KeyChooser {
+  Workload workload_;
+  ZipfSampler sampler_;
+
+  static unsigned long long uniform(unsigned long long lowest,
+                                    unsigned long long highest,
+                                    unsigned &seed) {
+    double r = rand_r(&seed) / (RAND_MAX + 1.0);
+    return lowest + (unsigned long long)(r * (highest - lowest + 1));
+  }
+
+public:
+  explicit KeyChooser(const Workload &workload)
+      : workload_(workload), sampler_(workload.keys, workload.zipf) {}
+
+  unsigned long long next(unsigned &seed, unsigned long long inserted) const {
+    unsigned long long total = workload_.keys + inserted;
+
+    switch (workload_.key_distribution) {
+    case KeyDistribution::ZIPFIAN:
+      return sampler_.sample(seed);
+    case KeyDistribution::LATEST:
+      return total - sampler_.sample(seed) + 1;
+    case KeyDistribution::HOTSPOT: {
+      unsigned long long hot = std::ceil(workload_.hot_keys * total);
+      if (hot < 1) {
+        hot = 1;
+      }
+
+      double r = rand_r(&seed) / (RAND_MAX + 1.0);
+      if (hot >= total || r < workload_.hot_ops) {
+        return uniform(1, hot, seed);
+      }
+
+      return uniform(hot + 1, total, seed);
+    }
+    default:
+      return uniform(1, total, seed);
+    }
+  }
+};
+
+// parses the numbers in the comma-separated text; returns false if any is
+// malformed
+inline bool parse_numbers(const std::string &text,
+                          std::vector<double> &numbers) {
+  std::size_t start = 0;
+
+  while (start <= text.size()) {
+    std::size_t end = text.find(',', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+
+    std::string field = text.substr(start, end - start);
+    char *parsed;
+    double number = std::strtod(field.c_str(), &parsed);
+    if (field.empty() || *parsed != '\0') {
+      return false;
+    }
+
+    numbers.push_back(number);
+    start = end + 1;
+  }
+
+  return true;
+}
+
+inline bool apply_preset(const std::string &preset, Workload &workload,
+                         std::string &error) {
+  workload.read = 1;
+  workload.update = workload.rmw = workload.insert = 0;
+  workload.key_distribution = KeyDistribution::ZIPFIAN;
+  workload.zipf = 0.99;
+
+  if (preset == "A") {
+    workload.read = workload.update = 0.5;
+  } else if (preset == "B") {
+    workload.read = 0.95;
+    workload.update = 0.05;
+  } else if (preset == "C") {
+    workload.read = 1;
+  } else if (preset == "D") {
+    workload.read = 0.95;
+    workload.insert = 0.05;
+    workload.key_distribution = KeyDistribution::LATEST;
+  } else if (preset == "F") {
+    workload.read = workload.rmw = 0.5;
+  } else if (preset == "E") {
+    error = "YCSB workload E needs scans, which Anna does not support";
+    return false;
+  } else {
+    error = "unknown preset " + preset;
+    return false;
+  }
+
+  return true;
+}
+
+// Parses the fields of a WORKLOAD command (see kWorkloadUsage), the first of
+// which is the mode. Returns false, with a description in error, if any
+// option is invalid.
+inline bool parse_workload(const std::vector<std::string> &fields,
+                           Workload &workload, std::string &error) {
+  // the preset goes first, so that the other options override it
+  for (unsigned i = 1; i < fields.size(); i++) {
+    if (fields[i].compare(0, 7, "preset=") == 0 &&
+        !apply_preset(fields[i].substr(7), workload, error)) {
+      return false;
+    }
+  }
+
+  bool mix_given = false;
+  double read = 0, update = 0, rmw = 0, insert = 0;
+
+  for (unsigned i = 1; i < fields.size(); i++) {
+    std::size_t equals = fields[i].find('=');
+    if (equals == std::string::npos) {
+      error = "expected name=value instead of " + fields[i];
+      return false;
+    }
+
+    std::string name = fields[i].substr(0, equals);
+    std::string value = fields[i].substr(equals + 1);
+
+    if (name == "preset") {
+      continue;
+    }
+
+    std::string kind = value.substr(0, value.find(','));
+    std::vector<double> numbers;
+    std::string rest =
+        kind.size() < value.size() ? value.substr(kind.size() + 1) : "";
+    bool is_number = parse_numbers(value, numbers);
+
+    if (name == "read" || name == "update" || name == "rmw" ||
+        name == "insert") {
+      if (!is_number || numbers.size() != 1 || numbers[0] < 0) {
+        error = name + " must be a non-negative fraction";
+        return false;
+      }
+
+      mix_given = true;
+      if (name == "read") {
+        read = numbers[0];
+      } else if (name == "update") {
+        update = numbers[0];
+      } else if (name == "rmw") {
+        rmw = numbers[0];
+      } else {
+        insert = numbers[0];
+      }
+    } else if (name == "keys" || name == "period" || name == "time") {
+      if (!is_number || numbers.size() != 1 || numbers[0] < 1) {
+        error = name + " must be a positive number";
+        return false;
+      }
+
+      if (name == "keys") {
+        workload.keys = numbers[0];
+      } else if (name == "period") {
+        workload.report_period = numbers[0];
+      } else {
+        workload.time = numbers[0];
+      }
+    } else if (name == "dist") {
+      numbers.clear();
+      if (!rest.empty() && !parse_numbers(rest, numbers)) {
+        error = "malformed key distribution " + value;
+        return false;
+      }
+
+      if (kind == "uniform" && numbers.size() == 0) {
+        workload.key_distribution = KeyDistribution::UNIFORM;
+      } else if ((kind == "zipf" || kind == "latest") &&
+                 numbers.size() <= 1) {
+        workload.key_distribution =
+            kind == "zipf" ? KeyDistribution::ZIPFIAN : KeyDistribution::LATEST;
+        if (numbers.size() == 1) {
+          workload.zipf = numbers[0];
+        }
+
+        if (workload.zipf <= 0) {
+          error = "the Zipf coefficient must be positive";
+          return false;
+        }
+      } else if (kind == "hotspot" && numbers.size() == 2 &&
+                 numbers[0] > 0 && numbers[0] <= 1 && numbers[1] >= 0 &&
+                 numbers[1] <= 1) {
+        workload.key_distribution = KeyDistribution::HOTSPOT;
+        workload.hot_keys = numbers[0];
+        workload.hot_ops = numbers[1];
+      } else {
+        error = "invalid key distribution " + value;
+        return false;
+      }
+    } else if (name == "value") {
+      numbers.clear();
+      if (!parse_numbers(rest, numbers)) {
+        error = "malformed value size distribution " + value;
+        return false;
+      }
+
+      if (kind == "fixed" && numbers.size() == 1 && numbers[0] >= 0) {
+        workload.value_distribution = ValueDistribution::FIXED;
+        workload.value_min = workload.value_max = numbers[0];
+      } else if (kind == "uniform" && numbers.size() == 2 &&
+                 numbers[0] >= 0 && numbers[1] >= numbers[0]) {
+        workload.value_distribution = ValueDistribution::UNIFORM;
+        workload.value_min = numbers[0];
+        workload.value_max = numbers[1];
+      } else if (kind == "pareto" && numbers.size() == 3 && numbers[0] >= 1 &&
+                 numbers[1] > 0 && numbers[2] >= numbers[0]) {
+        workload.value_distribution = ValueDistribution::PARETO;
+        workload.value_min = numbers[0];
+        workload.pareto_shape = numbers[1];
+        workload.value_max = numbers[2];
+      } else {
+        error = "invalid value size distribution " + value;
+        return false;
+      }
+    } else if (name == "lattice") {
+      if (value == "lww") {
+        workload.lattice = WorkloadLattice::LWW;
+      } else if (value == "set") {
+        workload.lattice = WorkloadLattice::SET;
+      } else if (value == "causal") {
+        workload.lattice = WorkloadLattice::CAUSAL;
+      } else {
+        error = "unknown lattice " + value;
+        return false;
+      }
+    } else {
+      error = "unknown option " + name;
+      return false;
+    }
+  }
+
+  if (mix_given) {
+    double total = read + update + rmw + insert;
+    if (total <= 0) {
+      error = "the operation mix is empty";
+      return false;
+    }
+
+    workload.read = read / total;
+    workload.update = update / total;
+    workload.rmw = rmw / total;
+    workload.insert = insert / total;
+  }
+
+  return true;
+}
+
+#endif // KVS_INCLUDE_BENCHMARK_WORKLOAD_HPP_
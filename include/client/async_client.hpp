@@ -0,0 +1,191 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_CLIENT_ASYNC_CLIENT_HPP_
+#define INCLUDE_CLIENT_ASYNC_CLIENT_HPP_
+
+#include <chrono>
+#include <deque>
+#include <functional>
+
+#include "anna.pb.h"
+#include "common.hpp"
+#include "kvs_common.hpp"
+#include "replica_selector.hpp"
+#include "scan_merger.hpp"
+
+// the most keys that one request to a server thread carries; a request that
+// reaches this many is sent without waiting for flush()
+const unsigned kClientMaxRequestTuples = 1000;
+
+// how many times a key is sent again after a server thread answers that it
+// is not responsible for the key, or is too busy to serve it
+const unsigned kClientMaxRetries = 2;
+
+// the answer to a GET or PUT: the response tuple for its key, or a tuple
+// with only the key and the error if the client gave up on it
+typedef std::function<void(const KeyTuple &)> ClientCallback;
+
+// the answer to a scan: a page of keys in order, whether the range has more
+// keys after them, and an error if the client gave up on the scan
+typedef std::function<void(const vector<Key> &, bool, AnnaError)>
+    ScanCallback;
+
+// A client that keeps any number of GETs and PUTs in flight and runs a
+// callback for each as its answer arrives. Requests are buffered until
+// flush(), and the keys bound for the same server thread share one request.
+// Key addresses come from the routing tier, likewise batched, and are
+// cached until a server marks them invalid. Of a key's replicas, each
+// request goes to the one the ReplicaSelector picks. Responses are only
+// read in poll(), which blocks in zmq_poll rather than spinning until one
+// arrives or the oldest request times out. Scans go through the routing
+// tier to every server thread, and the client merges their answers.
+//
+// The client is not thread-safe; each thread should have its own, with its
+// own tid so that responses find their way back to it.
+class AsyncKvsClient {
+  // the tests drive the client through a subclass
+protected:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Operation {
+    RequestType type_;
+    Key key_;
+    string payload_;
+    LatticeType lattice_type_;
+    ClientCallback callback_;
+
+    // the times the key has been sent again, and the server thread it was
+    // last sent to, which a retry avoids if the key has other replicas
+    unsigned retries_;
+    Address address_;
+  };
+
+  // a request that has been sent to a server thread, with the operations
+  // each of its keys answers, in the order they were added
+  struct Inflight {
+    Address address_;
+    map<Key, std::deque<uint64_t>> operations_;
+    unsigned remaining_;
+  };
+
+  // a scan whose page is being merged from the answers of the servers
+  struct Scan {
+    ScanMerger merger_;
+    ScanCallback callback_;
+  };
+
+  vector<UserRoutingThread> routing_threads_;
+  UserThread ut_;
+  std::chrono::milliseconds timeout_;
+  unsigned seed_;
+  logger log_;
+
+  zmq::context_t context_;
+  SocketCache pushers_;
+  zmq::socket_t response_puller_;
+  zmq::socket_t key_address_puller_;
+  zmq::socket_t scan_puller_;
+
+  uint64_t next_operation_;
+  uint64_t next_request_;
+  map<uint64_t, Operation> operations_;
+
+  map<Key, vector<Address>> address_cache_;
+  ReplicaSelector selector_;
+
+  // keys waiting for their addresses with the operations waiting on them,
+  // the keys among them to ask the routing tier about at the next flush(),
+  // and when each of the others was asked about
+  map<Key, vector<uint64_t>> unresolved_;
+  vector<Key> to_resolve_;
+  map<Key, TimePoint> resolving_;
+
+  // the requests being filled per server thread and request type, with
+  // their operations, and the requests that have been sent, by request ID
+  map<pair<Address, RequestType>, pair<KeyRequest, Inflight>> outbox_;
+  map<string, Inflight> inflight_;
+
+  // the request IDs and address lookups that were sent, oldest first, for
+  // timing them out; entries that have been answered are skipped
+  std::deque<pair<TimePoint, string>> request_order_;
+  std::deque<pair<TimePoint, Key>> resolve_order_;
+
+  // the scans waiting for answers, by request ID, and when each was sent
+  map<string, Scan> scans_;
+  std::deque<pair<TimePoint, string>> scan_order_;
+
+  string request_id();
+
+  void route(uint64_t id);
+  void enqueue(const Address &address, uint64_t id);
+  void send(const Address &address, KeyRequest &request, Inflight &inflight);
+
+  void finish(uint64_t id, const KeyTuple &tuple);
+  void fail(uint64_t id, AnnaError error);
+  bool retry(uint64_t id, AnnaError error);
+
+  void handle_address_response(const string &serialized);
+  void handle_response(const string &serialized);
+  void handle_scan_response(const string &serialized);
+  void finish_scan(map<string, Scan>::iterator it, AnnaError error);
+  void expire(TimePoint now);
+
+  // how long poll() may block before the oldest request times out
+  long next_expiry(TimePoint now) const;
+
+public:
+  // timeout is how long a request may go unanswered, in milliseconds,
+  // before its callbacks are run with a TIMEOUT error
+  AsyncKvsClient(const vector<UserRoutingThread> &routing_threads,
+                 const Address &ip, unsigned tid, unsigned timeout);
+
+  // starts reading key
+  void get(const Key &key, ClientCallback callback);
+
+  // starts merging payload, a serialized lattice of type lattice_type, into
+  // key
+  void put(const Key &key, const string &payload, LatticeType lattice_type,
+           ClientCallback callback);
+
+  // starts reading the first page of up to limit keys (kMaxScanPage if 0)
+  // that start with prefix and fall between start and end, both exclusive,
+  // with no upper bound if end is empty; the next page starts after the last
+  // key of this one. Scans are sent right away, not at the next flush().
+  void scan(const string &prefix, const Key &start, const Key &end,
+            unsigned limit, ScanCallback callback);
+
+  // sends every request that has been buffered
+  void flush();
+
+  // flushes, then waits up to timeout milliseconds (forever if negative) for
+  // answers and runs their callbacks; returns the number of callbacks run
+  unsigned poll(long timeout);
+
+  // polls until every operation has been answered
+  void wait();
+
+  // the operations and scans whose callbacks have not run yet
+  unsigned outstanding() const { return operations_.size() + scans_.size(); }
+
+  void clear_cache() { address_cache_.clear(); }
+
+  zmq::context_t *get_context() { return &context_; }
+
+  unsigned get_seed() const { return seed_; }
+
+  void set_logger(logger log) { log_ = log; }
+};
+
+#endif // INCLUDE_CLIENT_ASYNC_CLIENT_HPP_
@@ -15,21 +15,23 @@
 #ifndef KVS_INCLUDE_CONSISTENT_HASH_MAP_HPP_
 #define KVS_INCLUDE_CONSISTENT_HASH_MAP_HPP_
 
-#include <map>
+#include <algorithm>
 #include <string>
-
-template <typename T, typename Hash,
-          typename Alloc =
-              std::allocator<std::pair<const typename Hash::ResultType, T>>>
-class ConsistentHashMap {
+#include <vector>
+
+// The ring is a flat vector of (hash, node) pairs sorted by hash, so a lookup
+// is one binary search over contiguous memory. Bulk insert and erase rebuild
+// the vector once per membership change instead of once per virtual node.
+// Nodes are placed by the caller, so a node can be a small handle (such as an
+// index into a table of servers) rather than the object that was hashed.
+template <typename T, typename Hash> class ConsistentHashMap {
 public:
   typedef typename Hash::ResultType size_type;
-  typedef std::map<size_type, T, std::less<size_type>, Alloc> map_type;
-  typedef typename map_type::value_type value_type;
+  typedef std::pair<size_type, T> value_type;
+  typedef std::vector<value_type> ring_type;
   typedef value_type &reference;
   typedef const value_type &const_reference;
-  typedef typename map_type::iterator iterator;
-  typedef Alloc allocator_type;
+  typedef typename ring_type::iterator iterator;
 
 public:
   ConsistentHashMap() {}
@@ -41,16 +43,25 @@ public:
 
   bool empty() const { return nodes_.empty(); }
 
-  std::pair<iterator, bool> insert(const T &node) {
-    size_type hash = hasher_(node);
-    return nodes_.insert(value_type(hash, node));
+  // inserts all (hash, node) pairs and re-sorts the ring once; pairs whose
+  // hash is already taken are skipped
+  void insert(const ring_type &nodes) {
+    nodes_.insert(nodes_.end(), nodes.begin(), nodes.end());
+
+    // a stable sort keeps existing nodes ahead of new ones with the same hash
+    std::stable_sort(nodes_.begin(), nodes_.end(), compare_hash);
+    nodes_.erase(std::unique(nodes_.begin(), nodes_.end(), same_hash),
+                 nodes_.end());
   }
 
-  void erase(iterator it) { nodes_.erase(it); }
+  // removes every pair for which remove(pair) holds, in a single pass over
+  // the ring
+  template <typename Predicate> std::size_t erase_if(Predicate remove) {
+    std::size_t old_size = nodes_.size();
+    nodes_.erase(std::remove_if(nodes_.begin(), nodes_.end(), remove),
+                 nodes_.end());
 
-  std::size_t erase(const T &node) {
-    size_type hash = hasher_(node);
-    return nodes_.erase(hash);
+    return old_size - nodes_.size();
   }
 
   iterator find(size_type hash) {
@@ -58,7 +69,7 @@ public:
       return nodes_.end();
     }
 
-    iterator it = nodes_.lower_bound(hash);
+    iterator it = lower_bound(hash);
 
     if (it == nodes_.end()) {
       it = nodes_.begin();
@@ -67,15 +78,30 @@ public:
     return it;
   }
 
-  iterator find(Key key) { return find(hasher_(key)); }
+  iterator find(const Key &key) { return find(hasher_(key)); }
 
   iterator begin() { return nodes_.begin(); }
 
   iterator end() { return nodes_.end(); }
 
 private:
+  static bool compare_hash(const value_type &a, const value_type &b) {
+    return a.first < b.first;
+  }
+
+  static bool same_hash(const value_type &a, const value_type &b) {
+    return a.first == b.first;
+  }
+
+  iterator lower_bound(size_type hash) {
+    return std::lower_bound(
+        nodes_.begin(), nodes_.end(), hash,
+        [](const value_type &value, size_type h) { return value.first < h; });
+  }
+
+protected:
   Hash hasher_;
-  map_type nodes_;
+  ring_type nodes_;
 };
 
 #endif // KVS_INCLUDE_CONSISTENT_HASH_MAP_HPP_
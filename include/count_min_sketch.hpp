@@ -0,0 +1,119 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_COUNT_MIN_SKETCH_HPP_
+#define KVS_INCLUDE_COUNT_MIN_SKETCH_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hashers.hpp"
+
+// the seed of the sketch's key hash; it is independent of the ring's hash
+// seed, so that every node sketches a key into the same counters
+const uint64_t kSketchSeed = 0x5BD1E9955BD1E995ULL;
+
+// An approximate count per key in depth rows of width counters. A key adds
+// its count to one counter in each row, and its estimate is the smallest of
+// those counters, so an estimate is never below the true count and exceeds
+// it by at most a small fraction of the total with high probability; an
+// estimate of 0 means the key was never counted. Sketches of the same
+// dimensions add up (and subtract) counter by counter.
+class CountMinSketch {
+  unsigned width_;
+  unsigned depth_;
+  std::vector<uint32_t> counts_;
+
+  // the rows' positions come from the two halves of a single hash
+  std::size_t index(unsigned row, uint64_t hash) const {
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+    return row * width_ + (h1 + row * h2) % width_;
+  }
+
+public:
+  CountMinSketch(unsigned width = 0, unsigned depth = 0)
+      : width_(width), depth_(depth), counts_(width * depth, 0) {}
+
+  static uint64_t hash(const std::string &key) {
+    return hash64(key, kSketchSeed);
+  }
+
+  unsigned width() const { return width_; }
+  unsigned depth() const { return depth_; }
+  bool empty() const { return counts_.empty(); }
+
+  // the counters, row after row
+  const std::vector<uint32_t> &counts() const { return counts_; }
+
+  // replaces the counters with depth rows of width; returns false and leaves
+  // the sketch empty if counts does not hold a whole number of rows
+  bool assign(unsigned width, const std::vector<uint32_t> &counts) {
+    if (width == 0 || counts.size() % width != 0) {
+      width_ = 0;
+      depth_ = 0;
+      counts_.clear();
+      return false;
+    }
+
+    width_ = width;
+    depth_ = counts.size() / width;
+    counts_ = counts;
+    return true;
+  }
+
+  void add(const std::string &key, uint32_t count) {
+    uint64_t h = hash(key);
+    for (unsigned row = 0; row < depth_; row++) {
+      counts_[index(row, h)] += count;
+    }
+  }
+
+  uint32_t estimate(const std::string &key) const {
+    if (empty()) {
+      return 0;
+    }
+
+    uint64_t h = hash(key);
+    uint32_t estimate = counts_[index(0, h)];
+
+    for (unsigned row = 1; row < depth_; row++) {
+      estimate = std::min(estimate, counts_[index(row, h)]);
+    }
+
+    return estimate;
+  }
+
+  // adds other's counters to this sketch's, or subtracts them; returns false
+  // and changes nothing if the dimensions differ
+  bool merge(const CountMinSketch &other, bool subtract = false) {
+    if (other.width_ != width_ || other.depth_ != depth_) {
+      return false;
+    }
+
+    for (std::size_t i = 0; i < counts_.size(); i++) {
+      if (subtract) {
+        counts_[i] -= other.counts_[i];
+      } else {
+        counts_[i] += other.counts_[i];
+      }
+    }
+
+    return true;
+  }
+};
+
+#endif // KVS_INCLUDE_COUNT_MIN_SKETCH_HPP_
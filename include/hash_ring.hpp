@@ -20,17 +20,57 @@
 #include "hashers.hpp"
 #include "kvs_common.hpp"
 #include "metadata.hpp"
+#include "replica_selector.hpp"
+#include "yaml-cpp/yaml.h"
 
+// The number of distinct owners precomputed for every virtual node. Lookups
+// for up to this many replicas are a binary search plus a table read; larger
+// replication factors fall back to walking the ring.
+const unsigned kOwnershipTableDepth = 4;
+
+// the number of virtual nodes per thread in the rings of tier; set by
+// configure_hashing, and kVirtualThreadNum unless the conf says otherwise
+unsigned virtual_node_count(Tier tier);
+
+// The bound ε on each thread's share of a ring above the mean, or 0 for the
+// plain ring; set by configure_hashing. With a bound, the ownership table
+// moves keys off threads whose ring segments add up to more than (1 + ε)
+// times the mean share, so every thread's share stays within (1 + ε) of the
+// mean, give or take one segment.
+double ring_load_bound();
+
+// ring segments are weighed in units of 2^kLoadArcShift hash values
+const unsigned kLoadArcShift = 16;
+
+// The ring keeps one ServerThread per thread, and each virtual node is only a
+// (hash, thread index) pair, so a thread's virtual nodes cost 16 bytes each
+// rather than a ServerThread apiece.
 template <typename H>
-class HashRing : public ConsistentHashMap<ServerThread, H> {
+class HashRing : public ConsistentHashMap<unsigned, H> {
+  typedef ConsistentHashMap<unsigned, H> Base;
+
 public:
-  HashRing() {}
+  explicit HashRing(unsigned virtual_nodes = kVirtualThreadNum,
+                    double load_bound = 0)
+      : virtual_nodes_(virtual_nodes), load_bound_(load_bound), depth_(0) {}
 
   ~HashRing() {}
 
 public:
   ServerThreadSet get_unique_servers() const { return unique_servers; }
 
+  // the number of threads in the ring
+  unsigned server_count() const { return threads_.size(); }
+
+  unsigned virtual_nodes() const { return virtual_nodes_; }
+
+  double load_bound() const { return load_bound_; }
+
+  // the thread a virtual node (as found by find) belongs to
+  const ServerThread &server(typename Base::const_reference node) const {
+    return threads_[node.second];
+  }
+
   bool insert(Address public_ip, Address private_ip, int join_count,
               unsigned tid) {
     ServerThread new_thread = ServerThread(public_ip, private_ip, tid, 0);
@@ -47,30 +87,357 @@ public:
       unique_servers.insert(new_thread);
       server_join_count[private_ip] = join_count;
 
-      for (unsigned virtual_num = 0; virtual_num < kVirtualThreadNum;
+      unsigned index = threads_.size();
+      threads_.push_back(new_thread);
+
+      typename Base::ring_type virtual_threads;
+      virtual_threads.reserve(virtual_nodes_);
+
+      for (unsigned virtual_num = 0; virtual_num < virtual_nodes_;
            virtual_num++) {
-        ServerThread st = ServerThread(public_ip, private_ip, tid, virtual_num);
-        ConsistentHashMap<ServerThread, H>::insert(st);
+        virtual_threads.push_back(
+            {this->hasher_(new_thread, virtual_num), index});
       }
 
+      Base::insert(virtual_threads);
+      rebuild_owners();
+
       return true;
     }
   }
 
   void remove(Address public_ip, Address private_ip, unsigned tid) {
-    for (unsigned virtual_num = 0; virtual_num < kVirtualThreadNum;
-         virtual_num++) {
-      ServerThread st = ServerThread(public_ip, private_ip, tid, virtual_num);
-      ConsistentHashMap<ServerThread, H>::erase(st);
+    unsigned index = 0;
+    while (index < threads_.size() &&
+           !(threads_[index].private_ip() == private_ip &&
+             threads_[index].tid() == tid)) {
+      index++;
+    }
+
+    if (index < threads_.size()) {
+      this->erase_if([index](const typename Base::value_type &node) {
+        return node.second == index;
+      });
+
+      // close the gap the thread leaves in the table
+      threads_.erase(threads_.begin() + index);
+      for (auto &node : this->nodes_) {
+        if (node.second > index) {
+          node.second -= 1;
+        }
+      }
     }
 
     unique_servers.erase(ServerThread(public_ip, private_ip, tid, 0));
     server_join_count.erase(private_ip);
+    rebuild_owners();
+  }
+
+  // returns the first count distinct threads found walking clockwise from
+  // the position of key (skipping, with a load bound, threads whose share is
+  // full); count is capped at the number of threads in the ring
+  ServerThreadList responsible(const Key &key, unsigned count) {
+    ServerThreadList threads;
+    auto pos = this->find(key);
+
+    if (pos == this->end()) {
+      return threads;
+    }
+
+    std::size_t index = pos - this->begin();
+    count = std::min(count, (unsigned)threads_.size());
+
+    if (count <= depth_) {
+      for (unsigned i = 0; i < count; i++) {
+        threads.push_back(threads_[owners_[index * depth_ + i]]);
+      }
+
+      return threads;
+    }
+
+    for (unsigned server : owners_at(index, count)) {
+      threads.push_back(threads_[server]);
+    }
+
+    return threads;
+  }
+
+  typedef typename Base::size_type size_type;
+  typedef std::pair<size_type, size_type> HashRange;
+
+  // returns the hash ranges of the keys for which the thread with this
+  // private_ip is among the first count distinct threads; a range (lo, hi]
+  // runs clockwise from lo, so it wraps if lo > hi and covers the whole ring
+  // if lo == hi
+  vector<HashRange> owned_ranges(const Address &private_ip, unsigned count) {
+    vector<HashRange> ranges;
+    std::size_t n = this->nodes_.size();
+    unsigned target = 0;
+
+    while (target < threads_.size() &&
+           threads_[target].private_ip() != private_ip) {
+      target++;
+    }
+
+    if (count == 0 || target == threads_.size()) {
+      return ranges;
+    }
+
+    if (load_bound_ > 0) {
+      return bounded_owned_ranges(target, count);
+    }
+
+    for (std::size_t p = 0; p < n; p++) {
+      if (this->nodes_[p].second != target) {
+        continue;
+      }
+
+      // a key reaches this virtual node unless count other threads come
+      // first; walking back stops at the previous virtual node of the target,
+      // whose own range covers the keys beyond it
+      vector<bool> seen(threads_.size(), false);
+      unsigned found = 0;
+      std::size_t j = p;
+
+      for (std::size_t step = 1; step < n; step++) {
+        j = (p + n - step) % n;
+        unsigned server = this->nodes_[j].second;
+
+        if (server == target) {
+          break;
+        }
+
+        if (!seen[server]) {
+          seen[server] = true;
+          if (++found == count) {
+            break;
+          }
+        }
+      }
+
+      if (j == p || (this->nodes_[j].second != target && found < count)) {
+        // fewer than count other threads in the ring
+        ranges.clear();
+        ranges.push_back(HashRange(this->nodes_[p].first,
+                                   this->nodes_[p].first));
+        return ranges;
+      }
+
+      ranges.push_back(HashRange(this->nodes_[j].first, this->nodes_[p].first));
+    }
+
+    return ranges;
   }
 
 private:
+  // the first count distinct threads, as indices into threads_, for keys
+  // that land on the virtual node at index: the ownership table's entries,
+  // then any further threads walking clockwise from the node
+  vector<unsigned> owners_at(std::size_t index, unsigned count) const {
+    std::size_t n = this->nodes_.size();
+    count = std::min(count, (unsigned)threads_.size());
+
+    const unsigned *row = &owners_[index * depth_];
+    vector<unsigned> servers(row, row + std::min(count, depth_));
+    vector<bool> seen(threads_.size(), false);
+    for (unsigned server : servers) {
+      seen[server] = true;
+    }
+
+    while (servers.size() < count) {
+      unsigned server = this->nodes_[index].second;
+      if (!seen[server]) {
+        seen[server] = true;
+        servers.push_back(server);
+      }
+
+      index = (index + 1) % n;
+    }
+
+    return servers;
+  }
+
+  // with a load bound, a thread's keys are no longer one ring segment per
+  // virtual node, so each node's owners are read off the table instead
+  vector<HashRange> bounded_owned_ranges(unsigned target, unsigned count) {
+    vector<HashRange> ranges;
+    std::size_t n = this->nodes_.size();
+
+    if (count >= threads_.size()) {
+      ranges.push_back(HashRange(this->nodes_[0].first, this->nodes_[0].first));
+      return ranges;
+    }
+
+    for (std::size_t p = 0; p < n; p++) {
+      vector<unsigned> servers = owners_at(p, count);
+
+      if (std::find(servers.begin(), servers.end(), target) != servers.end()) {
+        ranges.push_back(HashRange(this->nodes_[(p + n - 1) % n].first,
+                                   this->nodes_[p].first));
+      }
+    }
+
+    return ranges;
+  }
+
+  // recomputes, for every virtual node, the first depth_ distinct threads
+  // clockwise from it; this only runs on membership changes
+  void rebuild_owners() {
+    std::size_t n = this->nodes_.size();
+    depth_ = std::min(kOwnershipTableDepth, (unsigned)threads_.size());
+    owners_.assign(n * depth_, 0);
+
+    if (load_bound_ > 0) {
+      rebuild_bounded_owners();
+      return;
+    }
+
+    for (std::size_t i = 0; i < n; i++) {
+      unsigned *row = &owners_[i * depth_];
+      unsigned found = 0;
+
+      for (std::size_t j = i; found < depth_; j = (j + 1) % n) {
+        unsigned server = this->nodes_[j].second;
+
+        if (std::find(row, row + found, server) == row + found) {
+          row[found++] = server;
+        }
+      }
+    }
+  }
+
+  // Consistent hashing with bounded loads, with the ring segments as the
+  // load: for each rank of the table, the virtual nodes are visited in ring
+  // order, and each node's segment goes to the first thread clockwise that
+  // is not already an owner of the node and whose share of that rank is
+  // still under (1 + load_bound_) times the mean. A thread can overshoot the
+  // bound by one segment. Skipping full threads goes through a
+  // path-compressed table of the next node whose thread still has room, so
+  // a rebuild stays close to linear in the ring size.
+  void rebuild_bounded_owners() {
+    std::size_t n = this->nodes_.size();
+    unsigned server_count = threads_.size();
+
+    // segment lengths are shifted down so that their sum is exact in 64 bits
+    // and as a double
+    vector<uint64_t> arcs(n);
+    vector<vector<std::size_t>> positions(server_count);
+    uint64_t total = 0;
+
+    for (std::size_t i = 0; i < n; i++) {
+      arcs[i] = (uint64_t)(this->nodes_[i].first -
+                           this->nodes_[(i + n - 1) % n].first) >>
+                kLoadArcShift;
+      total += arcs[i];
+      positions[this->nodes_[i].second].push_back(i);
+    }
+
+    uint64_t cap =
+        (uint64_t)((1.0 + load_bound_) * (double)total / server_count);
+
+    vector<uint64_t> load(server_count);
+    vector<std::size_t> next(n + 1);
+
+    // the first node from p on (or n) whose thread has room
+    auto open = [&next](std::size_t p) {
+      while (next[p] != p) {
+        next[p] = next[next[p]];
+        p = next[p];
+      }
+
+      return p;
+    };
+
+    for (unsigned rank = 0; rank < depth_; rank++) {
+      std::fill(load.begin(), load.end(), 0);
+      for (std::size_t p = 0; p <= n; p++) {
+        next[p] = p;
+      }
+
+      for (std::size_t i = 0; i < n; i++) {
+        unsigned *row = &owners_[i * depth_];
+        unsigned chosen = server_count;
+
+        bool wrapped = false;
+        for (std::size_t p = open(i);; p = open(p + 1)) {
+          if (p == n) {
+            if (wrapped) {
+              break;
+            }
+
+            wrapped = true;
+            p = open(0);
+            if (p == n) {
+              break;
+            }
+          }
+
+          if (wrapped && p >= i) {
+            break;
+          }
+
+          unsigned server = this->nodes_[p].second;
+          if (std::find(row, row + rank, server) == row + rank) {
+            chosen = server;
+            break;
+          }
+        }
+
+        // every thread with room already owns the node; take the next one
+        // clockwise as the unbounded ring would
+        for (std::size_t j = i; chosen == server_count; j = (j + 1) % n) {
+          unsigned server = this->nodes_[j].second;
+          if (std::find(row, row + rank, server) == row + rank) {
+            chosen = server;
+          }
+        }
+
+        row[rank] = chosen;
+        bool had_room = load[chosen] < cap;
+        load[chosen] += arcs[i];
+
+        if (had_room && load[chosen] >= cap) {
+          for (std::size_t p : positions[chosen]) {
+            next[p] = p + 1;
+          }
+        }
+      }
+    }
+  }
+
+  unsigned virtual_nodes_;
+
+  // the bound on each thread's share above the mean; 0 places keys on the
+  // plain ring
+  double load_bound_;
+
   ServerThreadSet unique_servers;
   map<string, int> server_join_count;
+
+  // threads_ holds one entry per thread in the ring, which the virtual nodes
+  // refer to by index, and owners_ holds depth_ thread indices per virtual
+  // node
+  vector<ServerThread> threads_;
+  vector<unsigned> owners_;
+  unsigned depth_;
+};
+
+// A ring per tier, each created on first use with the tier's number of
+// virtual nodes and the configured load bound.
+template <typename Ring>
+class TierRingMap : public hmap<Tier, Ring, TierEnumHash> {
+public:
+  Ring &operator[](const Tier &tier) {
+    auto it = this->find(tier);
+
+    if (it == this->end()) {
+      it = this->insert({tier, Ring(virtual_node_count(tier),
+                                    ring_load_bound())})
+               .first;
+    }
+
+    return it->second;
+  }
 };
 
 // These typedefs are for brevity, and they were introduced after we removed
@@ -78,15 +445,15 @@ private:
 // GlobalHashRing, TierEnumHash> every time was tedious.
 typedef HashRing<GlobalHasher> GlobalHashRing;
 typedef HashRing<LocalHasher> LocalHashRing;
-typedef hmap<Tier, GlobalHashRing, TierEnumHash> GlobalRingMap;
-typedef hmap<Tier, LocalHashRing, TierEnumHash> LocalRingMap;
+typedef TierRingMap<GlobalHashRing> GlobalRingMap;
+typedef TierRingMap<LocalHashRing> LocalRingMap;
 
 class HashRingUtilInterface {
 public:
   virtual ServerThreadList get_responsible_threads(
       Address respond_address, const Key &key, bool metadata,
       GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-      map<Key, KeyReplication> &key_replication_map, SocketCache &pushers,
+      KeyReplicationMap &key_replication_map, SocketCache &pushers,
       const vector<Tier> &tiers, bool &succeed, unsigned &seed) = 0;
 
   ServerThreadList
@@ -106,7 +473,7 @@ public:
   virtual ServerThreadList get_responsible_threads(
       Address respond_address, const Key &key, bool metadata,
       GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-      map<Key, KeyReplication> &key_replication_map, SocketCache &pushers,
+      KeyReplicationMap &key_replication_map, SocketCache &pushers,
       const vector<Tier> &tiers, bool &succeed, unsigned &seed);
 };
 
@@ -135,6 +502,19 @@ void prepare_metadata_put_request(const Key &key, const string &value,
                                   map<Address, KeyRequest> &addr_request_map,
                                   Address response_address, unsigned &rid);
 
+// the calling thread's ReplicaSelector, which picks the replica each
+// metadata request goes to; the responses are recorded with answered
+ReplicaSelector &replica_selector();
+
+// the one of threads, which must not be empty, that the calling thread's
+// ReplicaSelector picks for a request; seed is the caller's, if it has one
+const ServerThread &select_replica(const ServerThreadList &threads,
+                                   unsigned *seed = nullptr);
+
+// reads the optional hashing section of the conf; this must run before any
+// ring is populated
+void configure_hashing(const YAML::Node &conf);
+
 extern HashRingUtilInterface *kHashRingUtil;
 
 #endif // INCLUDE_HASH_RING_HPP_
@@ -16,33 +16,173 @@
 #define KVS_INCLUDE_HASHERS_HPP_
 
 #include "kvs_threads.hpp"
+#include <cstdint>
 #include <vector>
 
-struct GlobalHasher {
-  uint32_t operator()(const ServerThread &th) {
-    // prepend a string to make the hash value different than
-    // what it would be on the naked input
-    return std::hash<string>{}("GLOBAL" + th.virtual_id());
+// legacy reproduces the original std::hash placement (including its 32-bit
+// global ring), so clusters created before seeded hashing keep their layout;
+// it is the default, and seeded hashing is only used where the conf sets
+// hashing: mode: seeded. Every node in a cluster must use the same mode and
+// seed.
+enum HashMode { legacy, seeded };
+
+// Both are defined in hash_ring.cpp and set by configure_hashing.
+extern HashMode kHashMode;
+extern uint64_t kHashSeed;
+
+// local ring positions are drawn with a different seed so that they are
+// independent of global ring positions
+const uint64_t kLocalHashSalt = 0x9E3779B97F4A7C15ULL;
+
+namespace xxh64 {
+
+const uint64_t kPrime1 = 11400714785074694791ULL;
+const uint64_t kPrime2 = 14029467366897019727ULL;
+const uint64_t kPrime3 = 1609587929392839161ULL;
+const uint64_t kPrime4 = 9650029242287828579ULL;
+const uint64_t kPrime5 = 2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// byte-wise little-endian loads keep ring layouts identical across platforms
+inline uint64_t read64(const unsigned char *p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+inline uint32_t read32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t mix_round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t val) {
+  acc ^= mix_round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+} // namespace xxh64
+
+// XXH64 of len bytes at data; no allocation and no dependence on the
+// standard library's hash implementation
+inline uint64_t hash64(const char *data, std::size_t len, uint64_t seed) {
+  using namespace xxh64;
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  const unsigned char *end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + kPrime1 + kPrime2;
+    uint64_t v2 = seed + kPrime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kPrime1;
+
+    do {
+      v1 = mix_round(v1, read64(p));
+      v2 = mix_round(v2, read64(p + 8));
+      v3 = mix_round(v3, read64(p + 16));
+      v4 = mix_round(v4, read64(p + 24));
+      p += 32;
+    } while (p + 32 <= end);
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge_round(h, v1);
+    h = merge_round(h, v2);
+    h = merge_round(h, v3);
+    h = merge_round(h, v4);
+  } else {
+    h = seed + kPrime5;
   }
 
-  uint32_t operator()(const Key &key) {
-    // prepend a string to make the hash value different than
-    // what it would be on the naked input
-    return std::hash<string>{}("GLOBAL" + key);
+  h += len;
+
+  for (; p + 8 <= end; p += 8) {
+    h ^= mix_round(0, read64(p));
+    h = rotl(h, 27) * kPrime1 + kPrime4;
   }
 
-  typedef uint32_t ResultType;
+  if (p + 4 <= end) {
+    h ^= read32(p) * kPrime1;
+    h = rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+
+  for (; p < end; p++) {
+    h ^= (*p) * kPrime5;
+    h = rotl(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t hash64(const string &s, uint64_t seed) {
+  return hash64(s.data(), s.size(), seed);
+}
+
+struct GlobalHasher {
+  typedef uint64_t ResultType;
+
+  // the position of virtual node virtual_num of thread th
+  ResultType operator()(const ServerThread &th, unsigned virtual_num) {
+    string virtual_id = th.id() + "_" + std::to_string(virtual_num);
+
+    if (kHashMode == HashMode::legacy) {
+      // prepend a string to make the hash value different than
+      // what it would be on the naked input
+      return (uint32_t)std::hash<string>{}("GLOBAL" + virtual_id);
+    }
+
+    return hash64(virtual_id, kHashSeed);
+  }
+
+  ResultType operator()(const Key &key) {
+    if (kHashMode == HashMode::legacy) {
+      return (uint32_t)std::hash<string>{}("GLOBAL" + key);
+    }
+
+    return hash64(key, kHashSeed);
+  }
 };
 
 struct LocalHasher {
-  typedef std::hash<string>::result_type ResultType;
+  typedef uint64_t ResultType;
 
-  ResultType operator()(const ServerThread &th) {
-    return std::hash<string>{}(std::to_string(th.tid()) + "_" +
-                               std::to_string(th.virtual_num()));
+  ResultType operator()(const ServerThread &th, unsigned virtual_num) {
+    if (kHashMode == HashMode::legacy) {
+      return std::hash<string>{}(std::to_string(th.tid()) + "_" +
+                                 std::to_string(virtual_num));
+    }
+
+    // hash the (tid, virtual_num) pair as 8 little-endian bytes
+    char buffer[8];
+    uint64_t packed = ((uint64_t)th.tid() << 32) | virtual_num;
+    for (unsigned i = 0; i < 8; i++) {
+      buffer[i] = (char)(packed >> (8 * i));
+    }
+
+    return hash64(buffer, sizeof(buffer), kHashSeed ^ kLocalHashSalt);
   }
 
-  ResultType operator()(const Key &key) { return std::hash<string>{}(key); }
+  ResultType operator()(const Key &key) {
+    if (kHashMode == HashMode::legacy) {
+      return std::hash<string>{}(key);
+    }
+
+    return hash64(key, kHashSeed ^ kLocalHashSalt);
+  }
 };
 
 #endif // KVS_INCLUDE_HASHERS_HPP_
@@ -0,0 +1,82 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_ADMISSION_CONTROL_HPP_
+#define INCLUDE_KVS_ADMISSION_CONTROL_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+#include "anna.pb.h"
+
+// the error a shed request is answered with. AnnaError belongs to the shared
+// protocol package, which has no error for an overloaded thread; TIMEOUT,
+// which clients already count as a request the KVS did not serve, stands in
+// for it, and the clients retry it on another replica.
+const AnnaError kOverloadedError = AnnaError::TIMEOUT;
+
+// Decides when a thread sheds its requests rather than let its queue grow.
+// A ZMQ socket does not say how many messages it holds, so the thread tracks
+// how long its request socket has stayed backlogged instead: from the first
+// drain that stopped at the budget with requests still queued to the next
+// one that emptied the socket, every request that arrived waited behind
+// others. Once that has gone on for more than max_backlog milliseconds, the
+// thread answers requests with kOverloadedError without touching their keys
+// until a drain empties the socket again; shedding is cheap, so that happens
+// quickly. A max_backlog of 0 disables shedding.
+class AdmissionControl {
+  std::chrono::milliseconds max_backlog_;
+
+  bool backlogged_;
+  std::chrono::steady_clock::time_point since_;
+
+  uint64_t shed_;
+
+public:
+  explicit AdmissionControl(unsigned max_backlog)
+      : max_backlog_(max_backlog), backlogged_(false), shed_(0) {}
+
+  bool enabled() const { return max_backlog_.count() > 0; }
+
+  // records whether the drain that ended at now left requests queued
+  void record_drain(bool backlogged,
+                    std::chrono::steady_clock::time_point now) {
+    if (backlogged && !backlogged_) {
+      since_ = now;
+    }
+
+    backlogged_ = backlogged;
+  }
+
+  // how long the socket has stayed backlogged as of now, in milliseconds
+  uint64_t backlog(std::chrono::steady_clock::time_point now) const {
+    if (!backlogged_) {
+      return 0;
+    }
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now - since_)
+        .count();
+  }
+
+  bool overloaded(std::chrono::steady_clock::time_point now) const {
+    return enabled() && backlogged_ && now - since_ > max_backlog_;
+  }
+
+  void record_shed() { shed_ += 1; }
+
+  // the requests shed so far
+  uint64_t shed() const { return shed_; }
+};
+
+#endif // INCLUDE_KVS_ADMISSION_CONTROL_HPP_
@@ -15,31 +15,260 @@
 #ifndef INCLUDE_KVS_BASE_KV_STORE_HPP_
 #define INCLUDE_KVS_BASE_KV_STORE_HPP_
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "anna.pb.h"
 #include "lattices/core_lattices.hpp"
+#include "value_bytes.hpp"
 
+// An open-addressing hash table with linear probing. Slots only hold a hash
+// fragment and an index, so a probe sequence stays within a few cache lines;
+// keys and values live in fixed-size chunks (a per-store arena) that are
+// recycled through a free list instead of being allocated per node.
 template <typename K, typename V> class KVStore {
 protected:
-  MapLattice<K, V> db;
+  struct Entry {
+    K key;
+    V value;
+    // serialized form of value, cleared whenever value is merged
+    std::string serialized;
+    // heap_bytes(value), kept up to date as values are merged in
+    std::size_t value_bytes = 0;
+  };
+
+  struct Slot {
+    uint32_t hash;
+    uint32_t index;
+  };
+
+  static const uint32_t kEmptySlot = UINT32_MAX;
+  static const std::size_t kEntriesPerChunk = 1024;
+  static const std::size_t kInitialSlots = 1024;
+
+  std::vector<Slot> slots_;
+  std::vector<std::unique_ptr<Entry[]>> chunks_;
+  std::vector<uint32_t> free_entries_;
+  uint32_t next_entry_;
+  std::size_t size_;
+  std::size_t key_bytes_;
+  std::hash<K> hasher_;
+
+  static uint32_t hash_fragment(std::size_t h) {
+    return static_cast<uint32_t>(h ^ (h >> 32));
+  }
+
+  std::size_t mask() const { return slots_.size() - 1; }
+
+  Entry &entry(uint32_t index) {
+    return chunks_[index / kEntriesPerChunk][index % kEntriesPerChunk];
+  }
+
+  // returns the slot holding k, or the empty slot that ends its probe
+  // sequence if k is not in the table
+  std::size_t probe(const K &k, uint32_t hash) {
+    std::size_t pos = hash & mask();
+
+    while (slots_[pos].index != kEmptySlot) {
+      if (slots_[pos].hash == hash && entry(slots_[pos].index).key == k) {
+        return pos;
+      }
+
+      pos = (pos + 1) & mask();
+    }
+
+    return pos;
+  }
+
+  uint32_t allocate_entry() {
+    if (free_entries_.size() > 0) {
+      uint32_t index = free_entries_.back();
+      free_entries_.pop_back();
+      return index;
+    }
+
+    if (next_entry_ == chunks_.size() * kEntriesPerChunk) {
+      chunks_.push_back(std::unique_ptr<Entry[]>(new Entry[kEntriesPerChunk]));
+    }
+
+    return next_entry_++;
+  }
+
+  // the bytes of memory an entry takes up: its arena entry, its share of
+  // the slot table (which is kept at least a quarter empty), and what its
+  // key, value and serialized form hold on the heap. A serialized form filled
+  // in by a read is only counted from the next write on.
+  static unsigned entry_bytes(const Entry &e) {
+    return sizeof(Entry) + sizeof(Slot) * 4 / 3 + heap_bytes(e.key) +
+           e.value_bytes + heap_bytes(e.serialized);
+  }
+
+  // slots hold the hash fragment, so growing never touches the keys
+  void grow() {
+    std::vector<Slot> old_slots(slots_.size() * 2, Slot{0, kEmptySlot});
+    old_slots.swap(slots_);
+
+    for (const Slot &slot : old_slots) {
+      if (slot.index != kEmptySlot) {
+        std::size_t pos = slot.hash & mask();
+        while (slots_[pos].index != kEmptySlot) {
+          pos = (pos + 1) & mask();
+        }
+
+        slots_[pos] = slot;
+      }
+    }
+  }
+
+  Entry *find_entry(const K &k) {
+    std::size_t pos = probe(k, hash_fragment(hasher_(k)));
+    return slots_[pos].index == kEmptySlot ? nullptr
+                                           : &entry(slots_[pos].index);
+  }
+
+  // returns the entry for k, inserting an empty value if k is absent
+  Entry &find_or_insert(const K &k) {
+    uint32_t hash = hash_fragment(hasher_(k));
+    std::size_t pos = probe(k, hash);
+
+    if (slots_[pos].index != kEmptySlot) {
+      return entry(slots_[pos].index);
+    }
+
+    // keep the load factor under 3/4
+    if ((size_ + 1) * 4 > slots_.size() * 3) {
+      grow();
+      pos = probe(k, hash);
+    }
+
+    uint32_t index = allocate_entry();
+    Entry &e = entry(index);
+    e.key = k;
+    slots_[pos] = Slot{hash, index};
+    size_ += 1;
+    key_bytes_ += k.size();
+
+    return e;
+  }
 
 public:
-  KVStore<K, V>() {}
+  KVStore<K, V>()
+      : slots_(kInitialSlots, Slot{0, kEmptySlot}), next_entry_(0), size_(0),
+        key_bytes_(0) {}
 
-  KVStore<K, V>(MapLattice<K, V> &other) { db = other; }
+  KVStore<K, V>(MapLattice<K, V> &other) : KVStore<K, V>() {
+    for (const auto &pair : other.reveal()) {
+      put(pair.first, pair.second);
+    }
+  }
 
   V get(const K &k, AnnaError &error) {
-    if (!db.contains(k).reveal()) {
+    uint32_t hash = hash_fragment(hasher_(k));
+    std::size_t pos = probe(k, hash);
+
+    if (slots_[pos].index == kEmptySlot) {
       error = AnnaError::KEY_DNE;
+      return V();
+    }
+
+    return entry(slots_[pos].index).value;
+  }
+
+  // returns nullptr if k is absent; otherwise, cache points at the serialized
+  // form of the value, which is empty if the value has been merged since it
+  // was last filled in
+  const V *find(const K &k, std::string *&cache) {
+    Entry *e = find_entry(k);
+    if (e == nullptr) {
+      return nullptr;
     }
 
-    return db.at(k);
+    cache = &e->serialized;
+    return &e->value;
   }
 
-  void put(const K &k, const V &v) { return db.at(k).merge(v); }
+  // as find, and bytes is set to what put returns if it leaves the value
+  // unchanged
+  const V *find(const K &k, std::string *&cache, unsigned &bytes) {
+    Entry *e = find_entry(k);
+    if (e == nullptr) {
+      return nullptr;
+    }
 
-  unsigned size(const K &k) { return db.at(k).size().reveal(); }
+    cache = &e->serialized;
+    bytes = entry_bytes(*e);
+    return &e->value;
+  }
 
-  void remove(const K &k) { db.remove(k); }
+  // merges v into the stored value and returns the bytes the key now takes
+  // up, so a PUT only walks the probe sequence once
+  unsigned put(const K &k, const V &v) {
+    Entry &e = find_or_insert(k);
+    merge_counting(e.value, v, e.value_bytes);
+    e.serialized.clear();
+    return entry_bytes(e);
+  }
+
+  unsigned size(const K &k) { return find_or_insert(k).value.size().reveal(); }
+
+  // loads the first slot of k's probe sequence into cache, so the lookups of
+  // a batch of keys can overlap their cache misses
+  void prefetch(const K &k) const {
+#if defined(__GNUC__)
+    __builtin_prefetch(&slots_[hash_fragment(hasher_(k)) & mask()]);
+#endif
+  }
+
+  void remove(const K &k) {
+    uint32_t hash = hash_fragment(hasher_(k));
+    std::size_t hole = probe(k, hash);
+
+    if (slots_[hole].index == kEmptySlot) {
+      return;
+    }
+
+    // release the entry back to the arena
+    uint32_t index = slots_[hole].index;
+    Entry &e = entry(index);
+    key_bytes_ -= e.key.size();
+    e.key = K();
+    e.value = V();
+    e.serialized = std::string();
+    e.value_bytes = 0;
+    free_entries_.push_back(index);
+    size_ -= 1;
+
+    // backward-shift deletion: pull later entries of the probe run into the
+    // hole so lookups never have to skip over tombstones
+    std::size_t pos = hole;
+    while (true) {
+      pos = (pos + 1) & mask();
+      if (slots_[pos].index == kEmptySlot) {
+        break;
+      }
+
+      std::size_t home = slots_[pos].hash & mask();
+      if (((pos - home) & mask()) >= ((pos - hole) & mask())) {
+        slots_[hole] = slots_[pos];
+        hole = pos;
+      }
+    }
+
+    slots_[hole].index = kEmptySlot;
+  }
+
+  std::size_t key_count() const { return size_; }
+
+  // approximate number of bytes held by the table and the arena; this does
+  // not include memory owned by the lattices themselves
+  unsigned long long memory_usage() const {
+    return slots_.capacity() * sizeof(Slot) +
+           chunks_.size() * kEntriesPerChunk * sizeof(Entry) +
+           free_entries_.capacity() * sizeof(uint32_t) + key_bytes_;
+  }
 };
 
 #endif // INCLUDE_KVS_BASE_KV_STORE_HPP_
@@ -0,0 +1,179 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_CACHE_FANOUT_HPP_
+#define INCLUDE_KVS_CACHE_FANOUT_HPP_
+
+#include <chrono>
+
+#include "server_utils.hpp"
+
+// A cache that lists this among its keys is sent invalidations, tuples with
+// the key and the invalidate flag but no value, instead of the new values of
+// the keys it holds.
+const string kCacheInvalidationsOnly = "ANNA_CACHE_INVALIDATIONS_ONLY";
+
+// Pushes the changed keys that caches hold to those caches. Each key is read
+// and serialized once per flush, into a tuple that is appended as is to the
+// update of every cache that wants it; updates are KeyRequests, whose
+// repeated tuples concatenate on the wire, so no update is serialized as a
+// whole. A cache is sent at most one update per min_interval_; the keys that
+// change in between wait for the next one, and are sent with their values as
+// of then.
+class CacheFanout {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Cache {
+    set<Key> pending_;
+    TimePoint last_sent_;
+    bool sent_ = false;
+    bool invalidations_only_ = false;
+  };
+
+  std::chrono::microseconds min_interval_;
+  map<Address, Cache> caches_;
+
+  // the keys waiting to be sent, over all caches
+  unsigned pending_;
+
+  // the start of every update, a KeyRequest with nothing but its type
+  string header_;
+
+  // the encoded tuple for key, as a KeyRequest of that one tuple, or an
+  // empty string if the key is not stored here. Caches are clients, so a
+  // compressed value is sent as the client wrote it.
+  const string &encode(const Key &key, bool invalidation,
+                       StoredKeyMap &stored_key_map, SerializerMap &serializers,
+                       map<Key, string> &encoded, logger log) {
+    auto it = encoded.find(key);
+    if (it != encoded.end()) {
+      return it->second;
+    }
+
+    string &bytes = encoded[key];
+    auto stored = stored_key_map.find(key);
+    if (stored == stored_key_map.end()) {
+      return bytes;
+    }
+
+    KeyRequest piece;
+    KeyTuple *tp = piece.add_tuples();
+    tp->set_key(key);
+    tp->set_lattice_type(stored->second.type_);
+
+    if (invalidation) {
+      tp->set_invalidate(true);
+    } else {
+      AnnaError error = AnnaError::NO_ERROR;
+      serializers[stored->second.type_]->get(key, tp->mutable_payload(),
+                                             error);
+      if (error != AnnaError::NO_ERROR) {
+        return bytes;
+      }
+
+      decompress_payload(stored->second.type_, tp->mutable_payload(), log);
+    }
+
+    piece.SerializeToString(&bytes);
+    return bytes;
+  }
+
+public:
+  CacheFanout(unsigned min_interval = 0)
+      : min_interval_(std::chrono::milliseconds(min_interval)), pending_(0) {
+    KeyRequest header;
+    header.set_type(RequestType::PUT);
+    header.SerializeToString(&header_);
+  }
+
+  void set_invalidations_only(const Address &cache_ip, bool only) {
+    caches_[cache_ip].invalidations_only_ = only;
+  }
+
+  bool invalidations_only(const Address &cache_ip) const {
+    auto it = caches_.find(cache_ip);
+    return it != caches_.end() && it->second.invalidations_only_;
+  }
+
+  // drops a cache that has gone away, with its pending keys
+  void forget(const Address &cache_ip) {
+    auto it = caches_.find(cache_ip);
+    if (it != caches_.end()) {
+      pending_ -= it->second.pending_.size();
+      caches_.erase(it);
+    }
+  }
+
+  // records that key has changed, for each of the caches that hold it
+  void add(const Key &key, const vector<Address> &cache_ips) {
+    for (const Address &cache_ip : cache_ips) {
+      if (caches_[cache_ip].pending_.insert(key).second) {
+        pending_ += 1;
+      }
+    }
+  }
+
+  unsigned pending() const { return pending_; }
+
+  // sends every cache whose interval is up the keys it has pending, and
+  // returns the number of caches sent an update
+  unsigned flush(StoredKeyMap &stored_key_map, SerializerMap &serializers,
+                 SocketCache &pushers, logger log) {
+    TimePoint now = std::chrono::steady_clock::now();
+    map<Key, string> values;
+    map<Key, string> invalidations;
+    unsigned sent = 0;
+
+    for (auto &pair : caches_) {
+      Cache &cache = pair.second;
+      if (cache.pending_.empty() ||
+          (cache.sent_ && now - cache.last_sent_ < min_interval_)) {
+        continue;
+      }
+
+      zmq::socket_t *socket =
+          &pushers[CacheThread(pair.first, 0).cache_update_connect_address()];
+      string update = header_;
+
+      for (const Key &key : cache.pending_) {
+        const string &bytes =
+            cache.invalidations_only_
+                ? encode(key, true, stored_key_map, serializers, invalidations,
+                         log)
+                : encode(key, false, stored_key_map, serializers, values, log);
+        update += bytes;
+
+        // ship the chunk once it is large enough, as gossip does
+        if (update.size() >= kGossipChunkSize) {
+          kZmqUtil->send_string(update, socket);
+          update = header_;
+        }
+      }
+
+      if (update.size() > header_.size()) {
+        kZmqUtil->send_string(update, socket);
+      }
+
+      pending_ -= cache.pending_.size();
+      cache.pending_.clear();
+      cache.last_sent_ = now;
+      cache.sent_ = true;
+      sent += 1;
+    }
+
+    return sent;
+  }
+};
+
+#endif // INCLUDE_KVS_CACHE_FANOUT_HPP_
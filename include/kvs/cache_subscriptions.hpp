@@ -0,0 +1,262 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_CACHE_SUBSCRIPTIONS_HPP_
+#define INCLUDE_KVS_CACHE_SUBSCRIPTIONS_HPP_
+
+#include <unordered_set>
+
+#include "cache_fanout.hpp"
+#include "metadata.pb.h"
+
+// Which caches hold which keys, as the caches register them. Keys and caches
+// are both interned to small integer IDs, which are reused once freed: each
+// cache keeps the IDs of its keys, and each key a bitmap of the IDs of the
+// caches that hold it, so a key is stored once however many caches hold it.
+//
+// Registrations are CachedKeys, with a version. One that is at the version
+// last applied is skipped, one whose snapshot is no newer than that version
+// only has its later deltas applied, and any other is compared in full.
+class CacheSubscriptions {
+  struct Cache {
+    unsigned id_;
+    uint64_t version_ = 0;
+    bool invalidations_only_ = false;
+    std::unordered_set<unsigned> keys_;
+  };
+
+  struct Subscribers {
+    Key key_;
+    vector<uint64_t> caches_;
+    unsigned count_ = 0;
+  };
+
+  hmap<Address, Cache> caches_;
+  vector<Address> cache_addresses_;
+  vector<unsigned> free_cache_ids_;
+
+  hmap<Key, unsigned> key_ids_;
+  vector<Subscribers> keys_;
+  vector<unsigned> free_key_ids_;
+
+  Cache &cache(const Address &address) {
+    auto it = caches_.find(address);
+    if (it != caches_.end()) {
+      return it->second;
+    }
+
+    Cache &cache = caches_[address];
+    if (free_cache_ids_.empty()) {
+      cache.id_ = cache_addresses_.size();
+      cache_addresses_.push_back(address);
+    } else {
+      cache.id_ = free_cache_ids_.back();
+      free_cache_ids_.pop_back();
+      cache_addresses_[cache.id_] = address;
+    }
+
+    return cache;
+  }
+
+  void subscribe(Cache &cache, const Key &key) {
+    if (key == kCacheInvalidationsOnly) {
+      cache.invalidations_only_ = true;
+      return;
+    }
+
+    auto it = key_ids_.find(key);
+    unsigned id;
+
+    if (it != key_ids_.end()) {
+      id = it->second;
+    } else if (free_key_ids_.empty()) {
+      id = keys_.size();
+      keys_.push_back(Subscribers());
+    } else {
+      id = free_key_ids_.back();
+      free_key_ids_.pop_back();
+    }
+
+    if (!cache.keys_.insert(id).second) {
+      return;
+    }
+
+    Subscribers &subscribers = keys_[id];
+    if (subscribers.count_ == 0) {
+      subscribers.key_ = key;
+      key_ids_[key] = id;
+    }
+
+    unsigned word = cache.id_ / 64;
+    if (subscribers.caches_.size() <= word) {
+      subscribers.caches_.resize(word + 1, 0);
+    }
+
+    subscribers.caches_[word] |= uint64_t(1) << (cache.id_ % 64);
+    subscribers.count_ += 1;
+  }
+
+  void unsubscribe(Cache &cache, unsigned id) {
+    if (cache.keys_.erase(id) == 0) {
+      return;
+    }
+
+    Subscribers &subscribers = keys_[id];
+    subscribers.caches_[cache.id_ / 64] &= ~(uint64_t(1) << (cache.id_ % 64));
+    subscribers.count_ -= 1;
+
+    if (subscribers.count_ == 0) {
+      key_ids_.erase(subscribers.key_);
+      subscribers = Subscribers();
+      free_key_ids_.push_back(id);
+    }
+  }
+
+  void unsubscribe(Cache &cache, const Key &key) {
+    if (key == kCacheInvalidationsOnly) {
+      cache.invalidations_only_ = false;
+      return;
+    }
+
+    auto it = key_ids_.find(key);
+    if (it != key_ids_.end()) {
+      unsubscribe(cache, it->second);
+    }
+  }
+
+  void apply(Cache &cache, const CachedKeysDelta &delta) {
+    for (const Key &key : delta.added()) {
+      subscribe(cache, key);
+    }
+
+    for (const Key &key : delta.removed()) {
+      unsubscribe(cache, key);
+    }
+  }
+
+public:
+  // applies the registration of the cache at address, and returns whether
+  // anything had to be compared
+  bool update(const Address &address, const CachedKeys &registration) {
+    uint64_t version = registration.deltas_size() > 0
+                           ? registration.deltas().rbegin()->version()
+                           : registration.snapshot_version();
+
+    bool known = caches_.find(address) != caches_.end();
+    Cache &cache = this->cache(address);
+
+    if (known && version != 0 && version == cache.version_) {
+      return false;
+    }
+
+    if (known && version != 0 &&
+        cache.version_ >= registration.snapshot_version() &&
+        cache.version_ < version) {
+      for (const CachedKeysDelta &delta : registration.deltas()) {
+        if (delta.version() > cache.version_) {
+          apply(cache, delta);
+        }
+      }
+
+      cache.version_ = version;
+      return true;
+    }
+
+    // the keys as of version, and the marker, which is not a key
+    std::unordered_set<Key> keys(registration.keys().begin(),
+                                 registration.keys().end());
+    for (const CachedKeysDelta &delta : registration.deltas()) {
+      keys.insert(delta.added().begin(), delta.added().end());
+      for (const Key &key : delta.removed()) {
+        keys.erase(key);
+      }
+    }
+
+    cache.invalidations_only_ = keys.erase(kCacheInvalidationsOnly) > 0;
+
+    vector<unsigned> dropped;
+    for (unsigned id : cache.keys_) {
+      if (keys.find(keys_[id].key_) == keys.end()) {
+        dropped.push_back(id);
+      }
+    }
+
+    for (unsigned id : dropped) {
+      unsubscribe(cache, id);
+    }
+
+    for (const Key &key : keys) {
+      subscribe(cache, key);
+    }
+
+    cache.version_ = version;
+    return true;
+  }
+
+  // forgets the cache at address, which has gone away
+  void remove(const Address &address) {
+    auto it = caches_.find(address);
+    if (it == caches_.end()) {
+      return;
+    }
+
+    Cache &cache = it->second;
+    vector<unsigned> ids(cache.keys_.begin(), cache.keys_.end());
+    for (unsigned id : ids) {
+      unsubscribe(cache, id);
+    }
+
+    cache_addresses_[cache.id_] = "";
+    free_cache_ids_.push_back(cache.id_);
+    caches_.erase(it);
+  }
+
+  // the addresses of the caches that hold key, in the order of their IDs
+  void caches(const Key &key, vector<Address> &addresses) const {
+    addresses.clear();
+
+    auto it = key_ids_.find(key);
+    if (it == key_ids_.end()) {
+      return;
+    }
+
+    const vector<uint64_t> &words = keys_[it->second].caches_;
+    for (unsigned word = 0; word < words.size(); word++) {
+      for (uint64_t bits = words[word]; bits != 0; bits &= bits - 1) {
+        unsigned id = word * 64 + __builtin_ctzll(bits);
+        addresses.push_back(cache_addresses_[id]);
+      }
+    }
+  }
+
+  bool invalidations_only(const Address &address) const {
+    auto it = caches_.find(address);
+    return it != caches_.end() && it->second.invalidations_only_;
+  }
+
+  uint64_t version(const Address &address) const {
+    auto it = caches_.find(address);
+    return it == caches_.end() ? 0 : it->second.version_;
+  }
+
+  // the number of keys that one cache or another holds
+  unsigned key_count() const { return key_ids_.size(); }
+
+  unsigned key_count(const Address &address) const {
+    auto it = caches_.find(address);
+    return it == caches_.end() ? 0 : it->second.keys_.size();
+  }
+};
+
+#endif // INCLUDE_KVS_CACHE_SUBSCRIPTIONS_HPP_
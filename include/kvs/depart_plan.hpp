@@ -0,0 +1,202 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_DEPART_PLAN_HPP_
+#define INCLUDE_KVS_DEPART_PLAN_HPP_
+
+#include <algorithm>
+
+#include "hash_ring.hpp"
+#include "server_utils.hpp"
+
+// the most keys a departing thread keeps queued for its new owners; the plan
+// queues more once the event loop has sent enough of them
+const unsigned kDepartQueueSize = 10 * DATA_REDISTRIBUTE_THRESHOLD;
+
+// How a departing thread hands its keys off. The rings, which no longer hold
+// this node, are cut at the virtual nodes of every tier into ranges, and the
+// keys in a range have the same owners in every tier's ring, so the nodes a
+// key goes to are resolved once per range and replication factor rather than
+// once per key; only the thread within each node is looked up per key, and
+// once for all of the key's nodes in a tier, since every node has the same
+// local ring. The event loop walks the plan in hash order, a batch of keys
+// at a time, as it sends the keys queued before, so nothing is computed or
+// held for all of the keys up front.
+class DepartPlan {
+  typedef StoredKeyMap::HashType HashType;
+
+  // the largest hash of every range but the last, which runs to the top of
+  // the hash space
+  vector<HashType> cuts_;
+
+  // the range being walked and the walk's place in it
+  unsigned range_;
+  StoredKeyMap::IndexPosition position_;
+  bool active_;
+
+  // the owners of the current range per tier and global replication factor
+  map<pair<Tier, unsigned>, ServerThreadList> owners_;
+
+  HashType range_end() const {
+    return range_ < cuts_.size() ? cuts_[range_]
+                                 : std::numeric_limits<HashType>::max();
+  }
+
+  const ServerThreadList &owners(const Key &key, Tier tier, unsigned rep,
+                                 GlobalRingMap &global_hash_rings) {
+    auto it = owners_.find({tier, rep});
+    if (it == owners_.end()) {
+      it = owners_
+               .insert({{tier, rep},
+                        responsible_global(key, rep, global_hash_rings[tier])})
+               .first;
+    }
+
+    return it->second;
+  }
+
+  // adds the gossip addresses of the threads that take key over to
+  // join_gossip_map
+  void route(const Key &key, GlobalRingMap &global_hash_rings,
+             LocalRingMap &local_hash_rings,
+             const KeyReplicationMap &key_replication_map,
+             AddressKeysetMap &join_gossip_map) {
+    if (is_metadata(key)) {
+      for (const ServerThread &thread :
+           kHashRingUtil->get_responsible_threads_metadata(
+               key, global_hash_rings[Tier::MEMORY],
+               local_hash_rings[Tier::MEMORY])) {
+        join_gossip_map[thread.gossip_connect_address()].insert(key);
+      }
+
+      return;
+    }
+
+    auto replication = key_replication_map.find(key);
+
+    for (const Tier &tier : kAllTiers) {
+      // a key whose replication factor this thread never learned goes to its
+      // owners under the default factors rather than nowhere
+      unsigned global_rep = 0;
+      unsigned local_rep = kDefaultLocalReplication;
+      auto metadata = kTierMetadata.find(tier);
+      if (metadata != kTierMetadata.end()) {
+        global_rep = metadata->second.default_replication_;
+      }
+
+      if (replication != key_replication_map.end()) {
+        const KeyReplication &rep = replication->second;
+        auto global = rep.global_replication_.find(tier);
+        auto local = rep.local_replication_.find(tier);
+        global_rep = global == rep.global_replication_.end() ? 0
+                                                             : global->second;
+        local_rep = local == rep.local_replication_.end() ? 0 : local->second;
+      }
+
+      const ServerThreadList &nodes =
+          owners(key, tier, global_rep, global_hash_rings);
+      if (nodes.empty()) {
+        continue;
+      }
+
+      set<unsigned> tids =
+          responsible_local(key, local_rep, local_hash_rings[tier]);
+
+      for (const ServerThread &node : nodes) {
+        for (unsigned tid : tids) {
+          join_gossip_map[ServerThread(node.public_ip(), node.private_ip(),
+                                       tid)
+                              .gossip_connect_address()]
+              .insert(key);
+        }
+      }
+    }
+  }
+
+public:
+  DepartPlan() : range_(0), active_(false) {}
+
+  // plans the hand-off of every key in stored_key_map; global_hash_rings
+  // must no longer hold this node
+  void start(GlobalRingMap &global_hash_rings,
+             const StoredKeyMap &stored_key_map) {
+    cuts_.clear();
+
+    for (const Tier &tier : kAllTiers) {
+      GlobalHashRing &ring = global_hash_rings[tier];
+      for (auto it = ring.begin(); it != ring.end(); ++it) {
+        cuts_.push_back(it->first);
+      }
+    }
+
+    std::sort(cuts_.begin(), cuts_.end());
+    cuts_.erase(std::unique(cuts_.begin(), cuts_.end()), cuts_.end());
+
+    // the keys past the last cut land on the first virtual nodes, as the
+    // keys up to the first cut do, so the two ranges share owners; they are
+    // simply resolved twice
+    range_ = 0;
+    position_ = StoredKeyMap::IndexPosition(0, Key());
+    owners_.clear();
+    active_ = stored_key_map.indexed() > 0;
+  }
+
+  // whether some of the keys have not been queued yet
+  bool active() const { return active_; }
+
+  // the number of ranges, and how many have been queued in full
+  unsigned ranges() const { return cuts_.size() + 1; }
+
+  unsigned ranges_done() const { return active_ ? range_ : ranges(); }
+
+  // queues the next keys of the plan for their new owners in
+  // join_gossip_map, stopping after batch keys; returns the number of keys
+  // it went through
+  unsigned next(const StoredKeyMap &stored_key_map,
+                GlobalRingMap &global_hash_rings,
+                LocalRingMap &local_hash_rings,
+                const KeyReplicationMap &key_replication_map,
+                AddressKeysetMap &join_gossip_map, unsigned batch) {
+    unsigned walked = 0;
+
+    while (active_ && walked < batch) {
+      HashType hi = range_end();
+      bool done = stored_key_map.walk_index(
+          position_, hi, batch - walked, [&](const Key &key) {
+            walked += 1;
+            route(key, global_hash_rings, local_hash_rings,
+                  key_replication_map, join_gossip_map);
+          });
+
+      if (!done) {
+        break;
+      }
+
+      owners_.clear();
+      range_ += 1;
+
+      if (range_ > cuts_.size() ||
+          hi == std::numeric_limits<HashType>::max()) {
+        range_ = cuts_.size() + 1;
+        active_ = false;
+      } else {
+        position_ = StoredKeyMap::IndexPosition(hi + 1, Key());
+      }
+    }
+
+    return walked;
+  }
+};
+
+#endif // INCLUDE_KVS_DEPART_PLAN_HPP_
@@ -0,0 +1,197 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_DISK_READER_HPP_
+#define INCLUDE_KVS_DISK_READER_HPP_
+
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sys/eventfd.h>
+#include <thread>
+
+#include "log_store.hpp"
+
+// A GET on a disk thread that waits for its reads, with what its response
+// needs.
+struct ParkedRead {
+  Key key_;
+  Address address_;
+  string response_id_;
+  bool invalidate_;
+  LogReadPlan plan_;
+
+  // one per record of the plan once read, or empty if a read failed
+  vector<string> payloads_;
+
+  // the records folded together, once collected
+  string payload_;
+  bool found_;
+};
+
+// A pool of I/O threads that serves a disk thread's GETs off its event loop,
+// so that a slow read only delays its own response. submit plans the reads
+// of a GET with the LogStore and parks the GET here, and the event loop goes
+// on with other work; the I/O threads pread the records, and signal an
+// eventfd that the event loop polls next to its sockets. collect then folds
+// the records together. The store itself is only touched by submit and
+// collect, from the event loop.
+class DiskReader {
+  LogStore *store_;
+  int event_fd_;
+  vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable pending_;
+  std::deque<ParkedRead *> queue_;
+  vector<ParkedRead *> done_;
+  bool stopping_;
+
+  // the GETs submitted and not yet collected
+  unsigned in_flight_;
+
+  // reads the records of get's plan
+  void load(ParkedRead *get) {
+    const LogReadPlan &plan = get->plan_;
+    get->payloads_.resize(plan.records_.size());
+
+    for (unsigned i = 0; i < plan.records_.size(); i++) {
+      const LogRecord &record = plan.records_[i];
+      string &payload = get->payloads_[i];
+      payload.resize(record.length_);
+
+      size_t done = 0;
+      while (done < record.length_) {
+        ssize_t n = pread(plan.fds_[i], &payload[done], record.length_ - done,
+                          record.offset_ + done);
+        if (n <= 0) {
+          get->payloads_.clear();
+          return;
+        }
+
+        done += n;
+      }
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+      pending_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+
+      ParkedRead *get = queue_.front();
+      queue_.pop_front();
+
+      lock.unlock();
+      load(get);
+      lock.lock();
+
+      done_.push_back(get);
+      uint64_t one = 1;
+      if (write(event_fd_, &one, sizeof(one)) < 0) {
+        std::cerr << "Failed to signal a finished disk read." << std::endl;
+      }
+    }
+  }
+
+public:
+  DiskReader(LogStore *store, unsigned thread_count)
+      : store_(store), stopping_(false), in_flight_(0) {
+    event_fd_ = eventfd(0, EFD_NONBLOCK);
+
+    for (unsigned i = 0; i < thread_count; i++) {
+      threads_.push_back(std::thread(&DiskReader::run, this));
+    }
+  }
+
+  // finishes the reads already submitted before it returns
+  ~DiskReader() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+
+    pending_.notify_all();
+    for (std::thread &thread : threads_) {
+      thread.join();
+    }
+
+    for (ParkedRead *get : done_) {
+      delete get;
+    }
+
+    close(event_fd_);
+  }
+
+  // readable while finished reads are waiting to be collected
+  int fd() const { return event_fd_; }
+
+  unsigned in_flight() const { return in_flight_; }
+
+  // parks a GET of key until its records are read; returns false, and parks
+  // nothing, if the key is not stored or its value is cached
+  bool submit(const Key &key, const Address &address,
+              const string &response_id, bool invalidate) {
+    ParkedRead *get = new ParkedRead();
+    if (!store_->plan_read(key, get->plan_)) {
+      delete get;
+      return false;
+    }
+
+    get->key_ = key;
+    get->address_ = address;
+    get->response_id_ = response_id;
+    get->invalidate_ = invalidate;
+    get->found_ = false;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_.push_back(get);
+    }
+
+    in_flight_ += 1;
+    pending_.notify_one();
+    return true;
+  }
+
+  // moves the GETs whose reads have finished into done, with their records
+  // folded together; the caller frees them
+  void collect(vector<ParkedRead *> &done) {
+    uint64_t count;
+    if (::read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+      std::cerr << "Failed to read the disk read eventfd." << std::endl;
+    }
+
+    vector<ParkedRead *> finished;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      finished.swap(done_);
+    }
+
+    for (ParkedRead *get : finished) {
+      get->found_ = store_->finish_read(get->key_, get->plan_, get->payloads_,
+                                        &get->payload_);
+      done.push_back(get);
+    }
+
+    in_flight_ -= finished.size();
+  }
+};
+
+#endif // INCLUDE_KVS_DISK_READER_HPP_
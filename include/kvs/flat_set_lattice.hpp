@@ -0,0 +1,120 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_FLAT_SET_LATTICE_HPP_
+#define INCLUDE_KVS_FLAT_SET_LATTICE_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include "lattices/core_lattices.hpp"
+
+// A set lattice kept as a sorted vector rather than a tree, for the sets
+// the servers store: one allocation for the elements instead of one per
+// element, and a merge that walks both sides in order. Its elements are in
+// the order SetLattice and OrderedSetLattice serialize theirs in, so it
+// stands in for either.
+template <typename T> class FlatSetLattice {
+  std::vector<T> element;
+
+  // the first index from from on whose element is not less than value; the
+  // search gallops ahead from from, so placing a few values into a large
+  // set costs a few comparisons each rather than a pass over the set
+  std::size_t gallop(const T &value, std::size_t from) const {
+    std::size_t bound = from;
+    std::size_t step = 1;
+
+    while (bound < element.size() && element[bound] < value) {
+      from = bound + 1;
+      bound += step;
+      step *= 2;
+    }
+
+    return std::lower_bound(element.begin() + from,
+                            element.begin() + std::min(bound, element.size()),
+                            value) -
+           element.begin();
+  }
+
+public:
+  FlatSetLattice() {}
+
+  // elements need not be sorted, nor free of duplicates
+  explicit FlatSetLattice(std::vector<T> elements)
+      : element(std::move(elements)) {
+    if (!std::is_sorted(element.begin(), element.end())) {
+      std::sort(element.begin(), element.end());
+    }
+
+    element.erase(std::unique(element.begin(), element.end()), element.end());
+  }
+
+  const std::vector<T> &reveal() const { return element; }
+
+  MaxLattice<unsigned> size() const {
+    return MaxLattice<unsigned>(element.size());
+  }
+
+  bool contains(const T &value) const {
+    return std::binary_search(element.begin(), element.end(), value);
+  }
+
+  // merges in the elements of other in place: an existing element is found
+  // by galloping, and the new ones are moved into place from the back, so
+  // each element moves at most once. When every new element sorts after the
+  // last one, as with appended ids or timestamps, they are appended.
+  void merge(const FlatSetLattice<T> &other) {
+    const std::vector<T> &values = other.element;
+    if (values.empty() || &other == this) {
+      return;
+    }
+
+    if (element.empty() || element.back() < values.front()) {
+      element.insert(element.end(), values.begin(), values.end());
+      return;
+    }
+
+    // where each new value goes: before the element at its position
+    std::vector<std::size_t> positions;
+    std::vector<const T *> additions;
+    std::size_t position = 0;
+
+    for (const T &value : values) {
+      position = gallop(value, position);
+
+      if (position == element.size() || value < element[position]) {
+        positions.push_back(position);
+        additions.push_back(&value);
+      }
+    }
+
+    if (additions.empty()) {
+      return;
+    }
+
+    std::size_t read = element.size();
+    element.resize(element.size() + additions.size());
+    std::size_t write = element.size();
+
+    for (std::size_t i = additions.size(); i-- > 0;) {
+      std::move_backward(element.begin() + positions[i],
+                         element.begin() + read, element.begin() + write);
+      write -= read - positions[i];
+      read = positions[i];
+      element[--write] = *additions[i];
+    }
+  }
+};
+
+#endif // INCLUDE_KVS_FLAT_SET_LATTICE_HPP_
@@ -0,0 +1,159 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_HOT_KEY_DETECTOR_HPP_
+#define INCLUDE_KVS_HOT_KEY_DETECTOR_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "metadata.hpp"
+
+// Spots the keys a thread reads often enough that it should not serve them
+// alone, without waiting for the monitor. The thread counts the GETs of each
+// key it is responsible for over short intervals; a key read threshold times
+// within one is hot, and the thread raises its local replication factor to
+// every thread on the node, which then copy the key and take their share of
+// its reads. Once raised, a key stays hot at its share of threshold reads per
+// interval, and the raised factor is kept until it has not been for hold
+// seconds, at which point the thread lowers it back, unless something
+// else, like the monitor, has changed it in the meantime. The changes go into
+// the thread's next stats report, so the monitor knows of them. A threshold
+// of 0 disables detection.
+class HotKeyDetector {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Replication {
+    // the local replication factor before the thread raised it, and what it
+    // was raised to
+    unsigned previous_;
+    unsigned raised_;
+    TimePoint last_hot_;
+  };
+
+  unsigned threshold_;
+  std::chrono::milliseconds interval_;
+  std::chrono::seconds hold_;
+
+  struct Count {
+    unsigned count_;
+    // the reads that make the key hot in this interval
+    unsigned needed_;
+  };
+
+  TimePoint interval_start_;
+  hmap<Key, Count> counts_;
+
+  // the keys that have crossed the threshold since the last take_hot
+  std::vector<Key> hot_;
+
+  std::unordered_map<Key, Replication> raised_;
+
+  // the changes made since the last report
+  std::vector<ReplicationFactor> changes_;
+
+public:
+  HotKeyDetector(unsigned threshold, unsigned interval, unsigned hold)
+      : threshold_(threshold), interval_(interval), hold_(hold) {}
+
+  bool enabled() const { return threshold_ > 0; }
+
+  // starts a new interval if the current one is over as of now
+  void set_time(TimePoint now) {
+    if (now - interval_start_ >= interval_) {
+      counts_.clear();
+      interval_start_ = now;
+    }
+  }
+
+  void record(const Key &key) {
+    auto result = counts_.insert({key, Count{0, threshold_}});
+    Count &count = result.first->second;
+
+    if (result.second) {
+      auto it = raised_.find(key);
+      if (it != raised_.end()) {
+        count.needed_ = std::max(threshold_ / it->second.raised_, 1u);
+      }
+    }
+
+    if (++count.count_ == count.needed_) {
+      hot_.push_back(key);
+    }
+  }
+
+  // the keys that have turned hot since the last call
+  std::vector<Key> take_hot() {
+    std::vector<Key> hot;
+    hot.swap(hot_);
+    return hot;
+  }
+
+  // whether the thread should raise key's local replication factor from
+  // current to target as of now; a key it has raised already only counts as
+  // hot again
+  bool raise(const Key &key, unsigned current, unsigned target,
+             TimePoint now) {
+    auto it = raised_.find(key);
+    if (it != raised_.end()) {
+      it->second.last_hot_ = now;
+      return false;
+    }
+
+    if (current >= target) {
+      return false;
+    }
+
+    raised_[key] = Replication{current, target, now};
+    return true;
+  }
+
+  // calls lower(key, previous) for every raised key that has not been hot
+  // for hold as of now, if current(key) says its local replication factor is
+  // still the one the thread raised it to, and forgets the key either way
+  template <typename Current, typename Lower>
+  void expire(TimePoint now, Current current, Lower lower) {
+    for (auto it = raised_.begin(); it != raised_.end();) {
+      if (now - it->second.last_hot_ < hold_) {
+        ++it;
+        continue;
+      }
+
+      if (current(it->first) == it->second.raised_) {
+        lower(it->first, it->second.previous_);
+      }
+
+      it = raised_.erase(it);
+    }
+  }
+
+  bool raised(const Key &key) const { return raised_.count(key) > 0; }
+
+  void record_change(const ReplicationFactor &factor) {
+    changes_.push_back(factor);
+  }
+
+  // moves the changes made since the last report into report
+  void fill(ServerStatsReport &report) {
+    for (ReplicationFactor &factor : changes_) {
+      report.add_replication()->Swap(&factor);
+    }
+
+    changes_.clear();
+  }
+};
+
+#endif // INCLUDE_KVS_HOT_KEY_DETECTOR_HPP_
@@ -0,0 +1,89 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_INTRA_NODE_DISPATCH_HPP_
+#define INCLUDE_KVS_INTRA_NODE_DISPATCH_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "spsc_queue.hpp"
+
+// How long a thread may block in poll while intra-node dispatch is enabled
+// (in milliseconds), since requests handed over through the mailboxes do not
+// wake up the receiving thread.
+const long kIntraNodePollTimeout = 1;
+
+// One SPSC queue for every ordered pair of worker threads on this node. A
+// thread that receives a request for a key owned by another thread on the
+// same node hands the serialized request over directly, instead of sending
+// it back through the network stack or making it wait on a replication
+// factor lookup.
+class IntraNodeMailboxes {
+  typedef SpscQueue<std::string> Mailbox;
+
+  unsigned threads_;
+  std::vector<std::unique_ptr<Mailbox>> mailboxes_;
+
+  Mailbox &mailbox(unsigned from, unsigned to) {
+    return *mailboxes_[from * threads_ + to];
+  }
+
+public:
+  IntraNodeMailboxes(unsigned threads, std::size_t capacity)
+      : threads_(threads) {
+    for (unsigned i = 0; i < threads * threads; i++) {
+      mailboxes_.push_back(std::unique_ptr<Mailbox>(new Mailbox(capacity)));
+    }
+  }
+
+  // returns false if the mailbox from -> to is full
+  bool send(unsigned from, unsigned to, std::string &&request) {
+    if (from >= threads_ || to >= threads_) {
+      return false;
+    }
+
+    return mailbox(from, to).push(std::move(request));
+  }
+
+  // calls handler on up to budget requests sent to thread to, taking turns
+  // among the senders, and returns the number of requests handled
+  template <typename F> unsigned receive(unsigned to, unsigned budget, F f) {
+    unsigned received = 0;
+    std::string request;
+    bool progress = true;
+
+    while (received < budget && progress) {
+      progress = false;
+
+      for (unsigned from = 0; from < threads_ && received < budget; from++) {
+        if (mailbox(from, to).pop(request)) {
+          f(request);
+          received += 1;
+          progress = true;
+        }
+      }
+    }
+
+    return received;
+  }
+
+  unsigned threads() const { return threads_; }
+};
+
+// nullptr unless intra-node dispatch is enabled in the conf
+extern IntraNodeMailboxes *kIntraNodeMailboxes;
+
+#endif // INCLUDE_KVS_INTRA_NODE_DISPATCH_HPP_
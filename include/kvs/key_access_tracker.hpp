@@ -0,0 +1,265 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_KEY_ACCESS_TRACKER_HPP_
+#define INCLUDE_KVS_KEY_ACCESS_TRACKER_HPP_
+
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <queue>
+
+#include "count_min_sketch.hpp"
+#include "metadata.hpp"
+
+// the number of time buckets a key's access window is divided into
+const unsigned kAccessBucketCount = 12;
+
+// A summary of a tracker's counts, built a batch of keys at a time so that
+// the event loop can serve requests in between; the counts of keys summarized
+// in different batches are taken at different times.
+struct AccessSummary {
+  // a min-heap of the hottest keys seen so far
+  typedef std::pair<unsigned, Key> HotKey;
+  typedef std::priority_queue<HotKey, vector<HotKey>, std::greater<HotKey>>
+      HotKeys;
+
+  unsigned hot_key_count_;
+  CountMinSketch sketch_;
+  unsigned long long accessed_;
+  unsigned long long total_;
+  double squares_;
+  HotKeys hot_;
+
+  // the next bucket of the tracker's table to summarize, and the number of
+  // buckets it had when the summary started
+  std::size_t bucket_;
+  std::size_t bucket_count_;
+
+  void add(const Key &key, unsigned count) {
+    if (count == 0) {
+      return;
+    }
+
+    sketch_.add(key, count);
+    accessed_ += 1;
+    total_ += count;
+    squares_ += (double)count * count;
+
+    if (hot_.size() < hot_key_count_) {
+      hot_.push(HotKey(count, key));
+    } else if (hot_key_count_ > 0 && count > hot_.top().first) {
+      hot_.pop();
+      hot_.push(HotKey(count, key));
+    }
+  }
+
+  // moves the summary into report
+  void fill(ServerStatsReport &report) {
+    for (; !hot_.empty(); hot_.pop()) {
+      KeyAccessData_KeyCount *tp = report.add_hot_keys();
+      tp->set_key(hot_.top().second);
+      tp->set_access_count(hot_.top().first);
+    }
+
+    report.set_sketch_width(sketch_.width());
+    for (uint32_t counter : sketch_.counts()) {
+      report.add_sketch(counter);
+    }
+
+    report.set_accessed_keys(accessed_);
+    report.set_access_total(total_);
+    report.set_access_square_total(squares_);
+  }
+};
+
+// Counts accesses per key over a sliding window of window_ seconds. Each key
+// owns a fixed ring of kAccessBucketCount counters, so recording an access is
+// a lookup and an increment, and the memory per key does not depend on how
+// often it is accessed. An access expires up to one bucket width (window_ /
+// kAccessBucketCount) early or late.
+class KeyAccessTracker {
+  struct Counter {
+    unsigned buckets_[kAccessBucketCount];
+    // the bucket number that buckets_ was last advanced to
+    unsigned long long bucket_;
+    unsigned total_;
+  };
+
+  hmap<Key, Counter> counters_;
+  unsigned long long bucket_width_; // in milliseconds
+
+  // the bucket that the tracker's clock is in; the event loop moves the
+  // clock with set_time, so recording an access does not read the time
+  unsigned long long current_bucket_;
+
+  unsigned long long
+  bucket_of(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               time.time_since_epoch())
+               .count() /
+           bucket_width_;
+  }
+
+  // zeroes the buckets that have rotated out of the window since the counter
+  // was last touched
+  static void advance(Counter &counter, unsigned long long bucket) {
+    if (bucket - counter.bucket_ >= kAccessBucketCount) {
+      for (unsigned i = 0; i < kAccessBucketCount; i++) {
+        counter.buckets_[i] = 0;
+      }
+
+      counter.total_ = 0;
+    } else {
+      for (unsigned long long b = counter.bucket_ + 1; b <= bucket; b++) {
+        counter.total_ -= counter.buckets_[b % kAccessBucketCount];
+        counter.buckets_[b % kAccessBucketCount] = 0;
+      }
+    }
+
+    counter.bucket_ = bucket;
+  }
+
+public:
+  KeyAccessTracker(unsigned window = 60)
+      : bucket_width_(window * 1000ULL / kAccessBucketCount),
+        current_bucket_(bucket_of(std::chrono::steady_clock::now())) {}
+
+  // moves the tracker's clock to now, which must not be earlier than the
+  // last time it was set to
+  void set_time(std::chrono::steady_clock::time_point now) {
+    current_bucket_ = bucket_of(now);
+  }
+
+  void record(const Key &key) {
+    unsigned long long bucket = current_bucket_;
+    auto result = counters_.insert({key, Counter()});
+    Counter &counter = result.first->second;
+
+    if (result.second) {
+      counter.bucket_ = bucket;
+    } else {
+      advance(counter, bucket);
+    }
+
+    counter.buckets_[bucket % kAccessBucketCount] += 1;
+    counter.total_ += 1;
+  }
+
+  // the number of accesses to key within the window
+  unsigned count(const Key &key) {
+    auto it = counters_.find(key);
+    if (it == counters_.end()) {
+      return 0;
+    }
+
+    advance(it->second, current_bucket_);
+    return it->second.total_;
+  }
+
+  // adds the windowed access count of every tracked key to access; keys that
+  // are no longer in stored_key_map are dropped instead of reported
+  void report(KeyAccessData &access,
+              const map<Key, KeyProperty> &stored_key_map) {
+    unsigned long long bucket = current_bucket_;
+
+    for (auto it = counters_.begin(); it != counters_.end();) {
+      if (stored_key_map.find(it->first) == stored_key_map.end()) {
+        it = counters_.erase(it);
+        continue;
+      }
+
+      advance(it->second, bucket);
+
+      KeyAccessData_KeyCount *tp = access.add_keys();
+      tp->set_key(it->first);
+      tp->set_access_count(it->second.total_);
+      ++it;
+    }
+  }
+
+  // starts summary over, for the hot_key_count most accessed keys and a
+  // sketch of sketch_depth rows of sketch_width counters
+  void start_summary(AccessSummary &summary, unsigned hot_key_count,
+                     unsigned sketch_width, unsigned sketch_depth) const {
+    summary.hot_key_count_ = hot_key_count;
+    summary.sketch_ = CountMinSketch(sketch_width, sketch_depth);
+    summary.accessed_ = 0;
+    summary.total_ = 0;
+    summary.squares_ = 0;
+    summary.hot_ = AccessSummary::HotKeys();
+    summary.bucket_ = 0;
+    summary.bucket_count_ = counters_.bucket_count();
+  }
+
+  // adds the keys in the next buckets of the table to summary, until at
+  // least batch keys have been added; returns true once every key has been.
+  // Keys that are no longer in stored_key_map are dropped, as in report. If
+  // the table has been rehashed since the summary started, its keys have
+  // moved between buckets, so the summary starts over.
+  bool summarize_batch(AccessSummary &summary,
+                       const map<Key, KeyProperty> &stored_key_map,
+                       unsigned batch) {
+    if (counters_.bucket_count() != summary.bucket_count_) {
+      start_summary(summary, summary.hot_key_count_, summary.sketch_.width(),
+                    summary.sketch_.depth());
+    }
+
+    unsigned long long bucket = current_bucket_;
+    unsigned added = 0;
+
+    for (; summary.bucket_ < summary.bucket_count_ && added < batch;
+         summary.bucket_++) {
+      std::size_t b = summary.bucket_;
+
+      for (auto it = counters_.begin(b); it != counters_.end(b);) {
+        if (stored_key_map.find(it->first) == stored_key_map.end()) {
+          // erasing a key leaves the iterators to the others valid
+          Key key = it->first;
+          ++it;
+          counters_.erase(key);
+          continue;
+        }
+
+        advance(it->second, bucket);
+        summary.add(it->first, it->second.total_);
+        added += 1;
+        ++it;
+      }
+    }
+
+    return summary.bucket_ == summary.bucket_count_;
+  }
+
+  // fills report with the hot_key_count most accessed keys, a sketch of
+  // every tracked key's count, and the totals over all of them; keys that
+  // are no longer in stored_key_map are dropped, as in report
+  void summarize(ServerStatsReport &report,
+                 const map<Key, KeyProperty> &stored_key_map,
+                 unsigned hot_key_count, unsigned sketch_width,
+                 unsigned sketch_depth) {
+    AccessSummary summary;
+    start_summary(summary, hot_key_count, sketch_width, sketch_depth);
+
+    while (!summarize_batch(summary, stored_key_map,
+                            std::numeric_limits<unsigned>::max())) {
+    }
+
+    summary.fill(report);
+  }
+
+  std::size_t size() const { return counters_.size(); }
+};
+
+#endif // INCLUDE_KVS_KEY_ACCESS_TRACKER_HPP_
@@ -0,0 +1,79 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_KEY_SIZE_REPORTER_HPP_
+#define INCLUDE_KVS_KEY_SIZE_REPORTER_HPP_
+
+#include "count_min_sketch.hpp"
+#include "metadata.hpp"
+
+// every this many reports carries the size of every primary key, so that the
+// monitor recovers from a lost report or a missed change
+const unsigned kFullSizeReportRounds = 8;
+
+// Decides which key sizes go into a thread's stats reports: the sizes that
+// changed since they were last reported, and every size in each
+// kFullSizeReportRounds-th report. The sizes last reported are kept by key
+// hash rather than by key, so a thread holds 16 bytes per primary key; two
+// keys whose hashes collide may have a change go unreported until the next
+// full report.
+class KeySizeReporter {
+  hmap<uint64_t, unsigned> reported_;
+
+  // the sizes added during a full report, which replace reported_
+  hmap<uint64_t, unsigned> next_;
+
+  unsigned round_;
+
+public:
+  KeySizeReporter() : round_(0) {}
+
+  // whether the report being built carries every size
+  bool full() const { return round_ % kFullSizeReportRounds == 0; }
+
+  void add(ServerStatsReport &report, const Key &key, unsigned size) {
+    uint64_t hash = CountMinSketch::hash(key);
+
+    if (full()) {
+      next_[hash] = size;
+    } else {
+      auto result = reported_.insert({hash, size});
+
+      if (!result.second && result.first->second == size) {
+        return;
+      }
+
+      result.first->second = size;
+    }
+
+    KeySizeData_KeySize *ks = report.add_key_sizes();
+    ks->set_key(key);
+    ks->set_size(size);
+  }
+
+  // marks the end of the report's sizes; the keys that have left this
+  // thread are forgotten at the end of the next full report
+  void finish(ServerStatsReport &report) {
+    report.set_full_sizes(full());
+
+    if (full()) {
+      reported_.swap(next_);
+      next_.clear();
+    }
+
+    round_ += 1;
+  }
+};
+
+#endif // INCLUDE_KVS_KEY_SIZE_REPORTER_HPP_
@@ -16,6 +16,12 @@
 #define INCLUDE_KVS_KVS_HANDLERS_HPP_
 
 #include "hash_ring.hpp"
+#include "kvs/admission_control.hpp"
+#include "kvs/cache_subscriptions.hpp"
+#include "kvs/depart_plan.hpp"
+#include "kvs/hot_key_detector.hpp"
+#include "kvs/shared_rings.hpp"
+#include "kvs/tenant_limits.hpp"
 #include "metadata.pb.h"
 #include "requests.hpp"
 #include "server_utils.hpp"
@@ -24,92 +30,160 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
                        Address private_ip, logger log, string &serialized,
                        GlobalRingMap &global_hash_rings,
                        LocalRingMap &local_hash_rings,
-                       map<Key, KeyProperty> &stored_key_map,
-                       map<Key, KeyReplication> &key_replication_map,
+                       StoredKeyMap &stored_key_map,
+                       KeyReplicationMap &key_replication_map,
                        set<Key> &join_remove_set, SocketCache &pushers,
                        ServerThread &wt, AddressKeysetMap &join_gossip_map,
                        int self_join_count);
 
-void node_depart_handler(unsigned thread_id, Address public_ip,
-                         Address private_ip, GlobalRingMap &global_hash_rings,
-                         logger log, string &serialized, SocketCache &pushers);
+void node_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
+                         Address private_ip, logger log, string &serialized,
+                         GlobalRingMap &global_hash_rings,
+                         LocalRingMap &local_hash_rings,
+                         StoredKeyMap &stored_key_map,
+                         KeyReplicationMap &key_replication_map,
+                         set<Key> &join_remove_set, SocketCache &pushers,
+                         ServerThread &wt, AddressKeysetMap &join_gossip_map);
 
 void self_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
                          Address private_ip, logger log, string &serialized,
                          GlobalRingMap &global_hash_rings,
                          LocalRingMap &local_hash_rings,
-                         map<Key, KeyProperty> &stored_key_map,
-                         map<Key, KeyReplication> &key_replication_map,
+                         StoredKeyMap &stored_key_map,
+                         KeyReplicationMap &key_replication_map,
                          vector<Address> &routing_ips,
                          vector<Address> &monitoring_ips, ServerThread &wt,
-                         SocketCache &pushers, SerializerMap &serializers);
+                         SocketCache &pushers, DepartPlan &depart_plan);
 
+// forwarded is set for requests handed over by another thread on this node;
+// a disk thread with I/O threads passes their disk_reader, which takes over
+// its GETs of stored keys; a thread that tracks tenants passes their limits
 void user_request_handler(
     unsigned &access_count, unsigned &seed, string &serialized, logger log,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
     map<Key, vector<PendingRequest>> &pending_requests,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
-    map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers);
+    KeyAccessTracker &key_access_tracker, StoredKeyMap &stored_key_map,
+    KeyReplicationMap &key_replication_map, LocalChangeset &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    ResponseBatcher &batcher, MessageBuffers &buffers, bool forwarded = false,
+    DiskReader *disk_reader = nullptr, HotKeyDetector *hot_keys = nullptr,
+    TenantLimits *tenants = nullptr);
+
+// answers every tuple of a request with kOverloadedError, without touching
+// its keys; returns false, and answers nothing, if the request asks for no
+// response, since its sender could not learn that it was dropped
+bool shed_request_handler(string &serialized, SocketCache &pushers,
+                          ResponseBatcher &batcher, MessageBuffers &buffers);
+
+// answers a KeyScanRequest with the keys this thread stores in its range,
+// up to its limit or kMaxScanPage
+void key_scan_handler(string &serialized, StoredKeyMap &stored_key_map,
+                      SocketCache &pushers);
+
+// answers the GETs whose reads disk_reader has finished
+void disk_read_handler(DiskReader &disk_reader, logger log,
+                       SocketCache &pushers, ResponseBatcher &batcher);
 
 void gossip_handler(unsigned &seed, string &serialized,
                     GlobalRingMap &global_hash_rings,
                     LocalRingMap &local_hash_rings,
                     map<Key, vector<PendingGossip>> &pending_gossip,
-                    map<Key, KeyProperty> &stored_key_map,
-                    map<Key, KeyReplication> &key_replication_map,
-                    ServerThread &wt, SerializerMap &serializers,
-                    SocketCache &pushers, logger log);
+                    StoredKeyMap &stored_key_map,
+                    KeyReplicationMap &key_replication_map, ServerThread &wt,
+                    SerializerMap &serializers, SocketCache &pushers,
+                    MessageBuffers &buffers, logger log);
 
 void replication_response_handler(
     unsigned &seed, unsigned &access_count, logger log, string &serialized,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
     map<Key, vector<PendingRequest>> &pending_requests,
     map<Key, vector<PendingGossip>> &pending_gossip,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
-    map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers);
+    KeyAccessTracker &key_access_tracker, StoredKeyMap &stored_key_map,
+    KeyReplicationMap &key_replication_map, LocalChangeset &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    ResponseBatcher &batcher, MessageBuffers &buffers);
 
 void replication_change_handler(
     Address public_ip, Address private_ip, unsigned thread_id, unsigned &seed,
     logger log, string &serialized, GlobalRingMap &global_hash_rings,
-    LocalRingMap &local_hash_rings, map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
+    LocalRingMap &local_hash_rings, StoredKeyMap &stored_key_map,
+    KeyReplicationMap &key_replication_map, LocalChangeset &local_changeset,
     ServerThread &wt, SerializerMap &serializers, SocketCache &pushers);
 
 // Postcondition:
-// cache_ip_to_keys, key_to_cache_ips are both updated
-// with the IPs and their fresh list of repsonsible keys
-// in the serialized response.
+// cache_subscriptions holds the keys each cache in the serialized response
+// registered, and cache_fanout whether it wants invalidations only.
 void cache_ip_response_handler(string &serialized,
-                               map<Address, set<Key>> &cache_ip_to_keys,
-                               map<Key, set<Address>> &key_to_cache_ips);
+                               CacheSubscriptions &cache_subscriptions,
+                               CacheFanout &cache_fanout,
+                               MessageBuffers &buffers);
 
 void management_node_response_handler(string &serialized,
                                       set<Address> &extant_caches,
-                                      map<Address, set<Key>> &cache_ip_to_keys,
-                                      map<Key, set<Address>> &key_to_cache_ips,
+                                      CacheSubscriptions &cache_subscriptions,
+                                      CacheFanout &cache_fanout,
                                       GlobalRingMap &global_hash_rings,
                                       LocalRingMap &local_hash_rings,
                                       SocketCache &pushers, ServerThread &wt,
                                       unsigned &rid);
 
+// sends each address the current value of its keys; keys with a delta in
+// deltas are sent that delta instead. The addresses are other servers', so
+// compressed values are sent as they are stored (caches are sent their
+// updates by CacheFanout).
 void send_gossip(AddressKeysetMap &addr_keyset_map, SocketCache &pushers,
-                 SerializerMap &serializers,
-                 map<Key, KeyProperty> &stored_key_map);
+                 SerializerMap &serializers, StoredKeyMap &stored_key_map,
+                 const LocalChangeset *deltas = nullptr);
 
-std::pair<string, AnnaError> process_get(const Key &key,
-                                         Serializer *serializer);
+AnnaError process_get(const Key &key, Serializer *serializer, string *payload);
 
 void process_put(const Key &key, LatticeType lattice_type,
                  const string &payload, Serializer *serializer,
-                 map<Key, KeyProperty> &stored_key_map);
+                 StoredKeyMap &stored_key_map);
+
+// as above, for a key whose entry in stored_key_map the caller has already
+// looked up, or inserted
+void process_put(const Key &key, KeyProperty &property,
+                 LatticeType lattice_type, const string &payload,
+                 Serializer *serializer, StoredKeyMap &stored_key_map);
+
+// returns true if kSelfTier is the highest tier that holds a replica of key
+bool is_primary_tier(const Key &key, KeyReplicationMap &key_replication_map);
 
 bool is_primary_replica(const Key &key,
-                        map<Key, KeyReplication> &key_replication_map,
+                        KeyReplicationMap &key_replication_map,
                         GlobalRingMap &global_hash_rings,
                         LocalRingMap &local_hash_rings, ServerThread &st);
 
+// Evicts keys chosen by the clock of stored_key_map until the bytes it
+// retains are at most target. A key this thread is the primary replica of is
+// demoted to the disk tier: its memory replication factor drops to 0, the
+// new factor is stored and sent to every replica and routing node, and the
+// key is gossiped to its disk replicas. Any other copy is dropped by lowering
+// the key's global or local memory factor by 1 the same way, which only
+// works for the key's last node or its last thread on each node; the copy is
+// marked as dropping and is served until the change reaches this thread.
+// Metadata keys are never evicted, and primary replicas stay if there is no
+// disk tier. Returns the number of keys evicted or being dropped.
+unsigned evict_to_budget(unsigned long long target, unsigned &seed,
+                         logger log, GlobalRingMap &global_hash_rings,
+                         LocalRingMap &local_hash_rings,
+                         StoredKeyMap &stored_key_map,
+                         KeyReplicationMap &key_replication_map,
+                         LocalChangeset &local_changeset,
+                         vector<Address> &routing_ips, ServerThread &wt,
+                         SerializerMap &serializers, SocketCache &pushers,
+                         unsigned &rid);
+
+// Changes the memory tier local replication factor of key to local on every
+// node that holds the key, as the monitor does: the new factor is stored and
+// sent to the first thread of each of the key's memory nodes, which passes it
+// on to the others, and to every routing node. The threads apply it, and
+// copy the key to its new replicas, when the change reaches them, so
+// key_replication_map is left as is. Returns the new factor.
+ReplicationFactor change_local_replication(
+    const Key &key, unsigned local, GlobalRingMap &global_hash_rings,
+    LocalRingMap &local_hash_rings, KeyReplicationMap &key_replication_map,
+    vector<Address> &routing_ips, SocketCache &pushers, unsigned &rid);
+
 #endif // INCLUDE_KVS_KVS_HANDLERS_HPP_
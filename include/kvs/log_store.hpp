@@ -0,0 +1,769 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_LOG_STORE_HPP_
+#define INCLUDE_KVS_LOG_STORE_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "anna.pb.h"
+#include "lww_timestamp.hpp"
+#include "read_cache.hpp"
+#include "types.hpp"
+
+// the size at which the active segment is sealed and a new one is started
+const unsigned long long kLogSegmentSize = 64 * 1024 * 1024;
+
+// the number of unmerged records a key may accumulate before a PUT folds
+// them into one
+const unsigned kLogMaxChainLength = 8;
+
+// sealed segments whose live fraction drops below this are compacted
+const double kLogCompactionRatio = 0.5;
+
+// the upper bound on how long an acknowledged write waits for fsync (in
+// microseconds)
+const unsigned kLogSyncInterval = 5000;
+
+// the number of records a single compaction step examines
+const unsigned kLogCompactionBatch = 256;
+
+// each record is a fixed header followed by the key and the payload
+// (serialized lattice); a tombstone has an empty payload. Memory tier
+// write-ahead logs use the same records.
+struct LogRecordHeader {
+  uint32_t key_length_;
+  uint32_t payload_length_;
+  uint8_t lattice_type_;
+  uint8_t tombstone_;
+};
+
+const unsigned kLogHeaderSize = 10;
+
+inline void encode_log_header(const LogRecordHeader &header, char *buf) {
+  memcpy(buf, &header.key_length_, 4);
+  memcpy(buf + 4, &header.payload_length_, 4);
+  buf[8] = header.lattice_type_;
+  buf[9] = header.tombstone_;
+}
+
+inline void decode_log_header(const char *buf, LogRecordHeader &header) {
+  memcpy(&header.key_length_, buf, 4);
+  memcpy(&header.payload_length_, buf + 4, 4);
+  header.lattice_type_ = buf[8];
+  header.tombstone_ = buf[9];
+}
+
+struct LogRecord {
+  unsigned segment_;
+  // offset of the payload within the segment
+  unsigned long long offset_;
+  unsigned length_;
+};
+
+struct LogIndexEntry {
+  LatticeType type_;
+  // records that have not been merged together yet, oldest first
+  vector<LogRecord> records_;
+  // the newest timestamp among the records of an LWW key
+  uint64_t timestamp_ = 0;
+  // the segment of the first record written since the key was last removed;
+  // merged-away copies of its records may remain from there on
+  unsigned oldest_segment_ = 0;
+};
+
+// what the tombstones of a removed key may still hide
+struct LogTombstone {
+  // the oldest segment that may hold records written before a removal
+  unsigned oldest_segment_;
+  // the number of the key's tombstone records in the segments
+  unsigned count_;
+};
+
+// the reads that make up a GET of a key, for a caller that issues them
+// itself rather than through LogStore::get, as the disk tier's I/O threads do
+struct LogReadPlan {
+  LatticeType type_;
+  vector<LogRecord> records_;
+  // the file descriptor of each record's segment
+  vector<int> fds_;
+};
+
+// merges two serialized lattices of the given type into one
+typedef std::function<string(LatticeType, const string &, const string &)>
+    LatticeMergeFunction;
+
+// A per-thread append-only store for the disk tier. PUTs append the
+// incoming lattice without reading what is already stored; the index keeps
+// every unmerged record for a key, and reads, long chains, and compaction
+// fold them together with the lattice merge. Writes are made durable in
+// groups: sync() is called from the event loop and issues at most one
+// fdatasync per kLogSyncInterval. Merged values are kept in a ReadCache,
+// which PUTs merge into, so that a hot key is read from the segments once.
+class LogStore {
+  string dir_;
+  LatticeMergeFunction merge_;
+
+  std::unordered_map<Key, LogIndexEntry> index_;
+  std::unordered_map<Key, LogTombstone> tombstones_;
+
+  // segment id -> file descriptor; the largest id is the active segment
+  map<unsigned, int> segments_;
+  map<unsigned, unsigned long long> live_bytes_;
+  map<unsigned, unsigned long long> total_bytes_;
+
+  unsigned active_segment_;
+  bool dirty_;
+  std::chrono::steady_clock::time_point last_sync_;
+
+  // the number of planned reads of each segment that are still in flight
+  map<unsigned, unsigned> pins_;
+
+  ReadCache cache_;
+
+  // progress of the segment currently being compacted
+  bool compacting_;
+  unsigned compaction_segment_;
+  unsigned long long compaction_offset_;
+
+  string segment_name(unsigned segment) const {
+    return dir_ + "segment_" + std::to_string(segment) + ".log";
+  }
+
+  static bool read_fully(int fd, char *buf, size_t length, off_t offset) {
+    while (length > 0) {
+      ssize_t n = pread(fd, buf, length, offset);
+      if (n <= 0) {
+        return false;
+      }
+
+      buf += n;
+      length -= n;
+      offset += n;
+    }
+
+    return true;
+  }
+
+  void open_segment(unsigned segment) {
+    int fd = open(segment_name(segment).c_str(), O_RDWR | O_CREAT | O_APPEND,
+                  0644);
+    if (fd == -1) {
+      std::cerr << "Failed to open log segment " << segment_name(segment)
+                << std::endl;
+      return;
+    }
+
+    segments_[segment] = fd;
+    active_segment_ = segment;
+  }
+
+  // appends a record to the active segment and fills in where its payload
+  // landed (if record is not null); returns false if the write failed, in
+  // which case nothing was appended
+  bool append(const Key &key, LatticeType type, const string &payload,
+              bool tombstone, LogRecord *record = nullptr) {
+    if (total_bytes_[active_segment_] >= kLogSegmentSize) {
+      sync();
+      open_segment(active_segment_ + 1);
+    }
+
+    LogRecordHeader header = {static_cast<uint32_t>(key.size()),
+                              static_cast<uint32_t>(payload.size()),
+                              static_cast<uint8_t>(type),
+                              static_cast<uint8_t>(tombstone)};
+
+    string bytes(kLogHeaderSize, '\0');
+    encode_log_header(header, &bytes[0]);
+    bytes += key;
+    bytes += payload;
+
+    unsigned long long start = total_bytes_[active_segment_];
+    const char *buf = bytes.data();
+    size_t remaining = bytes.size();
+
+    while (remaining > 0) {
+      ssize_t n = write(segments_[active_segment_], buf, remaining);
+      if (n <= 0) {
+        std::cerr << "Failed to append to log segment." << std::endl;
+
+        // cut off what was written, so that the next record still starts
+        // at the offset the index expects; if that fails too, seal the
+        // segment and write into a fresh one
+        if (ftruncate(segments_[active_segment_], start) != 0) {
+          sync();
+          open_segment(active_segment_ + 1);
+        }
+
+        return false;
+      }
+
+      buf += n;
+      remaining -= n;
+    }
+
+    total_bytes_[active_segment_] += bytes.size();
+    if (!tombstone) {
+      live_bytes_[active_segment_] += bytes.size();
+    }
+
+    dirty_ = true;
+    if (record != nullptr) {
+      *record = LogRecord{active_segment_, start + kLogHeaderSize + key.size(),
+                          static_cast<unsigned>(payload.size())};
+    }
+
+    return true;
+  }
+
+  void release(const Key &key, const LogRecord &record) {
+    live_bytes_[record.segment_] -=
+        kLogHeaderSize + key.size() + record.length_;
+  }
+
+  bool read(const LogRecord &record, string *payload) {
+    payload->resize(record.length_);
+    if (record.length_ == 0) {
+      return true;
+    }
+
+    return read_fully(segments_[record.segment_], &(*payload)[0],
+                      record.length_, record.offset_);
+  }
+
+  // folds every record of the entry into one serialized lattice
+  bool merge_records(const LogIndexEntry &entry, string *payload) {
+    if (!read(entry.records_[0], payload)) {
+      return false;
+    }
+
+    string next;
+    for (unsigned i = 1; i < entry.records_.size(); i++) {
+      if (!read(entry.records_[i], &next)) {
+        return false;
+      }
+
+      *payload = merge_(entry.type_, *payload, next);
+    }
+
+    return true;
+  }
+
+  // raises the entry's timestamp to that of an LWW record; the timestamp is
+  // the first field of the payload, so only the payload's first bytes are
+  // read
+  void note_timestamp(LogIndexEntry &entry, const LogRecord &record) {
+    string prefix(std::min(record.length_, kLWWTimestampPrefix), '\0');
+    uint64_t timestamp;
+
+    if (read_fully(segments_[record.segment_], &prefix[0], prefix.size(),
+                   record.offset_) &&
+        peek_lww_prefix(prefix, timestamp)) {
+      entry.timestamp_ = std::max(entry.timestamp_, timestamp);
+    }
+  }
+
+  static unsigned payload_bytes(const LogIndexEntry &entry) {
+    unsigned size = 0;
+    for (const LogRecord &record : entry.records_) {
+      size += record.length_;
+    }
+
+    return size;
+  }
+
+  // counts a tombstone for key that hides records from oldest_segment on
+  void note_tombstone(const Key &key, unsigned oldest_segment) {
+    auto result = tombstones_.insert({key, LogTombstone{oldest_segment, 0}});
+    LogTombstone &tombstone = result.first->second;
+    tombstone.oldest_segment_ =
+        std::min(tombstone.oldest_segment_, oldest_segment);
+    tombstone.count_ += 1;
+  }
+
+  // whether a tombstone for key in segment must be kept, i.e., whether a
+  // segment older than it may still hold records it hides
+  bool hides_records(const Key &key, unsigned segment) const {
+    auto it = tombstones_.find(key);
+    if (it == tombstones_.end()) {
+      return false;
+    }
+
+    auto older = segments_.lower_bound(it->second.oldest_segment_);
+    return older != segments_.end() && older->first < segment;
+  }
+
+  // replaces the chain of records for key with a single merged record;
+  // returns false, leaving the chain as it was, if the append failed
+  bool collapse(const Key &key, LogIndexEntry &entry, const string &merged) {
+    LogRecord merged_record;
+    if (!append(key, entry.type_, merged, false, &merged_record)) {
+      return false;
+    }
+
+    for (const LogRecord &record : entry.records_) {
+      release(key, record);
+    }
+
+    entry.records_.clear();
+    entry.records_.push_back(merged_record);
+    return true;
+  }
+
+  // rebuilds the index by scanning every segment in order
+  void recover() {
+    DIR *dir = opendir(dir_.c_str());
+    if (dir == nullptr) {
+      return;
+    }
+
+    vector<unsigned> ids;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr) {
+      unsigned id;
+      if (sscanf(ent->d_name, "segment_%u.log", &id) == 1) {
+        ids.push_back(id);
+      }
+    }
+
+    closedir(dir);
+    std::sort(ids.begin(), ids.end());
+
+    for (const unsigned &id : ids) {
+      open_segment(id);
+      int fd = segments_[id];
+      off_t size = lseek(fd, 0, SEEK_END);
+      off_t offset = 0;
+      char buf[kLogHeaderSize];
+
+      while (offset + kLogHeaderSize <= size &&
+             read_fully(fd, buf, kLogHeaderSize, offset)) {
+        LogRecordHeader header;
+        decode_log_header(buf, header);
+
+        unsigned long long record_size =
+            kLogHeaderSize + header.key_length_ + header.payload_length_;
+        if (offset + record_size > (unsigned long long)size) {
+          break;
+        }
+
+        Key key(header.key_length_, '\0');
+        if (header.key_length_ > 0 &&
+            !read_fully(fd, &key[0], header.key_length_,
+                        offset + kLogHeaderSize)) {
+          break;
+        }
+
+        auto it = index_.find(key);
+        if (header.tombstone_) {
+          if (it != index_.end()) {
+            for (const LogRecord &record : it->second.records_) {
+              release(key, record);
+            }
+
+            note_tombstone(key, it->second.oldest_segment_);
+            index_.erase(it);
+          } else {
+            note_tombstone(key, id);
+          }
+        } else {
+          bool fresh = it == index_.end();
+          LogIndexEntry &entry = index_[key];
+          if (fresh) {
+            entry.oldest_segment_ = id;
+          }
+
+          entry.type_ = static_cast<LatticeType>(header.lattice_type_);
+          entry.records_.push_back(LogRecord{
+              id, (unsigned long long)offset + kLogHeaderSize +
+                      header.key_length_,
+              header.payload_length_});
+          live_bytes_[id] += record_size;
+
+          if (entry.type_ == LatticeType::LWW) {
+            note_timestamp(entry, entry.records_.back());
+          }
+        }
+
+        offset += record_size;
+      }
+
+      // drop a torn record left behind by a crash
+      if (offset < size && ftruncate(fd, offset) != 0) {
+        std::cerr << "Failed to truncate log segment." << std::endl;
+      }
+
+      total_bytes_[id] = offset;
+    }
+  }
+
+public:
+  LogStore(const string &dir, LatticeMergeFunction merge,
+           unsigned long long cache_bytes = 0)
+      : dir_(dir), merge_(merge), active_segment_(0), dirty_(false),
+        last_sync_(std::chrono::steady_clock::now()), cache_(cache_bytes),
+        compacting_(false), compaction_segment_(0), compaction_offset_(0) {
+    if (dir_.back() != '/') {
+      dir_ += "/";
+    }
+
+    mkdir(dir_.c_str(), 0755);
+    recover();
+
+    // always write into a fresh segment after a restart
+    open_segment(segments_.size() == 0 ? 0 : active_segment_ + 1);
+  }
+
+  ~LogStore() {
+    sync();
+    for (const auto &pair : segments_) {
+      close(pair.second);
+    }
+  }
+
+  bool get(const Key &key, string *payload) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+
+    if (cache_.get(key, payload)) {
+      return true;
+    }
+
+    if (!merge_records(it->second, payload)) {
+      std::cerr << "Failed to read payload." << std::endl;
+      return false;
+    }
+
+    // fold the chain so the next read is a single pread
+    if (it->second.records_.size() > 1) {
+      collapse(key, it->second, *payload);
+    }
+
+    cache_.put(key, *payload);
+    return true;
+  }
+
+  // fills in the reads that make up a GET of key, and keeps their segments
+  // until finish_read; returns false if the key is not stored, or if its
+  // value is cached and get returns it without a read
+  bool plan_read(const Key &key, LogReadPlan &plan) {
+    auto it = index_.find(key);
+    if (it == index_.end() || cache_.find(key) != nullptr) {
+      return false;
+    }
+
+    cache_.record_miss();
+
+    plan.type_ = it->second.type_;
+    plan.records_ = it->second.records_;
+    plan.fds_.clear();
+
+    for (const LogRecord &record : plan.records_) {
+      plan.fds_.push_back(segments_[record.segment_]);
+      pins_[record.segment_] += 1;
+    }
+
+    return true;
+  }
+
+  // folds the payloads read for plan (one per record, or none if the reads
+  // failed) into payload, and releases the plan's segments. As in get, the
+  // chain is collapsed and the value cached, unless a write has changed the
+  // chain since the plan.
+  bool finish_read(const Key &key, const LogReadPlan &plan,
+                   const vector<string> &payloads, string *payload) {
+    for (const LogRecord &record : plan.records_) {
+      pins_[record.segment_] -= 1;
+    }
+
+    if (payloads.size() != plan.records_.size() || payloads.empty()) {
+      return false;
+    }
+
+    *payload = payloads[0];
+    for (unsigned i = 1; i < payloads.size(); i++) {
+      *payload = merge_(plan.type_, *payload, payloads[i]);
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end() &&
+        it->second.records_.size() == plan.records_.size()) {
+      bool unchanged = true;
+      for (unsigned i = 0; i < plan.records_.size(); i++) {
+        unchanged = unchanged &&
+                    it->second.records_[i].segment_ ==
+                        plan.records_[i].segment_ &&
+                    it->second.records_[i].offset_ == plan.records_[i].offset_;
+      }
+
+      if (unchanged && payloads.size() > 1) {
+        collapse(key, it->second, *payload);
+      }
+
+      if (unchanged) {
+        cache_.put(key, *payload);
+      }
+    }
+
+    return true;
+  }
+
+  // returns the number of payload bytes stored for the key. An LWW write
+  // older than what is stored would lose every merge, so it is dropped
+  // without being appended.
+  unsigned put(const Key &key, LatticeType type, const string &payload) {
+    uint64_t timestamp = 0;
+    bool timed = type == LatticeType::LWW && peek_lww(payload, timestamp);
+
+    auto it = index_.find(key);
+    if (timed && it != index_.end() && timestamp < it->second.timestamp_) {
+      return payload_bytes(it->second);
+    }
+
+    // a write that cannot be appended is not indexed
+    LogRecord record;
+    if (!append(key, type, payload, false, &record)) {
+      return it == index_.end() ? 0 : payload_bytes(it->second);
+    }
+
+    bool fresh = it == index_.end();
+    LogIndexEntry &entry = index_[key];
+    entry.type_ = type;
+    entry.records_.push_back(record);
+    entry.timestamp_ = std::max(entry.timestamp_, timestamp);
+
+    if (fresh) {
+      entry.oldest_segment_ = entry.records_.back().segment_;
+    }
+
+    // keep a cached value current without reading the chain back
+    string *cached = cache_.find(key);
+    if (cached != nullptr) {
+      cache_.put(key, merge_(type, *cached, payload));
+    }
+
+    if (entry.records_.size() >= kLogMaxChainLength) {
+      string merged;
+      if (merge_records(entry, &merged) && collapse(key, entry, merged)) {
+        cache_.put(key, merged);
+      }
+    }
+
+    return payload_bytes(entry);
+  }
+
+  void remove(const Key &key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return;
+    }
+
+    for (const LogRecord &record : it->second.records_) {
+      release(key, record);
+    }
+
+    // without its tombstone the key comes back on recovery, but it is not
+    // served before then
+    if (append(key, it->second.type_, "", true)) {
+      note_tombstone(key, it->second.oldest_segment_);
+    }
+
+    index_.erase(it);
+    cache_.erase(key);
+  }
+
+  // group commit: flushes everything appended since the last call, at most
+  // once per kLogSyncInterval unless forced
+  void sync(bool force = true) {
+    if (!dirty_) {
+      return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!force && std::chrono::duration_cast<std::chrono::microseconds>(
+                      now - last_sync_)
+                          .count() < kLogSyncInterval) {
+      return;
+    }
+
+    if (fdatasync(segments_[active_segment_]) != 0) {
+      std::cerr << "Failed to sync log segment." << std::endl;
+    }
+
+    dirty_ = false;
+    last_sync_ = now;
+  }
+
+  // incrementally rewrites the live records of a sealed segment whose live
+  // fraction is below kLogCompactionRatio, merging each key's records as it
+  // goes; each call handles at most kLogCompactionBatch records so the event
+  // loop is never stalled, and returns true while there is work left
+  bool compact() {
+    if (!compacting_) {
+      for (const auto &pair : segments_) {
+        unsigned id = pair.first;
+        if (id != active_segment_ && total_bytes_[id] > 0 &&
+            (double)live_bytes_[id] / total_bytes_[id] < kLogCompactionRatio) {
+          compacting_ = true;
+          compaction_segment_ = id;
+          compaction_offset_ = 0;
+          break;
+        }
+      }
+
+      if (!compacting_) {
+        return false;
+      }
+    }
+
+    unsigned victim = compaction_segment_;
+    int fd = segments_[victim];
+    char buf[kLogHeaderSize];
+
+    for (unsigned i = 0; i < kLogCompactionBatch; i++) {
+      if (compaction_offset_ + kLogHeaderSize > total_bytes_[victim] ||
+          !read_fully(fd, buf, kLogHeaderSize, compaction_offset_)) {
+        break;
+      }
+
+      LogRecordHeader header;
+      decode_log_header(buf, header);
+
+      Key key(header.key_length_, '\0');
+      if (header.key_length_ > 0 &&
+          !read_fully(fd, &key[0], header.key_length_,
+                      compaction_offset_ + kLogHeaderSize)) {
+        // try the record again on the next call
+        return true;
+      }
+
+      unsigned long long payload_offset =
+          compaction_offset_ + kLogHeaderSize + header.key_length_;
+      auto it = index_.find(key);
+
+      if (header.tombstone_) {
+        // a tombstone is only carried forward while an older segment may
+        // still hold records it hides. If the key has been stored again
+        // since, its value is rewritten after the moved tombstone so that
+        // recovery does not drop it.
+        string merged;
+        bool keep = hides_records(key, victim);
+
+        if (keep && it != index_.end() && !merge_records(it->second, &merged)) {
+          // try the record again on the next call
+          return true;
+        }
+
+        if (keep && !append(key, static_cast<LatticeType>(header.lattice_type_),
+                            "", true)) {
+          return true;
+        }
+
+        if (keep && it != index_.end() && !collapse(key, it->second, merged)) {
+          // the tombstone just moved stays behind, so it is counted, and the
+          // record is tried again on the next call
+          note_tombstone(key, victim);
+          return true;
+        }
+
+        if (!keep) {
+          auto tombstone = tombstones_.find(key);
+          if (tombstone != tombstones_.end() &&
+              --tombstone->second.count_ == 0) {
+            tombstones_.erase(tombstone);
+          }
+        }
+      } else if (it != index_.end()) {
+        bool live = false;
+        for (const LogRecord &record : it->second.records_) {
+          if (record.segment_ == victim && record.offset_ == payload_offset) {
+            live = true;
+          }
+        }
+
+        string merged;
+        if (live && !merge_records(it->second, &merged)) {
+          // a live record that is not moved would be lost with the segment,
+          // so try it again on the next call
+          return true;
+        }
+
+        if (live && !collapse(key, it->second, merged)) {
+          return true;
+        }
+      }
+
+      compaction_offset_ = payload_offset + header.payload_length_;
+    }
+
+    if (compaction_offset_ + kLogHeaderSize <= total_bytes_[victim]) {
+      return true;
+    }
+
+    // every live record has been moved once none of the segment's bytes are
+    // live; otherwise scan it again rather than lose the ones left behind
+    if (live_bytes_[victim] > 0) {
+      compaction_offset_ = 0;
+      return true;
+    }
+
+    // wait for the reads of the segment in flight to finish
+    auto pinned = pins_.find(victim);
+    if (pinned != pins_.end() && pinned->second > 0) {
+      return false;
+    }
+
+    // the rewritten records must be durable before the old copies vanish
+    sync();
+    close(fd);
+    unlink(segment_name(victim).c_str());
+
+    segments_.erase(victim);
+    live_bytes_.erase(victim);
+    total_bytes_.erase(victim);
+    compacting_ = false;
+    return false;
+  }
+
+  const ReadCache &cache() const { return cache_; }
+
+  // true if there are appended records that have not been synced yet
+  bool dirty() const { return dirty_; }
+
+  unsigned long long disk_usage() const {
+    unsigned long long usage = 0;
+    for (const auto &pair : total_bytes_) {
+      usage += pair.second;
+    }
+
+    return usage;
+  }
+};
+
+#endif // INCLUDE_KVS_LOG_STORE_HPP_
@@ -0,0 +1,135 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_LOOP_CLOCK_HPP_
+#define INCLUDE_KVS_LOOP_CLOCK_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define KVS_HAS_TSC 1
+#endif
+
+// A fine-grained monotonic clock for timing handlers. On x86 CPUs with an
+// invariant TSC (one that ticks at a constant rate on every core, whatever
+// the power state), a reading is a single rdtsc; elsewhere it falls back to
+// steady_clock in nanoseconds. The tick rate is calibrated against
+// steady_clock on first use, which spins for 10 milliseconds, so servers
+// calibrate before starting their worker threads.
+class CycleClock {
+  struct Calibration {
+    bool tsc;
+    double ticks_per_microsecond;
+  };
+
+#ifdef KVS_HAS_TSC
+  static bool invariant_tsc() {
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) &&
+        eax >= 0x80000007) {
+      __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+      return edx & (1 << 8);
+    }
+
+    return false;
+  }
+#endif
+
+  static Calibration calibrate() {
+#ifdef KVS_HAS_TSC
+    if (invariant_tsc()) {
+      auto start = std::chrono::steady_clock::now();
+      uint64_t tsc_start = __rdtsc();
+
+      std::chrono::steady_clock::time_point end;
+      do {
+        end = std::chrono::steady_clock::now();
+      } while (end - start < std::chrono::milliseconds(10));
+
+      uint64_t ticks = __rdtsc() - tsc_start;
+      double elapsed =
+          std::chrono::duration<double, std::micro>(end - start).count();
+      return {true, ticks / elapsed};
+    }
+#endif
+
+    // steady_clock readings, in nanoseconds
+    return {false, 1000};
+  }
+
+  static const Calibration &calibration() {
+    static const Calibration calibration = calibrate();
+    return calibration;
+  }
+
+public:
+  static uint64_t now() {
+#ifdef KVS_HAS_TSC
+    if (calibration().tsc) {
+      return __rdtsc();
+    }
+#endif
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static double ticks_per_microsecond() {
+    return calibration().ticks_per_microsecond;
+  }
+
+  static double to_microseconds(uint64_t ticks) {
+    return ticks / calibration().ticks_per_microsecond;
+  }
+
+  // whether readings come from the TSC rather than steady_clock
+  static bool uses_tsc() { return calibration().tsc; }
+};
+
+// The coarse time of an event loop: steady_clock is read once per iteration
+// by tick(), and every deadline and timestamp in the iteration uses that
+// reading, so they cost a load rather than a clock read each.
+class LoopClock {
+  std::chrono::steady_clock::time_point now_;
+
+public:
+  LoopClock() : now_(std::chrono::steady_clock::now()) {}
+
+  void tick() { now_ = std::chrono::steady_clock::now(); }
+
+  std::chrono::steady_clock::time_point now() const { return now_; }
+
+  long long microseconds_since(
+      std::chrono::steady_clock::time_point start) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(now_ - start)
+        .count();
+  }
+
+  long long milliseconds_since(
+      std::chrono::steady_clock::time_point start) const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now_ - start)
+        .count();
+  }
+
+  long long seconds_since(std::chrono::steady_clock::time_point start) const {
+    return std::chrono::duration_cast<std::chrono::seconds>(now_ - start)
+        .count();
+  }
+};
+
+#endif // INCLUDE_KVS_LOOP_CLOCK_HPP_
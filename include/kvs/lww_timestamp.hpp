@@ -0,0 +1,115 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_LWW_TIMESTAMP_HPP_
+#define INCLUDE_KVS_LWW_TIMESTAMP_HPP_
+
+#include <cstdint>
+#include <string>
+
+// Reads the fields of a serialized LWWValue in place, so that a write can be
+// compared with the stored value by its timestamp before (or instead of)
+// parsing the message and copying its value out. LWWValue is the timestamp
+// (field 1, a varint) and the value (field 2, length-delimited); a field
+// left at its default is not serialized.
+const uint64_t kLWWTimestampTag = 1 << 3;
+const uint64_t kLWWValueTag = 2 << 3 | 2;
+
+inline bool read_varint(const char *&p, const char *end, uint64_t &value) {
+  value = 0;
+
+  for (unsigned shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*p++);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// finds the timestamp of a serialized LWWValue and, if value is set, where
+// its value starts and how long it is; returns false if the message is
+// malformed, and the caller falls back to parsing it
+inline bool peek_lww(const std::string &serialized, uint64_t &timestamp,
+                     const char **value = nullptr,
+                     std::size_t *value_length = nullptr) {
+  const char *p = serialized.data();
+  const char *end = p + serialized.size();
+
+  timestamp = 0;
+  if (value != nullptr) {
+    *value = end;
+    *value_length = 0;
+  }
+
+  while (p < end) {
+    uint64_t tag;
+    uint64_t field;
+    if (!read_varint(p, end, tag) || !read_varint(p, end, field)) {
+      return false;
+    }
+
+    if (tag == kLWWTimestampTag) {
+      timestamp = field;
+    } else if ((tag & 7) == 2) {
+      if (field > static_cast<uint64_t>(end - p)) {
+        return false;
+      }
+
+      if (tag == kLWWValueTag && value != nullptr) {
+        *value = p;
+        *value_length = field;
+      }
+
+      p += field;
+    } else if ((tag & 7) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// the bytes a serialized LWWValue starts with its timestamp in, if it has
+// one: the tag and a varint of up to 10 bytes
+const unsigned kLWWTimestampPrefix = 11;
+
+// finds the timestamp of a serialized LWWValue from its first
+// kLWWTimestampPrefix bytes (or all of it, if it is shorter), since the
+// fields are serialized in order
+inline bool peek_lww_prefix(const std::string &prefix, uint64_t &timestamp) {
+  const char *p = prefix.data();
+  const char *end = p + prefix.size();
+
+  timestamp = 0;
+  if (p == end) {
+    return true;
+  }
+
+  uint64_t tag;
+  if (!read_varint(p, end, tag)) {
+    return false;
+  }
+
+  if (tag != kLWWTimestampTag) {
+    return tag == kLWWValueTag;
+  }
+
+  return read_varint(p, end, timestamp);
+}
+
+#endif // INCLUDE_KVS_LWW_TIMESTAMP_HPP_
@@ -0,0 +1,265 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_MEMORY_SNAPSHOT_HPP_
+#define INCLUDE_KVS_MEMORY_SNAPSHOT_HPP_
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "anna.pb.h"
+#include "types.hpp"
+
+// the first bytes of every snapshot; the last one is the format version
+const char kSnapshotMagic[8] = {'A', 'N', 'N', 'A', 'S', 'N', 'P', '1'};
+
+// the magic followed by the number of records
+const unsigned kSnapshotHeaderSize = 16;
+
+// the key length and the payload length (4 bytes each), and the lattice type
+const unsigned kSnapshotRecordHeaderSize = 9;
+
+// A memory tier thread's keys, written to a file that outlives the process,
+// so that a restarted thread can serve them right away rather than wait for
+// its peers to send them back. The event loop writes a snapshot a batch of
+// keys at a time into a temporary file, which replaces the previous snapshot
+// once it is complete and synced. Keys change between batches, so a snapshot
+// is not a consistent cut, but each value in it is one its key held; since
+// values are lattices, merging them with what the peers send back after the
+// restart converges just as gossip does.
+//
+// The file is a header (the magic and the number of records) followed by
+// records packed back to back: the record header, the key, and the serialized
+// lattice. load maps the file and reads the records in place.
+class MemorySnapshot {
+  string path_;
+  string temp_path_;
+
+  // the temporary file of the snapshot being written, or -1
+  int fd_;
+  uint64_t records_;
+  string buffer_;
+
+  // the last key written, once the first one has been
+  Key cursor_;
+  bool started_;
+
+  void discard(const string &message) {
+    std::cerr << message << " " << temp_path_ << std::endl;
+    close(fd_);
+    unlink(temp_path_.c_str());
+    fd_ = -1;
+  }
+
+  bool write_fully(const char *buf, size_t length, off_t offset) {
+    while (length > 0) {
+      ssize_t n = pwrite(fd_, buf, length, offset);
+      if (n <= 0) {
+        return false;
+      }
+
+      buf += n;
+      length -= n;
+      offset += n;
+    }
+
+    return true;
+  }
+
+  // appends the buffered records to the file
+  bool flush() {
+    off_t end = lseek(fd_, 0, SEEK_END);
+    bool written = end >= 0 && write_fully(buffer_.data(), buffer_.size(), end);
+    buffer_.clear();
+    return written;
+  }
+
+  void append(const Key &key, LatticeType type, const string &payload) {
+    char header[kSnapshotRecordHeaderSize];
+    uint32_t key_length = key.size();
+    uint32_t payload_length = payload.size();
+    memcpy(header, &key_length, 4);
+    memcpy(header + 4, &payload_length, 4);
+    header[8] = static_cast<uint8_t>(type);
+
+    buffer_.append(header, kSnapshotRecordHeaderSize);
+    buffer_ += key;
+    buffer_ += payload;
+    records_ += 1;
+  }
+
+public:
+  MemorySnapshot(const string &dir, unsigned tid)
+      : fd_(-1), records_(0), started_(false) {
+    string root = dir.back() == '/' ? dir : dir + "/";
+    mkdir(root.c_str(), 0755);
+
+    path_ = root + "snapshot_" + std::to_string(tid);
+    temp_path_ = path_ + ".tmp";
+  }
+
+  ~MemorySnapshot() {
+    if (fd_ != -1) {
+      discard("Abandoning the unfinished snapshot");
+    }
+  }
+
+  const string &path() const { return path_; }
+
+  bool in_progress() const { return fd_ != -1; }
+
+  // starts a new snapshot; a snapshot left unfinished by a crash is
+  // overwritten
+  bool start() {
+    fd_ = open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ == -1) {
+      std::cerr << "Failed to open snapshot " << temp_path_ << std::endl;
+      return false;
+    }
+
+    records_ = 0;
+    started_ = false;
+
+    char header[kSnapshotHeaderSize] = {0};
+    memcpy(header, kSnapshotMagic, sizeof(kSnapshotMagic));
+
+    if (!write_fully(header, kSnapshotHeaderSize, 0)) {
+      discard("Failed to write snapshot header");
+      return false;
+    }
+
+    return true;
+  }
+
+  // writes the next batch keys of stored, a map from keys to their
+  // KeyProperty, in key order; read(key, type, &payload) serializes a key's
+  // value and returns false if there is none. Returns true once every key
+  // has been written, after which finish completes the snapshot.
+  template <typename Map, typename Read>
+  bool write_batch(const Map &stored, unsigned batch, Read read) {
+    auto it = started_ ? stored.upper_bound(cursor_) : stored.begin();
+    string payload;
+
+    for (unsigned i = 0; i < batch && it != stored.end(); ++it, i++) {
+      if (it->second.type_ != LatticeType::NONE &&
+          read(it->first, it->second.type_, &payload)) {
+        append(it->first, it->second.type_, payload);
+      }
+
+      cursor_ = it->first;
+      started_ = true;
+    }
+
+    if (!flush()) {
+      discard("Failed to write snapshot");
+      return false;
+    }
+
+    return it == stored.end();
+  }
+
+  // records the number of records, syncs the snapshot, and puts it in place
+  // of the previous one
+  bool finish() {
+    if (!write_fully(reinterpret_cast<const char *>(&records_), 8,
+                     sizeof(kSnapshotMagic)) ||
+        fdatasync(fd_) != 0) {
+      discard("Failed to sync snapshot");
+      return false;
+    }
+
+    close(fd_);
+    fd_ = -1;
+
+    if (rename(temp_path_.c_str(), path_.c_str()) != 0) {
+      std::cerr << "Failed to replace snapshot " << path_ << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  // maps the snapshot at path and calls f(key, type, payload) for each of its
+  // records; returns the number of records read, stopping at the first one
+  // that runs past the end of the file
+  template <typename F> static uint64_t load(const string &path, F f) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kSnapshotHeaderSize) {
+      close(fd);
+      return 0;
+    }
+
+    size_t size = st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+      std::cerr << "Failed to map snapshot " << path << std::endl;
+      return 0;
+    }
+
+    // the records are read in order, once
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const char *data = static_cast<const char *>(map);
+    uint64_t records = 0;
+
+    if (memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0) {
+      memcpy(&records, data + sizeof(kSnapshotMagic), 8);
+    } else {
+      std::cerr << "Not a snapshot: " << path << std::endl;
+    }
+
+    size_t offset = kSnapshotHeaderSize;
+    uint64_t loaded = 0;
+
+    for (; loaded < records; loaded++) {
+      if (size - offset < kSnapshotRecordHeaderSize) {
+        break;
+      }
+
+      uint32_t key_length;
+      uint32_t payload_length;
+      memcpy(&key_length, data + offset, 4);
+      memcpy(&payload_length, data + offset + 4, 4);
+      LatticeType type =
+          static_cast<LatticeType>(static_cast<uint8_t>(data[offset + 8]));
+      offset += kSnapshotRecordHeaderSize;
+
+      if (size - offset < (size_t)key_length + payload_length) {
+        break;
+      }
+
+      f(Key(data + offset, key_length), type,
+        string(data + offset + key_length, payload_length));
+      offset += key_length + payload_length;
+    }
+
+    munmap(map, size);
+    return loaded;
+  }
+};
+
+#endif // INCLUDE_KVS_MEMORY_SNAPSHOT_HPP_
@@ -0,0 +1,30 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_MESSAGE_BUFFERS_HPP_
+#define INCLUDE_KVS_MESSAGE_BUFFERS_HPP_
+
+#include "anna.pb.h"
+
+// The protobuf messages a worker thread parses requests into and builds
+// responses in. They are reused for every request instead of being created
+// and destroyed each time: Clear() (which ParseFromString calls first) keeps
+// the capacity of strings and repeated fields, so after a few requests of a
+// given shape, parsing and answering the next one does not allocate.
+struct MessageBuffers {
+  KeyRequest request;
+  KeyResponse response;
+};
+
+#endif // INCLUDE_KVS_MESSAGE_BUFFERS_HPP_
@@ -0,0 +1,135 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_READ_CACHE_HPP_
+#define INCLUDE_KVS_READ_CACHE_HPP_
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "types.hpp"
+
+// A byte-bounded LRU cache of the merged values of a disk thread's keys, so
+// that a key read often is served from memory before the movement policy
+// gets around to promoting it. The cache holds serialized lattices, which is
+// what a read of the log produces and a response carries. A capacity of 0
+// disables it.
+class ReadCache {
+  struct Entry {
+    string payload_;
+    std::list<Key>::iterator position_;
+  };
+
+  // the list and hash nodes of an entry, and the key's second copy
+  static const unsigned long long kEntryOverhead =
+      sizeof(Entry) + sizeof(Key) + 6 * sizeof(void *);
+
+  unsigned long long capacity_;
+  unsigned long long bytes_;
+
+  // most recently used first
+  std::list<Key> order_;
+  std::unordered_map<Key, Entry> entries_;
+
+  uint64_t hits_;
+  uint64_t misses_;
+
+  static unsigned long long cost(const Key &key, const string &payload) {
+    return kEntryOverhead + 2 * key.size() + payload.size();
+  }
+
+  void evict() {
+    while (bytes_ > capacity_ && !order_.empty()) {
+      erase(order_.back());
+    }
+  }
+
+public:
+  explicit ReadCache(unsigned long long capacity)
+      : capacity_(capacity), bytes_(0), hits_(0), misses_(0) {}
+
+  bool enabled() const { return capacity_ > 0; }
+
+  // copies key's cached value into payload; counts a hit or a miss
+  bool get(const Key &key, string *payload) {
+    if (!enabled()) {
+      return false;
+    }
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      misses_ += 1;
+      return false;
+    }
+
+    hits_ += 1;
+    order_.splice(order_.begin(), order_, it->second.position_);
+    *payload = it->second.payload_;
+    return true;
+  }
+
+  // the cached value of key, or nullptr; neither a hit nor a miss
+  string *find(const Key &key) {
+    auto it = entries_.find(key);
+    return it == entries_.end() ? nullptr : &it->second.payload_;
+  }
+
+  // counts a miss for a lookup that was made with find
+  void record_miss() {
+    if (enabled()) {
+      misses_ += 1;
+    }
+  }
+
+  // caches payload as key's value, replacing what was cached
+  void put(const Key &key, const string &payload) {
+    if (!enabled() || cost(key, payload) > capacity_) {
+      erase(key);
+      return;
+    }
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      order_.push_front(key);
+      it = entries_.insert({key, Entry{string(), order_.begin()}}).first;
+    } else {
+      bytes_ -= cost(key, it->second.payload_);
+      order_.splice(order_.begin(), order_, it->second.position_);
+    }
+
+    it->second.payload_ = payload;
+    bytes_ += cost(key, payload);
+    evict();
+  }
+
+  void erase(const Key &key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return;
+    }
+
+    bytes_ -= cost(key, it->second.payload_);
+    order_.erase(it->second.position_);
+    entries_.erase(it);
+  }
+
+  unsigned long long bytes() const { return bytes_; }
+
+  uint64_t hits() const { return hits_; }
+
+  uint64_t misses() const { return misses_; }
+};
+
+#endif // INCLUDE_KVS_READ_CACHE_HPP_
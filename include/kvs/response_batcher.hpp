@@ -0,0 +1,158 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_RESPONSE_BATCHER_HPP_
+#define INCLUDE_KVS_RESPONSE_BATCHER_HPP_
+
+#include <chrono>
+#include <cstring>
+
+#include "anna.pb.h"
+#include "common.hpp"
+
+// Buffers outgoing KeyResponses per response address for at most max_delay_
+// microseconds (or until max_tuples_ tuples are waiting). Responses to the
+// same request are coalesced into a single KeyResponse, and everything bound
+// for one address goes out as a single multipart ZMQ message; clients read
+// the parts one at a time, exactly as if they had been sent separately. With
+// a max_delay_ of 0, every response is sent as soon as it is handed over.
+//
+// A held batcher buffers every response, whatever its bounds, until it is
+// released; a thread with a write-ahead log holds its responses until the
+// writes they report on are durable.
+class ResponseBatcher {
+  unsigned max_delay_;
+  unsigned max_tuples_;
+  bool held_;
+
+  map<Address, vector<KeyResponse>> pending_;
+  unsigned pending_tuples_;
+  std::chrono::steady_clock::time_point oldest_;
+
+  // reused for every response, so serializing does not allocate once it has
+  // grown to the largest response size
+  string serialized_;
+
+  void send_batch(const vector<KeyResponse> &batch, zmq::socket_t *socket) {
+    for (unsigned i = 0; i < batch.size(); i++) {
+      batch[i].SerializeToString(&serialized_);
+
+      zmq::message_t message(serialized_.size());
+      memcpy(message.data(), serialized_.data(), serialized_.size());
+      socket->send(message, i + 1 < batch.size() ? ZMQ_SNDMORE : 0);
+    }
+  }
+
+public:
+  ResponseBatcher(unsigned max_delay = 0, unsigned max_tuples = 0)
+      : max_delay_(max_delay), max_tuples_(max_tuples), held_(false),
+        pending_tuples_(0) {}
+
+  // buffers every response from now on, until the next release
+  void hold() { held_ = true; }
+
+  // sends every buffered response, and goes on buffering
+  void release(SocketCache &pushers) {
+    if (pending_tuples_ > 0) {
+      flush(pushers);
+    }
+  }
+
+  void send(const Address &address, const KeyResponse &response,
+            SocketCache &pushers) {
+    if (max_delay_ == 0 && !held_) {
+      response.SerializeToString(&serialized_);
+      kZmqUtil->send_string(serialized_, &pushers[address]);
+      return;
+    }
+
+    if (pending_tuples_ == 0) {
+      oldest_ = std::chrono::steady_clock::now();
+    }
+
+    pending_tuples_ += response.tuples_size();
+    vector<KeyResponse> &batch = pending_[address];
+
+    bool coalesced = false;
+    if (response.response_id() != "") {
+      for (KeyResponse &buffered : batch) {
+        if (buffered.response_id() == response.response_id() &&
+            buffered.type() == response.type()) {
+          buffered.mutable_tuples()->MergeFrom(response.tuples());
+          coalesced = true;
+          break;
+        }
+      }
+    }
+
+    if (!coalesced) {
+      batch.push_back(response);
+    }
+
+    if (!held_ && pending_tuples_ >= max_tuples_) {
+      flush(pushers);
+    }
+  }
+
+  // sends responses, which are all bound for address, as one message, or
+  // buffers each of them as send would
+  void send_all(const Address &address, const vector<KeyResponse> &responses,
+                SocketCache &pushers) {
+    if (max_delay_ > 0 || held_ || responses.size() == 1) {
+      for (const KeyResponse &response : responses) {
+        send(address, response, pushers);
+      }
+    } else if (responses.size() > 1) {
+      send_batch(responses, &pushers[address]);
+    }
+  }
+
+  void flush(SocketCache &pushers) {
+    for (const auto &pair : pending_) {
+      if (pair.second.size() == 1) {
+        pair.second[0].SerializeToString(&serialized_);
+        kZmqUtil->send_string(serialized_, &pushers[pair.first]);
+      } else {
+        send_batch(pair.second, &pushers[pair.first]);
+      }
+    }
+
+    pending_.clear();
+    pending_tuples_ = 0;
+  }
+
+  // flushes if the oldest buffered response has waited max_delay_
+  void flush_if_due(SocketCache &pushers) {
+    if (!held_ && pending_tuples_ > 0 && time_until_due() == 0) {
+      flush(pushers);
+    }
+  }
+
+  bool empty() const { return pending_tuples_ == 0; }
+
+  // milliseconds until the buffered responses must go out, rounded up
+  long time_until_due() const {
+    long waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - oldest_)
+                      .count();
+
+    if (waited >= (long)max_delay_) {
+      return 0;
+    }
+
+    return (max_delay_ - waited + 999) / 1000;
+  }
+};
+
+#endif // INCLUDE_KVS_RESPONSE_BATCHER_HPP_
@@ -0,0 +1,306 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_SERVER_METRICS_HPP_
+#define INCLUDE_KVS_SERVER_METRICS_HPP_
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.hpp"
+
+// The work a server thread does, in the order of its poll items; the gossip
+// round is the periodic gossip of the local changeset.
+enum class Handler {
+  JOIN,
+  DEPART,
+  SELF_DEPART,
+  REQUEST,
+  GOSSIP,
+  REPLICATION_RESPONSE,
+  REPLICATION_CHANGE,
+  CACHE_IP,
+  MANAGEMENT,
+  GOSSIP_ROUND,
+  EVICTION,
+  SNAPSHOT,
+  WAL_COMMIT,
+  DISK_READ,
+  STATS_REPORT,
+  HOT_KEYS
+};
+
+const unsigned kHandlerCount = 16;
+
+const char *const kHandlerNames[kHandlerCount] = {
+    "join",       "depart",       "self_depart",          "request",
+    "gossip",     "replication_response", "replication_change", "cache_ip",
+    "management", "gossip_round", "eviction", "snapshot", "wal_commit",
+    "disk_read",  "stats_report", "hot_keys"};
+
+// the upper bounds (in microseconds) of the histogram buckets exported to
+// Prometheus; the full-resolution histograms stay in the server
+const uint64_t kMetricsBuckets[] = {10,    25,    50,     100,    250,
+                                    500,   1000,  2500,   5000,   10000,
+                                    25000, 50000, 100000, 250000, 1000000};
+
+// how often each server thread publishes its metrics (in milliseconds)
+const unsigned kMetricsPublishInterval = 1000;
+
+// a scrape is answered once its headers end or it reaches this many bytes
+const unsigned kMetricsMaxRequestSize = 8192;
+
+struct HandlerMetrics {
+  // the time spent on each message
+  LatencyHistogram latency;
+
+  // the number of times the handler's socket was drained, and how many of
+  // those stopped at the drain budget with messages still queued
+  uint64_t wakeups = 0;
+  uint64_t backlogged = 0;
+};
+
+// The metrics of one server thread since it started: the time each handler
+// spends per message, how often each socket is left with a backlog, and the
+// sizes of the thread's queues and stores. A thread records into its own
+// ServerMetrics and periodically publishes a copy to the MetricsRegistry.
+struct ServerMetrics {
+  std::vector<HandlerMetrics> handlers;
+
+  // requests and gossip waiting on a key's replication factor
+  uint64_t pending_requests = 0;
+  uint64_t pending_gossip = 0;
+
+  // bytes held by the value stores, and the total size of the stored values
+  uint64_t value_store_bytes = 0;
+  uint64_t storage_consumption_bytes = 0;
+
+  // the disk tier's read cache: lookups it answered and did not, and the
+  // bytes it holds
+  uint64_t read_cache_hits = 0;
+  uint64_t read_cache_misses = 0;
+  uint64_t read_cache_bytes = 0;
+
+  // the requests shed while the thread was overloaded, and how long (in
+  // milliseconds) its request socket has been backlogged
+  uint64_t requests_shed = 0;
+  uint64_t request_backlog_ms = 0;
+
+  // whether the thread has started serving, and how long (in milliseconds)
+  // after the process started it did
+  uint64_t ready = 0;
+  uint64_t startup_ms = 0;
+
+  ServerMetrics() : handlers(kHandlerCount) {}
+
+  void record(Handler handler, double latency) {
+    handlers[static_cast<unsigned>(handler)].latency.record(latency);
+  }
+
+  void record_drain(Handler handler, bool backlogged) {
+    HandlerMetrics &metrics = handlers[static_cast<unsigned>(handler)];
+    metrics.wakeups += 1;
+
+    if (backlogged) {
+      metrics.backlogged += 1;
+    }
+  }
+};
+
+// The latest metrics published by each server thread of this process,
+// rendered in the Prometheus text format for scrapes.
+class MetricsRegistry {
+  struct Slot {
+    std::mutex mutex;
+    ServerMetrics metrics;
+  };
+
+  std::vector<std::unique_ptr<Slot>> slots_;
+
+  static void header(std::ostringstream &out, const std::string &name,
+                     const std::string &type, const std::string &help) {
+    out << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+  }
+
+  static std::string labels(unsigned tid, unsigned handler) {
+    return "thread=\"" + std::to_string(tid) + "\",handler=\"" +
+           kHandlerNames[handler] + "\"";
+  }
+
+public:
+  explicit MetricsRegistry(unsigned threads) {
+    for (unsigned i = 0; i < threads; i++) {
+      slots_.push_back(std::unique_ptr<Slot>(new Slot()));
+    }
+  }
+
+  void publish(unsigned tid, const ServerMetrics &metrics) {
+    if (tid >= slots_.size()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(slots_[tid]->mutex);
+    slots_[tid]->metrics = metrics;
+  }
+
+  std::string render() {
+    std::vector<ServerMetrics> snapshots;
+    for (const auto &slot : slots_) {
+      std::lock_guard<std::mutex> lock(slot->mutex);
+      snapshots.push_back(slot->metrics);
+    }
+
+    std::ostringstream out;
+
+    header(out, "anna_handler_latency_microseconds", "histogram",
+           "Time spent handling each message.");
+    for (unsigned tid = 0; tid < snapshots.size(); tid++) {
+      for (unsigned h = 0; h < kHandlerCount; h++) {
+        const LatencyHistogram &latency = snapshots[tid].handlers[h].latency;
+        const std::vector<uint64_t> &counts = latency.counts();
+        std::string name = "anna_handler_latency_microseconds";
+        uint64_t cumulative = 0;
+        unsigned index = 0;
+
+        for (uint64_t bound : kMetricsBuckets) {
+          // buckets hold values within the histogram's precision of their
+          // index, so a few values just above bound may be counted with it
+          for (; index <= LatencyHistogram::bucket_index(bound); index++) {
+            cumulative += counts[index];
+          }
+
+          out << name << "_bucket{" << labels(tid, h) << ",le=\"" << bound
+              << "\"} " << cumulative << "\n";
+        }
+
+        out << name << "_bucket{" << labels(tid, h) << ",le=\"+Inf\"} "
+            << latency.total() << "\n"
+            << name << "_sum{" << labels(tid, h) << "} "
+            << latency.mean() * latency.total() << "\n"
+            << name << "_count{" << labels(tid, h) << "} " << latency.total()
+            << "\n";
+      }
+    }
+
+    header(out, "anna_socket_wakeups_total", "counter",
+           "Times a handler's socket was drained.");
+    for (unsigned tid = 0; tid < snapshots.size(); tid++) {
+      for (unsigned h = 0; h < kHandlerCount; h++) {
+        out << "anna_socket_wakeups_total{" << labels(tid, h) << "} "
+            << snapshots[tid].handlers[h].wakeups << "\n";
+      }
+    }
+
+    header(out, "anna_socket_backlogged_total", "counter",
+           "Drains that hit the drain budget with messages still queued.");
+    for (unsigned tid = 0; tid < snapshots.size(); tid++) {
+      for (unsigned h = 0; h < kHandlerCount; h++) {
+        out << "anna_socket_backlogged_total{" << labels(tid, h) << "} "
+            << snapshots[tid].handlers[h].backlogged << "\n";
+      }
+    }
+
+    struct Gauge {
+      std::string name;
+      std::string help;
+      uint64_t ServerMetrics::*value;
+    };
+
+    const std::vector<Gauge> counters = {
+        {"anna_read_cache_hits_total",
+         "Disk tier reads answered by the read cache.",
+         &ServerMetrics::read_cache_hits},
+        {"anna_read_cache_misses_total",
+         "Disk tier reads that the read cache could not answer.",
+         &ServerMetrics::read_cache_misses},
+        {"anna_requests_shed_total",
+         "Requests answered as overloaded without being served.",
+         &ServerMetrics::requests_shed}};
+
+    for (const Gauge &counter : counters) {
+      header(out, counter.name, "counter", counter.help);
+
+      for (unsigned tid = 0; tid < snapshots.size(); tid++) {
+        out << counter.name << "{thread=\"" << tid << "\"} "
+            << snapshots[tid].*counter.value << "\n";
+      }
+    }
+
+    const std::vector<Gauge> gauges = {
+        {"anna_pending_requests",
+         "Requests waiting on a key's replication factor.",
+         &ServerMetrics::pending_requests},
+        {"anna_pending_gossip", "Gossip waiting on a key's replication factor.",
+         &ServerMetrics::pending_gossip},
+        {"anna_value_store_bytes", "Bytes held by the value stores.",
+         &ServerMetrics::value_store_bytes},
+        {"anna_storage_consumption_bytes",
+         "Total size of the stored values, as of the last stats report.",
+         &ServerMetrics::storage_consumption_bytes},
+        {"anna_read_cache_bytes", "Bytes held by the disk tier's read cache.",
+         &ServerMetrics::read_cache_bytes},
+        {"anna_request_backlog_milliseconds",
+         "How long the request socket has stayed backlogged.",
+         &ServerMetrics::request_backlog_ms},
+        {"anna_thread_ready", "Whether the thread has started serving.",
+         &ServerMetrics::ready},
+        {"anna_startup_milliseconds",
+         "Time from the process start until the thread started serving.",
+         &ServerMetrics::startup_ms}};
+
+    for (const Gauge &gauge : gauges) {
+      header(out, gauge.name, "gauge", gauge.help);
+
+      for (unsigned tid = 0; tid < snapshots.size(); tid++) {
+        out << gauge.name << "{thread=\"" << tid << "\"} "
+            << snapshots[tid].*gauge.value << "\n";
+      }
+    }
+
+    return out.str();
+  }
+};
+
+// Answers one HTTP request with the registry's metrics if it asks for
+// /metrics (or /), and with a 404 otherwise; the connection is closed after
+// every response.
+inline std::string metrics_http_response(const std::string &request,
+                                         MetricsRegistry &registry) {
+  std::string path;
+  std::istringstream line(request.substr(0, request.find("\r\n")));
+  std::string method;
+  line >> method >> path;
+
+  std::string status = "200 OK";
+  std::string body;
+
+  if (method != "GET") {
+    status = "405 Method Not Allowed";
+  } else if (path == "/metrics" || path == "/") {
+    body = registry.render();
+  } else {
+    status = "404 Not Found";
+  }
+
+  return "HTTP/1.1 " + status +
+         "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+         "Content-Length: " +
+         std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
+
+#endif // INCLUDE_KVS_SERVER_METRICS_HPP_
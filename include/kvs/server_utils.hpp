@@ -15,815 +15,925 @@
 #ifndef INCLUDE_KVS_SERVER_UTILS_HPP_
 #define INCLUDE_KVS_SERVER_UTILS_HPP_
 
-#include <fstream>
+#include <limits>
 #include <string>
-#include <unistd.h> // for ftruncate(2)
 
 #include "base_kv_store.hpp"
 #include "common.hpp"
+#include "disk_reader.hpp"
+#include "hashers.hpp"
+#include "intra_node_dispatch.hpp"
+#include "key_access_tracker.hpp"
 #include "kvs_common.hpp"
 #include "lattices/lww_pair_lattice.hpp"
+#include "log_store.hpp"
+#include "lww_timestamp.hpp"
+#include "message_buffers.hpp"
+#include "response_batcher.hpp"
+#include "trace.hpp"
+#include "value_compression.hpp"
+#include "workload_capture.hpp"
+#include "write_ahead_log.hpp"
 #include "yaml-cpp/yaml.h"
 
 // Define the garbage collect threshold
 #define GARBAGE_COLLECT_THRESHOLD 10000000
 
-// Define the data redistribute threshold
-#define DATA_REDISTRIBUTE_THRESHOLD 50
+// Define the default number of keys handed off to each address per event
+// loop iteration after a node join or departure
+#define DATA_REDISTRIBUTE_THRESHOLD 1000
 
-// Define the gossip period (frequency)
+// Define the default gossip period (frequency)
 #define PERIOD 10000000 // 10 seconds
 
+// The size (in bytes of keys and payloads) at which a gossip or
+// redistribution message to one address is sent and a new one started.
+const unsigned kGossipChunkSize = 4 * 1024 * 1024;
+
+// Every kAntiEntropyRounds-th round of gossip sends the full value of each key
+// that has only been gossiped as deltas since the previous full round.
+const unsigned kAntiEntropyRounds = 6;
+
 typedef KVStore<Key, LWWPairLattice<string>> MemoryLWWKVS;
-typedef KVStore<Key, SetLattice<string>> MemorySetKVS;
-typedef KVStore<Key, OrderedSetLattice<string>> MemoryOrderedSetKVS;
+typedef KVStore<Key, FlatSetLattice<string>> MemorySetKVS;
+typedef KVStore<Key, FlatSetLattice<string>> MemoryOrderedSetKVS;
 typedef KVStore<Key, SingleKeyCausalLattice<SetLattice<string>>>
     MemorySingleKeyCausalKVS;
 typedef KVStore<Key, MultiKeyCausalLattice<SetLattice<string>>>
     MemoryMultiKeyCausalKVS;
 typedef KVStore<Key, PriorityLattice<double, string>> MemoryPriorityKVS;
 
+// moves the values of a parsed SetValue into a set
+inline FlatSetLattice<string> to_flat_set(SetValue &set_value) {
+  vector<string> elements;
+  elements.reserve(set_value.values_size());
+
+  for (string &element : *set_value.mutable_values()) {
+    elements.push_back(std::move(element));
+  }
+
+  return FlatSetLattice<string>(std::move(elements));
+}
+
+// serialized like SetLattice and OrderedSetLattice, as a SetValue in order
+inline string serialize(const FlatSetLattice<string> &l) {
+  SetValue set_value;
+  for (const string &element : l.reveal()) {
+    set_value.add_values(element);
+  }
+
+  string serialized;
+  set_value.SerializeToString(&serialized);
+  return serialized;
+}
+
+inline FlatSetLattice<string> deserialize_flat_set(const string &serialized) {
+  SetValue set_value;
+  set_value.ParseFromString(serialized);
+  return to_flat_set(set_value);
+}
+
 // a map that represents which keys should be sent to which IP-port combinations
 typedef map<Address, set<Key>> AddressKeysetMap;
 
-class Serializer {
+// the tenant key belongs to: the prefix of the key up to the first
+// delimiter, or "" for a key without one
+inline string tenant_of(const Key &key, char delimiter) {
+  std::size_t end = key.find(delimiter);
+  return end == string::npos ? string() : key.substr(0, end);
+}
+
+// The keys stored on this thread, indexed by their position on the global
+// hash ring as well, so a membership change only visits the keys in the hash
+// ranges that changed owner. process_put indexes a key when it first writes
+// it; entries that a lookup through operator[] creates hold no data and are
+// left out of the index.
+//
+// The map also keeps the total size of the stored keys, and runs a CLOCK over
+// them in key order to choose keys to evict: a key that was accessed since
+// the hand last passed it gets another turn, and the first one that was not
+// is the next victim.
+//
+// Once told the delimiter of tenant prefixes, it keeps the size of each
+// tenant's keys as well, which is what tenants' memory quotas are held to.
+//
+// A key whose copy on this thread is about to be dropped, by a replication
+// change that is still on its way here, is marked as dropping until the
+// change arrives; its size when it was marked is not counted in
+// retained_bytes.
+class StoredKeyMap : public map<Key, KeyProperty> {
 public:
-  virtual string get(const Key &key, AnnaError &error) = 0;
-  virtual unsigned put(const Key &key, const string &serialized) = 0;
-  virtual void remove(const Key &key) = 0;
-  virtual ~Serializer(){};
-};
+  typedef GlobalHasher::ResultType HashType;
 
-class MemoryLWWSerializer : public Serializer {
-  MemoryLWWKVS *kvs_;
+private:
+  typedef std::set<std::pair<HashType, Key>> HashIndex;
 
-public:
-  MemoryLWWSerializer(MemoryLWWKVS *kvs) : kvs_(kvs) {}
-
-  string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
+  HashIndex hash_index_;
 
-    if (val.reveal().value == "") {
-      error = AnnaError::KEY_DNE;
-    }
+  // the sum of the sizes set through set_size
+  unsigned long long bytes_;
 
-    return serialize(val);
-  }
+  // the last key the clock hand passed
+  Key hand_;
 
-  unsigned put(const Key &key, const string &serialized) {
-    LWWPairLattice<string> val = deserialize_lww(serialized);
-    kvs_->put(key, val);
-    return kvs_->size(key);
-  }
+  // the keys marked as dropping, with their sizes when they were marked, and
+  // the sum of those sizes
+  map<Key, unsigned> dropping_;
+  unsigned long long dropping_bytes_;
 
-  void remove(const Key &key) { kvs_->remove(key); }
-};
+  // the delimiter that ends a key's tenant prefix, or 0 if tenants are not
+  // tracked, and the sum of the sizes of each tenant's keys
+  char tenant_delimiter_;
+  hmap<string, unsigned long long> tenant_bytes_;
 
-class MemorySetSerializer : public Serializer {
-  MemorySetKVS *kvs_;
+  void charge(const Key &key, unsigned old_size, unsigned new_size) {
+    if (tenant_delimiter_ == 0) {
+      return;
+    }
 
-public:
-  MemorySetSerializer(MemorySetKVS *kvs) : kvs_(kvs) {}
+    unsigned long long &bytes =
+        tenant_bytes_[tenant_of(key, tenant_delimiter_)];
+    bytes = bytes - std::min(bytes, (unsigned long long)old_size) + new_size;
+  }
 
-  string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
-    if (val.size().reveal() == 0) {
-      error = AnnaError::KEY_DNE;
+  // the first index entry whose hash is greater than hash
+  HashIndex::const_iterator first_after(HashType hash) const {
+    if (hash == std::numeric_limits<HashType>::max()) {
+      return hash_index_.end();
     }
-    return serialize(val);
-  }
 
-  unsigned put(const Key &key, const string &serialized) {
-    SetLattice<string> sl = deserialize_set(serialized);
-    kvs_->put(key, sl);
-    return kvs_->size(key);
+    return hash_index_.lower_bound(std::make_pair(hash + 1, Key()));
   }
 
-  void remove(const Key &key) { kvs_->remove(key); }
-};
+public:
+  // a place in the hash index, for walking it a batch of keys at a time
+  typedef std::pair<HashType, Key> IndexPosition;
 
-class MemoryOrderedSetSerializer : public Serializer {
-  MemoryOrderedSetKVS *kvs_;
+  using map<Key, KeyProperty>::erase;
 
-public:
-  MemoryOrderedSetSerializer(MemoryOrderedSetKVS *kvs) : kvs_(kvs) {}
+  StoredKeyMap() : bytes_(0), dropping_bytes_(0), tenant_delimiter_(0) {}
 
-  string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
-    return serialize(val);
+  // starts keeping the size of each tenant's keys; keys stored before are
+  // not counted
+  void track_tenants(char delimiter) { tenant_delimiter_ = delimiter; }
+
+  void index(const Key &key) {
+    hash_index_.insert(std::make_pair(GlobalHasher()(key), key));
   }
 
-  unsigned put(const Key &key, const string &serialized) {
-    OrderedSetLattice<string> sl = deserialize_ordered_set(serialized);
-    kvs_->put(key, sl);
-    return kvs_->size(key);
+  std::size_t erase(const Key &key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+
+    // sizes written directly (as the tests do) were never counted
+    bytes_ -= std::min(bytes_, (unsigned long long)it->second.size_);
+    charge(key, it->second.size_, 0);
+    end_drop(key);
+    hash_index_.erase(std::make_pair(GlobalHasher()(key), key));
+    map<Key, KeyProperty>::erase(it);
+    return 1;
   }
 
-  void remove(const Key &key) { kvs_->remove(key); }
-};
+  void set_size(const Key &key, KeyProperty &property, unsigned size) {
+    bytes_ = bytes_ - std::min(bytes_, (unsigned long long)property.size_) +
+             size;
+    charge(key, property.size_, size);
+    property.size_ = size;
+  }
 
-class MemorySingleKeyCausalSerializer : public Serializer {
-  MemorySingleKeyCausalKVS *kvs_;
+  unsigned long long bytes() const { return bytes_; }
 
-public:
-  MemorySingleKeyCausalSerializer(MemorySingleKeyCausalKVS *kvs) : kvs_(kvs) {}
+  // the bytes that stay stored once the keys marked as dropping are gone
+  unsigned long long retained_bytes() const {
+    return bytes_ - std::min(bytes_, dropping_bytes_);
+  }
 
-  string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
-    if (val.reveal().value.size().reveal() == 0) {
-      error = AnnaError::KEY_DNE;
+  void start_drop(const Key &key) {
+    auto it = find(key);
+    if (it != end() && dropping_.insert({key, it->second.size_}).second) {
+      dropping_bytes_ += it->second.size_;
     }
-    return serialize(val);
   }
 
-  unsigned put(const Key &key, const string &serialized) {
-    SingleKeyCausalValue causal_value = deserialize_causal(serialized);
-    VectorClockValuePair<SetLattice<string>> p =
-        to_vector_clock_value_pair(causal_value);
-    kvs_->put(key, SingleKeyCausalLattice<SetLattice<string>>(p));
-    return kvs_->size(key);
+  // unmarks key, as when the change that was to drop it has arrived
+  void end_drop(const Key &key) {
+    auto it = dropping_.find(key);
+    if (it != dropping_.end()) {
+      dropping_bytes_ -= it->second;
+      dropping_.erase(it);
+    }
   }
 
-  void remove(const Key &key) { kvs_->remove(key); }
-};
+  bool dropping(const Key &key) const {
+    return dropping_.find(key) != dropping_.end();
+  }
 
-class MemoryMultiKeyCausalSerializer : public Serializer {
-  MemoryMultiKeyCausalKVS *kvs_;
+  // the bytes the keys of tenant take up, if tenants are tracked
+  unsigned long long tenant_bytes(const string &tenant) const {
+    auto it = tenant_bytes_.find(tenant);
+    return it == tenant_bytes_.end() ? 0 : it->second;
+  }
 
-public:
-  MemoryMultiKeyCausalSerializer(MemoryMultiKeyCausalKVS *kvs) : kvs_(kvs) {}
+  const hmap<string, unsigned long long> &tenant_bytes() const {
+    return tenant_bytes_;
+  }
 
-  string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
-    if (val.reveal().value.size().reveal() == 0) {
-      error = AnnaError::KEY_DNE;
+  // marks a stored key as recently accessed
+  void touch(const Key &key) {
+    auto it = find(key);
+    if (it != end()) {
+      it->second.referenced_ = true;
     }
-    return serialize(val);
   }
 
-  unsigned put(const Key &key, const string &serialized) {
-    MultiKeyCausalValue multi_key_causal_value =
-        deserialize_multi_key_causal(serialized);
-    MultiKeyCausalPayload<SetLattice<string>> p =
-        to_multi_key_causal_payload(multi_key_causal_value);
-    kvs_->put(key, MultiKeyCausalLattice<SetLattice<string>>(p));
-    return kvs_->size(key);
-  }
+  // advances the clock hand to the next key that holds data, was not
+  // accessed since the hand last passed it, and for which evictable holds;
+  // returns false if no key qualifies within two turns of the clock
+  template <typename Predicate>
+  bool next_victim(Key &victim, Predicate evictable) {
+    std::size_t steps = 2 * size();
+
+    for (std::size_t step = 0; step < steps; step++) {
+      auto it = upper_bound(hand_);
+      if (it == end()) {
+        it = begin();
+      }
 
-  void remove(const Key &key) { kvs_->remove(key); }
-};
+      hand_ = it->first;
+      KeyProperty &property = it->second;
 
-class MemoryPrioritySerializer : public Serializer {
-  MemoryPriorityKVS *kvs_;
+      if (property.type_ == LatticeType::NONE || !evictable(it->first)) {
+        continue;
+      }
 
-public:
-  MemoryPrioritySerializer(MemoryPriorityKVS *kvs) : kvs_(kvs) {}
+      if (property.referenced_) {
+        property.referenced_ = false;
+        continue;
+      }
 
-  string get(const Key &key, AnnaError &error) {
-    auto val = kvs_->get(key, error);
-    if (val.reveal().value == "") {
-      error = AnnaError::KEY_DNE;
+      victim = it->first;
+      return true;
     }
-    return serialize(val);
-  }
 
-  unsigned put(const Key &key, const string &serialized) {
-    PriorityLattice<double, string> val = deserialize_priority(serialized);
-    kvs_->put(key, val);
-    return kvs_->size(key);
+    return false;
   }
 
-  void remove(const Key &key) { kvs_->remove(key); }
-};
+  // calls f on every indexed key with a hash in (lo, hi], in ring order;
+  // the range runs clockwise, as in HashRing::owned_ranges
+  template <typename F>
+  void for_each_in_range(HashType lo, HashType hi, F f) const {
+    auto start = first_after(lo);
+    auto stop = first_after(hi);
 
-class DiskLWWSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+    if (lo < hi) {
+      for (auto it = start; it != stop; ++it) {
+        f(it->second);
+      }
 
-public:
-  DiskLWWSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+      return;
+    }
 
-    ebs_root_ = conf["ebs"].as<string>();
+    for (auto it = start; it != hash_index_.end(); ++it) {
+      f(it->second);
+    }
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
+    for (auto it = hash_index_.begin(); it != stop; ++it) {
+      f(it->second);
     }
   }
 
-  string get(const Key &key, AnnaError &error) {
-    string res;
-    LWWValue value;
+  // calls f on the indexed keys from position on, in hash order, until it
+  // reaches one with a hash above hi or has called f batch times; moves
+  // position past the last key and returns true once no key is left. A walk
+  // that starts at (lo + 1, "") and ends at hi covers the range (lo, hi].
+  template <typename F>
+  bool walk_index(IndexPosition &position, HashType hi, unsigned batch,
+                  F f) const {
+    auto it = hash_index_.lower_bound(position);
+
+    for (unsigned i = 0; i < batch; ++it, i++) {
+      if (it == hash_index_.end() || it->first > hi) {
+        return true;
+      }
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+      f(it->second);
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
-      error = AnnaError::KEY_DNE;
-    } else {
-      if (value.value() == "") {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
+      // the first position after the key
+      position = *it;
+      position.second.push_back('\0');
     }
-    return res;
-  }
 
-  unsigned put(const Key &key, const string &serialized) {
-    LWWValue input_value;
-    input_value.ParseFromString(serialized);
+    return it == hash_index_.end() || it->first > hi;
+  }
 
-    LWWValue original_value;
+  // adds the indexed keys with a hash in (lo, hi] to keys
+  void keys_in_range(HashType lo, HashType hi, set<Key> &keys) const {
+    for_each_in_range(lo, hi, [&keys](const Key &key) { keys.insert(key); });
+  }
 
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+  std::size_t indexed() const { return hash_index_.size(); }
+};
 
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
+// The serializers below are final, so a call through one of them rather
+// than through a Serializer pointer (as the microbenchmarks make) is bound at
+// compile time, and the store's merge for its lattice is inlined into it.
+class Serializer {
+public:
+  // writes the serialized value for key into payload, which is usually the
+  // payload field of the outgoing KeyTuple
+  virtual void get(const Key &key, string *payload, AnnaError &error) = 0;
+  // merges serialized into the value stored at key and returns the bytes the
+  // key takes up in the store, in memory or on disk
+  virtual unsigned put(const Key &key, const string &serialized) = 0;
+  virtual void remove(const Key &key) = 0;
+  // hints that key is about to be read, so its slot can be loaded early
+  virtual void prefetch(const Key &key) {}
+  // bytes of memory held by the underlying store, if it tracks them
+  virtual unsigned long long memory_usage() { return 0; }
+  virtual ~Serializer(){};
 
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
-      std::cerr << "Failed to parse payload." << std::endl;
-      return 0;
-    } else {
-      if (input_value.timestamp() >= original_value.timestamp()) {
-        std::fstream output(fname,
-                            std::ios::out | std::ios::trunc | std::ios::binary);
-        if (!input_value.SerializeToOstream(&output)) {
-          std::cerr << "Failed to write payload" << std::endl;
-        }
-        return output.tellp();
-      } else {
-        return input.tellp();
-      }
-    }
+  string get(const Key &key, AnnaError &error) {
+    string payload;
+    get(key, &payload, error);
+    return payload;
   }
+};
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+// copies the cached serialized form of the value stored at key into payload,
+// serializing the value first if it has been merged since the last read;
+// returns nullptr if the key is not in the store
+template <typename V>
+const V *get_serialized(KVStore<Key, V> *kvs, const Key &key, string *payload,
+                        AnnaError &error) {
+  string *cache;
+  const V *val = kvs->find(key, cache);
+
+  if (val == nullptr) {
+    error = AnnaError::KEY_DNE;
+    return nullptr;
+  }
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+  if (cache->empty()) {
+    *cache = serialize(*val);
   }
-};
 
-class DiskSetSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+  *payload = *cache;
+  return val;
+}
+
+class MemoryLWWSerializer final : public Serializer {
+  MemoryLWWKVS *kvs_;
+
+  // reused by every put, so parsing a value does not allocate the message
+  LWWValue value_;
 
 public:
-  DiskSetSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  MemoryLWWSerializer(MemoryLWWKVS *kvs) : kvs_(kvs) {}
 
-    ebs_root_ = conf["ebs"].as<string>();
+  void get(const Key &key, string *payload, AnnaError &error) {
+    auto val = get_serialized(kvs_, key, payload, error);
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
+    if (val != nullptr && val->reveal().value == "") {
+      error = AnnaError::KEY_DNE;
     }
   }
 
-  string get(const Key &key, AnnaError &error) {
-    string res;
-    SetValue value;
+  unsigned put(const Key &key, const string &serialized) {
+    // a write older than the stored value is dropped without being parsed,
+    // as is a write of the stored value itself
+    string *cache;
+    unsigned bytes;
+    uint64_t timestamp;
+    const LWWPairLattice<string> *stored = kvs_->find(key, cache, bytes);
+
+    if (stored != nullptr && peek_lww(serialized, timestamp) &&
+        (timestamp < stored->reveal().timestamp ||
+         (timestamp == stored->reveal().timestamp && !cache->empty() &&
+          *cache == serialized))) {
+      return bytes;
+    }
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    value_.ParseFromString(serialized);
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
-      error = AnnaError::KEY_DNE;
-    } else {
-      if (value.values_size() == 0) {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
-    }
-    return res;
+    // the parsed value is moved into the lattice rather than copied
+    LWWPairLattice<string> val(TimestampValuePair<string>(
+        value_.timestamp(), std::move(*value_.mutable_value())));
+    return kvs_->put(key, val);
   }
 
-  unsigned put(const Key &key, const string &serialized) {
-    SetValue input_value;
-    input_value.ParseFromString(serialized);
+  void remove(const Key &key) { kvs_->remove(key); }
 
-    SetValue original_value;
+  void prefetch(const Key &key) { kvs_->prefetch(key); }
 
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+  unsigned long long memory_usage() { return kvs_->memory_usage(); }
+};
 
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
-      std::cerr << "Failed to parse payload." << std::endl;
-      return 0;
-    } else {
-      // get the existing value that we have and merge
-      set<string> set_union;
-      for (auto &val : original_value.values()) {
-        set_union.emplace(std::move(val));
-      }
-      for (auto &val : input_value.values()) {
-        set_union.emplace(std::move(val));
-      }
+class MemorySetSerializer final : public Serializer {
+  MemorySetKVS *kvs_;
 
-      SetValue new_value;
-      for (auto &val : set_union) {
-        new_value.add_values(std::move(val));
-      }
+  // reused by every put, like MemoryLWWSerializer::value_
+  SetValue value_;
 
-      // write out the new payload.
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+public:
+  MemorySetSerializer(MemorySetKVS *kvs) : kvs_(kvs) {}
 
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
-      return output.tellp();
+  void get(const Key &key, string *payload, AnnaError &error) {
+    auto val = get_serialized(kvs_, key, payload, error);
+    if (val != nullptr && val->reveal().empty()) {
+      error = AnnaError::KEY_DNE;
     }
   }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+  unsigned put(const Key &key, const string &serialized) {
+    value_.ParseFromString(serialized);
+    return kvs_->put(key, to_flat_set(value_));
   }
-};
 
-class DiskOrderedSetSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+  void remove(const Key &key) { kvs_->remove(key); }
 
-public:
-  DiskOrderedSetSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  void prefetch(const Key &key) { kvs_->prefetch(key); }
 
-    ebs_root_ = conf["ebs"].as<string>();
+  unsigned long long memory_usage() { return kvs_->memory_usage(); }
+};
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
-    }
-  }
+class MemoryOrderedSetSerializer final : public Serializer {
+  MemoryOrderedSetKVS *kvs_;
 
-  string get(const Key &key, AnnaError &error) {
-    string res;
-    SetValue value;
+  // reused by every put, like MemoryLWWSerializer::value_
+  SetValue value_;
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+public:
+  MemoryOrderedSetSerializer(MemoryOrderedSetKVS *kvs) : kvs_(kvs) {}
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
-      error = AnnaError::KEY_DNE;
-    } else {
-      value.SerializeToString(&res);
-    }
-    return res;
+  void get(const Key &key, string *payload, AnnaError &error) {
+    get_serialized(kvs_, key, payload, error);
   }
 
   unsigned put(const Key &key, const string &serialized) {
-    SetValue input_value;
-    input_value.ParseFromString(serialized);
-
-    SetValue original_value;
-
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+    value_.ParseFromString(serialized);
+    return kvs_->put(key, to_flat_set(value_));
+  }
 
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
-      std::cerr << "Failed to parse payload." << std::endl;
-      return 0;
-    } else {
-      // get the existing value that we have and merge
-      ordered_set<string> set_union;
-      for (auto &val : original_value.values()) {
-        set_union.emplace(std::move(val));
-      }
-      for (auto &val : input_value.values()) {
-        set_union.emplace(std::move(val));
-      }
+  void remove(const Key &key) { kvs_->remove(key); }
 
-      SetValue new_value;
-      for (auto &val : set_union) {
-        new_value.add_values(std::move(val));
-      }
+  void prefetch(const Key &key) { kvs_->prefetch(key); }
 
-      // write out the new payload.
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+  unsigned long long memory_usage() { return kvs_->memory_usage(); }
+};
 
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
-      return output.tellp();
+// Causal values carry metadata that no merge or read can depend on, and that
+// would otherwise be stored, logged, and gossiped with every version: clock
+// entries at zero (the bottom of MaxLattice), dependencies with no entries
+// left, and, for a value of key self, a dependency on self that its own
+// vector clock already covers. Pruning only removes entries that are
+// satisfied by every version, so the merged result is unchanged.
+
+// whether clock is covered by (less than or equal to) bound
+inline bool covered_by(const VectorClock &clock, const VectorClock &bound) {
+  const auto &entries = bound.reveal();
+
+  for (const auto &pair : clock.reveal()) {
+    auto it = entries.find(pair.first);
+    if (it == entries.end() || it->second.reveal() < pair.second.reveal()) {
+      return false;
     }
   }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+  return true;
+}
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
+// returns true and replaces clock if it has entries at zero
+inline bool prune_clock(VectorClock &clock) {
+  map<string, MaxLattice<unsigned>> entries;
+  for (const auto &pair : clock.reveal()) {
+    if (pair.second.reveal() > 0) {
+      entries.insert(pair);
     }
   }
-};
 
-class DiskSingleKeyCausalSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
+  if (entries.size() == clock.reveal().size()) {
+    return false;
+  }
 
-public:
-  DiskSingleKeyCausalSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  clock = VectorClock(entries);
+  return true;
+}
+
+// returns true if anything was pruned from payload; self is the key the
+// value belongs to, if it is known
+template <typename T>
+bool prune_causal(MultiKeyCausalPayload<T> &payload,
+                  const Key *self = nullptr) {
+  bool pruned = prune_clock(payload.vector_clock);
+  map<Key, VectorClock> dependencies;
+
+  for (const auto &pair : payload.dependencies.reveal()) {
+    VectorClock clock = pair.second;
+    pruned = prune_clock(clock) || pruned;
+
+    if (clock.reveal().empty() ||
+        (self != nullptr && pair.first == *self &&
+         covered_by(clock, payload.vector_clock))) {
+      pruned = true;
+      continue;
+    }
 
-    ebs_root_ = conf["ebs"].as<string>();
+    dependencies.insert({pair.first, clock});
+  }
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
-    }
+  if (pruned) {
+    payload.dependencies = MapLattice<Key, VectorClock>(dependencies);
   }
 
-  string get(const Key &key, AnnaError &error) {
-    string res;
-    SingleKeyCausalValue value;
+  return pruned;
+}
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+class MemorySingleKeyCausalSerializer final : public Serializer {
+  MemorySingleKeyCausalKVS *kvs_;
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
+public:
+  MemorySingleKeyCausalSerializer(MemorySingleKeyCausalKVS *kvs) : kvs_(kvs) {}
+
+  void get(const Key &key, string *payload, AnnaError &error) {
+    auto val = get_serialized(kvs_, key, payload, error);
+    if (val != nullptr && val->reveal().value.size().reveal() == 0) {
       error = AnnaError::KEY_DNE;
-    } else {
-      if (value.values_size() == 0) {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
     }
-    return res;
   }
 
   unsigned put(const Key &key, const string &serialized) {
-    SingleKeyCausalValue input_value;
-    input_value.ParseFromString(serialized);
-
-    SingleKeyCausalValue original_value;
-
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
-
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
-      std::cerr << "Failed to parse payload." << std::endl;
-      return 0;
-    } else {
-      // get the existing value that we have and merge
-      VectorClockValuePair<SetLattice<string>> orig_pair;
-      for (const auto &pair : original_value.vector_clock()) {
-        orig_pair.vector_clock.insert(pair.first, pair.second);
-      }
-      for (auto &val : original_value.values()) {
-        orig_pair.value.insert(std::move(val));
-      }
-      SingleKeyCausalLattice<SetLattice<string>> orig(orig_pair);
+    SingleKeyCausalValue causal_value = deserialize_causal(serialized);
+    VectorClockValuePair<SetLattice<string>> p =
+        to_vector_clock_value_pair(causal_value);
+    prune_clock(p.vector_clock);
+    return kvs_->put(key, SingleKeyCausalLattice<SetLattice<string>>(p));
+  }
 
-      VectorClockValuePair<SetLattice<string>> input_pair;
-      for (const auto &pair : input_value.vector_clock()) {
-        input_pair.vector_clock.insert(pair.first, pair.second);
-      }
-      for (auto &val : input_value.values()) {
-        input_pair.value.insert(std::move(val));
-      }
-      SingleKeyCausalLattice<SetLattice<string>> input(input_pair);
+  void remove(const Key &key) { kvs_->remove(key); }
 
-      orig.merge(input);
+  void prefetch(const Key &key) { kvs_->prefetch(key); }
 
-      SingleKeyCausalValue new_value;
-      auto ptr = new_value.mutable_vector_clock();
-      // serialize vector clock
-      for (const auto &pair : orig.reveal().vector_clock.reveal()) {
-        (*ptr)[pair.first] = pair.second.reveal();
-      }
+  unsigned long long memory_usage() { return kvs_->memory_usage(); }
+};
 
-      // serialize values
-      // note that this creates unnecessary copy of val, but
-      // we have to since the reveal() method is marked as "const"
-      for (const string &val : orig.reveal().value.reveal()) {
-        new_value.add_values(val);
-      }
+class MemoryMultiKeyCausalSerializer final : public Serializer {
+  MemoryMultiKeyCausalKVS *kvs_;
 
-      // write out the new payload.
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+public:
+  MemoryMultiKeyCausalSerializer(MemoryMultiKeyCausalKVS *kvs) : kvs_(kvs) {}
 
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
-      return output.tellp();
+  void get(const Key &key, string *payload, AnnaError &error) {
+    auto val = get_serialized(kvs_, key, payload, error);
+    if (val != nullptr && val->reveal().value.size().reveal() == 0) {
+      error = AnnaError::KEY_DNE;
     }
   }
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+  unsigned put(const Key &key, const string &serialized) {
+    MultiKeyCausalValue multi_key_causal_value =
+        deserialize_multi_key_causal(serialized);
+    MultiKeyCausalPayload<SetLattice<string>> p =
+        to_multi_key_causal_payload(multi_key_causal_value);
+    prune_causal(p, &key);
+    return kvs_->put(key, MultiKeyCausalLattice<SetLattice<string>>(p));
   }
-};
-
-class DiskMultiKeyCausalSerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
 
-public:
-  DiskMultiKeyCausalSerializer(unsigned &tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  void remove(const Key &key) { kvs_->remove(key); }
 
-    ebs_root_ = conf["ebs"].as<string>();
+  void prefetch(const Key &key) { kvs_->prefetch(key); }
 
-    if (ebs_root_.back() != '/') {
-      ebs_root_ += "/";
-    }
-  }
+  unsigned long long memory_usage() { return kvs_->memory_usage(); }
+};
 
-  string get(const Key &key, AnnaError &error) {
-    string res;
-    MultiKeyCausalValue value;
+class MemoryPrioritySerializer final : public Serializer {
+  MemoryPriorityKVS *kvs_;
 
-    // open a new filestream for reading in a binary
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+public:
+  MemoryPrioritySerializer(MemoryPriorityKVS *kvs) : kvs_(kvs) {}
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
+  void get(const Key &key, string *payload, AnnaError &error) {
+    auto val = get_serialized(kvs_, key, payload, error);
+    if (val != nullptr && val->reveal().value == "") {
       error = AnnaError::KEY_DNE;
-    } else {
-      if (value.values_size() == 0) {
-        error = AnnaError::KEY_DNE;
-      } else {
-        value.SerializeToString(&res);
-      }
     }
-    return res;
   }
 
   unsigned put(const Key &key, const string &serialized) {
-    MultiKeyCausalValue input_value;
-    input_value.ParseFromString(serialized);
+    PriorityLattice<double, string> val = deserialize_priority(serialized);
+    return kvs_->put(key, val);
+  }
 
-    MultiKeyCausalValue original_value;
+  void remove(const Key &key) { kvs_->remove(key); }
 
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-    std::fstream input(fname, std::ios::in | std::ios::binary);
+  void prefetch(const Key &key) { kvs_->prefetch(key); }
 
-    if (!input) { // in this case, this key has never been seen before, so we
-                  // attempt to create a new file for it
-      // ios::trunc means that we overwrite the existing file
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+  unsigned long long memory_usage() { return kvs_->memory_usage(); }
+};
 
-      if (!input_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload." << std::endl;
-      }
-      return output.tellp();
-    } else if (!original_value.ParseFromIstream(
-                   &input)) { // if we have seen the key before, attempt to
-                              // parse what was there before
-      std::cerr << "Failed to parse payload." << std::endl;
-      return 0;
-    } else {
-      // get the existing value that we have and merge
-      MultiKeyCausalPayload<SetLattice<string>> orig_payload;
-      for (const auto &pair : original_value.vector_clock()) {
-        orig_payload.vector_clock.insert(pair.first, pair.second);
-      }
+// merges two serialized lattices of the same type and returns the serialized
+// result; this is how the disk tier folds records together
+inline string merge_serialized(LatticeType type, const string &first,
+                               const string &second) {
+  switch (type) {
+  case LatticeType::LWW: {
+    LWWPairLattice<string> val = deserialize_lww(first);
+    val.merge(deserialize_lww(second));
+    return serialize(val);
+  }
+  case LatticeType::SET:
+  case LatticeType::ORDERED_SET: {
+    FlatSetLattice<string> val = deserialize_flat_set(first);
+    val.merge(deserialize_flat_set(second));
+    return serialize(val);
+  }
+  case LatticeType::SINGLE_CAUSAL: {
+    SingleKeyCausalLattice<SetLattice<string>> val(
+        to_vector_clock_value_pair(deserialize_causal(first)));
+    val.merge(SingleKeyCausalLattice<SetLattice<string>>(
+        to_vector_clock_value_pair(deserialize_causal(second))));
+
+    VectorClockValuePair<SetLattice<string>> merged = val.reveal();
+    if (prune_clock(merged.vector_clock)) {
+      return serialize(SingleKeyCausalLattice<SetLattice<string>>(merged));
+    }
 
-      for (const auto &dep : original_value.dependencies()) {
-        VectorClock vc;
-        for (const auto &pair : dep.vector_clock()) {
-          vc.insert(pair.first, pair.second);
-        }
+    return serialize(val);
+  }
+  case LatticeType::MULTI_CAUSAL: {
+    MultiKeyCausalLattice<SetLattice<string>> val(
+        to_multi_key_causal_payload(deserialize_multi_key_causal(first)));
+    val.merge(MultiKeyCausalLattice<SetLattice<string>>(
+        to_multi_key_causal_payload(deserialize_multi_key_causal(second))));
+
+    // the key is not known here, so only the entries every value can do
+    // without are pruned
+    MultiKeyCausalPayload<SetLattice<string>> merged = val.reveal();
+    if (prune_causal(merged)) {
+      return serialize(MultiKeyCausalLattice<SetLattice<string>>(merged));
+    }
 
-        orig_payload.dependencies.insert(dep.key(), vc);
-      }
+    return serialize(val);
+  }
+  case LatticeType::PRIORITY: {
+    PriorityLattice<double, string> val = deserialize_priority(first);
+    val.merge(deserialize_priority(second));
+    return serialize(val);
+  }
+  default: return second;
+  }
+}
 
-      for (auto &val : original_value.values()) {
-        orig_payload.value.insert(std::move(val));
-      }
+// all lattice types on a disk thread share one LogStore; the serializer only
+// tags records with its type
+class DiskSerializer final : public Serializer {
+  LogStore *store_;
+  LatticeType type_;
 
-      MultiKeyCausalLattice<SetLattice<string>> orig(orig_payload);
-      MultiKeyCausalPayload<SetLattice<string>> input_payload;
+public:
+  DiskSerializer(LogStore *store, LatticeType type)
+      : store_(store), type_(type) {}
 
-      for (const auto &pair : input_value.vector_clock()) {
-        input_payload.vector_clock.insert(pair.first, pair.second);
-      }
+  void get(const Key &key, string *payload, AnnaError &error) {
+    if (!store_->get(key, payload)) {
+      error = AnnaError::KEY_DNE;
+    }
+  }
 
-      for (const auto &dep : input_value.dependencies()) {
-        VectorClock vc;
-        for (const auto &pair : dep.vector_clock()) {
-          vc.insert(pair.first, pair.second);
-        }
-        input_payload.dependencies.insert(dep.key(), vc);
-      }
+  unsigned put(const Key &key, const string &serialized) {
+    return store_->put(key, type_, serialized);
+  }
 
-      for (auto &val : input_value.values()) {
-        input_payload.value.insert(std::move(val));
-      }
+  void remove(const Key &key) { store_->remove(key); }
+};
 
-      MultiKeyCausalLattice<SetLattice<string>> input(input_payload);
-      orig.merge(input);
+// logs every write to a memory serializer in a write-ahead log before
+// applying it
+class LoggedSerializer final : public Serializer {
+  Serializer *serializer_;
+  WriteAheadLog *wal_;
+  LatticeType type_;
 
-      MultiKeyCausalValue new_value;
-      auto ptr = new_value.mutable_vector_clock();
+public:
+  LoggedSerializer(Serializer *serializer, WriteAheadLog *wal,
+                   LatticeType type)
+      : serializer_(serializer), wal_(wal), type_(type) {}
 
-      // serialize vector clock
-      for (const auto &pair : orig.reveal().vector_clock.reveal()) {
-        (*ptr)[pair.first] = pair.second.reveal();
-      }
+  void get(const Key &key, string *payload, AnnaError &error) {
+    serializer_->get(key, payload, error);
+  }
 
-      // serialize dependencies
-      for (const auto &pair : orig.reveal().dependencies.reveal()) {
-        auto dep = new_value.add_dependencies();
-        dep->set_key(pair.first);
-        auto vc_ptr = dep->mutable_vector_clock();
+  unsigned put(const Key &key, const string &serialized) {
+    wal_->append(key, type_, serialized);
+    return serializer_->put(key, serialized);
+  }
 
-        for (const auto &vc_pair : pair.second.reveal()) {
-          (*vc_ptr)[vc_pair.first] = vc_pair.second.reveal();
-        }
-      }
+  void remove(const Key &key) {
+    wal_->append(key, type_, "", true);
+    serializer_->remove(key);
+  }
 
-      // note that this creates unnecessary copy of val, but
-      // we have to since the reveal() method is marked as "const"
-      for (const string &val : orig.reveal().value.reveal()) {
-        new_value.add_values(val);
-      }
+  void prefetch(const Key &key) { serializer_->prefetch(key); }
 
-      std::fstream output(fname,
-                          std::ios::out | std::ios::trunc | std::ios::binary);
+  unsigned long long memory_usage() { return serializer_->memory_usage(); }
+};
 
-      if (!new_value.SerializeToOstream(&output)) {
-        std::cerr << "Failed to write payload" << std::endl;
-      }
+// compresses the values of LWW writes of at least threshold bytes before
+// they reach the serializer, so they are stored, logged, and gossiped
+// compressed. Merging two LWW values only compares their timestamps, so a
+// stored value stays compressed until a client reads it.
+class CompressedLWWSerializer final : public Serializer {
+  Serializer *serializer_;
+  unsigned threshold_;
 
-      return output.tellp();
-    }
-  }
+  // reused by every put, like MemoryLWWSerializer::value_
+  LWWValue value_;
+  string framed_;
+  string serialized_;
 
-  void remove(const Key &key) {
-    string fname = ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
+public:
+  CompressedLWWSerializer(Serializer *serializer, unsigned threshold)
+      : serializer_(serializer), threshold_(threshold) {}
 
-    if (std::remove(fname.c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
-    }
+  void get(const Key &key, string *payload, AnnaError &error) {
+    serializer_->get(key, payload, error);
   }
-};
-
-class DiskPrioritySerializer : public Serializer {
-  unsigned tid_;
-  string ebs_root_;
 
-  //! Compute the name of the file that stores a value for a given key
-  string fname(const Key &key) const {
-    return ebs_root_ + "ebs_" + std::to_string(tid_) + "/" + key;
-  }
+  unsigned put(const Key &key, const string &serialized) {
+    // a value with the magic is already a frame (see frame_client_payload);
+    // it, and a value too short to compress, pass through without being
+    // parsed
+    uint64_t timestamp;
+    const char *value;
+    std::size_t length;
+    if (peek_lww(serialized, timestamp, &value, &length) &&
+        (is_compressed(value, length) ||
+         (length < threshold_ && !has_magic(value, length)))) {
+      return serializer_->put(key, serialized);
+    }
 
-public:
-  DiskPrioritySerializer(unsigned tid) : tid_(tid) {
-    YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+    value_.ParseFromString(serialized);
 
-    ebs_root_ = conf["ebs"].as<string>();
+    if (is_compressed(value_.value()) ||
+        !compress_value(value_.value(), threshold_, framed_)) {
+      return serializer_->put(key, serialized);
+    }
 
-    if (ebs_root_.back() != '/')
-      ebs_root_ += "/";
+    value_.mutable_value()->swap(framed_);
+    value_.SerializeToString(&serialized_);
+    return serializer_->put(key, serialized_);
   }
 
-  string get(const Key &key, AnnaError &error) override {
-    string res;
-    PriorityValue value;
+  void remove(const Key &key) { serializer_->remove(key); }
 
-    std::fstream input(fname(key), std::ios::in | std::ios::binary);
+  void prefetch(const Key &key) { serializer_->prefetch(key); }
 
-    if (!input) {
-      error = AnnaError::KEY_DNE;
-    } else if (!value.ParseFromIstream(&input)) {
-      std::cerr << "Failed to parse payload." << std::endl;
-      error = AnnaError::KEY_DNE;
-    } else if (value.value() == "") {
-      error = AnnaError::KEY_DNE;
-    } else {
-      value.SerializeToString(&res);
-    }
-    return res;
+  unsigned long long memory_usage() { return serializer_->memory_usage(); }
+};
+
+// restores the original value of a compressed LWW payload that is about to
+// be sent to a client; other payloads are left as they are
+inline void decompress_payload(LatticeType type, string *payload,
+                               logger log) {
+  if (type != LatticeType::LWW) {
+    return;
   }
 
-  unsigned put(const Key &key, const string &serialized) override {
-    PriorityValue input_value;
-    input_value.ParseFromString(serialized);
+  LWWValue value;
+  value.ParseFromString(*payload);
+  if (!is_compressed(value.value())) {
+    return;
+  }
 
-    int fd = open(fname(key).c_str(), O_RDWR | O_CREAT);
-    if (fd == -1) {
-      std::cerr << "Failed to open file" << std::endl;
-      return 0;
-    }
+  string original;
+  if (!decompress_value(value.value(), original)) {
+    log->error("Failed to decompress a stored value.");
+    return;
+  }
 
-    PriorityValue original_value;
-    if (!original_value.ParseFromFileDescriptor(fd) ||
-        input_value.priority() < original_value.priority()) {
-      // resize the file to 0
-      ftruncate(fd, 0);
-      // ftruncate does not change the fd's file offset, so we set it to 0
-      lseek(fd, 0, SEEK_SET);
-      if (!input_value.SerializeToFileDescriptor(fd))
-        std::cerr << "Failed to write payload" << std::endl;
-    }
+  value.mutable_value()->swap(original);
+  value.SerializeToString(payload);
+}
+
+// the payload a client's write is stored and gossiped as. Servers take any
+// value that starts with kCompressedMagic for a frame, so a client LWW value
+// that starts with it is framed here, as it arrives, and read back intact;
+// framed holds the framed payload if one was made. Every other payload is
+// returned as it is.
+inline const string &frame_client_payload(LatticeType type,
+                                          const string &payload,
+                                          string &framed) {
+  if (type != LatticeType::LWW) {
+    return payload;
+  }
 
-    unsigned pos = lseek(fd, 0, SEEK_CUR);
+  uint64_t timestamp;
+  const char *value;
+  std::size_t length;
+  if (peek_lww(payload, timestamp, &value, &length) &&
+      !has_magic(value, length)) {
+    return payload;
+  }
 
-    if (close(fd) == -1)
-      std::cerr << "Problem closing file" << std::endl;
+  LWWValue lww_value;
+  lww_value.ParseFromString(payload);
+  if (!has_magic(lww_value.value().data(), lww_value.value().size())) {
+    return payload;
+  }
 
-    return pos;
+  string frame;
+  compress_value(lww_value.value(), 0, frame);
+  lww_value.mutable_value()->swap(frame);
+  lww_value.SerializeToString(&framed);
+  return framed;
+}
+
+// each disk thread keeps its log under ebs_root/ebs_<tid>/, and caches the
+// values it reads in up to cache_bytes bytes
+inline LogStore *create_log_store(unsigned tid, string ebs_root,
+                                  unsigned long long cache_bytes) {
+  if (!ebs_root.empty() && ebs_root.back() != '/') {
+    ebs_root += "/";
   }
 
-  void remove(const Key &key) override {
-    if (std::remove(fname(key).c_str()) != 0) {
-      std::cerr << "Error deleting file" << std::endl;
+  return new LogStore(ebs_root + "ebs_" + std::to_string(tid),
+                      merge_serialized, cache_bytes);
+}
+
+// returns true if another message is already queued on the socket, so the
+// event loop can keep draining it without going back through poll
+inline bool has_pending_message(zmq::socket_t *socket) {
+  return socket->getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN;
+}
+
+// returns true if the socket can take another message without blocking, so
+// bulk transfers can back off while a receiver catches up
+inline bool can_send(zmq::socket_t *socket) {
+  return socket->getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLOUT;
+}
+
+// The prefix of the inproc endpoints that KVS server threads bind next to
+// their TCP ones, so that threads of the same process reach each other
+// without going through the kernel's TCP stack.
+const string kInprocBase = "inproc://kvs:";
+
+// returns the inproc endpoint that matches a TCP bind or connect address
+inline Address inproc_address(const Address &address) {
+  return kInprocBase + address.substr(address.rfind(':') + 1);
+}
+
+// binds socket to address and to the matching inproc endpoint
+inline void bind_with_inproc(zmq::socket_t &socket, const Address &address) {
+  socket.bind(address);
+  socket.bind(inproc_address(address));
+}
+
+// re-points the pushers for the private addresses of the threads on this
+// node at their inproc endpoints; the addresses themselves stay the TCP ones,
+// since they are also handed out to other nodes as response addresses. This
+// only works if all the threads share one context.
+inline void connect_local_threads(SocketCache &pushers, const ServerThread &wt,
+                                  unsigned thread_count) {
+  for (unsigned tid = 0; tid < thread_count; tid++) {
+    ServerThread st(wt.public_ip(), wt.private_ip(), tid);
+    vector<Address> addresses = {st.node_join_connect_address(),
+                                 st.node_depart_connect_address(),
+                                 st.self_depart_connect_address(),
+                                 st.gossip_connect_address(),
+                                 st.replication_response_connect_address(),
+                                 st.replication_change_connect_address(),
+                                 st.cache_ip_response_connect_address(),
+                                 st.management_node_response_connect_address()};
+
+    for (const Address &address : addresses) {
+      zmq::socket_t &socket = pushers[address];
+      socket.disconnect(address);
+      socket.connect(inproc_address(address));
     }
   }
-};
+}
 
 using SerializerMap =
     std::unordered_map<LatticeType, Serializer *, lattice_type_hash>;
 
 struct PendingRequest {
-  PendingRequest() {}
+  PendingRequest() : parked_(0) {}
   PendingRequest(RequestType type, LatticeType lattice_type, string payload,
-                 Address addr, string response_id)
+                 Address addr, string response_id, Trace trace = Trace())
       : type_(type), lattice_type_(std::move(lattice_type)),
-        payload_(std::move(payload)), addr_(addr), response_id_(response_id) {}
+        payload_(std::move(payload)), addr_(addr), response_id_(response_id),
+        trace_(trace), parked_(trace.sampled() ? trace_time() : 0) {}
 
   RequestType type_;
   LatticeType lattice_type_;
   string payload_;
   Address addr_;
   string response_id_;
+
+  // the trace of the request, if it is sampled, and when it was parked
+  Trace trace_;
+  uint64_t parked_;
 };
 
 struct PendingGossip {
@@ -834,4 +944,118 @@ struct PendingGossip {
   string payload_;
 };
 
+// The keys changed on this thread since the last round of gossip. For set
+// lattices, it also accumulates the join of the payloads written since then;
+// a replica that received every earlier round only needs that delta. Keys
+// gossiped as deltas are sent in full once every kAntiEntropyRounds rounds, in
+// case a replica missed a round.
+//
+// A round is sent in batches: start_round() snapshots the changes, and the
+// event loop takes next_batch() keys per iteration until round_done(). Writes
+// made in the meantime go to the following round.
+class LocalChangeset {
+  set<Key> keys_;
+  map<Key, string> deltas_;
+  set<Key> anti_entropy_;
+  unsigned round_;
+
+  // the round being sent
+  vector<Key> round_keys_;
+  map<Key, string> round_deltas_;
+  std::size_t round_position_;
+  bool in_round_;
+
+  static bool has_deltas(LatticeType type) {
+    return type == LatticeType::SET || type == LatticeType::ORDERED_SET;
+  }
+
+public:
+  LocalChangeset() : round_(0), round_position_(0), in_round_(false) {}
+
+  // marks key as changed; it is gossiped with its full value
+  void insert(const Key &key) {
+    keys_.insert(key);
+    deltas_.erase(key);
+  }
+
+  // marks key as changed by a write of payload, which is folded into the
+  // key's delta when its lattice type supports it
+  void insert(const Key &key, LatticeType type, const string &payload) {
+    if (!has_deltas(type)) {
+      insert(key);
+    } else if (keys_.insert(key).second) {
+      deltas_[key] = payload;
+    } else {
+      auto it = deltas_.find(key);
+
+      // keys already marked for a full send stay that way
+      if (it != deltas_.end()) {
+        it->second = merge_serialized(type, it->second, payload);
+      }
+    }
+  }
+
+  void erase(const Key &key) {
+    keys_.erase(key);
+    deltas_.erase(key);
+    anti_entropy_.erase(key);
+    round_deltas_.erase(key);
+  }
+
+  // snapshots the pending changes as the round to send
+  void start_round() {
+    for (const Key &key : keys_) {
+      if (deltas_.find(key) != deltas_.end()) {
+        anti_entropy_.insert(key);
+      } else {
+        anti_entropy_.erase(key);
+      }
+    }
+
+    round_keys_.assign(keys_.begin(), keys_.end());
+    round_deltas_.swap(deltas_);
+    round_position_ = 0;
+    in_round_ = true;
+
+    keys_.clear();
+    deltas_.clear();
+    round_ += 1;
+
+    // the next round sends these in full
+    if (round_ % kAntiEntropyRounds == 0) {
+      keys_.swap(anti_entropy_);
+    }
+  }
+
+  bool in_round() const { return in_round_; }
+
+  bool round_done() const { return round_position_ == round_keys_.size(); }
+
+  // returns up to count keys of the current round that have not been sent
+  vector<Key> next_batch(std::size_t count) {
+    std::size_t end = std::min(round_position_ + count, round_keys_.size());
+    vector<Key> batch(round_keys_.begin() + round_position_,
+                      round_keys_.begin() + end);
+    round_position_ = end;
+    return batch;
+  }
+
+  void finish_round() {
+    round_keys_.clear();
+    round_deltas_.clear();
+    round_position_ = 0;
+    in_round_ = false;
+  }
+
+  // returns the delta to gossip for key in the current round, or nullptr if
+  // the full value should be sent
+  const string *delta(const Key &key) const {
+    auto it = round_deltas_.find(key);
+    return it == round_deltas_.end() ? nullptr : &it->second;
+  }
+
+  // the number of changed keys waiting for the next round
+  std::size_t size() const { return keys_.size(); }
+};
+
 #endif // INCLUDE_KVS_SERVER_UTILS_HPP_
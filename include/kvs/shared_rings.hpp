@@ -0,0 +1,79 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_SHARED_RINGS_HPP_
+#define INCLUDE_KVS_SHARED_RINGS_HPP_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "hash_ring.hpp"
+
+// The hash rings of a server process, shared by all of its threads. Thread 0
+// keeps its own copy of the global rings and is the only thread that applies
+// membership changes; after each change it publishes a copy, and only then
+// tells the other threads about the change, so they find it already applied.
+// A published copy is never modified again, so the other threads read it
+// without a lock, and it is freed once the last of them has moved on to a
+// newer one. The local rings are built once and never change.
+class SharedRings {
+  std::shared_ptr<GlobalRingMap> global_;
+  LocalRingMap local_;
+
+  std::mutex mutex_;
+  std::condition_variable initialized_;
+  bool ready_;
+
+public:
+  SharedRings() : ready_(false) {}
+
+  // publishes the first rings and wakes the threads waiting for them
+  void init(const GlobalRingMap &global, const LocalRingMap &local) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    local_ = local;
+    publish(global);
+    ready_ = true;
+    initialized_.notify_all();
+  }
+
+  // blocks until thread 0 has published the first rings
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    initialized_.wait(lock, [this] { return ready_; });
+  }
+
+  void publish(const GlobalRingMap &global) {
+    std::atomic_store(&global_, std::make_shared<GlobalRingMap>(global));
+  }
+
+  // the latest global rings; callers must not modify them
+  std::shared_ptr<GlobalRingMap> global() const {
+    return std::atomic_load(&global_);
+  }
+
+  LocalRingMap &local() { return local_; }
+};
+
+// Set in the server's main; null where threads keep their own rings, as in
+// the handler tests.
+extern SharedRings *kSharedRings;
+
+// whether thread_id reads the rings thread 0 publishes rather than applying
+// membership changes itself
+inline bool reads_shared_rings(unsigned thread_id) {
+  return kSharedRings != nullptr && thread_id != 0;
+}
+
+#endif // INCLUDE_KVS_SHARED_RINGS_HPP_
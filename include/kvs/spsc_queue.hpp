@@ -0,0 +1,87 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_SPSC_QUEUE_HPP_
+#define INCLUDE_KVS_SPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// A bounded, lock-free queue for exactly one producer and one consumer
+// thread. The capacity is rounded up to a power of two; push fails instead of
+// blocking when the queue is full.
+template <typename T> class SpscQueue {
+  static const std::size_t kCacheLine = 64;
+
+  std::vector<T> slots_;
+  std::size_t mask_;
+
+  // head_ is only written by the consumer and tail_ only by the producer;
+  // the padding keeps them on separate cache lines
+  char head_pad_[kCacheLine];
+  std::atomic<std::size_t> head_;
+  char tail_pad_[kCacheLine];
+  std::atomic<std::size_t> tail_;
+  char end_pad_[kCacheLine];
+
+public:
+  explicit SpscQueue(std::size_t capacity) : head_(0), tail_(0) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // called by the producer only
+  bool push(T &&value) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // called by the consumer only
+  bool pop(T &value) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() const { return slots_.size(); }
+};
+
+#endif // INCLUDE_KVS_SPSC_QUEUE_HPP_
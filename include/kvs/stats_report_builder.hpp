@@ -0,0 +1,125 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_STATS_REPORT_BUILDER_HPP_
+#define INCLUDE_KVS_STATS_REPORT_BUILDER_HPP_
+
+#include <deque>
+
+#include "key_access_tracker.hpp"
+#include "key_size_reporter.hpp"
+#include "server_utils.hpp"
+
+// Builds a thread's stats report a batch of keys at a time, so that summing
+// up the access counts of every tracked key and looking up the sizes of
+// every primary key does not hold up the requests behind it. The event loop
+// starts a report when one is due and steps it once per iteration until it
+// is complete. Like a memory snapshot, a report is not a consistent cut:
+// keys summarized in different steps are counted at different times.
+class StatsReportBuilder {
+  typedef StoredKeyMap::HashType HashType;
+
+  ServerStatsReport report_;
+  AccessSummary summary_;
+  bool building_;
+  bool summarized_;
+
+  // the stretches of the hash index whose key sizes are left to report, in
+  // order: where the walk of each is, and the largest hash in it
+  std::deque<std::pair<StoredKeyMap::IndexPosition, HashType>> stretches_;
+
+public:
+  StatsReportBuilder() : building_(false), summarized_(false) {}
+
+  bool building() const { return building_; }
+
+  // starts a report that carries header's fields and the sizes of the keys
+  // with a hash in ranges, given as HashRing::owned_ranges returns them
+  template <typename Ranges>
+  void start(const ServerStatsReport &header, const Ranges &ranges,
+             const KeyAccessTracker &tracker, unsigned hot_key_count,
+             unsigned sketch_width, unsigned sketch_depth) {
+    report_ = header;
+    tracker.start_summary(summary_, hot_key_count, sketch_width, sketch_depth);
+    building_ = true;
+    summarized_ = false;
+    stretches_.clear();
+
+    HashType top = std::numeric_limits<HashType>::max();
+
+    for (const auto &range : ranges) {
+      HashType lo = range.first;
+      HashType hi = range.second;
+
+      // a range that wraps is the stretch after lo and the one up to hi
+      if (lo < top) {
+        stretches_.push_back({{lo + 1, Key()}, lo < hi ? hi : top});
+      }
+
+      if (lo >= hi) {
+        stretches_.push_back({{0, Key()}, hi});
+      }
+    }
+  }
+
+  // does the next batch keys of the report's work; include(key) says whether
+  // a key's size belongs in it. Returns true once the report is complete.
+  template <typename Include>
+  bool step(KeyAccessTracker &tracker, const StoredKeyMap &stored_key_map,
+            KeySizeReporter &sizes, unsigned batch, Include include) {
+    if (!summarized_) {
+      summarized_ = tracker.summarize_batch(summary_, stored_key_map, batch);
+
+      if (summarized_) {
+        summary_.fill(report_);
+      }
+
+      return false;
+    }
+
+    while (!stretches_.empty() && batch > 0) {
+      unsigned walked = 0;
+
+      bool done = stored_key_map.walk_index(
+          stretches_.front().first, stretches_.front().second, batch,
+          [&](const Key &key) {
+            walked += 1;
+
+            if (include(key)) {
+              sizes.add(report_, key, stored_key_map.at(key).size_);
+            }
+          });
+
+      batch -= walked;
+      if (!done) {
+        return false;
+      }
+
+      stretches_.pop_front();
+    }
+
+    if (!stretches_.empty()) {
+      return false;
+    }
+
+    sizes.finish(report_);
+    building_ = false;
+    return true;
+  }
+
+  // the report, once step has completed it
+  const ServerStatsReport &report() const { return report_; }
+};
+
+#endif // INCLUDE_KVS_STATS_REPORT_BUILDER_HPP_
@@ -0,0 +1,170 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_TENANT_LIMITS_HPP_
+#define INCLUDE_KVS_TENANT_LIMITS_HPP_
+
+#include <algorithm>
+#include <chrono>
+
+#include "admission_control.hpp"
+#include "server_utils.hpp"
+
+// The limits of one tenant on one thread; a limit of 0 is no limit.
+struct TenantQuota {
+  // the requests per second the tenant's keys are served at, and how many
+  // may arrive at once after a quiet spell; a burst of 0 is one second's
+  // worth
+  double rate = 0;
+  double burst = 0;
+
+  // the bytes the tenant's keys may take up before writes of new data to
+  // them are refused
+  unsigned long long memory = 0;
+};
+
+// Holds each tenant, the keys with the same prefix (see tenant_of), to its
+// quota on this thread: the requests for its keys draw from a token bucket
+// that refills at its rate, and once its keys take up its memory quota in
+// the store, its writes are refused. Refused tuples are answered with
+// kOverloadedError, as shed requests are. Metadata keys belong to no tenant.
+// The thread counts each tenant's requests for its next stats report, so the
+// monitor can tell which tenant a thread's load comes from. A delimiter of 0
+// disables tenants.
+class TenantLimits {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Tenant {
+    TenantQuota quota_;
+    double tokens_;
+    TimePoint refilled_;
+
+    // since the last report
+    unsigned accesses_;
+    unsigned rejected_;
+  };
+
+  char delimiter_;
+  TenantQuota default_quota_;
+  map<string, TenantQuota> quotas_;
+
+  hmap<string, Tenant> tenants_;
+
+  // the event loop moves the clock with set_time, as for the access tracker
+  TimePoint now_;
+
+  Tenant &tenant(const string &name) {
+    auto it = tenants_.find(name);
+    if (it != tenants_.end()) {
+      return it->second;
+    }
+
+    Tenant &tenant = tenants_[name];
+    auto quota = quotas_.find(name);
+    tenant.quota_ = quota == quotas_.end() ? default_quota_ : quota->second;
+    tenant.tokens_ = capacity(tenant.quota_);
+    tenant.refilled_ = now_;
+    tenant.accesses_ = 0;
+    tenant.rejected_ = 0;
+    return tenant;
+  }
+
+  static double capacity(const TenantQuota &quota) {
+    return quota.burst > 0 ? quota.burst : quota.rate;
+  }
+
+public:
+  TenantLimits(char delimiter, TenantQuota default_quota = TenantQuota(),
+               map<string, TenantQuota> quotas = {})
+      : delimiter_(delimiter), default_quota_(default_quota),
+        quotas_(std::move(quotas)), now_(std::chrono::steady_clock::now()) {}
+
+  bool enabled() const { return delimiter_ != 0; }
+
+  char delimiter() const { return delimiter_; }
+
+  void set_time(TimePoint now) { now_ = std::max(now_, now); }
+
+  // whether a request for key is served, and, if write is set, whether its
+  // value may be stored; counts the request either way
+  bool admit(const Key &key, bool write, const StoredKeyMap &stored_key_map) {
+    if (is_metadata(key)) {
+      return true;
+    }
+
+    string name = tenant_of(key, delimiter_);
+    Tenant &tenant = this->tenant(name);
+    tenant.accesses_ += 1;
+
+    const TenantQuota &quota = tenant.quota_;
+
+    if (quota.rate > 0) {
+      double elapsed =
+          std::chrono::duration<double>(now_ - tenant.refilled_).count();
+      tenant.tokens_ = std::min(capacity(quota),
+                                tenant.tokens_ + elapsed * quota.rate);
+      tenant.refilled_ = now_;
+
+      if (tenant.tokens_ < 1) {
+        tenant.rejected_ += 1;
+        return false;
+      }
+    }
+
+    if (write && quota.memory > 0 &&
+        stored_key_map.tenant_bytes(name) >= quota.memory) {
+      tenant.rejected_ += 1;
+      return false;
+    }
+
+    if (quota.rate > 0) {
+      tenant.tokens_ -= 1;
+    }
+
+    return true;
+  }
+
+  // adds the usage of every tenant with requests or stored keys to report,
+  // and starts the next epoch's counts
+  void fill(ServerStatsReport &report, const StoredKeyMap &stored_key_map) {
+    for (const auto &pair : stored_key_map.tenant_bytes()) {
+      if (pair.second > 0) {
+        tenant(pair.first);
+      }
+    }
+
+    for (auto it = tenants_.begin(); it != tenants_.end();) {
+      Tenant &tenant = it->second;
+      unsigned long long bytes = stored_key_map.tenant_bytes(it->first);
+
+      if (tenant.accesses_ == 0 && bytes == 0) {
+        // a tenant that is gone starts over with a full bucket
+        it = tenants_.erase(it);
+        continue;
+      }
+
+      TenantUsage *usage = report.add_tenants();
+      usage->set_tenant(it->first);
+      usage->set_access_count(tenant.accesses_);
+      usage->set_rejected_count(tenant.rejected_);
+      usage->set_bytes(bytes);
+
+      tenant.accesses_ = 0;
+      tenant.rejected_ = 0;
+      ++it;
+    }
+  }
+};
+
+#endif // INCLUDE_KVS_TENANT_LIMITS_HPP_
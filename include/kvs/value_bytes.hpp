@@ -0,0 +1,182 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_VALUE_BYTES_HPP_
+#define INCLUDE_KVS_VALUE_BYTES_HPP_
+
+#include <string>
+#include <utility>
+
+#include "common.hpp"
+#include "flat_set_lattice.hpp"
+
+// Estimates of the heap memory that keys and lattice values hold beyond the
+// objects themselves, so that the server can account for the bytes it stores
+// rather than the number of elements. The estimates follow the standard
+// containers' layouts and leave out the allocator's rounding.
+
+// the node of a std::set or std::map: a color and three pointers, followed by
+// the element
+const std::size_t kTreeNodeOverhead = 4 * sizeof(void *);
+
+// All overloads are declared before any is defined, so that the templates
+// below find each other: the lattices' elements are in namespace std, where
+// argument-dependent lookup would not look for them.
+inline std::size_t heap_bytes(const std::string &s);
+template <typename A, typename B>
+std::size_t heap_bytes(const std::pair<A, B> &pair);
+template <typename T> std::size_t heap_bytes(const MaxLattice<T> &lattice);
+template <typename K, typename V>
+std::size_t heap_bytes(const MapLattice<K, V> &lattice);
+template <typename T> std::size_t heap_bytes(const SetLattice<T> &lattice);
+template <typename T>
+std::size_t heap_bytes(const OrderedSetLattice<T> &lattice);
+template <typename T> std::size_t heap_bytes(const FlatSetLattice<T> &lattice);
+template <typename T> std::size_t heap_bytes(const LWWPairLattice<T> &lattice);
+template <typename P, typename V>
+std::size_t heap_bytes(const PriorityLattice<P, V> &lattice);
+template <typename T>
+std::size_t heap_bytes(const SingleKeyCausalLattice<T> &lattice);
+template <typename T>
+std::size_t heap_bytes(const MultiKeyCausalLattice<T> &lattice);
+
+// the nodes of a tree-based container and what their elements hold
+template <typename C> std::size_t tree_bytes(const C &container) {
+  std::size_t bytes = 0;
+
+  for (const auto &element : container) {
+    bytes += kTreeNodeOverhead + sizeof(element) + heap_bytes(element);
+  }
+
+  return bytes;
+}
+
+// short strings are stored inside the object itself
+inline std::size_t heap_bytes(const std::string &s) {
+  static const std::size_t inline_capacity = std::string().capacity();
+  return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
+}
+
+template <typename A, typename B>
+std::size_t heap_bytes(const std::pair<A, B> &pair) {
+  return heap_bytes(pair.first) + heap_bytes(pair.second);
+}
+
+template <typename T> std::size_t heap_bytes(const MaxLattice<T> &lattice) {
+  return 0;
+}
+
+template <typename K, typename V>
+std::size_t heap_bytes(const MapLattice<K, V> &lattice) {
+  return tree_bytes(lattice.reveal());
+}
+
+template <typename T> std::size_t heap_bytes(const SetLattice<T> &lattice) {
+  return tree_bytes(lattice.reveal());
+}
+
+template <typename T>
+std::size_t heap_bytes(const OrderedSetLattice<T> &lattice) {
+  return tree_bytes(lattice.reveal());
+}
+
+// the whole of the vector's capacity, and what its elements hold
+template <typename T>
+std::size_t heap_bytes(const FlatSetLattice<T> &lattice) {
+  std::size_t bytes = lattice.reveal().capacity() * sizeof(T);
+
+  for (const T &element : lattice.reveal()) {
+    bytes += heap_bytes(element);
+  }
+
+  return bytes;
+}
+
+template <typename T>
+std::size_t heap_bytes(const LWWPairLattice<T> &lattice) {
+  return heap_bytes(lattice.reveal().value);
+}
+
+template <typename P, typename V>
+std::size_t heap_bytes(const PriorityLattice<P, V> &lattice) {
+  return heap_bytes(lattice.reveal().value);
+}
+
+template <typename T>
+std::size_t heap_bytes(const SingleKeyCausalLattice<T> &lattice) {
+  return heap_bytes(lattice.reveal().vector_clock) +
+         heap_bytes(lattice.reveal().value);
+}
+
+template <typename T>
+std::size_t heap_bytes(const MultiKeyCausalLattice<T> &lattice) {
+  return heap_bytes(lattice.reveal().vector_clock) +
+         heap_bytes(lattice.reveal().dependencies) +
+         heap_bytes(lattice.reveal().value);
+}
+
+// Merges other into lattice, and keeps bytes, the heap_bytes of lattice, up
+// to date. The set lattices only measure the elements that other adds, so
+// that a merge into a large set costs what it adds rather than what is
+// stored; the others are measured again, which costs as much as the merge.
+template <typename L>
+void merge_counting(L &lattice, const L &other, std::size_t &bytes) {
+  lattice.merge(other);
+  bytes = heap_bytes(lattice);
+}
+
+template <typename C, typename T>
+std::size_t added_tree_bytes(const C &container, const T &other) {
+  std::size_t bytes = 0;
+
+  for (const auto &element : other) {
+    if (container.find(element) == container.end()) {
+      bytes += kTreeNodeOverhead + sizeof(element) + heap_bytes(element);
+    }
+  }
+
+  return bytes;
+}
+
+template <typename T>
+void merge_counting(SetLattice<T> &lattice, const SetLattice<T> &other,
+                    std::size_t &bytes) {
+  bytes += added_tree_bytes(lattice.reveal(), other.reveal());
+  lattice.merge(other);
+}
+
+template <typename T>
+void merge_counting(OrderedSetLattice<T> &lattice,
+                    const OrderedSetLattice<T> &other, std::size_t &bytes) {
+  bytes += added_tree_bytes(lattice.reveal(), other.reveal());
+  lattice.merge(other);
+}
+
+// the vector only grows, so the change in capacity is added as well
+template <typename T>
+void merge_counting(FlatSetLattice<T> &lattice,
+                    const FlatSetLattice<T> &other, std::size_t &bytes) {
+  std::size_t capacity = lattice.reveal().capacity();
+
+  for (const T &element : other.reveal()) {
+    if (!lattice.contains(element)) {
+      bytes += heap_bytes(element);
+    }
+  }
+
+  lattice.merge(other);
+  bytes += (lattice.reveal().capacity() - capacity) * sizeof(T);
+}
+
+#endif // INCLUDE_KVS_VALUE_BYTES_HPP_
@@ -0,0 +1,261 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_VALUE_COMPRESSION_HPP_
+#define INCLUDE_KVS_VALUE_COMPRESSION_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Compression of the values that servers store and gossip. A compressed
+// value is framed by kCompressedMagic and the length of the original value
+// (4 bytes), followed by the value in the LZ4 block format. A value only
+// starts with the magic if it is framed: compress_value frames an original
+// value that happens to start with it however short it is, and servers frame
+// such client values as they arrive (see frame_client_payload).
+const char kCompressedMagic[4] = {'\0', 'L', 'Z', '4'};
+
+const unsigned kCompressedHeaderSize = 8;
+
+// a byte of an LZ4 block produces at most this many bytes of the original, so
+// a frame whose original size is larger than that is malformed
+const unsigned kLz4MaxRatio = 255;
+
+// an LZ4 match is at least 4 bytes, and the last 5 bytes of a block, as well
+// as the 12 before the last match ends, are always literals
+const unsigned kLz4MinMatch = 4;
+const unsigned kLz4LastLiterals = 5;
+const unsigned kLz4MatchLimit = 12;
+
+// the compressor finds matches through a table of the positions of 4-byte
+// sequences, indexed by their hash
+const unsigned kLz4HashBits = 12;
+
+inline uint32_t lz4_read32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+inline uint32_t lz4_hash(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - kLz4HashBits);
+}
+
+// appends a literal or match length beyond what a token holds
+inline void lz4_write_length(std::size_t length, std::string &out) {
+  for (; length >= 255; length -= 255) {
+    out.push_back(static_cast<char>(255));
+  }
+
+  out.push_back(static_cast<char>(length));
+}
+
+inline void lz4_write_sequence(const char *literals, std::size_t literal_length,
+                               std::size_t offset, std::size_t match_length,
+                               std::string &out) {
+  std::size_t token_match = match_length > 0 ? match_length - kLz4MinMatch : 0;
+  out.push_back(static_cast<char>(
+      (literal_length < 15 ? literal_length : 15) << 4 |
+      (token_match < 15 ? token_match : 15)));
+
+  if (literal_length >= 15) {
+    lz4_write_length(literal_length - 15, out);
+  }
+
+  out.append(literals, literal_length);
+
+  // the last sequence of a block has no match
+  if (match_length == 0) {
+    return;
+  }
+
+  out.push_back(static_cast<char>(offset & 0xff));
+  out.push_back(static_cast<char>(offset >> 8));
+
+  if (token_match >= 15) {
+    lz4_write_length(token_match - 15, out);
+  }
+}
+
+// appends src, compressed into an LZ4 block, to out
+inline void lz4_compress(const std::string &src, std::string &out) {
+  const char *base = src.data();
+  std::size_t size = src.size();
+  std::size_t anchor = 0;
+
+  if (size > kLz4MatchLimit) {
+    std::vector<uint32_t> table(1 << kLz4HashBits, 0);
+    std::size_t match_limit = size - kLz4MatchLimit;
+    std::size_t match_end = size - kLz4LastLiterals;
+    std::size_t pos = 0;
+
+    while (pos < match_limit) {
+      uint32_t sequence = lz4_read32(base + pos);
+      uint32_t &slot = table[lz4_hash(sequence)];
+      std::size_t candidate = slot;
+      slot = pos;
+
+      if (candidate >= pos || pos - candidate > 0xffff ||
+          lz4_read32(base + candidate) != sequence) {
+        pos += 1;
+        continue;
+      }
+
+      std::size_t length = kLz4MinMatch;
+      while (pos + length < match_end &&
+             base[candidate + length] == base[pos + length]) {
+        length += 1;
+      }
+
+      lz4_write_sequence(base + anchor, pos - anchor, pos - candidate, length,
+                         out);
+      pos += length;
+      anchor = pos;
+    }
+  }
+
+  lz4_write_sequence(base + anchor, size - anchor, 0, 0, out);
+}
+
+// reads a literal or match length beyond what a token holds
+inline bool lz4_read_length(const char *&in, const char *end,
+                            std::size_t &length) {
+  unsigned char byte;
+  do {
+    if (in == end) {
+      return false;
+    }
+
+    byte = static_cast<unsigned char>(*in++);
+    length += byte;
+  } while (byte == 255);
+
+  return true;
+}
+
+// decompresses the LZ4 block of length bytes at in into out, which must hold
+// exactly the original size; returns false if the block is malformed
+inline bool lz4_decompress(const char *in, std::size_t length,
+                           std::string &out) {
+  const char *end = in + length;
+  std::size_t written = 0;
+
+  while (in < end) {
+    unsigned char token = static_cast<unsigned char>(*in++);
+
+    std::size_t literal_length = token >> 4;
+    if (literal_length == 15 && !lz4_read_length(in, end, literal_length)) {
+      return false;
+    }
+
+    if (literal_length > (std::size_t)(end - in) ||
+        literal_length > out.size() - written) {
+      return false;
+    }
+
+    memcpy(&out[written], in, literal_length);
+    in += literal_length;
+    written += literal_length;
+
+    if (in == end) {
+      break;
+    }
+
+    if (end - in < 2) {
+      return false;
+    }
+
+    std::size_t offset = static_cast<unsigned char>(in[0]) |
+                         static_cast<unsigned char>(in[1]) << 8;
+    in += 2;
+
+    std::size_t match_length = token & 0xf;
+    if (match_length == 15 && !lz4_read_length(in, end, match_length)) {
+      return false;
+    }
+
+    match_length += kLz4MinMatch;
+    if (offset == 0 || offset > written ||
+        match_length > out.size() - written) {
+      return false;
+    }
+
+    // matches may overlap the bytes they produce, so they are copied
+    // forwards one byte at a time
+    for (std::size_t i = 0; i < match_length; i++, written++) {
+      out[written] = out[written - offset];
+    }
+  }
+
+  return written == out.size();
+}
+
+// whether a value starts with kCompressedMagic, which an original value has to
+// be framed for
+inline bool has_magic(const char *value, std::size_t length) {
+  return length >= sizeof(kCompressedMagic) &&
+         memcmp(value, kCompressedMagic, sizeof(kCompressedMagic)) == 0;
+}
+
+inline bool is_compressed(const char *value, std::size_t length) {
+  return length >= kCompressedHeaderSize && has_magic(value, length);
+}
+
+inline bool is_compressed(const std::string &value) {
+  return is_compressed(value.data(), value.size());
+}
+
+// frames value, compressed, into framed if it is at least threshold bytes and
+// compression makes it smaller; returns false, leaving framed unspecified, if
+// the value is better stored as it is
+inline bool compress_value(const std::string &value, unsigned threshold,
+                           std::string &framed) {
+  bool ambiguous = has_magic(value.data(), value.size());
+
+  if (!ambiguous && value.size() < threshold) {
+    return false;
+  }
+
+  uint32_t size = value.size();
+  framed.assign(kCompressedMagic, sizeof(kCompressedMagic));
+  framed.append(reinterpret_cast<const char *>(&size), 4);
+  lz4_compress(value, framed);
+
+  return ambiguous || framed.size() < value.size();
+}
+
+// writes the original of a framed value into value; returns false if the
+// frame is malformed
+inline bool decompress_value(const std::string &framed, std::string &value) {
+  if (!is_compressed(framed)) {
+    return false;
+  }
+
+  uint32_t size;
+  memcpy(&size, framed.data() + sizeof(kCompressedMagic), 4);
+
+  // the size is checked before anything is allocated for it
+  std::size_t block = framed.size() - kCompressedHeaderSize;
+  if (size > block * kLz4MaxRatio) {
+    return false;
+  }
+
+  value.assign(size, '\0');
+  return lz4_decompress(framed.data() + kCompressedHeaderSize,
+                        framed.size() - kCompressedHeaderSize, value);
+}
+
+#endif // INCLUDE_KVS_VALUE_COMPRESSION_HPP_
@@ -0,0 +1,238 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_KVS_WRITE_AHEAD_LOG_HPP_
+#define INCLUDE_KVS_WRITE_AHEAD_LOG_HPP_
+
+#include <chrono>
+#include <sys/mman.h>
+
+#include "log_store.hpp"
+
+// A memory tier thread's write-ahead log. Each write the thread applies is
+// appended to a buffer in the disk tier's record format, and commit writes
+// the buffer out with a single write and fdatasync, so all the writes of an
+// event loop iteration (or of several, within the delay and size bounds)
+// share one sync. The thread holds its responses back until the log is
+// committed, so no client hears about a write that a crash could lose.
+//
+// The log is cut at each snapshot: starting one moves the log aside, and
+// finishing it deletes the old log, whose writes the snapshot now holds.
+// Records are lattices that are merged into the store on replay, so replaying
+// one that the snapshot already holds is harmless.
+class WriteAheadLog {
+  string path_;
+  string old_path_;
+  int fd_;
+
+  // in microseconds and bytes
+  unsigned max_delay_;
+  unsigned max_batch_;
+
+  // the records appended since the last commit
+  string buffer_;
+  std::chrono::steady_clock::time_point oldest_;
+
+  void open_log() {
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ == -1) {
+      std::cerr << "Failed to open write-ahead log " << path_ << std::endl;
+    }
+  }
+
+  // calls f(key, type, payload, tombstone) for each complete record of the
+  // log at path, and returns the length of the complete records
+  template <typename F> static off_t replay(const string &path, F f) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return 0;
+    }
+
+    struct stat st;
+    off_t offset = 0;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (map == MAP_FAILED) {
+        std::cerr << "Failed to map write-ahead log " << path << std::endl;
+      } else {
+        const char *data = static_cast<const char *>(map);
+
+        while (st.st_size - offset >= kLogHeaderSize) {
+          LogRecordHeader header;
+          decode_log_header(data + offset, header);
+
+          const char *key = data + offset + kLogHeaderSize;
+          off_t length =
+              kLogHeaderSize + header.key_length_ + header.payload_length_;
+          if (st.st_size - offset < length) {
+            break;
+          }
+
+          f(Key(key, header.key_length_),
+            static_cast<LatticeType>(header.lattice_type_),
+            string(key + header.key_length_, header.payload_length_),
+            header.tombstone_ != 0);
+          offset += length;
+        }
+
+        munmap(map, st.st_size);
+      }
+    }
+
+    close(fd);
+    return offset;
+  }
+
+public:
+  WriteAheadLog(const string &dir, unsigned tid, unsigned max_delay,
+                unsigned max_batch)
+      : max_delay_(max_delay), max_batch_(max_batch) {
+    string root = dir.back() == '/' ? dir : dir + "/";
+    mkdir(root.c_str(), 0755);
+
+    path_ = root + "wal_" + std::to_string(tid) + ".log";
+    old_path_ = root + "wal_" + std::to_string(tid) + ".old";
+    open_log();
+  }
+
+  ~WriteAheadLog() {
+    commit();
+    close(fd_);
+  }
+
+  // replays the writes logged since the last finished snapshot through
+  // f(key, type, payload, tombstone), and drops a torn record a crash left
+  // at the end of the log; returns the number of records replayed
+  template <typename F> unsigned recover(F f) {
+    unsigned records = 0;
+    auto count = [&](const Key &key, LatticeType type, const string &payload,
+                     bool tombstone) {
+      f(key, type, payload, tombstone);
+      records += 1;
+    };
+
+    replay(old_path_, count);
+    off_t valid = replay(path_, count);
+
+    if (ftruncate(fd_, valid) != 0) {
+      std::cerr << "Failed to truncate write-ahead log." << std::endl;
+    }
+
+    return records;
+  }
+
+  void append(const Key &key, LatticeType type, const string &payload,
+              bool tombstone = false) {
+    if (buffer_.empty()) {
+      oldest_ = std::chrono::steady_clock::now();
+    }
+
+    LogRecordHeader header = {static_cast<uint32_t>(key.size()),
+                              static_cast<uint32_t>(payload.size()),
+                              static_cast<uint8_t>(type),
+                              static_cast<uint8_t>(tombstone)};
+
+    std::size_t start = buffer_.size();
+    buffer_.resize(start + kLogHeaderSize);
+    encode_log_header(header, &buffer_[start]);
+    buffer_ += key;
+    buffer_ += payload;
+  }
+
+  // whether every write appended so far is durable
+  bool empty() const { return buffer_.empty(); }
+
+  // whether the oldest uncommitted write has waited max_delay_, or the
+  // uncommitted writes have reached max_batch_ bytes
+  bool due() const { return !buffer_.empty() && time_until_due() == 0; }
+
+  // milliseconds until the uncommitted writes must be committed, rounded up
+  long time_until_due() const {
+    if (buffer_.size() >= max_batch_) {
+      return 0;
+    }
+
+    long waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - oldest_)
+                      .count();
+
+    if (waited >= (long)max_delay_) {
+      return 0;
+    }
+
+    return (max_delay_ - waited + 999) / 1000;
+  }
+
+  // writes out and syncs the uncommitted writes; they stay buffered if that
+  // fails, so the next commit tries again
+  bool commit() {
+    if (buffer_.empty()) {
+      return true;
+    }
+
+    const char *buf = buffer_.data();
+    size_t remaining = buffer_.size();
+    off_t start = lseek(fd_, 0, SEEK_END);
+
+    while (remaining > 0) {
+      ssize_t n = write(fd_, buf, remaining);
+      if (n <= 0) {
+        std::cerr << "Failed to append to write-ahead log." << std::endl;
+
+        // leave no partial batch behind for the retry to follow
+        if (start < 0 || ftruncate(fd_, start) != 0) {
+          std::cerr << "Failed to truncate write-ahead log." << std::endl;
+        }
+
+        return false;
+      }
+
+      buf += n;
+      remaining -= n;
+    }
+
+    if (fdatasync(fd_) != 0) {
+      std::cerr << "Failed to sync write-ahead log." << std::endl;
+      return false;
+    }
+
+    buffer_.clear();
+    return true;
+  }
+
+  // called as a snapshot starts: later writes go to a new log, and the
+  // current one is kept until the snapshot is finished. If the previous
+  // snapshot never finished, its old log is still needed, and the current
+  // log carries on.
+  void rotate() {
+    if (!commit() || access(old_path_.c_str(), F_OK) == 0) {
+      return;
+    }
+
+    close(fd_);
+    if (rename(path_.c_str(), old_path_.c_str()) != 0) {
+      std::cerr << "Failed to rotate write-ahead log." << std::endl;
+    }
+
+    open_log();
+  }
+
+  // called once a snapshot is finished, which holds every write the old log
+  // does
+  void retire() { unlink(old_path_.c_str()); }
+};
+
+#endif // INCLUDE_KVS_WRITE_AHEAD_LOG_HPP_
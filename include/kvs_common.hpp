@@ -29,6 +29,10 @@ const vector<Tier> kAllTiers = {
 
 const unsigned kSloWorst = 3000;
 
+// the most keys a thread answers a scan with, and the page size of a scan
+// that does not ask for one
+const unsigned kMaxScanPage = 10000;
+
 // run-time constants
 extern Tier kSelfTier;
 extern vector<Tier> kSelfTierIdVector;
@@ -49,6 +49,10 @@ const unsigned kCacheIpResponsePort = 7050;
 // request for the list of all existing function nodes.
 const unsigned kManagementNodeResponsePort = 7100;
 
+// The port on which KVS servers listen for scans that the routing tier fans
+// out to them.
+const unsigned kKeyScanPort = 7150;
+
 // The port on which routing servers listen for cluster membership requests.
 const unsigned kSeedPort = 6350;
 
@@ -62,6 +66,18 @@ const unsigned kRoutingReplicationResponsePort = 6500;
 // announcements from the monitoring system.
 const unsigned kRoutingReplicationChangePort = 6550;
 
+// The port on which routing servers answer requests for a ring snapshot.
+const unsigned kRoutingRingSnapshotPort = 6950;
+
+// The port on which routing servers publish ring snapshot updates.
+const unsigned kRoutingRingUpdatePort = 6980;
+
+// The port on which routing servers listen for key scans from clients.
+const unsigned kRoutingKeyScanPort = 7200;
+
+// The port on which clients listen for the pages of their key scans.
+const unsigned kUserScanResponsePort = 7250;
+
 // The port on which the monitoring system listens for cluster membership
 // changes.
 const unsigned kMonitoringNotifyPort = 6600;
@@ -78,9 +94,17 @@ const unsigned kDepartDonePort = 6700;
 // clients.
 const unsigned kFeedbackReportPort = 6750;
 
+// The port on which the monitoring nodes listen for the statistics reports
+// that server threads push.
+const unsigned kMonitoringStatsPort = 7300;
+
 // The port on which benchmark nodes listen for triggers.
 const unsigned kBenchmarkCommandPort = 6900;
 
+// The port on which the benchmark driver collects results from benchmark
+// threads.
+const unsigned kBenchmarkReportPort = 7350;
+
 // The port on which storage nodes retrieve their restart counts from the
 // management system.
 const unsigned kKopsRestartCountPort = 7000;
@@ -200,6 +224,14 @@ public:
   Address replication_change_bind_address() const {
     return kBindBase + std::to_string(tid_ + kServerReplicationChangePort);
   }
+
+  Address key_scan_connect_address() const {
+    return private_base_ + std::to_string(tid_ + kKeyScanPort);
+  }
+
+  Address key_scan_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kKeyScanPort);
+  }
 };
 
 inline bool operator==(const ServerThread &l, const ServerThread &r) {
@@ -264,6 +296,30 @@ public:
   Address replication_change_bind_address() const {
     return kBindBase + std::to_string(tid_ + kRoutingReplicationChangePort);
   }
+
+  Address ring_snapshot_connect_address() const {
+    return ip_base_ + std::to_string(tid_ + kRoutingRingSnapshotPort);
+  }
+
+  Address ring_snapshot_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kRoutingRingSnapshotPort);
+  }
+
+  Address ring_update_connect_address() const {
+    return ip_base_ + std::to_string(tid_ + kRoutingRingUpdatePort);
+  }
+
+  Address ring_update_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kRoutingRingUpdatePort);
+  }
+
+  Address key_scan_connect_address() const {
+    return ip_base_ + std::to_string(tid_ + kRoutingKeyScanPort);
+  }
+
+  Address key_scan_bind_address() const {
+    return kBindBase + std::to_string(tid_ + kRoutingKeyScanPort);
+  }
 };
 
 class MonitoringThread {
@@ -307,6 +363,14 @@ public:
   Address feedback_report_bind_address() const {
     return kBindBase + std::to_string(kFeedbackReportPort);
   }
+
+  Address stats_report_connect_address() const {
+    return ip_base_ + std::to_string(kMonitoringStatsPort);
+  }
+
+  Address stats_report_bind_address() const {
+    return kBindBase + std::to_string(kMonitoringStatsPort);
+  }
 };
 
 class BenchmarkThread {
@@ -327,6 +391,10 @@ private:
   unsigned tid_;
 };
 
+inline string get_benchmark_report_address(Address driver_ip) {
+  return "tcp://" + driver_ip + ":" + std::to_string(kBenchmarkReportPort);
+}
+
 inline string get_join_count_req_address(string management_ip) {
   return "tcp://" + management_ip + ":" + std::to_string(kKopsRestartCountPort);
 }
@@ -335,6 +403,14 @@ inline string get_func_nodes_req_address(string management_ip) {
   return "tcp://" + management_ip + ":" + std::to_string(kKopsFuncNodesPort);
 }
 
+inline string get_scan_response_connect_address(Address ip, unsigned tid) {
+  return "tcp://" + ip + ":" + std::to_string(tid + kUserScanResponsePort);
+}
+
+inline string get_scan_response_bind_address(unsigned tid) {
+  return kBindBase + std::to_string(tid + kUserScanResponsePort);
+}
+
 struct ThreadHash {
   std::size_t operator()(const ServerThread &st) const {
     return std::hash<string>{}(st.id());
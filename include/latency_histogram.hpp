@@ -0,0 +1,164 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_LATENCY_HISTOGRAM_HPP_
+#define KVS_INCLUDE_LATENCY_HISTOGRAM_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// the number of bits of each value a histogram bucket resolves; values are
+// recorded to within 1 / 2^kHistogramPrecisionBits of their magnitude
+const unsigned kHistogramPrecisionBits = 7;
+
+// values above this (in microseconds, about 19 hours) are recorded as this
+const uint64_t kHistogramMaxValue = (1ULL << 36) - 1;
+
+// An HDR-style histogram of latencies in microseconds. Values below
+// 2^(kHistogramPrecisionBits + 1) get a bucket each; above that, every power
+// of two is split into 2^kHistogramPrecisionBits equal buckets, so the
+// relative error is bounded at any magnitude with a fixed bucket count.
+// Histograms with the same layout merge by adding counts, which is how
+// per-thread histograms are combined across threads and benchmark nodes.
+class LatencyHistogram {
+  std::vector<uint64_t> counts_;
+  uint64_t total_;
+  uint64_t max_;
+  double sum_;
+
+  static unsigned msb(uint64_t value) {
+    unsigned bit = 0;
+    while (value >>= 1) {
+      bit++;
+    }
+
+    return bit;
+  }
+
+public:
+  LatencyHistogram()
+      : counts_(bucket_index(kHistogramMaxValue) + 1, 0), total_(0), max_(0),
+        sum_(0) {}
+
+  static unsigned bucket_index(uint64_t value) {
+    const uint64_t sub_buckets = 1ULL << kHistogramPrecisionBits;
+
+    if (value < 2 * sub_buckets) {
+      return value;
+    }
+
+    unsigned shift = msb(value) - kHistogramPrecisionBits;
+    return (shift + 1) * sub_buckets + ((value >> shift) - sub_buckets);
+  }
+
+  // the midpoint of the values that map to bucket index
+  static uint64_t bucket_value(unsigned index) {
+    const uint64_t sub_buckets = 1ULL << kHistogramPrecisionBits;
+
+    if (index < 2 * sub_buckets) {
+      return index;
+    }
+
+    unsigned shift = index / sub_buckets - 1;
+    uint64_t lowest = (sub_buckets + index % sub_buckets) << shift;
+    return lowest + ((1ULL << shift) >> 1);
+  }
+
+  void record(double latency) {
+    uint64_t value = latency < 0 ? 0 : (uint64_t)latency;
+    if (value > kHistogramMaxValue) {
+      value = kHistogramMaxValue;
+    }
+
+    counts_[bucket_index(value)] += 1;
+    total_ += 1;
+    sum_ += value;
+
+    if (value > max_) {
+      max_ = value;
+    }
+  }
+
+  // adds count values that fell into bucket index, e.g., when rebuilding a
+  // histogram that was sent over the network
+  void add(unsigned index, uint64_t count) {
+    if (index >= counts_.size() || count == 0) {
+      return;
+    }
+
+    counts_[index] += count;
+    total_ += count;
+    sum_ += (double)bucket_value(index) * count;
+
+    if (bucket_value(index) > max_) {
+      max_ = bucket_value(index);
+    }
+  }
+
+  void merge(const LatencyHistogram &other) {
+    for (unsigned i = 0; i < counts_.size(); i++) {
+      counts_[i] += other.counts_[i];
+    }
+
+    total_ += other.total_;
+    sum_ += other.sum_;
+
+    if (other.max_ > max_) {
+      max_ = other.max_;
+    }
+  }
+
+  // the p-th percentile (0 < p <= 1) by the nearest-rank method
+  double percentile(double p) const {
+    if (total_ == 0) {
+      return 0;
+    }
+
+    uint64_t rank = std::ceil(p * total_);
+    if (rank == 0) {
+      rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < counts_.size(); i++) {
+      seen += counts_[i];
+
+      if (seen >= rank) {
+        // the midpoint of the highest bucket may lie above the largest value
+        return bucket_value(i) < max_ ? bucket_value(i) : max_;
+      }
+    }
+
+    return max_;
+  }
+
+  double mean() const { return total_ == 0 ? 0 : sum_ / total_; }
+
+  void clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_ = 0;
+    max_ = 0;
+    sum_ = 0;
+  }
+
+  const std::vector<uint64_t> &counts() const { return counts_; }
+
+  uint64_t total() const { return total_; }
+
+  uint64_t max() const { return max_; }
+};
+
+#endif // KVS_INCLUDE_LATENCY_HISTOGRAM_HPP_
@@ -15,6 +15,8 @@
 #ifndef KVS_INCLUDE_METADATA_HPP_
 #define KVS_INCLUDE_METADATA_HPP_
 
+#include <chrono>
+
 #include "metadata.pb.h"
 #include "threads.hpp"
 
@@ -31,9 +33,71 @@ struct KeyReplication {
   hmap<Tier, unsigned, TierEnumHash> local_replication_;
 };
 
+// How long a replication factor request may go unanswered before another
+// miss on the same key is allowed to issue a new one.
+const unsigned kReplicationRequestTimeout = 1000; // in milliseconds
+
+// the default number of keys a routing thread keeps replication factors for
+const unsigned kDefaultReplicationCacheSize = 1 << 20;
+
+// The replication factors known to a thread, along with the keys that have a
+// replication factor request in flight, so that concurrent misses on a key
+// share a single metadata round-trip.
+//
+// With a capacity, the map is a cache: adding a key beyond the capacity
+// evicts another, whose factor is fetched again on its next miss. Routing
+// threads bound theirs. Servers and the monitor keep every factor, because
+// their handlers expect a factor for each key they store or track.
+class KeyReplicationMap : public map<Key, KeyReplication> {
+  hmap<Key, std::chrono::steady_clock::time_point> inflight_;
+
+  // 0 for no bound
+  unsigned capacity_;
+
+public:
+  KeyReplicationMap(unsigned capacity = 0) : capacity_(capacity) {}
+
+  KeyReplication &operator[](const Key &key) {
+    auto it = find(key);
+    if (it != end()) {
+      return it->second;
+    }
+
+    // evict the next key in order rather than tracking recency on every hit
+    if (capacity_ > 0 && size() >= capacity_) {
+      auto victim = upper_bound(key);
+      erase(victim == end() ? begin() : victim);
+    }
+
+    return insert({key, KeyReplication()}).first->second;
+  }
+
+  // returns true if the caller should issue a replication factor request for
+  // key, i.e., if none is in flight or the one in flight has timed out
+  bool start_request(const Key &key) {
+    auto now = std::chrono::steady_clock::now();
+    auto it = inflight_.find(key);
+
+    if (it != inflight_.end() &&
+        now - it->second <
+            std::chrono::milliseconds(kReplicationRequestTimeout)) {
+      return false;
+    }
+
+    inflight_[key] = now;
+    return true;
+  }
+
+  void finish_request(const Key &key) { inflight_.erase(key); }
+};
+
 struct KeyProperty {
   unsigned size_;
   LatticeType type_;
+
+  // set when the key is accessed, and cleared when the eviction clock passes
+  // it
+  bool referenced_;
 };
 
 inline bool operator==(const KeyReplication &lhs, const KeyReplication &rhs) {
@@ -84,15 +148,13 @@ struct TierMetadata {
   unsigned long long node_capacity_;
 };
 
-inline bool is_metadata(Key key) {
-  vector<string> v;
-  split(key, '|', v);
+// A key is metadata iff its first delimited token is the metadata identifier;
+// this only compares the prefix, so it never allocates.
+inline bool is_metadata(const Key &key) {
+  const string::size_type length = kMetadataIdentifier.size();
 
-  if (v[0] == kMetadataIdentifier) {
-    return true;
-  } else {
-    return false;
-  }
+  return key.compare(0, length, kMetadataIdentifier) == 0 &&
+         (key.size() == length || key[length] == kMetadataDelimiterChar);
 }
 
 // NOTE: This needs to be here because it needs the definition of TierMetadata
@@ -142,15 +204,16 @@ inline Key get_metadata_key(string data_key, MetadataType type) {
 // Precondition: metadata_key is actually a metadata key (output of
 // get_metadata_key).
 // TODO: same problem as get_metadata_key with the metadata types.
-inline Key get_key_from_metadata(Key metadata_key) {
+inline Key get_key_from_metadata(const Key &metadata_key) {
   string::size_type n_id;
   string::size_type n_type;
   // Find the first delimiter; this skips over the metadata identifier.
-  n_id = metadata_key.find(kMetadataDelimiter);
+  n_id = metadata_key.find(kMetadataDelimiterChar);
   // Find the second delimiter; this skips over the metadata type.
-  n_type = metadata_key.find(kMetadataDelimiter, n_id + 1);
-  string metadata_type = metadata_key.substr(n_id + 1, n_type - (n_id + 1));
-  if (metadata_type == kMetadataTypeReplication) {
+  n_type = metadata_key.find(kMetadataDelimiterChar, n_id + 1);
+  if (n_type != string::npos &&
+      metadata_key.compare(n_id + 1, n_type - (n_id + 1),
+                           kMetadataTypeReplication) == 0) {
     return metadata_key.substr(n_type + 1);
   }
 
@@ -158,7 +221,9 @@ inline Key get_key_from_metadata(Key metadata_key) {
 }
 
 // Precondition: key is from the non-data-key version of get_metadata_key.
-inline vector<string> split_metadata_key(Key key) {
+// This is the only place the individual metadata fields are parsed out, so
+// callers that just need to recognize metadata should use is_metadata.
+inline vector<string> split_metadata_key(const Key &key) {
   vector<string> tokens;
   split(key, kMetadataDelimiterChar, tokens);
 
@@ -166,7 +231,7 @@ inline vector<string> split_metadata_key(Key key) {
 }
 
 inline void warmup_key_replication_map_to_defaults(
-    map<Key, KeyReplication> &key_replication_map,
+    KeyReplicationMap &key_replication_map,
     unsigned &kDefaultGlobalMemoryReplication,
     unsigned &kDefaultGlobalEbsReplication,
     unsigned &kDefaultLocalReplication) {
@@ -184,7 +249,7 @@ inline void warmup_key_replication_map_to_defaults(
   }
 }
 
-inline void init_replication(map<Key, KeyReplication> &key_replication_map,
+inline void init_replication(KeyReplicationMap &key_replication_map,
                              const Key &key) {
   for (const Tier &tier : kAllTiers) {
     key_replication_map[key].global_replication_[tier] =
@@ -0,0 +1,276 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_MONITOR_ACCESS_AGGREGATE_HPP_
+#define KVS_INCLUDE_MONITOR_ACCESS_AGGREGATE_HPP_
+
+#include <chrono>
+#include <functional>
+#include <queue>
+
+#include "count_min_sketch.hpp"
+#include "metadata.pb.h"
+
+// What a tenant used of the threads that reported, summed over them.
+struct TenantTotals {
+  unsigned long long accesses = 0;
+  unsigned long long rejected = 0;
+  unsigned long long bytes = 0;
+};
+
+// One of the cluster's hottest keys. The true access count lies between
+// count, the sum over the threads where the key is hot, and bound, the
+// sketch's estimate; bound is 0 if the sketch does not cover every thread.
+struct HeavyHitter {
+  Key key;
+  unsigned count;
+  unsigned bound;
+};
+
+// The cluster-wide key access counts, kept up to date as server threads
+// report. Each thread's latest report replaces its previous one: the
+// thread's hot key counts are subtracted from the running sums and its new
+// ones added, and likewise for its sketch, so applying a report costs time in
+// proportion to the report rather than to the number of keys in the cluster.
+//
+// A key's count is exact if it is among the hot keys of every thread that
+// accessed it. The sketch bounds every other key's count from above; an
+// estimate of 0 means that no thread accessed the key within its window.
+class AccessAggregate {
+  struct Source {
+    map<Key, unsigned> hot;
+    CountMinSketch sketch;
+    unsigned long long accessed;
+    unsigned long long total;
+    double squares;
+    map<string, TenantTotals> tenants;
+    std::chrono::steady_clock::time_point received;
+  };
+
+  // by node (as public IP/private IP), then by thread
+  map<Address, map<unsigned, Source>> sources_;
+  unsigned source_count_;
+
+  // the sums over every source
+  map<Key, unsigned> hot_;
+  CountMinSketch sketch_;
+  unsigned sketched_;
+  unsigned long long accessed_;
+  unsigned long long total_;
+  double squares_;
+  map<string, TenantTotals> tenants_;
+
+  void add(const Source &source) {
+    for (const auto &pair : source.hot) {
+      hot_[pair.first] += pair.second;
+    }
+
+    if (!source.sketch.empty()) {
+      if (sketched_ == 0) {
+        sketch_ = CountMinSketch(source.sketch.width(), source.sketch.depth());
+      }
+
+      if (sketch_.merge(source.sketch)) {
+        sketched_ += 1;
+      }
+    }
+
+    accessed_ += source.accessed;
+    total_ += source.total;
+    squares_ += source.squares;
+    source_count_ += 1;
+
+    for (const auto &pair : source.tenants) {
+      TenantTotals &totals = tenants_[pair.first];
+      totals.accesses += pair.second.accesses;
+      totals.rejected += pair.second.rejected;
+      totals.bytes += pair.second.bytes;
+    }
+  }
+
+  void subtract(const Source &source) {
+    for (const auto &pair : source.hot) {
+      auto it = hot_.find(pair.first);
+
+      if (it->second <= pair.second) {
+        hot_.erase(it);
+      } else {
+        it->second -= pair.second;
+      }
+    }
+
+    if (!source.sketch.empty() && sketch_.merge(source.sketch, true)) {
+      sketched_ -= 1;
+    }
+
+    accessed_ -= source.accessed;
+    total_ -= source.total;
+    squares_ -= source.squares;
+    source_count_ -= 1;
+
+    for (const auto &pair : source.tenants) {
+      auto it = tenants_.find(pair.first);
+      TenantTotals &totals = it->second;
+      totals.accesses -= pair.second.accesses;
+      totals.rejected -= pair.second.rejected;
+      totals.bytes -= pair.second.bytes;
+
+      if (totals.accesses == 0 && totals.rejected == 0 && totals.bytes == 0) {
+        tenants_.erase(it);
+      }
+    }
+  }
+
+public:
+  AccessAggregate()
+      : source_count_(0), sketched_(0), accessed_(0), total_(0), squares_(0) {
+  }
+
+  void apply(const ServerStatsReport &report,
+             std::chrono::steady_clock::time_point received) {
+    Address node = report.public_ip() + "/" + report.private_ip();
+    map<unsigned, Source> &threads = sources_[node];
+    auto it = threads.find(report.tid());
+
+    if (it != threads.end()) {
+      subtract(it->second);
+    }
+
+    Source &source = threads[report.tid()];
+    source.hot.clear();
+
+    for (const auto &key_count : report.hot_keys()) {
+      source.hot[key_count.key()] = key_count.access_count();
+    }
+
+    // a sketch of different dimensions than the others is left out, and
+    // then the sketch no longer covers every source
+    vector<uint32_t> counts(report.sketch().begin(), report.sketch().end());
+    source.sketch.assign(report.sketch_width(), counts);
+    if (sketched_ > 0 && (source.sketch.width() != sketch_.width() ||
+                          source.sketch.depth() != sketch_.depth())) {
+      source.sketch = CountMinSketch();
+    }
+
+    source.accessed = report.accessed_keys();
+    source.total = report.access_total();
+    source.squares = report.access_square_total();
+    source.received = received;
+
+    source.tenants.clear();
+    for (const TenantUsage &usage : report.tenants()) {
+      TenantTotals &totals = source.tenants[usage.tenant()];
+      totals.accesses = usage.access_count();
+      totals.rejected = usage.rejected_count();
+      totals.bytes = usage.bytes();
+    }
+
+    add(source);
+  }
+
+  // forgets every thread of node (as public IP/private IP)
+  void remove(const Address &node) {
+    auto it = sources_.find(node);
+    if (it == sources_.end()) {
+      return;
+    }
+
+    for (const auto &pair : it->second) {
+      subtract(pair.second);
+    }
+
+    sources_.erase(it);
+  }
+
+  // forgets the threads that have not reported since oldest, and returns
+  // them by node and thread
+  vector<std::pair<Address, unsigned>>
+  expire(std::chrono::steady_clock::time_point oldest) {
+    vector<std::pair<Address, unsigned>> expired;
+
+    for (auto node = sources_.begin(); node != sources_.end();) {
+      for (auto thread = node->second.begin();
+           thread != node->second.end();) {
+        if (thread->second.received < oldest) {
+          subtract(thread->second);
+          expired.push_back({node->first, thread->first});
+          thread = node->second.erase(thread);
+        } else {
+          ++thread;
+        }
+      }
+
+      if (node->second.empty()) {
+        node = sources_.erase(node);
+      } else {
+        ++node;
+      }
+    }
+
+    return expired;
+  }
+
+  // the number of threads whose reports are held
+  unsigned sources() const { return source_count_; }
+
+  // whether the sketch covers every thread that reported
+  bool sketched() const {
+    return source_count_ > 0 && sketched_ == source_count_;
+  }
+
+  // the summed counts of the keys that are hot on some thread
+  const map<Key, unsigned> &hot() const { return hot_; }
+
+  // the k keys with the highest summed counts, hottest first; this costs
+  // time in proportion to the number of hot keys rather than to the keyspace
+  vector<HeavyHitter> heavy_hitters(unsigned k) const {
+    typedef std::pair<unsigned, const Key *> HotKey;
+    std::priority_queue<HotKey, vector<HotKey>, std::greater<HotKey>> top;
+
+    for (const auto &pair : hot_) {
+      if (top.size() < k) {
+        top.push(HotKey(pair.second, &pair.first));
+      } else if (k > 0 && pair.second > top.top().first) {
+        top.pop();
+        top.push(HotKey(pair.second, &pair.first));
+      }
+    }
+
+    vector<HeavyHitter> hitters(top.size());
+    bool bounded = sketched();
+
+    for (auto it = hitters.rbegin(); !top.empty(); top.pop(), ++it) {
+      it->key = *top.top().second;
+      it->count = top.top().first;
+      it->bound = bounded ? std::max(it->count, estimate(it->key)) : 0;
+    }
+
+    return hitters;
+  }
+
+  // an upper bound on key's access count, if sketched()
+  unsigned estimate(const Key &key) const { return sketch_.estimate(key); }
+
+  // the number of keys accessed on each thread, summed over threads, and the
+  // sum and the sum of squares of their counts; a key accessed on several
+  // threads counts once per thread
+  unsigned long long accessed() const { return accessed_; }
+  unsigned long long total() const { return total_; }
+  double squares() const { return squares_; }
+
+  // the usage of every tenant, summed over the threads' latest epochs
+  const map<string, TenantTotals> &tenants() const { return tenants_; }
+};
+
+#endif // KVS_INCLUDE_MONITOR_ACCESS_AGGREGATE_HPP_
@@ -0,0 +1,150 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_MONITOR_LOAD_FORECAST_HPP_
+#define KVS_INCLUDE_MONITOR_LOAD_FORECAST_HPP_
+
+#include <algorithm>
+#include <cmath>
+
+// the number of epochs observed before the forecast is acted on
+const unsigned kForecastWarmupEpochs = 3;
+
+// Double exponential smoothing (Holt's linear method): a smoothed level and a
+// smoothed trend, so that a steady rise is forecast to keep rising. alpha
+// weighs new observations into the level and beta new slopes into the trend.
+class HoltForecast {
+  double alpha_;
+  double beta_;
+  double level_;
+  double trend_;
+  unsigned samples_;
+
+public:
+  HoltForecast(double alpha, double beta)
+      : alpha_(alpha), beta_(beta), level_(0), trend_(0), samples_(0) {}
+
+  void observe(double value) {
+    if (samples_ == 0) {
+      level_ = value;
+      trend_ = 0;
+    } else {
+      double last = level_;
+      level_ = alpha_ * value + (1 - alpha_) * (level_ + trend_);
+      trend_ = beta_ * (level_ - last) + (1 - beta_) * trend_;
+    }
+
+    samples_ += 1;
+  }
+
+  // the value expected steps observations ahead, never below 0
+  double forecast(unsigned steps) const {
+    return std::max(0.0, level_ + steps * trend_);
+  }
+
+  unsigned samples() const { return samples_; }
+};
+
+// Forecasts the memory tier's load a number of epochs ahead, so that nodes
+// are added before the load arrives and removed only once it has stayed low.
+//
+// The load is measured as work: the average node occupancy times the number
+// of nodes, which, unlike the occupancy itself, does not change as nodes join
+// and leave. It is forecast directly, and also by scaling the current work by
+// the forecast client throughput; the higher of the two is used.
+//
+// Hysteresis keeps the tier from flapping: nodes are added when the forecast
+// occupancy passes high, up to the midpoint of low and high, and a node is
+// removed only after the forecast occupancy without it has stayed below low
+// for shrink_epochs epochs in a row.
+class LoadForecast {
+  HoltForecast work_;
+  HoltForecast throughput_;
+  double last_work_;
+  double last_throughput_;
+
+  unsigned horizon_;
+  double high_;
+  double low_;
+  unsigned shrink_epochs_;
+
+  unsigned node_count_;
+  unsigned low_epochs_;
+
+public:
+  LoadForecast(double alpha = 0.5, double beta = 0.3, unsigned horizon = 4,
+               double high = 0.6, double low = 0.3, unsigned shrink_epochs = 4)
+      : work_(alpha, beta), throughput_(alpha, beta), last_work_(0),
+        last_throughput_(0), horizon_(horizon), high_(high), low_(low),
+        shrink_epochs_(shrink_epochs), node_count_(0), low_epochs_(0) {}
+
+  // records an epoch's client throughput and the average occupancy of the
+  // node_count memory nodes; epochs without occupancy reports are skipped
+  void observe(double throughput, double occupancy, unsigned node_count) {
+    if (node_count == 0 || !std::isfinite(occupancy)) {
+      return;
+    }
+
+    last_work_ = occupancy * node_count;
+    last_throughput_ = throughput;
+    work_.observe(last_work_);
+    throughput_.observe(throughput);
+
+    // a removal only counts the epochs since the tier last changed size
+    if (node_count != node_count_) {
+      node_count_ = node_count;
+      low_epochs_ = 0;
+    }
+
+    if (node_count > 1 && projected_work() < low_ * (node_count - 1)) {
+      low_epochs_ += 1;
+    } else {
+      low_epochs_ = 0;
+    }
+  }
+
+  bool ready() const { return work_.samples() >= kForecastWarmupEpochs; }
+
+  // the work expected horizon epochs ahead, in nodes' worth of occupancy
+  double projected_work() const {
+    double work = work_.forecast(horizon_);
+
+    if (last_throughput_ > 0) {
+      work = std::max(work, last_work_ * throughput_.forecast(horizon_) /
+                                last_throughput_);
+    }
+
+    return work;
+  }
+
+  // the number of nodes to add to node_count ahead of the forecast load
+  unsigned nodes_to_add(unsigned node_count) const {
+    if (!ready() || node_count == 0) {
+      return 0;
+    }
+
+    double work = projected_work();
+    if (work <= high_ * node_count) {
+      return 0;
+    }
+
+    unsigned target = ceil(work / ((high_ + low_) / 2));
+    return target > node_count ? target - node_count : 0;
+  }
+
+  // whether the forecast load has stayed low enough to remove a node
+  bool can_remove() const { return ready() && low_epochs_ >= shrink_epochs_; }
+};
+
+#endif // KVS_INCLUDE_MONITOR_LOAD_FORECAST_HPP_
@@ -16,7 +16,9 @@
 #define KVS_INCLUDE_MONITOR_MONITORING_HANDLERS_HPP_
 
 #include "hash_ring.hpp"
+#include "latency_histogram.hpp"
 #include "metadata.pb.h"
+#include "monitor/access_aggregate.hpp"
 
 void membership_handler(logger log, string &serialized,
                         GlobalRingMap &global_hash_rings,
@@ -25,7 +27,8 @@ void membership_handler(logger log, string &serialized,
                         StorageStats &memory_storage, StorageStats &ebs_storage,
                         OccupancyStats &memory_occupancy,
                         OccupancyStats &ebs_occupancy,
-                        map<Key, map<Address, unsigned>> &key_access_frequency);
+                        AccessStats &memory_accesses, AccessStats &ebs_accesses,
+                        AccessAggregate &access);
 
 void depart_done_handler(logger log, string &serialized,
                          map<Address, unsigned> &departing_node_map,
@@ -36,6 +39,21 @@ void depart_done_handler(logger log, string &serialized,
 void feedback_handler(
     string &serialized, map<string, double> &user_latency,
     map<string, double> &user_throughput,
-    map<Key, std::pair<double, unsigned>> &latency_miss_ratio_map);
+    map<Key, std::pair<double, unsigned>> &latency_miss_ratio_map,
+    map<string, LatencyHistogram> &op_latency);
+
+// Postcondition:
+// the sending thread's statistics and access summary replace its previous
+// ones, and the key sizes and the replication factors in the report are
+// updated
+void stats_report_handler(logger log, string &serialized,
+                          AccessAggregate &access, map<Key, unsigned> &key_size,
+                          StorageStats &memory_storage,
+                          StorageStats &ebs_storage,
+                          OccupancyStats &memory_occupancy,
+                          OccupancyStats &ebs_occupancy,
+                          AccessStats &memory_accesses,
+                          AccessStats &ebs_accesses,
+                          KeyReplicationMap &key_replication_map);
 
 #endif // KVS_INCLUDE_MONITOR_MONITORING_HANDLERS_HPP_
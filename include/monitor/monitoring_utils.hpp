@@ -16,12 +16,23 @@
 #define KVS_INCLUDE_MONITOR_MONITORING_UTILS_HPP_
 
 #include "hash_ring.hpp"
+#include "latency_histogram.hpp"
 #include "metadata.pb.h"
+#include "monitor/access_aggregate.hpp"
+#include "monitor/tiering_plan.hpp"
 #include "requests.hpp"
 
 // define monitoring threshold (in second)
 const unsigned kMonitoringThreshold = 30;
 
+// the statistics of a server thread that has not reported for this long are
+// dropped (in second)
+const unsigned kStatsReportExpiry = 60;
+
+// how long a batch of requests to storage servers waits for its responses
+// (in millisecond)
+const long kMetadataRequestTimeout = 2000;
+
 // define the grace period for triggering elasticity action (in second)
 const unsigned kGracePeriod = 120;
 
@@ -34,10 +45,16 @@ const double kMinMemoryNodeConsumption = 0.3;
 const double kMaxEbsNodeConsumption = 0.75;
 const double kMinEbsNodeConsumption = 0.5;
 
+// the number of the hottest keys that selective replication considers
+const unsigned kSelectiveRepKeyCount = 100;
+
 // define threshold for promotion/demotion
 const unsigned kKeyPromotionThreshold = 0;
 const unsigned kKeyDemotionThreshold = 1;
 
+// the most keys promoted or evicted between the tiers in one epoch
+const unsigned kMaxKeyMovesPerEpoch = 1000;
+
 // define minimum number of nodes for each tier
 const unsigned kMinMemoryTierSize = 1;
 const unsigned kMinEbsTierSize = 0;
@@ -68,6 +85,7 @@ struct SummaryStats {
     min_occupancy_memory_public_ip = Address();
     min_occupancy_memory_private_ip = Address();
     avg_latency = 0;
+    p99_latency = 0;
     total_throughput = 0;
   }
 
@@ -93,29 +111,87 @@ struct SummaryStats {
   Address min_occupancy_memory_public_ip;
   Address min_occupancy_memory_private_ip;
   double avg_latency;
+  // 0 unless clients sent latency histograms
+  double p99_latency;
   double total_throughput;
 };
 
-void collect_internal_stats(
-    GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    SocketCache &pushers, MonitoringThread &mt, zmq::socket_t &response_puller,
-    logger log, unsigned &rid,
-    map<Key, map<Address, unsigned>> &key_access_frequency,
-    map<Key, unsigned> &key_size, StorageStats &memory_storage,
-    StorageStats &ebs_storage, OccupancyStats &memory_occupancy,
-    OccupancyStats &ebs_occupancy, AccessStats &memory_access,
-    AccessStats &ebs_access);
+// Sends every request in requests (by address) at once, then collects the
+// responses until each has answered or timeout (in milliseconds) has passed.
+// Returns the responses by address; the addresses that did not answer in
+// time are left out. Responses are matched by request ID, so late responses
+// to an earlier batch are dropped.
+template <typename REQ, typename RES>
+map<Address, RES> make_requests(const map<Address, REQ> &requests,
+                                SocketCache &pushers,
+                                zmq::socket_t &response_puller, long timeout) {
+  map<string, Address> outstanding;
+
+  for (const auto &pair : requests) {
+    string serialized;
+    pair.second.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[pair.first]);
+    outstanding[pair.second.request_id()] = pair.first;
+  }
+
+  map<Address, RES> responses;
+  vector<zmq::pollitem_t> pollitems = {
+      {static_cast<void *>(response_puller), 0, ZMQ_POLLIN, 0}};
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  while (outstanding.size() > 0) {
+    long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         deadline - std::chrono::steady_clock::now())
+                         .count();
+    if (remaining <= 0) {
+      break;
+    }
+
+    kZmqUtil->poll(remaining, &pollitems);
+    if (!(pollitems[0].revents & ZMQ_POLLIN)) {
+      continue;
+    }
+
+    RES response;
+    response.ParseFromString(kZmqUtil->recv_string(&response_puller));
+
+    auto it = outstanding.find(response.response_id());
+    if (it != outstanding.end()) {
+      responses[it->second] = response;
+      outstanding.erase(it);
+    }
+  }
+
+  return responses;
+}
+
+// removes thread tid of node from stats, and node once it has no threads
+// left
+template <typename Stats>
+void erase_thread_stats(Stats &stats, const Address &node, unsigned tid) {
+  auto it = stats.find(node);
+
+  if (it != stats.end()) {
+    it->second.erase(tid);
+
+    if (it->second.empty()) {
+      stats.erase(it);
+    }
+  }
+}
 
 void compute_summary_stats(
-    map<Key, map<Address, unsigned>> &key_access_frequency,
-    StorageStats &memory_storage, StorageStats &ebs_storage,
-    OccupancyStats &memory_occupancy, OccupancyStats &ebs_occupancy,
-    AccessStats &memory_access, AccessStats &ebs_access,
-    map<Key, unsigned> &key_access_summary, SummaryStats &ss, logger log,
-    unsigned &server_monitoring_epoch);
+    AccessAggregate &access, map<Key, unsigned> &key_size,
+    unsigned expected_sources, StorageStats &memory_storage,
+    StorageStats &ebs_storage, OccupancyStats &memory_occupancy,
+    OccupancyStats &ebs_occupancy, AccessStats &memory_access,
+    AccessStats &ebs_access, map<Key, unsigned> &key_access_summary,
+    SummaryStats &ss, logger log, unsigned &server_monitoring_epoch);
 
 void collect_external_stats(map<string, double> &user_latency,
                             map<string, double> &user_throughput,
+                            map<string, LatencyHistogram> &op_latency,
                             SummaryStats &ss, logger log);
 
 KeyReplication create_new_replication_vector(unsigned gm, unsigned ge,
@@ -124,16 +200,20 @@ KeyReplication create_new_replication_vector(unsigned gm, unsigned ge,
 void prepare_replication_factor_update(
     const Key &key,
     map<Address, ReplicationFactorUpdate> &replication_factor_map,
-    Address server_address, map<Key, KeyReplication> &key_replication_map);
+    Address server_address, KeyReplicationMap &key_replication_map);
 
+// Stores the requested replication factors that differ from the current ones
+// and sends each of the affected nodes, and every routing node, one update
+// with all of its changed keys. With a limit, at most that many keys change;
+// the others keep their factors until a later call asks for them again.
 void change_replication_factor(map<Key, KeyReplication> &requests,
                                GlobalRingMap &global_hash_rings,
                                LocalRingMap &local_hash_rings,
                                vector<Address> &routing_ips,
-                               map<Key, KeyReplication> &key_replication_map,
+                               KeyReplicationMap &key_replication_map,
                                SocketCache &pushers, MonitoringThread &mt,
                                zmq::socket_t &response_puller, logger log,
-                               unsigned &rid);
+                               unsigned &rid, unsigned limit = 0);
 
 void add_node(logger log, string tier, unsigned number, unsigned &adding,
               SocketCache &pushers, const Address &management_ip);
@@ -143,4 +223,16 @@ void remove_node(logger log, ServerThread &node, string tier,
                  map<Address, unsigned> &departing_node_map,
                  MonitoringThread &mt);
 
+// dereplicates the keys held by every memory node, then removes the least
+// occupied one
+void remove_memory_node(logger log, SummaryStats &ss,
+                        GlobalRingMap &global_hash_rings,
+                        LocalRingMap &local_hash_rings,
+                        KeyReplicationMap &key_replication_map,
+                        map<Key, unsigned> &key_access_summary,
+                        vector<Address> &routing_ips, SocketCache &pushers,
+                        MonitoringThread &mt, zmq::socket_t &response_puller,
+                        map<Address, unsigned> &departing_node_map,
+                        bool &removing_memory_node, unsigned &rid);
+
 #endif // KVS_INCLUDE_MONITOR_MONITORING_UTILS_HPP_
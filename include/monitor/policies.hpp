@@ -16,10 +16,16 @@
 #define KVS_INCLUDE_MONITOR_POLICIES_HPP_
 
 #include "hash_ring.hpp"
+#include "monitor/load_forecast.hpp"
 
 extern bool kEnableTiering;
 extern bool kEnableElasticity;
 extern bool kEnableSelectiveRep;
+extern bool kEnableForecast;
+
+// the most keys whose replication factors one policy changes in a monitoring
+// round (0 for no limit)
+extern unsigned kMaxReplicationChanges;
 
 void storage_policy(logger log, GlobalRingMap &global_hash_rings,
                     TimePoint &grace_start, SummaryStats &ss,
@@ -35,7 +41,7 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
                      SummaryStats &ss, unsigned &memory_node_count,
                      unsigned &ebs_node_count, unsigned &new_memory_count,
                      unsigned &new_ebs_count, Address management_ip,
-                     map<Key, KeyReplication> &key_replication_map,
+                     KeyReplicationMap &key_replication_map,
                      map<Key, unsigned> &key_access_summary,
                      map<Key, unsigned> &key_size, MonitoringThread &mt,
                      SocketCache &pushers, zmq::socket_t &response_puller,
@@ -46,11 +52,25 @@ void slo_policy(logger log, GlobalRingMap &global_hash_rings,
                 SummaryStats &ss, unsigned &memory_node_count,
                 unsigned &new_memory_count, bool &removing_memory_node,
                 Address management_ip,
-                map<Key, KeyReplication> &key_replication_map,
-                map<Key, unsigned> &key_access_summary, MonitoringThread &mt,
+                KeyReplicationMap &key_replication_map,
+                map<Key, unsigned> &key_access_summary,
+                const vector<HeavyHitter> &hot_keys, MonitoringThread &mt,
                 map<Address, unsigned> &departing_node_map,
                 SocketCache &pushers, zmq::socket_t &response_puller,
                 vector<Address> &routing_ips, unsigned &rid,
                 map<Key, std::pair<double, unsigned>> &latency_miss_ratio_map);
 
+void forecast_policy(logger log, LoadForecast &forecast,
+                     GlobalRingMap &global_hash_rings,
+                     LocalRingMap &local_hash_rings, TimePoint &grace_start,
+                     SummaryStats &ss, unsigned &memory_node_count,
+                     unsigned &new_memory_count, bool &removing_memory_node,
+                     Address management_ip,
+                     KeyReplicationMap &key_replication_map,
+                     map<Key, unsigned> &key_access_summary,
+                     MonitoringThread &mt,
+                     map<Address, unsigned> &departing_node_map,
+                     SocketCache &pushers, zmq::socket_t &response_puller,
+                     vector<Address> &routing_ips, unsigned &rid);
+
 #endif // KVS_INCLUDE_MONITOR_POLICIES_HPP_
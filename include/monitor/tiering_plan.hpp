@@ -0,0 +1,118 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_MONITOR_TIERING_PLAN_HPP_
+#define KVS_INCLUDE_MONITOR_TIERING_PLAN_HPP_
+
+#include <algorithm>
+
+#include "metadata.hpp"
+
+// a memory key is evicted for a disk key only if the disk key is at least
+// this many times denser, so that keys of similar density do not trade
+// places every epoch
+const double kEvictionDensityRatio = 2;
+
+// A key that could move between tiers, with its accesses over the servers'
+// access window and its size in bytes.
+struct TieringCandidate {
+  Key key;
+  unsigned accesses;
+  unsigned size;
+
+  // accesses per byte
+  double density() const { return (double)accesses / std::max(size, 1u); }
+};
+
+struct TieringPlan {
+  vector<Key> promote;
+  vector<Key> evict;
+
+  // the memory and EBS space the moves take up
+  unsigned long long promoted_bytes;
+  unsigned long long evicted_bytes;
+
+  // the size of the keys that would have been promoted but did not fit
+  unsigned long long unplaced_bytes;
+
+  TieringPlan() : promoted_bytes(0), evicted_bytes(0), unplaced_bytes(0) {}
+};
+
+// Chooses the disk keys to promote into free_memory bytes, as a greedy
+// knapsack by access density: the densest keys go first, and a key that does
+// not fit is passed over for smaller ones rather than ending the round. When
+// memory is short, the least dense memory keys are evicted (into at most
+// free_ebs bytes) to make room for keys kEvictionDensityRatio times denser.
+// At most max_moves keys are promoted or evicted, so that a round's migration
+// is bounded.
+inline TieringPlan plan_tiering(vector<TieringCandidate> disk_keys,
+                                vector<TieringCandidate> memory_keys,
+                                unsigned long long free_memory,
+                                unsigned long long free_ebs,
+                                unsigned max_moves) {
+  auto denser = [](const TieringCandidate &a, const TieringCandidate &b) {
+    return a.density() > b.density();
+  };
+
+  std::sort(disk_keys.begin(), disk_keys.end(), denser);
+  std::sort(memory_keys.rbegin(), memory_keys.rend(), denser);
+
+  TieringPlan plan;
+  unsigned moves = 0;
+  std::size_t next_victim = 0;
+
+  for (const TieringCandidate &candidate : disk_keys) {
+    if (moves >= max_moves) {
+      break;
+    }
+
+    // find the least dense memory keys that would make room
+    std::size_t victims = next_victim;
+    unsigned long long freed = 0;
+    unsigned long long ebs_used = 0;
+
+    while (free_memory + freed < candidate.size &&
+           victims < memory_keys.size() &&
+           memory_keys[victims].density() * kEvictionDensityRatio <
+               candidate.density() &&
+           moves + (victims - next_victim) + 1 < max_moves &&
+           plan.evicted_bytes + ebs_used + memory_keys[victims].size <=
+               free_ebs) {
+      freed += memory_keys[victims].size;
+      ebs_used += memory_keys[victims].size;
+      victims += 1;
+    }
+
+    if (free_memory + freed < candidate.size) {
+      plan.unplaced_bytes += candidate.size;
+      continue;
+    }
+
+    for (; next_victim < victims; next_victim++) {
+      plan.evict.push_back(memory_keys[next_victim].key);
+      moves += 1;
+    }
+
+    plan.evicted_bytes += ebs_used;
+    free_memory = free_memory + freed - candidate.size;
+
+    plan.promote.push_back(candidate.key);
+    plan.promoted_bytes += candidate.size;
+    moves += 1;
+  }
+
+  return plan;
+}
+
+#endif // KVS_INCLUDE_MONITOR_TIERING_PLAN_HPP_
@@ -0,0 +1,177 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_REPLICA_SELECTOR_HPP_
+#define KVS_INCLUDE_REPLICA_SELECTOR_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// the weight of a new sample in a replica's average latency
+const double kReplicaLatencyWeight = 0.2;
+
+// how long a request may go unanswered (in microseconds) before it no longer
+// counts as outstanding; it then counts as a sample of this latency instead
+const uint64_t kReplicaRequestTimeout = 10000000;
+
+// Picks which of a key's replicas a request goes to, by the power of two
+// choices: of two replicas drawn at random, the one with the lower expected
+// wait, its average latency times one more than its outstanding requests.
+// Latencies are exponentially weighted averages of the round trips of the
+// requests that were answered, and a replica with no samples yet is taken
+// to have the average latency of all of them. Requests are matched to their
+// responses by request ID.
+class ReplicaSelector {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Replica {
+    // in microseconds, 0 until the first sample
+    double latency_ = 0;
+    unsigned outstanding_ = 0;
+  };
+
+  struct Request {
+    std::string address_;
+    TimePoint sent_;
+  };
+
+  std::unordered_map<std::string, Replica> replicas_;
+
+  // the average latency over every replica, 1 until the first sample
+  double prior_ = 1;
+  bool sampled_ = false;
+
+  std::unordered_map<std::string, Request> requests_;
+
+  // the outstanding requests' IDs, oldest first, for expiring them
+  std::deque<std::pair<TimePoint, std::string>> order_;
+
+  // for the callers that bring no seed of their own, and for request IDs
+  unsigned seed_;
+  uint64_t next_id_;
+
+  static double average(double current, double latency) {
+    return (1 - kReplicaLatencyWeight) * current +
+           kReplicaLatencyWeight * latency;
+  }
+
+  void sample(Replica &replica, double latency) {
+    latency = std::max(latency, 1.0);
+    replica.latency_ =
+        replica.latency_ == 0 ? latency : average(replica.latency_, latency);
+    prior_ = sampled_ ? average(prior_, latency) : latency;
+    sampled_ = true;
+  }
+
+  // forgets the request with ID id, sampling its latency as of now
+  void finish(const std::string &id, TimePoint now) {
+    auto it = requests_.find(id);
+    if (it == requests_.end()) {
+      return;
+    }
+
+    Replica &replica = replicas_[it->second.address_];
+    replica.outstanding_ -= 1;
+    sample(replica, std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - it->second.sent_)
+                        .count());
+    requests_.erase(it);
+  }
+
+  void expire(TimePoint now) {
+    std::chrono::microseconds timeout(kReplicaRequestTimeout);
+
+    while (!order_.empty() && now - order_.front().first >= timeout) {
+      finish(order_.front().second, order_.front().first + timeout);
+      order_.pop_front();
+    }
+  }
+
+public:
+  ReplicaSelector()
+      : seed_(std::chrono::steady_clock::now().time_since_epoch().count()),
+        next_id_(0) {}
+
+  double score(const std::string &address) const {
+    auto it = replicas_.find(address);
+    if (it == replicas_.end()) {
+      return prior_;
+    }
+
+    const Replica &replica = it->second;
+    double latency = replica.latency_ > 0 ? replica.latency_ : prior_;
+    return latency * (replica.outstanding_ + 1);
+  }
+
+  // the index of the chosen one of count replicas, whose addresses
+  // address(i) gives
+  template <typename AddressOf>
+  std::size_t choose(std::size_t count, unsigned &seed, AddressOf address) {
+    std::size_t first = rand_r(&seed) % count;
+    if (count == 1) {
+      return first;
+    }
+
+    // a second replica other than the first
+    std::size_t second = (first + 1 + rand_r(&seed) % (count - 1)) % count;
+    return score(address(second)) < score(address(first)) ? second : first;
+  }
+
+  template <typename AddressOf>
+  std::size_t choose(std::size_t count, AddressOf address) {
+    return choose(count, seed_, address);
+  }
+
+  // a request ID that no other request from this selector has; the address
+  // responses go to makes it unique to the thread
+  std::string request_id(const std::string &response_address) {
+    return response_address + ":selected:" + std::to_string(next_id_++);
+  }
+
+  // records that the request with ID id went to address
+  void sent(const std::string &address, const std::string &id) {
+    TimePoint now = std::chrono::steady_clock::now();
+    expire(now);
+
+    if (id.empty() || !requests_.insert({id, Request{address, now}}).second) {
+      return;
+    }
+
+    replicas_[address].outstanding_ += 1;
+    order_.push_back({now, id});
+  }
+
+  // records the response to the request with ID id, if it was sent
+  void answered(const std::string &id) {
+    finish(id, std::chrono::steady_clock::now());
+  }
+
+  unsigned outstanding(const std::string &address) const {
+    auto it = replicas_.find(address);
+    return it == replicas_.end() ? 0 : it->second.outstanding_;
+  }
+
+  // the average latency of address, in microseconds, or 0 with no samples
+  double latency(const std::string &address) const {
+    auto it = replicas_.find(address);
+    return it == replicas_.end() ? 0 : it->second.latency_;
+  }
+};
+
+#endif // KVS_INCLUDE_REPLICA_SELECTOR_HPP_
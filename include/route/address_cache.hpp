@@ -0,0 +1,100 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_ROUTE_ADDRESS_CACHE_HPP_
+#define INCLUDE_ROUTE_ADDRESS_CACHE_HPP_
+
+#include "kvs_types.hpp"
+
+// the default number of keys a routing thread keeps addresses for
+const unsigned kDefaultAddressCacheSize = 1 << 20;
+
+// Remembers the key request addresses last computed for each key, so repeated
+// lookups skip the hash ring walk. The cache holds no state of its own: it
+// has to be invalidated whenever its inputs change, i.e., the whole cache on
+// a membership change and single keys on a replication factor change.
+//
+// The invalidations are also recorded until take_changes is called, because
+// they are exactly what clients holding a ring snapshot need to hear about.
+class AddressCache {
+  hmap<Key, vector<Address>> addresses_;
+  unsigned capacity_;
+
+  bool rings_changed_;
+  set<Key> changed_keys_;
+
+public:
+  AddressCache(unsigned capacity = kDefaultAddressCacheSize)
+      : capacity_(capacity), rings_changed_(false) {}
+
+  // returns nullptr on a miss
+  const vector<Address> *find(const Key &key) const {
+    auto it = addresses_.find(key);
+    if (it == addresses_.end()) {
+      return nullptr;
+    }
+
+    return &it->second;
+  }
+
+  void insert(const Key &key, const ServerThreadList &threads) {
+    if (capacity_ == 0) {
+      return;
+    }
+
+    // evict an arbitrary entry rather than tracking recency on every hit
+    if (addresses_.size() >= capacity_ &&
+        addresses_.find(key) == addresses_.end()) {
+      addresses_.erase(addresses_.begin());
+    }
+
+    vector<Address> &addresses = addresses_[key];
+    addresses.clear();
+    addresses.reserve(threads.size());
+
+    for (const ServerThread &thread : threads) {
+      addresses.push_back(thread.key_request_connect_address());
+    }
+  }
+
+  void invalidate(const Key &key) {
+    addresses_.erase(key);
+
+    if (!rings_changed_) {
+      changed_keys_.insert(key);
+    }
+  }
+
+  void clear() {
+    addresses_.clear();
+    rings_changed_ = true;
+    changed_keys_.clear();
+  }
+
+  bool changed() const { return rings_changed_ || !changed_keys_.empty(); }
+
+  // hands over the changes since the last call: either that the rings have
+  // changed, or the keys whose replication factor has
+  void take_changes(bool &rings_changed, set<Key> &keys) {
+    rings_changed = rings_changed_;
+    keys.swap(changed_keys_);
+
+    rings_changed_ = false;
+    changed_keys_.clear();
+  }
+
+  std::size_t size() const { return addresses_.size(); }
+};
+
+#endif // INCLUDE_ROUTE_ADDRESS_CACHE_HPP_
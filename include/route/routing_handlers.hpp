@@ -15,31 +15,52 @@
 #ifndef INCLUDE_ROUTE_ROUTING_HANDLERS_HPP_
 #define INCLUDE_ROUTE_ROUTING_HANDLERS_HPP_
 
+#include "address_cache.hpp"
 #include "hash_ring.hpp"
 #include "metadata.pb.h"
+#include "shared_routing_state.hpp"
+#include "trace.hpp"
 
 string seed_handler(logger log, GlobalRingMap &global_hash_rings);
 
 void membership_handler(logger log, string &serialized, SocketCache &pushers,
-                        GlobalRingMap &global_hash_rings, unsigned thread_id,
+                        GlobalRingMap &global_hash_rings,
+                        AddressCache &address_cache, unsigned thread_id,
                         Address ip);
 
 void replication_response_handler(
     logger log, string &serialized, SocketCache &pushers, RoutingThread &rt,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, KeyReplication> &key_replication_map,
+    KeyReplicationMap &key_replication_map, AddressCache &address_cache,
     map<Key, vector<pair<Address, string>>> &pending_requests, unsigned &seed);
 
 void replication_change_handler(logger log, string &serialized,
                                 SocketCache &pushers,
-                                map<Key, KeyReplication> &key_replication_map,
+                                KeyReplicationMap &key_replication_map,
+                                AddressCache &address_cache,
                                 unsigned thread_id, Address ip);
 
 void address_handler(logger log, string &serialized, SocketCache &pushers,
                      RoutingThread &rt, GlobalRingMap &global_hash_rings,
                      LocalRingMap &local_hash_rings,
-                     map<Key, KeyReplication> &key_replication_map,
+                     KeyReplicationMap &key_replication_map,
+                     AddressCache &address_cache,
                      map<Key, vector<pair<Address, string>>> &pending_requests,
                      unsigned &seed);
 
+string ring_snapshot_handler(logger log, string &serialized,
+                             GlobalRingMap &global_hash_rings,
+                             KeyReplicationMap &key_replication_map,
+                             unsigned long long version);
+
+// fans a key scan out to every storage thread, or answers it with no keys if
+// there are none
+void key_scan_handler(logger log, string &serialized, SocketCache &pushers,
+                      GlobalRingMap &global_hash_rings);
+
+// returns the update that takes clients from version - 1 to version
+string ring_update(GlobalRingMap &global_hash_rings,
+                   KeyReplicationMap &key_replication_map, bool rings_changed,
+                   const set<Key> &keys, unsigned long long version);
+
 #endif // INCLUDE_ROUTE_ROUTING_HANDLERS_HPP_
@@ -0,0 +1,189 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INCLUDE_ROUTE_SHARED_ROUTING_STATE_HPP_
+#define INCLUDE_ROUTE_SHARED_ROUTING_STATE_HPP_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "hash_ring.hpp"
+
+// the number of independently locked stretches of the shared replication
+// factors
+const unsigned kReplicationShardCount = 64;
+
+// The rings and the replication factors of a routing process, shared by all
+// of its threads. As with a server's SharedRings, thread 0 is the only thread
+// that applies membership changes: it keeps its own copy of the rings,
+// publishes a copy after each change and only then passes the change on, so
+// the other threads read the published copy without a lock, and never
+// rebuild rings of their own.
+//
+// A replication factor that any thread learns is kept here for the others,
+// so a key's factor is fetched once per process instead of once per thread.
+// A thread that misses on a key another thread is already asking about waits
+// for that thread to pass the response on rather than asking again. The
+// factors are split across kReplicationShardCount maps, each with its own
+// lock, which is only held to copy a single factor in or out.
+class SharedRoutingState {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Request {
+    TimePoint sent_;
+
+    // the threads that wait on the response, including the one that asked
+    set<unsigned> waiting_;
+  };
+
+  struct Shard {
+    std::mutex mutex_;
+    hmap<Key, KeyReplication> replication_;
+    hmap<Key, Request> requests_;
+  };
+
+  std::shared_ptr<GlobalRingMap> global_;
+  Shard shards_[kReplicationShardCount];
+
+  // how long a request is waited on before another thread may ask again, in
+  // milliseconds
+  unsigned request_timeout_;
+
+  Shard &shard(const Key &key) {
+    return shards_[std::hash<Key>()(key) % kReplicationShardCount];
+  }
+
+public:
+  explicit SharedRoutingState(
+      unsigned request_timeout = kReplicationRequestTimeout)
+      : request_timeout_(request_timeout) {}
+
+  // every tier is created in the published copy, so that the threads reading
+  // it only ever find tiers and never insert into a map they share
+  void publish(const GlobalRingMap &global) {
+    std::shared_ptr<GlobalRingMap> published =
+        std::make_shared<GlobalRingMap>(global);
+
+    for (const Tier &tier : kAllTiers) {
+      (*published)[tier];
+    }
+
+    std::atomic_store(&global_, published);
+  }
+
+  // the latest global rings; callers must not modify them
+  std::shared_ptr<GlobalRingMap> global() const {
+    return std::atomic_load(&global_);
+  }
+
+  // copies key's replication factor into replication, if a thread has
+  // learned it
+  bool find(const Key &key, KeyReplication &replication) {
+    Shard &s = shard(key);
+    std::unique_lock<std::mutex> lock(s.mutex_);
+
+    auto it = s.replication_.find(key);
+    if (it == s.replication_.end()) {
+      return false;
+    }
+
+    replication = it->second;
+    return true;
+  }
+
+  void update(const Key &key, const KeyReplication &replication) {
+    Shard &s = shard(key);
+    std::unique_lock<std::mutex> lock(s.mutex_);
+
+    // each shard holds its part of what a thread's own map may
+    if (s.replication_.size() >=
+            kDefaultReplicationCacheSize / kReplicationShardCount &&
+        s.replication_.find(key) == s.replication_.end()) {
+      s.replication_.erase(s.replication_.begin());
+    }
+
+    s.replication_[key] = replication;
+  }
+
+  // records that thread_id waits on key's replication factor; returns true
+  // if the thread should ask for it, i.e., if no other thread's request is
+  // in flight or the one in flight has timed out
+  bool start_request(const Key &key, unsigned thread_id) {
+    Shard &s = shard(key);
+    std::unique_lock<std::mutex> lock(s.mutex_);
+
+    TimePoint now = std::chrono::steady_clock::now();
+    auto result = s.requests_.insert({key, Request()});
+    Request &request = result.first->second;
+    request.waiting_.insert(thread_id);
+
+    if (!result.second &&
+        now - request.sent_ < std::chrono::milliseconds(request_timeout_)) {
+      return false;
+    }
+
+    request.sent_ = now;
+    return true;
+  }
+
+  // forgets the request for key and returns the threads that waited on it
+  set<unsigned> finish_request(const Key &key) {
+    Shard &s = shard(key);
+    std::unique_lock<std::mutex> lock(s.mutex_);
+
+    set<unsigned> waiting;
+    auto it = s.requests_.find(key);
+
+    if (it != s.requests_.end()) {
+      waiting.swap(it->second.waiting_);
+      s.requests_.erase(it);
+    }
+
+    return waiting;
+  }
+};
+
+// Set in the routing node's main; null where threads keep their own state,
+// as in the handler tests.
+extern SharedRoutingState *kSharedRoutingState;
+
+// whether thread_id reads the rings thread 0 publishes rather than applying
+// membership changes itself
+inline bool reads_shared_routing_state(unsigned thread_id) {
+  return kSharedRoutingState != nullptr && thread_id != 0;
+}
+
+// makes sure key_replication_map holds key's replication factor if any
+// thread has learned it; returns false if none has and another thread is
+// already asking for it, in which case that thread passes the response on to
+// thread_id
+inline bool share_replication(const Key &key,
+                              KeyReplicationMap &key_replication_map,
+                              unsigned thread_id) {
+  if (kSharedRoutingState == nullptr || is_metadata(key) ||
+      key_replication_map.find(key) != key_replication_map.end()) {
+    return true;
+  }
+
+  KeyReplication replication;
+  if (kSharedRoutingState->find(key, replication)) {
+    key_replication_map[key] = replication;
+    return true;
+  }
+
+  return kSharedRoutingState->start_request(key, thread_id);
+}
+
+#endif // INCLUDE_ROUTE_SHARED_ROUTING_STATE_HPP_
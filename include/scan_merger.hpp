@@ -0,0 +1,90 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_SCAN_MERGER_HPP_
+#define KVS_INCLUDE_SCAN_MERGER_HPP_
+
+#include <algorithm>
+
+#include "kvs_common.hpp"
+
+// Merges the answers of the storage threads a key scan was fanned out to
+// into one page. Each thread answers with its own keys in the range, in
+// order and up to the limit; a key stored on several replicas comes from
+// each of them. A thread that had more keys than the limit only says where
+// it stopped, so the page ends at the first of those stopping points: past
+// it, the keys of that thread are missing. The page is then cut to the
+// limit, and a scan that continues from its last key (start is exclusive)
+// misses nothing and repeats nothing.
+class ScanMerger {
+  unsigned limit_;
+
+  // the number of threads that answer, known from the first answer
+  unsigned expected_;
+  unsigned received_;
+
+  vector<Key> keys_;
+
+  // the least last key of the threads with more keys, if there are any
+  bool bounded_;
+  Key bound_;
+
+public:
+  explicit ScanMerger(unsigned limit)
+      : limit_(limit == 0 ? kMaxScanPage : std::min(limit, kMaxScanPage)),
+        expected_(0), received_(0), bounded_(false) {}
+
+  // adds one thread's answer; returns whether every thread has answered
+  bool add(const KeyScanResponse &response) {
+    expected_ = response.shard_count();
+    received_ += 1;
+
+    keys_.insert(keys_.end(), response.keys().begin(), response.keys().end());
+
+    if (response.more() && response.keys_size() > 0) {
+      const Key &last = response.keys(response.keys_size() - 1);
+      if (!bounded_ || last < bound_) {
+        bound_ = last;
+        bounded_ = true;
+      }
+    }
+
+    return complete();
+  }
+
+  // a scan with no threads to send to is answered once, with a count of 0
+  bool complete() const { return received_ > 0 && received_ >= expected_; }
+
+  // the merged page, and whether the range has keys after it
+  void page(vector<Key> &keys, bool &more) {
+    std::sort(keys_.begin(), keys_.end());
+    keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+
+    more = bounded_;
+    if (bounded_) {
+      keys_.erase(std::upper_bound(keys_.begin(), keys_.end(), bound_),
+                  keys_.end());
+    }
+
+    if (keys_.size() > limit_) {
+      keys_.resize(limit_);
+      more = true;
+    }
+
+    keys = std::move(keys_);
+    keys_.clear();
+  }
+};
+
+#endif // KVS_INCLUDE_SCAN_MERGER_HPP_
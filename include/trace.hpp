@@ -0,0 +1,196 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_TRACE_HPP_
+#define KVS_INCLUDE_TRACE_HPP_
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "common.hpp"
+#include "metadata.pb.h"
+
+// the first two bytes of every traced message: the tag of TracedMessage's
+// trace field (number 1000, length-delimited) as a varint; the fields of
+// KeyRequest and KeyAddressRequest all have one-byte tags below 0x80
+const unsigned char kTraceTag[] = {0xC2, 0x3E};
+
+// microseconds since the Unix epoch; spans from different machines are lined
+// up by wall-clock time
+inline uint64_t trace_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// The trace a request belongs to, if it is sampled.
+struct Trace {
+  // 0 if the request is not traced
+  uint64_t trace_id = 0;
+  uint64_t parent_span_id = 0;
+
+  // when the request was sent (0 if it was not traced), as a trace_time
+  uint64_t sent = 0;
+
+  bool sampled() const { return trace_id != 0; }
+};
+
+// reads the trace context in front of serialized, if there is one; checking
+// an untraced message costs a two-byte comparison
+inline Trace read_trace(const string &serialized) {
+  Trace trace;
+
+  if (serialized.size() < 2 ||
+      static_cast<unsigned char>(serialized[0]) != kTraceTag[0] ||
+      static_cast<unsigned char>(serialized[1]) != kTraceTag[1]) {
+    return trace;
+  }
+
+  TracedMessage traced;
+  traced.ParseFromString(serialized);
+
+  trace.trace_id = traced.trace().trace_id();
+  trace.parent_span_id = traced.trace().parent_span_id();
+  trace.sent = traced.trace().sent();
+  return trace;
+}
+
+// puts a context of trace_id in front of serialized, naming span_id as the
+// parent of the receiver's spans
+inline void write_trace(uint64_t trace_id, uint64_t span_id,
+                        string &serialized) {
+  TracedMessage traced;
+  TraceContext *context = traced.mutable_trace();
+  context->set_trace_id(trace_id);
+  context->set_parent_span_id(span_id);
+  context->set_sent(trace_time());
+
+  serialized.insert(0, traced.SerializeAsString());
+}
+
+// a random trace or span ID; never 0
+inline uint64_t new_span_id(unsigned &seed) {
+  uint64_t id = 0;
+  while (id == 0) {
+    // rand_r yields at least 15 random bits per call
+    for (unsigned i = 0; i < 5; i++) {
+      id = (id << 15) ^ (rand_r(&seed) & 0x7FFF);
+    }
+  }
+
+  return id;
+}
+
+inline string span_id_hex(uint64_t id) {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)id);
+  return hex;
+}
+
+inline string json_escape(const string &text) {
+  string escaped;
+
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c < 0x20) {
+      char code[7];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+
+  return escaped;
+}
+
+// Decides which requests are traced and writes their spans to a log, one
+// Zipkin v2 JSON span per line. Requests that arrive with a trace context are
+// always traced; others start a trace of their own with probability
+// fraction, so that requests from clients that do not trace are still
+// sampled at their first hop. One Tracer is shared by every thread of a
+// process.
+class Tracer {
+  double fraction_;
+  string service_;
+  Address ip_;
+  logger log_;
+
+public:
+  Tracer(double fraction, const string &service, const Address &ip,
+         logger log)
+      : fraction_(fraction), service_(service), ip_(ip), log_(log) {}
+
+  // returns whether trace is sampled, first starting a new trace with
+  // probability fraction_ if it is not
+  bool sample(Trace &trace, unsigned &seed) {
+    if (!trace.sampled() && fraction_ > 0 &&
+        rand_r(&seed) / (RAND_MAX + 1.0) < fraction_) {
+      trace.trace_id = new_span_id(seed);
+    }
+
+    return trace.sampled();
+  }
+
+  // records span span_id of trace, from start to end (trace_times), with the
+  // given events (a trace_time and a name each) and tags
+  void record(const Trace &trace, uint64_t span_id, const string &name,
+              uint64_t start, uint64_t end,
+              const vector<std::pair<uint64_t, string>> &events = {},
+              const map<string, string> &tags = {}) {
+    string span = "{\"traceId\":\"" + span_id_hex(trace.trace_id) +
+                  "\",\"id\":\"" + span_id_hex(span_id) + "\"";
+
+    if (trace.parent_span_id != 0) {
+      span += ",\"parentId\":\"" + span_id_hex(trace.parent_span_id) + "\"";
+    }
+
+    span += ",\"name\":\"" + json_escape(name) +
+            "\",\"kind\":\"SERVER\",\"timestamp\":" + std::to_string(start) +
+            ",\"duration\":" + std::to_string(end - start) +
+            ",\"localEndpoint\":{\"serviceName\":\"" + json_escape(service_) +
+            "\",\"ipv4\":\"" + json_escape(ip_) + "\"}";
+
+    if (events.size() > 0) {
+      span += ",\"annotations\":[";
+      for (unsigned i = 0; i < events.size(); i++) {
+        span += (i > 0 ? ",{\"timestamp\":" : "{\"timestamp\":") +
+                std::to_string(events[i].first) + ",\"value\":\"" +
+                json_escape(events[i].second) + "\"}";
+      }
+      span += "]";
+    }
+
+    if (tags.size() > 0) {
+      span += ",\"tags\":{";
+      bool first = true;
+      for (const auto &tag : tags) {
+        span += (first ? "\"" : ",\"") + json_escape(tag.first) + "\":\"" +
+                json_escape(tag.second) + "\"";
+        first = false;
+      }
+      span += "}";
+    }
+
+    log_->info("{}}}", span);
+  }
+};
+
+// the tracer of this process; null unless tracing is enabled
+extern Tracer *kTracer;
+
+#endif // KVS_INCLUDE_TRACE_HPP_
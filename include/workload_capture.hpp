@@ -0,0 +1,337 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_WORKLOAD_CAPTURE_HPP_
+#define KVS_INCLUDE_WORKLOAD_CAPTURE_HPP_
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+#include "anna.pb.h"
+#include "common.hpp"
+
+// A captured workload is a file that starts with kCaptureMagic and the wall
+// clock time of the capture's start, in microseconds since the Unix epoch, as
+// eight little-endian bytes. Each request follows as
+//
+//   varint  microseconds since the previous request (or the start)
+//   byte    request type
+//   varint  number of tuples, then per tuple:
+//     8 bytes  the key's hash, little-endian
+//     byte     lattice type
+//     varint   payload size in bytes
+//
+// Keys are only kept as hashes, so a capture holds no user keys or values,
+// but the same key has the same hash in every capture.
+const string kCaptureMagic = "ANNAWLC1";
+
+// the hash that stands in for key in a capture; 64-bit FNV-1a, so that it is
+// the same on every machine and in every build
+inline uint64_t capture_key_hash(const Key &key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : key) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+struct CapturedTuple {
+  uint64_t key_hash;
+  LatticeType lattice_type;
+  unsigned size;
+};
+
+struct CapturedRequest {
+  // microseconds since the capture started
+  uint64_t time;
+  RequestType type;
+  vector<CapturedTuple> tuples;
+};
+
+inline void put_varint(uint64_t value, string &out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+
+  out.push_back(static_cast<char>(value));
+}
+
+// reads a varint at pos and advances pos past it; returns false if data ends
+// first
+inline bool get_varint(const string &data, std::size_t &pos,
+                       uint64_t &value) {
+  value = 0;
+
+  for (unsigned shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+    unsigned char byte = data[pos++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline void put_fixed64(uint64_t value, string &out) {
+  for (unsigned i = 0; i < 8; i++) {
+    out.push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+inline bool get_fixed64(const string &data, std::size_t &pos,
+                        uint64_t &value) {
+  if (data.size() - pos < 8) {
+    return false;
+  }
+
+  value = 0;
+  for (unsigned i = 0; i < 8; i++) {
+    value |= (uint64_t)(unsigned char)data[pos + i] << (8 * i);
+  }
+
+  pos += 8;
+  return true;
+}
+
+// appends the record of request, delta microseconds after the one before
+inline void encode_captured_request(uint64_t delta,
+                                    const CapturedRequest &request,
+                                    string &out) {
+  put_varint(delta, out);
+  out.push_back(static_cast<char>(request.type));
+  put_varint(request.tuples.size(), out);
+
+  for (const CapturedTuple &tuple : request.tuples) {
+    put_fixed64(tuple.key_hash, out);
+    out.push_back(static_cast<char>(tuple.lattice_type));
+    put_varint(tuple.size, out);
+  }
+}
+
+// reads the record at pos into request, whose time is the previous
+// request's time plus the record's delta; returns false, leaving pos where
+// it was, if the record is incomplete
+inline bool decode_captured_request(const string &data, std::size_t &pos,
+                                    CapturedRequest &request) {
+  std::size_t start = pos;
+  uint64_t delta, count;
+
+  if (!get_varint(data, pos, delta) || pos >= data.size()) {
+    pos = start;
+    return false;
+  }
+
+  RequestType type = static_cast<RequestType>((unsigned char)data[pos++]);
+  if (!get_varint(data, pos, count)) {
+    pos = start;
+    return false;
+  }
+
+  vector<CapturedTuple> tuples(count);
+  for (CapturedTuple &tuple : tuples) {
+    uint64_t size;
+    if (!get_fixed64(data, pos, tuple.key_hash) || pos >= data.size()) {
+      pos = start;
+      return false;
+    }
+
+    tuple.lattice_type =
+        static_cast<LatticeType>((unsigned char)data[pos++]);
+    if (!get_varint(data, pos, size)) {
+      pos = start;
+      return false;
+    }
+
+    tuple.size = size;
+  }
+
+  request.time += delta;
+  request.type = type;
+  request.tuples = std::move(tuples);
+  return true;
+}
+
+// Records the requests a process receives to a capture file. Only the tuples
+// of a sampled fraction of the keys are kept, chosen by their hash, so that
+// every access to a sampled key is in the capture, and requests with no
+// sampled tuples are left out. One recorder is shared by every thread of a
+// process; records are buffered and written out a block at a time, or once
+// a second has passed.
+class WorkloadRecorder {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  // the buffer is written out once it reaches this many bytes
+  static const unsigned kBlockSize = 64 * 1024;
+
+  std::FILE *file_;
+  double fraction_;
+
+  std::mutex mutex_;
+  string buffer_;
+  TimePoint last_;
+  TimePoint flushed_;
+
+  void write() {
+    if (file_ != nullptr && buffer_.size() > 0) {
+      std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+      std::fflush(file_);
+    }
+
+    buffer_.clear();
+  }
+
+public:
+  WorkloadRecorder(const string &path, double fraction)
+      : fraction_(fraction) {
+    file_ = std::fopen(path.c_str(), "wb");
+
+    uint64_t start =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    buffer_ = kCaptureMagic;
+    put_fixed64(start, buffer_);
+
+    last_ = flushed_ = std::chrono::steady_clock::now();
+    write();
+  }
+
+  ~WorkloadRecorder() {
+    flush();
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+  }
+
+  // whether the capture file could be opened
+  bool open() const { return file_ != nullptr; }
+
+  bool sampled(uint64_t key_hash) const {
+    return (key_hash >> 11) * (1.0 / (1ULL << 53)) < fraction_;
+  }
+
+  void record(const KeyRequest &request) {
+    CapturedRequest captured;
+    captured.type = request.type();
+
+    for (const KeyTuple &tuple : request.tuples()) {
+      uint64_t hash = capture_key_hash(tuple.key());
+      if (sampled(hash)) {
+        captured.tuples.push_back(
+            {hash, tuple.lattice_type(), (unsigned)tuple.payload().size()});
+      }
+    }
+
+    if (captured.tuples.empty()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    TimePoint now = std::chrono::steady_clock::now();
+    uint64_t delta =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - last_)
+            .count();
+    last_ = now;
+
+    encode_captured_request(delta, captured, buffer_);
+
+    if (buffer_.size() >= kBlockSize ||
+        now - flushed_ >= std::chrono::seconds(1)) {
+      write();
+      flushed_ = now;
+    }
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write();
+  }
+};
+
+// Reads a capture file written by a WorkloadRecorder one request at a time.
+class WorkloadReader {
+  std::FILE *file_;
+  string buffer_;
+  std::size_t pos_;
+  bool valid_;
+  uint64_t start_;
+  CapturedRequest last_;
+
+  // reads more of the file into the buffer; returns false at its end
+  bool fill() {
+    buffer_.erase(0, pos_);
+    pos_ = 0;
+
+    char block[64 * 1024];
+    std::size_t read = std::fread(block, 1, sizeof(block), file_);
+    buffer_.append(block, read);
+    return read > 0;
+  }
+
+public:
+  explicit WorkloadReader(const string &path)
+      : pos_(0), valid_(false), start_(0) {
+    file_ = std::fopen(path.c_str(), "rb");
+    last_.time = 0;
+
+    if (file_ == nullptr) {
+      return;
+    }
+
+    while (buffer_.size() < kCaptureMagic.size() + 8 && fill()) {
+    }
+
+    valid_ = buffer_.compare(0, kCaptureMagic.size(), kCaptureMagic) == 0;
+    pos_ = kCaptureMagic.size();
+    valid_ = valid_ && get_fixed64(buffer_, pos_, start_);
+  }
+
+  ~WorkloadReader() {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+  }
+
+  // whether the file is a capture
+  bool valid() const { return valid_; }
+
+  // the wall clock time the capture started, in microseconds
+  uint64_t start() const { return start_; }
+
+  // reads the next request; returns false at the end of the capture
+  bool next(CapturedRequest &request) {
+    if (!valid_) {
+      return false;
+    }
+
+    while (!decode_captured_request(buffer_, pos_, last_)) {
+      if (!fill()) {
+        return false;
+      }
+    }
+
+    request = last_;
+    return true;
+  }
+};
+
+// the recorder of this process; null unless workload capture is enabled
+extern WorkloadRecorder *kWorkloadRecorder;
+
+#endif // KVS_INCLUDE_WORKLOAD_CAPTURE_HPP_
@@ -0,0 +1,106 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef KVS_INCLUDE_ZIPF_SAMPLER_HPP_
+#define KVS_INCLUDE_ZIPF_SAMPLER_HPP_
+
+#include <cmath>
+#include <cstdlib>
+
+// Draws ranks 1 to n, rank k with probability proportional to k^-exponent,
+// by rejection-inversion (Hormann and Derflinger, "Rejection-inversion to
+// generate variates from monotone discrete distributions", 1996). Sampling
+// takes a constant expected number of steps (well under two iterations for
+// any exponent), and the sampler keeps no per-rank state, so its cost does
+// not depend on n.
+class ZipfSampler {
+  unsigned long long n_;
+  double exponent_;
+
+  double h_integral_x1_;
+  double h_integral_n_;
+  double s_;
+
+  // log1p(x) / x, accurate near 0
+  static double helper1(double x) {
+    if (std::fabs(x) > 1e-8) {
+      return std::log1p(x) / x;
+    }
+
+    return 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+  }
+
+  // expm1(x) / x, accurate near 0
+  static double helper2(double x) {
+    if (std::fabs(x) > 1e-8) {
+      return std::expm1(x) / x;
+    }
+
+    return 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+  }
+
+  // x^-exponent_
+  double h(double x) const { return std::exp(-exponent_ * std::log(x)); }
+
+  // an antiderivative of h
+  double h_integral(double x) const {
+    double log_x = std::log(x);
+    return helper2((1 - exponent_) * log_x) * log_x;
+  }
+
+  double h_integral_inverse(double x) const {
+    double t = x * (1 - exponent_);
+    if (t < -1) {
+      // rounding errors can push t below -1 when x approaches its bound
+      t = -1;
+    }
+
+    return std::exp(helper1(t) * x);
+  }
+
+public:
+  ZipfSampler(unsigned long long n = 1, double exponent = 1)
+      : n_(n < 1 ? 1 : n), exponent_(exponent) {
+    h_integral_x1_ = h_integral(1.5) - 1;
+    h_integral_n_ = h_integral(n_ + 0.5);
+    s_ = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+  }
+
+  // seed is advanced with rand_r, like the rest of the benchmark's
+  // per-thread randomness
+  unsigned long long sample(unsigned &seed) const {
+    while (true) {
+      double uniform = rand_r(&seed) / (RAND_MAX + 1.0);
+      double u = h_integral_n_ + uniform * (h_integral_x1_ - h_integral_n_);
+      double x = h_integral_inverse(u);
+
+      unsigned long long k = x + 0.5;
+      if (k < 1) {
+        k = 1;
+      } else if (k > n_) {
+        k = n_;
+      }
+
+      if (k - x <= s_ || u >= h_integral(k + 0.5) - h(k)) {
+        return k;
+      }
+    }
+  }
+
+  unsigned long long n() const { return n_; }
+
+  double exponent() const { return exponent_; }
+};
+
+#endif // KVS_INCLUDE_ZIPF_SAMPLER_HPP_
@@ -14,7 +14,7 @@
 #  See the License for the specific language governing permissions and
 #  limitations under the License.
 
-args=( -j -b -t )
+args=( -j -b -t -m )
 containsElement() {
   local e match="$1"
   shift
@@ -22,7 +22,7 @@ containsElement() {
   return 1
 }
 
-while getopts ":j:b:tg" opt; do
+while getopts ":j:b:tmg" opt; do
   case $opt in
    j )
      MAKE_THREADS=$OPTARG
@@ -48,6 +48,10 @@ while getopts ":j:b:tg" opt; do
      TEST="-DBUILD_TEST=ON"
      echo "Testing enabled..."
      ;;
+   m )
+     MICROBENCH="-DBUILD_MICROBENCH=ON"
+     echo "Microbenchmarks enabled..."
+     ;;
    g )
      COMPILER="/usr/bin/g++"
      RUN_FORMAT=""
@@ -63,6 +67,7 @@ done
 if [[ -z "$MAKE_THREADS" ]]; then MAKE_THREADS=2; fi
 if [[ -z "$TYPE" ]]; then TYPE=Release; fi
 if [[ -z "$TEST" ]]; then TEST=""; fi
+if [[ -z "$MICROBENCH" ]]; then MICROBENCH=""; fi
 if [[ -z "$COMPILER" ]]; then
   COMPILER="/usr/bin/clang++"
   RUN_FORMAT="yes"
@@ -72,7 +77,7 @@ rm -rf build
 mkdir build
 cd build
 
-cmake -std=c++11 "-GUnix Makefiles" -DCMAKE_BUILD_TYPE=$TYPE -DCMAKE_CXX_COMPILER=$COMPILER $TEST ..
+cmake -std=c++11 "-GUnix Makefiles" -DCMAKE_BUILD_TYPE=$TYPE -DCMAKE_CXX_COMPILER=$COMPILER $TEST $MICROBENCH ..
 
 make -j${MAKE_THREADS}
 
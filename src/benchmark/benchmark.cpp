@@ -12,12 +12,17 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include <fstream>
 #include <stdlib.h>
 
 #include "benchmark.pb.h"
-#include "client/kvs_client.hpp"
+#include "benchmark/replay.hpp"
+#include "benchmark/workload.hpp"
+#include "client/async_client.hpp"
 #include "kvs_threads.hpp"
+#include "latency_histogram.hpp"
 #include "yaml-cpp/yaml.h"
+#include "zipf_sampler.hpp"
 
 unsigned kBenchmarkThreadNum;
 unsigned kRoutingThreadCount;
@@ -26,67 +31,168 @@ unsigned kDefaultLocalReplication;
 ZmqUtil zmq_util;
 ZmqUtilInterface *kZmqUtil = &zmq_util;
 
-double get_base(unsigned N, double skew) {
-  double base = 0;
-  for (unsigned k = 1; k <= N; k++) {
-    base += pow(k, -1 * skew);
+string generate_key(unsigned n) {
+  return string(8 - std::to_string(n).length(), '0') + std::to_string(n);
+}
+
+// a sampler of ranks 1 to num_keys with Zipf coefficient zipf; a zipf of 0
+// means uniform keys, which next_key draws without the sampler
+ZipfSampler prepare_keys(unsigned num_keys, double zipf, logger log) {
+  if (zipf > 0) {
+    log->info("Zipf coefficient is {}.", zipf);
+    return ZipfSampler(num_keys, zipf);
   }
-  return (1 / base);
+
+  log->info("Using a uniform random distribution.");
+  return ZipfSampler(num_keys, 0);
 }
 
-double get_zipf_prob(unsigned rank, double skew, double base) {
-  return pow(rank, -1 * skew) / base;
+Key next_key(const ZipfSampler &sampler, unsigned &seed) {
+  unsigned k;
+  if (sampler.exponent() > 0) {
+    k = sampler.sample(seed);
+  } else {
+    k = rand_r(&seed) % sampler.n() + 1;
+  }
+
+  return generate_key(k);
 }
 
-void receive(KvsClientInterface *client) {
-  vector<KeyResponse> responses = client->receive_async();
-  while (responses.size() == 0) {
-    responses = client->receive_async();
+// the name of key k of a workload with keys initial keys; inserted keys are
+// qualified by the client that inserted them, so clients do not overwrite
+// each other's inserts
+Key workload_key(unsigned long long k, unsigned long long keys,
+                 const string &uid) {
+  if (k <= keys) {
+    return generate_key(k);
   }
+
+  return generate_key(k) + "_" + uid;
 }
 
-int sample(int n, unsigned &seed, double base,
-           map<unsigned, double> &sum_probs) {
-  double z;           // Uniform random number (0 < z < 1)
-  int zipf_value;     // Computed exponential value to be returned
-  int i;              // Loop counter
-  int low, high, mid; // Binary-search bounds
-
-  // Pull a uniform random number (0 < z < 1)
-  do {
-    z = rand_r(&seed) / static_cast<double>(RAND_MAX);
-  } while ((z == 0) || (z == 1));
-
-  // Map z to the value
-  low = 1, high = n;
-
-  do {
-    mid = floor((low + high) / 2);
-    if (sum_probs[mid] >= z && sum_probs[mid - 1] < z) {
-      zipf_value = mid;
-      break;
-    } else if (sum_probs[mid] >= z) {
-      high = mid - 1;
-    } else {
-      low = mid + 1;
-    }
-  } while (low <= high);
+// a value of the workload's lattice type and a size drawn from its value
+// size distribution; set values are drawn from 16 elements, so that sets do
+// not grow without bound, and causal values advance this client's entry in
+// the vector clock
+string workload_value(const Workload &workload, unsigned &seed,
+                      unsigned thread_id, const string &uid,
+                      unsigned &version, LatticeType &type) {
+  string value(workload.value_size(seed), 'a');
+
+  if (workload.lattice == WorkloadLattice::SET) {
+    string element = std::to_string(rand_r(&seed) % 16);
+    value.replace(0, std::min(element.size(), value.size()), element);
+
+    type = LatticeType::SET;
+    return serialize(SetLattice<string>(set<string>({value})));
+  } else if (workload.lattice == WorkloadLattice::CAUSAL) {
+    MultiKeyCausalPayload<SetLattice<string>> payload;
+    version += 1;
+    payload.vector_clock.insert(uid, version);
+    payload.value.insert(value);
+
+    type = LatticeType::MULTI_CAUSAL;
+    return serialize(MultiKeyCausalLattice<SetLattice<string>>(payload));
+  }
 
-  // Assert that zipf_value is between 1 and N
-  assert((zipf_value >= 1) && (zipf_value <= n));
+  LWWPairLattice<string> val(
+      TimestampValuePair<string>(generate_timestamp(thread_id), value));
 
-  return zipf_value;
+  type = LatticeType::LWW;
+  return serialize(val);
 }
 
-string generate_key(unsigned n) {
-  return string(8 - std::to_string(n).length(), '0') + std::to_string(n);
+// sends feedback to the monitoring threads and, if report_address is set, to
+// the benchmark driver that is collecting this thread's results
+void send_feedback(const UserFeedback &feedback,
+                   const vector<MonitoringThread> &monitoring_threads,
+                   const Address &report_address, SocketCache &pushers) {
+  string serialized_latency;
+  feedback.SerializeToString(&serialized_latency);
+
+  for (const MonitoringThread &thread : monitoring_threads) {
+    kZmqUtil->send_string(serialized_latency,
+                          &pushers[thread.feedback_report_connect_address()]);
+  }
+
+  if (!report_address.empty()) {
+    kZmqUtil->send_string(serialized_latency, &pushers[report_address]);
+  }
+}
+
+// tells the benchmark driver, if there is one, that a command which reports
+// nothing to the monitoring threads has finished
+void report_finish(const string &uid, const Address &report_address,
+                   SocketCache &pushers) {
+  UserFeedback feedback;
+  feedback.set_uid(uid);
+  feedback.set_finish(true);
+
+  send_feedback(feedback, {}, report_address, pushers);
+}
+
+double microseconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now() - start)
+      .count();
+}
+
+// logs the latencies of every request type recorded in histograms during
+// this epoch, appends them to csv, adds them to feedback, and clears them;
+// returns the mean latency over all request types
+double report_latencies(unsigned epoch,
+                        map<string, LatencyHistogram> &histograms,
+                        std::ofstream &csv, UserFeedback &feedback,
+                        logger log) {
+  LatencyHistogram all;
+
+  for (auto &pair : histograms) {
+    LatencyHistogram &histogram = pair.second;
+    if (histogram.total() == 0) {
+      continue;
+    }
+
+    all.merge(histogram);
+
+    double p50 = histogram.percentile(0.5);
+    double p99 = histogram.percentile(0.99);
+    double p999 = histogram.percentile(0.999);
+
+    log->info("[Epoch {}] {} latency is p50 {} us, p99 {} us, p99.9 {} us, "
+              "max {} us over {} requests.",
+              epoch, pair.first, p50, p99, p999, histogram.max(),
+              histogram.total());
+
+    csv << epoch << "," << pair.first << "," << histogram.total() << ","
+        << histogram.mean() << "," << p50 << "," << histogram.percentile(0.9)
+        << "," << p99 << "," << p999 << "," << histogram.max() << std::endl;
+
+    UserFeedback_OpLatency *op = feedback.add_op_latency();
+    op->set_op(pair.first);
+    op->set_precision_bits(kHistogramPrecisionBits);
+    op->set_p50(p50);
+    op->set_p99(p99);
+    op->set_p999(p999);
+
+    const vector<uint64_t> &counts = histogram.counts();
+    for (unsigned i = 0; i < counts.size(); i++) {
+      if (counts[i] > 0) {
+        op->add_buckets(i);
+        op->add_counts(counts[i]);
+      }
+    }
+
+    histogram.clear();
+  }
+
+  return all.mean();
 }
 
 void run(const unsigned &thread_id,
          const vector<UserRoutingThread> &routing_threads,
          const vector<MonitoringThread> &monitoring_threads,
          const Address &ip) {
-  KvsClient client(routing_threads, ip, thread_id, 10000);
+  AsyncKvsClient client(routing_threads, ip, thread_id, 10000);
   string log_file = "log_" + std::to_string(thread_id) + ".txt";
   string logger_name = "benchmark_log_" + std::to_string(thread_id);
   auto log = spdlog::basic_logger_mt(logger_name, log_file, true);
@@ -98,6 +204,12 @@ void run(const unsigned &thread_id,
   // observed per-key avg latency
   map<Key, std::pair<double, unsigned>> observed_latency;
 
+  // the latencies of each request type in the current epoch, which are
+  // also written to a CSV file per thread
+  map<string, LatencyHistogram> histograms;
+  std::ofstream latency_csv("latency_" + std::to_string(thread_id) + ".csv");
+  latency_csv << "epoch,op,count,mean,p50,p90,p99,p99.9,max" << std::endl;
+
   // responsible for pulling benchmark commands
   zmq::context_t &context = *(client.get_context());
   SocketCache pushers(&context, ZMQ_PUSH);
@@ -108,6 +220,11 @@ void run(const unsigned &thread_id,
   vector<zmq::pollitem_t> pollitems = {
       {static_cast<void *>(command_puller), 0, ZMQ_POLLIN, 0}};
 
+  // where to send results, if a benchmark driver is collecting them; set by
+  // the REPORT command
+  Address report_address;
+  string uid = ip + ":" + std::to_string(thread_id);
+
   while (true) {
     kZmqUtil->poll(-1, &pollitems);
 
@@ -119,7 +236,15 @@ void run(const unsigned &thread_id,
       split(msg, ':', v);
       string mode = v[0];
 
-      if (mode == "CACHE") {
+      if (mode == "REPORT") {
+        if (v.size() > 1) {
+          report_address = get_benchmark_report_address(v[1]);
+          log->info("Reporting results to {}.", report_address);
+        } else {
+          report_address = "";
+          log->info("Stopped reporting results.");
+        }
+      } else if (mode == "CACHE") {
         unsigned num_keys = stoi(v[1]);
         // warm up cache
         client.clear_cache();
@@ -130,13 +255,21 @@ void run(const unsigned &thread_id,
             log->info("Warming up cache for key {}.", i);
           }
 
-          client.get_async(generate_key(i));
+          // only the addresses matter, so the answers are not waited on
+          // beyond keeping a bounded number of GETs outstanding
+          client.get(generate_key(i), nullptr);
+          if (client.outstanding() >= kClientMaxRequestTuples) {
+            client.poll(-1);
+          }
         }
 
+        client.wait();
+
         auto warmup_time = std::chrono::duration_cast<std::chrono::seconds>(
                                std::chrono::system_clock::now() - warmup_start)
                                .count();
         log->info("Cache warm-up took {} seconds.", warmup_time);
+        report_finish(uid, report_address, pushers);
       } else if (mode == "LOAD") {
         string type = v[1];
         unsigned num_keys = stoi(v[2]);
@@ -145,20 +278,7 @@ void run(const unsigned &thread_id,
         unsigned time = stoi(v[5]);
         double zipf = stod(v[6]);
 
-        map<unsigned, double> sum_probs;
-        double base;
-
-        if (zipf > 0) {
-          log->info("Zipf coefficient is {}.", zipf);
-          base = get_base(num_keys, zipf);
-          sum_probs[0] = 0;
-
-          for (unsigned i = 1; i <= num_keys; i++) {
-            sum_probs[i] = sum_probs[i - 1] + base / pow((double)i, zipf);
-          }
-        } else {
-          log->info("Using a uniform random distribution.");
-        }
+        ZipfSampler sampler = prepare_keys(num_keys, zipf, log);
 
         size_t count = 0;
         auto benchmark_start = std::chrono::system_clock::now();
@@ -171,46 +291,38 @@ void run(const unsigned &thread_id,
         unsigned epoch = 1;
 
         while (true) {
-          unsigned k;
-          if (zipf > 0) {
-            k = sample(num_keys, seed, base, sum_probs);
-          } else {
-            k = rand_r(&seed) % (num_keys) + 1;
-          }
-
-          Key key = generate_key(k);
+          Key key = next_key(sampler, seed);
+          auto req_start = std::chrono::system_clock::now();
 
           if (type == "G") {
-            client.get_async(key);
-            receive(&client);
+            client.get(key, nullptr);
+            client.wait();
             count += 1;
+            histograms[type].record(microseconds_since(req_start));
           } else if (type == "P") {
             unsigned ts = generate_timestamp(thread_id);
             LWWPairLattice<string> val(
                 TimestampValuePair<string>(ts, string(length, 'a')));
 
-            client.put_async(key, serialize(val), LatticeType::LWW);
-            receive(&client);
+            client.put(key, serialize(val), LatticeType::LWW, nullptr);
+            client.wait();
             count += 1;
+            histograms[type].record(microseconds_since(req_start));
           } else if (type == "M") {
-            auto req_start = std::chrono::system_clock::now();
             unsigned ts = generate_timestamp(thread_id);
             LWWPairLattice<string> val(
                 TimestampValuePair<string>(ts, string(length, 'a')));
 
-            client.put_async(key, serialize(val), LatticeType::LWW);
-            receive(&client);
-            client.get_async(key);
-            receive(&client);
+            client.put(key, serialize(val), LatticeType::LWW, nullptr);
+            client.wait();
+            client.get(key, nullptr);
+            client.wait();
             count += 2;
 
-            auto req_end = std::chrono::system_clock::now();
-
-            double key_latency =
-                (double)std::chrono::duration_cast<std::chrono::microseconds>(
-                    req_end - req_start)
-                    .count() /
-                2;
+            // M records the latency of the PUT and GET together
+            double pair_latency = microseconds_since(req_start);
+            histograms[type].record(pair_latency);
+            double key_latency = pair_latency / 2;
 
             if (observed_latency.find(key) == observed_latency.end()) {
               observed_latency[key].first = key_latency;
@@ -236,14 +348,14 @@ void run(const unsigned &thread_id,
             double throughput = (double)count / (double)time_elapsed;
             log->info("[Epoch {}] Throughput is {} ops/seconds.", epoch,
                       throughput);
-            epoch += 1;
 
-            auto latency = (double)1000000 / throughput;
             UserFeedback feedback;
 
-            feedback.set_uid(ip + ":" + std::to_string(thread_id));
-            feedback.set_latency(latency);
+            feedback.set_uid(uid);
+            feedback.set_latency(report_latencies(epoch, histograms,
+                                                  latency_csv, feedback, log));
             feedback.set_throughput(throughput);
+            epoch += 1;
 
             for (const auto &key_latency_pair : observed_latency) {
               if (key_latency_pair.second.first > 1) {
@@ -253,14 +365,8 @@ void run(const unsigned &thread_id,
               }
             }
 
-            string serialized_latency;
-            feedback.SerializeToString(&serialized_latency);
-
-            for (const MonitoringThread &thread : monitoring_threads) {
-              kZmqUtil->send_string(
-                  serialized_latency,
-                  &pushers[thread.feedback_report_connect_address()]);
-            }
+            send_feedback(feedback, monitoring_threads, report_address,
+                          pushers);
 
             count = 0;
             observed_latency.clear();
@@ -279,17 +385,415 @@ void run(const unsigned &thread_id,
         log->info("Finished");
         UserFeedback feedback;
 
-        feedback.set_uid(ip + ":" + std::to_string(thread_id));
+        feedback.set_uid(uid);
         feedback.set_finish(true);
 
-        string serialized_latency;
-        feedback.SerializeToString(&serialized_latency);
+        send_feedback(feedback, monitoring_threads, report_address, pushers);
+      } else if (mode == "OPEN") {
+        // open-loop load: requests go out at a fixed rate, whether or not
+        // earlier ones have been answered, and each latency is measured from
+        // the time its request was scheduled to go out, so that a slow
+        // system cannot hide its queueing delay by slowing the client down
+        string type = v[1];
+        unsigned num_keys = stoi(v[2]);
+        unsigned length = stoi(v[3]);
+        unsigned report_period = stoi(v[4]);
+        unsigned time = stoi(v[5]);
+        double zipf = stod(v[6]);
+        double rate = stod(v[7]);
+        unsigned max_outstanding = stoi(v[8]);
+
+        if (type != "G" && type != "P") {
+          log->info("{} is an invalid open-loop request type.", type);
+          report_finish(uid, report_address, pushers);
+          continue;
+        }
 
-        for (const MonitoringThread &thread : monitoring_threads) {
-          kZmqUtil->send_string(
-              serialized_latency,
-              &pushers[thread.feedback_report_connect_address()]);
+        if (rate <= 0 || max_outstanding == 0) {
+          log->info("Open-loop mode needs a positive rate and limit.");
+          report_finish(uid, report_address, pushers);
+          continue;
         }
+
+        ZipfSampler sampler = prepare_keys(num_keys, zipf, log);
+
+        typedef std::chrono::steady_clock::time_point TimePoint;
+        auto interval = std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1 / rate));
+
+        unsigned outstanding = 0;
+
+        size_t sent = 0;
+        size_t completed = 0;
+        size_t timeouts = 0;
+
+        auto benchmark_start = std::chrono::steady_clock::now();
+        auto epoch_start = benchmark_start;
+        auto next_send = benchmark_start;
+        unsigned epoch = 1;
+
+        while (true) {
+          auto now = std::chrono::steady_clock::now();
+
+          // requests that are due while the outstanding limit is reached
+          // are sent late, but keep their scheduled time
+          while (next_send <= now && outstanding < max_outstanding) {
+            Key key = next_key(sampler, seed);
+            TimePoint scheduled = next_send;
+
+            auto done = [&, scheduled](const KeyTuple &tuple) {
+              if (tuple.error() == AnnaError::TIMEOUT) {
+                timeouts += 1;
+              }
+
+              histograms[type].record(
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - scheduled)
+                      .count());
+
+              outstanding -= 1;
+              completed += 1;
+            };
+
+            if (type == "G") {
+              client.get(key, done);
+            } else {
+              unsigned ts = generate_timestamp(thread_id);
+              LWWPairLattice<string> val(
+                  TimestampValuePair<string>(ts, string(length, 'a')));
+
+              client.put(key, serialize(val), LatticeType::LWW, done);
+            }
+
+            outstanding += 1;
+            sent += 1;
+            next_send += interval;
+          }
+
+          // sleeps in the client until an answer comes or the next request
+          // is due
+          long wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          next_send - std::chrono::steady_clock::now())
+                          .count();
+          client.poll(outstanding < max_outstanding ? std::max(wait, 0L)
+                                                    : -1);
+          now = std::chrono::steady_clock::now();
+
+          auto time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                                  now - epoch_start)
+                                  .count();
+
+          // report throughput and latency percentiles every report_period
+          // seconds
+          if (time_elapsed >= report_period) {
+            double throughput = (double)completed / time_elapsed;
+
+            // how many scheduled requests are still waiting to be sent
+            long backlog = 0;
+            if (next_send < now) {
+              backlog = (now - next_send) / interval;
+            }
+
+            log->info("[Epoch {}] Offered {} ops/seconds, completed {} "
+                      "ops/seconds.",
+                      epoch, (double)sent / time_elapsed, throughput);
+            log->info("[Epoch {}] {} outstanding, {} behind schedule, {} "
+                      "timed out.",
+                      epoch, outstanding, backlog, timeouts);
+
+            UserFeedback feedback;
+
+            feedback.set_uid(uid);
+            feedback.set_latency(report_latencies(epoch, histograms,
+                                                  latency_csv, feedback, log));
+            feedback.set_throughput(throughput);
+            epoch += 1;
+
+            send_feedback(feedback, monitoring_threads, report_address,
+                          pushers);
+
+            sent = 0;
+            completed = 0;
+            timeouts = 0;
+            epoch_start = now;
+          }
+
+          auto total_time = std::chrono::duration_cast<std::chrono::seconds>(
+                                now - benchmark_start)
+                                .count();
+          if (total_time > time) {
+            break;
+          }
+        }
+
+        log->info("Finished with {} requests outstanding.", outstanding);
+
+        // their callbacks refer to this epoch's counters
+        client.wait();
+
+        UserFeedback feedback;
+
+        feedback.set_uid(uid);
+        feedback.set_finish(true);
+
+        send_feedback(feedback, monitoring_threads, report_address, pushers);
+      } else if (mode == "WORKLOAD") {
+        Workload workload;
+        string error;
+
+        if (!parse_workload(v, workload, error)) {
+          log->info("Invalid workload: {}.", error);
+          report_finish(uid, report_address, pushers);
+          continue;
+        }
+
+        log->info("Workload is {} read, {} update, {} read-modify-write, {} "
+                  "insert over {} keys.",
+                  workload.read, workload.update, workload.rmw,
+                  workload.insert, workload.keys);
+
+        KeyChooser chooser(workload);
+        unsigned long long inserted = 0;
+        unsigned version = 0;
+
+        size_t count = 0;
+        auto benchmark_start = std::chrono::system_clock::now();
+        auto epoch_start = benchmark_start;
+        unsigned epoch = 1;
+
+        while (true) {
+          Operation op = workload.next_operation(seed);
+          unsigned long long k;
+          if (op == Operation::INSERT) {
+            inserted += 1;
+            k = workload.keys + inserted;
+          } else {
+            k = chooser.next(seed, inserted);
+          }
+
+          Key key = workload_key(k, workload.keys, uid);
+          auto req_start = std::chrono::system_clock::now();
+
+          if (op == Operation::READ || op == Operation::RMW) {
+            client.get(key, nullptr);
+            client.wait();
+            count += 1;
+          }
+
+          if (op != Operation::READ) {
+            LatticeType type;
+            string payload = workload_value(workload, seed, thread_id, uid,
+                                            version, type);
+
+            client.put(key, payload, type, nullptr);
+            client.wait();
+            count += 1;
+          }
+
+          histograms[operation_name(op)].record(microseconds_since(req_start));
+
+          auto now = std::chrono::system_clock::now();
+          auto time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                                  now - epoch_start)
+                                  .count();
+
+          // report throughput and latencies every report_period seconds
+          if (time_elapsed >= workload.report_period) {
+            double throughput = (double)count / (double)time_elapsed;
+            log->info("[Epoch {}] Throughput is {} ops/seconds.", epoch,
+                      throughput);
+
+            UserFeedback feedback;
+
+            feedback.set_uid(uid);
+            feedback.set_latency(report_latencies(epoch, histograms,
+                                                  latency_csv, feedback, log));
+            feedback.set_throughput(throughput);
+            epoch += 1;
+
+            send_feedback(feedback, monitoring_threads, report_address,
+                          pushers);
+
+            count = 0;
+            epoch_start = now;
+          }
+
+          auto total_time = std::chrono::duration_cast<std::chrono::seconds>(
+                                now - benchmark_start)
+                                .count();
+          if (total_time > workload.time) {
+            break;
+          }
+        }
+
+        log->info("Finished after inserting {} keys.", inserted);
+        UserFeedback feedback;
+
+        feedback.set_uid(uid);
+        feedback.set_finish(true);
+        send_feedback(feedback, monitoring_threads, report_address, pushers);
+      } else if (mode == "REPLAY") {
+        // replays captured requests open-loop at their captured times,
+        // scaled by the speed; each thread replays the keys whose hash
+        // falls to it, so a key's requests keep their order
+        Replay replay;
+        string error;
+        CaptureMerger capture;
+
+        if (!parse_replay(v, replay, error)) {
+          log->info("Invalid replay: {}.", error);
+          report_finish(uid, report_address, pushers);
+          continue;
+        }
+
+        bool opened = true;
+        for (const string &file : replay.files) {
+          if (!capture.add(file)) {
+            log->info("{} is not a workload capture.", file);
+            opened = false;
+          }
+        }
+
+        if (!opened) {
+          report_finish(uid, report_address, pushers);
+          continue;
+        }
+
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        unsigned outstanding = 0;
+        size_t sent = 0;
+        size_t completed = 0;
+        size_t timeouts = 0;
+
+        auto benchmark_start = std::chrono::steady_clock::now();
+        auto epoch_start = benchmark_start;
+        unsigned epoch = 1;
+
+        CapturedRequest request;
+        uint64_t captured_at = 0;
+        bool more = capture.next(request, captured_at);
+        uint64_t first_captured_at = captured_at;
+        unsigned next_tuple = 0;
+
+        // when the current request is due
+        auto due = [&]() {
+          return benchmark_start +
+                 std::chrono::duration_cast<
+                     std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double, std::micro>(
+                         (captured_at - first_captured_at) / replay.speed));
+        };
+
+        while (more || outstanding > 0) {
+          auto now = std::chrono::steady_clock::now();
+
+          // requests that are due while the outstanding limit is reached
+          // are sent late, but keep their scheduled time
+          while (more && due() <= now && outstanding < replay.outstanding) {
+            if (next_tuple < request.tuples.size()) {
+              const CapturedTuple &captured = request.tuples[next_tuple];
+
+              if (captured.key_hash % kBenchmarkThreadNum == thread_id) {
+                Key key = replay_key(captured.key_hash);
+                TimePoint scheduled = due();
+                string op = RequestType_Name(request.type);
+
+                auto done = [&, scheduled, op](const KeyTuple &tuple) {
+                  if (tuple.error() == AnnaError::TIMEOUT) {
+                    timeouts += 1;
+                  }
+
+                  histograms[op].record(
+                      std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - scheduled)
+                          .count());
+
+                  outstanding -= 1;
+                  completed += 1;
+                };
+
+                // every value is replayed as an LWW value of the captured
+                // size
+                if (request.type == RequestType::PUT) {
+                  unsigned ts = generate_timestamp(thread_id);
+                  LWWPairLattice<string> val(TimestampValuePair<string>(
+                      ts, string(captured.size, 'a')));
+
+                  client.put(key, serialize(val), LatticeType::LWW, done);
+                } else {
+                  client.get(key, done);
+                }
+
+                outstanding += 1;
+                sent += 1;
+              }
+
+              next_tuple += 1;
+            }
+
+            if (next_tuple >= request.tuples.size()) {
+              next_tuple = 0;
+              more = capture.next(request, captured_at);
+            }
+          }
+
+          // sleeps in the client until an answer comes or the next request
+          // is due
+          long wait = -1;
+          if (more && outstanding < replay.outstanding) {
+            wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       due() - std::chrono::steady_clock::now())
+                       .count();
+            wait = std::max(wait, 0L);
+          }
+
+          client.poll(wait);
+          now = std::chrono::steady_clock::now();
+
+          auto time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                                  now - epoch_start)
+                                  .count();
+
+          // report throughput and latency percentiles every report_period
+          // seconds
+          if (time_elapsed >= replay.report_period) {
+            double throughput = (double)completed / time_elapsed;
+
+            log->info("[Epoch {}] Replayed {} ops/seconds, completed {} "
+                      "ops/seconds; {} outstanding, {} timed out.",
+                      epoch, (double)sent / time_elapsed, throughput,
+                      outstanding, timeouts);
+
+            UserFeedback feedback;
+
+            feedback.set_uid(uid);
+            feedback.set_latency(report_latencies(epoch, histograms,
+                                                  latency_csv, feedback, log));
+            feedback.set_throughput(throughput);
+            epoch += 1;
+
+            send_feedback(feedback, monitoring_threads, report_address,
+                          pushers);
+
+            sent = 0;
+            completed = 0;
+            timeouts = 0;
+            epoch_start = now;
+          }
+        }
+
+        log->info("Finished replaying after {} seconds.",
+                  std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now() - benchmark_start)
+                      .count());
+
+        UserFeedback feedback;
+
+        feedback.set_uid(uid);
+        feedback.set_finish(true);
+        send_feedback(feedback, monitoring_threads, report_address, pushers);
       } else if (mode == "WARM") {
         unsigned num_keys = stoi(v[1]);
         unsigned length = stoi(v[2]);
@@ -310,16 +814,19 @@ void run(const unsigned &thread_id,
           LWWPairLattice<string> val(
               TimestampValuePair<string>(ts, string(length, 'a')));
 
-          client.put_async(generate_key(i), serialize(val), LatticeType::LWW);
-          receive(&client);
+          client.put(generate_key(i), serialize(val), LatticeType::LWW,
+                     nullptr);
+          client.wait();
         }
 
         auto warmup_time = std::chrono::duration_cast<std::chrono::seconds>(
                                std::chrono::system_clock::now() - warmup_start)
                                .count();
         log->info("Warming up data took {} seconds.", warmup_time);
+        report_finish(uid, report_address, pushers);
       } else {
         log->info("{} is an invalid mode.", mode);
+        report_finish(uid, report_address, pushers);
       }
     }
   }
@@ -0,0 +1,295 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+// Microbenchmarks for the CPU-bound paths of a KVS request: lattice merges,
+// the memory serializers, lattice (de)serialization, hash ring lookups, and
+// metadata key checks. Run anna-microbench --benchmark_filter=<regex> to
+// select benchmarks; the arguments are the key counts, value sizes, set
+// sizes, and ring sizes noted by each one.
+
+#include "benchmark/benchmark.h"
+
+#include "hash_ring.hpp"
+#include "kvs/server_utils.hpp"
+#include "metadata.hpp"
+
+unsigned kDefaultLocalReplication = 1;
+Tier kSelfTier = Tier::MEMORY;
+unsigned kThreadNum = 1;
+
+vector<Tier> kSelfTierIdVector = {kSelfTier};
+hmap<Tier, TierMetadata, TierEnumHash> kTierMetadata = {};
+
+unsigned kEbsThreadNum = 1;
+unsigned kMemoryThreadNum = 1;
+unsigned kRoutingThreadNum = 1;
+
+IntraNodeMailboxes *kIntraNodeMailboxes = nullptr;
+
+ZmqUtil zmq_util;
+ZmqUtilInterface *kZmqUtil = &zmq_util;
+
+HashRingUtil hash_ring_util;
+HashRingUtilInterface *kHashRingUtil = &hash_ring_util;
+
+Key make_key(unsigned i) { return "key_" + std::to_string(i); }
+
+string make_lww(unsigned long long timestamp, unsigned value_size) {
+  return serialize(LWWPairLattice<string>(
+      TimestampValuePair<string>(timestamp, string(value_size, 'a'))));
+}
+
+// elements of element_size bytes, each numbered from first
+set<string> make_elements(unsigned first, unsigned count,
+                          unsigned element_size) {
+  set<string> elements;
+
+  for (unsigned i = first; i < first + count; i++) {
+    string element = std::to_string(i);
+    if (element.size() < element_size) {
+      element.append(element_size - element.size(), 'a');
+    }
+
+    elements.insert(element);
+  }
+
+  return elements;
+}
+
+// arg 0: the value size
+static void BM_LWWMerge(benchmark::State &state) {
+  string value(state.range(0), 'a');
+  LWWPairLattice<string> lattice(TimestampValuePair<string>(0, value));
+  unsigned long long timestamp = 1;
+
+  for (auto _ : state) {
+    // every update is newer, so every merge replaces the value
+    LWWPairLattice<string> update(
+        TimestampValuePair<string>(timestamp++, value));
+    lattice.merge(update);
+    benchmark::DoNotOptimize(lattice);
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LWWMerge)->Arg(16)->Arg(1024)->Arg(64 << 10);
+
+// arg 0: the size of the stored set; arg 1: the size of the merged set,
+// half of which overlaps the stored set
+static void BM_SetMerge(benchmark::State &state) {
+  unsigned stored = state.range(0);
+  unsigned merged = state.range(1);
+  SetLattice<string> update(make_elements(stored - merged / 2, merged, 16));
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    SetLattice<string> lattice(make_elements(0, stored, 16));
+    state.ResumeTiming();
+
+    lattice.merge(update);
+    benchmark::DoNotOptimize(lattice);
+  }
+}
+BENCHMARK(BM_SetMerge)->Args({16, 4})->Args({1024, 16})->Args({1024, 1024});
+
+// arg 0: the number of keys; arg 1: the value size
+static void BM_LWWSerializerPut(benchmark::State &state) {
+  unsigned keys = state.range(0);
+  MemoryLWWKVS kvs;
+  MemoryLWWSerializer serializer(&kvs);
+
+  vector<string> payloads;
+  for (unsigned i = 0; i < 16; i++) {
+    payloads.push_back(make_lww(i + 1, state.range(1)));
+  }
+
+  unsigned i = 0;
+  for (auto _ : state) {
+    serializer.put(make_key(i % keys), payloads[i % payloads.size()]);
+    i++;
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_LWWSerializerPut)->Args({1000, 16})->Args({1000, 1024})->Args(
+    {100000, 1024});
+
+// arg 0: the number of keys; arg 1: the value size
+static void BM_LWWSerializerGet(benchmark::State &state) {
+  unsigned keys = state.range(0);
+  MemoryLWWKVS kvs;
+  MemoryLWWSerializer serializer(&kvs);
+
+  for (unsigned i = 0; i < keys; i++) {
+    serializer.put(make_key(i), make_lww(1, state.range(1)));
+  }
+
+  string payload;
+  AnnaError error;
+  unsigned i = 0;
+
+  for (auto _ : state) {
+    serializer.get(make_key(i++ % keys), &payload, error);
+    benchmark::DoNotOptimize(payload);
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_LWWSerializerGet)->Args({1000, 16})->Args({1000, 1024})->Args(
+    {100000, 1024});
+
+// arg 0: the number of keys; arg 1: the number of elements in each put
+static void BM_SetSerializerPut(benchmark::State &state) {
+  unsigned keys = state.range(0);
+  MemorySetKVS kvs;
+  MemorySetSerializer serializer(&kvs);
+
+  // the sets stop growing once every payload has been merged into every key
+  vector<string> payloads;
+  for (unsigned i = 0; i < 16; i++) {
+    payloads.push_back(serialize(SetLattice<string>(
+        make_elements(i * state.range(1), state.range(1), 16))));
+  }
+
+  unsigned i = 0;
+  for (auto _ : state) {
+    serializer.put(make_key(i % keys), payloads[i % payloads.size()]);
+    i++;
+  }
+}
+BENCHMARK(BM_SetSerializerPut)->Args({1000, 1})->Args({1000, 16});
+
+// arg 0: the number of keys; arg 1: the number of elements in each set
+static void BM_SetSerializerGet(benchmark::State &state) {
+  unsigned keys = state.range(0);
+  MemorySetKVS kvs;
+  MemorySetSerializer serializer(&kvs);
+
+  string stored =
+      serialize(SetLattice<string>(make_elements(0, state.range(1), 16)));
+  for (unsigned i = 0; i < keys; i++) {
+    serializer.put(make_key(i), stored);
+  }
+
+  string payload;
+  AnnaError error;
+  unsigned i = 0;
+
+  for (auto _ : state) {
+    serializer.get(make_key(i++ % keys), &payload, error);
+    benchmark::DoNotOptimize(payload);
+  }
+}
+BENCHMARK(BM_SetSerializerGet)->Args({1000, 1})->Args({1000, 64});
+
+// arg 0: the value size
+static void BM_LWWSerialize(benchmark::State &state) {
+  LWWPairLattice<string> lattice(
+      TimestampValuePair<string>(1, string(state.range(0), 'a')));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(serialize(lattice));
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LWWSerialize)->Arg(16)->Arg(1024)->Arg(64 << 10);
+
+// arg 0: the value size
+static void BM_LWWDeserialize(benchmark::State &state) {
+  string serialized = make_lww(1, state.range(0));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(deserialize_lww(serialized));
+  }
+
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LWWDeserialize)->Arg(16)->Arg(1024)->Arg(64 << 10);
+
+// arg 0: the number of elements
+static void BM_SetSerialize(benchmark::State &state) {
+  SetLattice<string> lattice(make_elements(0, state.range(0), 16));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(serialize(lattice));
+  }
+}
+BENCHMARK(BM_SetSerialize)->Arg(1)->Arg(64)->Arg(1024);
+
+// arg 0: the number of elements
+static void BM_SetDeserialize(benchmark::State &state) {
+  string serialized =
+      serialize(SetLattice<string>(make_elements(0, state.range(0), 16)));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(deserialize_set(serialized));
+  }
+}
+BENCHMARK(BM_SetDeserialize)->Arg(1)->Arg(64)->Arg(1024);
+
+// arg 0: the number of nodes in the ring; arg 1: the replication factor
+static void BM_ResponsibleGlobal(benchmark::State &state) {
+  GlobalHashRing ring;
+  for (unsigned i = 0; i < state.range(0); i++) {
+    Address ip = "10.0." + std::to_string(i / 256) + "." +
+                 std::to_string(i % 256);
+    ring.insert(ip, ip, 0, 0);
+  }
+
+  vector<Key> keys;
+  for (unsigned i = 0; i < 1024; i++) {
+    keys.push_back(make_key(i));
+  }
+
+  unsigned i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        responsible_global(keys[i++ % keys.size()], state.range(1), ring));
+  }
+}
+BENCHMARK(BM_ResponsibleGlobal)->Args({1, 1})->Args({16, 3})->Args({256, 3});
+
+// arg 0: the number of threads in the ring; arg 1: the replication factor
+static void BM_ResponsibleLocal(benchmark::State &state) {
+  LocalHashRing ring;
+  for (unsigned tid = 0; tid < state.range(0); tid++) {
+    ring.insert("10.0.0.1", "10.0.0.1", 0, tid);
+  }
+
+  vector<Key> keys;
+  for (unsigned i = 0; i < 1024; i++) {
+    keys.push_back(make_key(i));
+  }
+
+  unsigned i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        responsible_local(keys[i++ % keys.size()], state.range(1), ring));
+  }
+}
+BENCHMARK(BM_ResponsibleLocal)->Args({1, 1})->Args({4, 1})->Args({16, 2});
+
+static void BM_IsMetadata(benchmark::State &state) {
+  vector<Key> keys = {make_key(1), kMetadataIdentifier + "|127.0.0.1|0|stats",
+                      "short"};
+  unsigned i = 0;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(is_metadata(keys[i++ % keys.size()]));
+  }
+}
+BENCHMARK(BM_IsMetadata);
+
+BENCHMARK_MAIN();
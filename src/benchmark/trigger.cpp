@@ -12,11 +12,18 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#include <chrono>
+#include <fstream>
 #include <stdlib.h>
 
+#include "benchmark.pb.h"
+#include "benchmark/replay.hpp"
+#include "benchmark/workload.hpp"
 #include "common.hpp"
 #include "hash_ring.hpp"
 #include "kvs_common.hpp"
+#include "kvs_threads.hpp"
+#include "latency_histogram.hpp"
 #include "threads.hpp"
 #include "yaml-cpp/yaml.h"
 
@@ -31,9 +38,264 @@ unsigned kBenchmarkThreadNum = 1;
 unsigned kRoutingThreadCount = 1;
 unsigned kDefaultLocalReplication = 1;
 
+// The results of one phase of a run: what each benchmark thread reported
+// until it finished.
+struct PhaseResult {
+  string name;
+  string command;
+  double seconds = 0;
+
+  // uid -> the throughput the thread reported in each epoch
+  map<string, vector<double>> throughput;
+
+  // request type -> the latencies of every thread, merged
+  map<string, LatencyHistogram> latency;
+
+  set<string> finished;
+};
+
+void print_help() {
+  std::cout << "CACHE:<keys>" << std::endl
+            << "LOAD:<G|P|M>:<keys>:<length>:<report period>:<time>:<zipf>"
+            << std::endl
+            << "OPEN:<G|P>:<keys>:<length>:<report period>:<time>:<zipf>:"
+               "<rate>:<max outstanding>"
+            << std::endl
+            << kWorkloadUsage << std::endl
+            << kReplayUsage << std::endl
+            << "WARM:<keys>:<length>:<total threads>" << std::endl
+            << "run <run file>" << std::endl;
+}
+
+// catches malformed workloads here rather than in every benchmark log
+bool check_command(const string &command) {
+  vector<string> fields;
+  split(command, ':', fields);
+
+  Workload workload;
+  string error;
+  if (fields.size() > 0 && fields[0] == "WORKLOAD" &&
+      !parse_workload(fields, workload, error)) {
+    std::cout << "Invalid workload: " << error << "." << std::endl;
+    return false;
+  }
+
+  Replay replay;
+  if (fields.size() > 0 && fields[0] == "REPLAY" &&
+      !parse_replay(fields, replay, error)) {
+    std::cout << "Invalid replay: " << error << "." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+void broadcast(const string &command, const vector<Address> &benchmark_address,
+               unsigned thread_num, SocketCache &pushers) {
+  for (const Address address : benchmark_address) {
+    for (unsigned tid = 0; tid < thread_num; tid++) {
+      BenchmarkThread bt = BenchmarkThread(address, tid);
+
+      kZmqUtil->send_string(command, &pushers[bt.benchmark_command_address()]);
+    }
+  }
+}
+
+// Sends the phase's command to every benchmark thread and collects their
+// feedback from results_puller until all of them have finished, or until
+// timeout seconds (if positive) have passed.
+void run_phase(PhaseResult &phase, unsigned timeout,
+               const vector<Address> &benchmark_address, unsigned thread_num,
+               zmq::socket_t &results_puller, SocketCache &pushers) {
+  unsigned expected = benchmark_address.size() * thread_num;
+  vector<zmq::pollitem_t> pollitems = {
+      {static_cast<void *>(results_puller), 0, ZMQ_POLLIN, 0}};
+
+  // drop whatever threads that missed the last phase's deadline sent late
+  kZmqUtil->poll(0, &pollitems);
+  while (pollitems[0].revents & ZMQ_POLLIN) {
+    kZmqUtil->recv_string(&results_puller);
+    kZmqUtil->poll(0, &pollitems);
+  }
+
+  std::cout << "Starting phase " << phase.name << ": " << phase.command
+            << std::endl;
+  broadcast(phase.command, benchmark_address, thread_num, pushers);
+  auto start = std::chrono::steady_clock::now();
+
+  while (phase.finished.size() < expected) {
+    double elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count() /
+                     1000.0;
+    if (timeout > 0 && elapsed >= timeout) {
+      std::cout << "Phase " << phase.name << " timed out with "
+                << expected - phase.finished.size()
+                << " threads still running." << std::endl;
+      break;
+    }
+
+    kZmqUtil->poll(1000, &pollitems);
+    if (!(pollitems[0].revents & ZMQ_POLLIN)) {
+      continue;
+    }
+
+    UserFeedback feedback;
+    feedback.ParseFromString(kZmqUtil->recv_string(&results_puller));
+
+    if (feedback.finish()) {
+      phase.finished.insert(feedback.uid());
+      continue;
+    }
+
+    phase.throughput[feedback.uid()].push_back(feedback.throughput());
+
+    for (const auto &op : feedback.op_latency()) {
+      if (op.precision_bits() != kHistogramPrecisionBits ||
+          op.buckets_size() != op.counts_size()) {
+        std::cout << "Ignoring " << op.op() << " latencies from "
+                  << feedback.uid() << ", whose histogram layout differs."
+                  << std::endl;
+        continue;
+      }
+
+      LatencyHistogram &histogram = phase.latency[op.op()];
+      for (int i = 0; i < op.buckets_size(); i++) {
+        histogram.add(op.buckets(i), op.counts(i));
+      }
+    }
+  }
+
+  phase.seconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count() /
+                  1000.0;
+}
+
+void emit_phase(YAML::Emitter &out, const PhaseResult &phase) {
+  double total_throughput = 0;
+
+  out << YAML::BeginMap;
+  out << YAML::Key << "name" << YAML::Value << phase.name;
+  out << YAML::Key << "command" << YAML::Value << phase.command;
+  out << YAML::Key << "seconds" << YAML::Value << phase.seconds;
+  out << YAML::Key << "finished-threads" << YAML::Value
+      << phase.finished.size();
+
+  out << YAML::Key << "threads" << YAML::Value << YAML::BeginSeq;
+  for (const auto &pair : phase.throughput) {
+    double sum = 0;
+    for (const double &throughput : pair.second) {
+      sum += throughput;
+    }
+
+    double mean = sum / pair.second.size();
+    total_throughput += mean;
+
+    out << YAML::BeginMap;
+    out << YAML::Key << "uid" << YAML::Value << pair.first;
+    out << YAML::Key << "epochs" << YAML::Value << pair.second.size();
+    out << YAML::Key << "throughput" << YAML::Value << mean;
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq;
+
+  // the sum of each thread's mean throughput over its epochs, in ops/second
+  out << YAML::Key << "throughput" << YAML::Value << total_throughput;
+
+  out << YAML::Key << "latency" << YAML::Value << YAML::BeginMap;
+  for (const auto &pair : phase.latency) {
+    const LatencyHistogram &histogram = pair.second;
+
+    out << YAML::Key << pair.first << YAML::Value << YAML::BeginMap;
+    out << YAML::Key << "requests" << YAML::Value << histogram.total();
+    out << YAML::Key << "mean" << YAML::Value << histogram.mean();
+    out << YAML::Key << "p50" << YAML::Value << histogram.percentile(0.5);
+    out << YAML::Key << "p90" << YAML::Value << histogram.percentile(0.9);
+    out << YAML::Key << "p99" << YAML::Value << histogram.percentile(0.99);
+    out << YAML::Key << "p99.9" << YAML::Value << histogram.percentile(0.999);
+    out << YAML::Key << "max" << YAML::Value << histogram.max();
+    out << YAML::EndMap;
+  }
+  out << YAML::EndMap;
+
+  out << YAML::EndMap;
+}
+
+// Runs the phases listed in the YAML run file at path, one after another, and
+// writes the merged results of all of them to <name>-<start time>.yml. See
+// docs/benchmarking.md for the run file's format.
+void run_file(const string &path, const Address &driver_ip,
+              const vector<Address> &benchmark_address, unsigned thread_num,
+              zmq::socket_t &results_puller, SocketCache &pushers) {
+  if (!std::ifstream(path).good()) {
+    std::cout << "Could not read run file " << path << "." << std::endl;
+    return;
+  }
+
+  YAML::Node run = YAML::LoadFile(path);
+
+  string name = run["name"] ? run["name"].as<string>() : "run";
+  YAML::Node phases = run["phases"];
+  if (!phases || phases.size() == 0) {
+    std::cout << "Run file " << path << " lists no phases." << std::endl;
+    return;
+  }
+
+  for (const YAML::Node &phase : phases) {
+    if (!phase["command"] || !check_command(phase["command"].as<string>())) {
+      std::cout << "Every phase needs a valid command." << std::endl;
+      return;
+    }
+  }
+
+  unsigned long long started =
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  broadcast("REPORT:" + driver_ip, benchmark_address, thread_num, pushers);
+
+  vector<PhaseResult> results;
+  for (const YAML::Node &phase : phases) {
+    PhaseResult result;
+    result.name = phase["name"] ? phase["name"].as<string>()
+                                : std::to_string(results.size() + 1);
+    result.command = phase["command"].as<string>();
+    unsigned timeout = phase["timeout"] ? phase["timeout"].as<unsigned>() : 0;
+
+    run_phase(result, timeout, benchmark_address, thread_num, results_puller,
+              pushers);
+    results.push_back(result);
+  }
+
+  // threads would otherwise keep sending to a driver that is gone
+  broadcast("REPORT", benchmark_address, thread_num, pushers);
+
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "name" << YAML::Value << name;
+  out << YAML::Key << "started" << YAML::Value << started;
+  out << YAML::Key << "benchmark-threads" << YAML::Value
+      << benchmark_address.size() * thread_num;
+  out << YAML::Key << "phases" << YAML::Value << YAML::BeginSeq;
+  for (const PhaseResult &result : results) {
+    emit_phase(out, result);
+  }
+  out << YAML::EndSeq;
+  out << YAML::EndMap;
+
+  string report_file = name + "-" + std::to_string(started) + ".yml";
+  std::ofstream report(report_file);
+  report << out.c_str() << std::endl;
+  std::cout << "Wrote the report of run " << name << " to " << report_file
+            << "." << std::endl;
+}
+
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <benchmark_threads>" << std::endl;
+  if (argc != 2 && argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <benchmark_threads> [<run file>]"
+              << std::endl;
     return 1;
   }
 
@@ -42,27 +304,64 @@ int main(int argc, char *argv[]) {
   // read the YAML conf
   vector<Address> benchmark_address;
   YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  configure_hashing(conf);
+
   YAML::Node benchmark = conf["benchmark"];
 
   for (const YAML::Node &node : benchmark) {
     benchmark_address.push_back(node.as<Address>());
   }
 
+  // benchmark threads send their results to this node's user IP
+  Address driver_ip;
+  if (YAML::Node user = conf["user"]) {
+    driver_ip = user["ip"].as<Address>();
+  }
+
   zmq::context_t context(1);
   SocketCache pushers(&context, ZMQ_PUSH);
 
+  zmq::socket_t results_puller(context, ZMQ_PULL);
+  results_puller.bind("tcp://*:" + std::to_string(kBenchmarkReportPort));
+
+  if (argc == 3) {
+    if (driver_ip.empty()) {
+      std::cerr << "Running a run file needs user: ip: in the conf."
+                << std::endl;
+      return 1;
+    }
+
+    run_file(argv[2], driver_ip, benchmark_address, thread_num,
+             results_puller, pushers);
+    return 0;
+  }
+
   string command;
   while (true) {
     std::cout << "command> ";
     getline(std::cin, command);
 
-    for (const Address address : benchmark_address) {
-      for (unsigned tid = 0; tid < thread_num; tid++) {
-        BenchmarkThread bt = BenchmarkThread(address, tid);
+    if (command == "help") {
+      print_help();
+      continue;
+    }
 
-        kZmqUtil->send_string(command,
-                              &pushers[bt.benchmark_command_address()]);
+    if (command.compare(0, 4, "run ") == 0) {
+      if (driver_ip.empty()) {
+        std::cout << "Running a run file needs user: ip: in the conf."
+                  << std::endl;
+      } else {
+        run_file(command.substr(4), driver_ip, benchmark_address, thread_num,
+                 results_puller, pushers);
       }
+
+      continue;
     }
+
+    if (!check_command(command)) {
+      continue;
+    }
+
+    broadcast(command, benchmark_address, thread_num, pushers);
   }
 }
@@ -0,0 +1,481 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "client/async_client.hpp"
+
+AsyncKvsClient::AsyncKvsClient(const vector<UserRoutingThread> &routing_threads,
+                               const Address &ip, unsigned tid,
+                               unsigned timeout)
+    : routing_threads_(routing_threads), ut_(UserThread(ip, tid)),
+      timeout_(timeout), context_(1), pushers_(&context_, ZMQ_PUSH),
+      response_puller_(context_, ZMQ_PULL),
+      key_address_puller_(context_, ZMQ_PULL),
+      scan_puller_(context_, ZMQ_PULL), next_operation_(0),
+      next_request_(0) {
+  seed_ = time(NULL);
+  seed_ += tid;
+
+  response_puller_.bind(ut_.response_bind_address());
+  key_address_puller_.bind(ut_.key_address_bind_address());
+  scan_puller_.bind(get_scan_response_bind_address(tid));
+}
+
+string AsyncKvsClient::request_id() {
+  return ut_.ip() + ":" + std::to_string(ut_.tid()) + "_" +
+         std::to_string(next_request_++);
+}
+
+void AsyncKvsClient::get(const Key &key, ClientCallback callback) {
+  uint64_t id = next_operation_++;
+  operations_[id] = Operation{RequestType::GET, key, "", LatticeType::NONE,
+                              std::move(callback), 0, ""};
+  route(id);
+}
+
+void AsyncKvsClient::put(const Key &key, const string &payload,
+                         LatticeType lattice_type, ClientCallback callback) {
+  uint64_t id = next_operation_++;
+  operations_[id] = Operation{RequestType::PUT, key, payload, lattice_type,
+                              std::move(callback), 0, ""};
+  route(id);
+}
+
+void AsyncKvsClient::scan(const string &prefix, const Key &start,
+                          const Key &end, unsigned limit,
+                          ScanCallback callback) {
+  KeyScanRequest request;
+  request.set_request_id(request_id());
+  request.set_response_address(
+      get_scan_response_connect_address(ut_.ip(), ut_.tid()));
+  request.set_prefix(prefix);
+  request.set_start(start);
+  request.set_end(end);
+  request.set_limit(limit);
+
+  // a scan counts as an operation toward the callbacks poll() reports
+  next_operation_ += 1;
+  scans_.insert({request.request_id(),
+                 Scan{ScanMerger(limit), std::move(callback)}});
+  scan_order_.push_back(
+      {std::chrono::steady_clock::now(), request.request_id()});
+
+  string serialized;
+  request.SerializeToString(&serialized);
+  const UserRoutingThread &rt =
+      routing_threads_[rand_r(&seed_) % routing_threads_.size()];
+  kZmqUtil->send_string(
+      serialized,
+      &pushers_[RoutingThread(rt.ip(), rt.tid()).key_scan_connect_address()]);
+}
+
+// adds the operation to the request for one of its key's replicas, or makes
+// it wait for the key's addresses if they are not cached
+void AsyncKvsClient::route(uint64_t id) {
+  Operation &op = operations_[id];
+  auto it = address_cache_.find(op.key_);
+
+  if (it == address_cache_.end() || it->second.empty()) {
+    vector<uint64_t> &waiting = unresolved_[op.key_];
+    if (waiting.empty() && resolving_.find(op.key_) == resolving_.end()) {
+      to_resolve_.push_back(op.key_);
+    }
+
+    waiting.push_back(id);
+    return;
+  }
+
+  const vector<Address> &addresses = it->second;
+  std::size_t index = selector_.choose(
+      addresses.size(), seed_,
+      [&addresses](std::size_t i) { return addresses[i]; });
+
+  // a retry goes to another replica if there is one
+  if (addresses.size() > 1 && addresses[index] == op.address_) {
+    index = (index + 1) % addresses.size();
+  }
+
+  op.address_ = addresses[index];
+  enqueue(op.address_, id);
+}
+
+void AsyncKvsClient::enqueue(const Address &address, uint64_t id) {
+  const Operation &op = operations_[id];
+  auto slot = std::make_pair(address, op.type_);
+  auto it = outbox_.find(slot);
+
+  if (it == outbox_.end()) {
+    it = outbox_.insert({slot, {KeyRequest(), Inflight()}}).first;
+    KeyRequest &request = it->second.first;
+    request.set_type(op.type_);
+    request.set_request_id(request_id());
+    request.set_response_address(ut_.response_connect_address());
+
+    it->second.second.address_ = address;
+    it->second.second.remaining_ = 0;
+  }
+
+  KeyRequest &request = it->second.first;
+  Inflight &inflight = it->second.second;
+
+  KeyTuple *tp = request.add_tuples();
+  tp->set_key(op.key_);
+  tp->set_address_cache_size(address_cache_[op.key_].size());
+
+  if (op.type_ == RequestType::PUT) {
+    tp->set_lattice_type(op.lattice_type_);
+    tp->set_payload(op.payload_);
+  }
+
+  inflight.operations_[op.key_].push_back(id);
+  inflight.remaining_ += 1;
+
+  if (request.tuples_size() >= kClientMaxRequestTuples) {
+    send(address, request, inflight);
+    outbox_.erase(it);
+  }
+}
+
+void AsyncKvsClient::send(const Address &address, KeyRequest &request,
+                          Inflight &inflight) {
+  string serialized;
+  request.SerializeToString(&serialized);
+  kZmqUtil->send_string(serialized, &pushers_[address]);
+
+  selector_.sent(address, request.request_id());
+  request_order_.push_back(
+      {std::chrono::steady_clock::now(), request.request_id()});
+  inflight_[request.request_id()] = std::move(inflight);
+}
+
+void AsyncKvsClient::flush() {
+  if (!to_resolve_.empty()) {
+    KeyAddressRequest request;
+    request.set_request_id(request_id());
+    request.set_response_address(ut_.key_address_connect_address());
+
+    TimePoint now = std::chrono::steady_clock::now();
+    for (const Key &key : to_resolve_) {
+      request.add_keys(key);
+      resolving_[key] = now;
+      resolve_order_.push_back({now, key});
+    }
+
+    to_resolve_.clear();
+
+    string serialized;
+    request.SerializeToString(&serialized);
+    const UserRoutingThread &rt =
+        routing_threads_[rand_r(&seed_) % routing_threads_.size()];
+    kZmqUtil->send_string(serialized,
+                          &pushers_[rt.key_address_connect_address()]);
+  }
+
+  for (auto &pair : outbox_) {
+    send(pair.first.first, pair.second.first, pair.second.second);
+  }
+
+  outbox_.clear();
+}
+
+// removes the operation before running its callback, which may start new
+// operations
+void AsyncKvsClient::finish(uint64_t id, const KeyTuple &tuple) {
+  auto it = operations_.find(id);
+  if (it == operations_.end()) {
+    return;
+  }
+
+  ClientCallback callback = std::move(it->second.callback_);
+  operations_.erase(it);
+
+  if (callback) {
+    callback(tuple);
+  }
+}
+
+void AsyncKvsClient::fail(uint64_t id, AnnaError error) {
+  KeyTuple tuple;
+  tuple.set_key(operations_[id].key_);
+  tuple.set_error(error);
+  finish(id, tuple);
+}
+
+// sends the operation again after a thread turned it away, unless it has
+// been sent kClientMaxRetries times already
+bool AsyncKvsClient::retry(uint64_t id, AnnaError error) {
+  if (error != AnnaError::WRONG_THREAD && error != AnnaError::TIMEOUT) {
+    return false;
+  }
+
+  Operation &op = operations_[id];
+  if (op.retries_ >= kClientMaxRetries) {
+    return false;
+  }
+
+  op.retries_ += 1;
+
+  // a thread that is not responsible for the key means the cached addresses
+  // are out of date
+  if (error == AnnaError::WRONG_THREAD) {
+    address_cache_.erase(op.key_);
+  }
+
+  route(id);
+  return true;
+}
+
+void AsyncKvsClient::handle_address_response(const string &serialized) {
+  KeyAddressResponse response;
+  response.ParseFromString(serialized);
+
+  for (const auto &key_address : response.addresses()) {
+    const Key &key = key_address.key();
+
+    // the routing tier answers keys it has to look up in a later response,
+    // so an empty answer without an error only means to keep waiting
+    if (response.error() == AnnaError::NO_ERROR &&
+        key_address.ips_size() == 0) {
+      continue;
+    }
+
+    resolving_.erase(key);
+    auto it = unresolved_.find(key);
+    if (it == unresolved_.end()) {
+      continue;
+    }
+
+    vector<uint64_t> waiting = std::move(it->second);
+    unresolved_.erase(it);
+
+    if (response.error() != AnnaError::NO_ERROR) {
+      if (log_ != nullptr) {
+        log_->error("Routing tier could not resolve key {}: {}.", key,
+                    AnnaError_Name(response.error()));
+      }
+
+      for (uint64_t id : waiting) {
+        fail(id, response.error());
+      }
+
+      continue;
+    }
+
+    vector<Address> &addresses = address_cache_[key];
+    addresses.assign(key_address.ips().begin(), key_address.ips().end());
+
+    for (uint64_t id : waiting) {
+      route(id);
+    }
+  }
+}
+
+void AsyncKvsClient::handle_response(const string &serialized) {
+  KeyResponse response;
+  response.ParseFromString(serialized);
+  selector_.answered(response.response_id());
+
+  auto it = inflight_.find(response.response_id());
+  if (it == inflight_.end()) {
+    // the request timed out before this answer came
+    return;
+  }
+
+  for (const KeyTuple &tuple : response.tuples()) {
+    auto ops = it->second.operations_.find(tuple.key());
+    if (ops == it->second.operations_.end() || ops->second.empty()) {
+      continue;
+    }
+
+    uint64_t id = ops->second.front();
+    ops->second.pop_front();
+    it->second.remaining_ -= 1;
+
+    if (tuple.invalidate()) {
+      address_cache_.erase(tuple.key());
+    }
+
+    if (!retry(id, tuple.error())) {
+      finish(id, tuple);
+    }
+  }
+
+  // a request's tuples may be answered across several responses
+  if (it->second.remaining_ == 0) {
+    inflight_.erase(it);
+  }
+}
+
+void AsyncKvsClient::handle_scan_response(const string &serialized) {
+  KeyScanResponse response;
+  response.ParseFromString(serialized);
+
+  auto it = scans_.find(response.request_id());
+  if (it == scans_.end()) {
+    // the scan timed out before this answer came
+    return;
+  }
+
+  if (it->second.merger_.add(response)) {
+    finish_scan(it, AnnaError::NO_ERROR);
+  }
+}
+
+// removes the scan before running its callback, which may start the next
+// page; a scan that failed is answered with no keys
+void AsyncKvsClient::finish_scan(map<string, Scan>::iterator it,
+                                 AnnaError error) {
+  vector<Key> keys;
+  bool more = false;
+  if (error == AnnaError::NO_ERROR) {
+    it->second.merger_.page(keys, more);
+  }
+
+  ScanCallback callback = std::move(it->second.callback_);
+  scans_.erase(it);
+
+  if (callback) {
+    callback(keys, more, error);
+  }
+}
+
+void AsyncKvsClient::expire(TimePoint now) {
+  while (!request_order_.empty() &&
+         now - request_order_.front().first >= timeout_) {
+    auto it = inflight_.find(request_order_.front().second);
+    request_order_.pop_front();
+
+    if (it == inflight_.end()) {
+      continue;
+    }
+
+    Inflight inflight = std::move(it->second);
+    inflight_.erase(it);
+
+    for (const auto &pair : inflight.operations_) {
+      for (uint64_t id : pair.second) {
+        fail(id, AnnaError::TIMEOUT);
+      }
+    }
+  }
+
+  while (!resolve_order_.empty() &&
+         now - resolve_order_.front().first >= timeout_) {
+    Key key = std::move(resolve_order_.front().second);
+    TimePoint asked = resolve_order_.front().first;
+    resolve_order_.pop_front();
+
+    // the key may have been asked about again since
+    auto it = resolving_.find(key);
+    if (it == resolving_.end() || it->second != asked) {
+      continue;
+    }
+
+    resolving_.erase(it);
+    vector<uint64_t> waiting = std::move(unresolved_[key]);
+    unresolved_.erase(key);
+
+    for (uint64_t id : waiting) {
+      fail(id, AnnaError::TIMEOUT);
+    }
+  }
+
+  while (!scan_order_.empty() &&
+         now - scan_order_.front().first >= timeout_) {
+    auto it = scans_.find(scan_order_.front().second);
+    scan_order_.pop_front();
+
+    if (it != scans_.end()) {
+      finish_scan(it, AnnaError::TIMEOUT);
+    }
+  }
+}
+
+long AsyncKvsClient::next_expiry(TimePoint now) const {
+  TimePoint next = TimePoint::max();
+
+  if (!request_order_.empty()) {
+    next = request_order_.front().first + timeout_;
+  }
+
+  if (!resolve_order_.empty()) {
+    next = std::min(next, resolve_order_.front().first + timeout_);
+  }
+
+  if (!scan_order_.empty()) {
+    next = std::min(next, scan_order_.front().first + timeout_);
+  }
+
+  if (next == TimePoint::max()) {
+    return -1;
+  }
+
+  // rounded up, so that poll does not return just before the expiry
+  long wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  next - now + std::chrono::milliseconds(1))
+                  .count();
+  return wait < 0 ? 0 : wait;
+}
+
+unsigned AsyncKvsClient::poll(long timeout) {
+  flush();
+
+  vector<zmq::pollitem_t> pollitems = {
+      {static_cast<void *>(response_puller_), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(key_address_puller_), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(scan_puller_), 0, ZMQ_POLLIN, 0}};
+
+  unsigned before = outstanding();
+  unsigned started = next_operation_;
+
+  TimePoint now = std::chrono::steady_clock::now();
+  long wait = next_expiry(now);
+  if (timeout >= 0 && (wait < 0 || timeout < wait)) {
+    wait = timeout;
+  }
+
+  kZmqUtil->poll(wait, &pollitems);
+
+  // drain what has arrived without blocking again
+  while ((pollitems[0].revents | pollitems[1].revents |
+          pollitems[2].revents) &
+         ZMQ_POLLIN) {
+    if (pollitems[0].revents & ZMQ_POLLIN) {
+      handle_response(kZmqUtil->recv_string(&response_puller_));
+    }
+
+    if (pollitems[1].revents & ZMQ_POLLIN) {
+      handle_address_response(kZmqUtil->recv_string(&key_address_puller_));
+    }
+
+    if (pollitems[2].revents & ZMQ_POLLIN) {
+      handle_scan_response(kZmqUtil->recv_string(&scan_puller_));
+    }
+
+    kZmqUtil->poll(0, &pollitems);
+  }
+
+  expire(std::chrono::steady_clock::now());
+
+  // keys that were re-routed or newly resolved go out right away
+  flush();
+
+  // callbacks may have started operations of their own
+  return before + (next_operation_ - started) - outstanding();
+}
+
+void AsyncKvsClient::wait() {
+  while (outstanding() > 0) {
+    poll(-1);
+  }
+}
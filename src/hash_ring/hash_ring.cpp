@@ -18,12 +18,83 @@
 
 #include "requests.hpp"
 
+HashMode kHashMode = HashMode::legacy;
+
+ReplicaSelector &replica_selector() {
+  // every thread that sends metadata requests keeps its own
+  static thread_local ReplicaSelector selector;
+  return selector;
+}
+
+const ServerThread &select_replica(const ServerThreadList &threads,
+                                   unsigned *seed) {
+  ReplicaSelector &selector = replica_selector();
+  auto address = [&](std::size_t i) {
+    return threads[i].key_request_connect_address();
+  };
+
+  if (seed == nullptr) {
+    return threads[selector.choose(threads.size(), address)];
+  }
+
+  return threads[selector.choose(threads.size(), *seed, address)];
+}
+uint64_t kHashSeed = 0;
+
+// the tiers whose virtual node count the conf sets
+static hmap<Tier, unsigned, TierEnumHash> kTierVirtualNodes;
+
+unsigned virtual_node_count(Tier tier) {
+  auto it = kTierVirtualNodes.find(tier);
+  return it == kTierVirtualNodes.end() ? kVirtualThreadNum : it->second;
+}
+
+static double kRingLoadBound = 0;
+
+double ring_load_bound() {
+  // legacy rings keep the layout they were created with
+  return kHashMode == HashMode::legacy ? 0 : kRingLoadBound;
+}
+
+void configure_hashing(const YAML::Node &conf) {
+  YAML::Node hashing = conf["hashing"];
+
+  if (hashing) {
+    // a cluster only moves to seeded hashing when its conf asks for it
+    if (hashing["mode"] && hashing["mode"].as<string>() == "seeded") {
+      kHashMode = HashMode::seeded;
+    } else {
+      kHashMode = HashMode::legacy;
+    }
+
+    if (hashing["seed"]) {
+      kHashSeed = hashing["seed"].as<uint64_t>();
+    }
+
+    if (YAML::Node virtual_nodes = hashing["virtual-nodes"]) {
+      if (virtual_nodes["memory"]) {
+        kTierVirtualNodes[Tier::MEMORY] =
+            std::max(virtual_nodes["memory"].as<unsigned>(), 1u);
+      }
+
+      if (virtual_nodes["ebs"]) {
+        kTierVirtualNodes[Tier::DISK] =
+            std::max(virtual_nodes["ebs"].as<unsigned>(), 1u);
+      }
+    }
+
+    if (hashing["load-bound"]) {
+      kRingLoadBound = std::max(hashing["load-bound"].as<double>(), 0.0);
+    }
+  }
+}
+
 // get all threads responsible for a key from the "node_type" tier
 // metadata flag = 0 means the key is  metadata; otherwise, it is  regular data
 ServerThreadList HashRingUtil::get_responsible_threads(
     Address response_address, const Key &key, bool metadata,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, KeyReplication> &key_replication_map, SocketCache &pushers,
+    KeyReplicationMap &key_replication_map, SocketCache &pushers,
     const vector<Tier> &tiers, bool &succeed, unsigned &seed) {
   if (metadata) {
     succeed = true;
@@ -33,9 +104,13 @@ ServerThreadList HashRingUtil::get_responsible_threads(
     ServerThreadList result;
 
     if (key_replication_map.find(key) == key_replication_map.end()) {
-      kHashRingUtil->issue_replication_factor_request(
-          response_address, key, global_hash_rings[Tier::MEMORY],
-          local_hash_rings[Tier::MEMORY], pushers, seed);
+      // concurrent misses on the key share the request already in flight
+      if (key_replication_map.start_request(key)) {
+        kHashRingUtil->issue_replication_factor_request(
+            response_address, key, global_hash_rings[Tier::MEMORY],
+            local_hash_rings[Tier::MEMORY], pushers, seed);
+      }
+
       succeed = false;
     } else {
       for (const Tier &tier : tiers) {
@@ -62,53 +137,22 @@ ServerThreadList HashRingUtil::get_responsible_threads(
   }
 }
 
-// assuming the replication factor will never be greater than the number of
-// nodes in a tier return a set of ServerThreads that are responsible for a key
+// returns the global_rep distinct nodes responsible for a key; replication
+// factors beyond the number of nodes in the tier are capped
 ServerThreadList responsible_global(const Key &key, unsigned global_rep,
                                     GlobalHashRing &global_hash_ring) {
-  ServerThreadList threads;
-  auto pos = global_hash_ring.find(key);
-
-  if (pos != global_hash_ring.end()) {
-    // iterate for every value in the replication factor
-    unsigned i = 0;
-
-    while (i < global_rep) {
-      if (std::find(threads.begin(), threads.end(), pos->second) ==
-          threads.end()) {
-        threads.push_back(pos->second);
-        i += 1;
-      }
-      if (++pos == global_hash_ring.end()) {
-        pos = global_hash_ring.begin();
-      }
-    }
-  }
-
-  return threads;
+  return global_hash_ring.responsible(key, global_rep);
 }
 
-// assuming the replication factor will never be greater than the number of
-// worker threads return a set of tids that are responsible for a key
+// returns the tids of the local_rep distinct worker threads responsible for a
+// key; replication factors beyond the number of threads are capped
 set<unsigned> responsible_local(const Key &key, unsigned local_rep,
                                 LocalHashRing &local_hash_ring) {
   set<unsigned> tids;
-  auto pos = local_hash_ring.find(key);
-
-  if (pos != local_hash_ring.end()) {
-    // iterate for every value in the replication factor
-    unsigned i = 0;
 
-    while (i < local_rep) {
-      bool succeed = tids.insert(pos->second.tid()).second;
-      if (++pos == local_hash_ring.end()) {
-        pos = local_hash_ring.begin();
-      }
-
-      if (succeed) {
-        i += 1;
-      }
-    }
+  for (const ServerThread &thread :
+       local_hash_ring.responsible(key, local_rep)) {
+    tids.insert(thread.tid());
   }
 
   return tids;
@@ -124,8 +168,9 @@ Address prepare_metadata_request(const Key &key,
       key, global_memory_hash_ring, local_memory_hash_ring);
 
   if (threads.size() != 0) { // In case no servers have joined yet.
-    Address target_address = std::next(begin(threads), rand() % threads.size())
-                                 ->key_request_connect_address();
+    Address target_address =
+        select_replica(threads).key_request_connect_address();
+
     if (addr_request_map.find(target_address) == addr_request_map.end()) {
       addr_request_map[target_address].set_type(type);
       addr_request_map[target_address].set_response_address(response_address);
@@ -134,6 +179,11 @@ Address prepare_metadata_request(const Key &key,
       string req_id = response_address + ":" + std::to_string(rid);
       addr_request_map[target_address].set_request_id(req_id);
       rid += 1;
+
+      // a request sent without a response address is never answered
+      if (!response_address.empty()) {
+        replica_selector().sent(target_address, req_id);
+      }
     }
 
     return target_address;
@@ -202,13 +252,17 @@ void HashRingUtilInterface::issue_replication_factor_request(
   auto threads = kHashRingUtil->get_responsible_threads_metadata(
       replication_key, global_memory_hash_ring, local_memory_hash_ring);
 
+  ReplicaSelector &selector = replica_selector();
   Address target_address =
-      std::next(begin(threads), rand_r(&seed) % threads.size())
-          ->key_request_connect_address();
+      select_replica(threads, &seed).key_request_connect_address();
+
+  string request_id = selector.request_id(response_address);
+  selector.sent(target_address, request_id);
 
   KeyRequest key_request;
   key_request.set_type(RequestType::GET);
   key_request.set_response_address(response_address);
+  key_request.set_request_id(request_id);
 
   prepare_get_tuple(key_request, replication_key, LatticeType::LWW);
   string serialized;
@@ -15,53 +15,34 @@
 #include "kvs/kvs_handlers.hpp"
 
 void cache_ip_response_handler(string &serialized,
-                               map<Address, set<Key>> &cache_ip_to_keys,
-                               map<Key, set<Address>> &key_to_cache_ips) {
+                               CacheSubscriptions &cache_subscriptions,
+                               CacheFanout &cache_fanout,
+                               MessageBuffers &buffers) {
   // The response will be a list of cache IPs and their responsible keys.
-  KeyResponse response;
+  KeyResponse &response = buffers.response;
   response.ParseFromString(serialized);
+  replica_selector().answered(response.response_id());
 
   for (const auto &tuple : response.tuples()) {
     // tuple is a key-value pair from the KVS;
     // here, the key is the metadata key for the cache IP,
-    // and the value is the list of keys that cache is responsible for.
+    // and the value is the keys that cache is responsible for.
 
     if (tuple.error() == AnnaError::NO_ERROR) {
       // Extract the cache IP.
       Address cache_ip = get_key_from_user_metadata(tuple.key());
 
-      // Extract the keys that the cache is responsible for.
+      // Extract the keys that the cache is responsible for; a registration
+      // at a version this thread has applied already leaves them as they are.
       LWWValue lww_value;
       lww_value.ParseFromString(tuple.payload());
 
-      StringSet key_set;
-      key_set.ParseFromString(lww_value.value());
+      CachedKeys registration;
+      registration.ParseFromString(lww_value.value());
 
-      // First, update key_to_cache_ips with dropped keys for this cache.
-
-      // Figure out which keys are in the old set of keys for this IP
-      // that are not in the new fresh set of keys for this IP.
-      // (We can do this by destructively modifying the old set of keys
-      // since we don't need it anymore.)
-      set<Key> &old_keys_for_ip = cache_ip_to_keys[cache_ip];
-      for (const auto &cache_key : key_set.keys()) {
-        old_keys_for_ip.erase(cache_key);
-      }
-      set<Key> &deleted_keys = old_keys_for_ip;
-
-      // For the keys that have been deleted from this cache,
-      // remove them from the key->caches mapping too.
-      for (const auto &key : deleted_keys) {
-        key_to_cache_ips[key].erase(cache_ip);
-      }
-
-      cache_ip_to_keys[cache_ip].clear();
-
-      // Now we can update cache_ip_to_keys,
-      // as well as add new keys to key_to_cache_ips.
-      for (const auto &cache_key : key_set.keys()) {
-        cache_ip_to_keys[cache_ip].emplace(std::move(cache_key));
-        key_to_cache_ips[cache_key].insert(cache_ip);
+      if (cache_subscriptions.update(cache_ip, registration)) {
+        cache_fanout.set_invalidations_only(
+            cache_ip, cache_subscriptions.invalidations_only(cache_ip));
       }
     }
 
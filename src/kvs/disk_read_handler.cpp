@@ -0,0 +1,55 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+void disk_read_handler(DiskReader &disk_reader, logger log,
+                       SocketCache &pushers, ResponseBatcher &batcher) {
+  vector<ParkedRead *> done;
+  disk_reader.collect(done);
+
+  for (ParkedRead *get : done) {
+    if (!get->found_) {
+      log->error("Failed to read key {} from disk.", get->key_);
+    }
+
+    // each GET is answered on its own, as when it waits for a replication
+    // factor; the batcher coalesces the answers to one request
+    if (get->address_ != "") {
+      KeyResponse response;
+      response.set_type(RequestType::GET);
+      response.set_response_id(get->response_id_);
+
+      KeyTuple *tp = response.add_tuples();
+      tp->set_key(get->key_);
+      tp->set_lattice_type(get->plan_.type_);
+
+      if (get->found_) {
+        decompress_payload(get->plan_.type_, &get->payload_, log);
+        tp->set_payload(std::move(get->payload_));
+        tp->set_error(AnnaError::NO_ERROR);
+      } else {
+        tp->set_error(AnnaError::KEY_DNE);
+      }
+
+      if (get->invalidate_) {
+        tp->set_invalidate(true);
+      }
+
+      batcher.send(get->address_, response, pushers);
+    }
+
+    delete get;
+  }
+}
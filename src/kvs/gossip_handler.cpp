@@ -18,11 +18,11 @@ void gossip_handler(unsigned &seed, string &serialized,
                     GlobalRingMap &global_hash_rings,
                     LocalRingMap &local_hash_rings,
                     map<Key, vector<PendingGossip>> &pending_gossip,
-                    map<Key, KeyProperty> &stored_key_map,
-                    map<Key, KeyReplication> &key_replication_map,
-                    ServerThread &wt, SerializerMap &serializers,
-                    SocketCache &pushers, logger log) {
-  KeyRequest gossip;
+                    StoredKeyMap &stored_key_map,
+                    KeyReplicationMap &key_replication_map, ServerThread &wt,
+                    SerializerMap &serializers, SocketCache &pushers,
+                    MessageBuffers &buffers, logger log) {
+  KeyRequest &gossip = buffers.request;
   gossip.ParseFromString(serialized);
 
   bool succeed;
@@ -30,7 +30,7 @@ void gossip_handler(unsigned &seed, string &serialized,
 
   for (const KeyTuple &tuple : gossip.tuples()) {
     // first check if the thread is responsible for the key
-    Key key = tuple.key();
+    const Key &key = tuple.key();
     ServerThreadList threads = kHashRingUtil->get_responsible_threads(
         wt.replication_response_connect_address(), key, is_metadata(key),
         global_hash_rings, local_hash_rings, key_replication_map, pushers,
@@ -62,10 +62,12 @@ void gossip_handler(unsigned &seed, string &serialized,
                               tuple.lattice_type(), tuple.payload());
           }
         } else {
-          kHashRingUtil->issue_replication_factor_request(
-              wt.replication_response_connect_address(), key,
-              global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY],
-              pushers, seed);
+          if (key_replication_map.start_request(key)) {
+            kHashRingUtil->issue_replication_factor_request(
+                wt.replication_response_connect_address(), key,
+                global_hash_rings[Tier::MEMORY],
+                local_hash_rings[Tier::MEMORY], pushers, seed);
+          }
 
           pending_gossip[key].push_back(
               PendingGossip(tuple.lattice_type(), tuple.payload()));
@@ -0,0 +1,62 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+void key_scan_handler(string &serialized, StoredKeyMap &stored_key_map,
+                      SocketCache &pushers) {
+  KeyScanRequest request;
+  request.ParseFromString(serialized);
+
+  KeyScanResponse response;
+  response.set_request_id(request.request_id());
+  response.set_shard_count(request.shard_count());
+
+  unsigned limit = request.limit() == 0
+                       ? kMaxScanPage
+                       : std::min((unsigned)request.limit(), kMaxScanPage);
+  const string &prefix = request.prefix();
+  const Key &end = request.end();
+
+  // stored keys are kept in order, so the scan starts at the first key that
+  // can be in the range and stops at the first one past it
+  auto it = request.start() < prefix
+                ? stored_key_map.lower_bound(prefix)
+                : stored_key_map.upper_bound(request.start());
+
+  for (; it != stored_key_map.end(); ++it) {
+    const Key &key = it->first;
+    if (key.compare(0, prefix.size(), prefix) != 0 ||
+        (!end.empty() && key >= end)) {
+      break;
+    }
+
+    // entries without data, and the system's own keys, are not stored keys
+    if (it->second.type_ == LatticeType::NONE || is_metadata(key)) {
+      continue;
+    }
+
+    if ((unsigned)response.keys_size() == limit) {
+      response.set_more(true);
+      break;
+    }
+
+    response.add_keys(key);
+  }
+
+  string serialized_response;
+  response.SerializeToString(&serialized_response);
+  kZmqUtil->send_string(serialized_response,
+                        &pushers[request.response_address()]);
+}
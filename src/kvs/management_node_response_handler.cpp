@@ -16,8 +16,8 @@
 
 void management_node_response_handler(string &serialized,
                                       set<Address> &extant_caches,
-                                      map<Address, set<Key>> &cache_ip_to_keys,
-                                      map<Key, set<Address>> &key_to_cache_ips,
+                                      CacheSubscriptions &cache_subscriptions,
+                                      CacheFanout &cache_fanout,
                                       GlobalRingMap &global_hash_rings,
                                       LocalRingMap &local_hash_rings,
                                       SocketCache &pushers, ServerThread &wt,
@@ -38,10 +38,8 @@ void management_node_response_handler(string &serialized,
   // (cache IPs that we were tracking but were not in the newest list of
   // caches).
   for (const auto &cache_ip : deleted_caches) {
-    cache_ip_to_keys.erase(cache_ip);
-    for (auto &key_and_caches : key_to_cache_ips) {
-      key_and_caches.second.erase(cache_ip);
-    }
+    cache_subscriptions.remove(cache_ip);
+    cache_fanout.forget(cache_ip);
   }
 
   // Get the cached keys by cache IP.
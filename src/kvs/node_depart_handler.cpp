@@ -14,9 +14,14 @@
 
 #include "kvs/kvs_handlers.hpp"
 
-void node_depart_handler(unsigned thread_id, Address public_ip,
-                         Address private_ip, GlobalRingMap &global_hash_rings,
-                         logger log, string &serialized, SocketCache &pushers) {
+void node_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
+                         Address private_ip, logger log, string &serialized,
+                         GlobalRingMap &global_hash_rings,
+                         LocalRingMap &local_hash_rings,
+                         StoredKeyMap &stored_key_map,
+                         KeyReplicationMap &key_replication_map,
+                         set<Key> &join_remove_set, SocketCache &pushers,
+                         ServerThread &wt, AddressKeysetMap &join_gossip_map) {
   vector<string> v;
   split(serialized, ':', v);
 
@@ -27,10 +32,18 @@ void node_depart_handler(unsigned thread_id, Address public_ip,
   log->info("Received departure for node {}/{} on tier {}.",
             departing_public_ip, departing_private_ip, tier);
 
-  // update hash ring
-  global_hash_rings[tier].remove(departing_public_ip, departing_private_ip, 0);
+  // update hash ring; threads reading the shared rings get the departure
+  // once thread 0 has applied and published it
+  if (!reads_shared_rings(thread_id)) {
+    global_hash_rings[tier].remove(departing_public_ip, departing_private_ip,
+                                   0);
+  }
 
   if (thread_id == 0) {
+    if (kSharedRings != nullptr) {
+      kSharedRings->publish(global_hash_rings);
+    }
+
     // tell all worker threads about the node departure
     for (unsigned tid = 1; tid < kThreadNum; tid++) {
       kZmqUtil->send_string(serialized,
@@ -43,4 +56,30 @@ void node_depart_handler(unsigned thread_id, Address public_ip,
                 pair.second.size());
     }
   }
+
+  // the departing node hands off its own keys, but with a load bound its
+  // departure can also move segments between the remaining nodes, so keys
+  // this thread no longer owns are sent on to their new owners
+  if (tier == kSelfTier && global_hash_rings[tier].load_bound() > 0) {
+    bool succeed;
+
+    for (const auto &key_pair : stored_key_map) {
+      const Key &key = key_pair.first;
+      ServerThreadList threads = kHashRingUtil->get_responsible_threads(
+          wt.replication_response_connect_address(), key, is_metadata(key),
+          global_hash_rings, local_hash_rings, key_replication_map, pushers,
+          kSelfTierIdVector, succeed, seed);
+
+      if (!succeed) {
+        log->error("Missing key replication factor in node depart routine.");
+      } else if (std::find(threads.begin(), threads.end(), wt) ==
+                 threads.end()) {
+        join_remove_set.insert(key);
+
+        for (const ServerThread &thread : threads) {
+          join_gossip_map[thread.gossip_connect_address()].insert(key);
+        }
+      }
+    }
+  }
 }
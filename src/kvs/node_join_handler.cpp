@@ -18,8 +18,8 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
                        Address private_ip, logger log, string &serialized,
                        GlobalRingMap &global_hash_rings,
                        LocalRingMap &local_hash_rings,
-                       map<Key, KeyProperty> &stored_key_map,
-                       map<Key, KeyReplication> &key_replication_map,
+                       StoredKeyMap &stored_key_map,
+                       KeyReplicationMap &key_replication_map,
                        set<Key> &join_remove_set, SocketCache &pushers,
                        ServerThread &wt, AddressKeysetMap &join_gossip_map,
                        int self_join_count) {
@@ -32,9 +32,12 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
   Address new_server_private_ip = v[2];
   int join_count = stoi(v[3]);
 
-  // update global hash ring
-  bool inserted = global_hash_rings[tier].insert(
-      new_server_public_ip, new_server_private_ip, join_count, 0);
+  // update global hash ring; threads reading the shared rings only get the
+  // join once thread 0 has inserted the node and published the rings
+  bool inserted = reads_shared_rings(thread_id) ||
+                  global_hash_rings[tier].insert(new_server_public_ip,
+                                                 new_server_private_ip,
+                                                 join_count, 0);
 
   if (inserted) {
     log->info(
@@ -55,7 +58,7 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
       // gossip the new node address between server nodes to ensure consistency
       int index = 0;
       for (const auto &pair : global_hash_rings) {
-        const GlobalHashRing hash_ring = pair.second;
+        const GlobalHashRing &hash_ring = pair.second;
         Tier tier = pair.first;
 
         for (const ServerThread &st : hash_ring.get_unique_servers()) {
@@ -73,6 +76,10 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
                   hash_ring.size());
       }
 
+      if (kSharedRings != nullptr) {
+        kSharedRings->publish(global_hash_rings);
+      }
+
       // tell all worker threads about the new node join
       for (unsigned tid = 1; tid < kThreadNum; tid++) {
         kZmqUtil->send_string(serialized,
@@ -84,8 +91,33 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
     if (tier == kSelfTier) {
       bool succeed;
 
-      for (const auto &key_pair : stored_key_map) {
-        Key key = key_pair.first;
+      // only keys that the new node is now responsible for change owners (or,
+      // on a rejoin, need to be sent back), so we just look at the keys that
+      // fall into the ring segments the new node took over
+      unsigned max_replication = kMetadataReplicationFactor;
+      for (const auto &rep_pair : key_replication_map) {
+        auto it = rep_pair.second.global_replication_.find(kSelfTier);
+        if (it != rep_pair.second.global_replication_.end()) {
+          max_replication = std::max(max_replication, it->second);
+        }
+      }
+
+      // with a load bound, the join can also move segments between other
+      // nodes, so every key is checked
+      set<Key> affected_keys;
+      if (global_hash_rings[tier].load_bound() > 0) {
+        for (const auto &key_pair : stored_key_map) {
+          affected_keys.insert(key_pair.first);
+        }
+      } else {
+        for (const auto &range : global_hash_rings[tier].owned_ranges(
+                 new_server_private_ip, max_replication)) {
+          stored_key_map.keys_in_range(range.first, range.second,
+                                       affected_keys);
+        }
+      }
+
+      for (const Key &key : affected_keys) {
         ServerThreadList threads = kHashRingUtil->get_responsible_threads(
             wt.replication_response_connect_address(), key, is_metadata(key),
             global_hash_rings, local_hash_rings, key_replication_map, pushers,
@@ -98,10 +130,7 @@ void node_join_handler(unsigned thread_id, unsigned &seed, Address public_ip,
           // the key
           // 2) if the node is rejoining the cluster, and it is responsible for
           // the key
-          // NOTE: This is currently inefficient because every server will
-          // gossip the key currently -- we might be able to hack around the
-          // has ring to do it more efficiently, but I'm leaving this here for
-          // now
+          // NOTE: every replica of the key gossips it to the new node
           bool rejoin_responsible = false;
           if (join_count > 0) {
             for (const ServerThread &thread : threads) {
@@ -14,11 +14,33 @@
 
 #include "kvs/kvs_handlers.hpp"
 
+// whether every value factor sets is already the one in replication
+static bool in_place(const ReplicationFactor &factor,
+                     const KeyReplication &replication) {
+  for (const auto &global : factor.global()) {
+    auto it = replication.global_replication_.find(global.tier());
+    if (it == replication.global_replication_.end() ||
+        it->second != global.value()) {
+      return false;
+    }
+  }
+
+  for (const auto &local : factor.local()) {
+    auto it = replication.local_replication_.find(local.tier());
+    if (it == replication.local_replication_.end() ||
+        it->second != local.value()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 void replication_change_handler(
     Address public_ip, Address private_ip, unsigned thread_id, unsigned &seed,
     logger log, string &serialized, GlobalRingMap &global_hash_rings,
-    LocalRingMap &local_hash_rings, map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
+    LocalRingMap &local_hash_rings, StoredKeyMap &stored_key_map,
+    KeyReplicationMap &key_replication_map, LocalChangeset &local_changeset,
     ServerThread &wt, SerializerMap &serializers, SocketCache &pushers) {
   log->info("Received a replication factor change.");
   if (thread_id == 0) {
@@ -42,6 +64,18 @@ void replication_change_handler(
 
   for (const ReplicationFactor &key_rep : rep_change.updates()) {
     Key key = key_rep.key();
+
+    // a change that was to drop this thread's copy has arrived; if the copy
+    // stays after all, it may be chosen for eviction again
+    stored_key_map.end_drop(key);
+
+    // a factor that is already in place changes no owners, so there is
+    // nothing to look up or move
+    auto current = key_replication_map.find(key);
+    if (current != key_replication_map.end() &&
+        in_place(key_rep, current->second)) {
+      continue;
+    }
     // if this thread has the key stored before the change
     if (stored_key_map.find(key) != stored_key_map.end()) {
       ServerThreadList orig_threads = kHashRingUtil->get_responsible_threads(
@@ -14,25 +14,49 @@
 
 #include "kvs/kvs_handlers.hpp"
 
+// folds payload, a write of type that waited on the key's replication
+// factor, into merged; of two LWW writes the later one wins, which their
+// timestamps tell without parsing either
+static void merge_pending_write(LatticeType type, string &merged,
+                                const string &payload) {
+  uint64_t merged_timestamp, timestamp;
+
+  if (type == LatticeType::LWW && peek_lww(merged, merged_timestamp) &&
+      peek_lww(payload, timestamp) && timestamp != merged_timestamp) {
+    if (timestamp > merged_timestamp) {
+      merged = payload;
+    }
+
+    return;
+  }
+
+  merged = merge_serialized(type, merged, payload);
+}
+
 void replication_response_handler(
     unsigned &seed, unsigned &access_count, logger log, string &serialized,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
     map<Key, vector<PendingRequest>> &pending_requests,
     map<Key, vector<PendingGossip>> &pending_gossip,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
-    map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers) {
-  KeyResponse response;
+    KeyAccessTracker &key_access_tracker, StoredKeyMap &stored_key_map,
+    KeyReplicationMap &key_replication_map, LocalChangeset &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    ResponseBatcher &batcher, MessageBuffers &buffers) {
+  KeyResponse &response = buffers.response;
   response.ParseFromString(serialized);
+  replica_selector().answered(response.response_id());
 
   // we assume tuple 0 because there should only be one tuple responding to a
   // replication factor request
-  KeyTuple tuple = response.tuples(0);
+  const KeyTuple &tuple = response.tuples(0);
   Key key = get_key_from_metadata(tuple.key());
 
   AnnaError error = tuple.error();
 
+  if (error == AnnaError::NO_ERROR || error == AnnaError::KEY_DNE) {
+    key_replication_map.finish_request(key);
+  }
+
   if (error == AnnaError::NO_ERROR) {
     LWWValue lww_value;
     lww_value.ParseFromString(tuple.payload());
@@ -51,9 +75,10 @@ void replication_response_handler(
     // KEY_DNE means that the receiving thread was responsible for the metadata
     // but didn't have any values stored -- we use the default rep factor
     init_replication(key_replication_map, key);
-  } else if (error == AnnaError::WRONG_THREAD) {
+  } else if (error == AnnaError::WRONG_THREAD || error == kOverloadedError) {
     // this means that the node that received the rep factor request was not
-    // responsible for that metadata
+    // responsible for that metadata, or was too busy to answer; the request
+    // is sent again, most likely to another replica
     auto respond_address = wt.replication_response_connect_address();
     kHashRingUtil->issue_replication_factor_request(
         respond_address, key, global_hash_rings[Tier::MEMORY],
@@ -76,100 +101,130 @@ void replication_response_handler(
     if (succeed) {
       bool responsible =
           std::find(threads.begin(), threads.end(), wt) != threads.end();
+      const vector<PendingRequest> &requests = pending_requests[key];
 
-      for (const PendingRequest &request : pending_requests[key]) {
-        auto now = std::chrono::system_clock::now();
-
-        if (!responsible && request.addr_ != "") {
-          KeyResponse response;
+      // every write is folded into one, which is applied before any of the
+      // reads, so they can all be answered with a single read
+      vector<bool> applied(requests.size(), false);
+      if (responsible) {
+        LatticeType type = LatticeType::NONE;
+        if (stored_key_map.find(key) != stored_key_map.end()) {
+          type = stored_key_map[key].type_;
+        }
 
-          response.set_type(request.type_);
+        string merged;
+        bool merging = false;
 
-          if (request.response_id_ != "") {
-            response.set_response_id(request.response_id_);
+        for (unsigned i = 0; i < requests.size(); i++) {
+          const PendingRequest &request = requests[i];
+          if (request.type_ != RequestType::PUT) {
+            continue;
           }
 
-          KeyTuple *tp = response.add_tuples();
-          tp->set_key(key);
-          tp->set_error(AnnaError::WRONG_THREAD);
+          if (request.lattice_type_ == LatticeType::NONE) {
+            log->error("PUT request missing lattice type.");
+          } else if (type != LatticeType::NONE &&
+                     type != request.lattice_type_) {
+            log->error(
+                "Lattice type mismatch for key {}: {} from query but {} "
+                "expected.",
+                key, LatticeType_Name(request.lattice_type_),
+                LatticeType_Name(type));
+          } else {
+            type = request.lattice_type_;
+            applied[i] = true;
 
-          string serialized_response;
-          response.SerializeToString(&serialized_response);
-          kZmqUtil->send_string(serialized_response, &pushers[request.addr_]);
-        } else if (responsible && request.addr_ == "") {
-          // only put requests should fall into this category
-          if (request.type_ == RequestType::PUT) {
-            if (request.lattice_type_ == LatticeType::NONE) {
-              log->error("PUT request missing lattice type.");
-            } else if (stored_key_map.find(key) != stored_key_map.end() &&
-                       stored_key_map[key].type_ != LatticeType::NONE &&
-                       stored_key_map[key].type_ != request.lattice_type_) {
-
-              log->error(
-                  "Lattice type mismatch for key {}: query is {} but we expect "
-                  "{}.",
-                  key, LatticeType_Name(request.lattice_type_),
-                  LatticeType_Name(stored_key_map[key].type_));
+            if (merging) {
+              merge_pending_write(type, merged, request.payload_);
             } else {
-              process_put(key, request.lattice_type_, request.payload_,
-                          serializers[request.lattice_type_], stored_key_map);
-              key_access_tracker[key].insert(now);
-
-              access_count += 1;
-              local_changeset.insert(key);
+              merged = request.payload_;
+              merging = true;
             }
-          } else {
-            log->error("Received a GET request with no response address.");
           }
-        } else if (responsible && request.addr_ != "") {
-          KeyResponse response;
+        }
 
-          response.set_type(request.type_);
+        if (merging) {
+          process_put(key, type, merged, serializers[type], stored_key_map);
+          local_changeset.insert(key, type, merged);
+        }
+      }
+
+      // the answer to every read, made on the first one
+      KeyTuple read;
+      bool have_read = false;
+
+      // the responses, by the address they go to
+      map<Address, vector<KeyResponse>> responses;
+
+      for (unsigned i = 0; i < requests.size(); i++) {
+        const PendingRequest &request = requests[i];
+
+        if (request.addr_ == "") {
+          // only put requests should fall into this category
+          if (responsible && request.type_ == RequestType::GET) {
+            log->error("Received a GET request with no response address.");
+          } else if (applied[i]) {
+            key_access_tracker.record(key);
+            stored_key_map.touch(key);
+            access_count += 1;
+          }
+        } else {
+          vector<KeyResponse> &batch = responses[request.addr_];
+          batch.push_back(KeyResponse());
+          batch.back().set_type(request.type_);
 
           if (request.response_id_ != "") {
-            response.set_response_id(request.response_id_);
+            batch.back().set_response_id(request.response_id_);
           }
 
-          KeyTuple *tp = response.add_tuples();
+          KeyTuple *tp = batch.back().add_tuples();
           tp->set_key(key);
 
-          if (request.type_ == RequestType::GET) {
-            if (stored_key_map.find(key) == stored_key_map.end() ||
-                stored_key_map[key].type_ == LatticeType::NONE) {
-              tp->set_error(AnnaError::KEY_DNE);
-            } else {
-              auto res =
-                  process_get(key, serializers[stored_key_map[key].type_]);
-              tp->set_lattice_type(stored_key_map[key].type_);
-              tp->set_payload(res.first);
-              tp->set_error(res.second);
-            }
-          } else {
-            if (request.lattice_type_ == LatticeType::NONE) {
-              log->error("PUT request missing lattice type.");
-            } else if (stored_key_map.find(key) != stored_key_map.end() &&
-                       stored_key_map[key].type_ != LatticeType::NONE &&
-                       stored_key_map[key].type_ != request.lattice_type_) {
-              log->error(
-                  "Lattice type mismatch for key {}: {} from query but {} "
-                  "expected.",
-                  key, LatticeType_Name(request.lattice_type_),
-                  LatticeType_Name(stored_key_map[key].type_));
-            } else {
-              process_put(key, request.lattice_type_, request.payload_,
-                          serializers[request.lattice_type_], stored_key_map);
-              tp->set_lattice_type(request.lattice_type_);
-              local_changeset.insert(key);
+          if (!responsible) {
+            tp->set_error(AnnaError::WRONG_THREAD);
+          } else if (request.type_ == RequestType::GET) {
+            if (!have_read) {
+              read.set_key(key);
+
+              if (stored_key_map.find(key) == stored_key_map.end() ||
+                  stored_key_map[key].type_ == LatticeType::NONE) {
+                read.set_error(AnnaError::KEY_DNE);
+              } else {
+                read.set_lattice_type(stored_key_map[key].type_);
+                read.set_error(
+                    process_get(key, serializers[stored_key_map[key].type_],
+                                read.mutable_payload()));
+                decompress_payload(read.lattice_type(), read.mutable_payload(),
+                                   log);
+              }
+
+              have_read = true;
             }
+
+            *tp = read;
+          } else if (applied[i]) {
+            tp->set_lattice_type(request.lattice_type_);
           }
-          key_access_tracker[key].insert(now);
-          access_count += 1;
 
-          string serialized_response;
-          response.SerializeToString(&serialized_response);
-          kZmqUtil->send_string(serialized_response, &pushers[request.addr_]);
+          if (responsible) {
+            key_access_tracker.record(key);
+            stored_key_map.touch(key);
+            access_count += 1;
+          }
+        }
+
+        if (kTracer != nullptr && request.trace_.sampled()) {
+          kTracer->record(request.trace_, new_span_id(seed), "kvs.pending",
+                          request.parked_, trace_time(), {},
+                          {{"key", key},
+                           {"responsible", responsible ? "true" : "false"},
+                           {"thread", std::to_string(wt.tid())}});
         }
       }
+
+      for (const auto &pair : responses) {
+        batcher.send_all(pair.first, pair.second, pushers);
+      }
     } else {
       log->error(
           "Missing key replication factor in process pending request routine.");
@@ -18,13 +18,15 @@ void self_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
                          Address private_ip, logger log, string &serialized,
                          GlobalRingMap &global_hash_rings,
                          LocalRingMap &local_hash_rings,
-                         map<Key, KeyProperty> &stored_key_map,
-                         map<Key, KeyReplication> &key_replication_map,
+                         StoredKeyMap &stored_key_map,
+                         KeyReplicationMap &key_replication_map,
                          vector<Address> &routing_ips,
                          vector<Address> &monitoring_ips, ServerThread &wt,
-                         SocketCache &pushers, SerializerMap &serializers) {
+                         SocketCache &pushers, DepartPlan &depart_plan) {
   log->info("This node is departing.");
-  global_hash_rings[kSelfTier].remove(public_ip, private_ip, 0);
+  if (!reads_shared_rings(thread_id)) {
+    global_hash_rings[kSelfTier].remove(public_ip, private_ip, 0);
+  }
 
   // thread 0 notifies other nodes in the cluster (of all types) that it is
   // leaving the cluster
@@ -32,7 +34,7 @@ void self_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
     string msg = Tier_Name(kSelfTier) + ":" + public_ip + ":" + private_ip;
 
     for (const auto &pair : global_hash_rings) {
-      GlobalHashRing hash_ring = pair.second;
+      const GlobalHashRing &hash_ring = pair.second;
 
       for (const ServerThread &st : hash_ring.get_unique_servers()) {
         kZmqUtil->send_string(msg, &pushers[st.node_depart_connect_address()]);
@@ -53,6 +55,10 @@ void self_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
           msg, &pushers[MonitoringThread(address).notify_connect_address()]);
     }
 
+    if (kSharedRings != nullptr) {
+      kSharedRings->publish(global_hash_rings);
+    }
+
     // tell all worker threads about the self departure
     for (unsigned tid = 1; tid < kThreadNum; tid++) {
       kZmqUtil->send_string(serialized,
@@ -61,29 +67,18 @@ void self_depart_handler(unsigned thread_id, unsigned &seed, Address public_ip,
     }
   }
 
-  AddressKeysetMap addr_keyset_map;
-  bool succeed;
+  // the event loop walks the plan, streams the keys to their new owners, and
+  // acknowledges the departure once it is done; with nothing to hand off,
+  // acknowledge now
+  depart_plan.start(global_hash_rings, stored_key_map);
 
-  for (const auto &key_pair : stored_key_map) {
-    Key key = key_pair.first;
-    ServerThreadList threads = kHashRingUtil->get_responsible_threads(
-        wt.replication_response_connect_address(), key, is_metadata(key),
-        global_hash_rings, local_hash_rings, key_replication_map, pushers,
-        kAllTiers, succeed, seed);
-
-    if (succeed) {
-      // since we already removed this node from the hash ring, no need to
-      // exclude it explicitly
-      for (const ServerThread &thread : threads) {
-        addr_keyset_map[thread.gossip_connect_address()].insert(key);
-      }
-    } else {
-      log->error("Missing key replication factor in node depart routine");
-    }
+  if (!depart_plan.active()) {
+    kZmqUtil->send_string(public_ip + "_" + private_ip + "_" +
+                              Tier_Name(kSelfTier),
+                          &pushers[serialized]);
+    return;
   }
 
-  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
-  kZmqUtil->send_string(public_ip + "_" + private_ip + "_" +
-                            Tier_Name(kSelfTier),
-                        &pushers[serialized]);
+  log->info("Handing off {} keys in {} hash ranges.", stored_key_map.indexed(),
+            depart_plan.ranges());
 }
@@ -12,7 +12,18 @@
 //  See the License for the specific language governing permissions and
 //  limitations under the License.
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "kvs/key_size_reporter.hpp"
 #include "kvs/kvs_handlers.hpp"
+#include "kvs/loop_clock.hpp"
+#include "kvs/memory_snapshot.hpp"
+#include "kvs/server_metrics.hpp"
+#include "kvs/stats_report_builder.hpp"
 #include "yaml-cpp/yaml.h"
 
 // define server report threshold (in second)
@@ -38,20 +49,183 @@ unsigned kDefaultLocalReplication;
 
 hmap<Tier, TierMetadata, TierEnumHash> kTierMetadata;
 
+// the maximum number of messages handled per socket on each wakeup, by socket
+// class: user requests and replication responses, gossip, and everything else
+unsigned kRequestDrainBudget;
+unsigned kGossipDrainBudget;
+unsigned kControlDrainBudget;
+
+// the longest an idle thread blocks in poll (in milliseconds)
+long kMaxPollTimeout;
+
+// how long a response may be held back to share a send with others bound for
+// the same address (in microseconds, 0 disables batching), and the number of
+// buffered tuples that forces a flush
+unsigned kResponseBatchDelay;
+unsigned kResponseBatchSize;
+
+// the gossip period (in microseconds), the changeset size that starts a round
+// early, and the number of keys gossiped per event loop iteration
+long kGossipPeriod;
+unsigned kGossipFlushThreshold;
+unsigned kGossipBatchSize;
+
+// the shortest time between two updates to the same cache (in milliseconds);
+// the keys that change in between are sent together in the next one
+unsigned kCacheUpdateInterval;
+
+// the number of hottest keys, and the dimensions of the access count sketch,
+// in each stats report to the monitoring nodes, and the number of keys
+// summed up into a report per event loop iteration
+unsigned kStatsHotKeys;
+unsigned kStatsSketchWidth;
+unsigned kStatsSketchDepth;
+unsigned kStatsReportBatchSize;
+
+// the bytes of keys each memory tier thread may store before it evicts some,
+// and the size an eviction pass brings the store down to; a budget of 0
+// leaves the store unbounded
+unsigned long long kMemoryBudget;
+unsigned long long kEvictionTarget;
+
+// where memory tier threads keep their snapshots (empty if they keep none),
+// the time between the starts of two snapshots (in seconds), and the number
+// of keys written per event loop iteration
+string kSnapshotDir;
+unsigned kSnapshotPeriod;
+unsigned kSnapshotBatchSize;
+
+// the size (in bytes) from which LWW values are stored compressed; 0
+// disables compression
+unsigned kCompressionThreshold;
+
+// the number of I/O threads each disk thread reads its GETs with; with none,
+// the disk thread reads them itself
+unsigned kDiskReadThreads;
+
+// where disk threads keep their logs, and the bytes of values each one
+// caches (see create_log_store)
+string kEbsRoot;
+unsigned long long kDiskReadCacheBytes;
+
+// how long (in milliseconds) a thread's request socket may stay backlogged
+// before the thread sheds requests, 0 if it never does, and the requests the
+// socket queues before senders have to wait (0 keeps the ZMQ default)
+unsigned kMaxRequestBacklog;
+int kRequestQueueLimit;
+
+// the GETs of a key within one interval (in milliseconds) that make a memory
+// thread replicate it to every thread on its node (0 if they never do), and
+// how long (in seconds) the key must stay cold before the thread undoes that
+unsigned kHotKeyThreshold;
+unsigned kHotKeyInterval;
+unsigned kHotKeyHold;
+
+// where memory tier threads keep their write-ahead logs (empty if they keep
+// none), how long a write may wait for its group commit (in microseconds),
+// and the bytes of uncommitted writes that force a commit
+string kWalDir;
+unsigned kWalMaxDelay;
+unsigned kWalMaxBatch;
+
+// the character that ends the tenant prefix of a key (0 if threads do not
+// track tenants), and the quota each thread holds a tenant to, by tenant
+char kTenantDelimiter;
+TenantQuota kDefaultTenantQuota;
+map<string, TenantQuota> kTenantQuotas;
+
+// the mailboxes worker threads hand requests over through, if enabled
+IntraNodeMailboxes *kIntraNodeMailboxes = nullptr;
+
+// the latest metrics of every worker thread, served to Prometheus scrapes;
+// null unless the metrics endpoint is enabled
+MetricsRegistry *kMetricsRegistry = nullptr;
+
+// when the process started, which each thread's startup time is measured from
+std::chrono::steady_clock::time_point kProcessStart;
+
+// writes the spans of sampled requests; null unless tracing is enabled
+Tracer *kTracer = nullptr;
+
+// records the requests of sampled keys; null unless workload capture is
+// enabled
+WorkloadRecorder *kWorkloadRecorder = nullptr;
+
+SharedRings shared_rings;
+SharedRings *kSharedRings = &shared_rings;
+
+// the core each worker thread is pinned to, by thread id, and the cores the
+// ZMQ I/O threads may run on; both are empty unless pinning is enabled
+vector<int> kWorkerCores;
+vector<int> kIoCores;
+
 ZmqUtil zmq_util;
 ZmqUtilInterface *kZmqUtil = &zmq_util;
 
 HashRingUtil hash_ring_util;
 HashRingUtilInterface *kHashRingUtil = &hash_ring_util;
 
-void run(unsigned thread_id, Address public_ip, Address private_ip,
-         Address seed_ip, vector<Address> routing_ips,
+// pins the calling thread to core; memory the thread touches first, such as
+// its store arenas, then comes from that core's NUMA node under the kernel's
+// default first-touch policy
+void pin_thread(unsigned thread_id, int core, logger log) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+
+  int res = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (res != 0) {
+    log->error("Failed to pin thread {} to core {} ({}).", thread_id, core,
+               strerror(res));
+    return;
+  }
+
+  unsigned cpu = 0;
+  unsigned node = 0;
+  syscall(SYS_getcpu, &cpu, &node, nullptr);
+  log->info("Thread {} is pinned to core {} on NUMA node {}.", thread_id, cpu,
+            node);
+#else
+  log->error("Thread pinning is only supported on Linux.");
+#endif
+}
+
+// reads a tenant's quota from its section of the tenants configuration; a
+// limit that is left out is no limit
+TenantQuota read_tenant_quota(const YAML::Node &node) {
+  TenantQuota quota;
+
+  if (node) {
+    if (YAML::Node rate = node["rate"]) {
+      quota.rate = rate.as<double>();
+    }
+
+    if (YAML::Node burst = node["burst"]) {
+      quota.burst = burst.as<double>();
+    }
+
+    if (YAML::Node memory = node["memory-quota"]) {
+      quota.memory = memory.as<unsigned long long>();
+    }
+  }
+
+  return quota;
+}
+
+void run(zmq::context_t &context, unsigned thread_id, Address public_ip,
+         Address private_ip, Address seed_ip, vector<Address> routing_ips,
          vector<Address> monitoring_ips, Address management_ip) {
   string log_file = "log_" + std::to_string(thread_id) + ".txt";
   string log_name = "server_log_" + std::to_string(thread_id);
   auto log = spdlog::basic_logger_mt(log_name, log_file, true);
   log->flush_on(spdlog::level::info);
 
+  // pin before anything is allocated, so this thread's data stays local
+  if (thread_id < kWorkerCores.size()) {
+    pin_thread(thread_id, kWorkerCores[thread_id], log);
+  }
+
   // each thread has a handle to itself
   ServerThread wt = ServerThread(public_ip, private_ip, thread_id);
 
@@ -61,21 +235,22 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   // A monotonically increasing integer.
   unsigned rid = 0;
 
-  // prepare the zmq context
-  zmq::context_t context(1);
+  SocketCache pushers(&context, ZMQ_PUSH);
 
-  auto res = context.setctxopt(ZMQ_MAX_SOCKETS, kMaxSocketNumber);
-  if (res == 0) {
-    log->info("Successfully set max socket number to {}", kMaxSocketNumber);
-  } else {
-    log->error("E: socket error number {} ({})", errno, zmq_strerror(errno));
-  }
+  // messages to the other threads on this node stay inside the process
+  connect_local_threads(pushers, wt, kThreadNum);
 
-  SocketCache pushers(&context, ZMQ_PUSH);
+  // holds client responses back briefly so they can share a send
+  ResponseBatcher batcher(kResponseBatchDelay, kResponseBatchSize);
+
+  // the request and response messages every request is parsed into and
+  // answered with
+  MessageBuffers buffers;
 
-  // initialize hash ring maps
-  GlobalRingMap global_hash_rings;
-  LocalRingMap local_hash_rings;
+  // thread 0 builds the hash rings and keeps its own copy of the global rings
+  // to apply membership changes to; the other threads read the copies it
+  // publishes
+  std::shared_ptr<GlobalRingMap> global_hash_rings;
 
   // for periodically redistributing data when node joins
   AddressKeysetMap join_gossip_map;
@@ -83,78 +258,98 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   // keep track of which key should be removed when node joins
   set<Key> join_remove_set;
 
+  // set once this thread has been asked to depart; it exits after the rest
+  // of its data has been handed off and the departure acknowledged here
+  Address depart_done_address = "";
+
+  // the keys this thread has left to hand off once it is departing
+  DepartPlan depart_plan;
+
+  // whether every address with pending migration data could not be sent to
+  bool migration_blocked = false;
+
   // for tracking IP addresses of extant caches
   set<Address> extant_caches;
 
-  // For tracking the keys each extant cache is responsible for.
+  // For tracking the keys each extant cache is responsible for, and the
+  // caches that hold a given key, which is what gossip needs.
   // This is just our thread's cache of this.
-  map<Address, set<Key>> cache_ip_to_keys;
+  CacheSubscriptions cache_subscriptions;
 
-  // For tracking the caches that hold a given key.
-  // Inverse of cache_ip_to_keys.
-  // We need the two structures because
-  // key->caches is the one necessary for gossiping upon key updates,
-  // but the mapping is provided to us in the form cache->keys,
-  // so we need a local copy of this mapping in order to update key->caches
-  // with dropped keys when we receive a fresh cache->keys record.
-  map<Key, set<Address>> key_to_cache_ips;
+  // the changed keys on their way to the caches that hold them
+  CacheFanout cache_fanout(kCacheUpdateInterval);
 
   // pending events for asynchrony
   map<Key, vector<PendingRequest>> pending_requests;
   map<Key, vector<PendingGossip>> pending_gossip;
 
   // this map contains all keys that are actually stored in the KVS
-  map<Key, KeyProperty> stored_key_map;
-
-  map<Key, KeyReplication> key_replication_map;
-
-  // request server addresses from the seed node
-  zmq::socket_t addr_requester(context, ZMQ_REQ);
-  addr_requester.connect(RoutingThread(seed_ip, 0).seed_connect_address());
-  kZmqUtil->send_string("join", &addr_requester);
-
-  // receive and add all the addresses that seed node sent
-  string serialized_addresses = kZmqUtil->recv_string(&addr_requester);
-  ClusterMembership membership;
-  membership.ParseFromString(serialized_addresses);
-
-  // get join number from management node if we are running in Kubernetes
-  string count_str;
-
-  // if we are running the system outside of Kubernetes, we need to set the
-  // management address to NULL in the conf file, otherwise we will hang
-  // forever waiting to hear back about a restart count
-  if (management_ip != "NULL") {
-    zmq::socket_t join_count_requester(context, ZMQ_REQ);
-    join_count_requester.connect(get_join_count_req_address(management_ip));
-    kZmqUtil->send_string("restart:" + private_ip, &join_count_requester);
-    count_str = kZmqUtil->recv_string(&join_count_requester);
-  } else {
-    count_str = "0";
+  StoredKeyMap stored_key_map;
+  if (kTenantDelimiter != 0) {
+    stored_key_map.track_tenants(kTenantDelimiter);
   }
 
-  int self_join_count = stoi(count_str);
+  KeyReplicationMap key_replication_map;
 
-  // populate addresses
-  for (const auto &tier : membership.tiers()) {
-    Tier id = tier.tier_id();
+  string count_str = "0";
+  int self_join_count = 0;
 
-    for (const auto server : tier.servers()) {
-      global_hash_rings[id].insert(server.public_ip(), server.private_ip(), 0,
-                                   0);
+  if (thread_id == 0) {
+    global_hash_rings = std::make_shared<GlobalRingMap>();
+
+    // request server addresses from the seed node
+    zmq::socket_t addr_requester(context, ZMQ_REQ);
+    addr_requester.connect(RoutingThread(seed_ip, 0).seed_connect_address());
+    kZmqUtil->send_string("join", &addr_requester);
+
+    // receive and add all the addresses that seed node sent
+    string serialized_addresses = kZmqUtil->recv_string(&addr_requester);
+    ClusterMembership membership;
+    membership.ParseFromString(serialized_addresses);
+
+    // get join number from management node if we are running in Kubernetes;
+    // if we are running the system outside of Kubernetes, we need to set the
+    // management address to NULL in the conf file, otherwise we will hang
+    // forever waiting to hear back about a restart count
+    if (management_ip != "NULL") {
+      zmq::socket_t join_count_requester(context, ZMQ_REQ);
+      join_count_requester.connect(get_join_count_req_address(management_ip));
+      kZmqUtil->send_string("restart:" + private_ip, &join_count_requester);
+      count_str = kZmqUtil->recv_string(&join_count_requester);
     }
-  }
 
-  // add itself to global hash ring
-  global_hash_rings[kSelfTier].insert(public_ip, private_ip, self_join_count,
-                                      0);
+    self_join_count = stoi(count_str);
+
+    // every tier gets a ring, so that the other threads' lookups never add
+    // one to a published copy
+    for (const Tier &tier : kAllTiers) {
+      (*global_hash_rings)[tier];
+    }
+
+    // populate addresses
+    for (const auto &tier : membership.tiers()) {
+      Tier id = tier.tier_id();
+
+      for (const auto server : tier.servers()) {
+        (*global_hash_rings)[id].insert(server.public_ip(),
+                                        server.private_ip(), 0, 0);
+      }
+    }
 
-  // form local hash rings
-  for (const auto &pair : kTierMetadata) {
-    TierMetadata tier = pair.second;
-    for (unsigned tid = 0; tid < tier.thread_number_; tid++) {
-      local_hash_rings[tier.id_].insert(public_ip, private_ip, 0, tid);
+    // add itself to global hash ring
+    (*global_hash_rings)[kSelfTier].insert(public_ip, private_ip,
+                                           self_join_count, 0);
+
+    // form local hash rings
+    LocalRingMap local_hash_rings;
+    for (const auto &pair : kTierMetadata) {
+      TierMetadata tier = pair.second;
+      for (unsigned tid = 0; tid < tier.thread_number_; tid++) {
+        local_hash_rings[tier.id_].insert(public_ip, private_ip, 0, tid);
+      }
     }
+
+    kSharedRings->init(*global_hash_rings, local_hash_rings);
   }
 
   // thread 0 notifies other servers that it has joined
@@ -162,8 +357,8 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
     string msg = Tier_Name(kSelfTier) + ":" + public_ip + ":" + private_ip +
                  ":" + count_str;
 
-    for (const auto &pair : global_hash_rings) {
-      GlobalHashRing hash_ring = pair.second;
+    for (const auto &pair : *global_hash_rings) {
+      const GlobalHashRing &hash_ring = pair.second;
 
       for (const ServerThread &st : hash_ring.get_unique_servers()) {
         if (st.private_ip().compare(private_ip) != 0) {
@@ -196,6 +391,12 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   Serializer *mk_causal_serializer;
   Serializer *priority_serializer;
 
+  // the append-only store backing every serializer on a disk thread
+  LogStore *log_store = nullptr;
+
+  // the I/O threads that read the store for GETs, if there are any
+  DiskReader *disk_reader = nullptr;
+
   if (kSelfTier == Tier::MEMORY) {
     MemoryLWWKVS *lww_kvs = new MemoryLWWKVS();
     lww_serializer = new MemoryLWWSerializer(lww_kvs);
@@ -217,12 +418,20 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
     MemoryPriorityKVS *priority_kvs = new MemoryPriorityKVS();
     priority_serializer = new MemoryPrioritySerializer(priority_kvs);
   } else if (kSelfTier == Tier::DISK) {
-    lww_serializer = new DiskLWWSerializer(thread_id);
-    set_serializer = new DiskSetSerializer(thread_id);
-    ordered_set_serializer = new DiskOrderedSetSerializer(thread_id);
-    sk_causal_serializer = new DiskSingleKeyCausalSerializer(thread_id);
-    mk_causal_serializer = new DiskMultiKeyCausalSerializer(thread_id);
-    priority_serializer = new DiskPrioritySerializer(thread_id);
+    log_store = create_log_store(thread_id, kEbsRoot, kDiskReadCacheBytes);
+    lww_serializer = new DiskSerializer(log_store, LatticeType::LWW);
+    set_serializer = new DiskSerializer(log_store, LatticeType::SET);
+    ordered_set_serializer =
+        new DiskSerializer(log_store, LatticeType::ORDERED_SET);
+    sk_causal_serializer =
+        new DiskSerializer(log_store, LatticeType::SINGLE_CAUSAL);
+    mk_causal_serializer =
+        new DiskSerializer(log_store, LatticeType::MULTI_CAUSAL);
+    priority_serializer = new DiskSerializer(log_store, LatticeType::PRIORITY);
+
+    if (kDiskReadThreads > 0) {
+      disk_reader = new DiskReader(log_store, kDiskReadThreads);
+    }
   } else {
     log->info("Invalid node type");
     exit(1);
@@ -235,53 +444,148 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
   serializers[LatticeType::MULTI_CAUSAL] = mk_causal_serializer;
   serializers[LatticeType::PRIORITY] = priority_serializer;
 
+  if (kCompressionThreshold > 0) {
+    serializers[LatticeType::LWW] = new CompressedLWWSerializer(
+        serializers[LatticeType::LWW], kCompressionThreshold);
+  }
+
   // the set of changes made on this thread since the last round of gossip
-  set<Key> local_changeset;
+  LocalChangeset local_changeset;
+
+  // the snapshot this thread restarts from, if snapshots are enabled
+  MemorySnapshot *snapshot = nullptr;
+
+  if (kSnapshotDir != "" && kSelfTier == Tier::MEMORY) {
+    snapshot = new MemorySnapshot(kSnapshotDir, thread_id);
+
+    // serve the keys of the last run right away; anything newer that the
+    // peers send back is merged into them
+    uint64_t restored = MemorySnapshot::load(
+        snapshot->path(),
+        [&](const Key &key, LatticeType type, const string &payload) {
+          if (serializers.find(type) != serializers.end()) {
+            process_put(key, type, payload, serializers[type], stored_key_map);
+          }
+        });
+
+    log->info("Restored {} keys ({} bytes) from {}.", restored,
+              stored_key_map.bytes(), snapshot->path());
+  }
+
+  // the log of the writes this thread applied, if write-ahead logging is
+  // enabled
+  WriteAheadLog *wal = nullptr;
+
+  if (kWalDir != "" && kSelfTier == Tier::MEMORY) {
+    wal = new WriteAheadLog(kWalDir, thread_id, kWalMaxDelay, kWalMaxBatch);
+
+    // the writes since the last snapshot are replayed before the serializers
+    // start logging, so they are not logged again
+    unsigned replayed = wal->recover([&](const Key &key, LatticeType type,
+                                         const string &payload,
+                                         bool tombstone) {
+      if (serializers.find(type) == serializers.end()) {
+        return;
+      }
+
+      if (tombstone) {
+        serializers[type]->remove(key);
+        stored_key_map.erase(key);
+      } else {
+        process_put(key, type, payload, serializers[type], stored_key_map);
+      }
+    });
+
+    log->info("Replayed {} logged writes.", replayed);
+
+    for (auto &pair : serializers) {
+      pair.second = new LoggedSerializer(pair.second, wal, pair.first);
+    }
+
+    batcher.hold();
+  }
+
+  // the other threads build and recover their stores while thread 0 fetches
+  // the membership and builds the rings, and only then wait for them
+  if (thread_id != 0) {
+    kSharedRings->wait();
+    global_hash_rings = kSharedRings->global();
+  }
+
+  LocalRingMap &local_hash_rings = kSharedRings->local();
 
   // keep track of the key stat
   // the first entry is the size of the key,
   // the second entry is its lattice type.
   // keep track of key access timestamp
-  map<Key, std::multiset<TimePoint>> key_access_tracker;
+  KeyAccessTracker key_access_tracker(kKeyMonitoringThreshold);
+  // decides which key sizes the stats reports carry
+  KeySizeReporter key_size_reporter;
+  // the stats report being built for the monitoring nodes
+  StatsReportBuilder report_builder;
   // keep track of total access
   unsigned access_count;
 
   // listens for a new node joining
   zmq::socket_t join_puller(context, ZMQ_PULL);
-  join_puller.bind(wt.node_join_bind_address());
+  bind_with_inproc(join_puller, wt.node_join_bind_address());
 
   // listens for a node departing
   zmq::socket_t depart_puller(context, ZMQ_PULL);
-  depart_puller.bind(wt.node_depart_bind_address());
+  bind_with_inproc(depart_puller, wt.node_depart_bind_address());
 
   // responsible for listening for a command that this node should leave
   zmq::socket_t self_depart_puller(context, ZMQ_PULL);
-  self_depart_puller.bind(wt.self_depart_bind_address());
+  bind_with_inproc(self_depart_puller, wt.self_depart_bind_address());
 
   // responsible for handling requests
   zmq::socket_t request_puller(context, ZMQ_PULL);
+  if (kRequestQueueLimit > 0) {
+    request_puller.setsockopt(ZMQ_RCVHWM, &kRequestQueueLimit,
+                              sizeof(kRequestQueueLimit));
+  }
+
   request_puller.bind(wt.key_request_bind_address());
 
+  // sheds requests while the request socket is backed up
+  AdmissionControl admission(kMaxRequestBacklog);
+
+  // replicates the keys this thread alone is too slow to serve
+  HotKeyDetector hot_keys(kSelfTier == Tier::MEMORY ? kHotKeyThreshold : 0,
+                          kHotKeyInterval, kHotKeyHold);
+  HotKeyDetector *hot_key_detector = hot_keys.enabled() ? &hot_keys : nullptr;
+
+  // holds each tenant to its request rate and memory quota
+  TenantLimits tenants(kTenantDelimiter, kDefaultTenantQuota, kTenantQuotas);
+  TenantLimits *tenant_limits = tenants.enabled() ? &tenants : nullptr;
+
   // responsible for processing gossip
   zmq::socket_t gossip_puller(context, ZMQ_PULL);
-  gossip_puller.bind(wt.gossip_bind_address());
+  bind_with_inproc(gossip_puller, wt.gossip_bind_address());
 
   // responsible for listening for key replication factor response
   zmq::socket_t replication_response_puller(context, ZMQ_PULL);
-  replication_response_puller.bind(wt.replication_response_bind_address());
+  bind_with_inproc(replication_response_puller,
+                   wt.replication_response_bind_address());
 
   // responsible for listening for key replication factor change
   zmq::socket_t replication_change_puller(context, ZMQ_PULL);
-  replication_change_puller.bind(wt.replication_change_bind_address());
+  bind_with_inproc(replication_change_puller,
+                   wt.replication_change_bind_address());
 
   // responsible for listening for cached keys response messages.
   zmq::socket_t cache_ip_response_puller(context, ZMQ_PULL);
-  cache_ip_response_puller.bind(wt.cache_ip_response_bind_address());
+  bind_with_inproc(cache_ip_response_puller,
+                   wt.cache_ip_response_bind_address());
 
   // responsible for listening for function node IP lookup response messages.
   zmq::socket_t management_node_response_puller(context, ZMQ_PULL);
-  management_node_response_puller.bind(
-      wt.management_node_response_bind_address());
+  bind_with_inproc(management_node_response_puller,
+                   wt.management_node_response_bind_address());
+
+  // responsible for answering the key scans the routing tier fans out
+  zmq::socket_t key_scan_puller(context, ZMQ_PULL);
+  key_scan_puller.bind(wt.key_scan_bind_address());
 
   //  Initialize poll set
   vector<zmq::pollitem_t> pollitems = {
@@ -293,219 +597,478 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       {static_cast<void *>(replication_response_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(replication_change_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(cache_ip_response_puller), 0, ZMQ_POLLIN, 0},
-      {static_cast<void *>(management_node_response_puller), 0, ZMQ_POLLIN, 0}};
+      {static_cast<void *>(management_node_response_puller), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(key_scan_puller), 0, ZMQ_POLLIN, 0}};
+
+  // the I/O threads signal finished reads on an eventfd
+  if (disk_reader != nullptr) {
+    pollitems.push_back({nullptr, disk_reader->fd(), ZMQ_POLLIN, 0});
+  }
 
-  auto gossip_start = std::chrono::system_clock::now();
-  auto gossip_end = std::chrono::system_clock::now();
-  auto report_start = std::chrono::system_clock::now();
-  auto report_end = std::chrono::system_clock::now();
+  // read once per iteration for deadlines and access tracking; handlers are
+  // timed with the CycleClock
+  LoopClock loop_clock;
+  auto gossip_start = loop_clock.now();
+  auto report_start = loop_clock.now();
+  auto snapshot_start = loop_clock.now();
 
-  unsigned long long working_time = 0;
-  unsigned long long working_time_map[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  // in microseconds
+  double working_time = 0;
+  double working_time_map[kHandlerCount] = {0};
   unsigned epoch = 0;
 
+  // this thread's metrics, which are published to kMetricsRegistry
+  ServerMetrics metrics;
+  auto metrics_start = loop_clock.now();
+  auto hot_key_start = loop_clock.now();
+
+  // the bytes retained when the last eviction pass found nothing to evict (0
+  // if it evicted something); those bytes are not counted against the budget,
+  // and no pass runs again until as many more bytes as a pass frees have been
+  // written or the next report period starts
+  unsigned long long pinned_bytes = 0;
+  unsigned long long retry_bytes =
+      kMemoryBudget > kEvictionTarget ? kMemoryBudget - kEvictionTarget : 1;
+  bool budget_warned = false;
+
+  // adds the time since start (a CycleClock reading) to this thread's busy
+  // time and to handler's latency histogram; returns the reading it took, so
+  // that a loop over messages can start timing the next one from it
+  auto record_work = [&](Handler handler, uint64_t start) {
+    uint64_t end = CycleClock::now();
+    double time_elapsed = CycleClock::to_microseconds(end - start);
+
+    working_time += time_elapsed;
+    working_time_map[static_cast<unsigned>(handler)] += time_elapsed;
+    metrics.record(handler, time_elapsed);
+    return end;
+  };
+
+  // does the next batch keys of the stats report, and sends it to the
+  // monitoring nodes once it is complete; returns whether it is
+  auto step_report = [&](unsigned batch) {
+    auto primary = [&](const Key &key) {
+      ServerThreadList local_owner =
+          local_hash_rings[kSelfTier].responsible(key, 1);
+
+      return !local_owner.empty() && local_owner[0].tid() == wt.tid() &&
+             is_primary_tier(key, key_replication_map);
+    };
+
+    if (!report_builder.step(key_access_tracker, stored_key_map,
+                             key_size_reporter, batch, primary)) {
+      return false;
+    }
+
+    string serialized_report;
+    report_builder.report().SerializeToString(&serialized_report);
+
+    for (const Address &address : monitoring_ips) {
+      kZmqUtil->send_string(
+          serialized_report,
+          &pushers[MonitoringThread(address).stats_report_connect_address()]);
+    }
+
+    return true;
+  };
+
+  // how long poll blocks (in milliseconds); this backs off while the thread
+  // is idle and drops back to 0 as soon as there is work
+  long poll_timeout = 0;
+
+  metrics.ready = 1;
+  metrics.startup_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - kProcessStart)
+                           .count();
+  log->info("Thread {} is ready to serve after {} ms.", thread_id,
+            metrics.startup_ms);
+
+  if (kMetricsRegistry != nullptr) {
+    kMetricsRegistry->publish(thread_id, metrics);
+  }
+
   // enter event loop
   while (true) {
-    kZmqUtil->poll(0, &pollitems);
+    kZmqUtil->poll(poll_timeout, &pollitems);
+    loop_clock.tick();
+    key_access_tracker.set_time(loop_clock.now());
+    hot_keys.set_time(loop_clock.now());
+    tenants.set_time(loop_clock.now());
+
+    bool idle = true;
+    for (const zmq::pollitem_t &item : pollitems) {
+      if (item.revents & ZMQ_POLLIN) {
+        idle = false;
+      }
+    }
 
     // receives a node join
     if (pollitems[0].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized = kZmqUtil->recv_string(&join_puller);
-      node_join_handler(thread_id, seed, public_ip, private_ip, log, serialized,
-                        global_hash_rings, local_hash_rings, stored_key_map,
-                        key_replication_map, join_remove_set, pushers, wt,
-                        join_gossip_map, self_join_count);
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&join_puller);
+
+        // thread 0 published the rings with the join before passing it on
+        if (reads_shared_rings(thread_id)) {
+          global_hash_rings = kSharedRings->global();
+        }
 
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[0] += time_elapsed;
+        node_join_handler(thread_id, seed, public_ip, private_ip, log,
+                          serialized, *global_hash_rings, local_hash_rings,
+                          stored_key_map, key_replication_map, join_remove_set,
+                          pushers, wt, join_gossip_map, self_join_count);
+        work_start = record_work(Handler::JOIN, work_start);
+      } while (++drained < kControlDrainBudget &&
+               has_pending_message(&join_puller));
+
+      bool backlogged =
+          drained == kControlDrainBudget && has_pending_message(&join_puller);
+      metrics.record_drain(Handler::JOIN, backlogged);
     }
 
     if (pollitems[1].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&depart_puller);
 
-      string serialized = kZmqUtil->recv_string(&depart_puller);
-      node_depart_handler(thread_id, public_ip, private_ip, global_hash_rings,
-                          log, serialized, pushers);
+        if (reads_shared_rings(thread_id)) {
+          global_hash_rings = kSharedRings->global();
+        }
 
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[1] += time_elapsed;
+        node_depart_handler(thread_id, seed, public_ip, private_ip, log,
+                            serialized, *global_hash_rings, local_hash_rings,
+                            stored_key_map, key_replication_map,
+                            join_remove_set, pushers, wt, join_gossip_map);
+        work_start = record_work(Handler::DEPART, work_start);
+      } while (++drained < kControlDrainBudget &&
+               has_pending_message(&depart_puller));
+
+      bool backlogged =
+          drained == kControlDrainBudget && has_pending_message(&depart_puller);
+      metrics.record_drain(Handler::DEPART, backlogged);
     }
 
     if (pollitems[2].revents & ZMQ_POLLIN) {
+      if (wal != nullptr) {
+        wal->commit();
+      }
+
+      batcher.flush(pushers);
+
       string serialized = kZmqUtil->recv_string(&self_depart_puller);
+
+      if (reads_shared_rings(thread_id)) {
+        global_hash_rings = kSharedRings->global();
+      }
+
       self_depart_handler(thread_id, seed, public_ip, private_ip, log,
-                          serialized, global_hash_rings, local_hash_rings,
+                          serialized, *global_hash_rings, local_hash_rings,
                           stored_key_map, key_replication_map, routing_ips,
-                          monitoring_ips, wt, pushers, serializers);
+                          monitoring_ips, wt, pushers, depart_plan);
 
-      return;
+      if (!depart_plan.active()) {
+        return;
+      }
+
+      // keep running until all of our data has been handed off
+      depart_done_address = serialized;
     }
 
     if (pollitems[3].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized = kZmqUtil->recv_string(&request_puller);
-      user_request_handler(access_count, seed, serialized, log,
-                           global_hash_rings, local_hash_rings,
-                           pending_requests, key_access_tracker, stored_key_map,
-                           key_replication_map, local_changeset, wt,
-                           serializers, pushers);
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      bool overloaded = admission.overloaded(loop_clock.now());
+      do {
+        string serialized = kZmqUtil->recv_string(&request_puller);
+
+        // an overloaded thread answers right away, so that the clients go
+        // to another replica instead of waiting behind the backlog
+        if (overloaded &&
+            shed_request_handler(serialized, pushers, batcher, buffers)) {
+          admission.record_shed();
+          work_start = record_work(Handler::REQUEST, work_start);
+          continue;
+        }
 
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
+        user_request_handler(access_count, seed, serialized, log,
+                             *global_hash_rings, local_hash_rings,
+                             pending_requests, key_access_tracker,
+                             stored_key_map, key_replication_map,
+                             local_changeset, wt, serializers, pushers,
+                             batcher, buffers, false, disk_reader,
+                             hot_key_detector, tenant_limits);
+        work_start = record_work(Handler::REQUEST, work_start);
+      } while (++drained < kRequestDrainBudget &&
+               has_pending_message(&request_puller));
+
+      bool backlogged = drained == kRequestDrainBudget &&
+                        has_pending_message(&request_puller);
+      metrics.record_drain(Handler::REQUEST, backlogged);
+      admission.record_drain(backlogged, loop_clock.now());
+    }
 
-      working_time += time_elapsed;
-      working_time_map[3] += time_elapsed;
+    // requests other threads on this node handed over to us
+    if (kIntraNodeMailboxes != nullptr) {
+      unsigned received = kIntraNodeMailboxes->receive(
+          thread_id, kRequestDrainBudget, [&](string &serialized) {
+            uint64_t work_start = CycleClock::now();
+            user_request_handler(access_count, seed, serialized, log,
+                                 *global_hash_rings, local_hash_rings,
+                                 pending_requests, key_access_tracker,
+                                 stored_key_map, key_replication_map,
+                                 local_changeset, wt, serializers, pushers,
+                                 batcher, buffers, true, disk_reader,
+                                 hot_key_detector, tenant_limits);
+            record_work(Handler::REQUEST, work_start);
+          });
+
+      if (received > 0) {
+        idle = false;
+      }
     }
 
     if (pollitems[4].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized = kZmqUtil->recv_string(&gossip_puller);
-      gossip_handler(seed, serialized, global_hash_rings, local_hash_rings,
-                     pending_gossip, stored_key_map, key_replication_map, wt,
-                     serializers, pushers, log);
-
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[4] += time_elapsed;
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&gossip_puller);
+        gossip_handler(seed, serialized, *global_hash_rings, local_hash_rings,
+                       pending_gossip, stored_key_map, key_replication_map, wt,
+                       serializers, pushers, buffers, log);
+        work_start = record_work(Handler::GOSSIP, work_start);
+      } while (++drained < kGossipDrainBudget &&
+               has_pending_message(&gossip_puller));
+
+      bool backlogged =
+          drained == kGossipDrainBudget && has_pending_message(&gossip_puller);
+      metrics.record_drain(Handler::GOSSIP, backlogged);
     }
 
     // receives replication factor response
     if (pollitems[5].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized = kZmqUtil->recv_string(&replication_response_puller);
-      replication_response_handler(
-          seed, access_count, log, serialized, global_hash_rings,
-          local_hash_rings, pending_requests, pending_gossip,
-          key_access_tracker, stored_key_map, key_replication_map,
-          local_changeset, wt, serializers, pushers);
-
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[5] += time_elapsed;
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&replication_response_puller);
+        replication_response_handler(
+            seed, access_count, log, serialized, *global_hash_rings,
+            local_hash_rings, pending_requests, pending_gossip,
+            key_access_tracker, stored_key_map, key_replication_map,
+            local_changeset, wt, serializers, pushers, batcher, buffers);
+        work_start = record_work(Handler::REPLICATION_RESPONSE, work_start);
+      } while (++drained < kRequestDrainBudget &&
+               has_pending_message(&replication_response_puller));
+
+      bool backlogged = drained == kRequestDrainBudget &&
+                        has_pending_message(&replication_response_puller);
+      metrics.record_drain(Handler::REPLICATION_RESPONSE, backlogged);
     }
 
     // receive replication factor change
     if (pollitems[6].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized = kZmqUtil->recv_string(&replication_change_puller);
-      replication_change_handler(
-          public_ip, private_ip, thread_id, seed, log, serialized,
-          global_hash_rings, local_hash_rings, stored_key_map,
-          key_replication_map, local_changeset, wt, serializers, pushers);
-
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[6] += time_elapsed;
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&replication_change_puller);
+        replication_change_handler(
+            public_ip, private_ip, thread_id, seed, log, serialized,
+            *global_hash_rings, local_hash_rings, stored_key_map,
+            key_replication_map, local_changeset, wt, serializers, pushers);
+        work_start = record_work(Handler::REPLICATION_CHANGE, work_start);
+      } while (++drained < kControlDrainBudget &&
+               has_pending_message(&replication_change_puller));
+
+      bool backlogged = drained == kControlDrainBudget &&
+                        has_pending_message(&replication_change_puller);
+      metrics.record_drain(Handler::REPLICATION_CHANGE, backlogged);
     }
 
     // Receive cache IP lookup response.
     if (pollitems[7].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized = kZmqUtil->recv_string(&cache_ip_response_puller);
-      cache_ip_response_handler(serialized, cache_ip_to_keys, key_to_cache_ips);
-
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[7] += time_elapsed;
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&cache_ip_response_puller);
+        cache_ip_response_handler(serialized, cache_subscriptions,
+                                  cache_fanout, buffers);
+        work_start = record_work(Handler::CACHE_IP, work_start);
+      } while (++drained < kControlDrainBudget &&
+               has_pending_message(&cache_ip_response_puller));
+
+      bool backlogged = drained == kControlDrainBudget &&
+                        has_pending_message(&cache_ip_response_puller);
+      metrics.record_drain(Handler::CACHE_IP, backlogged);
     }
 
     // Receive management node response.
     if (pollitems[8].revents & ZMQ_POLLIN) {
-      auto work_start = std::chrono::system_clock::now();
-
-      string serialized =
-          kZmqUtil->recv_string(&management_node_response_puller);
-      management_node_response_handler(
-          serialized, extant_caches, cache_ip_to_keys, key_to_cache_ips,
-          global_hash_rings, local_hash_rings, pushers, wt, rid);
-
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
-      working_time += time_elapsed;
-      working_time_map[8] += time_elapsed;
-    }
-
-    // gossip updates to other threads
-    gossip_end = std::chrono::system_clock::now();
-    if (std::chrono::duration_cast<std::chrono::microseconds>(gossip_end -
-                                                              gossip_start)
-            .count() >= PERIOD) {
-      auto work_start = std::chrono::system_clock::now();
-      // only gossip if we have changes
-      if (local_changeset.size() > 0) {
-        AddressKeysetMap addr_keyset_map;
-
-        bool succeed;
-        for (const Key &key : local_changeset) {
-          // Get the threads that we need to gossip to.
-          ServerThreadList threads = kHashRingUtil->get_responsible_threads(
-              wt.replication_response_connect_address(), key, is_metadata(key),
-              global_hash_rings, local_hash_rings, key_replication_map, pushers,
-              kAllTiers, succeed, seed);
-
-          if (succeed) {
-            for (const ServerThread &thread : threads) {
-              if (!(thread == wt)) {
-                addr_keyset_map[thread.gossip_connect_address()].insert(key);
-              }
-            }
-          } else {
-            log->error("Missing key replication factor in gossip routine.");
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized =
+            kZmqUtil->recv_string(&management_node_response_puller);
+        management_node_response_handler(
+            serialized, extant_caches, cache_subscriptions, cache_fanout,
+            *global_hash_rings, local_hash_rings, pushers, wt, rid);
+        work_start = record_work(Handler::MANAGEMENT, work_start);
+      } while (++drained < kControlDrainBudget &&
+               has_pending_message(&management_node_response_puller));
+
+      bool backlogged = drained == kControlDrainBudget &&
+                        has_pending_message(&management_node_response_puller);
+      metrics.record_drain(Handler::MANAGEMENT, backlogged);
+    }
+
+    // a scan walks up to kMaxScanPage keys, so few are taken per wakeup
+    if (pollitems[9].revents & ZMQ_POLLIN) {
+      uint64_t work_start = CycleClock::now();
+      unsigned drained = 0;
+      do {
+        string serialized = kZmqUtil->recv_string(&key_scan_puller);
+        key_scan_handler(serialized, stored_key_map, pushers);
+        work_start = record_work(Handler::REQUEST, work_start);
+      } while (++drained < kControlDrainBudget &&
+               has_pending_message(&key_scan_puller));
+    }
+
+    // answer the GETs whose disk reads have finished
+    if (disk_reader != nullptr && (pollitems[10].revents & ZMQ_POLLIN)) {
+      uint64_t work_start = CycleClock::now();
+      disk_read_handler(*disk_reader, log, pushers, batcher);
+      record_work(Handler::DISK_READ, work_start);
+    }
+
+    batcher.flush_if_due(pushers);
+
+    // group commit the disk writes made in this iteration, and reclaim at
+    // most one stale log segment
+    if (log_store != nullptr) {
+      log_store->sync(false);
+      if (log_store->compact()) {
+        idle = false;
+      }
+    }
+
+    // write the next batch of keys of a snapshot, starting a new one once the
+    // period is up
+    if (snapshot != nullptr) {
+      if (!snapshot->in_progress() &&
+          loop_clock.seconds_since(snapshot_start) >= kSnapshotPeriod) {
+        snapshot->start();
+        snapshot_start = loop_clock.now();
+
+        // the writes from here on go to a log the snapshot does not retire
+        if (wal != nullptr && snapshot->in_progress()) {
+          wal->rotate();
+        }
+      }
+
+      if (snapshot->in_progress()) {
+        uint64_t work_start = CycleClock::now();
+        auto read = [&](const Key &key, LatticeType type, string *payload) {
+          AnnaError error = AnnaError::NO_ERROR;
+          serializers[type]->get(key, payload, error);
+          return error == AnnaError::NO_ERROR;
+        };
+
+        if (snapshot->write_batch(stored_key_map, kSnapshotBatchSize, read) &&
+            snapshot->finish()) {
+          log->info("Wrote snapshot {}.", snapshot->path());
+
+          if (wal != nullptr) {
+            wal->retire();
           }
+        }
+
+        record_work(Handler::SNAPSHOT, work_start);
+        idle = false;
+      }
+    }
 
-          // Get the caches that we need to gossip to.
-          if (key_to_cache_ips.find(key) != key_to_cache_ips.end()) {
-            set<Address> &cache_ips = key_to_cache_ips[key];
-            for (const Address &cache_ip : cache_ips) {
-              CacheThread ct(cache_ip, 0);
-              addr_keyset_map[ct.cache_update_connect_address()].insert(key);
+    // group commit the writes logged since the last commit once the oldest
+    // has waited long enough, and send the responses held back for them
+    if (wal != nullptr) {
+      if (wal->due()) {
+        uint64_t work_start = CycleClock::now();
+        if (!wal->commit()) {
+          log->error("Failed to commit the write-ahead log.");
+        }
+
+        record_work(Handler::WAL_COMMIT, work_start);
+      }
+
+      if (wal->empty()) {
+        batcher.release(pushers);
+      }
+    }
+
+    // start a round of gossip once the period is up, or early if the
+    // changeset has grown large
+    if (!local_changeset.in_round() &&
+        (loop_clock.microseconds_since(gossip_start) >= kGossipPeriod ||
+         local_changeset.size() >= kGossipFlushThreshold)) {
+      local_changeset.start_round();
+      gossip_start = loop_clock.now();
+    }
+
+    // gossip updates to other threads, at most kGossipBatchSize keys per
+    // iteration so that a large round does not stall requests
+    if (local_changeset.in_round()) {
+      uint64_t work_start = CycleClock::now();
+      AddressKeysetMap addr_keyset_map;
+      vector<Address> cache_ips;
+
+      bool succeed;
+      for (const Key &key : local_changeset.next_batch(kGossipBatchSize)) {
+        // Get the threads that we need to gossip to.
+        ServerThreadList threads = kHashRingUtil->get_responsible_threads(
+            wt.replication_response_connect_address(), key, is_metadata(key),
+            *global_hash_rings, local_hash_rings, key_replication_map, pushers,
+            kAllTiers, succeed, seed);
+
+        if (succeed) {
+          for (const ServerThread &thread : threads) {
+            if (!(thread == wt)) {
+              addr_keyset_map[thread.gossip_connect_address()].insert(key);
             }
           }
+        } else {
+          log->error("Missing key replication factor in gossip routine.");
         }
 
-        send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
-        local_changeset.clear();
+        // Get the caches that we need to gossip to.
+        cache_subscriptions.caches(key, cache_ips);
+        if (!cache_ips.empty()) {
+          cache_fanout.add(key, cache_ips);
+        }
       }
 
-      gossip_start = std::chrono::system_clock::now();
-      auto time_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-                              std::chrono::system_clock::now() - work_start)
-                              .count();
+      send_gossip(addr_keyset_map, pushers, serializers, stored_key_map,
+                  &local_changeset);
+
+      if (local_changeset.round_done()) {
+        local_changeset.finish_round();
+      } else {
+        idle = false;
+      }
+
+      record_work(Handler::GOSSIP_ROUND, work_start);
+    }
 
-      working_time += time_elapsed;
-      working_time_map[9] += time_elapsed;
+    // push the changed keys to the caches whose update interval is up; with
+    // no interval, that is right after the batch that found them
+    if (cache_fanout.pending() > 0) {
+      uint64_t work_start = CycleClock::now();
+      cache_fanout.flush(stored_key_map, serializers, pushers, log);
+      record_work(Handler::GOSSIP_ROUND, work_start);
     }
 
     // Collect and store internal statistics,
     // fetch the most recent list of cache IPs,
     // and send out GET requests for the cached keys by cache IP.
-    report_end = std::chrono::system_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(
-                        report_end - report_start)
-                        .count();
+    auto duration = loop_clock.seconds_since(report_start);
 
     if (duration >= kServerReportThreshold) {
       epoch += 1;
@@ -514,34 +1077,49 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       Key key =
           get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::server_stats);
 
-      // compute total storage consumption
-      unsigned long long consumption = 0;
-      for (const auto &key_pair : stored_key_map) {
-        consumption += key_pair.second.size_;
-      }
+      // the total size of the stored keys, kept up to date by every put
+      unsigned long long consumption = stored_key_map.bytes();
+
+      metrics.storage_consumption_bytes = consumption;
 
-      int index = 0;
-      for (const unsigned long long &time : working_time_map) {
+      for (unsigned i = 0; i < kHandlerCount; i++) {
         // cast to microsecond
-        double event_occupancy = (double)time / ((double)duration * 1000000);
+        double event_occupancy =
+            working_time_map[i] / ((double)duration * 1000000);
 
         if (event_occupancy > 0.02) {
-          log->info("Event {} occupancy is {}.", std::to_string(index++),
+          log->info("Event {} occupancy is {}.", kHandlerNames[i],
                     std::to_string(event_occupancy));
         }
       }
 
-      double occupancy = (double)working_time / ((double)duration * 1000000);
+      double occupancy = working_time / ((double)duration * 1000000);
       if (occupancy > 0.02) {
         log->info("Occupancy is {}.", std::to_string(occupancy));
       }
 
+      if (kSelfTier == Tier::MEMORY) {
+        unsigned long long memory_usage = 0;
+        for (const auto &serializer_pair : serializers) {
+          memory_usage += serializer_pair.second->memory_usage();
+        }
+
+        log->info("Store memory usage is {} bytes.", memory_usage);
+      }
+
       ServerThreadStatistics stat;
       stat.set_storage_consumption(consumption / 1000); // cast to KB
       stat.set_occupancy(occupancy);
       stat.set_epoch(epoch);
       stat.set_access_count(access_count);
 
+      unsigned long long pending_migration_keys = 0;
+      for (const auto &pair : join_gossip_map) {
+        pending_migration_keys += pair.second.size();
+      }
+
+      stat.set_pending_migration_keys(pending_migration_keys);
+
       string serialized_stat;
       stat.SerializeToString(&serialized_stat);
 
@@ -551,95 +1129,47 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
                         serialize(ts, serialized_stat));
 
       auto threads = kHashRingUtil->get_responsible_threads_metadata(
-          key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
+          key, (*global_hash_rings)[Tier::MEMORY],
+          local_hash_rings[Tier::MEMORY]);
       if (threads.size() != 0) {
         Address target_address =
-            std::next(begin(threads), rand_r(&seed) % threads.size())
-                ->key_request_connect_address();
+            select_replica(threads, &seed).key_request_connect_address();
         string serialized;
         req.SerializeToString(&serialized);
         kZmqUtil->send_string(serialized, &pushers[target_address]);
       }
 
-      // compute key access stats
-      KeyAccessData access;
-      auto current_time = std::chrono::system_clock::now();
-
-      for (const auto &key_access_pair : key_access_tracker) {
-        Key key = key_access_pair.first;
-        auto access_times = key_access_pair.second;
-
-        // garbage collect
-        for (const auto &time : access_times) {
-          if (std::chrono::duration_cast<std::chrono::seconds>(current_time -
-                                                               time)
-                  .count() >= kKeyMonitoringThreshold) {
-            access_times.erase(time);
-            break;
-          }
+      // push the epoch's statistics, the hottest keys, and the key sizes
+      // that changed straight to the monitoring nodes, so that they never
+      // have to scan every key this thread tracks; the keys are summed up a
+      // batch at a time below, and a report that is still being built when
+      // the next one is due is finished first
+      if (report_builder.building()) {
+        while (!step_report(std::numeric_limits<unsigned>::max())) {
         }
-
-        // update key_access_frequency
-        KeyAccessData_KeyCount *tp = access.add_keys();
-        tp->set_key(key);
-        tp->set_access_count(access_times.size());
-      }
-
-      // report key access stats
-      key = get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::key_access);
-      string serialized_access;
-      access.SerializeToString(&serialized_access);
-
-      req.Clear();
-      req.set_type(RequestType::PUT);
-      prepare_put_tuple(req, key, LatticeType::LWW,
-                        serialize(ts, serialized_access));
-
-      threads = kHashRingUtil->get_responsible_threads_metadata(
-          key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
-
-      if (threads.size() != 0) {
-        Address target_address =
-            std::next(begin(threads), rand_r(&seed) % threads.size())
-                ->key_request_connect_address();
-        string serialized;
-        req.SerializeToString(&serialized);
-        kZmqUtil->send_string(serialized, &pushers[target_address]);
       }
 
-      KeySizeData primary_key_size;
-      for (const auto &key_pair : stored_key_map) {
-        if (is_primary_replica(key_pair.first, key_replication_map,
-                               global_hash_rings, local_hash_rings, wt)) {
-          KeySizeData_KeySize *ks = primary_key_size.add_key_sizes();
-          ks->set_key(key_pair.first);
-          ks->set_size(key_pair.second.size_);
-        }
+      ServerStatsReport header;
+      header.set_public_ip(wt.public_ip());
+      header.set_private_ip(wt.private_ip());
+      header.set_tid(wt.tid());
+      header.set_tier(kSelfTier);
+      *header.mutable_stats() = stat;
+      hot_keys.fill(header);
+      if (tenants.enabled()) {
+        tenants.fill(header, stored_key_map);
       }
 
-      key = get_metadata_key(wt, kSelfTier, wt.tid(), MetadataType::key_size);
-
-      string serialized_size;
-      primary_key_size.SerializeToString(&serialized_size);
-
-      req.Clear();
-      req.set_type(RequestType::PUT);
-      prepare_put_tuple(req, key, LatticeType::LWW,
-                        serialize(ts, serialized_size));
-
-      threads = kHashRingUtil->get_responsible_threads_metadata(
-          key, global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY]);
-
-      if (threads.size() != 0) {
-        Address target_address =
-            std::next(begin(threads), rand_r(&seed) % threads.size())
-                ->key_request_connect_address();
-        string serialized;
-        req.SerializeToString(&serialized);
-        kZmqUtil->send_string(serialized, &pushers[target_address]);
-      }
+      // this node is the primary replica for exactly the ring segments where
+      // it is the first owner, so only the keys in them need to be checked
+      report_builder.start(
+          header,
+          (*global_hash_rings)[kSelfTier].owned_ranges(wt.private_ip(), 1),
+          key_access_tracker, kStatsHotKeys, kStatsSketchWidth,
+          kStatsSketchDepth);
 
-      report_start = std::chrono::system_clock::now();
+      report_start = loop_clock.now();
+      pinned_bytes = 0;
 
       // Get the most recent list of cache IPs.
       // (Actually gets the list of all current function executor nodes.)
@@ -658,40 +1188,168 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
       memset(working_time_map, 0, sizeof(working_time_map));
     }
 
-    // redistribute data after node joins
+    if (report_builder.building()) {
+      uint64_t work_start = CycleClock::now();
+      step_report(kStatsReportBatchSize);
+      record_work(Handler::STATS_REPORT, work_start);
+      idle = false;
+    }
+
+    // publish a snapshot of this thread's metrics for the metrics endpoint
+    if (kMetricsRegistry != nullptr &&
+        loop_clock.milliseconds_since(metrics_start) >=
+            kMetricsPublishInterval) {
+      metrics.pending_requests = 0;
+      for (const auto &pair : pending_requests) {
+        metrics.pending_requests += pair.second.size();
+      }
+
+      metrics.pending_gossip = 0;
+      for (const auto &pair : pending_gossip) {
+        metrics.pending_gossip += pair.second.size();
+      }
+
+      metrics.value_store_bytes = 0;
+      for (const auto &serializer_pair : serializers) {
+        metrics.value_store_bytes += serializer_pair.second->memory_usage();
+      }
+
+      metrics.requests_shed = admission.shed();
+      metrics.request_backlog_ms = admission.backlog(loop_clock.now());
+
+      if (log_store != nullptr) {
+        metrics.read_cache_hits = log_store->cache().hits();
+        metrics.read_cache_misses = log_store->cache().misses();
+        metrics.read_cache_bytes = log_store->cache().bytes();
+      }
+
+      kMetricsRegistry->publish(thread_id, metrics);
+      metrics_start = loop_clock.now();
+    }
+
+    // keep the store within its budget, so that a burst of writes is demoted
+    // or dropped instead of growing the process until it runs out of memory;
+    // the copies already being dropped are as good as gone
+    if (kMemoryBudget > 0 && stored_key_map.retained_bytes() > kMemoryBudget &&
+        (pinned_bytes == 0 ||
+         stored_key_map.retained_bytes() >= pinned_bytes + retry_bytes)) {
+      uint64_t work_start = CycleClock::now();
+      unsigned evicted = evict_to_budget(
+          std::max(kEvictionTarget, pinned_bytes), seed, log,
+          *global_hash_rings, local_hash_rings, stored_key_map,
+          key_replication_map, local_changeset, routing_ips, wt, serializers,
+          pushers, rid);
+
+      if (evicted == 0) {
+        pinned_bytes = stored_key_map.retained_bytes();
+
+        if (!budget_warned) {
+          log->warn("Cannot evict any of the {} bytes stored to meet the "
+                    "memory budget of {} bytes.",
+                    pinned_bytes, kMemoryBudget);
+          budget_warned = true;
+        }
+      } else {
+        pinned_bytes = 0;
+        budget_warned = false;
+      }
+
+      record_work(Handler::EVICTION, work_start);
+    }
+
+    // spread the reads of the keys that turned hot over every thread on the
+    // node, and take back the spread of those that have cooled off
+    if (hot_keys.enabled() &&
+        loop_clock.milliseconds_since(hot_key_start) >= kHotKeyInterval) {
+      uint64_t work_start = CycleClock::now();
+      auto local_replication = [&](const Key &key) {
+        return key_replication_map[key].local_replication_[Tier::MEMORY];
+      };
+
+      for (const Key &key : hot_keys.take_hot()) {
+        if (hot_keys.raise(key, local_replication(key), kThreadNum,
+                           loop_clock.now())) {
+          log->info("Key {} is hot; replicating it to every local thread.",
+                    key);
+          hot_keys.record_change(change_local_replication(
+              key, kThreadNum, *global_hash_rings, local_hash_rings,
+              key_replication_map, routing_ips, pushers, rid));
+        }
+      }
+
+      hot_keys.expire(loop_clock.now(), local_replication,
+                      [&](const Key &key, unsigned previous) {
+                        hot_keys.record_change(change_local_replication(
+                            key, previous, *global_hash_rings,
+                            local_hash_rings, key_replication_map,
+                            routing_ips, pushers, rid));
+                      });
+
+      hot_key_start = loop_clock.now();
+      record_work(Handler::HOT_KEYS, work_start);
+    }
+
+    // stream data to its new owners after a node join or departure; each
+    // address gets at most DATA_REDISTRIBUTE_THRESHOLD keys per iteration,
+    // and is skipped while its send queue is full so a slow receiver only
+    // delays its own transfer
+    migration_blocked = false;
+
+    // a departing thread queues the next keys of its plan as the ones queued
+    // before go out, so all of the new owners are sent to at once while the
+    // queued keys stay bounded
+    if (depart_plan.active()) {
+      unsigned queued = 0;
+      for (const auto &pair : join_gossip_map) {
+        queued += pair.second.size();
+      }
+
+      if (queued < kDepartQueueSize) {
+        unsigned ranges_done = depart_plan.ranges_done();
+        depart_plan.next(stored_key_map, *global_hash_rings, local_hash_rings,
+                         key_replication_map, join_gossip_map,
+                         kDepartQueueSize - queued);
+
+        // progress is logged every tenth of the ranges
+        unsigned ranges = depart_plan.ranges();
+        if (depart_plan.ranges_done() * 10 / ranges !=
+            ranges_done * 10 / ranges) {
+          log->info("Queued {} of {} hash ranges for hand-off.",
+                    depart_plan.ranges_done(), depart_plan.ranges());
+        }
+      }
+    }
+
     if (join_gossip_map.size() != 0) {
-      set<Address> remove_address_set;
       AddressKeysetMap addr_keyset_map;
+      unsigned sent_addresses = 0;
 
-      for (const auto &join_pair : join_gossip_map) {
-        Address address = join_pair.first;
-        set<Key> key_set = join_pair.second;
-        // track all sent keys because we cannot modify the key_set while
-        // iterating over it
-        set<Key> sent_keys;
-
-        for (const Key &key : key_set) {
-          addr_keyset_map[address].insert(key);
-          sent_keys.insert(key);
-          if (sent_keys.size() >= DATA_REDISTRIBUTE_THRESHOLD) {
-            break;
-          }
+      for (auto it = join_gossip_map.begin(); it != join_gossip_map.end();) {
+        if (!can_send(&pushers[it->first])) {
+          ++it;
+          continue;
         }
 
-        // remove the keys we just dealt with
-        for (const Key &key : sent_keys) {
-          key_set.erase(key);
+        set<Key> &key_set = it->second;
+        set<Key> &batch = addr_keyset_map[it->first];
+        auto key_it = key_set.begin();
+
+        while (key_it != key_set.end() &&
+               batch.size() < DATA_REDISTRIBUTE_THRESHOLD) {
+          batch.insert(*key_it);
+          key_it = key_set.erase(key_it);
         }
 
+        sent_addresses += 1;
+
         if (key_set.size() == 0) {
-          remove_address_set.insert(address);
+          it = join_gossip_map.erase(it);
+        } else {
+          ++it;
         }
       }
 
-      for (const Address &remove_address : remove_address_set) {
-        join_gossip_map.erase(remove_address);
-      }
-
+      migration_blocked = sent_addresses == 0;
       send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
 
       // remove keys
@@ -704,10 +1362,112 @@ void run(unsigned thread_id, Address public_ip, Address private_ip,
         join_remove_set.clear();
       }
     }
+
+    if (depart_done_address != "" && !depart_plan.active() &&
+        join_gossip_map.size() == 0) {
+      kZmqUtil->send_string(public_ip + "_" + private_ip + "_" +
+                                Tier_Name(kSelfTier),
+                            &pushers[depart_done_address]);
+      return;
+    }
+
+    // while idle, double the poll timeout up to kMaxPollTimeout, but never
+    // sleep past the next gossip round, stats report, or log sync
+    if (!idle || ((join_gossip_map.size() != 0 || depart_plan.active()) &&
+                  !migration_blocked)) {
+      poll_timeout = 0;
+    } else if (migration_blocked) {
+      // wait for the receivers to drain their queues
+      poll_timeout = 1;
+    } else {
+      poll_timeout = std::min(std::max(poll_timeout * 2, 1L), kMaxPollTimeout);
+
+      long gossip_deadline =
+          (kGossipPeriod - loop_clock.microseconds_since(gossip_start)) / 1000;
+      long report_deadline = kServerReportThreshold * 1000 -
+                             loop_clock.milliseconds_since(report_start);
+
+      poll_timeout = std::min(poll_timeout, gossip_deadline);
+      poll_timeout = std::min(poll_timeout, report_deadline);
+
+      if (!batcher.empty()) {
+        poll_timeout = std::min(poll_timeout, batcher.time_until_due());
+      }
+
+      if (log_store != nullptr && log_store->dirty()) {
+        poll_timeout = std::min(poll_timeout, (long)kLogSyncInterval / 1000);
+      }
+
+      if (wal != nullptr && !wal->empty()) {
+        poll_timeout = std::min(poll_timeout, wal->time_until_due());
+      }
+
+      if (kIntraNodeMailboxes != nullptr) {
+        poll_timeout = std::min(poll_timeout, kIntraNodePollTimeout);
+      }
+
+      poll_timeout = std::max(poll_timeout, 0L);
+    }
+  }
+}
+
+// Answers HTTP scrapes of /metrics on port with the metrics in
+// kMetricsRegistry. A ZMQ_STREAM socket hands over each connection's bytes
+// tagged with its identity; sending an empty message to an identity closes
+// its connection.
+void serve_metrics(zmq::context_t &context, unsigned port) {
+  zmq::socket_t http(context, ZMQ_STREAM);
+  http.bind("tcp://*:" + std::to_string(port));
+
+  // the bytes of each connection's request received so far
+  map<string, string> requests;
+
+  while (true) {
+    zmq::message_t identity_message;
+    zmq::message_t data_message;
+    http.recv(&identity_message);
+    http.recv(&data_message);
+
+    string identity(static_cast<char *>(identity_message.data()),
+                    identity_message.size());
+    string &request = requests[identity];
+    request.append(static_cast<char *>(data_message.data()),
+                   data_message.size());
+
+    // an empty message announces a new connection or the end of one
+    if (data_message.size() == 0) {
+      requests.erase(identity);
+      continue;
+    }
+
+    if (request.find("\r\n\r\n") == string::npos &&
+        request.size() < kMetricsMaxRequestSize) {
+      continue;
+    }
+
+    string response = metrics_http_response(request, *kMetricsRegistry);
+    requests.erase(identity);
+
+    zmq::message_t response_identity(identity.size());
+    memcpy(response_identity.data(), identity.data(), identity.size());
+    http.send(response_identity, ZMQ_SNDMORE);
+
+    zmq::message_t response_message(response.size());
+    memcpy(response_message.data(), response.data(), response.size());
+    http.send(response_message);
+
+    zmq::message_t close_identity(identity.size());
+    memcpy(close_identity.data(), identity.data(), identity.size());
+    http.send(close_identity, ZMQ_SNDMORE);
+
+    zmq::message_t close_message;
+    http.send(close_message);
   }
 }
 
 int main(int argc, char *argv[]) {
+  kProcessStart = std::chrono::steady_clock::now();
+
   if (argc != 1) {
     std::cerr << "Usage: " << argv[0] << std::endl;
     return 1;
@@ -737,6 +1497,8 @@ int main(int argc, char *argv[]) {
 
   // read the YAML conf
   YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  configure_hashing(conf);
+
   YAML::Node threads = conf["threads"];
   kMemoryThreadCount = threads["memory"].as<unsigned>();
   kEbsThreadCount = threads["ebs"].as<unsigned>();
@@ -750,6 +1512,148 @@ int main(int argc, char *argv[]) {
   kDefaultGlobalEbsReplication = replication["ebs"].as<unsigned>();
   kDefaultLocalReplication = replication["local"].as<unsigned>();
 
+  kRequestDrainBudget = 64;
+  kGossipDrainBudget = 16;
+  kControlDrainBudget = 4;
+  kMaxPollTimeout = 100;
+  kResponseBatchDelay = 0;
+  kResponseBatchSize = 64;
+  kGossipPeriod = PERIOD;
+  kGossipFlushThreshold = 100000;
+  kGossipBatchSize = 10000;
+  kCacheUpdateInterval = 0;
+  kStatsHotKeys = 1000;
+  kStatsSketchWidth = 2048;
+  kStatsSketchDepth = 4;
+  kStatsReportBatchSize = 10000;
+  kMemoryBudget = 0;
+  kEvictionTarget = 0;
+  kSnapshotDir = "";
+  kSnapshotPeriod = 300;
+  kSnapshotBatchSize = 1000;
+  kCompressionThreshold = 0;
+  kDiskReadThreads = 0;
+  kDiskReadCacheBytes = 0;
+  kMaxRequestBacklog = 0;
+  kRequestQueueLimit = 0;
+  kHotKeyThreshold = 0;
+  kHotKeyInterval = 100;
+  kHotKeyHold = 30;
+  kWalDir = "";
+  kWalMaxDelay = 1000;
+  kWalMaxBatch = 1 << 20;
+  kTenantDelimiter = 0;
+
+  if (YAML::Node event_loop = conf["event-loop"]) {
+    kRequestDrainBudget = event_loop["request-budget"].as<unsigned>();
+    kGossipDrainBudget = event_loop["gossip-budget"].as<unsigned>();
+    kControlDrainBudget = event_loop["control-budget"].as<unsigned>();
+    kMaxPollTimeout = event_loop["max-poll-timeout"].as<long>();
+  }
+
+  if (YAML::Node batching = conf["response-batching"]) {
+    kResponseBatchDelay = batching["max-delay"].as<unsigned>();
+    kResponseBatchSize = batching["max-tuples"].as<unsigned>();
+  }
+
+  if (YAML::Node gossip = conf["gossip"]) {
+    kGossipPeriod = gossip["period"].as<long>() * 1000;
+    kGossipFlushThreshold = gossip["flush-threshold"].as<unsigned>();
+    kGossipBatchSize = gossip["batch-size"].as<unsigned>();
+  }
+
+  if (YAML::Node cache_updates = conf["cache-updates"]) {
+    kCacheUpdateInterval = cache_updates["min-interval"].as<unsigned>();
+  }
+
+  if (YAML::Node stats = conf["stats-report"]) {
+    kStatsHotKeys = stats["hot-keys"].as<unsigned>();
+    kStatsSketchWidth = stats["sketch-width"].as<unsigned>();
+    kStatsSketchDepth = stats["sketch-depth"].as<unsigned>();
+    kStatsReportBatchSize =
+        std::max(stats["batch-size"].as<unsigned>(), 1u);
+  }
+
+  // the budget is a share of the node's capacity (kept in KB), split evenly
+  // between its threads
+  if (YAML::Node budget = conf["memory-budget"]) {
+    if (budget["enabled"].as<bool>() && kSelfTier == Tier::MEMORY) {
+      kMemoryBudget = budget["node-fraction"].as<double>() *
+                      kMemoryNodeCapacity * 1000 / kMemoryThreadCount;
+      kEvictionTarget = budget["evict-to"].as<double>() * kMemoryBudget;
+    }
+  }
+
+  if (YAML::Node snapshots = conf["memory-snapshot"]) {
+    if (snapshots["enabled"].as<bool>()) {
+      kSnapshotDir = snapshots["dir"].as<string>();
+      kSnapshotPeriod = snapshots["period"].as<unsigned>();
+      kSnapshotBatchSize = snapshots["batch-size"].as<unsigned>();
+    }
+  }
+
+  if (YAML::Node compression = conf["compression"]) {
+    if (compression["enabled"].as<bool>()) {
+      kCompressionThreshold = compression["threshold"].as<unsigned>();
+    }
+  }
+
+  // the disk threads' stores are configured here rather than as each thread
+  // builds its own, so that the configuration is read once per process
+  if (YAML::Node ebs = conf["ebs"]) {
+    kEbsRoot = ebs.as<string>();
+  }
+
+  if (YAML::Node disk_reads = conf["disk-reads"]) {
+    kDiskReadThreads = disk_reads["io-threads"].as<unsigned>();
+
+    if (YAML::Node cache_size = disk_reads["cache-size"]) {
+      kDiskReadCacheBytes = cache_size.as<unsigned long long>();
+    }
+  }
+
+  if (YAML::Node admission = conf["admission-control"]) {
+    if (admission["enabled"].as<bool>()) {
+      kMaxRequestBacklog = admission["max-backlog"].as<unsigned>();
+      kRequestQueueLimit = admission["queue-limit"].as<int>();
+    }
+  }
+
+  if (YAML::Node hot_keys = conf["hot-key-replication"]) {
+    if (hot_keys["enabled"].as<bool>()) {
+      kHotKeyThreshold = hot_keys["threshold"].as<unsigned>();
+      kHotKeyInterval = std::max(hot_keys["interval"].as<unsigned>(), 1u);
+      kHotKeyHold = hot_keys["hold"].as<unsigned>();
+    }
+  }
+
+  if (YAML::Node wal = conf["write-ahead-log"]) {
+    if (wal["enabled"].as<bool>()) {
+      kWalDir = wal["dir"].as<string>();
+      kWalMaxDelay = wal["max-delay"].as<unsigned>();
+      kWalMaxBatch = wal["max-batch"].as<unsigned>();
+    }
+  }
+
+  if (YAML::Node tenants = conf["tenants"]) {
+    if (tenants["enabled"].as<bool>()) {
+      kTenantDelimiter = tenants["delimiter"].as<char>();
+      kDefaultTenantQuota = read_tenant_quota(tenants["default"]);
+
+      for (const auto &quota : tenants["quotas"]) {
+        kTenantQuotas[quota.first.as<string>()] =
+            read_tenant_quota(quota.second);
+      }
+    }
+  }
+
+  if (YAML::Node affinity = conf["affinity"]) {
+    if (affinity["enabled"].as<bool>()) {
+      kWorkerCores = affinity["worker-cores"].as<vector<int>>();
+      kIoCores = affinity["io-cores"].as<vector<int>>();
+    }
+  }
+
   YAML::Node server = conf["server"];
   Address public_ip = server["public_ip"].as<string>();
   Address private_ip = server["private_ip"].as<string>();
@@ -779,15 +1683,106 @@ int main(int argc, char *argv[]) {
 
   kThreadNum = kTierMetadata[kSelfTier].thread_number_;
 
+  // worker threads exchange requests for each other's keys directly
+  if (YAML::Node dispatch = conf["intra-node-dispatch"]) {
+    if (dispatch["enabled"].as<bool>() && kThreadNum > 1) {
+      kIntraNodeMailboxes = new IntraNodeMailboxes(
+          kThreadNum, dispatch["queue-size"].as<unsigned>());
+    }
+  }
+
+  // all threads share a context, so they can reach each other over inproc
+  // endpoints; it gets one I/O thread per worker thread, as when each worker
+  // had a context of its own
+  zmq::context_t context(kThreadNum);
+
+  auto res = context.setctxopt(ZMQ_MAX_SOCKETS, kMaxSocketNumber * kThreadNum);
+  if (res != 0) {
+    std::cerr << "Failed to set the max socket number: " << zmq_strerror(errno)
+              << std::endl;
+  }
+
+  if (kWorkerCores.size() > 0 || kIoCores.size() > 0) {
+    // a - marks a worker thread that is left unpinned
+    std::cout << "Thread placement: worker cores [";
+    for (unsigned tid = 0; tid < kThreadNum; tid++) {
+      std::cout << (tid > 0 ? " " : "")
+                << (tid < kWorkerCores.size()
+                        ? std::to_string(kWorkerCores[tid])
+                        : "-");
+    }
+
+    std::cout << "], I/O cores [";
+    for (unsigned i = 0; i < kIoCores.size(); i++) {
+      std::cout << (i > 0 ? " " : "") << kIoCores[i];
+    }
+
+    std::cout << "]." << std::endl;
+  }
+
+  // the I/O threads start with the first socket, so this has to come first
+  for (int core : kIoCores) {
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+    context.setctxopt(ZMQ_THREAD_AFFINITY_CPU_ADD, core);
+#else
+    std::cerr << "This ZMQ version cannot pin its I/O threads; ignoring core "
+              << core << "." << std::endl;
+#endif
+  }
+
+  // serve every worker thread's metrics to Prometheus from a thread of its
+  // own, so that scrapes never stall a worker
+  if (YAML::Node metrics = conf["metrics"]) {
+    if (metrics["enabled"].as<bool>()) {
+      kMetricsRegistry = new MetricsRegistry(kThreadNum);
+      std::thread(serve_metrics, std::ref(context),
+                  metrics["port"].as<unsigned>())
+          .detach();
+    }
+  }
+
+  // trace a fraction of the requests that arrive untraced, along with every
+  // request that arrives with a trace context
+  if (YAML::Node tracing = conf["tracing"]) {
+    if (tracing["enabled"].as<bool>()) {
+      auto span_log =
+          spdlog::basic_logger_mt("spans", "spans_kvs.jsonl", true);
+      span_log->set_pattern("%v");
+      span_log->flush_on(spdlog::level::info);
+      kTracer = new Tracer(tracing["sample-fraction"].as<double>(),
+                           "anna-kvs", public_ip, span_log);
+    }
+  }
+
+  if (YAML::Node capture = conf["workload-capture"]) {
+    if (capture["enabled"].as<bool>()) {
+      string path = capture["path"].as<string>();
+      kWorkloadRecorder = new WorkloadRecorder(
+          path, capture["sample-fraction"].as<double>());
+
+      if (!kWorkloadRecorder->open()) {
+        std::cerr << "Could not open workload capture " << path << "."
+                  << std::endl;
+        delete kWorkloadRecorder;
+        kWorkloadRecorder = nullptr;
+      }
+    }
+  }
+
+  // calibrate the handler timer once, rather than in the first worker to
+  // time a message
+  CycleClock::ticks_per_microsecond();
+
   // start the initial threads based on kThreadNum
   vector<std::thread> worker_threads;
   for (unsigned thread_id = 1; thread_id < kThreadNum; thread_id++) {
-    worker_threads.push_back(std::thread(run, thread_id, public_ip, private_ip,
-                                         seed_ip, routing_ips, monitoring_ips,
-                                         mgmt_ip));
+    worker_threads.push_back(std::thread(run, std::ref(context), thread_id,
+                                         public_ip, private_ip, seed_ip,
+                                         routing_ips, monitoring_ips, mgmt_ip));
   }
 
-  run(0, public_ip, private_ip, seed_ip, routing_ips, monitoring_ips, mgmt_ip);
+  run(context, 0, public_ip, private_ip, seed_ip, routing_ips, monitoring_ips,
+      mgmt_ip);
 
   // join on all threads to make sure they finish before exiting
   for (unsigned tid = 1; tid < kThreadNum; tid++) {
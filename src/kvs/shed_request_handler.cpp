@@ -0,0 +1,41 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+bool shed_request_handler(string &serialized, SocketCache &pushers,
+                          ResponseBatcher &batcher, MessageBuffers &buffers) {
+  KeyRequest &request = buffers.request;
+  request.ParseFromString(serialized);
+
+  if (request.response_address() == "") {
+    return false;
+  }
+
+  KeyResponse &response = buffers.response;
+  response.Clear();
+  response.set_response_id(request.request_id());
+  response.set_type(request.type());
+  response.set_error(kOverloadedError);
+
+  for (const KeyTuple &tuple : request.tuples()) {
+    KeyTuple *tp = response.add_tuples();
+    tp->set_key(tuple.key());
+    tp->set_lattice_type(tuple.lattice_type());
+    tp->set_error(kOverloadedError);
+  }
+
+  batcher.send(request.response_address(), response, pushers);
+  return true;
+}
@@ -14,18 +14,58 @@
 
 #include "kvs/kvs_handlers.hpp"
 
+// returns the tid of another thread on this node that is responsible for
+// the key, or wt's own tid if there is none
+static unsigned local_owner(const ServerThreadList &threads,
+                            const ServerThread &wt) {
+  for (const ServerThread &thread : threads) {
+    if (thread.private_ip() == wt.private_ip() && thread.tid() != wt.tid()) {
+      return thread.tid();
+    }
+  }
+
+  return wt.tid();
+}
+
 void user_request_handler(
     unsigned &access_count, unsigned &seed, string &serialized, logger log,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
     map<Key, vector<PendingRequest>> &pending_requests,
-    map<Key, std::multiset<TimePoint>> &key_access_tracker,
-    map<Key, KeyProperty> &stored_key_map,
-    map<Key, KeyReplication> &key_replication_map, set<Key> &local_changeset,
-    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers) {
-  KeyRequest request;
+    KeyAccessTracker &key_access_tracker, StoredKeyMap &stored_key_map,
+    KeyReplicationMap &key_replication_map, LocalChangeset &local_changeset,
+    ServerThread &wt, SerializerMap &serializers, SocketCache &pushers,
+    ResponseBatcher &batcher, MessageBuffers &buffers, bool forwarded,
+    DiskReader *disk_reader, HotKeyDetector *hot_keys, TenantLimits *tenants) {
+  // requests that are not sampled skip every trace_time() below
+  Trace trace;
+  uint64_t dequeued = 0;
+  uint64_t span_id = 0;
+
+  if (kTracer != nullptr) {
+    trace = read_trace(serialized);
+
+    if (kTracer->sample(trace, seed)) {
+      dequeued = trace_time();
+      span_id = new_span_id(seed);
+    }
+  }
+
+  // the trace of the work this request leaves for later, whose parent is
+  // this request's span
+  Trace child;
+  child.trace_id = trace.trace_id;
+  child.parent_span_id = span_id;
+
+  KeyRequest &request = buffers.request;
   request.ParseFromString(serialized);
 
-  KeyResponse response;
+  // requests forwarded from another thread were recorded there
+  if (kWorkloadRecorder != nullptr && !forwarded) {
+    kWorkloadRecorder->record(request);
+  }
+
+  KeyResponse &response = buffers.response;
+  response.Clear();
   string response_id = request.request_id();
   response.set_response_id(request.request_id());
 
@@ -35,18 +75,71 @@ void user_request_handler(
   RequestType request_type = request.type();
   string response_address = request.response_address();
 
-  for (const auto &tuple : request.tuples()) {
-    // first check if the thread is responsible for the key
-    Key key = tuple.key();
-    string payload = tuple.payload();
+  // parks a tuple until this thread knows the key's replication factor
+  auto park = [&](const KeyTuple &tuple) {
+    const Key &key = tuple.key();
 
-    ServerThreadList threads = kHashRingUtil->get_responsible_threads(
+    // if we don't know what threads are responsible, we issue a rep factor
+    // request (unless one is in flight) and make the request pending
+    if (key_replication_map.start_request(key)) {
+      kHashRingUtil->issue_replication_factor_request(
+          wt.replication_response_connect_address(), key,
+          global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY],
+          pushers, seed);
+    }
+
+    string framed;
+    pending_requests[key].push_back(PendingRequest(
+        request_type, tuple.lattice_type(),
+        frame_client_payload(tuple.lattice_type(), tuple.payload(), framed),
+        response_address, response_id, child));
+  };
+
+  // first resolve the owners of every key, look up the keys this thread
+  // owns, and start loading the stored ones into cache, so the lookups of a
+  // large batch overlap. Each key is looked up in stored_key_map once; its
+  // entry stays valid below, since nothing is erased while the request is
+  // processed.
+  int tuple_count = request.tuples_size();
+  vector<ServerThreadList> owners(tuple_count);
+  vector<bool> resolved(tuple_count);
+  vector<StoredKeyMap::iterator> stored(tuple_count, stored_key_map.end());
+
+  for (int i = 0; i < tuple_count; i++) {
+    const Key &key = request.tuples(i).key();
+    owners[i] = kHashRingUtil->get_responsible_threads(
         wt.replication_response_connect_address(), key, is_metadata(key),
         global_hash_rings, local_hash_rings, key_replication_map, pushers,
         kSelfTierIdVector, succeed, seed);
+    resolved[i] = succeed;
 
-    if (succeed) {
+    if (succeed &&
+        std::find(owners[i].begin(), owners[i].end(), wt) != owners[i].end()) {
+      stored[i] = stored_key_map.find(key);
+
+      if (request_type == RequestType::GET &&
+          stored[i] != stored_key_map.end() &&
+          stored[i]->second.type_ != LatticeType::NONE) {
+        serializers[stored[i]->second.type_]->prefetch(key);
+      }
+    }
+  }
+
+  // the tuples handed to other threads on this node, by thread
+  map<unsigned, KeyRequest> forwards;
+
+  for (int i = 0; i < tuple_count; i++) {
+    const KeyTuple &tuple = request.tuples(i);
+    const Key &key = tuple.key();
+    string framed;
+    const string &payload =
+        frame_client_payload(tuple.lattice_type(), tuple.payload(), framed);
+    const ServerThreadList &threads = owners[i];
+
+    if (resolved[i]) {
       if (std::find(threads.begin(), threads.end(), wt) == threads.end()) {
+        unsigned owner = local_owner(threads, wt);
+
         if (is_metadata(key)) {
           // this means that this node is not responsible for this metadata key
           KeyTuple *tp = response.add_tuples();
@@ -54,49 +147,87 @@ void user_request_handler(
           tp->set_key(key);
           tp->set_lattice_type(tuple.lattice_type());
           tp->set_error(AnnaError::WRONG_THREAD);
+        } else if (!forwarded && kIntraNodeMailboxes != nullptr &&
+                   owner != wt.tid()) {
+          // the owning thread on this node answers the client directly;
+          // forwarded requests are never forwarded again, so threads with
+          // different views of the key cannot pass it back and forth
+          KeyRequest &forward = forwards[owner];
+          *forward.add_tuples() = tuple;
         } else {
-          // if we don't know what threads are responsible, we issue a rep
-          // factor request and make the request pending
-          kHashRingUtil->issue_replication_factor_request(
-              wt.replication_response_connect_address(), key,
-              global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY],
-              pushers, seed);
-
-          pending_requests[key].push_back(
-              PendingRequest(request_type, tuple.lattice_type(), payload,
-                             response_address, response_id));
+          park(tuple);
         }
       } else { // if we know the responsible threads, we process the request
+        bool invalidate = tuple.address_cache_size() > 0 &&
+                          tuple.address_cache_size() != threads.size();
+
+        // a tenant over its rate or memory quota is refused before its key
+        // is touched
+        if (tenants != nullptr &&
+            !tenants->admit(key, request_type == RequestType::PUT,
+                            stored_key_map)) {
+          KeyTuple *tp = response.add_tuples();
+          tp->set_key(key);
+          tp->set_lattice_type(tuple.lattice_type());
+          tp->set_error(kOverloadedError);
+          continue;
+        }
+
+        // a GET of a stored key on a disk thread is answered once the I/O
+        // threads have read it
+        if (request_type == RequestType::GET && disk_reader != nullptr &&
+            disk_reader->submit(key, response_address, response_id,
+                                invalidate)) {
+          key_access_tracker.record(key);
+          access_count += 1;
+          continue;
+        }
+
         KeyTuple *tp = response.add_tuples();
         tp->set_key(key);
 
-        if (request_type == RequestType::GET) {
-          if (stored_key_map.find(key) == stored_key_map.end() ||
-              stored_key_map[key].type_ == LatticeType::NONE) {
+        StoredKeyMap::iterator &it = stored[i];
+        LatticeType stored_type = it == stored_key_map.end()
+                                      ? LatticeType::NONE
+                                      : it->second.type_;
 
+        if (request_type == RequestType::GET) {
+          if (stored_type == LatticeType::NONE) {
             tp->set_error(AnnaError::KEY_DNE);
           } else {
-            auto res = process_get(key, serializers[stored_key_map[key].type_]);
-            tp->set_lattice_type(stored_key_map[key].type_);
-            tp->set_payload(res.first);
-            tp->set_error(res.second);
+            tp->set_lattice_type(stored_type);
+            tp->set_error(process_get(key, serializers[stored_type],
+                                      tp->mutable_payload()));
+            decompress_payload(tp->lattice_type(), tp->mutable_payload(), log);
+
+            if (hot_keys != nullptr && !is_metadata(key)) {
+              hot_keys->record(key);
+            }
           }
         } else if (request_type == RequestType::PUT) {
+          // an earlier tuple of this request may have written the key since
+          // it was looked up; emplace_hint finds that entry. A PUT without a
+          // lattice type is refused first, so that it never adds the key.
+          if (tuple.lattice_type() != LatticeType::NONE &&
+              it == stored_key_map.end()) {
+            it = stored_key_map.emplace_hint(it, key, KeyProperty());
+            stored_type = it->second.type_;
+          }
+
           if (tuple.lattice_type() == LatticeType::NONE) {
             log->error("PUT request missing lattice type.");
-          } else if (stored_key_map.find(key) != stored_key_map.end() &&
-                     stored_key_map[key].type_ != LatticeType::NONE &&
-                     stored_key_map[key].type_ != tuple.lattice_type()) {
+          } else if (stored_type != LatticeType::NONE &&
+                     stored_type != tuple.lattice_type()) {
             log->error(
                 "Lattice type mismatch for key {}: query is {} but we expect "
                 "{}.",
                 key, LatticeType_Name(tuple.lattice_type()),
-                LatticeType_Name(stored_key_map[key].type_));
+                LatticeType_Name(stored_type));
           } else {
-            process_put(key, tuple.lattice_type(), payload,
+            process_put(key, it->second, tuple.lattice_type(), payload,
                         serializers[tuple.lattice_type()], stored_key_map);
 
-            local_changeset.insert(key);
+            local_changeset.insert(key, tuple.lattice_type(), payload);
             tp->set_lattice_type(tuple.lattice_type());
           }
         } else {
@@ -104,25 +235,66 @@ void user_request_handler(
                      request_type);
         }
 
-        if (tuple.address_cache_size() > 0 &&
-            tuple.address_cache_size() != threads.size()) {
+        if (invalidate) {
           tp->set_invalidate(true);
         }
 
-        key_access_tracker[key].insert(std::chrono::system_clock::now());
+        key_access_tracker.record(key);
+        if (it != stored_key_map.end()) {
+          it->second.referenced_ = true;
+        }
         access_count += 1;
       }
     } else {
       pending_requests[key].push_back(
           PendingRequest(request_type, tuple.lattice_type(), payload,
-                         response_address, response_id));
+                         response_address, response_id, child));
+    }
+  }
+
+  uint64_t processed = trace.sampled() ? trace_time() : 0;
+
+  // each sibling gets the tuples it owns in a single message; if its mailbox
+  // is full, they wait for a replication factor like any other stray tuple
+  for (auto &pair : forwards) {
+    KeyRequest &forward = pair.second;
+    forward.set_type(request_type);
+    forward.set_request_id(response_id);
+    forward.set_response_address(response_address);
+
+    string serialized;
+    forward.SerializeToString(&serialized);
+
+    if (trace.sampled()) {
+      write_trace(trace.trace_id, span_id, serialized);
+    }
+
+    if (!kIntraNodeMailboxes->send(wt.tid(), pair.first,
+                                   std::move(serialized))) {
+      for (const KeyTuple &tuple : forward.tuples()) {
+        park(tuple);
+      }
     }
   }
 
   if (response.tuples_size() > 0 && request.response_address() != "") {
-    string serialized_response;
-    response.SerializeToString(&serialized_response);
-    kZmqUtil->send_string(serialized_response,
-                          &pushers[request.response_address()]);
+    batcher.send(request.response_address(), response, pushers);
+  }
+
+  if (trace.sampled()) {
+    // the span starts when the request was sent, if the sender traced it,
+    // so that it includes the time the request spent queued
+    uint64_t start = trace.sent != 0 ? trace.sent : dequeued;
+    uint64_t responded = trace_time();
+
+    kTracer->record(trace, span_id, forwarded ? "kvs.forwarded" : "kvs.request",
+                    start, responded,
+                    {{dequeued, "dequeue"},
+                     {processed, "processed"},
+                     {responded, "respond"}},
+                    {{"request.type", RequestType_Name(request_type)},
+                     {"request.tuples", std::to_string(tuple_count)},
+                     {"request.forwarded", std::to_string(forwards.size())},
+                     {"thread", std::to_string(wt.tid())}});
   }
 }
@@ -15,15 +15,13 @@
 #include "kvs/kvs_handlers.hpp"
 
 void send_gossip(AddressKeysetMap &addr_keyset_map, SocketCache &pushers,
-                 SerializerMap &serializers,
-                 map<Key, KeyProperty> &stored_key_map) {
-  map<Address, KeyRequest> gossip_map;
-
+                 SerializerMap &serializers, StoredKeyMap &stored_key_map,
+                 const LocalChangeset *deltas) {
   for (const auto &key_pair : addr_keyset_map) {
-    string address = key_pair.first;
-    RequestType type;
-    RequestType_Parse("PUT", &type);
-    gossip_map[address].set_type(type);
+    const Address &address = key_pair.first;
+    KeyRequest request;
+    request.set_type(RequestType::PUT);
+    unsigned long long bytes = 0;
 
     for (const auto &key : key_pair.second) {
       LatticeType type;
@@ -34,67 +32,370 @@ void send_gossip(AddressKeysetMap &addr_keyset_map, SocketCache &pushers,
         type = stored_key_map[key].type_;
       }
 
-      auto res = process_get(key, serializers[type]);
+      // serialize straight into the outgoing tuple, and drop it again if the
+      // key turns out to be missing
+      KeyTuple *tp = request.add_tuples();
+      const string *delta = deltas == nullptr ? nullptr : deltas->delta(key);
+      AnnaError error = AnnaError::NO_ERROR;
+
+      if (delta != nullptr) {
+        tp->set_payload(*delta);
+      } else {
+        error = process_get(key, serializers[type], tp->mutable_payload());
+      }
+
+      if (error == 0) {
+        tp->set_key(key);
+        tp->set_lattice_type(type);
+        bytes += key.size() + tp->payload().size();
+      } else {
+        request.mutable_tuples()->RemoveLast();
+      }
+
+      // ship the chunk once it is large enough, so neither side has to hold
+      // (or parse) the whole batch for this address at once
+      if (bytes >= kGossipChunkSize) {
+        string serialized;
+        request.SerializeToString(&serialized);
+        kZmqUtil->send_string(serialized, &pushers[address]);
 
-      if (res.second == 0) {
-        prepare_put_tuple(gossip_map[address], key, type, res.first);
+        request.clear_tuples();
+        bytes = 0;
       }
     }
-  }
 
-  // send gossip
-  for (const auto &gossip_pair : gossip_map) {
-    string serialized;
-    gossip_pair.second.SerializeToString(&serialized);
-    kZmqUtil->send_string(serialized, &pushers[gossip_pair.first]);
+    if (request.tuples_size() > 0) {
+      string serialized;
+      request.SerializeToString(&serialized);
+      kZmqUtil->send_string(serialized, &pushers[address]);
+    }
   }
 }
 
-std::pair<string, AnnaError> process_get(const Key &key,
-                                         Serializer *serializer) {
+AnnaError process_get(const Key &key, Serializer *serializer,
+                      string *payload) {
   AnnaError error = AnnaError::NO_ERROR;
-  auto res = serializer->get(key, error);
-  return std::pair<string, AnnaError>(std::move(res), error);
+  serializer->get(key, payload, error);
+  return error;
 }
 
 void process_put(const Key &key, LatticeType lattice_type,
                  const string &payload, Serializer *serializer,
-                 map<Key, KeyProperty> &stored_key_map) {
-  stored_key_map[key].size_ = serializer->put(key, payload);
-  stored_key_map[key].type_ = std::move(lattice_type);
+                 StoredKeyMap &stored_key_map) {
+  process_put(key, stored_key_map[key], std::move(lattice_type), payload,
+              serializer, stored_key_map);
 }
 
-bool is_primary_replica(const Key &key,
-                        map<Key, KeyReplication> &key_replication_map,
-                        GlobalRingMap &global_hash_rings,
-                        LocalRingMap &local_hash_rings, ServerThread &st) {
+void process_put(const Key &key, KeyProperty &property,
+                 LatticeType lattice_type, const string &payload,
+                 Serializer *serializer, StoredKeyMap &stored_key_map) {
+  if (property.type_ == LatticeType::NONE) {
+    stored_key_map.index(key);
+  }
+
+  stored_key_map.set_size(key, property, serializer->put(key, payload));
+  property.type_ = std::move(lattice_type);
+}
+
+bool is_primary_tier(const Key &key, KeyReplicationMap &key_replication_map) {
   if (key_replication_map[key].global_replication_[kSelfTier] == 0) {
     return false;
-  } else {
-    if (kSelfTier > Tier::MEMORY) {
-      bool has_upper_tier_replica = false;
-      for (const Tier &tier : kAllTiers) {
-        if (tier < kSelfTier &&
-            key_replication_map[key].global_replication_[tier] > 0) {
-          has_upper_tier_replica = true;
-        }
-      }
-      if (has_upper_tier_replica) {
+  }
+
+  if (kSelfTier > Tier::MEMORY) {
+    for (const Tier &tier : kAllTiers) {
+      if (tier < kSelfTier &&
+          key_replication_map[key].global_replication_[tier] > 0) {
         return false;
       }
     }
+  }
+
+  return true;
+}
 
-    auto global_pos = global_hash_rings[kSelfTier].find(key);
-    if (global_pos != global_hash_rings[kSelfTier].end() &&
-        st.private_ip().compare(global_pos->second.private_ip()) == 0) {
-      auto local_pos = local_hash_rings[kSelfTier].find(key);
+bool is_primary_replica(const Key &key,
+                        KeyReplicationMap &key_replication_map,
+                        GlobalRingMap &global_hash_rings,
+                        LocalRingMap &local_hash_rings, ServerThread &st) {
+  if (!is_primary_tier(key, key_replication_map)) {
+    return false;
+  }
+
+  // the first owners rather than the threads at the key's ring positions,
+  // which differ when the rings have a load bound
+  ServerThreadList global_owner =
+      global_hash_rings[kSelfTier].responsible(key, 1);
+  if (!global_owner.empty() &&
+      st.private_ip().compare(global_owner[0].private_ip()) == 0) {
+    ServerThreadList local_owner =
+        local_hash_rings[kSelfTier].responsible(key, 1);
+
+    if (!local_owner.empty() && st.tid() == local_owner[0].tid()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// builds the factor a ReplicationFactorUpdate carries for key
+static ReplicationFactor replication_factor(const Key &key,
+                                            const KeyReplication &replication) {
+  ReplicationFactor factor;
+  factor.set_key(key);
+
+  for (const auto &pair : replication.global_replication_) {
+    ReplicationFactor_ReplicationValue *global = factor.add_global();
+    global->set_tier(pair.first);
+    global->set_value(pair.second);
+  }
+
+  for (const auto &pair : replication.local_replication_) {
+    ReplicationFactor_ReplicationValue *local = factor.add_local();
+    local->set_tier(pair.first);
+    local->set_value(pair.second);
+  }
+
+  return factor;
+}
+
+// lowers one of key's memory tier factors in replication by 1 if that takes
+// the key off st: st's node is the last of the key's nodes, or st is the
+// last of the key's threads on each node. Returns false, leaving
+// replication as it is, if neither holds.
+static bool drop_replica(const Key &key, KeyReplication &replication,
+                         GlobalRingMap &global_hash_rings,
+                         LocalRingMap &local_hash_rings, ServerThread &st) {
+  ServerThreadList nodes =
+      responsible_global(key, replication.global_replication_[Tier::MEMORY],
+                         global_hash_rings[Tier::MEMORY]);
+  if (nodes.size() > 1 &&
+      st.private_ip().compare(nodes.back().private_ip()) == 0) {
+    replication.global_replication_[Tier::MEMORY] = nodes.size() - 1;
+    return true;
+  }
+
+  ServerThreadList threads = local_hash_rings[Tier::MEMORY].responsible(
+      key, replication.local_replication_[Tier::MEMORY]);
+  if (threads.size() > 1 && st.tid() == threads.back().tid()) {
+    replication.local_replication_[Tier::MEMORY] = threads.size() - 1;
+    return true;
+  }
+
+  return false;
+}
+
+unsigned evict_to_budget(unsigned long long target, unsigned &seed,
+                         logger log, GlobalRingMap &global_hash_rings,
+                         LocalRingMap &local_hash_rings,
+                         StoredKeyMap &stored_key_map,
+                         KeyReplicationMap &key_replication_map,
+                         LocalChangeset &local_changeset,
+                         vector<Address> &routing_ips, ServerThread &wt,
+                         SerializerMap &serializers, SocketCache &pushers,
+                         unsigned &rid) {
+  bool can_demote = kSelfTier == Tier::MEMORY &&
+                    global_hash_rings[Tier::DISK].server_count() > 0;
+
+  auto evictable = [&](const Key &key) {
+    if (is_metadata(key) ||
+        key_replication_map.find(key) == key_replication_map.end() ||
+        stored_key_map.dropping(key)) {
+      return false;
+    }
+
+    if (is_primary_replica(key, key_replication_map, global_hash_rings,
+                           local_hash_rings, wt)) {
+      return can_demote;
+    }
 
-      if (local_pos != local_hash_rings[kSelfTier].end() &&
-          st.tid() == local_pos->second.tid()) {
-        return true;
+    KeyReplication replication = key_replication_map[key];
+    return kSelfTier == Tier::MEMORY &&
+           drop_replica(key, replication, global_hash_rings, local_hash_rings,
+                        wt);
+  };
+
+  AddressKeysetMap addr_keyset_map;
+  map<Address, KeyRequest> metadata_puts;
+  map<Address, ReplicationFactorUpdate> updates;
+  set<Key> chosen;
+  set<Key> remove_set;
+  unsigned long long remaining = stored_key_map.retained_bytes();
+  bool succeed;
+
+  Key key;
+  while (remaining > target && chosen.size() < stored_key_map.size() &&
+         stored_key_map.next_victim(key, evictable)) {
+    if (!chosen.insert(key).second) {
+      // the clock came back around to a key it already chose
+      break;
+    }
+
+    remaining -= std::min(remaining,
+                          (unsigned long long)stored_key_map[key].size_);
+
+    KeyReplication replication = key_replication_map[key];
+    unsigned memory_replication =
+        replication.global_replication_[Tier::MEMORY];
+    bool primary = is_primary_replica(key, key_replication_map,
+                                      global_hash_rings, local_hash_rings, wt);
+
+    if (primary) {
+      replication.global_replication_[Tier::MEMORY] = 0;
+      replication.global_replication_[Tier::DISK] =
+          std::max(replication.global_replication_[Tier::DISK], 1u);
+      replication.local_replication_[Tier::DISK] =
+          std::max(replication.local_replication_[Tier::DISK], 1u);
+      key_replication_map[key] = replication;
+      remove_set.insert(key);
+    } else {
+      // the copy stays, and is served, until the change reaches this thread
+      // and the key is handed to its remaining replicas (see
+      // replication_change_handler)
+      drop_replica(key, replication, global_hash_rings, local_hash_rings, wt);
+    }
+
+    ReplicationFactor factor = replication_factor(key, replication);
+
+    // no one waits for the put, so it is sent without a response address
+    string serialized_factor;
+    factor.SerializeToString(&serialized_factor);
+    prepare_metadata_put_request(
+        get_metadata_key(key, MetadataType::replication), serialized_factor,
+        global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY],
+        metadata_puts, "", rid);
+
+    // the old memory replicas apply the change, and a demoted key's disk
+    // replicas take it, as when the monitor moves it
+    ServerThreadList threads = responsible_global(
+        key, memory_replication, global_hash_rings[Tier::MEMORY]);
+
+    if (primary) {
+      ServerThreadList disk_threads =
+          responsible_global(key, replication.global_replication_[Tier::DISK],
+                             global_hash_rings[Tier::DISK]);
+      threads.insert(threads.end(), disk_threads.begin(), disk_threads.end());
+    }
+
+    for (const ServerThread &thread : threads) {
+      *updates[thread.replication_change_connect_address()].add_updates() =
+          factor;
+    }
+
+    for (const Address &address : routing_ips) {
+      *updates[RoutingThread(address, 0).replication_change_connect_address()]
+           .add_updates() = factor;
+    }
+
+    if (primary) {
+      ServerThreadList disk_replicas = kHashRingUtil->get_responsible_threads(
+          wt.replication_response_connect_address(), key, false,
+          global_hash_rings, local_hash_rings, key_replication_map, pushers,
+          {Tier::DISK}, succeed, seed);
+
+      for (const ServerThread &thread : disk_replicas) {
+        addr_keyset_map[thread.gossip_connect_address()].insert(key);
       }
     }
+  }
 
-    return false;
+  if (chosen.empty()) {
+    return 0;
+  }
+
+  for (const auto &pair : metadata_puts) {
+    string serialized;
+    pair.second.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[pair.first]);
+  }
+
+  for (const auto &pair : updates) {
+    string serialized;
+    pair.second.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[pair.first]);
   }
+
+  send_gossip(addr_keyset_map, pushers, serializers, stored_key_map);
+
+  for (const Key &key : chosen) {
+    if (remove_set.find(key) == remove_set.end()) {
+      stored_key_map.start_drop(key);
+      continue;
+    }
+
+    serializers[stored_key_map[key].type_]->remove(key);
+    stored_key_map.erase(key);
+    local_changeset.erase(key);
+  }
+
+  log->info("Evicted {} keys ({} demoted to disk, {} replicas being dropped); "
+            "{} bytes are stored.",
+            chosen.size(), remove_set.size(),
+            chosen.size() - remove_set.size(), stored_key_map.bytes());
+
+  return chosen.size();
+}
+
+ReplicationFactor change_local_replication(
+    const Key &key, unsigned local, GlobalRingMap &global_hash_rings,
+    LocalRingMap &local_hash_rings, KeyReplicationMap &key_replication_map,
+    vector<Address> &routing_ips, SocketCache &pushers, unsigned &rid) {
+  const KeyReplication &replication = key_replication_map[key];
+
+  ReplicationFactor factor;
+  factor.set_key(key);
+
+  for (const auto &pair : replication.global_replication_) {
+    ReplicationFactor_ReplicationValue *global = factor.add_global();
+    global->set_tier(pair.first);
+    global->set_value(pair.second);
+  }
+
+  for (const auto &pair : replication.local_replication_) {
+    ReplicationFactor_ReplicationValue *value = factor.add_local();
+    value->set_tier(pair.first);
+    value->set_value(pair.first == Tier::MEMORY ? local : pair.second);
+  }
+
+  // no one waits for the put, so it is sent without a response address
+  string serialized_factor;
+  factor.SerializeToString(&serialized_factor);
+
+  map<Address, KeyRequest> metadata_puts;
+  prepare_metadata_put_request(
+      get_metadata_key(key, MetadataType::replication), serialized_factor,
+      global_hash_rings[Tier::MEMORY], local_hash_rings[Tier::MEMORY],
+      metadata_puts, "", rid);
+
+  for (const auto &pair : metadata_puts) {
+    string serialized;
+    pair.second.SerializeToString(&serialized);
+    kZmqUtil->send_string(serialized, &pushers[pair.first]);
+  }
+
+  ReplicationFactorUpdate update;
+  *update.add_updates() = factor;
+  string serialized_update;
+  update.SerializeToString(&serialized_update);
+
+  auto it = replication.global_replication_.find(Tier::MEMORY);
+  unsigned memory_replication =
+      it == replication.global_replication_.end() ? 0 : it->second;
+
+  for (const ServerThread &node : responsible_global(
+           key, memory_replication, global_hash_rings[Tier::MEMORY])) {
+    kZmqUtil->send_string(
+        serialized_update,
+        &pushers[ServerThread(node.public_ip(), node.private_ip(), 0)
+                     .replication_change_connect_address()]);
+  }
+
+  for (const Address &address : routing_ips) {
+    Address target =
+        RoutingThread(address, 0).replication_change_connect_address();
+    kZmqUtil->send_string(serialized_update, &pushers[target]);
+  }
+
+  return factor;
 }
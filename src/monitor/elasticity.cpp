@@ -37,3 +37,48 @@ void remove_node(logger log, ServerThread &node, string tier, bool &removing,
   kZmqUtil->send_string(ack_addr, &pushers[connection_addr]);
   removing = true;
 }
+
+void remove_memory_node(logger log, SummaryStats &ss,
+                        GlobalRingMap &global_hash_rings,
+                        LocalRingMap &local_hash_rings,
+                        KeyReplicationMap &key_replication_map,
+                        map<Key, unsigned> &key_access_summary,
+                        vector<Address> &routing_ips, SocketCache &pushers,
+                        MonitoringThread &mt, zmq::socket_t &response_puller,
+                        map<Address, unsigned> &departing_node_map,
+                        bool &removing_memory_node, unsigned &rid) {
+  map<Key, KeyReplication> requests;
+
+  // before sending remove command, first adjust relevant key's replication
+  // factor
+  for (const auto &key_access_pair : key_access_summary) {
+    Key key = key_access_pair.first;
+
+    if (!is_metadata(key) &&
+        key_replication_map[key].global_replication_[Tier::MEMORY] ==
+            global_hash_rings[Tier::MEMORY].server_count()) {
+      unsigned new_mem_rep =
+          key_replication_map[key].global_replication_[Tier::MEMORY] - 1;
+      unsigned new_ebs_rep =
+          std::max(kMinimumReplicaNumber - new_mem_rep, (unsigned)0);
+      requests[key] = create_new_replication_vector(
+          new_mem_rep, new_ebs_rep,
+          key_replication_map[key].local_replication_[Tier::MEMORY],
+          key_replication_map[key].local_replication_[Tier::DISK]);
+      log->info("Dereplication for key {}. M: {}->{}. E: {}->{}", key,
+                key_replication_map[key].global_replication_[Tier::MEMORY],
+                requests[key].global_replication_[Tier::MEMORY],
+                key_replication_map[key].global_replication_[Tier::DISK],
+                requests[key].global_replication_[Tier::DISK]);
+    }
+  }
+
+  change_replication_factor(requests, global_hash_rings, local_hash_rings,
+                            routing_ips, key_replication_map, pushers, mt,
+                            response_puller, log, rid);
+
+  ServerThread node = ServerThread(ss.min_occupancy_memory_public_ip,
+                                   ss.min_occupancy_memory_private_ip, 0);
+  remove_node(log, node, "memory", removing_memory_node, pushers,
+              departing_node_map, mt);
+}
@@ -18,7 +18,8 @@
 void feedback_handler(
     string &serialized, map<string, double> &user_latency,
     map<string, double> &user_throughput,
-    map<Key, std::pair<double, unsigned>> &latency_miss_ratio_map) {
+    map<Key, std::pair<double, unsigned>> &latency_miss_ratio_map,
+    map<string, LatencyHistogram> &op_latency) {
   UserFeedback fb;
   fb.ParseFromString(serialized);
 
@@ -46,5 +47,17 @@ void feedback_handler(
         latency_miss_ratio_map[key].second += 1;
       }
     }
+
+    // merge the latency histograms of all clients, per request type
+    for (const auto &op : fb.op_latency()) {
+      if (op.precision_bits() != kHistogramPrecisionBits) {
+        continue;
+      }
+
+      LatencyHistogram &histogram = op_latency[op.op()];
+      for (int i = 0; i < op.buckets_size() && i < op.counts_size(); i++) {
+        histogram.add(op.buckets(i), op.counts(i));
+      }
+    }
   }
 }
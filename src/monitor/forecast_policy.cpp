@@ -0,0 +1,68 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "monitor/monitoring_utils.hpp"
+#include "monitor/policies.hpp"
+
+void forecast_policy(logger log, LoadForecast &forecast,
+                     GlobalRingMap &global_hash_rings,
+                     LocalRingMap &local_hash_rings, TimePoint &grace_start,
+                     SummaryStats &ss, unsigned &memory_node_count,
+                     unsigned &new_memory_count, bool &removing_memory_node,
+                     Address management_ip,
+                     KeyReplicationMap &key_replication_map,
+                     map<Key, unsigned> &key_access_summary,
+                     MonitoringThread &mt,
+                     map<Address, unsigned> &departing_node_map,
+                     SocketCache &pushers, zmq::socket_t &response_puller,
+                     vector<Address> &routing_ips, unsigned &rid) {
+  forecast.observe(ss.total_throughput, ss.avg_memory_occupancy,
+                   memory_node_count);
+
+  if (!kEnableElasticity || !forecast.ready()) {
+    return;
+  }
+
+  log->info("Forecast memory tier load is {} node(s) for {} node(s).",
+            forecast.projected_work(), memory_node_count);
+
+  // wait for the nodes being added or removed before changing the tier again
+  if (new_memory_count > 0 || removing_memory_node) {
+    return;
+  }
+
+  unsigned node_to_add = forecast.nodes_to_add(memory_node_count);
+  if (node_to_add > 0) {
+    log->info("Adding memory nodes ahead of the forecast load.");
+    add_node(log, "memory", node_to_add, new_memory_count, pushers,
+             management_ip);
+    return;
+  }
+
+  auto time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                          std::chrono::system_clock::now() - grace_start)
+                          .count();
+
+  if (forecast.can_remove() && time_elapsed > kGracePeriod &&
+      memory_node_count > std::max(ss.required_memory_node,
+                                   (unsigned)kMinMemoryTierSize)) {
+    log->info("Forecast load stays low; removing memory node {}/{}.",
+              ss.min_occupancy_memory_public_ip,
+              ss.min_occupancy_memory_private_ip);
+    remove_memory_node(log, ss, global_hash_rings, local_hash_rings,
+                       key_replication_map, key_access_summary, routing_ips,
+                       pushers, mt, response_puller, departing_node_map,
+                       removing_memory_node, rid);
+  }
+}
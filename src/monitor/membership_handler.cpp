@@ -19,8 +19,8 @@ void membership_handler(
     unsigned &new_memory_count, unsigned &new_ebs_count, TimePoint &grace_start,
     vector<Address> &routing_ips, StorageStats &memory_storage,
     StorageStats &ebs_storage, OccupancyStats &memory_occupancy,
-    OccupancyStats &ebs_occupancy,
-    map<Key, map<Address, unsigned>> &key_access_frequency) {
+    OccupancyStats &ebs_occupancy, AccessStats &memory_accesses,
+    AccessStats &ebs_accesses, AccessAggregate &access) {
   vector<string> v;
 
   split(serialized, ':', v);
@@ -72,32 +72,25 @@ void membership_handler(
     // update hash ring
     global_hash_rings[tier].remove(new_server_public_ip, new_server_private_ip,
                                    0);
-    if (tier == Tier::MEMORY) {
-      memory_storage.erase(new_server_private_ip);
-      memory_occupancy.erase(new_server_private_ip);
 
-      // NOTE: No const here because we are calling erase
-      for (auto &key_access_pair : key_access_frequency) {
-        for (unsigned i = 0; i < kMemoryThreadCount; i++) {
-          key_access_pair.second.erase(new_server_private_ip + ":" +
-                                       std::to_string(i));
-        }
-      }
-    } else if (tier == Tier::DISK) {
-      ebs_storage.erase(new_server_private_ip);
-      ebs_occupancy.erase(new_server_private_ip);
+    // the node's statistics are kept until it departs, since they are
+    // pushed rather than collected every epoch
+    Address ip_pair = new_server_public_ip + "/" + new_server_private_ip;
 
-      // NOTE: No const here because we are calling erase
-      for (auto &key_access_pair : key_access_frequency) {
-        for (unsigned i = 0; i < kEbsThreadCount; i++) {
-          key_access_pair.second.erase(new_server_private_ip + ":" +
-                                       std::to_string(i));
-        }
-      }
+    if (tier == Tier::MEMORY) {
+      memory_storage.erase(ip_pair);
+      memory_occupancy.erase(ip_pair);
+      memory_accesses.erase(ip_pair);
+    } else if (tier == Tier::DISK) {
+      ebs_storage.erase(ip_pair);
+      ebs_occupancy.erase(ip_pair);
+      ebs_accesses.erase(ip_pair);
     } else {
       log->error("Invalid tier: {}.", std::to_string(tier));
     }
 
+    access.remove(ip_pair);
+
     for (const auto &pair : global_hash_rings) {
       log->info("Hash ring for tier {} is size {}.", pair.first,
                 pair.second.size());
@@ -31,6 +31,8 @@ unsigned kMinimumReplicaNumber;
 bool kEnableElasticity;
 bool kEnableTiering;
 bool kEnableSelectiveRep;
+bool kEnableForecast;
+unsigned kMaxReplicationChanges;
 
 // read-only per-tier metadata
 hmap<Tier, TierMetadata, TierEnumHash> kTierMetadata;
@@ -52,6 +54,8 @@ int main(int argc, char *argv[]) {
 
   // read the YAML conf
   YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  configure_hashing(conf);
+
   YAML::Node monitoring = conf["monitoring"];
   Address ip = monitoring["ip"].as<Address>();
   Address management_ip = monitoring["mgmt_ip"].as<Address>();
@@ -61,10 +65,32 @@ int main(int argc, char *argv[]) {
   kEnableSelectiveRep = policy["selective-rep"].as<bool>();
   kEnableTiering = policy["tiering"].as<bool>();
 
+  kMaxReplicationChanges = 0;
+  if (YAML::Node changes = policy["replication-changes-per-round"]) {
+    kMaxReplicationChanges = changes.as<unsigned>();
+  }
+
   log->info("Elasticity policy enabled: {}", kEnableElasticity);
   log->info("Tiering policy enabled: {}", kEnableTiering);
   log->info("Selective replication policy enabled: {}", kEnableSelectiveRep);
 
+  // forecasting is opt-in; without it, nodes are added and removed only in
+  // response to the latency and occupancy observed
+  LoadForecast forecast;
+  kEnableForecast = false;
+
+  if (YAML::Node forecasting = policy["forecast"]) {
+    kEnableForecast = forecasting["enabled"].as<bool>();
+    forecast = LoadForecast(
+        forecasting["alpha"].as<double>(), forecasting["beta"].as<double>(),
+        forecasting["horizon"].as<unsigned>(),
+        forecasting["high-occupancy"].as<double>(),
+        forecasting["low-occupancy"].as<double>(),
+        forecasting["shrink-epochs"].as<unsigned>());
+  }
+
+  log->info("Load forecasting enabled: {}", kEnableForecast);
+
   YAML::Node threads = conf["threads"];
   kMemoryThreadCount = threads["memory"].as<unsigned>();
   kEbsThreadCount = threads["ebs"].as<unsigned>();
@@ -98,12 +124,13 @@ int main(int argc, char *argv[]) {
   }
 
   // keep track of the keys' replication info
-  map<Key, KeyReplication> key_replication_map;
+  KeyReplicationMap key_replication_map;
 
   unsigned memory_node_count;
   unsigned ebs_node_count;
 
-  map<Key, map<Address, unsigned>> key_access_frequency;
+  // the latest key access summary of every server thread and their sums
+  AccessAggregate access;
 
   map<Key, unsigned> key_access_summary;
 
@@ -129,6 +156,9 @@ int main(int argc, char *argv[]) {
 
   map<Key, std::pair<double, unsigned>> latency_miss_ratio_map;
 
+  // the latencies clients reported during this epoch, per request type
+  map<string, LatencyHistogram> op_latency;
+
   vector<Address> routing_ips;
 
   MonitoringThread mt = MonitoringThread(ip);
@@ -159,10 +189,15 @@ int main(int argc, char *argv[]) {
   zmq::socket_t feedback_puller(context, ZMQ_PULL);
   feedback_puller.bind(mt.feedback_report_bind_address());
 
+  // responsible for receiving the statistics that server threads push
+  zmq::socket_t stats_puller(context, ZMQ_PULL);
+  stats_puller.bind(mt.stats_report_bind_address());
+
   vector<zmq::pollitem_t> pollitems = {
       {static_cast<void *>(notify_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(depart_done_puller), 0, ZMQ_POLLIN, 0},
-      {static_cast<void *>(feedback_puller), 0, ZMQ_POLLIN, 0}};
+      {static_cast<void *>(feedback_puller), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(stats_puller), 0, ZMQ_POLLIN, 0}};
 
   auto report_start = std::chrono::system_clock::now();
   auto report_end = std::chrono::system_clock::now();
@@ -186,7 +221,7 @@ int main(int argc, char *argv[]) {
       membership_handler(log, serialized, global_hash_rings, new_memory_count,
                          new_ebs_count, grace_start, routing_ips,
                          memory_storage, ebs_storage, memory_occupancy,
-                         ebs_occupancy, key_access_frequency);
+                         ebs_occupancy, memory_accesses, ebs_accesses, access);
     }
 
     if (pollitems[1].revents & ZMQ_POLLIN) {
@@ -199,7 +234,15 @@ int main(int argc, char *argv[]) {
     if (pollitems[2].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&feedback_puller);
       feedback_handler(serialized, user_latency, user_throughput,
-                       latency_miss_ratio_map);
+                       latency_miss_ratio_map, op_latency);
+    }
+
+    if (pollitems[3].revents & ZMQ_POLLIN) {
+      string serialized = kZmqUtil->recv_string(&stats_puller);
+      stats_report_handler(log, serialized, access, key_size, memory_storage,
+                           ebs_storage, memory_occupancy, ebs_occupancy,
+                           memory_accesses, ebs_accesses,
+                           key_replication_map);
     }
 
     report_end = std::chrono::system_clock::now();
@@ -209,36 +252,46 @@ int main(int argc, char *argv[]) {
             .count() >= kMonitoringThreshold) {
       server_monitoring_epoch += 1;
 
-      memory_node_count =
-          global_hash_rings[Tier::MEMORY].size() / kVirtualThreadNum;
-      ebs_node_count = global_hash_rings[Tier::DISK].size() / kVirtualThreadNum;
+      memory_node_count = global_hash_rings[Tier::MEMORY].server_count();
+      ebs_node_count = global_hash_rings[Tier::DISK].server_count();
 
-      key_access_frequency.clear();
       key_access_summary.clear();
-
-      memory_storage.clear();
-      ebs_storage.clear();
-
-      memory_occupancy.clear();
-      ebs_occupancy.clear();
-
       ss.clear();
 
-      user_latency.clear();
-      user_throughput.clear();
-      latency_miss_ratio_map.clear();
+      // server threads push their statistics as they go; drop those of the
+      // threads that have stopped reporting without departing
+      auto oldest = std::chrono::steady_clock::now() -
+                    std::chrono::seconds(kStatsReportExpiry);
+      for (const auto &expired : access.expire(oldest)) {
+        log->info("Thread {}:{} stopped reporting statistics.", expired.first,
+                  expired.second);
+
+        erase_thread_stats(memory_storage, expired.first, expired.second);
+        erase_thread_stats(ebs_storage, expired.first, expired.second);
+        erase_thread_stats(memory_occupancy, expired.first, expired.second);
+        erase_thread_stats(ebs_occupancy, expired.first, expired.second);
+        erase_thread_stats(memory_accesses, expired.first, expired.second);
+        erase_thread_stats(ebs_accesses, expired.first, expired.second);
+      }
+
+      unsigned expected_sources = memory_node_count * kMemoryThreadCount +
+                                  ebs_node_count * kEbsThreadCount;
 
-      collect_internal_stats(
-          global_hash_rings, local_hash_rings, pushers, mt, response_puller,
-          log, rid, key_access_frequency, key_size, memory_storage, ebs_storage,
-          memory_occupancy, ebs_occupancy, memory_accesses, ebs_accesses);
+      compute_summary_stats(access, key_size, expected_sources, memory_storage,
+                            ebs_storage, memory_occupancy, ebs_occupancy,
+                            memory_accesses, ebs_accesses, key_access_summary,
+                            ss, log, server_monitoring_epoch);
 
-      compute_summary_stats(key_access_frequency, memory_storage, ebs_storage,
-                            memory_occupancy, ebs_occupancy, memory_accesses,
-                            ebs_accesses, key_access_summary, ss, log,
-                            server_monitoring_epoch);
+      // so that the load the policies act on can be traced to its tenants
+      for (const auto &pair : access.tenants()) {
+        log->info("Tenant \"{}\" made {} requests ({} refused) and stores {} "
+                  "bytes.",
+                  pair.first, pair.second.accesses, pair.second.rejected,
+                  pair.second.bytes);
+      }
 
-      collect_external_stats(user_latency, user_throughput, ss, log);
+      collect_external_stats(user_latency, user_throughput, op_latency, ss,
+                             log);
 
       // initialize replication factor for new keys
       for (const auto &key_access_pair : key_access_summary) {
@@ -262,10 +315,27 @@ int main(int argc, char *argv[]) {
 
       slo_policy(log, global_hash_rings, local_hash_rings, grace_start, ss,
                  memory_node_count, new_memory_count, removing_memory_node,
-                 management_ip, key_replication_map, key_access_summary, mt,
+                 management_ip, key_replication_map, key_access_summary,
+                 access.heavy_hitters(kSelectiveRepKeyCount), mt,
                  departing_node_map, pushers, response_puller, routing_ips, rid,
                  latency_miss_ratio_map);
 
+      if (kEnableForecast) {
+        forecast_policy(log, forecast, global_hash_rings, local_hash_rings,
+                        grace_start, ss, memory_node_count, new_memory_count,
+                        removing_memory_node, management_ip,
+                        key_replication_map, key_access_summary, mt,
+                        departing_node_map, pushers, response_puller,
+                        routing_ips, rid);
+      }
+
+      // client feedback is gathered over the epoch, so it is only cleared
+      // once the policies have seen it
+      user_latency.clear();
+      user_throughput.clear();
+      latency_miss_ratio_map.clear();
+      op_latency.clear();
+
       report_start = std::chrono::system_clock::now();
     }
   }
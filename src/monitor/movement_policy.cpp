@@ -20,7 +20,7 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
                      SummaryStats &ss, unsigned &memory_node_count,
                      unsigned &ebs_node_count, unsigned &new_memory_count,
                      unsigned &new_ebs_count, Address management_ip,
-                     map<Key, KeyReplication> &key_replication_map,
+                     KeyReplicationMap &key_replication_map,
                      map<Key, unsigned> &key_access_summary,
                      map<Key, unsigned> &key_size, MonitoringThread &mt,
                      SocketCache &pushers, zmq::socket_t &response_puller,
@@ -31,6 +31,7 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
   int time_elapsed = 0;
   unsigned long long required_storage = 0;
   unsigned long long free_storage = 0;
+  unsigned long long evicted_storage = 0;
   bool overflow = false;
 
   if (kEnableTiering) {
@@ -38,31 +39,64 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
         (kMaxMemoryNodeConsumption *
              kTierMetadata[Tier::MEMORY].node_capacity_ * memory_node_count -
          ss.total_memory_consumption);
+    unsigned long long free_ebs_storage = std::max(
+        kMaxEbsNodeConsumption * kTierMetadata[Tier::DISK].node_capacity_ *
+                ebs_node_count -
+            ss.total_ebs_consumption,
+        0.0);
+
+    vector<TieringCandidate> disk_keys;
+    vector<TieringCandidate> memory_keys;
+
     for (const auto &key_access_pair : key_access_summary) {
       Key key = key_access_pair.first;
       unsigned access_count = key_access_pair.second;
 
-      if (!is_metadata(key) && access_count > kKeyPromotionThreshold &&
-          key_replication_map[key].global_replication_[Tier::MEMORY] == 0 &&
-          key_size.find(key) != key_size.end()) {
-        required_storage += key_size[key];
-        if (required_storage > free_storage) {
-          overflow = true;
-        } else {
-          requests[key] = create_new_replication_vector(
-              key_replication_map[key].global_replication_[Tier::MEMORY] + 1,
-              key_replication_map[key].global_replication_[Tier::DISK] - 1,
-              key_replication_map[key].local_replication_[Tier::MEMORY],
-              key_replication_map[key].local_replication_[Tier::DISK]);
+      if (is_metadata(key) || key_size.find(key) == key_size.end()) {
+        continue;
+      }
+
+      TieringCandidate candidate = {key, access_count, key_size[key]};
+
+      if (key_replication_map[key].global_replication_[Tier::MEMORY] == 0) {
+        if (access_count > kKeyPromotionThreshold) {
+          disk_keys.push_back(candidate);
         }
+      } else if (access_count >= kKeyDemotionThreshold) {
+        // the cold keys are demoted below regardless
+        memory_keys.push_back(candidate);
       }
     }
 
+    TieringPlan plan = plan_tiering(disk_keys, memory_keys, free_storage,
+                                    free_ebs_storage, kMaxKeyMovesPerEpoch);
+
+    for (const Key &key : plan.promote) {
+      requests[key] = create_new_replication_vector(
+          key_replication_map[key].global_replication_[Tier::MEMORY] + 1,
+          key_replication_map[key].global_replication_[Tier::DISK] - 1,
+          key_replication_map[key].local_replication_[Tier::MEMORY],
+          key_replication_map[key].local_replication_[Tier::DISK]);
+    }
+
+    for (const Key &key : plan.evict) {
+      requests[key] =
+          create_new_replication_vector(0, kMinimumReplicaNumber, 1, 1);
+    }
+
+    // the keys still on disk count towards the memory the tier should have
+    overflow = plan.unplaced_bytes > 0;
+    required_storage = plan.promoted_bytes + plan.unplaced_bytes;
+    evicted_storage = plan.evicted_bytes;
+
     change_replication_factor(requests, global_hash_rings, local_hash_rings,
                               routing_ips, key_replication_map, pushers, mt,
-                              response_puller, log, rid);
+                              response_puller, log, rid,
+                              kMaxReplicationChanges);
 
-    log->info("Promoting {} keys into memory tier.", requests.size());
+    log->info("Promoting {} keys into memory tier.", plan.promote.size());
+    log->info("Evicting {} keys to make room for denser ones.",
+              plan.evict.size());
     time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
                        std::chrono::system_clock::now() - grace_start)
                        .count();
@@ -90,7 +124,7 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
     free_storage =
         (kMaxEbsNodeConsumption * kTierMetadata[Tier::DISK].node_capacity_ *
              ebs_node_count -
-         ss.total_ebs_consumption);
+         ss.total_ebs_consumption - evicted_storage);
     overflow = false;
 
     for (const auto &key_access_pair : key_access_summary) {
@@ -112,7 +146,8 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
 
     change_replication_factor(requests, global_hash_rings, local_hash_rings,
                               routing_ips, key_replication_map, pushers, mt,
-                              response_puller, log, rid);
+                              response_puller, log, rid,
+                              kMaxReplicationChanges);
 
     log->info("Demoting {} keys into EBS tier.", requests.size());
     if (kEnableElasticity && overflow && new_ebs_count == 0 &&
@@ -155,7 +190,8 @@ void movement_policy(logger log, GlobalRingMap &global_hash_rings,
 
     change_replication_factor(requests, global_hash_rings, local_hash_rings,
                               routing_ips, key_replication_map, pushers, mt,
-                              response_puller, log, rid);
+                              response_puller, log, rid,
+                              kMaxReplicationChanges);
   }
 
   requests.clear();
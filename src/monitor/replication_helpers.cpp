@@ -29,7 +29,7 @@ KeyReplication create_new_replication_vector(unsigned gm, unsigned ge,
 void prepare_replication_factor_update(
     const Key &key,
     map<Address, ReplicationFactorUpdate> &replication_factor_map,
-    Address server_address, map<Key, KeyReplication> &key_replication_map) {
+    Address server_address, KeyReplicationMap &key_replication_map) {
   ReplicationFactor *rf = replication_factor_map[server_address].add_updates();
   rf->set_key(key);
 
@@ -52,10 +52,10 @@ void change_replication_factor(map<Key, KeyReplication> &requests,
                                GlobalRingMap &global_hash_rings,
                                LocalRingMap &local_hash_rings,
                                vector<Address> &routing_ips,
-                               map<Key, KeyReplication> &key_replication_map,
+                               KeyReplicationMap &key_replication_map,
                                SocketCache &pushers, MonitoringThread &mt,
                                zmq::socket_t &response_puller, logger log,
-                               unsigned &rid) {
+                               unsigned &rid, unsigned limit) {
   // used to keep track of the original replication factors for the requested
   // keys
   map<Key, KeyReplication> orig_key_replication_map_info;
@@ -66,16 +66,29 @@ void change_replication_factor(map<Key, KeyReplication> &requests,
   // form the replication factor update request map
   map<Address, ReplicationFactorUpdate> replication_factor_map;
 
+  // the keys whose factors change; only they are stored and sent out
+  vector<Key> changed;
+  unsigned deferred = 0;
+
   for (const auto &request_pair : requests) {
     Key key = request_pair.first;
     KeyReplication new_rep = request_pair.second;
-    orig_key_replication_map_info[key] = key_replication_map[key];
 
     // don't send an update if we're not changing the metadata
     if (new_rep == key_replication_map[key]) {
       continue;
     }
 
+    // the rest wait for a later round, whose policies ask for them again if
+    // they are still needed
+    if (limit > 0 && changed.size() >= limit) {
+      deferred += 1;
+      continue;
+    }
+
+    changed.push_back(key);
+    orig_key_replication_map_info[key] = key_replication_map[key];
+
     // update the metadata map
     key_replication_map[key].global_replication_ = new_rep.global_replication_;
     key_replication_map[key].local_replication_ = new_rep.local_replication_;
@@ -106,22 +119,27 @@ void change_replication_factor(map<Key, KeyReplication> &requests,
         mt.response_connect_address(), rid);
   }
 
-  // send updates to storage nodes
+  // send updates to all storage nodes at once; the keys of the nodes that
+  // do not answer in time keep their old replication factors
+  map<Address, KeyResponse> responses = make_requests<KeyRequest, KeyResponse>(
+      addr_request_map, pushers, response_puller, kMetadataRequestTimeout);
+
   set<Key> failed_keys;
   for (const auto &request_pair : addr_request_map) {
-    bool succeed;
-    auto res = make_request<KeyRequest, KeyResponse>(
-        request_pair.second, pushers[request_pair.first], response_puller,
-        succeed);
+    auto response = responses.find(request_pair.first);
+    if (response != responses.end()) {
+      replica_selector().answered(response->second.response_id());
+    }
 
-    if (!succeed) {
-      log->error("Replication factor put timed out!");
+    if (response == responses.end()) {
+      log->error("Replication factor put to {} timed out!",
+                 request_pair.first);
 
       for (const auto &tuple : request_pair.second.tuples()) {
         failed_keys.insert(get_key_from_metadata(tuple.key()));
       }
     } else {
-      for (const auto &tuple : res.tuples()) {
+      for (const auto &tuple : response->second.tuples()) {
         if (tuple.error() == 2) {
           log->error(
               "Replication factor put for key {} rejected due to incorrect "
@@ -134,9 +152,12 @@ void change_replication_factor(map<Key, KeyReplication> &requests,
     }
   }
 
-  for (const auto &request_pair : requests) {
-    Key key = request_pair.first;
+  if (deferred > 0) {
+    log->info("Deferred {} replication factor changes to a later round.",
+              deferred);
+  }
 
+  for (const Key &key : changed) {
     if (failed_keys.find(key) == failed_keys.end()) {
       for (const Tier &tier : kAllTiers) {
         unsigned rep = std::max(
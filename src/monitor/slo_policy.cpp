@@ -20,22 +20,25 @@ void slo_policy(logger log, GlobalRingMap &global_hash_rings,
                 SummaryStats &ss, unsigned &memory_node_count,
                 unsigned &new_memory_count, bool &removing_memory_node,
                 Address management_ip,
-                map<Key, KeyReplication> &key_replication_map,
-                map<Key, unsigned> &key_access_summary, MonitoringThread &mt,
+                KeyReplicationMap &key_replication_map,
+                map<Key, unsigned> &key_access_summary,
+                const vector<HeavyHitter> &hot_keys, MonitoringThread &mt,
                 map<Address, unsigned> &departing_node_map,
                 SocketCache &pushers, zmq::socket_t &response_puller,
                 vector<Address> &routing_ips, unsigned &rid,
                 map<Key, std::pair<double, unsigned>> &latency_miss_ratio_map) {
-  // check latency to trigger elasticity or selective replication
+  // check latency to trigger elasticity or selective replication; the p99
+  // is used if clients reported histograms, and the average otherwise
+  double latency = ss.p99_latency > 0 ? ss.p99_latency : ss.avg_latency;
+
   map<Key, KeyReplication> requests;
-  if (ss.avg_latency > kSloWorst && new_memory_count == 0) {
-    log->info("Observed latency ({}) violates SLO({}).", ss.avg_latency,
-              kSloWorst);
+  if (latency > kSloWorst && new_memory_count == 0) {
+    log->info("Observed latency ({}) violates SLO({}).", latency, kSloWorst);
 
     // figure out if we should do hot key replication or add nodes
     if (kEnableElasticity && ss.min_memory_occupancy > 0.15) {
       unsigned node_to_add =
-          ceil((ss.avg_latency / kSloWorst - 1) * memory_node_count);
+          ceil((latency / kSloWorst - 1) * memory_node_count);
 
       // trigger elasticity
       auto time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(
@@ -46,15 +49,18 @@ void slo_policy(logger log, GlobalRingMap &global_hash_rings,
                  management_ip);
       }
     } else if (kEnableSelectiveRep) {
-      for (const auto &key_access_pair : key_access_summary) {
-        Key key = key_access_pair.first;
-        unsigned access_count = key_access_pair.second;
+      // only the cluster's hottest keys are considered, each by the accesses
+      // it is known to have had
+      for (const HeavyHitter &hitter : hot_keys) {
+        const Key &key = hitter.key;
+        unsigned access_count = hitter.count;
 
         if (!is_metadata(key) &&
             access_count > ss.key_access_mean + ss.key_access_std &&
             latency_miss_ratio_map.find(key) != latency_miss_ratio_map.end()) {
-          log->info("Key {} accessed {} times (threshold is {}).", key,
-                    access_count, ss.key_access_mean + ss.key_access_std);
+          log->info("Key {} accessed {} to {} times (threshold is {}).", key,
+                    access_count, hitter.bound,
+                    ss.key_access_mean + ss.key_access_std);
           unsigned target_rep_factor =
               key_replication_map[key].global_replication_[Tier::MEMORY] *
               latency_miss_ratio_map[key].first;
@@ -99,9 +105,10 @@ void slo_policy(logger log, GlobalRingMap &global_hash_rings,
 
       change_replication_factor(requests, global_hash_rings, local_hash_rings,
                                 routing_ips, key_replication_map, pushers, mt,
-                                response_puller, log, rid);
+                                response_puller, log, rid,
+                                kMaxReplicationChanges);
     }
-  } else if (kEnableElasticity && !removing_memory_node &&
+  } else if (kEnableElasticity && !kEnableForecast && !removing_memory_node &&
              ss.min_memory_occupancy < 0.05 &&
              memory_node_count > std::max(ss.required_memory_node,
                                           (unsigned)kMinMemoryTierSize)) {
@@ -113,38 +120,10 @@ void slo_policy(logger log, GlobalRingMap &global_hash_rings,
                             .count();
 
     if (time_elapsed > kGracePeriod) {
-      // before sending remove command, first adjust relevant key's replication
-      // factor
-      for (const auto &key_access_pair : key_access_summary) {
-        Key key = key_access_pair.first;
-
-        if (!is_metadata(key) &&
-            key_replication_map[key].global_replication_[Tier::MEMORY] ==
-                (global_hash_rings[Tier::MEMORY].size() / kVirtualThreadNum)) {
-          unsigned new_mem_rep =
-              key_replication_map[key].global_replication_[Tier::MEMORY] - 1;
-          unsigned new_ebs_rep =
-              std::max(kMinimumReplicaNumber - new_mem_rep, (unsigned)0);
-          requests[key] = create_new_replication_vector(
-              new_mem_rep, new_ebs_rep,
-              key_replication_map[key].local_replication_[Tier::MEMORY],
-              key_replication_map[key].local_replication_[Tier::DISK]);
-          log->info("Dereplication for key {}. M: {}->{}. E: {}->{}", key,
-                    key_replication_map[key].global_replication_[Tier::MEMORY],
-                    requests[key].global_replication_[Tier::MEMORY],
-                    key_replication_map[key].global_replication_[Tier::DISK],
-                    requests[key].global_replication_[Tier::DISK]);
-        }
-      }
-
-      change_replication_factor(requests, global_hash_rings, local_hash_rings,
-                                routing_ips, key_replication_map, pushers, mt,
-                                response_puller, log, rid);
-
-      ServerThread node = ServerThread(ss.min_occupancy_memory_public_ip,
-                                       ss.min_occupancy_memory_private_ip, 0);
-      remove_node(log, node, "memory", removing_memory_node, pushers,
-                  departing_node_map, mt);
+      remove_memory_node(log, ss, global_hash_rings, local_hash_rings,
+                         key_replication_map, key_access_summary, routing_ips,
+                         pushers, mt, response_puller, departing_node_map,
+                         removing_memory_node, rid);
     }
   }
 }
@@ -13,149 +13,43 @@
 //  limitations under the License.
 
 #include "monitor/monitoring_utils.hpp"
-#include "requests.hpp"
-
-void collect_internal_stats(
-    GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    SocketCache &pushers, MonitoringThread &mt, zmq::socket_t &response_puller,
-    logger log, unsigned &rid,
-    map<Key, map<Address, unsigned>> &key_access_frequency,
-    map<Key, unsigned> &key_size, StorageStats &memory_storage,
+
+void compute_summary_stats(
+    AccessAggregate &access, map<Key, unsigned> &key_size,
+    unsigned expected_sources, StorageStats &memory_storage,
     StorageStats &ebs_storage, OccupancyStats &memory_occupancy,
     OccupancyStats &ebs_occupancy, AccessStats &memory_accesses,
-    AccessStats &ebs_accesses) {
-  map<Address, KeyRequest> addr_request_map;
-
-  for (const Tier &tier : kAllTiers) {
-    GlobalHashRing hash_ring = global_hash_rings[tier];
-
-    for (const ServerThread &st : hash_ring.get_unique_servers()) {
-      for (unsigned i = 0; i < kTierMetadata[tier].thread_number_; i++) {
-        Key key = get_metadata_key(st, tier, i, MetadataType::server_stats);
-        prepare_metadata_get_request(key, global_hash_rings[Tier::MEMORY],
-                                     local_hash_rings[Tier::MEMORY],
-                                     addr_request_map,
-                                     mt.response_connect_address(), rid);
-
-        key = get_metadata_key(st, tier, i, MetadataType::key_access);
-        prepare_metadata_get_request(key, global_hash_rings[Tier::MEMORY],
-                                     local_hash_rings[Tier::MEMORY],
-                                     addr_request_map,
-                                     mt.response_connect_address(), rid);
-
-        key = get_metadata_key(st, tier, i, MetadataType::key_size);
-        prepare_metadata_get_request(key, global_hash_rings[Tier::MEMORY],
-                                     local_hash_rings[Tier::MEMORY],
-                                     addr_request_map,
-                                     mt.response_connect_address(), rid);
+    AccessStats &ebs_accesses, map<Key, unsigned> &key_access_summary,
+    SummaryStats &ss, logger log, unsigned &server_monitoring_epoch) {
+  // the keys that are hot on some thread get their summed counts
+  key_access_summary = access.hot();
+
+  // of the other keys, those that the sketch shows no thread accessed get a
+  // count of 0, so that they can be demoted; that takes a report from every
+  // thread, or keys on the threads that have not reported would look cold.
+  // Keys that were accessed but are hot nowhere are left out.
+  if (access.sketched() && access.sources() >= expected_sources) {
+    for (const auto &key_size_pair : key_size) {
+      const Key &key = key_size_pair.first;
+
+      if (key_access_summary.find(key) == key_access_summary.end() &&
+          access.estimate(key) == 0) {
+        key_access_summary[key] = 0;
       }
     }
+  } else {
+    log->info("Have access reports from {} of {} threads.", access.sources(),
+              expected_sources);
   }
 
-  for (const auto &addr_request_pair : addr_request_map) {
-    bool succeed;
-    auto res = make_request<KeyRequest, KeyResponse>(
-        addr_request_pair.second, pushers[addr_request_pair.first],
-        response_puller, succeed);
-
-    if (succeed) {
-      for (const KeyTuple &tuple : res.tuples()) {
-        if (tuple.error() == 0) {
-          vector<string> tokens = split_metadata_key(tuple.key());
-
-          string metadata_type = tokens[1];
-          Address ip_pair = tokens[2] + "/" + tokens[3];
-          unsigned tid = stoi(tokens[4]);
-          Tier tier;
-          Tier_Parse(tokens[5], &tier);
-
-          LWWValue lww_value;
-          lww_value.ParseFromString(tuple.payload());
-
-          if (metadata_type == "stats") {
-            // deserialize the value
-            ServerThreadStatistics stat;
-            stat.ParseFromString(lww_value.value());
-
-            if (tier == MEMORY) {
-              memory_storage[ip_pair][tid] = stat.storage_consumption();
-              memory_occupancy[ip_pair][tid] =
-                  std::pair<double, unsigned>(stat.occupancy(), stat.epoch());
-              memory_accesses[ip_pair][tid] = stat.access_count();
-            } else {
-              ebs_storage[ip_pair][tid] = stat.storage_consumption();
-              ebs_occupancy[ip_pair][tid] =
-                  std::pair<double, unsigned>(stat.occupancy(), stat.epoch());
-              ebs_accesses[ip_pair][tid] = stat.access_count();
-            }
-          } else if (metadata_type == "access") {
-            // deserialized the value
-            KeyAccessData access;
-            access.ParseFromString(lww_value.value());
-
-            for (const auto &key_count : access.keys()) {
-              Key key = key_count.key();
-              key_access_frequency[key][ip_pair + ":" + std::to_string(tid)] =
-                  key_count.access_count();
-            }
-          } else if (metadata_type == "size") {
-            // deserialized the size
-            KeySizeData key_size_msg;
-            key_size_msg.ParseFromString(lww_value.value());
-
-            for (const auto &key_size_tuple : key_size_msg.key_sizes()) {
-              key_size[key_size_tuple.key()] = key_size_tuple.size();
-            }
-          }
-        } else if (tuple.error() == 1) {
-          log->error("Key {} doesn't exist.", tuple.key());
-        } else {
-          // The hash ring should never be inconsistent.
-          log->error("Hash ring is inconsistent for key {}.", tuple.key());
-        }
-      }
-    } else {
-      log->error("Request timed out.");
-      continue;
-    }
+  // compute the key access mean and standard deviation over the keys
+  // accessed on each thread
+  if (access.accessed() > 0) {
+    ss.key_access_mean = (double)access.total() / access.accessed();
+    double variance = access.squares() / access.accessed() -
+                      ss.key_access_mean * ss.key_access_mean;
+    ss.key_access_std = sqrt(std::max(variance, 0.0));
   }
-}
-
-void compute_summary_stats(
-    map<Key, map<Address, unsigned>> &key_access_frequency,
-    StorageStats &memory_storage, StorageStats &ebs_storage,
-    OccupancyStats &memory_occupancy, OccupancyStats &ebs_occupancy,
-    AccessStats &memory_accesses, AccessStats &ebs_accesses,
-    map<Key, unsigned> &key_access_summary, SummaryStats &ss, logger log,
-    unsigned &server_monitoring_epoch) {
-  // compute key access summary
-  unsigned cnt = 0;
-  double mean = 0;
-  double ms = 0;
-
-  for (const auto &key_access_pair : key_access_frequency) {
-    Key key = key_access_pair.first;
-    unsigned access_count = 0;
-
-    for (const auto &per_machine_pair : key_access_pair.second) {
-      access_count += per_machine_pair.second;
-    }
-
-    key_access_summary[key] = access_count;
-
-    if (access_count > 0) {
-      cnt += 1;
-
-      double delta = access_count - mean;
-      mean += (double)delta / cnt;
-
-      double delta2 = access_count - mean;
-      ms += delta * delta2;
-    }
-  }
-
-  ss.key_access_mean = mean;
-  ss.key_access_std = sqrt((double)ms / cnt);
 
   log->info("Access: mean={}, std={}", ss.key_access_mean, ss.key_access_std);
 
@@ -166,8 +60,8 @@ void compute_summary_stats(
     }
   }
 
-  for (const auto &access : ebs_accesses) {
-    for (const auto &thread_access : access.second) {
+  for (const auto &accesses : ebs_accesses) {
+    for (const auto &thread_access : accesses.second) {
       ss.total_ebs_access += thread_access.second;
     }
   }
@@ -339,6 +233,7 @@ void compute_summary_stats(
 
 void collect_external_stats(map<string, double> &user_latency,
                             map<string, double> &user_throughput,
+                            map<string, LatencyHistogram> &op_latency,
                             SummaryStats &ss, logger log) {
   // gather latency info
   if (user_latency.size() > 0) {
@@ -356,6 +251,23 @@ void collect_external_stats(map<string, double> &user_latency,
 
   log->info("Average latency is {}.", ss.avg_latency);
 
+  // gather latency percentiles, across all clients and request types
+  LatencyHistogram all;
+  for (const auto &op_pair : op_latency) {
+    const LatencyHistogram &histogram = op_pair.second;
+    all.merge(histogram);
+
+    log->info("{} latency is p50 {}, p99 {}, p99.9 {} over {} requests.",
+              op_pair.first, histogram.percentile(0.5),
+              histogram.percentile(0.99), histogram.percentile(0.999),
+              histogram.total());
+  }
+
+  if (all.total() > 0) {
+    ss.p99_latency = all.percentile(0.99);
+    log->info("P99 latency is {}.", ss.p99_latency);
+  }
+
   // gather throughput info
   if (user_throughput.size() > 0) {
     // compute latency from users
@@ -0,0 +1,72 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "monitor/monitoring_handlers.hpp"
+
+void stats_report_handler(logger log, string &serialized,
+                          AccessAggregate &access, map<Key, unsigned> &key_size,
+                          StorageStats &memory_storage,
+                          StorageStats &ebs_storage,
+                          OccupancyStats &memory_occupancy,
+                          OccupancyStats &ebs_occupancy,
+                          AccessStats &memory_accesses,
+                          AccessStats &ebs_accesses,
+                          KeyReplicationMap &key_replication_map) {
+  ServerStatsReport report;
+  report.ParseFromString(serialized);
+
+  Address ip_pair = report.public_ip() + "/" + report.private_ip();
+  unsigned tid = report.tid();
+  const ServerThreadStatistics &stat = report.stats();
+
+  if (stat.pending_migration_keys() > 0) {
+    log->info("Thread {}:{} has {} keys left to migrate.", ip_pair, tid,
+              stat.pending_migration_keys());
+  }
+
+  if (report.tier() == Tier::MEMORY) {
+    memory_storage[ip_pair][tid] = stat.storage_consumption();
+    memory_occupancy[ip_pair][tid] =
+        std::pair<double, unsigned>(stat.occupancy(), stat.epoch());
+    memory_accesses[ip_pair][tid] = stat.access_count();
+  } else {
+    ebs_storage[ip_pair][tid] = stat.storage_consumption();
+    ebs_occupancy[ip_pair][tid] =
+        std::pair<double, unsigned>(stat.occupancy(), stat.epoch());
+    ebs_accesses[ip_pair][tid] = stat.access_count();
+  }
+
+  access.apply(report, std::chrono::steady_clock::now());
+
+  for (const auto &key_size_tuple : report.key_sizes()) {
+    key_size[key_size_tuple.key()] = key_size_tuple.size();
+  }
+
+  // the thread has already sent these to the key's replicas and the routing
+  // tier; the monitor only adopts them, so that its policies start from them
+  for (const ReplicationFactor &factor : report.replication()) {
+    KeyReplication &replication = key_replication_map[factor.key()];
+
+    for (const auto &global : factor.global()) {
+      replication.global_replication_[global.tier()] = global.value();
+    }
+
+    for (const auto &local : factor.local()) {
+      replication.local_replication_[local.tier()] = local.value();
+    }
+
+    log->info("Thread {}:{} set the local replication of key {}.", ip_pair,
+              tid, factor.key());
+  }
+}
@@ -57,9 +57,9 @@ void storage_policy(logger log, GlobalRingMap &global_hash_rings,
 
       if (time_elapsed > kGracePeriod) {
         // pick a random ebs node and send remove node command
-        auto node = next(global_hash_rings[Tier::DISK].begin(),
-                         rand() % global_hash_rings[Tier::DISK].size())
-                        ->second;
+        GlobalHashRing &ebs_ring = global_hash_rings[Tier::DISK];
+        ServerThread node = ebs_ring.server(
+            *next(ebs_ring.begin(), rand() % ebs_ring.size()));
         remove_node(log, node, "ebs", removing_ebs_node, pushers,
                     departing_node_map, mt);
       }
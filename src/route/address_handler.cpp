@@ -17,9 +17,21 @@
 void address_handler(logger log, string &serialized, SocketCache &pushers,
                      RoutingThread &rt, GlobalRingMap &global_hash_rings,
                      LocalRingMap &local_hash_rings,
-                     map<Key, KeyReplication> &key_replication_map,
+                     KeyReplicationMap &key_replication_map,
+                     AddressCache &address_cache,
                      map<Key, vector<pair<Address, string>>> &pending_requests,
                      unsigned &seed) {
+  Trace trace;
+  uint64_t dequeued = 0;
+
+  if (kTracer != nullptr) {
+    trace = read_trace(serialized);
+
+    if (kTracer->sample(trace, seed)) {
+      dequeued = trace_time();
+    }
+  }
+
   KeyAddressRequest addr_request;
   addr_request.ParseFromString(serialized);
 
@@ -33,6 +45,7 @@ void address_handler(logger log, string &serialized, SocketCache &pushers,
   }
 
   bool respond = false;
+  unsigned pending_keys = 0;
   if (num_servers == 0) {
     addr_response.set_error(AnnaError::NO_SERVERS);
 
@@ -44,10 +57,33 @@ void address_handler(logger log, string &serialized, SocketCache &pushers,
     respond = true;
   } else { // if there are servers, attempt to return the correct threads
     for (const Key &key : addr_request.keys()) {
+      const vector<Address> *cached = address_cache.find(key);
+
+      if (cached != nullptr) {
+        KeyAddressResponse_KeyAddress *tp = addr_response.add_addresses();
+        tp->set_key(key);
+        respond = true;
+
+        for (const Address &address : *cached) {
+          tp->add_ips(address);
+        }
+
+        continue;
+      }
+
       ServerThreadList threads = {};
+      bool pending = false;
 
-      if (key.length() >
-          0) { // Only run this code is the key is a valid string.
+      if (key.length() > 0 &&
+          !share_replication(key, key_replication_map, rt.tid())) {
+        // another thread is already asking for the key's replication factor
+        // and passes the response on to this one
+        pending_requests[key].push_back(std::pair<Address, string>(
+            addr_request.response_address(), addr_request.request_id()));
+        pending = true;
+        pending_keys += 1;
+      } else if (key.length() >
+                 0) { // Only run this code is the key is a valid string.
         // Otherwise, an empty response will be sent.
         for (const Tier &tier : kAllTiers) {
           threads = kHashRingUtil->get_responsible_threads(
@@ -63,11 +99,23 @@ void address_handler(logger log, string &serialized, SocketCache &pushers,
                           // the key
             pending_requests[key].push_back(std::pair<Address, string>(
                 addr_request.response_address(), addr_request.request_id()));
-            return;
+            pending = true;
+            pending_keys += 1;
+            break;
           }
         }
       }
 
+      // the key is answered on its own once its replication factor arrives;
+      // the rest of the batch does not wait for it
+      if (pending) {
+        continue;
+      }
+
+      if (threads.size() > 0) {
+        address_cache.insert(key, threads);
+      }
+
       KeyAddressResponse_KeyAddress *tp = addr_response.add_addresses();
       tp->set_key(key);
       respond = true;
@@ -85,4 +133,17 @@ void address_handler(logger log, string &serialized, SocketCache &pushers,
     kZmqUtil->send_string(serialized,
                           &pushers[addr_request.response_address()]);
   }
+
+  if (trace.sampled()) {
+    // keys waiting on a replication factor are answered later, outside this
+    // span
+    uint64_t start = trace.sent != 0 ? trace.sent : dequeued;
+    uint64_t responded = trace_time();
+
+    kTracer->record(trace, new_span_id(seed), "route.address", start,
+                    responded, {{dequeued, "dequeue"}, {responded, "respond"}},
+                    {{"request.keys", std::to_string(addr_request.keys_size())},
+                     {"request.pending", std::to_string(pending_keys)},
+                     {"thread", std::to_string(rt.tid())}});
+  }
 }
@@ -0,0 +1,60 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "route/routing_handlers.hpp"
+
+void key_scan_handler(logger log, string &serialized, SocketCache &pushers,
+                      GlobalRingMap &global_hash_rings) {
+  KeyScanRequest request;
+  request.ParseFromString(serialized);
+
+  // every storage thread holds keys in the range, since keys are placed by
+  // hash, so each one is scanned and the client merges their pages
+  vector<Address> threads;
+  for (const Tier &tier : kAllTiers) {
+    auto metadata = kTierMetadata.find(tier);
+    if (metadata == kTierMetadata.end()) {
+      continue;
+    }
+
+    for (const ServerThread &st :
+         global_hash_rings[tier].get_unique_servers()) {
+      for (unsigned tid = 0; tid < metadata->second.thread_number_; tid++) {
+        threads.push_back(ServerThread(st.public_ip(), st.private_ip(), tid)
+                              .key_scan_connect_address());
+      }
+    }
+  }
+
+  if (threads.empty()) {
+    log->info("No servers to scan for request {}.", request.request_id());
+
+    KeyScanResponse response;
+    response.set_request_id(request.request_id());
+
+    string serialized_response;
+    response.SerializeToString(&serialized_response);
+    kZmqUtil->send_string(serialized_response,
+                          &pushers[request.response_address()]);
+    return;
+  }
+
+  request.set_shard_count(threads.size());
+
+  string serialized_request;
+  request.SerializeToString(&serialized_request);
+  for (const Address &address : threads) {
+    kZmqUtil->send_string(serialized_request, &pushers[address]);
+  }
+}
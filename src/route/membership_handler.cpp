@@ -15,7 +15,8 @@
 #include "route/routing_handlers.hpp"
 
 void membership_handler(logger log, string &serialized, SocketCache &pushers,
-                        GlobalRingMap &global_hash_rings, unsigned thread_id,
+                        GlobalRingMap &global_hash_rings,
+                        AddressCache &address_cache, unsigned thread_id,
                         Address ip) {
   vector<string> v;
 
@@ -35,16 +36,22 @@ void membership_handler(logger log, string &serialized, SocketCache &pushers,
               new_server_public_ip, new_server_private_ip,
               std::to_string(tier));
 
-    // update hash ring
-    bool inserted = global_hash_rings[tier].insert(
-        new_server_public_ip, new_server_private_ip, join_count, 0);
+    // update hash ring; threads reading the shared rings only get the join
+    // once thread 0 has inserted the node and published the rings
+    bool inserted = reads_shared_routing_state(thread_id) ||
+                    global_hash_rings[tier].insert(new_server_public_ip,
+                                                   new_server_private_ip,
+                                                   join_count, 0);
 
     if (inserted) {
+      // any cached key may have moved onto the new node
+      address_cache.clear();
+
       if (thread_id == 0) {
         // gossip the new node address between server nodes to ensure
         // consistency
         for (const auto &pair : global_hash_rings) {
-          const GlobalHashRing hash_ring = pair.second;
+          const GlobalHashRing &hash_ring = pair.second;
 
           // we send a message with everything but the join because that is
           // what the server nodes expect
@@ -62,6 +69,10 @@ void membership_handler(logger log, string &serialized, SocketCache &pushers,
           }
         }
 
+        if (kSharedRoutingState != nullptr) {
+          kSharedRoutingState->publish(global_hash_rings);
+        }
+
         // tell all worker threads about the message
         for (unsigned tid = 1; tid < kRoutingThreadCount; tid++) {
           kZmqUtil->send_string(
@@ -78,10 +89,18 @@ void membership_handler(logger log, string &serialized, SocketCache &pushers,
   } else if (type == "depart") {
     log->info("Received depart from server {}/{}.", new_server_public_ip,
               new_server_private_ip, new_server_private_ip);
-    global_hash_rings[tier].remove(new_server_public_ip, new_server_private_ip,
-                                   0);
+    if (!reads_shared_routing_state(thread_id)) {
+      global_hash_rings[tier].remove(new_server_public_ip,
+                                     new_server_private_ip, 0);
+    }
+
+    address_cache.clear();
 
     if (thread_id == 0) {
+      if (kSharedRoutingState != nullptr) {
+        kSharedRoutingState->publish(global_hash_rings);
+      }
+
       // tell all worker threads about the message
       for (unsigned tid = 1; tid < kRoutingThreadCount; tid++) {
         kZmqUtil->send_string(
@@ -17,18 +17,25 @@
 void replication_response_handler(
     logger log, string &serialized, SocketCache &pushers, RoutingThread &rt,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, KeyReplication> &key_replication_map,
+    KeyReplicationMap &key_replication_map, AddressCache &address_cache,
     map<Key, vector<pair<Address, string>>> &pending_requests, unsigned &seed) {
   KeyResponse response;
   response.ParseFromString(serialized);
+  replica_selector().answered(response.response_id());
+
   // we assume tuple 0 because there should only be one tuple responding to a
   // replication factor request
-  KeyTuple tuple = response.tuples(0);
+  const KeyTuple &tuple = response.tuples(0);
 
   Key key = get_key_from_metadata(tuple.key());
 
   AnnaError error = tuple.error();
 
+  if (error == AnnaError::NO_ERROR || error == AnnaError::KEY_DNE) {
+    key_replication_map.finish_request(key);
+    address_cache.invalidate(key);
+  }
+
   if (error == AnnaError::NO_ERROR) {
     LWWValue lww_value;
     lww_value.ParseFromString(tuple.payload());
@@ -47,9 +54,11 @@ void replication_response_handler(
     // this means that the receiving thread was responsible for the metadata
     // but didn't have any values stored -- we use the default rep factor
     init_replication(key_replication_map, key);
-  } else if (error == AnnaError::WRONG_THREAD) {
+  } else if (error == AnnaError::WRONG_THREAD ||
+             error == AnnaError::TIMEOUT) {
     // this means that the node that received the rep factor request was not
-    // responsible for that metadata
+    // responsible for that metadata, or was too busy to answer; the request
+    // is sent again, most likely to another replica
     auto respond_address = rt.replication_response_connect_address();
     kHashRingUtil->issue_replication_factor_request(
         respond_address, key, global_hash_rings[Tier::MEMORY],
@@ -61,6 +70,20 @@ void replication_response_handler(
     return;
   }
 
+  // keep the factor for the other threads, and pass the response on to those
+  // that waited on this thread's request rather than asking themselves
+  if (kSharedRoutingState != nullptr) {
+    kSharedRoutingState->update(key, key_replication_map[key]);
+
+    for (unsigned tid : kSharedRoutingState->finish_request(key)) {
+      if (tid != rt.tid()) {
+        kZmqUtil->send_string(
+            serialized, &pushers[RoutingThread(rt.ip(), tid)
+                                     .replication_response_connect_address()]);
+      }
+    }
+  }
+
   // process pending key address requests
   if (pending_requests.find(key) != pending_requests.end()) {
     bool succeed;
@@ -82,6 +105,11 @@ void replication_response_handler(
       }
     }
 
+    // a key no tier has a thread for is answered, but not cached
+    if (threads.size() > 0) {
+      address_cache.insert(key, threads);
+    }
+
     for (const auto &pending_key_req : pending_requests[key]) {
       KeyAddressResponse key_res;
       key_res.set_response_id(pending_key_req.second);
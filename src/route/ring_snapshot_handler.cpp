@@ -0,0 +1,134 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "route/routing_handlers.hpp"
+
+// adds the replication factor of key to snapshot, if we know it
+static void add_replication(RingSnapshot &snapshot, const Key &key,
+                            KeyReplicationMap &key_replication_map) {
+  auto it = key_replication_map.find(key);
+  if (it == key_replication_map.end()) {
+    return;
+  }
+
+  ReplicationFactor *rf = snapshot.add_replication();
+  rf->set_key(key);
+
+  for (const auto &pair : it->second.global_replication_) {
+    ReplicationFactor_ReplicationValue *global = rf->add_global();
+    global->set_tier(pair.first);
+    global->set_value(pair.second);
+  }
+
+  for (const auto &pair : it->second.local_replication_) {
+    ReplicationFactor_ReplicationValue *local = rf->add_local();
+    local->set_tier(pair.first);
+    local->set_value(pair.second);
+  }
+}
+
+static bool is_default_replication(const KeyReplication &replication) {
+  for (const auto &pair : replication.global_replication_) {
+    if (pair.second != kTierMetadata[pair.first].default_replication_) {
+      return false;
+    }
+  }
+
+  for (const auto &pair : replication.local_replication_) {
+    if (pair.second != kDefaultLocalReplication) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static RingSnapshot full_snapshot(GlobalRingMap &global_hash_rings,
+                                  KeyReplicationMap &key_replication_map,
+                                  unsigned long long version) {
+  RingSnapshot snapshot;
+  snapshot.set_version(version);
+  snapshot.set_seeded_hashing(kHashMode == HashMode::seeded);
+  snapshot.set_hash_seed(kHashSeed);
+  snapshot.set_virtual_nodes(kVirtualThreadNum);
+
+  for (const Tier &tier : kAllTiers) {
+    RingSnapshot_TierRing *ring = snapshot.add_tiers();
+    ring->set_tier(tier);
+    ring->set_thread_count(kTierMetadata[tier].thread_number_);
+    ring->set_global_replication(kTierMetadata[tier].default_replication_);
+    ring->set_local_replication(kDefaultLocalReplication);
+
+    const GlobalHashRing &hash_ring = global_hash_rings[tier];
+    ring->set_virtual_nodes(hash_ring.virtual_nodes());
+    ring->set_load_bound(hash_ring.load_bound());
+    for (const ServerThread &st : hash_ring.get_unique_servers()) {
+      auto server = ring->add_servers();
+      server->set_private_ip(st.private_ip());
+      server->set_public_ip(st.public_ip());
+    }
+  }
+
+  for (const auto &pair : key_replication_map) {
+    if (!is_default_replication(pair.second)) {
+      add_replication(snapshot, pair.first, key_replication_map);
+    }
+  }
+
+  return snapshot;
+}
+
+string ring_snapshot_handler(logger log, string &serialized,
+                             GlobalRingMap &global_hash_rings,
+                             KeyReplicationMap &key_replication_map,
+                             unsigned long long version) {
+  RingSnapshot snapshot;
+
+  // the request is the version the client already has, if any; an up to date
+  // client gets an empty delta back
+  if (serialized == std::to_string(version)) {
+    snapshot.set_version(version);
+    snapshot.set_delta(true);
+    snapshot.set_base_version(version);
+  } else {
+    log->info("Sending ring snapshot version {}.", version);
+    snapshot = full_snapshot(global_hash_rings, key_replication_map, version);
+  }
+
+  string response;
+  snapshot.SerializeToString(&response);
+  return response;
+}
+
+string ring_update(GlobalRingMap &global_hash_rings,
+                   KeyReplicationMap &key_replication_map, bool rings_changed,
+                   const set<Key> &keys, unsigned long long version) {
+  RingSnapshot snapshot;
+
+  if (rings_changed) {
+    snapshot = full_snapshot(global_hash_rings, key_replication_map, version);
+  } else {
+    snapshot.set_version(version);
+    snapshot.set_delta(true);
+    snapshot.set_base_version(version - 1);
+
+    for (const Key &key : keys) {
+      add_replication(snapshot, key, key_replication_map);
+    }
+  }
+
+  string serialized;
+  snapshot.SerializeToString(&serialized);
+  return serialized;
+}
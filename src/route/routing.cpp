@@ -28,6 +28,12 @@ ZmqUtilInterface *kZmqUtil = &zmq_util;
 HashRingUtil hash_ring_util;
 HashRingUtilInterface *kHashRingUtil = &hash_ring_util;
 
+// writes the spans of sampled requests; null unless tracing is enabled
+Tracer *kTracer = nullptr;
+
+SharedRoutingState shared_routing_state;
+SharedRoutingState *kSharedRoutingState = &shared_routing_state;
+
 void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
   string log_file = "log_" + std::to_string(thread_id) + ".txt";
   string log_name = "routing_log_" + std::to_string(thread_id);
@@ -50,7 +56,8 @@ void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
   }
 
   SocketCache pushers(&context, ZMQ_PUSH);
-  map<Key, KeyReplication> key_replication_map;
+  KeyReplicationMap key_replication_map(kDefaultReplicationCacheSize);
+  AddressCache address_cache;
 
   if (thread_id == 0) {
     // notify monitoring nodes
@@ -62,10 +69,20 @@ void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
     }
   }
 
-  // initialize hash ring maps
-  GlobalRingMap global_hash_rings;
+  // thread 0 applies membership changes to its own rings; the other threads
+  // read the copy it last published
+  std::shared_ptr<GlobalRingMap> global_hash_rings =
+      thread_id == 0 ? std::make_shared<GlobalRingMap>()
+                     : kSharedRoutingState->global();
   LocalRingMap local_hash_rings;
 
+  if (thread_id == 0) {
+    // create every tier up front, as the copies thread 0 publishes have them
+    for (const Tier &tier : kAllTiers) {
+      (*global_hash_rings)[tier];
+    }
+  }
+
   // pending events for asynchrony
   map<Key, vector<pair<Address, string>>> pending_requests;
 
@@ -99,12 +116,30 @@ void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
   zmq::socket_t key_address_puller(context, ZMQ_PULL);
   key_address_puller.bind(rt.key_address_bind_address());
 
+  // responsible for handing ring snapshots to clients that route on their own
+  zmq::socket_t ring_snapshot_responder(context, ZMQ_REP);
+  ring_snapshot_responder.bind(rt.ring_snapshot_bind_address());
+
+  // responsible for pushing ring snapshot updates to those clients
+  zmq::socket_t ring_update_publisher(context, ZMQ_PUB);
+  ring_update_publisher.bind(rt.ring_update_bind_address());
+
+  // responsible for fanning key scans from clients out to the servers
+  zmq::socket_t key_scan_puller(context, ZMQ_PULL);
+  key_scan_puller.bind(rt.key_scan_bind_address());
+
+  // versions start from the clock, so that a restarted thread does not reuse
+  // versions that clients may still hold
+  unsigned long long ring_version = (unsigned long long)time(NULL) << 20;
+
   vector<zmq::pollitem_t> pollitems = {
       {static_cast<void *>(addr_responder), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(notify_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(replication_response_puller), 0, ZMQ_POLLIN, 0},
       {static_cast<void *>(replication_change_puller), 0, ZMQ_POLLIN, 0},
-      {static_cast<void *>(key_address_puller), 0, ZMQ_POLLIN, 0}};
+      {static_cast<void *>(key_address_puller), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(ring_snapshot_responder), 0, ZMQ_POLLIN, 0},
+      {static_cast<void *>(key_scan_puller), 0, ZMQ_POLLIN, 0}};
 
   while (true) {
     kZmqUtil->poll(-1, &pollitems);
@@ -112,36 +147,67 @@ void run(unsigned thread_id, Address ip, vector<Address> monitoring_ips) {
     // only relavant for the seed node
     if (pollitems[0].revents & ZMQ_POLLIN) {
       kZmqUtil->recv_string(&addr_responder);
-      auto serialized = seed_handler(log, global_hash_rings);
+      auto serialized = seed_handler(log, *global_hash_rings);
       kZmqUtil->send_string(serialized, &addr_responder);
     }
 
     // handle a join or depart event coming from the server side
     if (pollitems[1].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&notify_puller);
-      membership_handler(log, serialized, pushers, global_hash_rings, thread_id,
-                         ip);
+
+      // thread 0 published the rings with the change before passing it on
+      if (reads_shared_routing_state(thread_id)) {
+        global_hash_rings = kSharedRoutingState->global();
+      }
+
+      membership_handler(log, serialized, pushers, *global_hash_rings,
+                         address_cache, thread_id, ip);
     }
 
     // received replication factor response
     if (pollitems[2].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&replication_response_puller);
-      replication_response_handler(log, serialized, pushers, rt,
-                                   global_hash_rings, local_hash_rings,
-                                   key_replication_map, pending_requests, seed);
+      replication_response_handler(
+          log, serialized, pushers, rt, *global_hash_rings, local_hash_rings,
+          key_replication_map, address_cache, pending_requests, seed);
     }
 
     if (pollitems[3].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&replication_change_puller);
       replication_change_handler(log, serialized, pushers, key_replication_map,
-                                 thread_id, ip);
+                                 address_cache, thread_id, ip);
     }
 
     if (pollitems[4].revents & ZMQ_POLLIN) {
       string serialized = kZmqUtil->recv_string(&key_address_puller);
-      address_handler(log, serialized, pushers, rt, global_hash_rings,
-                      local_hash_rings, key_replication_map, pending_requests,
-                      seed);
+      address_handler(log, serialized, pushers, rt, *global_hash_rings,
+                      local_hash_rings, key_replication_map, address_cache,
+                      pending_requests, seed);
+    }
+
+    if (pollitems[5].revents & ZMQ_POLLIN) {
+      string serialized = kZmqUtil->recv_string(&ring_snapshot_responder);
+      string snapshot =
+          ring_snapshot_handler(log, serialized, *global_hash_rings,
+                                key_replication_map, ring_version);
+      kZmqUtil->send_string(snapshot, &ring_snapshot_responder);
+    }
+
+    if (pollitems[6].revents & ZMQ_POLLIN) {
+      string serialized = kZmqUtil->recv_string(&key_scan_puller);
+      key_scan_handler(log, serialized, pushers, *global_hash_rings);
+    }
+
+    // everything that invalidated cached addresses also changes the snapshot
+    if (address_cache.changed()) {
+      bool rings_changed;
+      set<Key> keys;
+      address_cache.take_changes(rings_changed, keys);
+
+      ring_version += 1;
+      kZmqUtil->send_string(ring_update(*global_hash_rings, key_replication_map,
+                                        rings_changed, keys, ring_version),
+                            &ring_update_publisher);
     }
   }
 }
@@ -153,6 +219,8 @@ int main(int argc, char *argv[]) {
   }
 
   YAML::Node conf = YAML::LoadFile("conf/anna-config.yml");
+  configure_hashing(conf);
+
   YAML::Node threads = conf["threads"];
   unsigned kMemoryThreadCount = threads["memory"].as<unsigned>();
   unsigned kEbsThreadCount = threads["ebs"].as<unsigned>();
@@ -184,6 +252,23 @@ int main(int argc, char *argv[]) {
       TierMetadata(Tier::DISK, kEbsThreadCount, kDefaultGlobalEbsReplication,
                    kEbsNodeCapacity);
 
+  // trace a fraction of the requests that arrive untraced, along with every
+  // request that arrives with a trace context
+  if (YAML::Node tracing = conf["tracing"]) {
+    if (tracing["enabled"].as<bool>()) {
+      auto span_log =
+          spdlog::basic_logger_mt("spans", "spans_route.jsonl", true);
+      span_log->set_pattern("%v");
+      span_log->flush_on(spdlog::level::info);
+      kTracer = new Tracer(tracing["sample-fraction"].as<double>(),
+                           "anna-route", ip, span_log);
+    }
+  }
+
+  // the worker threads start out with the empty rings thread 0 starts with;
+  // publish creates every tier in them
+  kSharedRoutingState->publish(GlobalRingMap());
+
   vector<std::thread> routing_worker_threads;
 
   for (unsigned thread_id = 1; thread_id < kRoutingThreadCount; thread_id++) {
@@ -21,7 +21,7 @@ string seed_handler(logger log, GlobalRingMap &global_hash_rings) {
 
   for (const auto &pair : global_hash_rings) {
     Tier tid = pair.first;
-    GlobalHashRing hash_ring = pair.second;
+    const GlobalHashRing &hash_ring = pair.second;
 
     ClusterMembership_TierMembership *tier = membership.add_tiers();
     tier->set_tier_id(tid);
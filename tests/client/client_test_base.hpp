@@ -0,0 +1,93 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "client/async_client.hpp"
+#include "mock_zmq_utils.hpp"
+
+MockZmqUtil mock_zmq_util;
+ZmqUtilInterface *kZmqUtil = &mock_zmq_util;
+
+// a client whose responses are handed to it directly rather than read from
+// its sockets
+class TestAsyncKvsClient : public AsyncKvsClient {
+public:
+  TestAsyncKvsClient(unsigned tid, unsigned timeout)
+      : AsyncKvsClient({UserRoutingThread("127.0.0.1", 0)}, "127.0.0.1", tid,
+                       timeout) {}
+
+  using AsyncKvsClient::expire;
+  using AsyncKvsClient::handle_address_response;
+  using AsyncKvsClient::handle_response;
+
+  // the server thread that operation id was last sent to
+  Address address_of(uint64_t id) { return operations_[id].address_; }
+};
+
+class ClientTest : public ::testing::Test {
+protected:
+  Address server_a = "tcp://10.0.0.1:6200";
+  Address server_b = "tcp://10.0.0.2:6200";
+
+  // the tuples the callbacks were run with
+  vector<KeyTuple> answers;
+  ClientCallback record = [this](const KeyTuple &tuple) {
+    answers.push_back(tuple);
+  };
+
+public:
+  void TearDown() {
+    // clear all the logged messages after each test
+    mock_zmq_util.sent_messages.clear();
+  }
+
+  vector<string> get_zmq_messages() { return mock_zmq_util.sent_messages; }
+
+  string address_response(const map<Key, vector<Address>> &addresses) {
+    KeyAddressResponse response;
+    response.set_error(AnnaError::NO_ERROR);
+
+    for (const auto &pair : addresses) {
+      auto *tp = response.add_addresses();
+      tp->set_key(pair.first);
+
+      for (const Address &address : pair.second) {
+        tp->add_ips(address);
+      }
+    }
+
+    string serialized;
+    response.SerializeToString(&serialized);
+    return serialized;
+  }
+
+  // answers every tuple of the request the client sent last, with error
+  string key_response(AnnaError error) {
+    KeyRequest request;
+    request.ParseFromString(get_zmq_messages().back());
+
+    KeyResponse response;
+    response.set_type(request.type());
+    response.set_response_id(request.request_id());
+
+    for (const KeyTuple &tuple : request.tuples()) {
+      KeyTuple *tp = response.add_tuples();
+      tp->set_key(tuple.key());
+      tp->set_error(error);
+    }
+
+    string serialized;
+    response.SerializeToString(&serialized);
+    return serialized;
+  }
+};
@@ -0,0 +1,167 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+const unsigned kClientTestTimeout = 1000;
+
+TEST_F(ClientTest, BatchesKeysPerServerThreadUntilFlush) {
+  TestAsyncKvsClient client(1, kClientTestTimeout);
+
+  client.get("a", record);
+  client.get("b", record);
+  client.put("c", "c", LatticeType::LWW, record);
+
+  // nothing is sent before flush, and then one lookup covers every key
+  EXPECT_EQ(get_zmq_messages().size(), 0);
+  client.flush();
+  EXPECT_EQ(get_zmq_messages().size(), 1);
+
+  KeyAddressRequest lookup;
+  lookup.ParseFromString(get_zmq_messages()[0]);
+  EXPECT_EQ(lookup.keys_size(), 3);
+
+  client.handle_address_response(address_response(
+      {{"a", {server_a}}, {"b", {server_a}}, {"c", {server_b}}}));
+  EXPECT_EQ(get_zmq_messages().size(), 1);
+
+  // a and b share a request to their server thread
+  client.flush();
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 3);
+
+  KeyRequest gets;
+  gets.ParseFromString(messages[1]);
+  EXPECT_EQ(gets.type(), RequestType::GET);
+  EXPECT_EQ(gets.tuples_size(), 2);
+
+  KeyRequest puts;
+  puts.ParseFromString(messages[2]);
+  EXPECT_EQ(puts.type(), RequestType::PUT);
+  EXPECT_EQ(puts.tuples_size(), 1);
+  EXPECT_EQ(puts.tuples(0).key(), "c");
+
+  // a flush with nothing buffered sends nothing
+  client.flush();
+  EXPECT_EQ(get_zmq_messages().size(), 3);
+
+  client.handle_response(key_response(AnnaError::NO_ERROR));
+  EXPECT_EQ(answers.size(), 1);
+  EXPECT_EQ(answers[0].key(), "c");
+  EXPECT_EQ(client.outstanding(), 2);
+}
+
+TEST_F(ClientTest, InvalidateDropsCachedAddress) {
+  TestAsyncKvsClient client(2, kClientTestTimeout);
+
+  client.get("a", record);
+  client.get("b", record);
+  client.flush();
+  client.handle_address_response(
+      address_response({{"a", {server_a}}, {"b", {server_a}}}));
+  client.flush();
+
+  // the server marks a's cached address invalid
+  KeyResponse response;
+  response.ParseFromString(key_response(AnnaError::NO_ERROR));
+  for (KeyTuple &tuple : *response.mutable_tuples()) {
+    tuple.set_invalidate(tuple.key() == "a");
+  }
+
+  string serialized;
+  response.SerializeToString(&serialized);
+  client.handle_response(serialized);
+  EXPECT_EQ(answers.size(), 2);
+
+  mock_zmq_util.sent_messages.clear();
+  client.get("a", record);
+  client.get("b", record);
+  client.flush();
+
+  // a is looked up again, while b goes straight to its server thread
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  KeyAddressRequest lookup;
+  lookup.ParseFromString(messages[0]);
+  EXPECT_EQ(lookup.keys_size(), 1);
+  EXPECT_EQ(lookup.keys(0), "a");
+
+  KeyRequest request;
+  request.ParseFromString(messages[1]);
+  EXPECT_EQ(request.tuples_size(), 1);
+  EXPECT_EQ(request.tuples(0).key(), "b");
+}
+
+TEST_F(ClientTest, RetriesOnAnotherReplica) {
+  TestAsyncKvsClient client(3, kClientTestTimeout);
+
+  client.get("a", record);
+  client.flush();
+  client.handle_address_response(
+      address_response({{"a", {server_a, server_b}}}));
+  client.flush();
+  Address first = client.address_of(0);
+
+  // a busy replica sends the key to the other one, without a new lookup
+  client.handle_response(key_response(AnnaError::TIMEOUT));
+  EXPECT_EQ(answers.size(), 0);
+  EXPECT_EQ(get_zmq_messages().size(), 2);
+
+  client.flush();
+  EXPECT_EQ(get_zmq_messages().size(), 3);
+  EXPECT_NE(client.address_of(0), first);
+
+  client.handle_response(key_response(AnnaError::NO_ERROR));
+  EXPECT_EQ(answers.size(), 1);
+  EXPECT_EQ(answers[0].error(), AnnaError::NO_ERROR);
+
+  // the key is given up on after kClientMaxRetries
+  client.get("a", record);
+  for (unsigned i = 0; i <= kClientMaxRetries; i++) {
+    client.flush();
+    client.handle_response(key_response(AnnaError::TIMEOUT));
+  }
+
+  EXPECT_EQ(answers.size(), 2);
+  EXPECT_EQ(answers[1].error(), AnnaError::TIMEOUT);
+  EXPECT_EQ(client.outstanding(), 0);
+}
+
+TEST_F(ClientTest, TimesOutUnansweredRequests) {
+  TestAsyncKvsClient client(4, kClientTestTimeout);
+  auto now = std::chrono::steady_clock::now();
+  auto later = now + std::chrono::milliseconds(2 * kClientTestTimeout);
+
+  client.get("a", record);
+  client.flush();
+  client.handle_address_response(address_response({{"a", {server_a}}}));
+  client.flush();
+  string late = key_response(AnnaError::NO_ERROR);
+
+  // a key whose lookup goes unanswered times out too
+  client.get("b", record);
+  client.flush();
+
+  client.expire(now);
+  EXPECT_EQ(answers.size(), 0);
+
+  client.expire(later);
+  EXPECT_EQ(answers.size(), 2);
+  EXPECT_EQ(answers[0].error(), AnnaError::TIMEOUT);
+  EXPECT_EQ(answers[1].error(), AnnaError::TIMEOUT);
+  EXPECT_EQ(client.outstanding(), 0);
+
+  // an answer that comes after the timeout is dropped
+  client.handle_response(late);
+  EXPECT_EQ(answers.size(), 2);
+}
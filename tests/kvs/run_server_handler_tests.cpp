@@ -24,10 +24,45 @@
 #include "types.hpp"
 
 #include "server_handler_base.hpp"
+#include "test_admission_control.hpp"
+#include "test_cache_fanout.hpp"
+#include "test_cache_subscriptions.hpp"
+#include "test_causal_pruning.hpp"
+#include "test_disk_reader.hpp"
+#include "test_flat_set_lattice.hpp"
+#include "test_hash_ring.hpp"
+#include "test_hot_key_detector.hpp"
+#include "test_key_access_tracker.hpp"
+#include "test_key_replication_map.hpp"
+#include "test_key_scan_handler.hpp"
+#include "test_local_changeset.hpp"
+#include "test_kv_store.hpp"
+#include "test_latency_histogram.hpp"
+#include "test_load_forecast.hpp"
+#include "test_log_store.hpp"
+#include "test_loop_clock.hpp"
+#include "test_lww_timestamp.hpp"
+#include "test_memory_budget.hpp"
+#include "test_memory_snapshot.hpp"
 #include "test_node_depart_handler.hpp"
 #include "test_node_join_handler.hpp"
+#include "test_read_cache.hpp"
+#include "test_rep_factor_response_handler.hpp"
+#include "test_replica_selector.hpp"
+#include "test_scan_merger.hpp"
 #include "test_self_depart_handler.hpp"
+#include "test_server_metrics.hpp"
+#include "test_spsc_queue.hpp"
+#include "test_stats_report.hpp"
+#include "test_tenant_limits.hpp"
+#include "test_tiering_plan.hpp"
+#include "test_trace.hpp"
 #include "test_user_request_handler.hpp"
+#include "test_value_compression.hpp"
+#include "test_workload.hpp"
+#include "test_workload_capture.hpp"
+#include "test_write_ahead_log.hpp"
+#include "test_zipf_sampler.hpp"
 
 unsigned kDefaultLocalReplication = 1;
 Tier kSelfTier = Tier::MEMORY;
@@ -40,6 +75,11 @@ unsigned kEbsThreadNum = 1;
 unsigned kMemoryThreadNum = 1;
 unsigned kRoutingThreadNum = 1;
 
+IntraNodeMailboxes *kIntraNodeMailboxes = nullptr;
+Tracer *kTracer = nullptr;
+WorkloadRecorder *kWorkloadRecorder = nullptr;
+SharedRings *kSharedRings = nullptr;
+
 int main(int argc, char *argv[]) {
   log_->set_level(spdlog::level::info);
   testing::InitGoogleTest(&argc, argv);
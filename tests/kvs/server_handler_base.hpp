@@ -31,16 +31,18 @@ protected:
   unsigned thread_id = 0;
   GlobalRingMap global_hash_rings;
   LocalRingMap local_hash_rings;
-  map<Key, KeyProperty> stored_key_map;
-  map<Key, KeyReplication> key_replication_map;
+  StoredKeyMap stored_key_map;
+  KeyReplicationMap key_replication_map;
   ServerThread wt;
   map<Key, vector<PendingRequest>> pending_requests;
   map<Key, vector<PendingGossip>> pending_gossip;
-  map<Key, std::multiset<TimePoint>> key_access_tracker;
-  set<Key> local_changeset;
+  KeyAccessTracker key_access_tracker;
+  LocalChangeset local_changeset;
 
   zmq::context_t context;
   SocketCache pushers = SocketCache(&context, ZMQ_PUSH);
+  ResponseBatcher batcher;
+  MessageBuffers buffers;
   SerializerMap serializers;
   Serializer *lww_serializer;
   Serializer *set_serializer;
@@ -0,0 +1,79 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/admission_control.hpp"
+#include "kvs/kvs_handlers.hpp"
+
+TEST(AdmissionControlTest, ShedsOnceBackloggedTooLong) {
+  AdmissionControl admission(100);
+  auto start = std::chrono::steady_clock::now();
+  auto at = [&](unsigned ms) { return start + std::chrono::milliseconds(ms); };
+
+  EXPECT_TRUE(admission.enabled());
+  EXPECT_FALSE(admission.overloaded(at(0)));
+
+  admission.record_drain(true, at(0));
+  admission.record_drain(true, at(50));
+  EXPECT_FALSE(admission.overloaded(at(50)));
+  EXPECT_EQ(admission.backlog(at(50)), 50);
+
+  admission.record_drain(true, at(150));
+  EXPECT_TRUE(admission.overloaded(at(150)));
+
+  // a drain that empties the socket ends the backlog
+  admission.record_drain(false, at(160));
+  EXPECT_FALSE(admission.overloaded(at(160)));
+  EXPECT_EQ(admission.backlog(at(160)), 0);
+
+  admission.record_drain(true, at(170));
+  EXPECT_FALSE(admission.overloaded(at(200)));
+
+  AdmissionControl disabled(0);
+  disabled.record_drain(true, at(0));
+  EXPECT_FALSE(disabled.overloaded(at(1000)));
+}
+
+TEST_F(ServerHandlerTest, ShedRequestTest) {
+  Key key = "key";
+  string value = "value";
+  serializers[LatticeType::LWW]->put(key, serialize(0, value));
+  stored_key_map[key].type_ = LatticeType::LWW;
+
+  string get_request = get_key_request(key, ip);
+  EXPECT_TRUE(shed_request_handler(get_request, pushers, batcher, buffers));
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 1);
+
+  KeyResponse response;
+  response.ParseFromString(messages[0]);
+
+  EXPECT_EQ(response.response_id(), kRequestId);
+  EXPECT_EQ(response.error(), kOverloadedError);
+  EXPECT_EQ(response.tuples().size(), 1);
+  EXPECT_EQ(response.tuples(0).key(), key);
+  EXPECT_EQ(response.tuples(0).error(), kOverloadedError);
+  EXPECT_EQ(response.tuples(0).payload(), "");
+
+  // a PUT that asks for no response cannot be shed
+  KeyRequest request;
+  request.ParseFromString(
+      put_key_request(key, LatticeType::LWW, serialize(1, "new"), ip));
+  request.clear_response_address();
+
+  string put_request;
+  request.SerializeToString(&put_request);
+  EXPECT_FALSE(shed_request_handler(put_request, pushers, batcher, buffers));
+  EXPECT_EQ(get_zmq_messages().size(), 1);
+}
@@ -0,0 +1,109 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#include "kvs/cache_fanout.hpp"
+
+TEST_F(ServerHandlerTest, CacheFanoutSharesEncodedValues) {
+  Key key = "key";
+  string value = serialize(0, "value");
+  serializers[LatticeType::LWW]->put(key, value);
+  stored_key_map[key].type_ = LatticeType::LWW;
+
+  CacheFanout fanout;
+  fanout.set_invalidations_only("10.0.0.3", true);
+  fanout.add(key, {"10.0.0.1", "10.0.0.2", "10.0.0.3"});
+  fanout.add("missing", {"10.0.0.1"});
+  EXPECT_EQ(fanout.pending(), 4);
+
+  EXPECT_EQ(fanout.flush(stored_key_map, serializers, pushers, log_), 3);
+  EXPECT_EQ(fanout.pending(), 0);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 3);
+
+  // caches are sent updates in address order, and keys not stored here are
+  // left out
+  for (unsigned i = 0; i < 2; i++) {
+    KeyRequest update;
+    update.ParseFromString(messages[i]);
+
+    EXPECT_EQ(update.type(), RequestType::PUT);
+    EXPECT_EQ(update.tuples_size(), 1);
+    EXPECT_EQ(update.tuples(0).key(), key);
+    EXPECT_EQ(update.tuples(0).lattice_type(), LatticeType::LWW);
+    EXPECT_EQ(update.tuples(0).payload(), value);
+    EXPECT_FALSE(update.tuples(0).invalidate());
+  }
+
+  EXPECT_EQ(messages[0], messages[1]);
+
+  KeyRequest invalidation;
+  invalidation.ParseFromString(messages[2]);
+  EXPECT_EQ(invalidation.tuples_size(), 1);
+  EXPECT_EQ(invalidation.tuples(0).key(), key);
+  EXPECT_TRUE(invalidation.tuples(0).invalidate());
+  EXPECT_EQ(invalidation.tuples(0).payload(), "");
+}
+
+TEST_F(ServerHandlerTest, CacheFanoutRateLimit) {
+  serializers[LatticeType::LWW]->put("a", serialize(0, "a"));
+  stored_key_map["a"].type_ = LatticeType::LWW;
+  serializers[LatticeType::LWW]->put("b", serialize(0, "b"));
+  stored_key_map["b"].type_ = LatticeType::LWW;
+
+  CacheFanout fanout(60000);
+  fanout.add("a", {"10.0.0.1"});
+  EXPECT_EQ(fanout.flush(stored_key_map, serializers, pushers, log_), 1);
+
+  // a second change within the interval waits for the next update
+  fanout.add("b", {"10.0.0.1"});
+  EXPECT_EQ(fanout.flush(stored_key_map, serializers, pushers, log_), 0);
+  EXPECT_EQ(fanout.pending(), 1);
+  EXPECT_EQ(get_zmq_messages().size(), 1);
+
+  // a cache that has gone away takes its pending keys with it
+  fanout.forget("10.0.0.1");
+  EXPECT_EQ(fanout.pending(), 0);
+}
+
+TEST_F(ServerHandlerTest, CacheFanoutDecompressesValues) {
+  Serializer *plain = serializers[LatticeType::LWW];
+  CompressedLWWSerializer compressed(plain, 4096);
+  serializers[LatticeType::LWW] = &compressed;
+
+  Key key = "key";
+  string value = serialize(1, string(8192, 'a'));
+  serializers[LatticeType::LWW]->put(key, value);
+  stored_key_map[key].type_ = LatticeType::LWW;
+
+  // the value is stored compressed, but the cache is sent the original
+  AnnaError error = AnnaError::NO_ERROR;
+  EXPECT_LT(serializers[LatticeType::LWW]->get(key, error).size(),
+            value.size());
+
+  CacheFanout fanout;
+  fanout.add(key, {"10.0.0.1"});
+  EXPECT_EQ(fanout.flush(stored_key_map, serializers, pushers, log_), 1);
+
+  vector<string> messages = get_zmq_messages();
+  ASSERT_EQ(messages.size(), 1);
+
+  KeyRequest update;
+  update.ParseFromString(messages[0]);
+  ASSERT_EQ(update.tuples_size(), 1);
+  EXPECT_EQ(update.tuples(0).payload(), value);
+
+  serializers[LatticeType::LWW] = plain;
+}
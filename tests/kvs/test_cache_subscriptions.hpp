@@ -0,0 +1,107 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/cache_subscriptions.hpp"
+
+CachedKeys cached_keys(const vector<Key> &keys, uint64_t snapshot_version) {
+  CachedKeys registration;
+  for (const Key &key : keys) {
+    registration.add_keys(key);
+  }
+
+  registration.set_snapshot_version(snapshot_version);
+  return registration;
+}
+
+void add_delta(CachedKeys &registration, uint64_t version,
+               const vector<Key> &added, const vector<Key> &removed) {
+  CachedKeysDelta *delta = registration.add_deltas();
+  delta->set_version(version);
+
+  for (const Key &key : added) {
+    delta->add_added(key);
+  }
+
+  for (const Key &key : removed) {
+    delta->add_removed(key);
+  }
+}
+
+TEST(CacheSubscriptionsTest, AppliesOnlyUnseenDeltas) {
+  CacheSubscriptions subscriptions;
+  vector<Address> caches;
+
+  CachedKeys registration = cached_keys({"a", "b"}, 1);
+  EXPECT_TRUE(subscriptions.update("10.0.0.1", registration));
+  EXPECT_TRUE(subscriptions.update("10.0.0.2", cached_keys({"b"}, 1)));
+  EXPECT_EQ(subscriptions.key_count(), 2);
+
+  subscriptions.caches("b", caches);
+  EXPECT_EQ(caches, vector<Address>({"10.0.0.1", "10.0.0.2"}));
+
+  // the same version again changes nothing
+  EXPECT_FALSE(subscriptions.update("10.0.0.1", registration));
+
+  add_delta(registration, 2, {"c"}, {"a"});
+  add_delta(registration, 3, {"a", kCacheInvalidationsOnly}, {"b"});
+  EXPECT_TRUE(subscriptions.update("10.0.0.1", registration));
+  EXPECT_EQ(subscriptions.version("10.0.0.1"), 3);
+  EXPECT_EQ(subscriptions.key_count("10.0.0.1"), 2);
+  EXPECT_TRUE(subscriptions.invalidations_only("10.0.0.1"));
+
+  subscriptions.caches("a", caches);
+  EXPECT_EQ(caches, vector<Address>({"10.0.0.1"}));
+  subscriptions.caches("b", caches);
+  EXPECT_EQ(caches, vector<Address>({"10.0.0.2"}));
+
+  // a cache that has gone away frees its ID and the keys only it held
+  subscriptions.remove("10.0.0.1");
+  EXPECT_EQ(subscriptions.key_count(), 1);
+  subscriptions.caches("c", caches);
+  EXPECT_TRUE(caches.empty());
+
+  EXPECT_TRUE(subscriptions.update("10.0.0.3", cached_keys({"b"}, 1)));
+  subscriptions.caches("b", caches);
+  EXPECT_EQ(caches, vector<Address>({"10.0.0.3", "10.0.0.2"}));
+}
+
+TEST(CacheSubscriptionsTest, ComparesInFullWhenBehind) {
+  CacheSubscriptions subscriptions;
+  vector<Address> caches;
+
+  EXPECT_TRUE(subscriptions.update("10.0.0.1", cached_keys({"a", "b"}, 1)));
+
+  // this thread missed the versions up to the snapshot
+  CachedKeys registration = cached_keys({"b", "c"}, 5);
+  add_delta(registration, 6, {"d"}, {"b"});
+  EXPECT_TRUE(subscriptions.update("10.0.0.1", registration));
+  EXPECT_EQ(subscriptions.version("10.0.0.1"), 6);
+
+  subscriptions.caches("a", caches);
+  EXPECT_TRUE(caches.empty());
+  subscriptions.caches("b", caches);
+  EXPECT_TRUE(caches.empty());
+  EXPECT_EQ(subscriptions.key_count("10.0.0.1"), 2);
+
+  // a plain list of keys, as older caches register them, has no version and
+  // is always compared
+  StringSet key_set;
+  key_set.add_keys("e");
+  CachedKeys legacy;
+  legacy.ParseFromString(key_set.SerializeAsString());
+  EXPECT_TRUE(subscriptions.update("10.0.0.1", legacy));
+  EXPECT_TRUE(subscriptions.update("10.0.0.1", legacy));
+  EXPECT_EQ(subscriptions.key_count(), 1);
+  EXPECT_FALSE(subscriptions.invalidations_only("10.0.0.1"));
+}
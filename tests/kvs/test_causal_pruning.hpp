@@ -0,0 +1,68 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+TEST(CausalPruningTest, PrunesSatisfiedMetadata) {
+  Key key = "key";
+  MultiKeyCausalPayload<SetLattice<string>> p;
+  p.vector_clock.insert("a", 2);
+  p.vector_clock.insert("b", 0);
+  p.value.insert("value");
+
+  p.dependencies.insert(
+      key, VectorClock(map<string, MaxLattice<unsigned>>({{"a", 1}})));
+  p.dependencies.insert(
+      "zero", VectorClock(map<string, MaxLattice<unsigned>>({{"a", 0}})));
+  p.dependencies.insert(
+      "other",
+      VectorClock(map<string, MaxLattice<unsigned>>({{"a", 3}, {"c", 0}})));
+
+  EXPECT_TRUE(prune_causal(p, &key));
+  EXPECT_EQ(p.vector_clock.reveal().size(), 1);
+  EXPECT_EQ(p.dependencies.reveal().size(), 1);
+  EXPECT_EQ(p.dependencies.reveal().at("other").reveal().size(), 1);
+
+  // nothing is left to prune
+  EXPECT_FALSE(prune_causal(p, &key));
+
+  // a dependency on the key itself stays if the clock does not cover it
+  p.dependencies.insert(
+      key, VectorClock(map<string, MaxLattice<unsigned>>({{"a", 3}})));
+  EXPECT_FALSE(prune_causal(p, &key));
+  EXPECT_EQ(p.dependencies.reveal().size(), 2);
+}
+
+TEST(CausalPruningTest, DiskMergesPrune) {
+  MultiKeyCausalPayload<SetLattice<string>> first;
+  first.vector_clock.insert("a", 1);
+  first.value.insert("first");
+  first.dependencies.insert(
+      "dep", VectorClock(map<string, MaxLattice<unsigned>>({{"a", 0}})));
+
+  MultiKeyCausalPayload<SetLattice<string>> second;
+  second.vector_clock.insert("b", 1);
+  second.value.insert("second");
+
+  string merged = merge_serialized(
+      LatticeType::MULTI_CAUSAL,
+      serialize(MultiKeyCausalLattice<SetLattice<string>>(first)),
+      serialize(MultiKeyCausalLattice<SetLattice<string>>(second)));
+
+  MultiKeyCausalPayload<SetLattice<string>> value =
+      to_multi_key_causal_payload(deserialize_multi_key_causal(merged));
+  EXPECT_EQ(value.vector_clock.reveal().size(), 2);
+  EXPECT_EQ(value.dependencies.reveal().size(), 0);
+  EXPECT_EQ(value.value.size().reveal(), 2);
+}
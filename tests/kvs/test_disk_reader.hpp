@@ -0,0 +1,73 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+const string kDiskReaderTestDir = "disk_reader_test";
+
+// collects from reader until every submitted GET has finished
+vector<ParkedRead *> collect_all(DiskReader &reader) {
+  vector<ParkedRead *> done;
+  while (reader.in_flight() > 0) {
+    reader.collect(done);
+  }
+
+  return done;
+}
+
+TEST(DiskReaderTest, ReadsOffTheEventLoop) {
+  LogStore store(kDiskReaderTestDir, merge_serialized);
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"a"})));
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"b"})));
+
+  DiskReader reader(&store, 2);
+  EXPECT_FALSE(reader.submit("missing", "address", "id", false));
+  EXPECT_TRUE(reader.submit("key", "address", "id", true));
+  EXPECT_EQ(reader.in_flight(), 1);
+
+  vector<ParkedRead *> done = collect_all(reader);
+  EXPECT_EQ(done.size(), 1);
+  EXPECT_TRUE(done[0]->found_);
+  EXPECT_EQ(done[0]->address_, "address");
+  EXPECT_EQ(done[0]->response_id_, "id");
+  EXPECT_TRUE(done[0]->invalidate_);
+  EXPECT_EQ(deserialize_set(done[0]->payload_).reveal(),
+            set<string>({"a", "b"}));
+  delete done[0];
+
+  // the chain was folded into one record once it had been read
+  string payload;
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(deserialize_set(payload).reveal(), set<string>({"a", "b"}));
+  store.remove("key");
+}
+
+TEST(DiskReaderTest, RemovedWhileReading) {
+  LogStore store(kDiskReaderTestDir, merge_serialized);
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"a"})));
+
+  DiskReader reader(&store, 1);
+  EXPECT_TRUE(reader.submit("key", "address", "id", false));
+  store.remove("key");
+
+  // the GET was planned before the removal, so it still sees the value, but
+  // finishing it does not bring the key back
+  vector<ParkedRead *> done = collect_all(reader);
+  EXPECT_EQ(done.size(), 1);
+  EXPECT_TRUE(done[0]->found_);
+  delete done[0];
+
+  string payload;
+  EXPECT_FALSE(store.get("key", &payload));
+}
@@ -0,0 +1,67 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+TEST(FlatSetLatticeTest, SortsAndMerges) {
+  FlatSetLattice<string> lattice({"c", "a", "c", "b"});
+  EXPECT_EQ(lattice.reveal(), vector<string>({"a", "b", "c"}));
+  EXPECT_EQ(lattice.size().reveal(), 3);
+
+  // appended past the end
+  lattice.merge(FlatSetLattice<string>({"d", "e"}));
+  EXPECT_EQ(lattice.reveal(), vector<string>({"a", "b", "c", "d", "e"}));
+
+  // interleaved, with elements already present
+  lattice.merge(FlatSetLattice<string>({"0", "b", "bb", "e", "f"}));
+  EXPECT_EQ(lattice.reveal(),
+            vector<string>({"0", "a", "b", "bb", "c", "d", "e", "f"}));
+
+  lattice.merge(FlatSetLattice<string>({"a", "f"}));
+  lattice.merge(FlatSetLattice<string>());
+  lattice.merge(lattice);
+  EXPECT_EQ(lattice.size().reveal(), 8);
+  EXPECT_TRUE(lattice.contains("bb"));
+  EXPECT_FALSE(lattice.contains("g"));
+}
+
+TEST(FlatSetLatticeTest, MatchesSetLattice) {
+  FlatSetLattice<string> flat;
+  SetLattice<string> tree;
+  unsigned seed = 0;
+
+  for (unsigned round = 0; round < 50; round++) {
+    vector<string> delta;
+    set<string> tree_delta;
+
+    for (unsigned i = 0, n = rand_r(&seed) % 100; i < n; i++) {
+      string element = std::to_string(rand_r(&seed) % 1000);
+      delta.push_back(element);
+      tree_delta.insert(element);
+    }
+
+    flat.merge(FlatSetLattice<string>(delta));
+    tree.merge(SetLattice<string>(tree_delta));
+  }
+
+  EXPECT_EQ(serialize(flat), serialize(tree));
+  EXPECT_EQ(deserialize_flat_set(serialize(tree)).reveal(),
+            vector<string>(tree.reveal().begin(), tree.reveal().end()));
+
+  // the disk tier merges serialized sets the same way
+  string merged =
+      merge_serialized(LatticeType::SET, serialize(SetLattice<string>({"b"})),
+                       serialize(SetLattice<string>({"a", "c"})));
+  EXPECT_EQ(merged, serialize(SetLattice<string>({"a", "b", "c"})));
+}
@@ -0,0 +1,237 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "hash_ring.hpp"
+#include "kvs/server_utils.hpp"
+
+// walks the ring from the key's position, as the lookups did before the
+// ownership table existed
+ServerThreadList walk_ring(const Key &key, unsigned count,
+                           GlobalHashRing &ring) {
+  ServerThreadList threads;
+  auto pos = ring.find(key);
+
+  while (threads.size() < count) {
+    const ServerThread &thread = ring.server(*pos);
+    if (std::find(threads.begin(), threads.end(), thread) == threads.end()) {
+      threads.push_back(thread);
+    }
+
+    if (++pos == ring.end()) {
+      pos = ring.begin();
+    }
+  }
+
+  return threads;
+}
+
+TEST(HashRingTest, OwnershipMatchesRingWalk) {
+  GlobalHashRing ring;
+
+  for (unsigned i = 0; i < 6; i++) {
+    ring.insert("127.0.0." + std::to_string(i), "10.0.0." + std::to_string(i),
+                0, 0);
+  }
+
+  EXPECT_EQ(ring.size(), 6 * kVirtualThreadNum);
+
+  for (unsigned i = 0; i < 100; i++) {
+    Key key = "key_" + std::to_string(i);
+
+    for (unsigned rep = 1; rep <= 6; rep++) {
+      EXPECT_EQ(responsible_global(key, rep, ring), walk_ring(key, rep, ring));
+    }
+  }
+
+  ring.remove("127.0.0.2", "10.0.0.2", 0);
+  EXPECT_EQ(ring.size(), 5 * kVirtualThreadNum);
+
+  for (unsigned i = 0; i < 100; i++) {
+    Key key = "key_" + std::to_string(i);
+    EXPECT_EQ(responsible_global(key, 3, ring), walk_ring(key, 3, ring));
+    EXPECT_EQ(responsible_global(key, 10, ring).size(), 5);
+  }
+}
+
+TEST(HashRingTest, SharesOneEntryPerThread) {
+  GlobalHashRing ring(16);
+
+  for (unsigned i = 0; i < 4; i++) {
+    ring.insert("127.0.0." + std::to_string(i), "10.0.0." + std::to_string(i),
+                0, 0);
+  }
+
+  EXPECT_EQ(ring.virtual_nodes(), 16);
+  EXPECT_EQ(ring.size(), 64);
+  EXPECT_EQ(ring.server_count(), 4);
+
+  // removing a thread from the middle of the table keeps the others' virtual
+  // nodes pointing at them
+  ring.remove("127.0.0.1", "10.0.0.1", 0);
+  EXPECT_EQ(ring.size(), 48);
+  EXPECT_EQ(ring.server_count(), 3);
+
+  map<Address, unsigned> virtual_nodes;
+  for (const auto &node : ring) {
+    virtual_nodes[ring.server(node).private_ip()] += 1;
+  }
+
+  EXPECT_EQ(virtual_nodes.size(), 3);
+  EXPECT_EQ(virtual_nodes.count("10.0.0.1"), 0);
+  for (const auto &pair : virtual_nodes) {
+    EXPECT_EQ(pair.second, 16);
+  }
+
+  for (unsigned i = 0; i < 100; i++) {
+    Key key = "key_" + std::to_string(i);
+    EXPECT_EQ(responsible_global(key, 3, ring), walk_ring(key, 3, ring));
+  }
+
+  GlobalRingMap rings;
+  EXPECT_EQ(rings[Tier::MEMORY].virtual_nodes(),
+            virtual_node_count(Tier::MEMORY));
+}
+
+TEST(HashRingTest, OwnedRangesMatchResponsibility) {
+  GlobalHashRing ring;
+
+  for (unsigned i = 0; i < 4; i++) {
+    ring.insert("127.0.0." + std::to_string(i), "10.0.0." + std::to_string(i),
+                0, 0);
+  }
+
+  StoredKeyMap stored_key_map;
+  for (unsigned i = 0; i < 500; i++) {
+    Key key = "key_" + std::to_string(i);
+    stored_key_map[key] = KeyProperty{1, LatticeType::LWW};
+    stored_key_map.index(key);
+  }
+
+  for (unsigned rep = 1; rep <= 5; rep++) {
+    set<Key> owned;
+    for (const auto &range : ring.owned_ranges("10.0.0.1", rep)) {
+      stored_key_map.keys_in_range(range.first, range.second, owned);
+    }
+
+    set<Key> expected;
+    for (const auto &pair : stored_key_map) {
+      for (const ServerThread &thread :
+           responsible_global(pair.first, rep, ring)) {
+        if (thread.private_ip() == "10.0.0.1") {
+          expected.insert(pair.first);
+        }
+      }
+    }
+
+    EXPECT_EQ(owned, expected);
+  }
+
+  stored_key_map.erase("key_0");
+  EXPECT_EQ(stored_key_map.indexed(), 499);
+}
+
+TEST(HashRingTest, Xxh64KnownAnswers) {
+  EXPECT_EQ(hash64("", 0), 0xef46db3751d8e999ULL);
+  EXPECT_EQ(hash64("abc", 0), 0x44bc2cf5ad770999ULL);
+
+  // long enough to go through the 32-byte stripes
+  EXPECT_EQ(hash64("Nobody inspects the spammish repetition", 0),
+            0xfbcea83c8a378bf1ULL);
+}
+
+TEST(HashRingTest, BoundedLoadCapsShares) {
+  // the shares below are fractions of the 64-bit seeded ring
+  kHashMode = HashMode::seeded;
+
+  double bound = 0.1;
+  GlobalHashRing plain(32);
+  GlobalHashRing bounded(32, bound);
+
+  for (unsigned i = 0; i < 8; i++) {
+    plain.insert("127.0.0." + std::to_string(i), "10.0.0." + std::to_string(i),
+                 0, 0);
+    bounded.insert("127.0.0." + std::to_string(i),
+                   "10.0.0." + std::to_string(i), 0, 0);
+  }
+
+  EXPECT_EQ(bounded.load_bound(), bound);
+
+  // each thread's share of the hash space as the first owner, and the
+  // longest segment between two virtual nodes, as fractions of the ring
+  auto shares = [](GlobalHashRing &ring, double &longest) {
+    const double span = 18446744073709551616.0; // 2^64
+    map<Address, double> shares;
+    longest = 0;
+
+    for (unsigned i = 0; i < 8; i++) {
+      Address ip = "10.0.0." + std::to_string(i);
+      for (const auto &range : ring.owned_ranges(ip, 1)) {
+        double share = (double)(range.second - range.first) / span;
+        shares[ip] += share;
+        longest = std::max(longest, share);
+      }
+    }
+
+    return shares;
+  };
+
+  double longest;
+  double plain_max = 0;
+  for (const auto &pair : shares(plain, longest)) {
+    plain_max = std::max(plain_max, pair.second);
+  }
+
+  // 32 virtual nodes per thread leave the plain ring well out of bounds;
+  // the bounded one overshoots by at most a segment
+  EXPECT_GT(plain_max, (1 + bound) / 8);
+
+  double total = 0;
+  for (const auto &pair : shares(bounded, longest)) {
+    EXPECT_LE(pair.second, (1 + bound) / 8 + longest);
+    total += pair.second;
+  }
+
+  EXPECT_NEAR(total, 1, 1e-9);
+
+  // lookups agree with the ranges each thread owns, past the table too
+  StoredKeyMap stored_key_map;
+  for (unsigned i = 0; i < 500; i++) {
+    Key key = "key_" + std::to_string(i);
+    stored_key_map[key] = KeyProperty{1, LatticeType::LWW};
+    stored_key_map.index(key);
+  }
+
+  for (unsigned rep : {1, 3, 6}) {
+    set<Key> owned;
+    for (const auto &range : bounded.owned_ranges("10.0.0.1", rep)) {
+      stored_key_map.keys_in_range(range.first, range.second, owned);
+    }
+
+    set<Key> expected;
+    for (const auto &pair : stored_key_map) {
+      ServerThreadList threads = responsible_global(pair.first, rep, bounded);
+      EXPECT_EQ(threads.size(), rep);
+
+      for (const ServerThread &thread : threads) {
+        if (thread.private_ip() == "10.0.0.1") {
+          expected.insert(pair.first);
+        }
+      }
+    }
+
+    EXPECT_EQ(owned, expected);
+  }
+
+  kHashMode = HashMode::legacy;
+}
@@ -0,0 +1,131 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#include "kvs/hot_key_detector.hpp"
+#include "kvs/kvs_handlers.hpp"
+
+TEST(HotKeyDetectorTest, FindsKeysReadOftenWithinAnInterval) {
+  HotKeyDetector detector(3, 100, 30);
+  auto start = std::chrono::steady_clock::now();
+  detector.set_time(start);
+
+  detector.record("hot");
+  detector.record("hot");
+  detector.record("cold");
+  EXPECT_EQ(detector.take_hot().size(), 0);
+
+  // a key turns hot once per interval, however often it is read after that
+  detector.record("hot");
+  detector.record("hot");
+  EXPECT_EQ(detector.take_hot(), vector<Key>{"hot"});
+  EXPECT_EQ(detector.take_hot().size(), 0);
+
+  // the counts start over with the next interval
+  detector.set_time(start + std::chrono::milliseconds(100));
+  detector.record("cold");
+  detector.record("cold");
+  EXPECT_EQ(detector.take_hot().size(), 0);
+}
+
+TEST(HotKeyDetectorTest, UndoesItsReplicationOnceKeysCool) {
+  HotKeyDetector detector(4, 100, 30);
+  auto start = std::chrono::steady_clock::now();
+  detector.set_time(start);
+
+  EXPECT_FALSE(detector.raise("key", 4, 4, start));
+  EXPECT_TRUE(detector.raise("key", 1, 4, start));
+  EXPECT_TRUE(detector.raise("other", 1, 4, start));
+  EXPECT_TRUE(detector.raised("key"));
+
+  // a raised key stays hot at its share of the reads
+  auto later = start + std::chrono::seconds(20);
+  detector.set_time(later);
+  detector.record("key");
+  EXPECT_EQ(detector.take_hot(), vector<Key>{"key"});
+  EXPECT_FALSE(detector.raise("key", 4, 4, later));
+
+  map<Key, unsigned> local = {{"key", 4}, {"other", 2}};
+  map<Key, unsigned> lowered;
+  auto current = [&](const Key &key) { return local[key]; };
+  auto lower = [&](const Key &key, unsigned previous) {
+    lowered[key] = previous;
+  };
+
+  detector.expire(start + std::chrono::seconds(40), current, lower);
+  EXPECT_EQ(lowered.size(), 0);
+  EXPECT_TRUE(detector.raised("key"));
+
+  // the other key's factor was changed by someone else, so it is left alone
+  EXPECT_FALSE(detector.raised("other"));
+
+  detector.expire(later + std::chrono::seconds(30), current, lower);
+  EXPECT_EQ(lowered, (map<Key, unsigned>{{"key", 1}}));
+  EXPECT_FALSE(detector.raised("key"));
+}
+
+TEST_F(ServerHandlerTest, HotKeyDetectorCountsServedGets) {
+  Key key = "key";
+  serializers[LatticeType::LWW]->put(key, serialize(0, "value"));
+  stored_key_map[key].type_ = LatticeType::LWW;
+
+  HotKeyDetector detector(2, 100, 30);
+  detector.set_time(std::chrono::steady_clock::now());
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  for (unsigned i = 0; i < 2; i++) {
+    string get_request = get_key_request(key, ip);
+    user_request_handler(access_count, seed, get_request, log_,
+                         global_hash_rings, local_hash_rings, pending_requests,
+                         key_access_tracker, stored_key_map,
+                         key_replication_map, local_changeset, wt, serializers,
+                         pushers, batcher, buffers, false, nullptr, &detector);
+  }
+
+  EXPECT_EQ(detector.take_hot(), vector<Key>{key});
+}
+
+TEST_F(ServerHandlerTest, ChangeLocalReplicationTellsEveryReplica) {
+  Key key = "key";
+  unsigned rid = 0;
+  vector<Address> routing_ips = {"127.0.0.2"};
+
+  key_replication_map[key].global_replication_[Tier::MEMORY] = 1;
+  key_replication_map[key].local_replication_[Tier::MEMORY] = 1;
+  local_hash_rings[Tier::MEMORY].insert(ip, ip, 0, 0);
+
+  ReplicationFactor factor =
+      change_local_replication(key, 4, global_hash_rings, local_hash_rings,
+                               key_replication_map, routing_ips, pushers, rid);
+
+  EXPECT_EQ(factor.key(), key);
+  for (const auto &local : factor.local()) {
+    EXPECT_EQ(local.value(), 4);
+  }
+
+  // the change is applied once it comes back to this thread
+  EXPECT_EQ(key_replication_map[key].local_replication_[Tier::MEMORY], 1);
+
+  // the metadata put, the update to the key's node, and the one to the
+  // routing node
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 3);
+
+  for (unsigned i = 1; i < 3; i++) {
+    ReplicationFactorUpdate update;
+    update.ParseFromString(messages[i]);
+    EXPECT_EQ(update.updates_size(), 1);
+    EXPECT_EQ(update.updates(0).key(), key);
+  }
+}
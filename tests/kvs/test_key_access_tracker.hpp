@@ -0,0 +1,56 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/key_access_tracker.hpp"
+
+TEST(KeyAccessTrackerTest, CountsAndReports) {
+  KeyAccessTracker tracker;
+  map<Key, KeyProperty> stored_key_map;
+  stored_key_map["stored"] = KeyProperty{1, LatticeType::LWW};
+
+  tracker.record("stored");
+  tracker.record("stored");
+  tracker.record("missing");
+
+  EXPECT_EQ(tracker.count("stored"), 2);
+  EXPECT_EQ(tracker.count("missing"), 1);
+  EXPECT_EQ(tracker.count("untracked"), 0);
+
+  KeyAccessData access;
+  tracker.report(access, stored_key_map);
+
+  EXPECT_EQ(access.keys_size(), 1);
+  EXPECT_EQ(access.keys(0).key(), "stored");
+  EXPECT_EQ(access.keys(0).access_count(), 2);
+  EXPECT_EQ(tracker.size(), 1);
+}
+
+TEST(KeyAccessTrackerTest, ExpiresWithTheClock) {
+  KeyAccessTracker tracker(60);
+  auto start = std::chrono::steady_clock::now();
+  tracker.set_time(start);
+
+  tracker.record("key");
+  tracker.set_time(start + std::chrono::seconds(30));
+  tracker.record("key");
+  EXPECT_EQ(tracker.count("key"), 2);
+
+  // the first access leaves the window a minute after it was made, give or
+  // take a bucket width of 5 seconds
+  tracker.set_time(start + std::chrono::seconds(66));
+  EXPECT_EQ(tracker.count("key"), 1);
+
+  tracker.set_time(start + std::chrono::seconds(120));
+  EXPECT_EQ(tracker.count("key"), 0);
+}
@@ -0,0 +1,42 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "metadata.hpp"
+
+TEST(KeyReplicationMapTest, CapacityEvictsAnotherKey) {
+  KeyReplicationMap replication(2);
+
+  replication["a"].global_replication_[Tier::MEMORY] = 1;
+  replication["b"].global_replication_[Tier::MEMORY] = 2;
+  EXPECT_EQ(replication.size(), 2);
+
+  // a key already held is updated in place
+  replication["a"].global_replication_[Tier::MEMORY] = 3;
+  EXPECT_EQ(replication.size(), 2);
+
+  replication["c"].global_replication_[Tier::MEMORY] = 4;
+  EXPECT_EQ(replication.size(), 2);
+  EXPECT_EQ(replication.find("c")->second.global_replication_[Tier::MEMORY],
+            4);
+}
+
+TEST(KeyReplicationMapTest, UnboundedByDefault) {
+  KeyReplicationMap replication;
+
+  for (unsigned i = 0; i < 100; i++) {
+    replication[std::to_string(i)].global_replication_[Tier::MEMORY] = 1;
+  }
+
+  EXPECT_EQ(replication.size(), 100);
+}
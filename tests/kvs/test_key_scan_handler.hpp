@@ -0,0 +1,64 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+vector<Key> scanned(const KeyScanResponse &response) {
+  return vector<Key>(response.keys().begin(), response.keys().end());
+}
+
+TEST_F(ServerHandlerTest, KeyScanPagesThroughAPrefix) {
+  for (const Key &key : {"a/3", "a/1", "b/1", "a/2", "ab"}) {
+    process_put(key, LatticeType::LWW, serialize(0, "value"),
+                serializers[LatticeType::LWW], stored_key_map);
+  }
+
+  // a key this thread only knows the size of is not stored here
+  stored_key_map["a/0"];
+
+  auto scan = [this](const string &prefix, const Key &start, const Key &end,
+                     unsigned limit) {
+    KeyScanRequest request;
+    request.set_request_id(kRequestId);
+    request.set_response_address(UserThread(ip, 0).response_connect_address());
+    request.set_prefix(prefix);
+    request.set_start(start);
+    request.set_end(end);
+    request.set_limit(limit);
+    request.set_shard_count(1);
+
+    string serialized;
+    request.SerializeToString(&serialized);
+    key_scan_handler(serialized, stored_key_map, pushers);
+
+    KeyScanResponse response;
+    response.ParseFromString(get_zmq_messages().back());
+    return response;
+  };
+
+  KeyScanResponse response = scan("a/", "", "", 2);
+  EXPECT_EQ(response.request_id(), kRequestId);
+  EXPECT_EQ(response.shard_count(), 1);
+  EXPECT_EQ(scanned(response), vector<Key>({"a/1", "a/2"}));
+  EXPECT_TRUE(response.more());
+
+  // the next page starts after the last key of this one
+  response = scan("a/", "a/2", "", 2);
+  EXPECT_EQ(scanned(response), vector<Key>({"a/3"}));
+  EXPECT_FALSE(response.more());
+
+  response = scan("", "a/1", "b", 0);
+  EXPECT_EQ(scanned(response), vector<Key>({"a/2", "a/3", "ab"}));
+  EXPECT_FALSE(response.more());
+}
@@ -0,0 +1,144 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+TEST(KVStoreTest, PutAndGet) {
+  MemoryLWWKVS kvs;
+  AnnaError error = AnnaError::NO_ERROR;
+
+  kvs.put("key", LWWPairLattice<string>(TimestampValuePair<string>(1, "a")));
+  kvs.put("key", LWWPairLattice<string>(TimestampValuePair<string>(2, "b")));
+  kvs.put("key", LWWPairLattice<string>(TimestampValuePair<string>(0, "c")));
+
+  EXPECT_EQ(kvs.get("key", error).reveal().value, "b");
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+  EXPECT_EQ(kvs.key_count(), 1);
+}
+
+TEST(KVStoreTest, MissingKey) {
+  MemorySetKVS kvs;
+  AnnaError error = AnnaError::NO_ERROR;
+
+  kvs.get("key", error);
+  EXPECT_EQ(error, AnnaError::KEY_DNE);
+  EXPECT_EQ(kvs.key_count(), 0);
+}
+
+TEST(KVStoreTest, GrowAndRemove) {
+  MemorySetKVS kvs;
+  unsigned num_keys = 10000;
+
+  for (unsigned i = 0; i < num_keys; i++) {
+    EXPECT_GT(kvs.put(std::to_string(i),
+                      FlatSetLattice<string>({"a", std::to_string(i)})),
+              2 * sizeof(string));
+  }
+
+  EXPECT_EQ(kvs.key_count(), num_keys);
+
+  // remove every other key and make sure the rest are still reachable
+  for (unsigned i = 0; i < num_keys; i += 2) {
+    kvs.remove(std::to_string(i));
+  }
+
+  EXPECT_EQ(kvs.key_count(), num_keys / 2);
+
+  for (unsigned i = 0; i < num_keys; i++) {
+    AnnaError error = AnnaError::NO_ERROR;
+    FlatSetLattice<string> val = kvs.get(std::to_string(i), error);
+
+    if (i % 2 == 0) {
+      EXPECT_EQ(error, AnnaError::KEY_DNE);
+    } else {
+      EXPECT_EQ(error, AnnaError::NO_ERROR);
+      EXPECT_EQ(val.size().reveal(), 2);
+    }
+  }
+
+  EXPECT_GT(kvs.memory_usage(), 0);
+}
+
+TEST(KVStoreTest, PutReturnsBytes) {
+  MemoryLWWKVS kvs;
+  unsigned small = kvs.put(
+      "key", LWWPairLattice<string>(TimestampValuePair<string>(1, "a")));
+
+  // the value and the key are counted in full
+  EXPECT_GE(kvs.put("key", LWWPairLattice<string>(TimestampValuePair<string>(
+                               2, string(1000, 'x')))),
+            small + 1000);
+  EXPECT_GE(kvs.put(string(100, 'k'),
+                    LWWPairLattice<string>(TimestampValuePair<string>(1, "a"))),
+            small + 100);
+
+  // each set element adds at least its place in the vector
+  MemorySetKVS sets;
+  unsigned one = sets.put("key", FlatSetLattice<string>({"a"}));
+  unsigned two = sets.put("key", FlatSetLattice<string>({"b"}));
+  EXPECT_GE(two, one + sizeof(string));
+  EXPECT_EQ(sets.put("key", FlatSetLattice<string>({"b"})), two);
+}
+
+TEST(KVStoreTest, PutCountsOnlyWhatMergesAdd) {
+  MemorySetKVS kvs;
+  string *cache;
+  auto element = [](char c) { return string(100, c); };
+
+  // what put returns beyond the stored value's heap bytes stays the same as
+  // elements are added, in place or appended, and as duplicates are merged
+  unsigned overhead = kvs.put("key", FlatSetLattice<string>({element('m')})) -
+                      heap_bytes(*kvs.find("key", cache));
+
+  vector<vector<string>> merges = {{element('a'), element('z')},
+                                   {element('m'), element('n')},
+                                   {element('b'), element('y'), element('c')},
+                                   {element('a')}};
+
+  for (const vector<string> &merge : merges) {
+    unsigned bytes = kvs.put("key", FlatSetLattice<string>(merge));
+    EXPECT_EQ(bytes - heap_bytes(*kvs.find("key", cache)), overhead);
+  }
+
+  SetLattice<string> set;
+  std::size_t bytes = 0;
+  merge_counting(set, SetLattice<string>({element('a'), element('b')}), bytes);
+  merge_counting(set, SetLattice<string>({element('b'), element('c')}), bytes);
+  EXPECT_EQ(bytes, heap_bytes(set));
+}
+
+TEST(KVStoreTest, SerializedCache) {
+  MemoryLWWKVS kvs;
+  MemoryLWWSerializer serializer(&kvs);
+  AnnaError error = AnnaError::NO_ERROR;
+  string *cache;
+
+  serializer.put("key", serialize(1, "a"));
+  kvs.find("key", cache);
+  EXPECT_EQ(*cache, "");
+
+  // a read fills in the cached serialized form
+  string payload;
+  serializer.get("key", &payload, error);
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+  EXPECT_EQ(*cache, payload);
+  EXPECT_EQ(deserialize_lww(payload).reveal().value, "a");
+
+  // a merge invalidates it
+  serializer.put("key", serialize(2, "b"));
+  EXPECT_EQ(*cache, "");
+
+  serializer.get("key", &payload, error);
+  EXPECT_EQ(deserialize_lww(payload).reveal().value, "b");
+}
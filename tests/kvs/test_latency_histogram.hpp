@@ -0,0 +1,59 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "latency_histogram.hpp"
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  for (unsigned i = 1; i <= 1000; i++) {
+    histogram.record(i * 10);
+  }
+
+  EXPECT_EQ(histogram.total(), 1000);
+  EXPECT_EQ(histogram.max(), 10000);
+  EXPECT_NEAR(histogram.percentile(0.5), 5000, 5000.0 / 128);
+  EXPECT_NEAR(histogram.percentile(0.99), 9900, 9900.0 / 128);
+  EXPECT_NEAR(histogram.percentile(0.999), 9990, 9990.0 / 128);
+  EXPECT_EQ(histogram.percentile(1), 10000);
+  EXPECT_NEAR(histogram.mean(), 5005, 1);
+
+  histogram.clear();
+  EXPECT_EQ(histogram.total(), 0);
+  EXPECT_EQ(histogram.percentile(0.99), 0);
+}
+
+TEST(LatencyHistogramTest, MergeAndRebuild) {
+  LatencyHistogram fast;
+  LatencyHistogram slow;
+  for (unsigned i = 0; i < 99; i++) {
+    fast.record(100);
+  }
+  slow.record(1000000);
+
+  // rebuild slow from its nonempty buckets, as the monitor does with the
+  // histograms that clients send it
+  LatencyHistogram rebuilt;
+  const vector<uint64_t> &counts = slow.counts();
+  for (unsigned i = 0; i < counts.size(); i++) {
+    rebuilt.add(i, counts[i]);
+  }
+
+  EXPECT_EQ(rebuilt.total(), 1);
+  EXPECT_NEAR(rebuilt.percentile(1), 1000000, 1000000.0 / 128);
+
+  fast.merge(rebuilt);
+  EXPECT_EQ(fast.total(), 100);
+  EXPECT_EQ(fast.percentile(0.99), 100);
+  EXPECT_NEAR(fast.percentile(1), 1000000, 1000000.0 / 128);
+}
@@ -0,0 +1,71 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "monitor/load_forecast.hpp"
+
+TEST(LoadForecastTest, FollowsTrend) {
+  HoltForecast holt(0.5, 0.5);
+
+  for (unsigned i = 1; i <= 20; i++) {
+    holt.observe(10 * i);
+  }
+
+  EXPECT_EQ(holt.samples(), 20);
+  EXPECT_NEAR(holt.forecast(0), 200, 1);
+  EXPECT_NEAR(holt.forecast(2), 220, 2);
+  EXPECT_EQ(HoltForecast(0.5, 0.5).forecast(10), 0);
+}
+
+TEST(LoadForecastTest, AddsNodesAheadOfLoad) {
+  LoadForecast forecast(0.5, 0.5, 4, 0.6, 0.3, 2);
+
+  // the occupancy of two nodes rises by 5% an epoch; nothing happens until
+  // the warmup is over
+  forecast.observe(1000, 0.3, 2);
+  EXPECT_EQ(forecast.nodes_to_add(2), 0);
+  forecast.observe(1100, 0.35, 2);
+  forecast.observe(1200, 0.4, 2);
+  EXPECT_TRUE(forecast.ready());
+
+  // 0.5 is below the high mark, but four epochs ahead it is not
+  forecast.observe(1300, 0.45, 2);
+  forecast.observe(1400, 0.5, 2);
+  EXPECT_GT(forecast.projected_work(), 1.2);
+  EXPECT_GT(forecast.nodes_to_add(2), 0);
+  EXPECT_FALSE(forecast.can_remove());
+}
+
+TEST(LoadForecastTest, RemovesOnlyAfterSustainedLowLoad) {
+  LoadForecast forecast(0.5, 0.5, 4, 0.6, 0.3, 2);
+
+  for (unsigned i = 0; i < 3; i++) {
+    forecast.observe(100, 0.05, 4);
+  }
+  EXPECT_TRUE(forecast.can_remove());
+  EXPECT_EQ(forecast.nodes_to_add(4), 0);
+
+  // a change in the tier's size restarts the count
+  forecast.observe(100, 0.07, 3);
+  EXPECT_FALSE(forecast.can_remove());
+  forecast.observe(100, 0.07, 3);
+  EXPECT_TRUE(forecast.can_remove());
+
+  // one busy epoch resets it
+  forecast.observe(2000, 0.5, 3);
+  EXPECT_FALSE(forecast.can_remove());
+
+  // epochs without occupancy reports are skipped
+  forecast.observe(0, NAN, 3);
+  EXPECT_FALSE(forecast.can_remove());
+}
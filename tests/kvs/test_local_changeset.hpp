@@ -0,0 +1,69 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+TEST(LocalChangesetTest, AccumulatesSetDeltas) {
+  LocalChangeset changeset;
+  set<string> a = {"a"};
+  set<string> b = {"b"};
+  set<string> both = {"a", "b"};
+
+  changeset.insert("set", LatticeType::SET, serialize(SetLattice<string>(a)));
+  changeset.insert("set", LatticeType::SET, serialize(SetLattice<string>(b)));
+  changeset.insert("lww", LatticeType::LWW, serialize(0, string("value")));
+
+  EXPECT_EQ(changeset.size(), 2);
+  changeset.start_round();
+  EXPECT_EQ(changeset.size(), 0);
+  ASSERT_NE(changeset.delta("set"), nullptr);
+  EXPECT_EQ(*changeset.delta("set"), serialize(SetLattice<string>(both)));
+  EXPECT_EQ(changeset.delta("lww"), nullptr);
+
+  EXPECT_EQ(changeset.next_batch(1).size(), 1);
+  EXPECT_FALSE(changeset.round_done());
+  EXPECT_EQ(changeset.next_batch(1).size(), 1);
+  EXPECT_TRUE(changeset.round_done());
+  changeset.finish_round();
+
+  // a full-value change wins over the delta for the rest of the round
+  changeset.insert("set");
+  changeset.insert("set", LatticeType::SET, serialize(SetLattice<string>(a)));
+  changeset.start_round();
+  EXPECT_EQ(changeset.delta("set"), nullptr);
+}
+
+TEST(LocalChangesetTest, AntiEntropyRound) {
+  LocalChangeset changeset;
+  set<string> a = {"a"};
+
+  changeset.insert("set", LatticeType::SET, serialize(SetLattice<string>(a)));
+  changeset.start_round();
+  changeset.finish_round();
+  EXPECT_EQ(changeset.size(), 0);
+
+  for (unsigned i = 1; i < kAntiEntropyRounds - 1; i++) {
+    changeset.start_round();
+    changeset.finish_round();
+  }
+
+  EXPECT_EQ(changeset.size(), 0);
+  changeset.start_round();
+  changeset.finish_round();
+
+  // the key is resent in full
+  EXPECT_EQ(changeset.size(), 1);
+  changeset.start_round();
+  EXPECT_EQ(changeset.delta("set"), nullptr);
+}
@@ -0,0 +1,133 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+class LogStoreTest : public ::testing::Test {
+protected:
+  string dir_;
+
+  void SetUp() {
+    // each test starts from its own empty directory
+    char dir[] = "log_store_test_XXXXXX";
+    dir_ = mkdtemp(dir);
+  }
+
+  void TearDown() {
+    DIR *dir = opendir(dir_.c_str());
+    if (dir != nullptr) {
+      struct dirent *ent;
+      while ((ent = readdir(dir)) != nullptr) {
+        string name = ent->d_name;
+        if (name != "." && name != "..") {
+          unlink((dir_ + "/" + name).c_str());
+        }
+      }
+
+      closedir(dir);
+    }
+
+    rmdir(dir_.c_str());
+  }
+
+  // compacts every sealed segment that qualifies
+  void compact_all(LogStore &store) {
+    for (unsigned i = 0; i < 16; i++) {
+      store.compact();
+    }
+  }
+};
+
+TEST_F(LogStoreTest, MergeOnRead) {
+  LogStore store(dir_, merge_serialized);
+
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"a"})));
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"b"})));
+
+  string payload;
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(deserialize_set(payload).reveal(), set<string>({"a", "b"}));
+
+  store.remove("key");
+  EXPECT_FALSE(store.get("key", &payload));
+}
+
+TEST_F(LogStoreTest, Recovery) {
+  {
+    LogStore store(dir_, merge_serialized);
+    store.put("key", LatticeType::LWW, serialize(2, "b"));
+    store.put("key", LatticeType::LWW, serialize(1, "a"));
+    store.put("removed", LatticeType::LWW, serialize(1, "a"));
+    store.remove("removed");
+  }
+
+  LogStore store(dir_, merge_serialized);
+  string payload;
+
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(deserialize_lww(payload).reveal().value, "b");
+  EXPECT_FALSE(store.get("removed", &payload));
+}
+
+TEST_F(LogStoreTest, CompactionDropsTombstonesHidingNothing) {
+  unsigned long long sealed;
+  {
+    LogStore store(dir_, merge_serialized);
+    store.put("other", LatticeType::LWW, serialize(1, string(1000, 'x')));
+    sealed = store.disk_usage();
+  }
+
+  {
+    LogStore store(dir_, merge_serialized);
+    store.put("key", LatticeType::LWW, serialize(1, "a"));
+    store.remove("key");
+  }
+
+  // the tombstone's segment is compacted, and no older segment holds a
+  // record of the key, so the tombstone is not carried forward
+  LogStore store(dir_, merge_serialized);
+  compact_all(store);
+  EXPECT_EQ(store.disk_usage(), sealed);
+}
+
+TEST_F(LogStoreTest, CompactionKeepsTombstoneOfKeyStoredAgain) {
+  {
+    LogStore store(dir_, merge_serialized);
+    store.put("key", LatticeType::SET, serialize(SetLattice<string>({"a"})));
+    store.put("other", LatticeType::LWW, serialize(1, string(1000, 'x')));
+  }
+
+  {
+    LogStore store(dir_, merge_serialized);
+    store.remove("key");
+    store.put("key", LatticeType::SET, serialize(SetLattice<string>({"b"})));
+    store.put("junk", LatticeType::LWW, serialize(1, string(1000, 'x')));
+    store.remove("junk");
+  }
+
+  string payload;
+  {
+    // the first segment still holds the removed value of key, so the
+    // tombstone must outlive the compaction of the second one
+    LogStore store(dir_, merge_serialized);
+    compact_all(store);
+
+    EXPECT_TRUE(store.get("key", &payload));
+    EXPECT_EQ(deserialize_set(payload).reveal(), set<string>({"b"}));
+  }
+
+  LogStore store(dir_, merge_serialized);
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(deserialize_set(payload).reveal(), set<string>({"b"}));
+}
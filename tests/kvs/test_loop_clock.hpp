@@ -0,0 +1,45 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <thread>
+
+#include "kvs/loop_clock.hpp"
+
+TEST(LoopClockTest, CycleClockMatchesSteadyClock) {
+  EXPECT_GT(CycleClock::ticks_per_microsecond(), 0);
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t ticks_start = CycleClock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  uint64_t ticks = CycleClock::now() - ticks_start;
+  double elapsed = std::chrono::duration<double, std::micro>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  EXPECT_NEAR(CycleClock::to_microseconds(ticks), elapsed, elapsed * 0.05);
+}
+
+TEST(LoopClockTest, OnlyTicksOnce) {
+  LoopClock clock;
+  auto start = clock.now();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(clock.now(), start);
+  EXPECT_EQ(clock.milliseconds_since(start), 0);
+
+  clock.tick();
+  EXPECT_GE(clock.milliseconds_since(start), 20);
+  EXPECT_GE(clock.microseconds_since(start), 20000);
+  EXPECT_EQ(clock.seconds_since(start), 0);
+}
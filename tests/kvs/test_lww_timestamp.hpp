@@ -0,0 +1,80 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+const string kLWWTimestampTestDir = "lww_timestamp_test";
+
+TEST(LWWTimestampTest, PeekAtSerializedValues) {
+  uint64_t timestamp;
+  const char *value;
+  std::size_t length;
+
+  string serialized = serialize(300, "value");
+  EXPECT_TRUE(peek_lww(serialized, timestamp, &value, &length));
+  EXPECT_EQ(timestamp, 300);
+  EXPECT_EQ(string(value, length), "value");
+
+  EXPECT_TRUE(peek_lww_prefix(serialized.substr(0, kLWWTimestampPrefix),
+                              timestamp));
+  EXPECT_EQ(timestamp, 300);
+
+  // a zero timestamp is not serialized at all
+  EXPECT_TRUE(peek_lww(serialize(0, "value"), timestamp));
+  EXPECT_EQ(timestamp, 0);
+  EXPECT_TRUE(peek_lww_prefix(serialize(0, "value"), timestamp));
+  EXPECT_EQ(timestamp, 0);
+
+  EXPECT_FALSE(peek_lww(serialized.substr(0, serialized.size() - 1),
+                        timestamp));
+}
+
+TEST_F(ServerHandlerTest, StaleLWWWritesAreDropped) {
+  Key key = "key";
+  unsigned bytes = serializers[LatticeType::LWW]->put(key, serialize(5, "new"));
+
+  EXPECT_EQ(serializers[LatticeType::LWW]->put(key, serialize(3, "old")),
+            bytes);
+
+  AnnaError error = AnnaError::NO_ERROR;
+  EXPECT_EQ(serializers[LatticeType::LWW]->get(key, error),
+            serialize(5, "new"));
+
+  // a newer write still wins
+  serializers[LatticeType::LWW]->put(key, serialize(7, "newer"));
+  EXPECT_EQ(serializers[LatticeType::LWW]->get(key, error),
+            serialize(7, "newer"));
+}
+
+TEST(LWWTimestampTest, LogStoreDropsStaleWrites) {
+  {
+    LogStore store(kLWWTimestampTestDir, merge_serialized);
+    store.remove("key");
+    store.put("key", LatticeType::LWW, serialize(5, "new"));
+
+    unsigned long long usage = store.disk_usage();
+    store.put("key", LatticeType::LWW, serialize(3, "old"));
+    EXPECT_EQ(store.disk_usage(), usage);
+  }
+
+  // the timestamp is recovered from the records on restart
+  LogStore store(kLWWTimestampTestDir, merge_serialized);
+  unsigned long long usage = store.disk_usage();
+  store.put("key", LatticeType::LWW, serialize(4, "old"));
+  EXPECT_EQ(store.disk_usage(), usage);
+
+  string payload;
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(deserialize_lww(payload).reveal().value, "new");
+}
@@ -0,0 +1,165 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+TEST_F(ServerHandlerTest, ClockSkipsReferencedKeys) {
+  for (const Key &key : {"a", "b", "c"}) {
+    process_put(key, LatticeType::LWW, serialize(0, "value"),
+                serializers[LatticeType::LWW], stored_key_map);
+  }
+
+  unsigned size = stored_key_map["a"].size_;
+  EXPECT_EQ(stored_key_map.bytes(), 3 * size);
+
+  auto any = [](const Key &) { return true; };
+  Key victim;
+
+  stored_key_map.touch("a");
+  EXPECT_TRUE(stored_key_map.next_victim(victim, any));
+  EXPECT_EQ(victim, "b");
+
+  // the hand moves on from the last victim; a's reference bit was cleared
+  EXPECT_TRUE(stored_key_map.next_victim(victim, any));
+  EXPECT_EQ(victim, "c");
+  EXPECT_TRUE(stored_key_map.next_victim(victim, any));
+  EXPECT_EQ(victim, "a");
+
+  EXPECT_FALSE(stored_key_map.next_victim(
+      victim, [](const Key &key) { return key == "d"; }));
+
+  stored_key_map.erase("b");
+  EXPECT_EQ(stored_key_map.bytes(), 2 * size);
+}
+
+TEST_F(ServerHandlerTest, EvictionDropsNonPrimaryCopies) {
+  unsigned seed = 0;
+  unsigned rid = 0;
+  vector<Address> routing_ips;
+  global_hash_rings[Tier::MEMORY].insert("127.0.0.2", "127.0.0.2", 0, 0);
+  local_hash_rings[Tier::MEMORY].insert(ip, ip, 0, 0);
+
+  // a key that the other server is the primary replica of
+  Key key;
+  for (unsigned i = 0; key.empty(); i++) {
+    Key candidate = "key_" + std::to_string(i);
+    if (responsible_global(candidate, 1, global_hash_rings[Tier::MEMORY])[0]
+            .private_ip() == "127.0.0.2") {
+      key = candidate;
+    }
+  }
+
+  key_replication_map[key].global_replication_[Tier::MEMORY] = 2;
+  key_replication_map[key].local_replication_[Tier::MEMORY] = 1;
+  process_put(key, LatticeType::LWW, serialize(0, "value"),
+              serializers[LatticeType::LWW], stored_key_map);
+  unsigned long long size = stored_key_map.bytes();
+
+  EXPECT_EQ(evict_to_budget(0, seed, log_, global_hash_rings,
+                            local_hash_rings, stored_key_map,
+                            key_replication_map, local_changeset, routing_ips,
+                            wt, serializers, pushers, rid),
+            1);
+
+  // the copy is still served until the lowered factor comes back
+  EXPECT_EQ(stored_key_map.count(key), 1);
+  EXPECT_TRUE(stored_key_map.dropping(key));
+  EXPECT_EQ(stored_key_map.bytes(), size);
+  EXPECT_EQ(stored_key_map.retained_bytes(), 0);
+  EXPECT_EQ(key_replication_map[key].global_replication_[Tier::MEMORY], 2);
+
+  // the metadata put, and the update to both of the key's nodes
+  vector<string> messages = get_zmq_messages();
+  ASSERT_EQ(messages.size(), 3);
+
+  ReplicationFactorUpdate update;
+  update.ParseFromString(messages[2]);
+  ASSERT_EQ(update.updates_size(), 1);
+  EXPECT_EQ(update.updates(0).key(), key);
+
+  for (const auto &global : update.updates(0).global()) {
+    if (global.tier() == Tier::MEMORY) {
+      EXPECT_EQ(global.value(), 1);
+    }
+  }
+
+  // a key being dropped is not chosen again
+  EXPECT_EQ(evict_to_budget(0, seed, log_, global_hash_rings,
+                            local_hash_rings, stored_key_map,
+                            key_replication_map, local_changeset, routing_ips,
+                            wt, serializers, pushers, rid),
+            0);
+
+  replication_change_handler(ip, ip, thread_id, seed, log_, messages[2],
+                             global_hash_rings, local_hash_rings,
+                             stored_key_map, key_replication_map,
+                             local_changeset, wt, serializers, pushers);
+
+  // the mock hash ring util keeps this thread among the key's replicas, so
+  // the copy stays; it is no longer marked, and may be chosen again
+  EXPECT_EQ(key_replication_map[key].global_replication_[Tier::MEMORY], 1);
+  EXPECT_FALSE(stored_key_map.dropping(key));
+  EXPECT_EQ(stored_key_map.retained_bytes(), size);
+}
+
+TEST_F(ServerHandlerTest, EvictionDemotesPrimaryReplicas) {
+  unsigned seed = 0;
+  unsigned rid = 0;
+  vector<Address> routing_ips;
+  Key key = "key";
+
+  key_replication_map[key].global_replication_[Tier::MEMORY] = 1;
+  key_replication_map[key].local_replication_[Tier::MEMORY] = 1;
+  process_put(key, LatticeType::LWW, serialize(0, "value"),
+              serializers[LatticeType::LWW], stored_key_map);
+  local_hash_rings[Tier::MEMORY].insert(ip, ip, 0, 0);
+
+  // without a disk tier, the primary replica has nowhere to go
+  EXPECT_EQ(evict_to_budget(0, seed, log_, global_hash_rings,
+                            local_hash_rings, stored_key_map,
+                            key_replication_map, local_changeset, routing_ips,
+                            wt, serializers, pushers, rid),
+            0);
+  EXPECT_EQ(stored_key_map.count(key), 1);
+
+  global_hash_rings[Tier::DISK].insert("127.0.0.3", "127.0.0.3", 0, 0);
+  EXPECT_EQ(evict_to_budget(0, seed, log_, global_hash_rings,
+                            local_hash_rings, stored_key_map,
+                            key_replication_map, local_changeset, routing_ips,
+                            wt, serializers, pushers, rid),
+            1);
+
+  EXPECT_EQ(stored_key_map.count(key), 0);
+  EXPECT_EQ(key_replication_map[key].global_replication_[Tier::MEMORY], 0);
+  EXPECT_EQ(key_replication_map[key].global_replication_[Tier::DISK], 1);
+
+  // the metadata put, the update to the memory and the disk replica, and the
+  // gossip of the key
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 4);
+
+  ReplicationFactorUpdate update;
+  update.ParseFromString(messages[1]);
+  EXPECT_EQ(update.updates_size(), 1);
+  EXPECT_EQ(update.updates(0).key(), key);
+
+  for (const auto &global : update.updates(0).global()) {
+    EXPECT_EQ(global.value(), global.tier() == Tier::MEMORY ? 0 : 1);
+  }
+
+  KeyRequest gossip;
+  gossip.ParseFromString(messages[3]);
+  EXPECT_EQ(gossip.type(), RequestType::PUT);
+  EXPECT_EQ(gossip.tuples(0).key(), key);
+}
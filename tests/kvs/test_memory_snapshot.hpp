@@ -0,0 +1,102 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/memory_snapshot.hpp"
+#include "kvs/server_utils.hpp"
+
+const string kSnapshotTestDir = "memory_snapshot_test";
+
+TEST(MemorySnapshotTest, WriteAndLoad) {
+  map<Key, KeyProperty> stored;
+  map<Key, string> values;
+
+  for (unsigned i = 0; i < 10; i++) {
+    Key key = "key_" + std::to_string(i);
+    stored[key] = KeyProperty{1, LatticeType::LWW};
+    values[key] = serialize(i, std::to_string(i));
+  }
+
+  // an entry that holds no data, and a key whose value cannot be read
+  stored["lookup"] = KeyProperty{0, LatticeType::NONE};
+  stored["missing"] = KeyProperty{1, LatticeType::LWW};
+
+  auto read = [&](const Key &key, LatticeType type, string *payload) {
+    if (values.find(key) == values.end()) {
+      return false;
+    }
+
+    *payload = values[key];
+    return true;
+  };
+
+  MemorySnapshot snapshot(kSnapshotTestDir, 0);
+  EXPECT_TRUE(snapshot.start());
+  EXPECT_FALSE(snapshot.write_batch(stored, 4, read));
+
+  // keys written after the cursor has passed them are left for the next
+  // snapshot
+  stored["a"] = KeyProperty{1, LatticeType::LWW};
+  values["a"] = serialize(1, "a");
+
+  EXPECT_FALSE(snapshot.write_batch(stored, 4, read));
+  EXPECT_TRUE(snapshot.write_batch(stored, 4, read));
+  EXPECT_TRUE(snapshot.finish());
+  EXPECT_FALSE(snapshot.in_progress());
+
+  map<Key, string> loaded;
+  uint64_t count = MemorySnapshot::load(
+      snapshot.path(),
+      [&](const Key &key, LatticeType type, const string &payload) {
+        EXPECT_EQ(type, LatticeType::LWW);
+        loaded[key] = payload;
+      });
+
+  EXPECT_EQ(count, 10);
+  EXPECT_EQ(loaded.size(), 10);
+  EXPECT_EQ(loaded.count("a"), 0);
+  EXPECT_EQ(deserialize_lww(loaded["key_7"]).reveal().value, "7");
+}
+
+TEST(MemorySnapshotTest, TruncatedSnapshot) {
+  map<Key, KeyProperty> stored;
+  stored["first"] = KeyProperty{1, LatticeType::LWW};
+  stored["second"] = KeyProperty{1, LatticeType::LWW};
+
+  auto read = [](const Key &key, LatticeType type, string *payload) {
+    *payload = serialize(1, key);
+    return true;
+  };
+
+  MemorySnapshot snapshot(kSnapshotTestDir, 1);
+  EXPECT_TRUE(snapshot.start());
+  EXPECT_TRUE(snapshot.write_batch(stored, 10, read));
+  EXPECT_TRUE(snapshot.finish());
+
+  struct stat st;
+  EXPECT_EQ(stat(snapshot.path().c_str(), &st), 0);
+  EXPECT_EQ(truncate(snapshot.path().c_str(), st.st_size - 1), 0);
+
+  // the torn record is skipped, and the one before it is still read
+  unsigned calls = 0;
+  EXPECT_EQ(MemorySnapshot::load(snapshot.path(),
+                                 [&](const Key &key, LatticeType type,
+                                     const string &payload) { calls += 1; }),
+            1);
+  EXPECT_EQ(calls, 1);
+
+  EXPECT_EQ(MemorySnapshot::load(kSnapshotTestDir + "/none",
+                                 [&](const Key &key, LatticeType type,
+                                     const string &payload) { calls += 1; }),
+            0);
+}
@@ -15,15 +15,20 @@
 #include "kvs/kvs_handlers.hpp"
 
 TEST_F(ServerHandlerTest, SimpleNodeDepart) {
+  unsigned seed = 0;
   kThreadNum = 2;
+  set<Key> join_remove_set;
+  AddressKeysetMap join_gossip_map;
   global_hash_rings[Tier::MEMORY].insert("127.0.0.2", "127.0.0.2", 0, 0);
 
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].size(), 6000);
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].get_unique_servers().size(), 2);
 
   string serialized = Tier_Name(Tier::MEMORY) + ":127.0.0.2:127.0.0.2";
-  node_depart_handler(thread_id, ip, ip, global_hash_rings, log_, serialized,
-                      pushers);
+  node_depart_handler(thread_id, seed, ip, ip, log_, serialized,
+                      global_hash_rings, local_hash_rings, stored_key_map,
+                      key_replication_map, join_remove_set, pushers, wt,
+                      join_gossip_map);
 
   vector<string> messages = get_zmq_messages();
 
@@ -35,12 +40,18 @@ TEST_F(ServerHandlerTest, SimpleNodeDepart) {
 }
 
 TEST_F(ServerHandlerTest, FakeNodeDepart) {
+  unsigned seed = 0;
+  set<Key> join_remove_set;
+  AddressKeysetMap join_gossip_map;
+
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].size(), 3000);
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].get_unique_servers().size(), 1);
 
   string serialized = std::to_string(Tier::MEMORY) + ":127.0.0.2:127.0.0.2";
-  node_depart_handler(thread_id, ip, ip, global_hash_rings, log_, serialized,
-                      pushers);
+  node_depart_handler(thread_id, seed, ip, ip, log_, serialized,
+                      global_hash_rings, local_hash_rings, stored_key_map,
+                      key_replication_map, join_remove_set, pushers, wt,
+                      join_gossip_map);
 
   vector<string> messages = get_zmq_messages();
 
@@ -0,0 +1,77 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+const string kReadCacheTestDir = "read_cache_test";
+
+TEST(ReadCacheTest, EvictsLeastRecentlyUsed) {
+  ReadCache empty(0);
+  empty.put("a", "1");
+
+  string payload;
+  EXPECT_FALSE(empty.get("a", &payload));
+  EXPECT_EQ(empty.misses(), 0);
+
+  // room for two entries of this size, but not three
+  ReadCache probe(1 << 20);
+  probe.put("a", string(100, 'x'));
+  ReadCache cache(probe.bytes() * 2 + probe.bytes() / 2);
+
+  cache.put("a", string(100, 'a'));
+  cache.put("b", string(100, 'b'));
+  EXPECT_TRUE(cache.get("a", &payload));
+  EXPECT_EQ(payload, string(100, 'a'));
+
+  cache.put("c", string(100, 'c'));
+  EXPECT_FALSE(cache.get("b", &payload));
+  EXPECT_TRUE(cache.get("a", &payload));
+  EXPECT_TRUE(cache.get("c", &payload));
+  EXPECT_EQ(cache.bytes(), probe.bytes() * 2);
+
+  EXPECT_EQ(cache.hits(), 3);
+  EXPECT_EQ(cache.misses(), 1);
+
+  // a value larger than the whole cache is not kept
+  cache.put("a", string(1000, 'a'));
+  EXPECT_EQ(cache.find("a"), nullptr);
+
+  cache.erase("c");
+  EXPECT_EQ(cache.bytes(), 0);
+}
+
+TEST(ReadCacheTest, FollowsTheLogStore) {
+  LogStore store(kReadCacheTestDir, merge_serialized, 1 << 20);
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"a"})));
+
+  string payload;
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(store.cache().misses(), 1);
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(store.cache().hits(), 1);
+
+  // a PUT merges into the cached value
+  store.put("key", LatticeType::SET, serialize(SetLattice<string>({"b"})));
+  EXPECT_TRUE(store.get("key", &payload));
+  EXPECT_EQ(store.cache().hits(), 2);
+  EXPECT_EQ(deserialize_set(payload).reveal(), set<string>({"a", "b"}));
+
+  // a cached key is read without the I/O threads
+  LogReadPlan plan;
+  EXPECT_FALSE(store.plan_read("key", plan));
+
+  store.remove("key");
+  EXPECT_FALSE(store.get("key", &payload));
+  EXPECT_EQ(store.cache().bytes(), 0);
+}
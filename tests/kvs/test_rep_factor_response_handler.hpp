@@ -14,4 +14,121 @@
 
 #include "kvs/kvs_handlers.hpp"
 
-// TODO: write actual tests
+TEST_F(ServerHandlerTest, PendingRequestsShareOneWriteAndOneRead) {
+  Key key = "key";
+  Address writer = UserThread(ip, 1).response_connect_address();
+  Address first_reader = UserThread(ip, 2).response_connect_address();
+  Address second_reader = UserThread(ip, 3).response_connect_address();
+
+  // the later write wins even though it waited first
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::PUT, LatticeType::LWW, serialize(2, "new"), writer, "1"));
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::PUT, LatticeType::LWW, serialize(1, "old"), "", ""));
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::GET, LatticeType::NONE, "", first_reader, "2"));
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::GET, LatticeType::NONE, "", second_reader, "3"));
+
+  KeyResponse response;
+  response.set_type(RequestType::GET);
+  KeyTuple *tp = response.add_tuples();
+  tp->set_key(get_metadata_key(key, MetadataType::replication));
+  tp->set_error(AnnaError::KEY_DNE);
+
+  string serialized;
+  response.SerializeToString(&serialized);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  replication_response_handler(
+      seed, access_count, log_, serialized, global_hash_rings,
+      local_hash_rings, pending_requests, pending_gossip, key_access_tracker,
+      stored_key_map, key_replication_map, local_changeset, wt, serializers,
+      pushers, batcher, buffers);
+
+  string payload;
+  AnnaError error;
+  serializers[LatticeType::LWW]->get(key, &payload, error);
+  EXPECT_EQ(error, AnnaError::NO_ERROR);
+  EXPECT_EQ(payload, serialize(2, "new"));
+  EXPECT_EQ(local_changeset.size(), 1);
+  EXPECT_EQ(access_count, 4);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 3);
+
+  unsigned reads = 0;
+  for (const string &message : messages) {
+    KeyResponse key_response;
+    key_response.ParseFromString(message);
+    EXPECT_EQ(key_response.tuples().size(), 1);
+
+    const KeyTuple &rtp = key_response.tuples(0);
+    EXPECT_EQ(rtp.key(), key);
+    EXPECT_EQ(rtp.error(), AnnaError::NO_ERROR);
+
+    if (key_response.type() == RequestType::GET) {
+      EXPECT_EQ(rtp.payload(), serialize(2, "new"));
+      reads += 1;
+    } else {
+      EXPECT_EQ(key_response.response_id(), "1");
+      EXPECT_EQ(rtp.lattice_type(), LatticeType::LWW);
+    }
+  }
+
+  EXPECT_EQ(reads, 2);
+}
+
+TEST_F(ServerHandlerTest, PendingRequestsAreGroupedByAddressAndCounted) {
+  Key key = "key";
+  Address client = UserThread(ip, 1).response_connect_address();
+  Address other = UserThread(ip, 2).response_connect_address();
+
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::PUT, LatticeType::LWW, serialize(1, "value"), client, "1"));
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::GET, LatticeType::NONE, "", client, "2"));
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::GET, LatticeType::NONE, "", other, "3"));
+  pending_requests[key].push_back(PendingRequest(
+      RequestType::PUT, LatticeType::LWW, serialize(0, "older"), "", ""));
+
+  // a write of the wrong type is refused, and so not counted
+  pending_requests[key].push_back(
+      PendingRequest(RequestType::PUT, LatticeType::SET,
+                     serialize(SetLattice<string>({"a"})), "", ""));
+
+  KeyResponse response;
+  response.set_type(RequestType::GET);
+  KeyTuple *tp = response.add_tuples();
+  tp->set_key(get_metadata_key(key, MetadataType::replication));
+  tp->set_error(AnnaError::KEY_DNE);
+
+  string serialized;
+  response.SerializeToString(&serialized);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  replication_response_handler(
+      seed, access_count, log_, serialized, global_hash_rings,
+      local_hash_rings, pending_requests, pending_gossip, key_access_tracker,
+      stored_key_map, key_replication_map, local_changeset, wt, serializers,
+      pushers, batcher, buffers);
+
+  // the client's two responses go out together as one multipart message,
+  // past the mock; the other address gets its one response on its own
+  vector<string> messages = get_zmq_messages();
+  ASSERT_EQ(messages.size(), 1);
+
+  KeyResponse key_response;
+  key_response.ParseFromString(messages[0]);
+  EXPECT_EQ(key_response.response_id(), "3");
+  EXPECT_EQ(key_response.tuples(0).payload(), serialize(1, "value"));
+
+  EXPECT_EQ(access_count, 4);
+  EXPECT_EQ(local_changeset.size(), 1);
+  EXPECT_EQ(pending_requests.find(key), pending_requests.end());
+}
@@ -0,0 +1,71 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#include <thread>
+
+#include "replica_selector.hpp"
+
+TEST(ReplicaSelectorTest, AvoidsBusyReplicas) {
+  ReplicaSelector selector;
+  vector<Address> addresses = {"busy", "idle"};
+  auto address = [&](std::size_t i) { return addresses[i]; };
+
+  for (unsigned i = 0; i < 4; i++) {
+    selector.sent("busy", selector.request_id("client"));
+  }
+
+  EXPECT_EQ(selector.outstanding("busy"), 4);
+  EXPECT_EQ(selector.outstanding("idle"), 0);
+
+  unsigned seed = 0;
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_EQ(selector.choose(addresses.size(), seed, address), 1);
+  }
+}
+
+TEST(ReplicaSelectorTest, AvoidsSlowReplicas) {
+  ReplicaSelector selector;
+  vector<Address> addresses = {"slow", "fast"};
+  auto address = [&](std::size_t i) { return addresses[i]; };
+
+  string slow = selector.request_id("client");
+  string fast = selector.request_id("client");
+  EXPECT_NE(slow, fast);
+
+  selector.sent("slow", slow);
+  selector.sent("fast", fast);
+  selector.answered(fast);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  selector.answered(slow);
+
+  // answering a request twice, or one never sent, changes nothing
+  selector.answered(slow);
+  selector.answered("client:unknown");
+
+  EXPECT_EQ(selector.outstanding("slow"), 0);
+  EXPECT_EQ(selector.outstanding("fast"), 0);
+  EXPECT_GE(selector.latency("slow"), 20000);
+  EXPECT_LT(selector.latency("fast"), selector.latency("slow"));
+
+  unsigned seed = 0;
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_EQ(selector.choose(addresses.size(), seed, address), 1);
+  }
+}
+
+TEST(ReplicaSelectorTest, ChoosesTheOnlyReplica) {
+  ReplicaSelector selector;
+  unsigned seed = 0;
+
+  EXPECT_EQ(selector.choose(1, seed, [](std::size_t) { return "only"; }), 0);
+}
@@ -0,0 +1,72 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "scan_merger.hpp"
+
+KeyScanResponse scan_page(vector<Key> keys, bool more, unsigned shards) {
+  KeyScanResponse response;
+  for (const Key &key : keys) {
+    response.add_keys(key);
+  }
+
+  response.set_more(more);
+  response.set_shard_count(shards);
+  return response;
+}
+
+TEST(ScanMergerTest, StopsWhereTheFirstShardStopped) {
+  ScanMerger merger(3);
+
+  EXPECT_FALSE(merger.add(scan_page({"a", "d", "e"}, true, 3)));
+  EXPECT_FALSE(merger.add(scan_page({"b", "c"}, false, 3)));
+
+  // a replica of a key another shard holds is only listed once
+  EXPECT_TRUE(merger.add(scan_page({"a", "b", "f"}, true, 3)));
+
+  vector<Key> keys;
+  bool more;
+  merger.page(keys, more);
+
+  // the first shard may have keys between e and f, so the page cannot go
+  // past e, and the limit cuts it at c
+  EXPECT_EQ(keys, vector<Key>({"a", "b", "c"}));
+  EXPECT_TRUE(more);
+}
+
+TEST(ScanMergerTest, TakesEveryKeyOnceWhenNoShardHasMore) {
+  ScanMerger merger(10);
+
+  EXPECT_FALSE(merger.add(scan_page({"b", "c"}, false, 2)));
+  EXPECT_TRUE(merger.add(scan_page({"a", "c"}, false, 2)));
+
+  vector<Key> keys;
+  bool more;
+  merger.page(keys, more);
+
+  EXPECT_EQ(keys, vector<Key>({"a", "b", "c"}));
+  EXPECT_FALSE(more);
+}
+
+TEST(ScanMergerTest, CompletesWithNoShards) {
+  ScanMerger merger(10);
+  EXPECT_FALSE(merger.complete());
+  EXPECT_TRUE(merger.add(scan_page({}, false, 0)));
+
+  vector<Key> keys;
+  bool more;
+  merger.page(keys, more);
+
+  EXPECT_TRUE(keys.empty());
+  EXPECT_FALSE(more);
+}
@@ -22,12 +22,13 @@ TEST_F(ServerHandlerTest, SelfDepart) {
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].size(), 3000);
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].get_unique_servers().size(), 1);
 
+  DepartPlan depart_plan;
   string serialized = "tcp://127.0.0.2:6560";
 
   self_depart_handler(thread_id, seed, ip, ip, log_, serialized,
                       global_hash_rings, local_hash_rings, stored_key_map,
                       key_replication_map, routing_ips, monitoring_ips, wt,
-                      pushers, serializers);
+                      pushers, depart_plan);
 
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].size(), 0);
   EXPECT_EQ(global_hash_rings[Tier::MEMORY].get_unique_servers().size(), 0);
@@ -35,8 +36,62 @@ TEST_F(ServerHandlerTest, SelfDepart) {
   vector<string> zmq_messages = get_zmq_messages();
   EXPECT_EQ(zmq_messages.size(), 1);
   EXPECT_EQ(zmq_messages[0], ip + "_" + ip + "_" + Tier_Name(kSelfTier));
+  EXPECT_FALSE(depart_plan.active());
+}
+
+TEST_F(ServerHandlerTest, SelfDepartPlan) {
+  unsigned seed = 0;
+  vector<Address> routing_ips;
+  vector<Address> monitoring_ips;
+  Address other = "127.0.0.2";
+
+  global_hash_rings[Tier::MEMORY].insert(other, other, 0, 0);
+  local_hash_rings[Tier::MEMORY].insert(ip, ip, 0, 0);
+
+  vector<Key> keys = {"key_a", "key_b", "key_c"};
+  for (const Key &key : keys) {
+    process_put(key, LatticeType::LWW, serialize(0, "value"),
+                lww_serializer, stored_key_map);
+    key_replication_map[key].global_replication_[Tier::MEMORY] = 1;
+    key_replication_map[key].local_replication_[Tier::MEMORY] = 1;
+  }
+
+  DepartPlan depart_plan;
+  AddressKeysetMap join_gossip_map;
+  string serialized = "tcp://127.0.0.2:6560";
+
+  self_depart_handler(thread_id, seed, ip, ip, log_, serialized,
+                      global_hash_rings, local_hash_rings, stored_key_map,
+                      key_replication_map, routing_ips, monitoring_ips, wt,
+                      pushers, depart_plan);
+
+  // only the other node is told; the departure is acknowledged once the
+  // keys have been handed off
+  vector<string> zmq_messages = get_zmq_messages();
+  EXPECT_EQ(zmq_messages.size(), 1);
+  EXPECT_TRUE(depart_plan.active());
+  EXPECT_EQ(depart_plan.ranges(), 3001);
+
+  // a batch smaller than the keys leaves the plan where it stopped
+  EXPECT_EQ(depart_plan.next(stored_key_map, global_hash_rings,
+                             local_hash_rings, key_replication_map,
+                             join_gossip_map, 2),
+            2);
+  EXPECT_TRUE(depart_plan.active());
+
+  EXPECT_EQ(depart_plan.next(stored_key_map, global_hash_rings,
+                             local_hash_rings, key_replication_map,
+                             join_gossip_map, 10),
+            1);
+  EXPECT_FALSE(depart_plan.active());
+  EXPECT_EQ(depart_plan.ranges_done(), depart_plan.ranges());
+
+  Address gossip_address =
+      ServerThread(other, other, 0).gossip_connect_address();
+  EXPECT_EQ(join_gossip_map.size(), 1);
+  EXPECT_EQ(join_gossip_map[gossip_address],
+            set<Key>(keys.begin(), keys.end()));
 }
 
-// TODO: test should add keys and make sure that they are gossiped elsewhere
 // TODO: test should make sure that depart messages are sent to the worker
 // threads
@@ -0,0 +1,78 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_metrics.hpp"
+
+bool has_line(const string &text, const string &line) {
+  return text.find(line + "\n") != string::npos;
+}
+
+TEST(ServerMetricsTest, RenderHandlers) {
+  ServerMetrics metrics;
+  metrics.record(Handler::REQUEST, 20);
+  metrics.record(Handler::REQUEST, 200);
+  metrics.record(Handler::REQUEST, 2000000);
+  metrics.record_drain(Handler::REQUEST, false);
+  metrics.record_drain(Handler::REQUEST, true);
+  metrics.pending_requests = 3;
+  metrics.value_store_bytes = 4096;
+  metrics.ready = 1;
+  metrics.startup_ms = 250;
+
+  MetricsRegistry registry(2);
+  registry.publish(1, metrics);
+  string text = registry.render();
+
+  string labels = "thread=\"1\",handler=\"request\"";
+  string name = "anna_handler_latency_microseconds";
+  EXPECT_TRUE(has_line(text, "# TYPE " + name + " histogram"));
+  EXPECT_TRUE(has_line(text, name + "_bucket{" + labels + ",le=\"10\"} 0"));
+  EXPECT_TRUE(has_line(text, name + "_bucket{" + labels + ",le=\"25\"} 1"));
+  EXPECT_TRUE(has_line(text, name + "_bucket{" + labels + ",le=\"250\"} 2"));
+  EXPECT_TRUE(
+      has_line(text, name + "_bucket{" + labels + ",le=\"1000000\"} 2"));
+  EXPECT_TRUE(has_line(text, name + "_bucket{" + labels + ",le=\"+Inf\"} 3"));
+  EXPECT_TRUE(has_line(text, name + "_count{" + labels + "} 3"));
+
+  EXPECT_TRUE(has_line(text, "anna_socket_wakeups_total{" + labels + "} 2"));
+  EXPECT_TRUE(
+      has_line(text, "anna_socket_backlogged_total{" + labels + "} 1"));
+  EXPECT_TRUE(has_line(text, "anna_pending_requests{thread=\"1\"} 3"));
+  EXPECT_TRUE(has_line(text, "anna_value_store_bytes{thread=\"1\"} 4096"));
+  EXPECT_TRUE(has_line(text, "anna_thread_ready{thread=\"1\"} 1"));
+  EXPECT_TRUE(has_line(text, "anna_startup_milliseconds{thread=\"1\"} 250"));
+
+  // threads that have not published yet report zeros
+  EXPECT_TRUE(has_line(text, name + "_count{thread=\"0\",handler=\"join\"} 0"));
+  EXPECT_TRUE(has_line(text, "anna_pending_requests{thread=\"0\"} 0"));
+  EXPECT_TRUE(has_line(text, "anna_thread_ready{thread=\"0\"} 0"));
+}
+
+TEST(ServerMetricsTest, HttpResponse) {
+  MetricsRegistry registry(1);
+
+  string response = metrics_http_response(
+      "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", registry);
+  string body = registry.render();
+  EXPECT_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0);
+  EXPECT_NE(response.find("Content-Length: " + std::to_string(body.size())),
+            string::npos);
+  EXPECT_EQ(response.substr(response.size() - body.size()), body);
+
+  response = metrics_http_response("GET /other HTTP/1.1\r\n\r\n", registry);
+  EXPECT_EQ(response.compare(0, 22, "HTTP/1.1 404 Not Found"), 0);
+
+  response = metrics_http_response("POST /metrics HTTP/1.1\r\n\r\n", registry);
+  EXPECT_EQ(response.compare(0, 12, "HTTP/1.1 405"), 0);
+}
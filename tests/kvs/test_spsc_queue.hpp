@@ -0,0 +1,86 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <thread>
+
+#include "kvs/intra_node_dispatch.hpp"
+
+TEST(SpscQueueTest, BoundedFifo) {
+  SpscQueue<unsigned> queue(3);
+  EXPECT_EQ(queue.capacity(), 4);
+  EXPECT_TRUE(queue.empty());
+
+  for (unsigned i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.push(std::move(i)));
+  }
+
+  unsigned value = 10;
+  EXPECT_FALSE(queue.push(std::move(value)));
+
+  for (unsigned i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, i);
+  }
+
+  EXPECT_FALSE(queue.pop(value));
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, ConcurrentProducerAndConsumer) {
+  const unsigned count = 100000;
+  SpscQueue<unsigned> queue(64);
+
+  std::thread producer([&queue, count]() {
+    for (unsigned i = 0; i < count; i++) {
+      unsigned value = i;
+      while (!queue.push(std::move(value))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  unsigned expected = 0;
+  bool in_order = true;
+  while (expected < count) {
+    unsigned value;
+    if (queue.pop(value)) {
+      in_order = in_order && value == expected;
+      expected += 1;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  producer.join();
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, MailboxesTakeTurnsAmongSenders) {
+  IntraNodeMailboxes mailboxes(3, 2);
+
+  EXPECT_TRUE(mailboxes.send(0, 2, "a0"));
+  EXPECT_TRUE(mailboxes.send(0, 2, "a1"));
+  EXPECT_FALSE(mailboxes.send(0, 2, "a2"));
+  EXPECT_TRUE(mailboxes.send(1, 2, "b0"));
+  EXPECT_FALSE(mailboxes.send(1, 3, "c0"));
+
+  vector<string> received;
+  auto handler = [&received](string &request) { received.push_back(request); };
+
+  EXPECT_EQ(mailboxes.receive(0, 10, handler), 0);
+  EXPECT_EQ(mailboxes.receive(2, 2, handler), 2);
+  EXPECT_EQ(mailboxes.receive(2, 10, handler), 1);
+  EXPECT_EQ(received, vector<string>({"a0", "b0", "a1"}));
+}
@@ -0,0 +1,266 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "count_min_sketch.hpp"
+#include "kvs/key_access_tracker.hpp"
+#include "kvs/key_size_reporter.hpp"
+#include "kvs/stats_report_builder.hpp"
+#include "monitor/access_aggregate.hpp"
+
+TEST(StatsReportTest, SketchNeverUnderestimates) {
+  CountMinSketch sketch(64, 4);
+
+  for (unsigned i = 0; i < 500; i++) {
+    sketch.add("key_" + std::to_string(i), i % 7);
+  }
+
+  for (unsigned i = 0; i < 500; i++) {
+    EXPECT_GE(sketch.estimate("key_" + std::to_string(i)), i % 7);
+  }
+
+  CountMinSketch other(64, 4);
+  other.add("key_1", 5);
+  uint32_t before = sketch.estimate("key_1");
+  EXPECT_TRUE(sketch.merge(other));
+  EXPECT_GE(sketch.estimate("key_1"), before + 5);
+  EXPECT_TRUE(sketch.merge(other, true));
+  EXPECT_EQ(sketch.estimate("key_1"), before);
+
+  EXPECT_FALSE(sketch.merge(CountMinSketch(32, 4)));
+  EXPECT_EQ(CountMinSketch(64, 4).estimate("key_1"), 0);
+}
+
+TEST(StatsReportTest, SummarizesHotKeys) {
+  KeyAccessTracker tracker;
+  map<Key, KeyProperty> stored_key_map;
+
+  for (unsigned i = 1; i <= 5; i++) {
+    Key key = "key_" + std::to_string(i);
+    stored_key_map[key] = KeyProperty{1, LatticeType::LWW};
+
+    for (unsigned j = 0; j < i; j++) {
+      tracker.record(key);
+    }
+  }
+
+  tracker.record("missing");
+
+  ServerStatsReport report;
+  tracker.summarize(report, stored_key_map, 2, 256, 4);
+
+  map<Key, unsigned> hot;
+  for (const auto &key_count : report.hot_keys()) {
+    hot[key_count.key()] = key_count.access_count();
+  }
+
+  EXPECT_EQ(hot.size(), 2);
+  EXPECT_EQ(hot["key_5"], 5);
+  EXPECT_EQ(hot["key_4"], 4);
+
+  EXPECT_EQ(report.accessed_keys(), 5);
+  EXPECT_EQ(report.access_total(), 15);
+  EXPECT_EQ(report.access_square_total(), 55);
+  EXPECT_EQ(tracker.size(), 5);
+
+  CountMinSketch sketch;
+  vector<uint32_t> counts(report.sketch().begin(), report.sketch().end());
+  EXPECT_TRUE(sketch.assign(report.sketch_width(), counts));
+  EXPECT_EQ(sketch.depth(), 4);
+  EXPECT_GE(sketch.estimate("key_3"), 3);
+}
+
+TEST(StatsReportTest, BuildsReportInBatches) {
+  GlobalHashRing ring;
+  for (unsigned i = 0; i < 4; i++) {
+    ring.insert("127.0.0." + std::to_string(i), "10.0.0." + std::to_string(i),
+                0, 0);
+  }
+
+  KeyAccessTracker tracker;
+  StoredKeyMap stored_key_map;
+  for (unsigned i = 0; i < 200; i++) {
+    Key key = "key_" + std::to_string(i);
+    stored_key_map[key] = KeyProperty{i, LatticeType::LWW};
+    stored_key_map.index(key);
+
+    for (unsigned j = 0; j < i % 5; j++) {
+      tracker.record(key);
+    }
+  }
+
+  ServerStatsReport expected;
+  tracker.summarize(expected, stored_key_map, 10, 256, 4);
+
+  set<Key> owned;
+  for (const auto &range : ring.owned_ranges("10.0.0.1", 1)) {
+    stored_key_map.keys_in_range(range.first, range.second, owned);
+  }
+
+  ServerStatsReport header;
+  header.set_tid(3);
+
+  KeySizeReporter sizes;
+  StatsReportBuilder builder;
+  builder.start(header, ring.owned_ranges("10.0.0.1", 1), tracker, 10, 256,
+                4);
+  EXPECT_TRUE(builder.building());
+
+  unsigned steps = 0;
+  auto all = [](const Key &key) { return true; };
+  while (!builder.step(tracker, stored_key_map, sizes, 7, all)) {
+    steps += 1;
+
+    // keys stored while the report is built do not break it
+    if (steps == 3) {
+      stored_key_map["late"] = KeyProperty{1, LatticeType::LWW};
+      stored_key_map.index("late");
+    }
+  }
+
+  const ServerStatsReport &report = builder.report();
+  EXPECT_FALSE(builder.building());
+  EXPECT_GT(steps, 10);
+  EXPECT_EQ(report.tid(), 3);
+  EXPECT_EQ(report.accessed_keys(), expected.accessed_keys());
+  EXPECT_EQ(report.access_total(), expected.access_total());
+  EXPECT_EQ(report.hot_keys_size(), 10);
+  EXPECT_EQ(report.sketch_size(), expected.sketch_size());
+  EXPECT_TRUE(report.full_sizes());
+
+  set<Key> reported;
+  for (const auto &key_size : report.key_sizes()) {
+    reported.insert(key_size.key());
+    EXPECT_EQ(key_size.size(), stored_key_map.at(key_size.key()).size_);
+  }
+
+  owned.erase("late");
+  reported.erase("late");
+  EXPECT_EQ(reported, owned);
+}
+
+TEST(StatsReportTest, ReportsChangedSizes) {
+  KeySizeReporter reporter;
+
+  // the first report is full
+  ServerStatsReport report;
+  reporter.add(report, "a", 10);
+  reporter.add(report, "b", 20);
+  reporter.finish(report);
+  EXPECT_TRUE(report.full_sizes());
+  EXPECT_EQ(report.key_sizes_size(), 2);
+
+  report.Clear();
+  reporter.add(report, "a", 10);
+  reporter.add(report, "b", 25);
+  reporter.add(report, "c", 30);
+  reporter.finish(report);
+  EXPECT_FALSE(report.full_sizes());
+  EXPECT_EQ(report.key_sizes_size(), 2);
+  EXPECT_EQ(report.key_sizes(0).key(), "b");
+  EXPECT_EQ(report.key_sizes(1).key(), "c");
+
+  for (unsigned i = 2; i < kFullSizeReportRounds; i++) {
+    report.Clear();
+    reporter.add(report, "a", 10);
+    reporter.finish(report);
+    EXPECT_EQ(report.key_sizes_size(), 0);
+  }
+
+  report.Clear();
+  reporter.add(report, "a", 10);
+  reporter.finish(report);
+  EXPECT_TRUE(report.full_sizes());
+  EXPECT_EQ(report.key_sizes_size(), 1);
+}
+
+ServerStatsReport stats_report(const string &ip, unsigned tid,
+                               const map<Key, unsigned> &counts) {
+  ServerStatsReport report;
+  report.set_public_ip(ip);
+  report.set_private_ip(ip);
+  report.set_tid(tid);
+
+  CountMinSketch sketch(128, 4);
+  for (const auto &pair : counts) {
+    KeyAccessData_KeyCount *tp = report.add_hot_keys();
+    tp->set_key(pair.first);
+    tp->set_access_count(pair.second);
+    sketch.add(pair.first, pair.second);
+
+    report.set_accessed_keys(report.accessed_keys() + 1);
+    report.set_access_total(report.access_total() + pair.second);
+  }
+
+  report.set_sketch_width(sketch.width());
+  for (uint32_t counter : sketch.counts()) {
+    report.add_sketch(counter);
+  }
+
+  return report;
+}
+
+TEST(StatsReportTest, AggregatesIncrementally) {
+  AccessAggregate access;
+  auto now = std::chrono::steady_clock::now();
+
+  access.apply(stats_report("1.1.1.1", 0, {{"a", 3}, {"b", 1}}), now);
+  access.apply(stats_report("2.2.2.2", 0, {{"a", 2}}), now);
+  EXPECT_EQ(access.sources(), 2);
+  EXPECT_TRUE(access.sketched());
+  EXPECT_EQ(access.hot().at("a"), 5);
+  EXPECT_EQ(access.total(), 6);
+  EXPECT_GE(access.estimate("a"), 5);
+
+  // a thread's new report replaces its previous one
+  access.apply(stats_report("1.1.1.1", 0, {{"a", 1}}), now);
+  EXPECT_EQ(access.sources(), 2);
+  EXPECT_EQ(access.hot().at("a"), 3);
+  EXPECT_EQ(access.hot().count("b"), 0);
+  EXPECT_EQ(access.estimate("b"), 0);
+  EXPECT_EQ(access.total(), 3);
+
+  access.remove("2.2.2.2/2.2.2.2");
+  EXPECT_EQ(access.sources(), 1);
+  EXPECT_EQ(access.hot().at("a"), 1);
+
+  auto expired = access.expire(now + std::chrono::seconds(1));
+  EXPECT_EQ(expired.size(), 1);
+  EXPECT_EQ(expired[0].first, "1.1.1.1/1.1.1.1");
+  EXPECT_EQ(access.sources(), 0);
+  EXPECT_EQ(access.hot().size(), 0);
+  EXPECT_EQ(access.total(), 0);
+}
+
+TEST(StatsReportTest, FindsHeavyHitters) {
+  AccessAggregate access;
+  auto now = std::chrono::steady_clock::now();
+
+  access.apply(stats_report("1.1.1.1", 0, {{"a", 9}, {"b", 4}, {"c", 1}}),
+               now);
+  access.apply(stats_report("2.2.2.2", 0, {{"b", 6}, {"d", 2}}), now);
+
+  vector<HeavyHitter> hitters = access.heavy_hitters(2);
+  EXPECT_EQ(hitters.size(), 2);
+  EXPECT_EQ(hitters[0].key, "b");
+  EXPECT_EQ(hitters[0].count, 10);
+  EXPECT_EQ(hitters[1].key, "a");
+  EXPECT_EQ(hitters[1].count, 9);
+
+  for (const HeavyHitter &hitter : hitters) {
+    EXPECT_GE(hitter.bound, hitter.count);
+  }
+
+  EXPECT_EQ(access.heavy_hitters(10).size(), 4);
+  EXPECT_EQ(access.heavy_hitters(0).size(), 0);
+}
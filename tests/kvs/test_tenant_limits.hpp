@@ -0,0 +1,118 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+TEST_F(ServerHandlerTest, TenantRequestsDrawFromTheirOwnBucket) {
+  TenantQuota limited;
+  limited.rate = 2;
+  TenantLimits tenants('/', TenantQuota(), {{"noisy", limited}});
+
+  auto start = std::chrono::steady_clock::now();
+  tenants.set_time(start);
+
+  EXPECT_TRUE(tenants.admit("noisy/a", false, stored_key_map));
+  EXPECT_TRUE(tenants.admit("noisy/b", false, stored_key_map));
+  EXPECT_FALSE(tenants.admit("noisy/a", false, stored_key_map));
+
+  // other tenants, and keys without a tenant, are not held back
+  EXPECT_TRUE(tenants.admit("quiet/a", false, stored_key_map));
+  EXPECT_TRUE(tenants.admit("plain", false, stored_key_map));
+
+  // the bucket refills at the tenant's rate
+  tenants.set_time(start + std::chrono::milliseconds(500));
+  EXPECT_TRUE(tenants.admit("noisy/a", false, stored_key_map));
+  EXPECT_FALSE(tenants.admit("noisy/a", false, stored_key_map));
+
+  ServerStatsReport report;
+  tenants.fill(report, stored_key_map);
+  ASSERT_EQ(report.tenants_size(), 3);
+
+  map<string, TenantUsage> usage;
+  for (const TenantUsage &tenant : report.tenants()) {
+    usage[tenant.tenant()] = tenant;
+  }
+
+  EXPECT_EQ(usage["noisy"].access_count(), 5);
+  EXPECT_EQ(usage["noisy"].rejected_count(), 2);
+  EXPECT_EQ(usage["quiet"].access_count(), 1);
+  EXPECT_EQ(usage[""].access_count(), 1);
+
+  // the counts start over, and tenants with no keys and no requests are
+  // left out
+  report.Clear();
+  tenants.fill(report, stored_key_map);
+  EXPECT_EQ(report.tenants_size(), 0);
+}
+
+TEST_F(ServerHandlerTest, TenantWritesStopAtTheirMemoryQuota) {
+  stored_key_map.track_tenants('/');
+
+  process_put("big/a", LatticeType::LWW, serialize(0, "value"),
+              serializers[LatticeType::LWW], stored_key_map);
+  unsigned size = stored_key_map["big/a"].size_;
+  EXPECT_EQ(stored_key_map.tenant_bytes("big"), size);
+
+  TenantQuota quota;
+  quota.memory = 2 * size;
+  TenantLimits tenants('/', quota);
+
+  EXPECT_TRUE(tenants.admit("big/b", true, stored_key_map));
+  process_put("big/b", LatticeType::LWW, serialize(0, "value"),
+              serializers[LatticeType::LWW], stored_key_map);
+  EXPECT_EQ(stored_key_map.tenant_bytes("big"), 2 * size);
+
+  // reads go on, and so do the writes of other tenants
+  EXPECT_FALSE(tenants.admit("big/c", true, stored_key_map));
+  EXPECT_TRUE(tenants.admit("big/a", false, stored_key_map));
+  EXPECT_TRUE(tenants.admit("small/a", true, stored_key_map));
+
+  stored_key_map.erase("big/a");
+  EXPECT_EQ(stored_key_map.tenant_bytes("big"), size);
+  EXPECT_TRUE(tenants.admit("big/c", true, stored_key_map));
+}
+
+TEST_F(ServerHandlerTest, UserRequestRefusesTenantOverItsRate) {
+  TenantQuota quota;
+  quota.rate = 1;
+  TenantLimits tenants('/', quota);
+  tenants.set_time(std::chrono::steady_clock::now());
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  for (unsigned i = 0; i < 2; i++) {
+    string put_request = put_key_request(
+        "tenant/key", LatticeType::LWW, serialize(0, "value"), ip);
+    user_request_handler(access_count, seed, put_request, log_,
+                         global_hash_rings, local_hash_rings, pending_requests,
+                         key_access_tracker, stored_key_map,
+                         key_replication_map, local_changeset, wt, serializers,
+                         pushers, batcher, buffers, false, nullptr, nullptr,
+                         &tenants);
+  }
+
+  vector<string> messages = get_zmq_messages();
+  ASSERT_EQ(messages.size(), 2);
+
+  KeyResponse response;
+  response.ParseFromString(messages[0]);
+  EXPECT_EQ(response.tuples(0).error(), AnnaError::NO_ERROR);
+
+  response.ParseFromString(messages[1]);
+  EXPECT_EQ(response.tuples(0).error(), kOverloadedError);
+
+  EXPECT_EQ(access_count, 1);
+  EXPECT_EQ(local_changeset.size(), 1);
+}
@@ -0,0 +1,72 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "monitor/tiering_plan.hpp"
+
+TEST(TieringPlanTest, PromotesDensestKeysFirst) {
+  // a large lukewarm key and two small hot ones, with room for 300 bytes
+  vector<TieringCandidate> disk_keys = {
+      {"large", 50, 1000}, {"small_1", 20, 100}, {"small_2", 30, 100}};
+
+  TieringPlan plan = plan_tiering(disk_keys, {}, 300, 0, 10);
+  EXPECT_EQ(plan.promote, vector<Key>({"small_2", "small_1"}));
+  EXPECT_EQ(plan.promoted_bytes, 200);
+  EXPECT_EQ(plan.unplaced_bytes, 1000);
+  EXPECT_EQ(plan.evict.size(), 0);
+
+  // a key that does not fit does not keep smaller ones out
+  disk_keys.push_back({"huge", 100000, 400});
+  plan = plan_tiering(disk_keys, {}, 300, 0, 10);
+  EXPECT_EQ(plan.promote, vector<Key>({"small_2", "small_1"}));
+  EXPECT_EQ(plan.unplaced_bytes, 1400);
+}
+
+TEST(TieringPlanTest, EvictsSparseKeysForDenseOnes) {
+  vector<TieringCandidate> disk_keys = {{"hot", 100, 100}};
+  vector<TieringCandidate> memory_keys = {
+      {"lukewarm", 40, 100}, {"sparse_1", 1, 60}, {"sparse_2", 2, 60}};
+
+  TieringPlan plan = plan_tiering(disk_keys, memory_keys, 0, 1000, 10);
+  EXPECT_EQ(plan.promote, vector<Key>({"hot"}));
+  EXPECT_EQ(plan.evict, vector<Key>({"sparse_1", "sparse_2"}));
+  EXPECT_EQ(plan.evicted_bytes, 120);
+
+  // keys of similar density stay where they are
+  disk_keys = {{"warm", 50, 100}};
+  plan = plan_tiering(disk_keys, {{"lukewarm", 40, 100}}, 0, 1000, 10);
+  EXPECT_EQ(plan.promote.size(), 0);
+  EXPECT_EQ(plan.evict.size(), 0);
+  EXPECT_EQ(plan.unplaced_bytes, 100);
+
+  // evictions need room on EBS
+  plan = plan_tiering({{"hot", 100, 100}}, memory_keys, 0, 100, 10);
+  EXPECT_EQ(plan.promote.size(), 0);
+}
+
+TEST(TieringPlanTest, LimitsMovesPerRound) {
+  vector<TieringCandidate> disk_keys;
+  for (unsigned i = 0; i < 10; i++) {
+    disk_keys.push_back({"key_" + std::to_string(i), i + 1, 10});
+  }
+
+  TieringPlan plan = plan_tiering(disk_keys, {}, 1000, 0, 3);
+  EXPECT_EQ(plan.promote, vector<Key>({"key_9", "key_8", "key_7"}));
+  EXPECT_EQ(plan.unplaced_bytes, 0);
+
+  // a promotion that needs more evictions than the round allows waits
+  plan = plan_tiering({{"hot", 100, 100}},
+                      {{"sparse_1", 1, 50}, {"sparse_2", 1, 50}}, 0, 1000, 2);
+  EXPECT_EQ(plan.promote.size(), 0);
+  EXPECT_EQ(plan.evict.size(), 0);
+}
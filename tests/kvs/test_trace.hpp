@@ -0,0 +1,88 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <sstream>
+
+#include "spdlog/sinks/ostream_sink.h"
+#include "trace.hpp"
+
+TEST(TraceTest, ContextRoundTrip) {
+  KeyRequest request;
+  request.set_type(RequestType::PUT);
+  request.set_request_id("id");
+  request.set_response_address("tcp://127.0.0.1:6460");
+  request.add_tuples()->set_key("key");
+
+  string serialized;
+  request.SerializeToString(&serialized);
+  EXPECT_FALSE(read_trace(serialized).sampled());
+
+  write_trace(7, 9, serialized);
+  Trace trace = read_trace(serialized);
+  EXPECT_EQ(trace.trace_id, 7);
+  EXPECT_EQ(trace.parent_span_id, 9);
+  EXPECT_GT(trace.sent, 0);
+
+  // nodes that do not trace still read the request
+  KeyRequest received;
+  EXPECT_TRUE(received.ParseFromString(serialized));
+  EXPECT_EQ(received.request_id(), "id");
+  EXPECT_EQ(received.response_address(), request.response_address());
+  EXPECT_EQ(received.tuples(0).key(), "key");
+}
+
+TEST(TraceTest, SamplesFraction) {
+  std::ostringstream out;
+  auto sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(out);
+  unsigned seed = 0;
+
+  Tracer none(0, "anna-kvs", "127.0.0.1",
+              std::make_shared<spdlog::logger>("none", sink));
+  Trace trace;
+  EXPECT_FALSE(none.sample(trace, seed));
+
+  // a request that arrives traced stays traced
+  trace.trace_id = 1;
+  EXPECT_TRUE(none.sample(trace, seed));
+
+  Tracer all(1, "anna-kvs", "127.0.0.1",
+             std::make_shared<spdlog::logger>("all", sink));
+  Trace started;
+  EXPECT_TRUE(all.sample(started, seed));
+  EXPECT_NE(started.trace_id, 0);
+  EXPECT_EQ(started.parent_span_id, 0);
+}
+
+TEST(TraceTest, RecordsZipkinSpans) {
+  std::ostringstream out;
+  auto log = std::make_shared<spdlog::logger>(
+      "spans", std::make_shared<spdlog::sinks::ostream_sink_mt>(out));
+  log->set_pattern("%v");
+
+  Trace trace;
+  trace.trace_id = 0xab;
+  trace.parent_span_id = 0xcd;
+
+  Tracer tracer(1, "anna-kvs", "127.0.0.1", log);
+  tracer.record(trace, 0xef, "kvs.request", 100, 150, {{120, "dequeue"}},
+                {{"key", "a\"b"}});
+
+  EXPECT_EQ(out.str(),
+            "{\"traceId\":\"00000000000000ab\",\"id\":\"00000000000000ef\","
+            "\"parentId\":\"00000000000000cd\",\"name\":\"kvs.request\","
+            "\"kind\":\"SERVER\",\"timestamp\":100,\"duration\":50,"
+            "\"localEndpoint\":{\"serviceName\":\"anna-kvs\","
+            "\"ipv4\":\"127.0.0.1\"},\"annotations\":[{\"timestamp\":120,"
+            "\"value\":\"dequeue\"}],\"tags\":{\"key\":\"a\\\"b\"}}\n");
+}
@@ -30,7 +30,7 @@ TEST_F(ServerHandlerTest, UserGetLWWTest) {
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -49,7 +49,7 @@ TEST_F(ServerHandlerTest, UserGetLWWTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserGetSetTest) {
@@ -71,7 +71,7 @@ TEST_F(ServerHandlerTest, UserGetSetTest) {
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -90,7 +90,7 @@ TEST_F(ServerHandlerTest, UserGetSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserGetOrderedSetTest) {
@@ -113,7 +113,7 @@ TEST_F(ServerHandlerTest, UserGetOrderedSetTest) {
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -132,7 +132,7 @@ TEST_F(ServerHandlerTest, UserGetOrderedSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserGetCausalTest) {
@@ -158,7 +158,7 @@ TEST_F(ServerHandlerTest, UserGetCausalTest) {
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -207,7 +207,7 @@ TEST_F(ServerHandlerTest, UserGetCausalTest) {
 
   EXPECT_EQ(local_changeset.size(), 0);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
@@ -224,7 +224,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -242,14 +242,14 @@ TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -267,7 +267,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetLWWTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
@@ -287,7 +287,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -305,14 +305,14 @@ TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -330,7 +330,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
@@ -350,7 +350,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -368,14 +368,14 @@ TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -393,7 +393,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetOrderedSetTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
@@ -416,7 +416,7 @@ TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
   user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   vector<string> messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 1);
@@ -434,14 +434,14 @@ TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 1);
-  EXPECT_EQ(key_access_tracker[key].size(), 1);
+  EXPECT_EQ(key_access_tracker.count(key), 1);
 
   string get_request = get_key_request(key, ip);
 
   user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
                        local_hash_rings, pending_requests, key_access_tracker,
                        stored_key_map, key_replication_map, local_changeset, wt,
-                       serializers, pushers);
+                       serializers, pushers, batcher, buffers);
 
   messages = get_zmq_messages();
   EXPECT_EQ(messages.size(), 2);
@@ -489,9 +489,125 @@ TEST_F(ServerHandlerTest, UserPutAndGetCausalTest) {
 
   EXPECT_EQ(local_changeset.size(), 1);
   EXPECT_EQ(access_count, 2);
-  EXPECT_EQ(key_access_tracker[key].size(), 2);
+  EXPECT_EQ(key_access_tracker.count(key), 2);
 }
 
 // TODO: Test key address cache invalidation
 // TODO: Test replication factor request and making the request pending
 // TODO: Test metadata operations -- does this matter?
+
+TEST_F(ServerHandlerTest, UserRequestReusesBuffers) {
+  vector<Key> keys = {"key0", "key1", "key2"};
+  for (const Key &key : keys) {
+    serializers[LatticeType::LWW]->put(key, serialize(0, key));
+    stored_key_map[key].type_ = LatticeType::LWW;
+  }
+
+  KeyRequest request;
+  request.set_type(RequestType::GET);
+  request.set_response_address(UserThread(ip, 0).response_connect_address());
+  request.set_request_id(kRequestId);
+
+  for (const Key &key : keys) {
+    request.add_tuples()->set_key(key);
+  }
+
+  string batch_request;
+  request.SerializeToString(&batch_request);
+  string get_request = get_key_request("key1", ip);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  user_request_handler(access_count, seed, batch_request, log_,
+                       global_hash_rings, local_hash_rings, pending_requests,
+                       key_access_tracker, stored_key_map, key_replication_map,
+                       local_changeset, wt, serializers, pushers, batcher,
+                       buffers);
+  user_request_handler(access_count, seed, get_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, key_replication_map, local_changeset, wt,
+                       serializers, pushers, batcher, buffers);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+
+  KeyResponse response;
+  response.ParseFromString(messages[0]);
+  EXPECT_EQ(response.tuples().size(), 3);
+
+  // nothing from the larger first request is left in the reused messages
+  response.ParseFromString(messages[1]);
+  EXPECT_EQ(response.tuples().size(), 1);
+  EXPECT_EQ(response.tuples(0).key(), "key1");
+  EXPECT_EQ(response.tuples(0).payload(), serialize(0, string("key1")));
+  EXPECT_EQ(access_count, 4);
+}
+
+TEST_F(ServerHandlerTest, UserPutChecksTypeOfKeyWrittenInSameRequest) {
+  Key key = "key";
+  KeyRequest request;
+  request.set_type(RequestType::PUT);
+  request.set_response_address(UserThread(ip, 0).response_connect_address());
+  request.set_request_id(kRequestId);
+
+  KeyTuple *tp = request.add_tuples();
+  tp->set_key(key);
+  tp->set_lattice_type(LatticeType::LWW);
+  tp->set_payload(serialize(0, string("value")));
+
+  // the key is not stored when the request arrives, but the first tuple
+  // writes it before the second is processed
+  tp = request.add_tuples();
+  tp->set_key(key);
+  tp->set_lattice_type(LatticeType::SET);
+  tp->set_payload(serialize(SetLattice<string>({"value"})));
+
+  string put_request;
+  request.SerializeToString(&put_request);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, key_replication_map, local_changeset, wt,
+                       serializers, pushers, batcher, buffers);
+
+  EXPECT_EQ(stored_key_map[key].type_, LatticeType::LWW);
+  EXPECT_TRUE(stored_key_map[key].referenced_);
+  EXPECT_EQ(stored_key_map.indexed(), 1);
+  EXPECT_EQ(local_changeset.size(), 1);
+  EXPECT_EQ(access_count, 2);
+
+  AnnaError error = AnnaError::NO_ERROR;
+  EXPECT_EQ(serializers[LatticeType::LWW]->get(key, error),
+            serialize(0, string("value")));
+}
+
+TEST_F(ServerHandlerTest, UserPutWithoutLatticeTypeStoresNothing) {
+  Key key = "key";
+  KeyRequest request;
+  request.set_type(RequestType::PUT);
+  request.set_response_address(UserThread(ip, 0).response_connect_address());
+  request.set_request_id(kRequestId);
+
+  KeyTuple *tp = request.add_tuples();
+  tp->set_key(key);
+  tp->set_payload(serialize(0, string("value")));
+
+  string put_request;
+  request.SerializeToString(&put_request);
+
+  unsigned access_count = 0;
+  unsigned seed = 0;
+
+  user_request_handler(access_count, seed, put_request, log_, global_hash_rings,
+                       local_hash_rings, pending_requests, key_access_tracker,
+                       stored_key_map, key_replication_map, local_changeset, wt,
+                       serializers, pushers, batcher, buffers);
+
+  // the refused PUT leaves no entry behind for the key
+  EXPECT_TRUE(stored_key_map.find(key) == stored_key_map.end());
+  EXPECT_EQ(local_changeset.size(), 0);
+}
@@ -0,0 +1,144 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/kvs_handlers.hpp"
+
+// a JSON-like value of about size bytes
+string json_value(unsigned size) {
+  string value = "[";
+  for (unsigned i = 0; value.size() < size; i++) {
+    value += "{\"id\": " + std::to_string(i) + ", \"tags\": [\"a\", \"b\"]},";
+  }
+
+  return value;
+}
+
+TEST(ValueCompressionTest, RoundTrip) {
+  string value = json_value(8192);
+  string framed;
+  EXPECT_TRUE(compress_value(value, 4096, framed));
+  EXPECT_TRUE(is_compressed(framed));
+  EXPECT_LT(framed.size(), value.size() / 3);
+
+  string original;
+  EXPECT_TRUE(decompress_value(framed, original));
+  EXPECT_EQ(original, value);
+
+  // short values, and values that do not shrink, are stored as they are
+  EXPECT_FALSE(compress_value("value", 4096, framed));
+  EXPECT_FALSE(compress_value("abcdefghijklmnop", 1, framed));
+
+  // a value that looks framed is always framed, so it is read back intact
+  string lookalike = string(kCompressedMagic, 4) + "abcd";
+  EXPECT_TRUE(compress_value(lookalike, 4096, framed));
+  EXPECT_TRUE(decompress_value(framed, original));
+  EXPECT_EQ(original, lookalike);
+
+  // a block that runs past its original size is rejected
+  framed[4] -= 1;
+  EXPECT_FALSE(decompress_value(framed, original));
+
+  // so is a frame whose size its block could never produce, before anything
+  // is allocated for it
+  EXPECT_FALSE(decompress_value(lookalike, original));
+}
+
+TEST_F(ServerHandlerTest, CompressedLWWLookalikeValues) {
+  Serializer *plain = serializers[LatticeType::LWW];
+  CompressedLWWSerializer compressed(plain, 4096);
+  serializers[LatticeType::LWW] = &compressed;
+
+  // a client value that looks like a frame is framed as it arrives, and
+  // stored and read back as the client wrote it
+  Key key = "key";
+  string lookalike = string(kCompressedMagic, 4) + "abcd";
+  string framed;
+  const string &payload =
+      frame_client_payload(LatticeType::LWW, serialize(1, lookalike), framed);
+  EXPECT_EQ(&payload, &framed);
+
+  serializers[LatticeType::LWW]->put(key, payload);
+  AnnaError error = AnnaError::NO_ERROR;
+  string stored = serializers[LatticeType::LWW]->get(key, error);
+  decompress_payload(LatticeType::LWW, &stored, log_);
+  EXPECT_EQ(deserialize_lww(stored).reveal().value, lookalike);
+
+  // the same through a client PUT and GET
+  unsigned access_count = 0;
+  unsigned seed = 0;
+  string put_request = put_key_request("other", LatticeType::LWW,
+                                       serialize(1, lookalike), ip);
+  user_request_handler(access_count, seed, put_request, log_,
+                       global_hash_rings, local_hash_rings, pending_requests,
+                       key_access_tracker, stored_key_map, key_replication_map,
+                       local_changeset, wt, serializers, pushers, batcher,
+                       buffers);
+  user_request_handler(access_count, seed, get_key_request("other", ip), log_,
+                       global_hash_rings, local_hash_rings, pending_requests,
+                       key_access_tracker, stored_key_map, key_replication_map,
+                       local_changeset, wt, serializers, pushers, batcher,
+                       buffers);
+
+  vector<string> messages = get_zmq_messages();
+  ASSERT_EQ(messages.size(), 2);
+
+  KeyResponse response;
+  response.ParseFromString(messages[1]);
+  EXPECT_EQ(response.tuples(0).payload(), serialize(1, lookalike));
+
+  // other values are left as they are
+  string value = serialize(1, "value");
+  EXPECT_EQ(&frame_client_payload(LatticeType::LWW, value, framed), &value);
+
+  serializers[LatticeType::LWW] = plain;
+}
+
+TEST_F(ServerHandlerTest, CompressedLWWValues) {
+  Serializer *plain = serializers[LatticeType::LWW];
+  CompressedLWWSerializer compressed(plain, 4096);
+  serializers[LatticeType::LWW] = &compressed;
+
+  Key key = "key";
+  string value = json_value(8192);
+  process_put(key, LatticeType::LWW, serialize(1, value),
+              serializers[LatticeType::LWW], stored_key_map);
+
+  // the value is stored compressed, and an older write leaves it in place
+  // without being decompressed
+  EXPECT_LT(stored_key_map[key].size_, value.size());
+  process_put(key, LatticeType::LWW, serialize(0, json_value(4096)),
+              serializers[LatticeType::LWW], stored_key_map);
+
+  AnnaError error = AnnaError::NO_ERROR;
+  string payload = serializers[LatticeType::LWW]->get(key, error);
+  EXPECT_TRUE(is_compressed(deserialize_lww(payload).reveal().value));
+
+  // clients are sent the original value
+  unsigned access_count = 0;
+  unsigned seed = 0;
+  user_request_handler(access_count, seed, get_key_request(key, ip), log_,
+                       global_hash_rings, local_hash_rings, pending_requests,
+                       key_access_tracker, stored_key_map, key_replication_map,
+                       local_changeset, wt, serializers, pushers, batcher,
+                       buffers);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 1);
+
+  KeyResponse response;
+  response.ParseFromString(messages[0]);
+  EXPECT_EQ(response.tuples(0).payload(), serialize(1, value));
+
+  serializers[LatticeType::LWW] = plain;
+}
@@ -0,0 +1,115 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "benchmark/workload.hpp"
+
+vector<string> workload_fields(const vector<string> &options) {
+  vector<string> fields = {"WORKLOAD"};
+  fields.insert(fields.end(), options.begin(), options.end());
+  return fields;
+}
+
+TEST(WorkloadTest, Presets) {
+  Workload workload;
+  string error;
+
+  EXPECT_TRUE(parse_workload(workload_fields({"preset=B", "keys=1000"}),
+                             workload, error));
+  EXPECT_EQ(workload.read, 0.95);
+  EXPECT_EQ(workload.update, 0.05);
+  EXPECT_EQ(workload.keys, 1000);
+  EXPECT_EQ(workload.key_distribution, KeyDistribution::ZIPFIAN);
+
+  // options override the preset wherever they appear
+  EXPECT_TRUE(parse_workload(workload_fields({"read=9", "insert=1",
+                                              "preset=D"}),
+                             workload, error));
+  EXPECT_DOUBLE_EQ(workload.read, 0.9);
+  EXPECT_DOUBLE_EQ(workload.insert, 0.1);
+  EXPECT_EQ(workload.update, 0);
+  EXPECT_EQ(workload.key_distribution, KeyDistribution::LATEST);
+
+  EXPECT_FALSE(parse_workload(workload_fields({"preset=E"}), workload, error));
+  EXPECT_FALSE(parse_workload(workload_fields({"read=x"}), workload, error));
+  EXPECT_FALSE(parse_workload(workload_fields({"dist=hotspot,2,0.5"}),
+                              workload, error));
+  EXPECT_FALSE(parse_workload(workload_fields({"size=1"}), workload, error));
+}
+
+TEST(WorkloadTest, MixAndDistributions) {
+  Workload workload;
+  string error;
+
+  EXPECT_TRUE(parse_workload(
+      workload_fields({"read=0.9", "update=0.1", "dist=hotspot,0.1,0.9",
+                       "value=pareto,100,1.2,10000", "lattice=set"}),
+      workload, error));
+  EXPECT_EQ(workload.lattice, WorkloadLattice::SET);
+
+  KeyChooser chooser(workload);
+  unsigned seed = 7;
+  unsigned reads = 0;
+  unsigned hot = 0;
+  double sizes = 0;
+  const unsigned samples = 100000;
+
+  for (unsigned i = 0; i < samples; i++) {
+    if (workload.next_operation(seed) == Operation::READ) {
+      reads += 1;
+    }
+
+    unsigned long long key = chooser.next(seed, 0);
+    ASSERT_GE(key, 1);
+    ASSERT_LE(key, workload.keys);
+    if (key <= workload.keys / 10) {
+      hot += 1;
+    }
+
+    unsigned size = workload.value_size(seed);
+    ASSERT_GE(size, 100);
+    ASSERT_LE(size, 10000);
+    sizes += size;
+  }
+
+  EXPECT_NEAR(reads, samples * 0.9, samples * 0.01);
+  EXPECT_NEAR(hot, samples * 0.9, samples * 0.01);
+  // a Pareto distribution with shape 1.2 has a mean six times its minimum;
+  // the cap at 10000 pulls it down
+  EXPECT_GT(sizes / samples, 300);
+  EXPECT_LT(sizes / samples, 600);
+}
+
+TEST(WorkloadTest, LatestFavorsNewKeys) {
+  Workload workload;
+  string error;
+
+  EXPECT_TRUE(parse_workload(workload_fields({"keys=100", "dist=latest"}),
+                             workload, error));
+
+  KeyChooser chooser(workload);
+  unsigned seed = 3;
+  unsigned newest = 0;
+
+  for (unsigned i = 0; i < 10000; i++) {
+    unsigned long long key = chooser.next(seed, 50);
+    ASSERT_GE(key, 51);
+    ASSERT_LE(key, 150);
+    if (key == 150) {
+      newest += 1;
+    }
+  }
+
+  // 1 / H(100, 0.99) of the draws, about 19%
+  EXPECT_GT(newest, 1500);
+}
@@ -0,0 +1,121 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+
+#include <unistd.h>
+
+#include "benchmark/replay.hpp"
+
+TEST(WorkloadCaptureTest, EncodesRequests) {
+  CapturedRequest get;
+  get.type = RequestType::GET;
+  get.tuples.push_back({capture_key_hash("a"), LatticeType::NONE, 0});
+
+  CapturedRequest put;
+  put.type = RequestType::PUT;
+  put.tuples.push_back({capture_key_hash("b"), LatticeType::LWW, 300});
+  put.tuples.push_back({1ULL << 63, LatticeType::SET, 5});
+
+  string data;
+  encode_captured_request(7, get, data);
+  encode_captured_request(200000, put, data);
+
+  CapturedRequest decoded;
+  decoded.time = 0;
+  std::size_t pos = 0;
+
+  EXPECT_TRUE(decode_captured_request(data, pos, decoded));
+  EXPECT_EQ(decoded.time, 7);
+  EXPECT_EQ(decoded.type, RequestType::GET);
+  EXPECT_EQ(decoded.tuples.size(), 1);
+  EXPECT_EQ(decoded.tuples[0].key_hash, capture_key_hash("a"));
+
+  // a record cut short is left for when the rest has been read
+  char last = data.back();
+  data.pop_back();
+  EXPECT_FALSE(decode_captured_request(data, pos, decoded));
+  EXPECT_EQ(decoded.time, 7);
+  data.push_back(last);
+
+  EXPECT_TRUE(decode_captured_request(data, pos, decoded));
+  EXPECT_EQ(pos, data.size());
+  EXPECT_EQ(decoded.time, 200007);
+  EXPECT_EQ(decoded.type, RequestType::PUT);
+  EXPECT_EQ(decoded.tuples.size(), 2);
+  EXPECT_EQ(decoded.tuples[0].lattice_type, LatticeType::LWW);
+  EXPECT_EQ(decoded.tuples[0].size, 300);
+  EXPECT_EQ(decoded.tuples[1].key_hash, 1ULL << 63);
+}
+
+TEST(WorkloadCaptureTest, RecordsSampledKeysToFile) {
+  string path = "workload_capture_test.bin";
+
+  KeyRequest request;
+  request.set_type(RequestType::PUT);
+  for (unsigned i = 0; i < 100; i++) {
+    KeyTuple *tp = request.add_tuples();
+    tp->set_key("key_" + std::to_string(i));
+    tp->set_lattice_type(LatticeType::LWW);
+    tp->set_payload(string(i, 'a'));
+  }
+
+  unsigned sampled = 0;
+  {
+    WorkloadRecorder recorder(path, 0.5);
+    EXPECT_TRUE(recorder.open());
+
+    for (const KeyTuple &tuple : request.tuples()) {
+      sampled += recorder.sampled(capture_key_hash(tuple.key()));
+    }
+
+    recorder.record(request);
+    recorder.record(request);
+  }
+
+  EXPECT_GT(sampled, 0);
+  EXPECT_LT(sampled, 100);
+
+  CaptureMerger capture;
+  EXPECT_TRUE(capture.add(path));
+
+  CapturedRequest captured;
+  uint64_t first, second;
+  EXPECT_TRUE(capture.next(captured, first));
+  EXPECT_EQ(captured.type, RequestType::PUT);
+  EXPECT_EQ(captured.tuples.size(), sampled);
+  EXPECT_TRUE(capture.next(captured, second));
+  EXPECT_GE(second, first);
+  EXPECT_FALSE(capture.next(captured, second));
+
+  unlink(path.c_str());
+}
+
+TEST(WorkloadCaptureTest, ParsesReplay) {
+  Replay replay;
+  string error;
+
+  EXPECT_TRUE(parse_replay({"REPLAY", "files=a.bin,b.bin", "speed=0.5"},
+                           replay, error));
+  EXPECT_EQ(replay.files, vector<string>({"a.bin", "b.bin"}));
+  EXPECT_EQ(replay.speed, 0.5);
+
+  Replay other;
+  EXPECT_FALSE(parse_replay({"REPLAY", "speed=2"}, other, error));
+  EXPECT_FALSE(parse_replay({"REPLAY", "files=a.bin", "speed=0"}, other,
+                            error));
+  EXPECT_FALSE(parse_replay({"REPLAY", "files=a.bin", "outstanding=x"},
+                            other, error));
+
+  EXPECT_EQ(replay_key(255), "replay_00000000000000ff");
+}
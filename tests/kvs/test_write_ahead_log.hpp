@@ -0,0 +1,117 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "kvs/server_utils.hpp"
+
+const string kWalTestDir = "write_ahead_log_test";
+
+// the records a log replays in order, as (key, payload) pairs; tombstones
+// replay as "removed"
+vector<std::pair<Key, string>> replay_wal(WriteAheadLog &wal) {
+  vector<std::pair<Key, string>> records;
+  wal.recover([&](const Key &key, LatticeType type, const string &payload,
+                  bool tombstone) {
+    records.push_back(std::make_pair(key, tombstone ? "removed" : payload));
+  });
+
+  return records;
+}
+
+TEST(WriteAheadLogTest, GroupCommit) {
+  unlink((kWalTestDir + "/wal_0.log").c_str());
+  unlink((kWalTestDir + "/wal_1.log").c_str());
+
+  {
+    WriteAheadLog wal(kWalTestDir, 0, 1000000, 1 << 20);
+    replay_wal(wal);
+
+    wal.append("a", LatticeType::LWW, "1");
+    wal.append("b", LatticeType::SET, "2");
+    EXPECT_FALSE(wal.empty());
+    EXPECT_FALSE(wal.due());
+    EXPECT_GT(wal.time_until_due(), 0);
+
+    EXPECT_TRUE(wal.commit());
+    EXPECT_TRUE(wal.empty());
+
+    // a full batch is due right away
+    WriteAheadLog small(kWalTestDir, 1, 1000000, 16);
+    small.append("key", LatticeType::LWW, string(16, 'x'));
+    EXPECT_TRUE(small.due());
+  }
+
+  // the second log was committed when it was closed, and both replay
+  WriteAheadLog wal(kWalTestDir, 0, 0, 1 << 20);
+  vector<std::pair<Key, string>> records = replay_wal(wal);
+  EXPECT_EQ(records.size(), 2);
+  EXPECT_EQ(records[1], std::make_pair(Key("b"), string("2")));
+
+  WriteAheadLog small(kWalTestDir, 1, 0, 16);
+  EXPECT_EQ(replay_wal(small).size(), 1);
+}
+
+TEST(WriteAheadLogTest, TornRecord) {
+  string path = kWalTestDir + "/wal_2.log";
+  unlink(path.c_str());
+
+  {
+    WriteAheadLog wal(kWalTestDir, 2, 0, 1 << 20);
+    replay_wal(wal);
+    wal.append("first", LatticeType::LWW, "1");
+    wal.append("second", LatticeType::LWW, "2");
+  }
+
+  struct stat st;
+  EXPECT_EQ(stat(path.c_str(), &st), 0);
+  EXPECT_EQ(truncate(path.c_str(), st.st_size - 1), 0);
+
+  // the torn record is dropped, so records appended after it replay
+  {
+    WriteAheadLog wal(kWalTestDir, 2, 0, 1 << 20);
+    EXPECT_EQ(replay_wal(wal).size(), 1);
+    wal.append("third", LatticeType::LWW, "3", true);
+  }
+
+  WriteAheadLog wal(kWalTestDir, 2, 0, 1 << 20);
+  vector<std::pair<Key, string>> records = replay_wal(wal);
+  EXPECT_EQ(records.size(), 2);
+  EXPECT_EQ(records[1], std::make_pair(Key("third"), string("removed")));
+}
+
+TEST(WriteAheadLogTest, RotateAtSnapshot) {
+  unlink((kWalTestDir + "/wal_3.log").c_str());
+  unlink((kWalTestDir + "/wal_3.old").c_str());
+
+  WriteAheadLog wal(kWalTestDir, 3, 0, 1 << 20);
+  replay_wal(wal);
+  wal.append("before", LatticeType::LWW, "1");
+  wal.rotate();
+  wal.append("during", LatticeType::LWW, "2");
+
+  // if that snapshot never finishes, the next one keeps the older log, and
+  // the current one carries on
+  wal.rotate();
+  wal.append("after", LatticeType::LWW, "3");
+  EXPECT_TRUE(wal.commit());
+
+  WriteAheadLog unfinished(kWalTestDir, 3, 0, 1 << 20);
+  EXPECT_EQ(replay_wal(unfinished).size(), 3);
+
+  // once a snapshot is finished, only the writes since it started remain
+  wal.retire();
+  WriteAheadLog finished(kWalTestDir, 3, 0, 1 << 20);
+  vector<std::pair<Key, string>> records = replay_wal(finished);
+  EXPECT_EQ(records.size(), 2);
+  EXPECT_EQ(records[0].first, "during");
+}
@@ -0,0 +1,56 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "zipf_sampler.hpp"
+
+// the observed frequency of every rank is within 10% of its probability
+void check_zipf(unsigned n, double exponent) {
+  ZipfSampler sampler(n, exponent);
+  unsigned seed = 42;
+  const unsigned samples = 200000;
+
+  vector<unsigned> counts(n + 1, 0);
+  for (unsigned i = 0; i < samples; i++) {
+    unsigned long long k = sampler.sample(seed);
+    ASSERT_GE(k, 1);
+    ASSERT_LE(k, n);
+    counts[k] += 1;
+  }
+
+  double base = 0;
+  for (unsigned k = 1; k <= n; k++) {
+    base += pow(k, -exponent);
+  }
+
+  for (unsigned k = 1; k <= n; k++) {
+    double expected = samples * pow(k, -exponent) / base;
+    EXPECT_NEAR(counts[k], expected, expected * 0.1);
+  }
+}
+
+TEST(ZipfSamplerTest, MatchesDistribution) {
+  check_zipf(10, 1);
+  check_zipf(10, 0.5);
+  check_zipf(20, 1.5);
+  check_zipf(10, 0);
+}
+
+TEST(ZipfSamplerTest, SingleRank) {
+  ZipfSampler sampler(1, 1);
+  unsigned seed = 0;
+
+  for (unsigned i = 0; i < 100; i++) {
+    EXPECT_EQ(sampler.sample(seed), 1);
+  }
+}
@@ -17,7 +17,7 @@
 ServerThreadList MockHashRingUtil::get_responsible_threads(
     Address respond_address, const Key &key, bool metadata,
     GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-    map<Key, KeyReplication> &key_replication_map, SocketCache &pushers,
+    KeyReplicationMap &key_replication_map, SocketCache &pushers,
     const vector<Tier> &tiers, bool &succeed, unsigned &seed) {
   ServerThreadList threads;
   succeed = true;
@@ -25,7 +25,7 @@ public:
   virtual ServerThreadList get_responsible_threads(
       Address respond_address, const Key &key, bool metadata,
       GlobalRingMap &global_hash_rings, LocalRingMap &local_hash_rings,
-      map<Key, KeyReplication> &key_replication_map, SocketCache &pushers,
+      KeyReplicationMap &key_replication_map, SocketCache &pushers,
       const vector<Tier> &tiers, bool &succeed, unsigned &seed);
 };
 
@@ -30,7 +30,8 @@ protected:
   unsigned thread_id = 0;
   GlobalRingMap global_hash_rings;
   LocalRingMap local_hash_rings;
-  map<Key, KeyReplication> key_replication_map;
+  KeyReplicationMap key_replication_map;
+  AddressCache address_cache;
   map<Key, vector<pair<Address, string>>> pending_requests;
   zmq::context_t context;
   SocketCache pushers = SocketCache(&context, ZMQ_PUSH);
@@ -28,7 +28,9 @@
 #include "test_membership_handler.hpp"
 #include "test_replication_change_handler.hpp"
 #include "test_replication_response_handler.hpp"
+#include "test_ring_snapshot_handler.hpp"
 #include "test_seed_handler.hpp"
+#include "test_shared_routing_state.hpp"
 
 unsigned kDefaultLocalReplication = 1;
 unsigned kDefaultGlobalMemoryReplication = 1;
@@ -44,6 +46,9 @@ unsigned kEbsThreadNum = 1;
 unsigned kMemoryThreadNum = 1;
 unsigned kRoutingThreadCount = 1;
 
+Tracer *kTracer = nullptr;
+SharedRoutingState *kSharedRoutingState = nullptr;
+
 int main(int argc, char *argv[]) {
   log_->set_level(spdlog::level::off);
   testing::InitGoogleTest(&argc, argv);
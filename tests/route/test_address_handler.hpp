@@ -28,8 +28,8 @@ TEST_F(RoutingHandlerTest, Address) {
   req.SerializeToString(&serialized);
 
   address_handler(log_, serialized, pushers, rt, global_hash_rings,
-                  local_hash_rings, key_replication_map, pending_requests,
-                  seed);
+                  local_hash_rings, key_replication_map, address_cache,
+                  pending_requests, seed);
 
   vector<string> messages = get_zmq_messages();
 
@@ -50,3 +50,41 @@ TEST_F(RoutingHandlerTest, Address) {
     }
   }
 }
+
+TEST_F(RoutingHandlerTest, AddressCached) {
+  unsigned seed = 0;
+
+  KeyAddressRequest req;
+  req.set_request_id("1");
+  req.set_response_address("tcp://127.0.0.1:5000");
+  req.add_keys("key");
+
+  string serialized;
+  req.SerializeToString(&serialized);
+
+  address_handler(log_, serialized, pushers, rt, global_hash_rings,
+                  local_hash_rings, key_replication_map, address_cache,
+                  pending_requests, seed);
+
+  EXPECT_EQ(address_cache.size(), 1);
+  const vector<Address> *cached = address_cache.find("key");
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(cached->size(), 1);
+  EXPECT_EQ((*cached)[0], "tcp://127.0.0.1:6200");
+
+  // the second lookup is answered from the cache with the same addresses
+  address_handler(log_, serialized, pushers, rt, global_hash_rings,
+                  local_hash_rings, key_replication_map, address_cache,
+                  pending_requests, seed);
+
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 2);
+  EXPECT_EQ(messages[0], messages[1]);
+
+  // a node joining invalidates every cached address
+  string join = "join:" + Tier_Name(Tier::MEMORY) + ":127.0.0.2:127.0.0.2:0";
+  membership_handler(log_, join, pushers, global_hash_rings, address_cache,
+                     thread_id, ip);
+
+  EXPECT_EQ(address_cache.size(), 0);
+}
@@ -21,8 +21,8 @@ TEST_F(RoutingHandlerTest, Membership) {
   string message_base = Tier_Name(Tier::MEMORY) + ":127.0.0.2:127.0.0.2:0";
 
   string serialized = "join:" + message_base;
-  membership_handler(log_, serialized, pushers, global_hash_rings, thread_id,
-                     ip);
+  membership_handler(log_, serialized, pushers, global_hash_rings,
+                     address_cache, thread_id, ip);
 
   vector<string> messages = get_zmq_messages();
 
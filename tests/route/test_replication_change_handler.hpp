@@ -39,7 +39,7 @@ TEST_F(RoutingHandlerTest, ReplicationChange) {
   update.SerializeToString(&serialized);
 
   replication_change_handler(log_, serialized, pushers, key_replication_map,
-                             thread_id, ip);
+                             address_cache, thread_id, ip);
 
   vector<string> messages = get_zmq_messages();
 
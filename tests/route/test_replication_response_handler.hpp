@@ -55,7 +55,7 @@ TEST_F(RoutingHandlerTest, ReplicationResponse) {
 
   replication_response_handler(log_, serialized, pushers, rt, global_hash_rings,
                                local_hash_rings, key_replication_map,
-                               pending_requests, seed);
+                               address_cache, pending_requests, seed);
 
   EXPECT_EQ(key_replication_map[key].global_replication_[Tier::MEMORY], 2);
   EXPECT_EQ(key_replication_map[key].global_replication_[Tier::DISK], 2);
@@ -0,0 +1,98 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "route/routing_handlers.hpp"
+
+TEST_F(RoutingHandlerTest, RingSnapshot) {
+  vector<string> keys = {"key0", "key1"};
+  warmup_key_replication_map_to_defaults(keys);
+  key_replication_map["key1"].global_replication_[Tier::MEMORY] = 2;
+
+  string request = "";
+  string serialized = ring_snapshot_handler(log_, request, global_hash_rings,
+                                            key_replication_map, 7);
+
+  RingSnapshot snapshot;
+  snapshot.ParseFromString(serialized);
+
+  EXPECT_EQ(snapshot.version(), 7);
+  EXPECT_FALSE(snapshot.delta());
+  EXPECT_EQ(snapshot.virtual_nodes(), kVirtualThreadNum);
+  EXPECT_EQ(snapshot.tiers_size(), (int)kAllTiers.size());
+
+  for (const RingSnapshot_TierRing &ring : snapshot.tiers()) {
+    EXPECT_EQ(ring.virtual_nodes(), virtual_node_count(ring.tier()));
+    EXPECT_EQ(ring.load_bound(), ring_load_bound());
+
+    if (ring.tier() == Tier::MEMORY) {
+      EXPECT_EQ(ring.servers_size(), 1);
+      EXPECT_EQ(ring.servers(0).public_ip(), ip);
+      EXPECT_EQ(ring.servers(0).private_ip(), ip);
+    } else {
+      EXPECT_EQ(ring.servers_size(), 0);
+    }
+  }
+
+  // only the replication factor that differs from the defaults is included
+  EXPECT_EQ(snapshot.replication_size(), 1);
+  EXPECT_EQ(snapshot.replication(0).key(), "key1");
+
+  // a client that is up to date gets an empty delta
+  request = "7";
+  serialized = ring_snapshot_handler(log_, request, global_hash_rings,
+                                     key_replication_map, 7);
+  snapshot.ParseFromString(serialized);
+
+  EXPECT_TRUE(snapshot.delta());
+  EXPECT_EQ(snapshot.tiers_size(), 0);
+  EXPECT_EQ(snapshot.replication_size(), 0);
+}
+
+TEST_F(RoutingHandlerTest, RingUpdate) {
+  vector<string> keys = {"key"};
+  warmup_key_replication_map_to_defaults(keys);
+
+  // a replication factor change only invalidates that key, and is published
+  // as a delta
+  address_cache.invalidate("key");
+  EXPECT_TRUE(address_cache.changed());
+
+  bool rings_changed;
+  set<Key> changed;
+  address_cache.take_changes(rings_changed, changed);
+  EXPECT_FALSE(address_cache.changed());
+
+  RingSnapshot update;
+  update.ParseFromString(ring_update(global_hash_rings, key_replication_map,
+                                     rings_changed, changed, 8));
+
+  EXPECT_TRUE(update.delta());
+  EXPECT_EQ(update.base_version(), 7);
+  EXPECT_EQ(update.replication_size(), 1);
+  EXPECT_EQ(update.replication(0).key(), "key");
+
+  // a membership change is published as a full snapshot
+  string join = "join:" + Tier_Name(Tier::MEMORY) + ":127.0.0.2:127.0.0.2:0";
+  membership_handler(log_, join, pushers, global_hash_rings, address_cache,
+                     thread_id, ip);
+
+  address_cache.take_changes(rings_changed, changed);
+  EXPECT_TRUE(rings_changed);
+
+  update.ParseFromString(ring_update(global_hash_rings, key_replication_map,
+                                     rings_changed, changed, 9));
+
+  EXPECT_FALSE(update.delta());
+  EXPECT_EQ(update.version(), 9);
+}
@@ -0,0 +1,111 @@
+//  Copyright 2019 U.C. Berkeley RISE Lab
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include "route/routing_handlers.hpp"
+
+TEST_F(RoutingHandlerTest, SharedRoutingStatePublishCreatesEveryTier) {
+  SharedRoutingState state;
+  state.publish(GlobalRingMap());
+
+  std::shared_ptr<GlobalRingMap> published = state.global();
+  EXPECT_EQ(published->size(), kAllTiers.size());
+
+  for (const Tier &tier : kAllTiers) {
+    EXPECT_NE(published->find(tier), published->end());
+  }
+}
+
+TEST_F(RoutingHandlerTest, SharedRoutingStateWaitsOnRequestInFlight) {
+  SharedRoutingState state;
+  Key key = "key";
+
+  EXPECT_TRUE(state.start_request(key, 0));
+  EXPECT_FALSE(state.start_request(key, 1));
+  EXPECT_FALSE(state.start_request(key, 2));
+
+  set<unsigned> waiting = state.finish_request(key);
+  EXPECT_EQ(waiting, set<unsigned>({0, 1, 2}));
+
+  // the request is forgotten once finished, so the next miss asks again
+  EXPECT_EQ(state.finish_request(key).size(), 0);
+  EXPECT_TRUE(state.start_request(key, 1));
+}
+
+TEST_F(RoutingHandlerTest, SharedRoutingStateReissuesTimedOutRequest) {
+  SharedRoutingState state(0);
+  Key key = "key";
+
+  EXPECT_TRUE(state.start_request(key, 0));
+
+  // the request in flight has timed out, so the next thread asks again, and
+  // both threads still get the response
+  EXPECT_TRUE(state.start_request(key, 1));
+  EXPECT_EQ(state.finish_request(key), set<unsigned>({0, 1}));
+}
+
+TEST_F(RoutingHandlerTest, ReplicationResponseForwardedToWaitingThreads) {
+  SharedRoutingState state;
+  kSharedRoutingState = &state;
+
+  unsigned seed = 0;
+  Key key = "key";
+
+  // thread 0 asks for the factor and thread 1 waits on its request
+  EXPECT_TRUE(share_replication(key, key_replication_map, 0));
+  KeyReplicationMap other_replication_map;
+  EXPECT_FALSE(share_replication(key, other_replication_map, 1));
+
+  KeyResponse response;
+  response.set_type(RequestType::GET);
+  KeyTuple *tp = response.add_tuples();
+  tp->set_key(get_metadata_key(key, MetadataType::replication));
+  tp->set_lattice_type(LatticeType::LWW);
+
+  ReplicationFactor rf;
+  rf.set_key(key);
+
+  for (const Tier &tier : kAllTiers) {
+    ReplicationFactor_ReplicationValue *rep_global = rf.add_global();
+    rep_global->set_tier(tier);
+    rep_global->set_value(2);
+
+    ReplicationFactor_ReplicationValue *rep_local = rf.add_local();
+    rep_local->set_tier(tier);
+    rep_local->set_value(3);
+  }
+
+  string repfactor;
+  rf.SerializeToString(&repfactor);
+  tp->set_payload(serialize(0, repfactor));
+
+  string serialized;
+  response.SerializeToString(&serialized);
+
+  replication_response_handler(log_, serialized, pushers, rt, global_hash_rings,
+                               local_hash_rings, key_replication_map,
+                               address_cache, pending_requests, seed);
+
+  // the response is passed on to thread 1 only
+  vector<string> messages = get_zmq_messages();
+  EXPECT_EQ(messages.size(), 1);
+  EXPECT_EQ(messages[0], serialized);
+  EXPECT_EQ(state.finish_request(key).size(), 0);
+
+  // and the factor is kept for the other threads
+  EXPECT_TRUE(share_replication(key, other_replication_map, 1));
+  EXPECT_EQ(other_replication_map[key].global_replication_[Tier::MEMORY], 2);
+  EXPECT_EQ(other_replication_map[key].local_replication_[Tier::MEMORY], 3);
+
+  kSharedRoutingState = nullptr;
+}